@@ -7,9 +7,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#define AST_CALL_NEED	16	//!< Register need of a call (more than any target has)
+#define AST_MAX(a,b)	((a) > (b) ? (a) : (b))
+
 // === PROTOTYPES ===
 void	AST_DumpTree(tAST_Node *Node, int Depth);
 tAST_Node	*AST_NewNode(int Type);
+void	AST_SetPosition(char *File, int Line);
 tAST_Node	*AST_AppendNode(tAST_Node *Parent, tAST_Node *Child);
 tAST_Node	*AST_NewNoOp(void);
 tAST_Node	*AST_NewCodeBlock(void);
@@ -23,9 +27,19 @@ tAST_Node	*AST_NewBinOp(int Op, tAST_Node *Left, tAST_Node *Right);
 tAST_Node	*AST_NewUniOp(int Op, tAST_Node *Value);
 tAST_Node	*AST_NewLocalVar(tSymbol *Sym);
 tAST_Node	*AST_NewString(void *Data, size_t Length);
+tAST_Node	*AST_NewBlob(const tType *Type, void *Data, size_t Length);
 tAST_Node	*AST_NewInteger(uint64_t Value);
+const tType	*AST_GetIntegerType(const tAST_Node *Node);
 tAST_Node	*AST_NewArrayIndex(tAST_Node *Var, tAST_Node *Index);
 void	AST_DeleteNode(tAST_Node *Node);
+ int	AST_RegisterNeed(tAST_Node *Node);
+bool	AST_HasSideEffects(tAST_Node *Node);
+bool	AST_EvalRightFirst(tAST_Node *Left, tAST_Node *Right);
+void	AST_int_Label(tAST_Node *Node);
+
+// === GLOBALS ===
+char	*gsAST_File;	//!< Position of the token being parsed (see AST_SetPosition)
+ int	giAST_Line;
 
 // === CODE ===
 void AST_DumpTree(tAST_Node *Node, int Depth)
@@ -51,6 +65,9 @@ void AST_DumpTree(tAST_Node *Node, int Depth)
 	case NODETYPE_SYMBOL:
 		printf("Symbol - '%s' %p\n", Node->Symbol.Name, Node->Symbol.Sym);
 		break;
+	case NODETYPE_BLOB:
+		printf("Blob - %zi bytes\n", Node->Blob.Length);
+		break;
 	
 	// --- Branches ---
 	case NODETYPE_FUNCTIONCALL:
@@ -140,10 +157,27 @@ tAST_Node *AST_NewNode(int Type)
 {
 	tAST_Node	*ret = malloc(sizeof(tAST_Node));
 	ret->Type = Type;
+	ret->File = gsAST_File;
+	if( ret->File )
+		Ref(ret->File);
+	ret->Line = giAST_Line;
 	ret->NextSibling = NULL;
+	ret->RegNeed = 0;
+	ret->bSideEffects = false;
 	return ret;
 }
 
+void AST_SetPosition(char *File, int Line)
+{
+	if( File != gsAST_File ) {
+		if( File )
+			Ref(File);
+		Deref(gsAST_File);
+		gsAST_File = File;
+	}
+	giAST_Line = Line;
+}
+
 tAST_Node *AST_AppendNode(tAST_Node *Parent, tAST_Node *Child)
 {
 	if( Child == ACC_ERRPTR )
@@ -254,6 +288,7 @@ tAST_Node *AST_NewFor(tAST_Node *Init, tAST_Node *Test, tAST_Node *Inc, tAST_Nod
 	ret->For.Test = Test;
 	ret->For.Next = Inc;
 	ret->For.Action = Code;
+	ret->For.Unroll = 0;
 	return ret;
 }
 
@@ -344,13 +379,44 @@ tAST_Node	*AST_NewString(void *Data, size_t Length)
 	return ret;
 }
 
+/**
+ * \brief Array contents evaluated at parse time (Data is owned by the node)
+ */
+tAST_Node *AST_NewBlob(const tType *Type, void *Data, size_t Length)
+{
+	tAST_Node	*ret = AST_NewNode(NODETYPE_BLOB);
+	ret->Blob.Type = Type;
+	ret->Blob.Data = Data;
+	ret->Blob.Length = Length;
+	return ret;
+}
+
 tAST_Node *AST_NewInteger(uint64_t Value)
 {
 	tAST_Node	*ret = AST_NewNode(NODETYPE_INTEGER);
 	ret->Integer.Value = Value;
+	ret->Integer.Type = NULL;
 	return ret;
 }
 
+/**
+ * \brief Get the type of an integer constant
+ *
+ * Constants created without a type (character constants, sizeof) are `int`
+ * when the value fits, otherwise `unsigned int` or `long long`.
+ */
+const tType *AST_GetIntegerType(const tAST_Node *Node)
+{
+	int64_t	val = Node->Integer.Value;
+	if( Node->Integer.Type )
+		return Node->Integer.Type;
+	if( INT32_MIN <= val && val <= INT32_MAX )
+		return Types_CreateIntegerType(true, INTSIZE_INT);
+	if( Node->Integer.Value <= UINT32_MAX )
+		return Types_CreateIntegerType(false, INTSIZE_INT);
+	return Types_CreateIntegerType(true, INTSIZE_LONGLONG);
+}
+
 tAST_Node *AST_NewArrayIndex(tAST_Node *Var, tAST_Node *Index)
 {
 	tAST_Node	*ret = AST_NewNode(NODETYPE_INDEX);
@@ -377,6 +443,7 @@ void AST_DeleteNode(tAST_Node *Node)
 	switch(Node->Type)
 	{
 	case NODETYPE_INTEGER:
+		Deref(Node->File);
 		free(Node);
 		break;
 	
@@ -385,3 +452,143 @@ void AST_DeleteNode(tAST_Node *Node)
 		exit(-1);
 	}
 }
+
+/**
+ * \brief Registers needed to evaluate an expression without spilling
+ *
+ * Sethi-Ullman (Ershov) number of the tree, leaves need one register and a
+ * binary operation needs one more than its operands only if they need the
+ * same number (otherwise the more demanding side is evaluated first, and its
+ * result held while the other side reuses the rest).
+ */
+int AST_RegisterNeed(tAST_Node *Node)
+{
+	AST_int_Label(Node);
+	return Node->RegNeed;
+}
+
+/**
+ * \brief Check if evaluating an expression can modify state
+ */
+bool AST_HasSideEffects(tAST_Node *Node)
+{
+	AST_int_Label(Node);
+	return Node->bSideEffects;
+}
+
+/**
+ * \brief Decide the evaluation order of the operands of a binary operation
+ *
+ * C leaves the order unspecified (except for &&, || and ?:, which don't use
+ * this), so the more demanding operand goes first. Operands that both have
+ * side effects are kept in source order.
+ */
+bool AST_EvalRightFirst(tAST_Node *Left, tAST_Node *Right)
+{
+	if( AST_RegisterNeed(Right) <= AST_RegisterNeed(Left) )
+		return false;
+	if( AST_HasSideEffects(Left) && AST_HasSideEffects(Right) )
+		return false;
+	return true;
+}
+
+/**
+ * \brief Fill the cached register need and side effect flag of a node
+ */
+void AST_int_Label(tAST_Node *Node)
+{
+	tAST_Node	*left = NULL, *right = NULL;
+	 int	need = 0;
+	bool	effects = false;
+	
+	if( Node->RegNeed )
+		return ;
+	
+	switch(Node->Type)
+	{
+	case NODETYPE_FLOAT:
+	case NODETYPE_INTEGER:
+	case NODETYPE_LOCALVAR:
+	case NODETYPE_SYMBOL:
+	case NODETYPE_STRING:
+	case NODETYPE_BLOB:
+		need = 1;
+		break;
+	
+	// Calls clobber every scratch register, do them before anything else is live
+	case NODETYPE_FUNCTIONCALL:
+		need = AST_CALL_NEED;
+		effects = true;
+		break;
+	
+	case NODETYPE_NEGATE:
+	case NODETYPE_BWNOT:
+	case NODETYPE_LOGICNOT:
+	case NODETYPE_DEREF:
+	case NODETYPE_ADDROF:
+		need = AST_RegisterNeed(Node->UniOp.Value);
+		effects = Node->UniOp.Value->bSideEffects;
+		break;
+	case NODETYPE_POSTINC:
+	case NODETYPE_POSTDEC:
+	case NODETYPE_PREINC:
+	case NODETYPE_PREDEC:
+		// Old and new values are both live
+		need = AST_RegisterNeed(Node->UniOp.Value) + 1;
+		effects = true;
+		break;
+	case NODETYPE_CAST:
+		need = AST_RegisterNeed(Node->Cast.Value);
+		effects = Node->Cast.Value->bSideEffects;
+		break;
+	case NODETYPE_MEMBER:
+		need = AST_RegisterNeed(Node->Member.Struct);
+		effects = Node->Member.Struct->bSideEffects;
+		break;
+	
+	case NODETYPE_ASSIGN:
+		left = Node->Assign.To;
+		right = Node->Assign.From;
+		effects = true;
+		break;
+	case NODETYPE_ASSIGNOP:
+		left = Node->AssignOp.To;
+		right = Node->AssignOp.From;
+		effects = true;
+		break;
+	case NODETYPE_INDEX:
+	case NODETYPE_ADD ... NODETYPE_GREATERTHANEQU:
+		left = Node->BinOp.Left;
+		right = Node->BinOp.Right;
+		break;
+	
+	// Sequenced, the left value is consumed by a branch before the right is evaluated
+	case NODETYPE_BOOLOR:
+	case NODETYPE_BOOLAND:
+		need = AST_MAX( AST_RegisterNeed(Node->BinOp.Left), AST_RegisterNeed(Node->BinOp.Right) );
+		effects = Node->BinOp.Left->bSideEffects || Node->BinOp.Right->bSideEffects;
+		break;
+	case NODETYPE_CONDITIONAL:
+		need = AST_MAX( AST_RegisterNeed(Node->If.Test),
+			AST_MAX(AST_RegisterNeed(Node->If.True), AST_RegisterNeed(Node->If.False)) );
+		effects = Node->If.Test->bSideEffects || Node->If.True->bSideEffects || Node->If.False->bSideEffects;
+		break;
+	
+	// Not an expression, never worth moving
+	default:
+		need = AST_CALL_NEED;
+		effects = true;
+		break;
+	}
+	
+	if( left )
+	{
+		 int	l = AST_RegisterNeed(left);
+		 int	r = AST_RegisterNeed(right);
+		need = (l == r ? l + 1 : AST_MAX(l, r));
+		effects = effects || left->bSideEffects || right->bSideEffects;
+	}
+	
+	Node->RegNeed = AST_MAX(need, 1);
+	Node->bSideEffects = effects;
+}
@@ -5,47 +5,478 @@
  * compile.c
  * - Conversion from AST to infinite register machine
  */
+#include <global.h>
 #include <ast.h>
 #include <symbol.h>
 #include <irm.h>
+#include <consteval.h>
+#include <string.h>
 #include <assert.h>
 
-#define REG_VOID	0
+#define REG_VOID	IRM_REG_VOID
+#define SPECULATE_MAX_NODES	4	//!< Size of a `&&`/`||` operand that is evaluated unconditionally
+#define SWITCH_TABLE_MIN_CASES	4	//!< Case ranges needed to use a jump table
+#define SWITCH_TABLE_MIN_DENSITY	40	//!< Percentage of jump table entries that must be cases
+#define SWITCH_TABLE_MAX_SIZE	4096
+#define SWITCH_BITTEST_BITS	32	//!< Width of a bit test mask
+#define SWITCH_BITTEST_MAX_TARGETS	3
+#define SWITCH_LINEAR_MAX	3	//!< Clusters tested one after another instead of split in two
+#define UNROLL_FULL_MAX_TRIPS	16	//!< Longest loop completely unrolled without a hint
+#define UNROLL_FULL_MAX_NODES	128	//!< Size (AST nodes) of all copies of a completely unrolled body
+#define UNROLL_MAX_FACTOR	8
+#define UNROLL_PARTIAL_MAX_NODES	64	//!< Size of all copies in a partially unrolled loop
+#define UNROLL_HINT_MAX	1024	//!< Copies a `#pragma unroll` can ask for
 
 // === IMPORTS ===
 extern void	CompileError(tAST_Node *Node, const char *format, ...);
 extern void	CompileWarning(tAST_Node *Node, const char *format, ...);
+extern void	Optimiser_ProcessIRM(tFunction *Func);
 
 // === TYPES ===
 typedef struct sCompileState	tCompileState;
+typedef struct sCompileLocal	tCompileLocal;
+typedef struct sLValue	tLValue;
 typedef tIRMReg	tReg;
 
+struct sCompileLocal
+{
+	tCompileLocal	*Next;
+	const char	*Name;
+	 int	Local;
+	tSymbol	*Global;	//!< Block scope static/extern (Local is -1)
+};
+
 struct sCompileState
 {
 	tIRMHandle	Handle;
+	tCompileState	*Parent;
+	tCompileLocal	*Locals;	//!< Variables defined in this scope
+	tIRMBlock	*BreakTarget;
+	tIRMBlock	*ContinueTarget;
+	 int	Scope;	//!< IRM scope of the locals defined here
+};
+
+//! \brief Case label range, keyed so that ranges always sort as unsigned (see Compile_int_SwitchKey)
+typedef struct sSwitchCase
+{
+	uint64_t	Lo, Hi;
+	tIRMBlock	*Target;
+	tAST_Node	*Node;
+} tSwitchCase;
+
+enum eSwitchClusterKind
+{
+	SWITCHCLUSTER_RANGE,	//!< A single case range
+	SWITCHCLUSTER_BITTEST,	//!< Masks over a small span with few destinations
+	SWITCHCLUSTER_TABLE,	//!< Jump table over a dense span
+};
+
+typedef struct sSwitchCluster
+{
+	enum eSwitchClusterKind	Kind;
+	 int	First, Last;	//!< Cases covered
+	uint64_t	Lo, Hi;
+} tSwitchCluster;
+
+typedef struct sSwitchLowering
+{
+	tReg	Value;
+	const tType	*Type;
+	unsigned int	Flags;
+	 int	Bits;
+	bool	bSigned;
+	 int	nCases;
+	tSwitchCase	*Cases;
+	 int	nClusters;
+	tSwitchCluster	*Clusters;
+	tIRMBlock	*Default;
+} tSwitchLowering;
+
+//! \brief Counted `for` loop selected for unrolling (see Compile_int_PlanUnroll)
+typedef struct sLoopInfo
+{
+	 int	Local;	//!< Induction variable
+	tAST_Node	*Bound;	//!< Loop invariant compared against
+	 int	Cmp;	//!< Comparison node type, with the variable on the left
+	const tType	*CmpType;	//!< Type of the comparison (as wide as the variable)
+	int64_t	Step;
+	 int	Cost;	//!< AST nodes in the body and increment
+	 int	Trips;	//!< Iterations if fully unrolled, -1 otherwise
+	 int	Factor;	//!< Copies of the body in a partially unrolled loop
+} tLoopInfo;
+
+//! \brief Assignable location, either a local slot or a computed address
+struct sLValue
+{
+	 int	Local;	//!< Local index, -1 if Address is used
+	tReg	Address;
+	const tType	*Type;
 };
 
 // === PROTOTYPES ===
+void	Compile_int_MarkReadOnlyGlobals(void);
+void	Compile_int_MarkDirectOnly(void);
+void	Compile_int_FindEscapes(tIRMHandle IRM);
+void	Compile_int_Escape(const tSymbol *Sym);
+bool	Compile_int_IsConstObject(const tType *Type);
+tIRMHandle	Compile_ConvertFunction(tFunction *Func);
  int	Compile_ConvertNode(tCompileState *State, tAST_Node *Node, tReg *OutReg);
-tAST_Node	*Compile_OptimiseWithValues(tCompileState *State, tAST_Node *Node);
+ int	Compile_int_ConvertStatement(tCompileState *State, tAST_Node *Node);
+ int	Compile_int_ConvertCondition(tCompileState *State, tAST_Node *Node, tIRMBlock *True, tIRMBlock *False);
+ int	Compile_int_ConvertSwitch(tCompileState *State, tAST_Node *Node);
+ int	Compile_int_SwitchCompareCases(const void *A, const void *B);
+uint64_t	Compile_int_SwitchKey(const tSwitchLowering *SW, uint64_t Value);
+tReg	Compile_int_SwitchConstant(tCompileState *State, const tSwitchLowering *SW, uint64_t Key);
+void	Compile_int_SwitchCluster(tSwitchLowering *SW);
+void	Compile_int_SwitchTree(tCompileState *State, tSwitchLowering *SW, int First, int Last, uint64_t BoundLo, uint64_t BoundHi);
+void	Compile_int_SwitchLeaf(tCompileState *State, tSwitchLowering *SW, const tSwitchCluster *C, uint64_t BoundLo, uint64_t BoundHi, tIRMBlock *Fail);
+bool	Compile_int_PlanUnroll(tCompileState *State, tAST_Node *Node, tLoopInfo *Loop);
+tAST_Node	*Compile_int_LoopStep(tAST_Node *Next, int64_t *Step);
+bool	Compile_int_IsNamed(tAST_Node *Node, const char *Name);
+ int	Compile_int_LoopBodyCost(tAST_Node *Node, const char *Var, const char *Bound);
+ int	Compile_int_LoopTripCount(const tLoopInfo *Loop, const tType *VarType, uint64_t Start, uint64_t End, int Limit);
+ int	Compile_int_ConvertUnrolledFor(tCompileState *State, tAST_Node *Node, const tLoopInfo *Loop);
+ int	Compile_int_ConvertIteration(tCompileState *State, tAST_Node *Node, tIRMBlock *BreakTarget);
+ int	Compile_int_ConvertLogical(tCompileState *State, tAST_Node *Node, tReg *OutReg);
+bool	Compile_int_IsSpeculatable(tCompileState *State, tAST_Node *Node, int *Budget);
+ int	Compile_int_ConvertBoolean(tCompileState *State, tAST_Node *Node, tReg *OutReg);
+ int	Compile_int_ConvertOperands(tCompileState *State, tAST_Node *Left, tAST_Node *Right, tReg *LeftReg, tReg *RightReg);
+ int	Compile_int_ConvertBinOp(tCompileState *State, tAST_Node *Node, int NodeType, tReg Left, tReg Right, tReg *OutReg);
+ int	Compile_int_DefineLocal(tCompileState *State, tAST_Node *Node);
+ int	Compile_int_InitialiseAt(tCompileState *State, tAST_Node *Node, tLValue *Dest);
+ int	Compile_int_InitialiseBlob(tCompileState *State, tAST_Node *Node, tLValue *Dest);
+ int	Compile_int_GetLValue(tCompileState *State, tAST_Node *Node, tLValue *LV);
+tReg	Compile_int_LoadLValue(tCompileState *State, tLValue *LV);
+void	Compile_int_StoreLValue(tCompileState *State, tLValue *LV, tReg Value);
+tReg	Compile_int_Convert(tCompileState *State, tReg Reg, const tType *Type);
+tReg	Compile_int_Scale(tCompileState *State, tReg Reg, size_t Scale);
+tReg	Compile_int_Constant(tCompileState *State, const tType *Type, uint64_t Value);
+const tType	*Compile_int_ArithType(const tType *Left, const tType *Right);
+bool	Compile_int_IsSigned(const tType *Type);
+size_t	Compile_int_PointeeSize(const tType *Type);
 void	Compile_InitSubState(tCompileState *ParentState, tCompileState *ChildState);
 void	Compile_ClearSubState(tCompileState *ChildState);
+ int	Compile_int_FindLocal(tCompileState *State, const char *Name);
+tSymbol	*Compile_int_ResolveSymbol(tCompileState *State, const char *Name);
 bool	Compile_GetLocalSymbol(tCompileState *State, tReg *OutReg, const char *Name);
 tReg	AllocateRegister(tCompileState *State, const tType *Type);
 
 // === GLOBALS ===
 const tType	*TYPE_CHARCONSTANT;
+const tType	*TYPE_INT;
+const tType	*TYPE_UINT;
+const tType	*TYPE_LONGLONG;
+const tType	*TYPE_PTRDIFF;	//!< Signed integer as wide as a pointer
+const tType	*TYPE_SIZE;	//!< Unsigned integer as wide as a pointer
 
 // === CODE ===
-void Compile_ConvertFunction(tAST_Node *Node, int NArgs, const char **ArgNames, const tType **ArgTypes)
+/**
+ * \brief Convert all defined functions into IRM form and optimise them
+ */
+void Compile_ProcessFunctions(void)
+{
+	for( tFunction *fcn = gpFunctions; fcn; fcn = fcn->Next )
+	{
+		if( fcn->Sym.Value == NULL )
+			continue ;
+		fcn->IRM = Compile_ConvertFunction(fcn);
+	}
+	// The optimiser folds loads from globals that are never written
+	Compile_int_MarkReadOnlyGlobals();
+	for( tFunction *fcn = gpFunctions; fcn; fcn = fcn->Next )
+	{
+		if( fcn->IRM )
+			Optimiser_ProcessIRM(fcn);
+	}
+	// (after optimisation, which turns some indirect calls into direct ones)
+	Compile_int_MarkDirectOnly();
+}
+
+/**
+ * \brief Set tSymbol.bReadOnly on globals whose contents never change
+ *
+ * const objects always qualify. A static is read-only if the only things
+ * done with its address (in every function, and in the initialisers of
+ * other globals) are loads, so its initialiser is its value for the whole
+ * run of the program.
+ */
+void Compile_int_MarkReadOnlyGlobals(void)
+{
+	bool	all_known = true;
+	for( tFunction *fcn = gpFunctions; fcn; fcn = fcn->Next )
+	{
+		if( fcn->Sym.Value && !fcn->IRM )
+			all_known = false;
+	}
+	
+	for( tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
+	{
+		sym->bReadOnly = false;
+		if( sym->Type->Class == TYPECLASS_FUNCTION || sym->Linkage == LINKAGE_EXTERNAL )
+			continue ;
+		if( sym->Type->bVolatile )
+			continue ;
+		if( Compile_int_IsConstObject(sym->Type) )
+			sym->bReadOnly = (sym->Linkage == LINKAGE_STATIC || sym->Value);
+		else if( sym->Linkage == LINKAGE_STATIC && all_known )
+			sym->bReadOnly = true;
+	}
+	
+	// Addresses stored in other globals may be used to write anywhere
+	for( tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
+	{
+		tConstImage	image;
+		if( sym->Type->Class == TYPECLASS_FUNCTION || !sym->Value )
+			continue ;
+		if( sym->Value->Type == NODETYPE_BLOB )
+			continue ;
+		if( ConstEval_TryInitialiser(&image, sym->Type, sym->Value) )
+			continue ;
+		for( int i = 0; i < image.nRelocs; i ++ )
+		{
+			if( image.Relocs[i].Symbol )
+				Compile_int_Escape( Symbol_ResolveSymbol(image.Relocs[i].Symbol) );
+		}
+		ConstEval_FreeImage(&image);
+	}
+	
+	for( tFunction *fcn = gpFunctions; fcn; fcn = fcn->Next )
+	{
+		if( fcn->IRM )
+			Compile_int_FindEscapes(fcn->IRM);
+	}
+}
+
+/**
+ * \brief Clear bReadOnly on globals whose address is used for anything but loads
+ *
+ * Tracks which registers hold an address derived (by arithmetic or casts)
+ * from a single global's. A register that could point into two globals
+ * makes both escape.
+ */
+void Compile_int_FindEscapes(tIRMHandle IRM)
+{
+	const tSymbol	**base = calloc(IRM->nRegs, sizeof(*base));
+	bool	changed = true;
+	while( changed )
+	{
+		changed = false;
+		for( int b = 0; b < IRM->nBlocks; b ++ )
+		{
+			for( tIRMOp *op = IRM->Blocks[b]->FirstOp; op; op = op->Next )
+			{
+				const tSymbol	*sym = NULL;
+				switch( op->Op )
+				{
+				case IRMOP_SYMADDR:
+					sym = op->Sym;
+					break;
+				case IRMOP_COPY:
+				case IRMOP_CAST:
+				case IRMOP_SUB:
+					sym = base[op->Src[0]];
+					break;
+				case IRMOP_ADD:
+					sym = (base[op->Src[0]] ? base[op->Src[0]] : base[op->Src[1]]);
+					break;
+				default:
+					break;
+				}
+				if( !sym || op->Dst == IRM_REG_VOID || base[op->Dst] == sym )
+					continue ;
+				if( base[op->Dst] ) {
+					Compile_int_Escape(base[op->Dst]);
+					Compile_int_Escape(sym);
+					continue ;
+				}
+				base[op->Dst] = sym;
+				changed = true;
+			}
+		}
+	}
+	
+	for( int b = 0; b < IRM->nBlocks; b ++ )
+	{
+		for( tIRMOp *op = IRM->Blocks[b]->FirstOp; op; op = op->Next )
+		{
+			 int	n_uses = IRM_GetUseCount(op);
+			for( int i = 0; i < n_uses; i ++ )
+			{
+				const tSymbol	*sym = base[*IRM_GetUse(op, i)];
+				if( !sym )
+					continue ;
+				switch( op->Op )
+				{
+				case IRMOP_LOAD:
+				case IRMOP_COPY:
+				case IRMOP_CAST:
+					continue ;
+				case IRMOP_ADD:
+					if( !base[op->Src[0]] || !base[op->Src[1]] )
+						continue ;
+					break;
+				case IRMOP_SUB:
+					if( i == 0 && !base[op->Src[1]] )
+						continue ;
+					break;
+				default:
+					break;
+				}
+				Compile_int_Escape(sym);
+			}
+		}
+	}
+	free(base);
+}
+
+/**
+ * \brief Set tSymbol.bDirectOnly on static functions whose address is never taken
+ *
+ * The backend can then pick any calling convention for them, as it
+ * generates every call. A call is direct if its target register has a
+ * single definition, a SYMADDR of the function.
+ */
+void Compile_int_MarkDirectOnly(void)
+{
+	bool	all_known = true;
+	for( tFunction *fcn = gpFunctions; fcn; fcn = fcn->Next )
+	{
+		if( fcn->Sym.Value && !fcn->IRM )
+			all_known = false;
+	}
+	for( tFunction *fcn = gpFunctions; fcn; fcn = fcn->Next )
+	{
+		fcn->Sym.bDirectOnly = all_known && fcn->IRM && fcn->Linkage == LINKAGE_STATIC
+			&& !fcn->Sym.Type->Function->bIsVarg;
+	}
+	
+	for( tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
+	{
+		tConstImage	image;
+		if( sym->Type->Class == TYPECLASS_FUNCTION || !sym->Value )
+			continue ;
+		if( sym->Value->Type == NODETYPE_BLOB )
+			continue ;
+		if( ConstEval_TryInitialiser(&image, sym->Type, sym->Value) )
+			continue ;
+		for( int i = 0; i < image.nRelocs; i ++ )
+		{
+			tSymbol	*target = (image.Relocs[i].Symbol ? Symbol_ResolveSymbol(image.Relocs[i].Symbol) : NULL);
+			if( target )
+				target->bDirectOnly = false;
+		}
+		ConstEval_FreeImage(&image);
+	}
+	
+	for( tFunction *fcn = gpFunctions; fcn; fcn = fcn->Next )
+	{
+		tIRMHandle	h = fcn->IRM;
+		if( !h )
+			continue ;
+		 int	*ndefs = calloc(h->nRegs, sizeof(int));
+		const tSymbol	**fcn_addr = calloc(h->nRegs, sizeof(*fcn_addr));
+		for( int b = 0; b < h->nBlocks; b ++ )
+		{
+			for( tIRMOp *op = h->Blocks[b]->FirstOp; op; op = op->Next )
+			{
+				if( op->Dst == IRM_REG_VOID )
+					continue ;
+				ndefs[op->Dst] ++;
+				if( op->Op == IRMOP_SYMADDR && op->Sym->Type->Class == TYPECLASS_FUNCTION )
+					fcn_addr[op->Dst] = op->Sym;
+			}
+		}
+		for( int r = 0; r < h->nRegs; r ++ )
+		{
+			if( fcn_addr[r] && ndefs[r] != 1 )
+				((tSymbol*)fcn_addr[r])->bDirectOnly = false;
+		}
+		for( int b = 0; b < h->nBlocks; b ++ )
+		{
+			for( tIRMOp *op = h->Blocks[b]->FirstOp; op; op = op->Next )
+			{
+				 int	n_uses = IRM_GetUseCount(op);
+				for( int i = 0; i < n_uses; i ++ )
+				{
+					const tSymbol	*sym = fcn_addr[*IRM_GetUse(op, i)];
+					if( sym && !(op->Op == IRMOP_CALL && i == 0) )
+						((tSymbol*)sym)->bDirectOnly = false;
+				}
+			}
+		}
+		free(fcn_addr);
+		free(ndefs);
+	}
+}
+
+void Compile_int_Escape(const tSymbol *Sym)
+{
+	if( !Sym || !Sym->bReadOnly || Compile_int_IsConstObject(Sym->Type) )
+		return ;
+	((tSymbol*)Sym)->bReadOnly = false;
+}
+
+/**
+ * \brief Check if an object of this type is const (the whole object, or all elements of an array)
+ */
+bool Compile_int_IsConstObject(const tType *Type)
+{
+	while( Type->Class == TYPECLASS_ARRAY && !Type->bConst )
+		Type = Type->Array.Type;
+	return Type->bConst;
+}
+
+tIRMHandle Compile_ConvertFunction(tFunction *Func)
 {
 	if( !TYPE_CHARCONSTANT )
 	{
 		const tType	*type_char = Types_CreateIntegerType(true, INTSIZE_CHAR);
 		const tType	*type_c_char = Types_ApplyQualifiers(type_char, QUALIFIER_CONST);
 		TYPE_CHARCONSTANT = Types_CreatePointerType(type_c_char);
+		TYPE_INT = Types_CreateIntegerType(true, INTSIZE_INT);
+		TYPE_UINT = Types_CreateIntegerType(false, INTSIZE_INT);
+		TYPE_LONGLONG = Types_CreateIntegerType(true, INTSIZE_LONGLONG);
+		// (long is pointer sized on every target, but int is used when it is too)
+		enum eIntegerSize	ptr_size = (Types_GetSizeOf(TYPE_CHARCONSTANT) == Types_GetSizeOf(TYPE_INT) ? INTSIZE_INT : INTSIZE_LONG);
+		TYPE_PTRDIFF = Types_CreateIntegerType(true, ptr_size);
+		TYPE_SIZE = Types_CreateIntegerType(false, ptr_size);
+	}
+	const tFunctionSig	*sig = Func->Sym.Type->Function;
+
+	tCompileState	state = {
+		.Handle = IRM_CreateFunction(Func->Sym.Name, sig->nArgs)
+	};
+
+	// Define the arguments as locals (initialised from the argument registers)
+	for( int i = 0; i < sig->nArgs; i ++ )
+	{
+		 int	lcl = IRM_AddLocal(state.Handle, sig->ArgTypes[i], Func->ArgNames[i]);
+		tReg	reg = AllocateRegister(&state, sig->ArgTypes[i]);
+		IRM_AppendArgument(state.Handle, reg, i);
+		IRM_AppendStoreLocal(state.Handle, lcl, reg);
+		if( Func->ArgNames[i] )
+		{
+			tCompileLocal *cl = malloc(sizeof(tCompileLocal));
+			cl->Name = Func->ArgNames[i];
+			cl->Local = lcl;
+			cl->Global = NULL;
+			cl->Next = state.Locals;
+			state.Locals = cl;
+		}
+	}
+
+	if( Compile_ConvertNode(&state, Func->Sym.Value, NULL) ) {
+		Compile_ClearSubState(&state);
+		IRM_FreeFunction(state.Handle);
+		return NULL;
 	}
-	// Define the arguments from a special register set
+	Compile_ClearSubState(&state);
+
+	// Falling off the end of the function
+	IRM_AppendReturn(state.Handle, REG_VOID);
+
+	IRM_UpdateCFG(state.Handle);
+	return state.Handle;
 }
 
 #define NO_RESULT()	do{ \
@@ -57,14 +488,15 @@ void Compile_ConvertFunction(tAST_Node *Node, int NArgs, const char **ArgNames,
 #define WARN_UNUSED()	do { \
 	if(!OutReg) { \
 		CompileWarning(Node, "Ignoring result of operation");\
-		*OutReg = REG_VOID;\
 		return 0;\
 	}\
 }while(0)
 
 int Compile_ConvertNode(tCompileState *State, tAST_Node *Node, tReg *OutReg)
 {
-	Node = Compile_OptimiseWithValues(State, Node);
+	tReg	tmp_reg;
+	tLValue	lv;
+
 	switch(Node->Type)
 	{
 	case NODETYPE_NOOP:
@@ -73,8 +505,7 @@ int Compile_ConvertNode(tCompileState *State, tAST_Node *Node, tReg *OutReg)
 	// - Values
 	case NODETYPE_INTEGER:
 		WARN_UNUSED();
-		*OutReg = AllocateRegister(State, Node->Integer.Type);
-		IRM_AppendConstant(State->Handle, *OutReg, Node->Integer.Value);
+		*OutReg = Compile_int_Constant(State, AST_GetIntegerType(Node), Node->Integer.Value);
 		break;
 	//  > String = pointer to .rodata
 	case NODETYPE_STRING:
@@ -84,71 +515,1848 @@ int Compile_ConvertNode(tCompileState *State, tAST_Node *Node, tReg *OutReg)
 		break;
 	// NOTE: This covers implicit dereferences, '&ptr' is handled explicitly
 	case NODETYPE_SYMBOL:
+	case NODETYPE_INDEX:
+	case NODETYPE_MEMBER:
+	case NODETYPE_DEREF:
 		WARN_UNUSED();
 		// 1. Local variable/symbol (Stored in State)
-		if( Compile_GetLocalSymbol(State, OutReg, Node->Symbol.Name) ) {
+		if( Node->Type == NODETYPE_SYMBOL && Compile_GetLocalSymbol(State, OutReg, Node->Symbol.Name) ) {
 			// All good
+			break;
 		}
-		else {
-			tSymbol	*sym = Symbol_ResolveSymbol(Node->Symbol.Name);
-			if( !sym ) {
-				CompileError(Node, "Undefined reference to %s", Node->Symbol.Name);
-				return 1;
+		// 2. Enumeration constant
+		if( Node->Type == NODETYPE_SYMBOL ) {
+			uint64_t	val;
+			if( Types_GetEnumValue(Node->Symbol.Name, &val) ) {
+				*OutReg = Compile_int_Constant(State, TYPE_INT, val);
+				break;
 			}
-			*OutReg = AllocateRegister(State, sym->Type);
-			IRM_AppendSymbol(State->Handle, *OutReg, sym);
 		}
+		if( Compile_int_GetLValue(State, Node, &lv) )
+			return 1;
+		*OutReg = Compile_int_LoadLValue(State, &lv);
 		break;
-	
+
 	// --- "List" Nodes
 	// > Code block
 	case NODETYPE_BLOCK: {
+		NO_RESULT();
 		// Create new scope
 		tCompileState	new_state;
 		Compile_InitSubState(State, &new_state);
 		// Iterate nodes
 		for( tAST_Node *stmt = Node->CodeBlock.FirstStatement; stmt; stmt = stmt->NextSibling )
 		{
-			if( Compile_ConvertNode(&new_state, stmt, NULL) )
+			if( Compile_int_ConvertStatement(&new_state, stmt) ) {
+				Compile_ClearSubState(&new_state);
 				return 1;
+			}
 		}
 		// Clear scope
 		Compile_ClearSubState(&new_state);
 		break; }
 	// > Function call
-	case NODETYPE_FUNCTIONCALL:
+	case NODETYPE_FUNCTIONCALL: {
+		 int	nargs = 0;
+		for( tAST_Node *arg = Node->FunctionCall.FirstArgument; arg; arg = arg->NextSibling )
+			nargs ++;
+
 		// - Get function pointer
+		tReg	fcn;
+		if( Compile_ConvertNode(State, Node->FunctionCall.Function, &fcn) )
+			return 1;
+		const tType	*fcn_type = IRM_GetRegType(State->Handle, fcn);
+		if( fcn_type->Class == TYPECLASS_POINTER )
+			fcn_type = fcn_type->Pointer;
+		if( fcn_type->Class != TYPECLASS_FUNCTION ) {
+			CompileError(Node, "Calling a non-function");
+			return 1;
+		}
+		const tFunctionSig	*sig = fcn_type->Function;
+		if( nargs < sig->nArgs || (nargs > sig->nArgs && !sig->bIsVarg) ) {
+			CompileError(Node, "Function takes %i arguments, %i given", sig->nArgs, nargs);
+			return 1;
+		}
+
+		// - Evaluate arguments
+		tReg	args[nargs];
+		 int	i = 0;
+		for( tAST_Node *arg = Node->FunctionCall.FirstArgument; arg; arg = arg->NextSibling, i ++ )
+		{
+			if( Compile_ConvertNode(State, arg, &args[i]) )
+				return 1;
+			if( i < sig->nArgs )
+				args[i] = Compile_int_Convert(State, args[i], sig->ArgTypes[i]);
+		}
+
+		tReg	ret = REG_VOID;
+		if( sig->Return->Class != TYPECLASS_VOID )
+			ret = AllocateRegister(State, sig->Return);
+		else
+			NO_RESULT();
+		IRM_AppendCall(State->Handle, ret, fcn, nargs, args);
+		if( OutReg )
+			*OutReg = ret;
+		break; }
+
+	// --- Statements
+	case NODETYPE_LOCALVAR:
+		NO_RESULT();
+		return Compile_int_DefineLocal(State, Node);
+	case NODETYPE_IF: {
+		NO_RESULT();
+		tIRMBlock	*true_blk = IRM_CreateBlock(State->Handle);
+		tIRMBlock	*false_blk = IRM_CreateBlock(State->Handle);
+		tIRMBlock	*end_blk = IRM_CreateBlock(State->Handle);
+		if( Compile_int_ConvertCondition(State, Node->If.Test, true_blk, false_blk) )
+			return 1;
+		IRM_SetBlock(State->Handle, true_blk);
+		if( Compile_int_ConvertStatement(State, Node->If.True) )
+			return 1;
+		IRM_AppendJump(State->Handle, end_blk);
+		IRM_SetBlock(State->Handle, false_blk);
+		if( Compile_int_ConvertStatement(State, Node->If.False) )
+			return 1;
+		IRM_AppendJump(State->Handle, end_blk);
+		IRM_SetBlock(State->Handle, end_blk);
+		break; }
+	case NODETYPE_WHILE:
+	case NODETYPE_DOWHILE:
+	case NODETYPE_FOR: {
+		NO_RESULT();
+		tLoopInfo	loop;
+		if( Node->Type == NODETYPE_FOR && Compile_int_PlanUnroll(State, Node, &loop) )
+			return Compile_int_ConvertUnrolledFor(State, Node, &loop);
+		tIRMBlock	*test_blk = IRM_CreateBlock(State->Handle);
+		tIRMBlock	*body_blk = IRM_CreateBlock(State->Handle);
+		tIRMBlock	*next_blk = test_blk;
+		tIRMBlock	*end_blk = IRM_CreateBlock(State->Handle);
+		tAST_Node	*test = (Node->Type == NODETYPE_FOR ? Node->For.Test : Node->While.Test);
+		tAST_Node	*body = (Node->Type == NODETYPE_FOR ? Node->For.Action : Node->While.Action);
+		if( Node->Type == NODETYPE_FOR )
+		{
+			if( Compile_int_ConvertStatement(State, Node->For.Init) )
+				return 1;
+			next_blk = IRM_CreateBlock(State->Handle);
+		}
+		IRM_AppendJump(State->Handle, (Node->Type == NODETYPE_DOWHILE ? body_blk : test_blk));
+
+		// Condition
+		IRM_SetBlock(State->Handle, test_blk);
+		if( test->Type == NODETYPE_NOOP )
+			IRM_AppendJump(State->Handle, body_blk);
+		else if( Compile_int_ConvertCondition(State, test, body_blk, end_blk) )
+			return 1;
+
+		// Body
+		tCompileState	new_state;
+		Compile_InitSubState(State, &new_state);
+		new_state.BreakTarget = end_blk;
+		new_state.ContinueTarget = next_blk;
+		IRM_SetBlock(State->Handle, body_blk);
+		 int	rv = Compile_int_ConvertStatement(&new_state, body);
+		Compile_ClearSubState(&new_state);
+		if( rv )
+			return 1;
+		IRM_AppendJump(State->Handle, next_blk);
+
+		// Increment
+		if( Node->Type == NODETYPE_FOR )
+		{
+			IRM_SetBlock(State->Handle, next_blk);
+			if( Compile_int_ConvertStatement(State, Node->For.Next) )
+				return 1;
+			IRM_AppendJump(State->Handle, test_blk);
+		}
+		IRM_SetBlock(State->Handle, end_blk);
+		break; }
+	case NODETYPE_SWITCH:
+		NO_RESULT();
+		return Compile_int_ConvertSwitch(State, Node);
+	case NODETYPE_CASE:
+		CompileError(Node, "case label outside of switch");
+		return 1;
+	case NODETYPE_RETURN:
+		NO_RESULT();
+		if( Node->UniOp.Value->Type == NODETYPE_NOOP )
+			tmp_reg = REG_VOID;
+		else if( Compile_ConvertNode(State, Node->UniOp.Value, &tmp_reg) )
+			return 1;
+		IRM_AppendReturn(State->Handle, tmp_reg);
 		break;
-	
+	case NODETYPE_BREAK:
+	case NODETYPE_CONTINUE: {
+		NO_RESULT();
+		tIRMBlock	*target = NULL;
+		for( tCompileState *st = State; st && !target; st = st->Parent )
+			target = (Node->Type == NODETYPE_BREAK ? st->BreakTarget : st->ContinueTarget);
+		if( !target ) {
+			CompileError(Node, "%s outside of a loop", (Node->Type == NODETYPE_BREAK ? "break" : "continue"));
+			return 1;
+		}
+		IRM_AppendJump(State->Handle, target);
+		break; }
+
+	// --- Unary Operations
+	case NODETYPE_NEGATE:
+	case NODETYPE_BWNOT:
+		WARN_UNUSED();
+		if( Compile_ConvertNode(State, Node->UniOp.Value, &tmp_reg) )
+			return 1;
+		tmp_reg = Compile_int_Convert(State, tmp_reg,
+			Compile_int_ArithType(IRM_GetRegType(State->Handle, tmp_reg), TYPE_INT));
+		*OutReg = AllocateRegister(State, IRM_GetRegType(State->Handle, tmp_reg));
+		IRM_AppendUniOp(State->Handle, (Node->Type == NODETYPE_NEGATE ? IRMOP_NEG : IRMOP_NOT), 0, *OutReg, tmp_reg);
+		break;
+	case NODETYPE_LOGICNOT:
+		WARN_UNUSED();
+		if( Compile_ConvertNode(State, Node->UniOp.Value, &tmp_reg) )
+			return 1;
+		*OutReg = AllocateRegister(State, TYPE_INT);
+		IRM_AppendBinOp(State->Handle, IRMOP_CMPEQ, 0, *OutReg, tmp_reg,
+			Compile_int_Constant(State, IRM_GetRegType(State->Handle, tmp_reg), 0));
+		break;
+	case NODETYPE_ADDROF:
+		WARN_UNUSED();
+		if( Compile_int_GetLValue(State, Node->UniOp.Value, &lv) )
+			return 1;
+		if( lv.Local >= 0 ) {
+			lv.Address = AllocateRegister(State, Types_CreatePointerType(lv.Type));
+			IRM_AppendLocalAddr(State->Handle, lv.Address, lv.Local);
+		}
+		*OutReg = lv.Address;
+		break;
+	case NODETYPE_POSTINC:
+	case NODETYPE_POSTDEC:
+	case NODETYPE_PREINC:
+	case NODETYPE_PREDEC: {
+		if( Compile_int_GetLValue(State, Node->UniOp.Value, &lv) )
+			return 1;
+		tReg	old = Compile_int_LoadLValue(State, &lv);
+		tReg	new = AllocateRegister(State, lv.Type);
+		bool	is_inc = (Node->Type == NODETYPE_POSTINC || Node->Type == NODETYPE_PREINC);
+		size_t	step = (lv.Type->Class == TYPECLASS_POINTER ? Compile_int_PointeeSize(lv.Type) : 1);
+		IRM_AppendBinOp(State->Handle, (is_inc ? IRMOP_ADD : IRMOP_SUB), 0, new, old,
+			Compile_int_Constant(State, (lv.Type->Class == TYPECLASS_POINTER ? TYPE_SIZE : lv.Type), step));
+		Compile_int_StoreLValue(State, &lv, new);
+		if( OutReg )
+			*OutReg = (Node->Type == NODETYPE_POSTINC || Node->Type == NODETYPE_POSTDEC ? old : new);
+		break; }
+	case NODETYPE_CAST:
+		WARN_UNUSED();
+		if( Compile_ConvertNode(State, Node->Cast.Value, &tmp_reg) )
+			return 1;
+		*OutReg = Compile_int_Convert(State, tmp_reg, Node->Cast.Type);
+		break;
+
+	// --- Binary Operations
+	case NODETYPE_ASSIGN:
+		if( AST_EvalRightFirst(Node->Assign.To, Node->Assign.From) ) {
+			if( Compile_ConvertNode(State, Node->Assign.From, &tmp_reg) )
+				return 1;
+			if( Compile_int_GetLValue(State, Node->Assign.To, &lv) )
+				return 1;
+		}
+		else {
+			if( Compile_int_GetLValue(State, Node->Assign.To, &lv) )
+				return 1;
+			if( Compile_ConvertNode(State, Node->Assign.From, &tmp_reg) )
+				return 1;
+		}
+		tmp_reg = Compile_int_Convert(State, tmp_reg, lv.Type);
+		Compile_int_StoreLValue(State, &lv, tmp_reg);
+		if( OutReg )
+			*OutReg = tmp_reg;
+		break;
+	case NODETYPE_ASSIGNOP: {
+		// The old value is loaded as late as possible
+		bool	from_first = AST_EvalRightFirst(Node->AssignOp.To, Node->AssignOp.From);
+		if( from_first && Compile_ConvertNode(State, Node->AssignOp.From, &tmp_reg) )
+			return 1;
+		if( Compile_int_GetLValue(State, Node->AssignOp.To, &lv) )
+			return 1;
+		tReg	cur = Compile_int_LoadLValue(State, &lv);
+		if( !from_first && Compile_ConvertNode(State, Node->AssignOp.From, &tmp_reg) )
+			return 1;
+		if( Compile_int_ConvertBinOp(State, Node, Node->AssignOp.Op, cur, tmp_reg, &tmp_reg) )
+			return 1;
+		tmp_reg = Compile_int_Convert(State, tmp_reg, lv.Type);
+		Compile_int_StoreLValue(State, &lv, tmp_reg);
+		if( OutReg )
+			*OutReg = tmp_reg;
+		break; }
+
+	case NODETYPE_ADD ... NODETYPE_GREATERTHANEQU: {
+		WARN_UNUSED();
+		tReg	left, right;
+		if( Compile_int_ConvertOperands(State, Node->BinOp.Left, Node->BinOp.Right, &left, &right) )
+			return 1;
+		return Compile_int_ConvertBinOp(State, Node, Node->Type, left, right, OutReg); }
+	case NODETYPE_BOOLOR:
+	case NODETYPE_BOOLAND:
+	case NODETYPE_CONDITIONAL:
+		WARN_UNUSED();
+		return Compile_int_ConvertLogical(State, Node, OutReg);
+
 	default:
-		assert(!"Forgot a node in compile.c");
+		CompileError(Node, "Unhandled node type %i in IRM conversion", Node->Type);
+		return 1;
 	}
-	
+
 	// TODO: Check for return?
-	
+
 	return 0;
 }
 
-tAST_Node *Compile_OptimiseWithValues(tCompileState *State, tAST_Node *Node)
+/**
+ * \brief Convert a statement (a node whose value is unused)
+ */
+int Compile_int_ConvertStatement(tCompileState *State, tAST_Node *Node)
 {
-	// Return a version of the provided node, with now known values replaced by constants (and propagated up)
-	
-	// HACK - Do nothing, for now
-	return Node;
+	switch(Node->Type)
+	{
+	// Pure values as statements are pointless, but harmless
+	case NODETYPE_INTEGER:
+	case NODETYPE_STRING:
+	case NODETYPE_SYMBOL:
+	case NODETYPE_ADD ... NODETYPE_GREATERTHANEQU:
+		CompileWarning(Node, "Statement with no effect");
+		return 0;
+	// Function calls, assignments and increments can have their result ignored
+	case NODETYPE_FUNCTIONCALL:
+	case NODETYPE_ASSIGN:
+	case NODETYPE_ASSIGNOP:
+	case NODETYPE_POSTINC ... NODETYPE_PREDEC: {
+		if( Node->Type == NODETYPE_FUNCTIONCALL )
+			return Compile_ConvertNode(State, Node, NULL);
+		tReg	discard;
+		return Compile_ConvertNode(State, Node, &discard); }
+	default:
+		return Compile_ConvertNode(State, Node, NULL);
+	}
 }
 
-void Compile_InitSubState(tCompileState *ParentState, tCompileState *ChildState)
+/**
+ * \brief Convert a boolean expression into a branch
+ */
+int Compile_int_ConvertCondition(tCompileState *State, tAST_Node *Node, tIRMBlock *True, tIRMBlock *False)
 {
+	switch(Node->Type)
+	{
+	case NODETYPE_BOOLAND:
+	case NODETYPE_BOOLOR: {
+		tIRMBlock	*rhs_blk = IRM_CreateBlock(State->Handle);
+		if( Node->Type == NODETYPE_BOOLAND ) {
+			if( Compile_int_ConvertCondition(State, Node->BinOp.Left, rhs_blk, False) )
+				return 1;
+		}
+		else {
+			if( Compile_int_ConvertCondition(State, Node->BinOp.Left, True, rhs_blk) )
+				return 1;
+		}
+		IRM_SetBlock(State->Handle, rhs_blk);
+		return Compile_int_ConvertCondition(State, Node->BinOp.Right, True, False); }
+	case NODETYPE_LOGICNOT:
+		return Compile_int_ConvertCondition(State, Node->UniOp.Value, False, True);
+	default: {
+		tReg	val;
+		if( Compile_ConvertNode(State, Node, &val) )
+			return 1;
+		IRM_AppendBranch(State->Handle, val, True, False);
+		return 0; }
+	}
 }
-void Compile_ClearSubState(tCompileState *ChildState)
+
+/**
+ * \brief Convert the operands of a binary operation
+ *
+ * The side needing more registers is evaluated first (see AST_EvalRightFirst)
+ * so the other one's value isn't held while it is computed.
+ */
+int Compile_int_ConvertOperands(tCompileState *State, tAST_Node *Left, tAST_Node *Right, tReg *LeftReg, tReg *RightReg)
 {
+	if( AST_EvalRightFirst(Left, Right) )
+	{
+		if( Compile_ConvertNode(State, Right, RightReg) )
+			return 1;
+		return Compile_ConvertNode(State, Left, LeftReg);
+	}
+	if( Compile_ConvertNode(State, Left, LeftReg) )
+		return 1;
+	return Compile_ConvertNode(State, Right, RightReg);
 }
-bool Compile_GetLocalSymbol(tCompileState *State, tReg *OutReg, const char *Name)
+
+/**
+ * \brief Convert a switch statement into a compare chain
+ */
+int Compile_int_ConvertSwitch(tCompileState *State, tAST_Node *Node)
 {
-	return false;
+	tReg	val;
+	if( Compile_ConvertNode(State, Node->Switch.Condition, &val) )
+		return 1;
+	// The controlling expression is promoted, case labels are converted to its type
+	const tType	*type = Compile_int_ArithType(IRM_GetRegType(State->Handle, val), TYPE_INT);
+	val = Compile_int_Convert(State, val, type);
+
+	tIRMBlock	*end_blk = IRM_CreateBlock(State->Handle);
+	 int	ncases = 0;
+	for( tAST_Node *stmt = Node->Switch.FirstStatement; stmt; stmt = stmt->NextSibling )
+	{
+		if( stmt->Type == NODETYPE_CASE )
+			ncases ++;
+	}
+	tIRMBlock	*case_blocks[ncases+1];
+	tSwitchCase	cases[ncases+1];
+	tSwitchCluster	clusters[ncases+1];
+	tSwitchLowering	sw = {
+		.Value = val,
+		.Type = type,
+		.Flags = (Compile_int_IsSigned(type) ? IRMFLAG_SIGNED : 0),
+		.Bits = Types_GetSizeOf(type) * 8,
+		.bSigned = Compile_int_IsSigned(type),
+		.Cases = cases,
+		.Clusters = clusters,
+		.Default = end_blk,
+	};
+
+	// Collect the labels (adjacent labels share a block, so `case 1: case 2:` is one destination)
+	 int	i = 0;
+	for( tAST_Node *stmt = Node->Switch.FirstStatement, *prev = NULL; stmt; prev = stmt, stmt = stmt->NextSibling )
+	{
+		if( stmt->Type != NODETYPE_CASE )
+			continue ;
+		if( prev && prev->Type == NODETYPE_CASE )
+			case_blocks[i] = case_blocks[i-1];
+		else
+			case_blocks[i] = IRM_CreateBlock(State->Handle);
+		if( stmt->SwitchCase.Value1->Type == NODETYPE_NOOP ) {
+			sw.Default = case_blocks[i++];
+			continue ;
+		}
+
+		tAST_Node	*v2 = stmt->SwitchCase.Value2;
+		int64_t	v1val, v2val = 0;
+		if( ConstEval_TryInteger(stmt->SwitchCase.Value1, &v1val) || (v2 && ConstEval_TryInteger(v2, &v2val)) ) {
+			CompileError(stmt, "case label is not constant");
+			return 1;
+		}
+		tSwitchCase	*c = &cases[sw.nCases];
+		c->Lo = Compile_int_SwitchKey(&sw, v1val);
+		c->Hi = (v2 ? Compile_int_SwitchKey(&sw, v2val) : c->Lo);
+		c->Target = case_blocks[i];
+		c->Node = stmt;
+		if( c->Hi < c->Lo )
+			CompileWarning(stmt, "empty range specified");
+		else
+			sw.nCases ++;
+		i ++;
+	}
+
+	// Sort, then merge neighbouring labels of the same statement (`case 1: case 2:`)
+	qsort(cases, sw.nCases, sizeof(tSwitchCase), Compile_int_SwitchCompareCases);
+	 int	n = 0;
+	for( i = 0; i < sw.nCases; i ++ )
+	{
+		if( n > 0 && cases[i].Lo <= cases[n-1].Hi ) {
+			CompileError(cases[i].Node, "duplicate case value");
+			return 1;
+		}
+		if( n > 0 && cases[i].Lo == cases[n-1].Hi + 1 && cases[i].Target == cases[n-1].Target )
+			cases[n-1].Hi = cases[i].Hi;
+		else
+			cases[n++] = cases[i];
+	}
+	sw.nCases = n;
+
+	// Dispatch
+	if( sw.nCases == 0 ) {
+		IRM_AppendJump(State->Handle, sw.Default);
+	}
+	else {
+		 uint64_t	min = (sw.bSigned ? 1ULL << (sw.Bits-1) : 0);
+		Compile_int_SwitchCluster(&sw);
+		Compile_int_SwitchTree(State, &sw, 0, sw.nClusters-1,
+			Compile_int_SwitchKey(&sw, min), Compile_int_SwitchKey(&sw, min-1));
+	}
+
+	// Body
+	tCompileState	new_state;
+	Compile_InitSubState(State, &new_state);
+	new_state.BreakTarget = end_blk;
+	IRM_SetBlock(State->Handle, IRM_CreateBlock(State->Handle));	// Unreachable until a label
+	i = 0;
+	for( tAST_Node *stmt = Node->Switch.FirstStatement; stmt; stmt = stmt->NextSibling )
+	{
+		if( stmt->Type == NODETYPE_CASE ) {
+			// Fall through
+			if( i == 0 || case_blocks[i] != case_blocks[i-1] ) {
+				IRM_AppendJump(State->Handle, case_blocks[i]);
+				IRM_SetBlock(State->Handle, case_blocks[i]);
+			}
+			i ++;
+		}
+		else if( Compile_int_ConvertStatement(&new_state, stmt) ) {
+			Compile_ClearSubState(&new_state);
+			return 1;
+		}
+	}
+	Compile_ClearSubState(&new_state);
+	IRM_AppendJump(State->Handle, end_blk);
+	IRM_SetBlock(State->Handle, end_blk);
+	return 0;
 }
-tReg AllocateRegister(tCompileState *State, const tType *Type)
+
+int Compile_int_SwitchCompareCases(const void *A, const void *B)
 {
-	return 0;
+	const tSwitchCase	*a = A, *b = B;
+	return (a->Lo < b->Lo ? -1 : a->Lo > b->Lo);
+}
+
+/**
+ * \brief Convert a case value into an unsigned sort key
+ * \note Signed values are offset by the sign bit, so keys always compare unsigned
+ */
+uint64_t Compile_int_SwitchKey(const tSwitchLowering *SW, uint64_t Value)
+{
+	if( SW->Bits < 64 ) {
+		Value &= (1ULL << SW->Bits) - 1;
+		if( SW->bSigned && (Value >> (SW->Bits-1)) )
+			Value |= ~0ULL << SW->Bits;
+	}
+	return (SW->bSigned ? Value ^ (1ULL << 63) : Value);
+}
+
+tReg Compile_int_SwitchConstant(tCompileState *State, const tSwitchLowering *SW, uint64_t Key)
+{
+	return Compile_int_Constant(State, SW->Type, (SW->bSigned ? Key ^ (1ULL << 63) : Key));
+}
+
+/**
+ * \brief Group the sorted cases into jump tables, bit tests and single ranges
+ */
+void Compile_int_SwitchCluster(tSwitchLowering *SW)
+{
+	SW->nClusters = 0;
+	for( int i = 0; i < SW->nCases; )
+	{
+		tSwitchCluster	*c = &SW->Clusters[SW->nClusters++];
+		c->Kind = SWITCHCLUSTER_RANGE;
+		c->First = c->Last = i;
+
+		// Largest dense enough run for a table
+		uint64_t	covered = 0;
+		for( int j = i; j < SW->nCases && SW->Cases[j].Hi - SW->Cases[i].Lo < SWITCH_TABLE_MAX_SIZE; j ++ )
+		{
+			covered += SW->Cases[j].Hi - SW->Cases[j].Lo + 1;
+			uint64_t	span = SW->Cases[j].Hi - SW->Cases[i].Lo + 1;
+			if( j - i + 1 >= SWITCH_TABLE_MIN_CASES && covered*100 >= span*SWITCH_TABLE_MIN_DENSITY ) {
+				c->Kind = SWITCHCLUSTER_TABLE;
+				c->Last = j;
+			}
+		}
+
+		// Otherwise, few destinations within a word are picked with masks
+		if( c->Kind == SWITCHCLUSTER_RANGE )
+		{
+			tIRMBlock	*targets[SWITCH_BITTEST_MAX_TARGETS];
+			 int	ntargets = 0, ncmps = 0;
+			for( int j = i; j < SW->nCases && SW->Cases[j].Hi - SW->Cases[i].Lo < SWITCH_BITTEST_BITS; j ++ )
+			{
+				 int	t;
+				for( t = 0; t < ntargets && targets[t] != SW->Cases[j].Target; t ++ )
+					;
+				if( t == ntargets ) {
+					if( ntargets == SWITCH_BITTEST_MAX_TARGETS )
+						break;
+					targets[ntargets++] = SW->Cases[j].Target;
+				}
+				ncmps += (SW->Cases[j].Lo == SW->Cases[j].Hi ? 1 : 2);
+				// Each extra destination costs a test, so needs more comparisons replaced
+				if( ncmps >= 2 + ntargets + (ntargets > 1) ) {
+					c->Kind = SWITCHCLUSTER_BITTEST;
+					c->Last = j;
+				}
+			}
+		}
+		c->Lo = SW->Cases[c->First].Lo;
+		c->Hi = SW->Cases[c->Last].Hi;
+		i = c->Last + 1;
+	}
+}
+
+/**
+ * \brief Emit a binary search over clusters \a First to \a Last
+ * \param BoundLo,BoundHi	Keys the value is known to be between
+ */
+void Compile_int_SwitchTree(tCompileState *State, tSwitchLowering *SW, int First, int Last, uint64_t BoundLo, uint64_t BoundHi)
+{
+	tIRMHandle	h = State->Handle;
+	if( Last - First < SWITCH_LINEAR_MAX )
+	{
+		for( int i = First; i <= Last; i ++ )
+		{
+			const tSwitchCluster	*c = &SW->Clusters[i];
+			tIRMBlock	*next = (i == Last ? SW->Default : IRM_CreateBlock(h));
+			Compile_int_SwitchLeaf(State, SW, c, BoundLo, BoundHi, next);
+			if( i == Last )
+				break;
+			IRM_SetBlock(h, next);
+			// A failed range test at either end narrows the value
+			if( c->Kind == SWITCHCLUSTER_RANGE && c->Lo == BoundLo )
+				BoundLo = c->Hi + 1;
+			else if( c->Kind == SWITCHCLUSTER_RANGE && c->Hi == BoundHi )
+				BoundHi = c->Lo - 1;
+		}
+		return ;
+	}
+
+	 int	mid = (First + Last + 1) / 2;
+	uint64_t	pivot = SW->Clusters[mid].Lo;
+	tIRMBlock	*left = IRM_CreateBlock(h), *right = IRM_CreateBlock(h);
+	tReg	cnd = AllocateRegister(State, TYPE_INT);
+	IRM_AppendBinOp(h, IRMOP_CMPLT, SW->Flags, cnd, SW->Value, Compile_int_SwitchConstant(State, SW, pivot));
+	IRM_AppendBranch(h, cnd, left, right);
+	IRM_SetBlock(h, left);
+	Compile_int_SwitchTree(State, SW, First, mid-1, BoundLo, pivot-1);
+	IRM_SetBlock(h, right);
+	Compile_int_SwitchTree(State, SW, mid, Last, pivot, BoundHi);
+}
+
+/**
+ * \brief Test for one cluster, jumping to \a Fail if the value isn't in it
+ */
+void Compile_int_SwitchLeaf(tCompileState *State, tSwitchLowering *SW, const tSwitchCluster *C, uint64_t BoundLo, uint64_t BoundHi, tIRMBlock *Fail)
+{
+	tIRMHandle	h = State->Handle;
+	bool	exact = (C->Lo == BoundLo && C->Hi == BoundHi);
+	tReg	cnd, idx;
+
+	if( C->Kind == SWITCHCLUSTER_RANGE )
+	{
+		tIRMBlock	*target = SW->Cases[C->First].Target;
+		if( exact ) {
+			IRM_AppendJump(h, target);
+			return ;
+		}
+		cnd = AllocateRegister(State, TYPE_INT);
+		if( C->Lo == C->Hi )
+			IRM_AppendBinOp(h, IRMOP_CMPEQ, 0, cnd, SW->Value, Compile_int_SwitchConstant(State, SW, C->Lo));
+		else if( C->Lo == BoundLo )
+			IRM_AppendBinOp(h, IRMOP_CMPLE, SW->Flags, cnd, SW->Value, Compile_int_SwitchConstant(State, SW, C->Hi));
+		else if( C->Hi == BoundHi )
+			IRM_AppendBinOp(h, IRMOP_CMPGE, SW->Flags, cnd, SW->Value, Compile_int_SwitchConstant(State, SW, C->Lo));
+		else {
+			// Lo <= v <= Hi as one unsigned compare
+			idx = AllocateRegister(State, SW->Type);
+			IRM_AppendBinOp(h, IRMOP_SUB, 0, idx, SW->Value, Compile_int_SwitchConstant(State, SW, C->Lo));
+			IRM_AppendBinOp(h, IRMOP_CMPLE, 0, cnd, idx, Compile_int_Constant(State, SW->Type, C->Hi - C->Lo));
+		}
+		IRM_AppendBranch(h, cnd, target, Fail);
+		return ;
+	}
+
+	// Offset into the cluster, checked unless the search already bounded it
+	idx = SW->Value;
+	if( C->Lo != Compile_int_SwitchKey(SW, 0) ) {
+		idx = AllocateRegister(State, SW->Type);
+		IRM_AppendBinOp(h, IRMOP_SUB, 0, idx, SW->Value, Compile_int_SwitchConstant(State, SW, C->Lo));
+	}
+	if( !exact ) {
+		tIRMBlock	*in_range = IRM_CreateBlock(h);
+		cnd = AllocateRegister(State, TYPE_INT);
+		IRM_AppendBinOp(h, IRMOP_CMPLE, 0, cnd, idx, Compile_int_Constant(State, SW->Type, C->Hi - C->Lo));
+		IRM_AppendBranch(h, cnd, in_range, Fail);
+		IRM_SetBlock(h, in_range);
+	}
+
+	if( C->Kind == SWITCHCLUSTER_TABLE )
+	{
+		 int	count = C->Hi - C->Lo + 1;
+		tIRMBlock	**targets = malloc(count * sizeof(tIRMBlock*));
+		for( int i = 0; i < count; i ++ )
+			targets[i] = SW->Default;
+		for( int i = C->First; i <= C->Last; i ++ )
+		{
+			for( uint64_t k = SW->Cases[i].Lo - C->Lo; k <= SW->Cases[i].Hi - C->Lo; k ++ )
+				targets[k] = SW->Cases[i].Target;
+		}
+		// (the backend scales the index as an address register)
+		if( Types_GetSizeOf(IRM_GetRegType(h, idx)) != Types_GetSizeOf(TYPE_SIZE) )
+			idx = Compile_int_Convert(State, idx, TYPE_SIZE);
+		IRM_AppendSwitch(h, idx, count, targets);
+		free(targets);
+		return ;
+	}
+
+	// Bit test: `(1 << idx) & mask` for each destination, most common first
+	tIRMBlock	*targets[SWITCH_BITTEST_MAX_TARGETS];
+	uint32_t	masks[SWITCH_BITTEST_MAX_TARGETS];
+	 int	counts[SWITCH_BITTEST_MAX_TARGETS];
+	 int	ntargets = 0;
+	for( int i = C->First; i <= C->Last; i ++ )
+	{
+		const tSwitchCase	*c = &SW->Cases[i];
+		 int	t;
+		for( t = 0; t < ntargets && targets[t] != c->Target; t ++ )
+			;
+		if( t == ntargets ) {
+			targets[t] = c->Target;
+			masks[t] = 0;
+			counts[t] = 0;
+			ntargets ++;
+		}
+		for( uint64_t k = c->Lo - C->Lo; k <= c->Hi - C->Lo; k ++ )
+			masks[t] |= 1U << k;
+		counts[t] += c->Hi - c->Lo + 1;
+	}
+	for( int i = 1; i < ntargets; i ++ )
+	{
+		for( int j = i; j > 0 && counts[j] > counts[j-1]; j -- )
+		{
+			tIRMBlock	*tb = targets[j];	targets[j] = targets[j-1];	targets[j-1] = tb;
+			uint32_t	tm = masks[j];	masks[j] = masks[j-1];	masks[j-1] = tm;
+			 int	tc = counts[j];	counts[j] = counts[j-1];	counts[j-1] = tc;
+		}
+	}
+
+	if( Types_GetSizeOf(SW->Type) > Types_GetSizeOf(TYPE_UINT) )
+		idx = Compile_int_Convert(State, idx, TYPE_UINT);
+	tReg	bit = AllocateRegister(State, TYPE_UINT);
+	IRM_AppendBinOp(h, IRMOP_SHL, 0, bit, Compile_int_Constant(State, TYPE_UINT, 1), idx);
+	uint32_t	all = 0, full = (C->Hi - C->Lo == 31 ? ~0U : (2U << (C->Hi - C->Lo)) - 1);
+	for( int t = 0; t < ntargets; t ++ )
+	{
+		all |= masks[t];
+		// The last destination takes everything else in range
+		if( t == ntargets-1 && all == full ) {
+			IRM_AppendJump(h, targets[t]);
+			return ;
+		}
+		tIRMBlock	*next = (t == ntargets-1 ? Fail : IRM_CreateBlock(h));
+		tReg	hit = AllocateRegister(State, TYPE_UINT);
+		IRM_AppendBinOp(h, IRMOP_AND, 0, hit, bit, Compile_int_Constant(State, TYPE_UINT, masks[t]));
+		IRM_AppendBranch(h, hit, targets[t], next);
+		IRM_SetBlock(h, next);
+	}
+}
+
+/**
+ * \brief Decide if (and how far) a `for` loop is unrolled
+ *
+ * The loop has to step a local integer by a constant and compare it against
+ * a constant or a local that the body doesn't change. Small constant trip
+ * counts are unrolled completely, others are unrolled by a factor picked
+ * from the body size (or `#pragma unroll N`).
+ */
+bool Compile_int_PlanUnroll(tCompileState *State, tAST_Node *Node, tLoopInfo *Loop)
+{
+	tIRMHandle	h = State->Handle;
+	 int	hint = Node->For.Unroll;
+	if( hint == 1 )
+		return false;
+	if( hint > UNROLL_HINT_MAX )
+		hint = UNROLL_HINT_MAX;
+
+	// Increment: `i++`, `i += c`, `i = i - c`...
+	tAST_Node	*var = Compile_int_LoopStep(Node->For.Next, &Loop->Step);
+	if( !var )
+		return false;
+	Loop->Local = Compile_int_FindLocal(State, var->Symbol.Name);
+	if( Loop->Local < 0 || h->Locals[Loop->Local].bAddressTaken )
+		return false;
+	const tType	*vtype = h->Locals[Loop->Local].Type;
+	if( vtype->Class != TYPECLASS_INTEGER || vtype->bVolatile || Types_GetSizeOf(vtype) < Types_GetSizeOf(TYPE_INT) )
+		return false;
+
+	// Condition: `i <op> bound` (either way around)
+	tAST_Node	*test = Node->For.Test;
+	if( test->Type < NODETYPE_NOTEQUALS || test->Type > NODETYPE_GREATERTHANEQU )
+		return false;
+	Loop->Cmp = test->Type;
+	if( Compile_int_IsNamed(test->BinOp.Left, var->Symbol.Name) )
+		Loop->Bound = test->BinOp.Right;
+	else if( Compile_int_IsNamed(test->BinOp.Right, var->Symbol.Name) ) {
+		Loop->Bound = test->BinOp.Left;
+		switch(Loop->Cmp)
+		{
+		case NODETYPE_LESSTHAN:	Loop->Cmp = NODETYPE_GREATERTHAN;	break;
+		case NODETYPE_LESSTHANEQU:	Loop->Cmp = NODETYPE_GREATERTHANEQU;	break;
+		case NODETYPE_GREATERTHAN:	Loop->Cmp = NODETYPE_LESSTHAN;	break;
+		case NODETYPE_GREATERTHANEQU:	Loop->Cmp = NODETYPE_LESSTHANEQU;	break;
+		default:	break;
+		}
+	}
+	else
+		return false;
+
+	const tType	*btype = TYPE_INT;
+	const char	*bound_var = NULL;
+	bool	is_const = false;
+	uint64_t	end = 0;
+	if( Loop->Bound->Type == NODETYPE_INTEGER ) {
+		end = Loop->Bound->Integer.Value;
+		btype = AST_GetIntegerType(Loop->Bound);
+		is_const = true;
+	}
+	else if( Loop->Bound->Type == NODETYPE_SYMBOL ) {
+		 int	lcl = Compile_int_FindLocal(State, Loop->Bound->Symbol.Name);
+		if( lcl >= 0 ) {
+			btype = h->Locals[lcl].Type;
+			if( h->Locals[lcl].bAddressTaken || btype->bVolatile )
+				return false;
+			if( btype->Class != TYPECLASS_INTEGER && btype->Class != TYPECLASS_ENUM )
+				return false;
+			bound_var = Loop->Bound->Symbol.Name;
+		}
+		else if( Types_GetEnumValue(Loop->Bound->Symbol.Name, &end) )
+			is_const = true;
+		else
+			return false;
+	}
+	else
+		return false;
+	// (a wider bound would need the variable extended for every test)
+	Loop->CmpType = Compile_int_ArithType(vtype, btype);
+	if( Types_GetSizeOf(Loop->CmpType) != Types_GetSizeOf(vtype) )
+		return false;
+
+	// Neither may change inside the loop
+	Loop->Cost = Compile_int_LoopBodyCost(Node->For.Action, var->Symbol.Name, bound_var);
+	if( Loop->Cost < 0 )
+		return false;
+	Loop->Cost += Compile_int_LoopBodyCost(Node->For.Next, NULL, NULL);
+
+	// Constant start and bound: count the iterations
+	Loop->Trips = -1;
+	tAST_Node	*init = Node->For.Init;
+	if( is_const && init->Type == NODETYPE_ASSIGN && Compile_int_IsNamed(init->Assign.To, var->Symbol.Name)
+	 && init->Assign.From->Type == NODETYPE_INTEGER )
+	{
+		 int	limit = (hint == FOR_UNROLL_FULL ? UNROLL_HINT_MAX : (hint ? hint : UNROLL_FULL_MAX_TRIPS));
+		end = IRM_NormaliseConstant(Loop->CmpType, IRM_NormaliseConstant(btype, end));
+		 int	trips = Compile_int_LoopTripCount(Loop, vtype,
+			IRM_NormaliseConstant(vtype, init->Assign.From->Integer.Value), end, limit);
+		if( trips >= 0 && (hint || trips * Loop->Cost <= UNROLL_FULL_MAX_NODES) ) {
+			Loop->Trips = trips;
+			return true;
+		}
+	}
+
+	// Otherwise the number of iterations is calculated on entry
+	switch(Loop->Cmp)
+	{
+	case NODETYPE_LESSTHAN:
+	case NODETYPE_LESSTHANEQU:
+		if( Loop->Step < 0 )
+			return false;
+		break;
+	case NODETYPE_GREATERTHAN:
+	case NODETYPE_GREATERTHANEQU:
+		if( Loop->Step > 0 )
+			return false;
+		break;
+	default:
+		// `!=` only stops reliably when it can't step over the bound
+		if( Loop->Step != 1 && Loop->Step != -1 )
+			return false;
+		break;
+	}
+	if( hint > 1 )
+		Loop->Factor = hint;
+	else {
+		Loop->Factor = UNROLL_MAX_FACTOR;
+		while( Loop->Factor > 1 && Loop->Factor * Loop->Cost > UNROLL_PARTIAL_MAX_NODES )
+			Loop->Factor /= 2;
+	}
+	return Loop->Factor > 1;
+}
+
+/**
+ * \brief Get the variable and constant step of a loop increment
+ * \return Variable node, NULL if \a Next isn't a constant step
+ */
+tAST_Node *Compile_int_LoopStep(tAST_Node *Next, int64_t *Step)
+{
+	tAST_Node	*var, *amount;
+	bool	negative;
+	switch(Next->Type)
+	{
+	case NODETYPE_POSTINC:
+	case NODETYPE_PREINC:
+	case NODETYPE_POSTDEC:
+	case NODETYPE_PREDEC:
+		var = Next->UniOp.Value;
+		*Step = (Next->Type == NODETYPE_POSTINC || Next->Type == NODETYPE_PREINC ? 1 : -1);
+		return (var->Type == NODETYPE_SYMBOL ? var : NULL);
+	case NODETYPE_ASSIGNOP:
+		if( Next->AssignOp.Op != NODETYPE_ADD && Next->AssignOp.Op != NODETYPE_SUBTRACT )
+			return NULL;
+		var = Next->AssignOp.To;
+		amount = Next->AssignOp.From;
+		negative = (Next->AssignOp.Op == NODETYPE_SUBTRACT);
+		break;
+	case NODETYPE_ASSIGN: {
+		tAST_Node	*val = Next->Assign.From;
+		var = Next->Assign.To;
+		if( var->Type != NODETYPE_SYMBOL || (val->Type != NODETYPE_ADD && val->Type != NODETYPE_SUBTRACT) )
+			return NULL;
+		negative = (val->Type == NODETYPE_SUBTRACT);
+		if( Compile_int_IsNamed(val->BinOp.Left, var->Symbol.Name) )
+			amount = val->BinOp.Right;
+		else if( !negative && Compile_int_IsNamed(val->BinOp.Right, var->Symbol.Name) )
+			amount = val->BinOp.Left;
+		else
+			return NULL;
+		break; }
+	default:
+		return NULL;
+	}
+	if( var->Type != NODETYPE_SYMBOL || amount->Type != NODETYPE_INTEGER )
+		return NULL;
+	if( amount->Integer.Value == 0 || amount->Integer.Value > INT32_MAX )
+		return NULL;
+	*Step = (negative ? -(int64_t)amount->Integer.Value : (int64_t)amount->Integer.Value);
+	return var;
+}
+
+bool Compile_int_IsNamed(tAST_Node *Node, const char *Name)
+{
+	return Name && Node->Type == NODETYPE_SYMBOL && strcmp(Node->Symbol.Name, Name) == 0;
+}
+
+/**
+ * \brief Size of a loop body, checking that it leaves the loop variables alone
+ * \return Number of AST nodes, -1 if \a Var or \a Bound is written, has its
+ *         address taken, or is shadowed
+ */
+int Compile_int_LoopBodyCost(tAST_Node *Node, const char *Var, const char *Bound)
+{
+	 int	cost = 1, sub;
+	#define ADD_COST(n)	do { \
+		if( (sub = Compile_int_LoopBodyCost((n), Var, Bound)) < 0 ) \
+			return -1; \
+		cost += sub; \
+	} while(0)
+	switch(Node->Type)
+	{
+	case NODETYPE_BLOCK:
+		for( tAST_Node *stmt = Node->CodeBlock.FirstStatement; stmt; stmt = stmt->NextSibling )
+			ADD_COST(stmt);
+		break;
+	case NODETYPE_SWITCH:
+		ADD_COST(Node->Switch.Condition);
+		for( tAST_Node *stmt = Node->Switch.FirstStatement; stmt; stmt = stmt->NextSibling )
+			ADD_COST(stmt);
+		break;
+	case NODETYPE_FUNCTIONCALL:
+		ADD_COST(Node->FunctionCall.Function);
+		for( tAST_Node *arg = Node->FunctionCall.FirstArgument; arg; arg = arg->NextSibling )
+			ADD_COST(arg);
+		break;
+	case NODETYPE_IF:
+	case NODETYPE_CONDITIONAL:
+		ADD_COST(Node->If.Test);
+		ADD_COST(Node->If.True);
+		ADD_COST(Node->If.False);
+		break;
+	case NODETYPE_WHILE:
+	case NODETYPE_DOWHILE:
+		ADD_COST(Node->While.Test);
+		ADD_COST(Node->While.Action);
+		break;
+	case NODETYPE_FOR:
+		ADD_COST(Node->For.Init);
+		ADD_COST(Node->For.Test);
+		ADD_COST(Node->For.Next);
+		ADD_COST(Node->For.Action);
+		break;
+	case NODETYPE_LOCALVAR: {
+		const char	*name = Node->LocalVariable.Sym->Name;
+		if( (Var && strcmp(name, Var) == 0) || (Bound && strcmp(name, Bound) == 0) )
+			return -1;
+		if( Node->LocalVariable.Sym->Value )
+			ADD_COST(Node->LocalVariable.Sym->Value);
+		break; }
+	case NODETYPE_ADDROF:
+	case NODETYPE_POSTINC ... NODETYPE_PREDEC:
+		if( Compile_int_IsNamed(Node->UniOp.Value, Var) || Compile_int_IsNamed(Node->UniOp.Value, Bound) )
+			return -1;
+		ADD_COST(Node->UniOp.Value);
+		break;
+	case NODETYPE_NEGATE ... NODETYPE_DEREF:
+	case NODETYPE_RETURN:
+		ADD_COST(Node->UniOp.Value);
+		break;
+	case NODETYPE_CAST:
+		ADD_COST(Node->Cast.Value);
+		break;
+	case NODETYPE_MEMBER:
+		ADD_COST(Node->Member.Struct);
+		break;
+	case NODETYPE_ASSIGN:
+	case NODETYPE_ASSIGNOP:
+		if( Compile_int_IsNamed(Node->Assign.To, Var) || Compile_int_IsNamed(Node->Assign.To, Bound) )
+			return -1;
+		ADD_COST(Node->Assign.To);
+		ADD_COST(Node->Assign.From);
+		break;
+	case NODETYPE_INDEX:
+	case NODETYPE_ADD ... NODETYPE_BOOLAND:
+		ADD_COST(Node->BinOp.Left);
+		ADD_COST(Node->BinOp.Right);
+		break;
+	default:
+		break;
+	}
+	#undef ADD_COST
+	return cost;
+}
+
+/**
+ * \brief Run a loop with a constant start and bound
+ * \return Number of iterations, -1 if more than \a Limit (or the variable overflows)
+ */
+int Compile_int_LoopTripCount(const tLoopInfo *Loop, const tType *VarType, uint64_t Start, uint64_t End, int Limit)
+{
+	enum eIRMOpcodes	op;
+	switch(Loop->Cmp)
+	{
+	case NODETYPE_NOTEQUALS:	op = IRMOP_CMPNE;	break;
+	case NODETYPE_LESSTHAN: 	op = IRMOP_CMPLT;	break;
+	case NODETYPE_LESSTHANEQU:	op = IRMOP_CMPLE;	break;
+	case NODETYPE_GREATERTHAN:	op = IRMOP_CMPGT;	break;
+	default:	op = IRMOP_CMPGE;	break;
+	}
+	unsigned int	flags = (Compile_int_IsSigned(Loop->CmpType) ? IRMFLAG_SIGNED : 0);
+	uint64_t	val = Start;
+	for( int trips = 0; trips <= Limit; trips ++ )
+	{
+		uint64_t	cond;
+		IRM_FoldOperation(op, flags, TYPE_INT, IRM_NormaliseConstant(Loop->CmpType, val), End, &cond);
+		if( !cond )
+			return trips;
+		uint64_t	next = IRM_NormaliseConstant(VarType, val + Loop->Step);
+		// Signed overflow is undefined, leave the loop as written
+		if( VarType->Integer.bSigned && (Loop->Step > 0 ? (int64_t)next < (int64_t)val : (int64_t)next > (int64_t)val) )
+			return -1;
+		val = next;
+	}
+	return -1;
+}
+
+/**
+ * \brief Convert a `for` loop selected by Compile_int_PlanUnroll
+ *
+ * The condition can't have side effects, so it is only tested where the
+ * number of iterations left isn't known.
+ */
+int Compile_int_ConvertUnrolledFor(tCompileState *State, tAST_Node *Node, const tLoopInfo *Loop)
+{
+	tIRMHandle	h = State->Handle;
+	tIRMBlock	*end_blk = IRM_CreateBlock(h);
+	if( Compile_int_ConvertStatement(State, Node->For.Init) )
+		return 1;
+
+	if( Loop->Trips >= 0 )
+	{
+		for( int i = 0; i < Loop->Trips; i ++ )
+		{
+			if( Compile_int_ConvertIteration(State, Node, end_blk) )
+				return 1;
+		}
+		IRM_AppendJump(h, end_blk);
+		IRM_SetBlock(h, end_blk);
+		return 0;
+	}
+
+	// if( test ) {
+	//   count = <iterations>;
+	//   for( ; count >= factor; count -= factor ) { <body; next> * factor }
+	//   for( ; test; next ) body;	// The rest
+	// }
+	tIRMBlock	*count_blk = IRM_CreateBlock(h);
+	tIRMBlock	*main_test = IRM_CreateBlock(h);
+	tIRMBlock	*main_blk = IRM_CreateBlock(h);
+	tIRMBlock	*rest_test = IRM_CreateBlock(h);
+	tIRMBlock	*rest_blk = IRM_CreateBlock(h);
+	if( Compile_int_ConvertCondition(State, Node->For.Test, count_blk, end_blk) )
+		return 1;
+
+	// Distance to the bound, then iterations (the differences always fit unsigned)
+	IRM_SetBlock(h, count_blk);
+	const tType	*utype = Types_CreateIntegerType(false, Loop->CmpType->Integer.Size);
+	tReg	var = AllocateRegister(State, h->Locals[Loop->Local].Type);
+	tReg	bound;
+	IRM_AppendLoadLocal(h, var, Loop->Local);
+	var = Compile_int_Convert(State, Compile_int_Convert(State, var, Loop->CmpType), utype);
+	if( Compile_ConvertNode(State, Loop->Bound, &bound) )
+		return 1;
+	bound = Compile_int_Convert(State, Compile_int_Convert(State, bound, Loop->CmpType), utype);
+	tReg	count = AllocateRegister(State, utype);
+	if( Loop->Step > 0 )
+		IRM_AppendBinOp(h, IRMOP_SUB, 0, count, bound, var);
+	else
+		IRM_AppendBinOp(h, IRMOP_SUB, 0, count, var, bound);
+	uint64_t	step = (Loop->Step > 0 ? Loop->Step : -Loop->Step);
+	bool	inclusive = (Loop->Cmp == NODETYPE_LESSTHANEQU || Loop->Cmp == NODETYPE_GREATERTHANEQU);
+	// exclusive: (d - 1) / step + 1, inclusive: d / step + 1
+	// (an inclusive count wrapping to zero just leaves everything to the second loop)
+	if( step != 1 )
+	{
+		tReg	t;
+		if( !inclusive ) {
+			t = AllocateRegister(State, utype);
+			IRM_AppendBinOp(h, IRMOP_SUB, 0, t, count, Compile_int_Constant(State, utype, 1));
+			count = t;
+		}
+		t = AllocateRegister(State, utype);
+		IRM_AppendBinOp(h, IRMOP_DIV, 0, t, count, Compile_int_Constant(State, utype, step));
+		count = t;
+	}
+	if( step != 1 || inclusive )
+	{
+		tReg	t = AllocateRegister(State, utype);
+		IRM_AppendBinOp(h, IRMOP_ADD, 0, t, count, Compile_int_Constant(State, utype, 1));
+		count = t;
+	}
+	 int	counter = IRM_AddLocal(h, utype, NULL);
+	h->Locals[counter].Scope = State->Scope;
+	IRM_AppendStoreLocal(h, counter, count);
+	IRM_AppendJump(h, main_test);
+
+	IRM_SetBlock(h, main_test);
+	tReg	left = AllocateRegister(State, utype);
+	tReg	cond = AllocateRegister(State, TYPE_INT);
+	IRM_AppendLoadLocal(h, left, counter);
+	IRM_AppendBinOp(h, IRMOP_CMPGE, 0, cond, left, Compile_int_Constant(State, utype, Loop->Factor));
+	IRM_AppendBranch(h, cond, main_blk, rest_test);
+
+	IRM_SetBlock(h, main_blk);
+	left = AllocateRegister(State, utype);
+	IRM_AppendLoadLocal(h, left, counter);
+	count = AllocateRegister(State, utype);
+	IRM_AppendBinOp(h, IRMOP_SUB, 0, count, left, Compile_int_Constant(State, utype, Loop->Factor));
+	IRM_AppendStoreLocal(h, counter, count);
+	for( int i = 0; i < Loop->Factor; i ++ )
+	{
+		if( Compile_int_ConvertIteration(State, Node, end_blk) )
+			return 1;
+	}
+	IRM_AppendJump(h, main_test);
+
+	IRM_SetBlock(h, rest_test);
+	if( Compile_int_ConvertCondition(State, Node->For.Test, rest_blk, end_blk) )
+		return 1;
+	IRM_SetBlock(h, rest_blk);
+	if( Compile_int_ConvertIteration(State, Node, end_blk) )
+		return 1;
+	IRM_AppendJump(h, rest_test);
+
+	IRM_SetBlock(h, end_blk);
+	return 0;
+}
+
+/**
+ * \brief Emit one copy of a loop body followed by the increment
+ */
+int Compile_int_ConvertIteration(tCompileState *State, tAST_Node *Node, tIRMBlock *BreakTarget)
+{
+	tIRMBlock	*next_blk = IRM_CreateBlock(State->Handle);
+	tCompileState	new_state;
+	Compile_InitSubState(State, &new_state);
+	new_state.BreakTarget = BreakTarget;
+	new_state.ContinueTarget = next_blk;
+	 int	rv = Compile_int_ConvertStatement(&new_state, Node->For.Action);
+	Compile_ClearSubState(&new_state);
+	if( rv )
+		return 1;
+	IRM_AppendJump(State->Handle, next_blk);
+	IRM_SetBlock(State->Handle, next_blk);
+	return Compile_int_ConvertStatement(State, Node->For.Next);
+}
+
+/**
+ * \brief Convert a value-producing `&&`, `||` or `?:`
+ * \note Uses a temporary local, which SSA construction turns into a phi
+ */
+int Compile_int_ConvertLogical(tCompileState *State, tAST_Node *Node, tReg *OutReg)
+{
+	 int	budget = SPECULATE_MAX_NODES;
+	// A cheap right hand side is always evaluated: `(l != 0) & (r != 0)` needs no branches
+	if( Node->Type != NODETYPE_CONDITIONAL && Compile_int_IsSpeculatable(State, Node->BinOp.Right, &budget) )
+	{
+		tReg	left, right;
+		if( Compile_int_ConvertBoolean(State, Node->BinOp.Left, &left) )
+			return 1;
+		if( Compile_int_ConvertBoolean(State, Node->BinOp.Right, &right) )
+			return 1;
+		*OutReg = AllocateRegister(State, TYPE_INT);
+		IRM_AppendBinOp(State->Handle, (Node->Type == NODETYPE_BOOLAND ? IRMOP_AND : IRMOP_OR), 0, *OutReg, left, right);
+		return 0;
+	}
+
+	tIRMBlock	*true_blk = IRM_CreateBlock(State->Handle);
+	tIRMBlock	*false_blk = IRM_CreateBlock(State->Handle);
+	tIRMBlock	*end_blk = IRM_CreateBlock(State->Handle);
+	tReg	true_val, false_val;
+
+	if( Compile_int_ConvertCondition(State, (Node->Type == NODETYPE_CONDITIONAL ? Node->If.Test : Node), true_blk, false_blk) )
+		return 1;
+
+	IRM_SetBlock(State->Handle, true_blk);
+	if( Node->Type == NODETYPE_CONDITIONAL ) {
+		if( Compile_ConvertNode(State, Node->If.True, &true_val) )
+			return 1;
+	}
+	else {
+		true_val = Compile_int_Constant(State, TYPE_INT, 1);
+	}
+	const tType	*type = IRM_GetRegType(State->Handle, true_val);
+	 int	tmp = IRM_AddLocal(State->Handle, type, NULL);
+	IRM_AppendStoreLocal(State->Handle, tmp, true_val);
+	IRM_AppendJump(State->Handle, end_blk);
+
+	IRM_SetBlock(State->Handle, false_blk);
+	if( Node->Type == NODETYPE_CONDITIONAL ) {
+		if( Compile_ConvertNode(State, Node->If.False, &false_val) )
+			return 1;
+		false_val = Compile_int_Convert(State, false_val, type);
+	}
+	else {
+		false_val = Compile_int_Constant(State, TYPE_INT, 0);
+	}
+	IRM_AppendStoreLocal(State->Handle, tmp, false_val);
+	IRM_AppendJump(State->Handle, end_blk);
+
+	IRM_SetBlock(State->Handle, end_blk);
+	*OutReg = AllocateRegister(State, type);
+	IRM_AppendLoadLocal(State->Handle, *OutReg, tmp);
+	return 0;
+}
+
+/**
+ * \brief Check if an expression can be evaluated even when C says it isn't
+ *
+ * Only small integer expressions of variables qualify: nothing that could
+ * fault (dereferences, division), has side effects or reads volatile data.
+ * \param Budget	Nodes that may still be accepted
+ */
+bool Compile_int_IsSpeculatable(tCompileState *State, tAST_Node *Node, int *Budget)
+{
+	const tType	*type;
+	uint64_t	val;
+	if( -- *Budget < 0 )
+		return false;
+	switch(Node->Type)
+	{
+	case NODETYPE_INTEGER:
+		return true;
+	case NODETYPE_SYMBOL: {
+		 int	lcl = Compile_int_FindLocal(State, Node->Symbol.Name);
+		if( lcl >= 0 )
+			type = State->Handle->Locals[lcl].Type;
+		else if( Types_GetEnumValue(Node->Symbol.Name, &val) )
+			return true;
+		else {
+			tSymbol	*sym = Compile_int_ResolveSymbol(State, Node->Symbol.Name);
+			if( !sym )
+				return false;
+			type = sym->Type;
+		}
+		if( type->bVolatile )
+			return false;
+		return type->Class == TYPECLASS_INTEGER || type->Class == TYPECLASS_POINTER || type->Class == TYPECLASS_ENUM; }
+	case NODETYPE_NEGATE:
+	case NODETYPE_BWNOT:
+	case NODETYPE_LOGICNOT:
+		return Compile_int_IsSpeculatable(State, Node->UniOp.Value, Budget);
+	case NODETYPE_ADD ... NODETYPE_MULTIPLY:
+	case NODETYPE_BWOR ... NODETYPE_BOOLAND:
+		return Compile_int_IsSpeculatable(State, Node->BinOp.Left, Budget)
+			&& Compile_int_IsSpeculatable(State, Node->BinOp.Right, Budget);
+	default:
+		return false;
+	}
+}
+
+/**
+ * \brief Convert an expression to 0/1 (`Node != 0`)
+ */
+int Compile_int_ConvertBoolean(tCompileState *State, tAST_Node *Node, tReg *OutReg)
+{
+	tReg	val;
+	if( Compile_ConvertNode(State, Node, &val) )
+		return 1;
+	switch(Node->Type)
+	{
+	case NODETYPE_LOGICNOT:
+	case NODETYPE_EQUALS ... NODETYPE_BOOLAND:
+		*OutReg = val;
+		break;
+	default:
+		*OutReg = AllocateRegister(State, TYPE_INT);
+		IRM_AppendBinOp(State->Handle, IRMOP_CMPNE, 0, *OutReg, val,
+			Compile_int_Constant(State, IRM_GetRegType(State->Handle, val), 0));
+		break;
+	}
+	return 0;
+}
+
+/**
+ * \brief Emit a binary operation, handling pointer arithmetic and promotions
+ */
+int Compile_int_ConvertBinOp(tCompileState *State, tAST_Node *Node, int NodeType, tReg Left, tReg Right, tReg *OutReg)
+{
+	const tType	*ltype = IRM_GetRegType(State->Handle, Left);
+	const tType	*rtype = IRM_GetRegType(State->Handle, Right);
+	bool	lptr = (ltype->Class == TYPECLASS_POINTER);
+	bool	rptr = (rtype->Class == TYPECLASS_POINTER);
+	const tType	*type;
+	enum eIRMOpcodes	op;
+
+	switch(NodeType)
+	{
+	case NODETYPE_ADD:	op = IRMOP_ADD;	break;
+	case NODETYPE_SUBTRACT:	op = IRMOP_SUB;	break;
+	case NODETYPE_MULTIPLY:	op = IRMOP_MUL;	break;
+	case NODETYPE_DIVIDE:	op = IRMOP_DIV;	break;
+	case NODETYPE_MODULO:	op = IRMOP_MOD;	break;
+	case NODETYPE_BWOR:	op = IRMOP_OR; 	break;
+	case NODETYPE_BWAND:	op = IRMOP_AND;	break;
+	case NODETYPE_BWXOR:	op = IRMOP_XOR;	break;
+	case NODETYPE_BITSHIFTLEFT:	op = IRMOP_SHL;	break;
+	case NODETYPE_BITSHIFTRIGHT:	op = IRMOP_SHR;	break;
+	case NODETYPE_EQUALS:   	op = IRMOP_CMPEQ;	break;
+	case NODETYPE_NOTEQUALS:	op = IRMOP_CMPNE;	break;
+	case NODETYPE_LESSTHAN: 	op = IRMOP_CMPLT;	break;
+	case NODETYPE_LESSTHANEQU:	op = IRMOP_CMPLE;	break;
+	case NODETYPE_GREATERTHAN:	op = IRMOP_CMPGT;	break;
+	case NODETYPE_GREATERTHANEQU:	op = IRMOP_CMPGE;	break;
+	default:
+		CompileError(Node, "Unhandled binary operation %i", NodeType);
+		return 1;
+	}
+
+	// Pointer arithmetic
+	if( (lptr || rptr) && (op == IRMOP_ADD || op == IRMOP_SUB) )
+	{
+		if( lptr && rptr )
+		{
+			if( op != IRMOP_SUB ) {
+				CompileError(Node, "Adding two pointers");
+				return 1;
+			}
+			// (a - b) / sizeof(*a)
+			tReg	diff = AllocateRegister(State, TYPE_PTRDIFF);
+			IRM_AppendBinOp(State->Handle, IRMOP_SUB, 0, diff, Left, Right);
+			size_t	size = Compile_int_PointeeSize(ltype);
+			if( size == 1 ) {
+				*OutReg = diff;
+			}
+			else {
+				*OutReg = AllocateRegister(State, TYPE_PTRDIFF);
+				IRM_AppendBinOp(State->Handle, IRMOP_DIV, IRMFLAG_SIGNED, *OutReg, diff, Compile_int_Constant(State, TYPE_PTRDIFF, size));
+			}
+			return 0;
+		}
+		if( rptr ) {
+			if( op == IRMOP_SUB ) {
+				CompileError(Node, "Subtracting a pointer from an integer");
+				return 1;
+			}
+			tReg t = Left; Left = Right; Right = t;
+			ltype = rtype;
+		}
+		Right = Compile_int_Scale(State, Right, Compile_int_PointeeSize(ltype));
+		*OutReg = AllocateRegister(State, ltype);
+		IRM_AppendBinOp(State->Handle, op, 0, *OutReg, Left, Right);
+		return 0;
+	}
+
+	if( op == IRMOP_SHL || op == IRMOP_SHR )
+		type = Compile_int_ArithType(ltype, TYPE_INT);
+	else if( lptr || rptr )
+		type = TYPE_SIZE;	// Pointer comparisons (unsigned, at full width)
+	else
+		type = Compile_int_ArithType(ltype, rtype);
+	Left = Compile_int_Convert(State, Left, type);
+	Right = Compile_int_Convert(State, Right, (op == IRMOP_SHL || op == IRMOP_SHR ? TYPE_INT : type));
+
+	unsigned int	flags = (Compile_int_IsSigned(type) ? IRMFLAG_SIGNED : 0);
+	if( op >= IRMOP_CMPEQ )
+		type = TYPE_INT;
+	*OutReg = AllocateRegister(State, type);
+	IRM_AppendBinOp(State->Handle, op, flags, *OutReg, Left, Right);
+	return 0;
+}
+
+/**
+ * \brief Handle a local variable definition
+ */
+int Compile_int_DefineLocal(tCompileState *State, tAST_Node *Node)
+{
+	tSymbol	*sym = Node->LocalVariable.Sym;
+	if( sym->Global )
+	{
+		// Storage (and any initialiser) belongs to the global, this just brings the name into scope
+		tCompileLocal	*cl = malloc(sizeof(tCompileLocal));
+		cl->Name = sym->Name;
+		cl->Local = -1;
+		cl->Global = sym->Global;
+		cl->Next = State->Locals;
+		State->Locals = cl;
+		return 0;
+	}
+	 int	lcl = IRM_AddLocal(State->Handle, sym->Type, sym->Name);
+	State->Handle->Locals[lcl].Scope = State->Scope;
+
+	if( sym->Value )
+	{
+		tLValue	lv = {.Local = lcl, .Type = sym->Type};
+		if( Compile_int_InitialiseAt(State, sym->Value, &lv) )
+			return 1;
+	}
+
+	// Added after the initialiser, so `int x = x;` refers to the outer `x`
+	tCompileLocal	*cl = malloc(sizeof(tCompileLocal));
+	cl->Name = sym->Name;
+	cl->Local = lcl;
+	cl->Global = NULL;
+	cl->Next = State->Locals;
+	State->Locals = cl;
+	return 0;
+}
+
+/**
+ * \brief Store an initialiser (possibly braced) into a location
+ */
+int Compile_int_InitialiseAt(tCompileState *State, tAST_Node *Node, tLValue *Dest)
+{
+	if( Node->Type == NODETYPE_BLOB )
+		return Compile_int_InitialiseBlob(State, Node, Dest);
+	if( Node->Type != NODETYPE_BLOCK )
+	{
+		tReg	val;
+		if( Compile_ConvertNode(State, Node, &val) )
+			return 1;
+		Compile_int_StoreLValue(State, Dest, Compile_int_Convert(State, val, Dest->Type));
+		return 0;
+	}
+
+	// Braced initialiser, only valid on aggregates
+	const tType	*type = Dest->Type;
+	if( type->Class != TYPECLASS_ARRAY && type->Class != TYPECLASS_STRUCTURE && type->Class != TYPECLASS_UNION ) {
+		// `int x = {1};` is valid C
+		if( !Node->CodeBlock.FirstStatement ) {
+			CompileError(Node, "Empty scalar initialiser");
+			return 1;
+		}
+		return Compile_int_InitialiseAt(State, Node->CodeBlock.FirstStatement, Dest);
+	}
+
+	tReg	base;
+	if( Dest->Local >= 0 ) {
+		base = AllocateRegister(State, Types_CreatePointerType(type));
+		IRM_AppendLocalAddr(State->Handle, base, Dest->Local);
+	}
+	else {
+		base = Dest->Address;
+	}
+
+	 int	i = 0;
+	size_t	ofs = 0;
+	for( tAST_Node *val = Node->CodeBlock.FirstStatement; val; val = val->NextSibling, i ++ )
+	{
+		tLValue	ele = {.Local = -1};
+		if( type->Class == TYPECLASS_ARRAY ) {
+			ele.Type = type->Array.Type;
+			ofs = i * Types_GetSizeOf(ele.Type);
+		}
+		else {
+			if( i >= type->StructUnion->nFields ) {
+				CompileError(Node, "Excess elements in initialiser");
+				return 1;
+			}
+			ele.Type = type->StructUnion->Entries[i].Type;
+			ofs = Types_GetFieldOffset(type, i);
+		}
+		ele.Address = AllocateRegister(State, Types_CreatePointerType(ele.Type));
+		IRM_AppendBinOp(State->Handle, IRMOP_ADD, 0, ele.Address, base, Compile_int_Constant(State, TYPE_SIZE, ofs));
+		if( Compile_int_InitialiseAt(State, val, &ele) )
+			return 1;
+		if( type->Class == TYPECLASS_UNION )
+			break;
+	}
+	return 0;
+}
+
+/**
+ * \brief Initialise an array from constant data (see Parse_ConstantArray)
+ *
+ * The data, zero padded to the array's size, is placed in .rodata as a
+ * template and copied a word at a time. Small arrays are stored directly.
+ */
+int Compile_int_InitialiseBlob(tCompileState *State, tAST_Node *Node, tLValue *Dest)
+{
+	const tType	*type = Dest->Type;
+	if( type->Class != TYPECLASS_ARRAY || Types_GetSizeOf(type->Array.Type) != Types_GetSizeOf(Node->Blob.Type) ) {
+		CompileError(Node, "Initialiser doesn't match the array's element type");
+		return 1;
+	}
+	size_t	size = Types_GetSizeOf(type);
+	size_t	word = Types_GetSizeOf(TYPE_SIZE);
+	char	*data = calloc(1, size + 1);
+	memcpy(data, Node->Blob.Data, (Node->Blob.Length < size ? Node->Blob.Length : size));
+
+	tReg	base;
+	if( Dest->Local >= 0 ) {
+		base = AllocateRegister(State, Types_CreatePointerType(type));
+		IRM_AppendLocalAddr(State->Handle, base, Dest->Local);
+	}
+	else {
+		base = Dest->Address;
+	}
+
+	size_t	ofs = 0;
+	tReg	src = REG_VOID;
+	if( size > 4*word )
+	{
+		// do { *(base+i) = *(src+i); i += word; } while( i < words );
+		size_t	words = size / word * word;
+		 int	idx = IRM_AddLocal(State->Handle, TYPE_SIZE, NULL);
+		tIRMBlock	*loop_blk = IRM_CreateBlock(State->Handle);
+		tIRMBlock	*end_blk = IRM_CreateBlock(State->Handle);
+		src = AllocateRegister(State, TYPE_CHARCONSTANT);
+		IRM_AppendCharacterConstant(State->Handle, src, size, data);
+		IRM_AppendStoreLocal(State->Handle, idx, Compile_int_Constant(State, TYPE_SIZE, 0));
+		IRM_AppendJump(State->Handle, loop_blk);
+
+		IRM_SetBlock(State->Handle, loop_blk);
+		tReg	i = AllocateRegister(State, TYPE_SIZE);
+		tReg	from = AllocateRegister(State, Types_CreatePointerType(TYPE_SIZE));
+		tReg	to = AllocateRegister(State, Types_CreatePointerType(TYPE_SIZE));
+		tReg	val = AllocateRegister(State, TYPE_SIZE);
+		tReg	next = AllocateRegister(State, TYPE_SIZE);
+		tReg	cnd = AllocateRegister(State, TYPE_INT);
+		IRM_AppendLoadLocal(State->Handle, i, idx);
+		IRM_AppendBinOp(State->Handle, IRMOP_ADD, 0, from, src, i);
+		IRM_AppendBinOp(State->Handle, IRMOP_ADD, 0, to, base, i);
+		IRM_AppendLoad(State->Handle, val, from);
+		IRM_AppendStore(State->Handle, to, val);
+		IRM_AppendBinOp(State->Handle, IRMOP_ADD, 0, next, i, Compile_int_Constant(State, TYPE_SIZE, word));
+		IRM_AppendStoreLocal(State->Handle, idx, next);
+		IRM_AppendBinOp(State->Handle, IRMOP_CMPLT, 0, cnd, next, Compile_int_Constant(State, TYPE_SIZE, words));
+		IRM_AppendBranch(State->Handle, cnd, loop_blk, end_blk);
+		IRM_SetBlock(State->Handle, end_blk);
+		ofs = words;
+	}
+
+	// Whatever is left, largest pieces first
+	while( ofs < size )
+	{
+		size_t	piece = word;
+		while( piece > size - ofs )
+			piece /= 2;
+		const tType	*ptype = Types_CreateIntegerType(false,
+			(piece == 8 ? INTSIZE_LONGLONG : piece == 4 ? INTSIZE_INT : piece == 2 ? INTSIZE_SHORT : INTSIZE_CHAR));
+		tReg	to = AllocateRegister(State, Types_CreatePointerType(ptype));
+		tReg	val;
+		IRM_AppendBinOp(State->Handle, IRMOP_ADD, 0, to, base, Compile_int_Constant(State, TYPE_SIZE, ofs));
+		if( src != REG_VOID ) {
+			tReg	from = AllocateRegister(State, Types_CreatePointerType(ptype));
+			IRM_AppendBinOp(State->Handle, IRMOP_ADD, 0, from, src, Compile_int_Constant(State, TYPE_SIZE, ofs));
+			val = AllocateRegister(State, ptype);
+			IRM_AppendLoad(State->Handle, val, from);
+		}
+		else {
+			uint64_t	v = 0;
+			for( size_t j = piece; j --; )
+				v = (v << 8) | (uint8_t)data[ofs + j];
+			val = Compile_int_Constant(State, ptype, v);
+		}
+		IRM_AppendStore(State->Handle, to, val);
+		ofs += piece;
+	}
+	return 0;
+}
+
+/**
+ * \brief Get an assignable location for a node
+ */
+int Compile_int_GetLValue(tCompileState *State, tAST_Node *Node, tLValue *LV)
+{
+	tReg	tmp;
+	LV->Local = -1;
+	LV->Address = REG_VOID;
+	switch(Node->Type)
+	{
+	case NODETYPE_SYMBOL: {
+		 int	lcl = Compile_int_FindLocal(State, Node->Symbol.Name);
+		if( lcl >= 0 ) {
+			LV->Local = lcl;
+			LV->Type = State->Handle->Locals[lcl].Type;
+			return 0;
+		}
+		tSymbol	*sym = Compile_int_ResolveSymbol(State, Node->Symbol.Name);
+		if( !sym ) {
+			CompileError(Node, "Undefined reference to %s", Node->Symbol.Name);
+			return 1;
+		}
+		LV->Type = sym->Type;
+		LV->Address = AllocateRegister(State, Types_CreatePointerType(sym->Type));
+		IRM_AppendSymbol(State->Handle, LV->Address, sym);
+		return 0; }
+	case NODETYPE_DEREF:
+		if( Compile_ConvertNode(State, Node->UniOp.Value, &tmp) )
+			return 1;
+		if( IRM_GetRegType(State->Handle, tmp)->Class != TYPECLASS_POINTER ) {
+			CompileError(Node, "Dereferencing a non-pointer");
+			return 1;
+		}
+		LV->Type = IRM_GetRegType(State->Handle, tmp)->Pointer;
+		LV->Address = tmp;
+		return 0;
+	case NODETYPE_INDEX: {
+		tReg	base, index;
+		if( Compile_int_ConvertOperands(State, Node->BinOp.Left, Node->BinOp.Right, &base, &index) )
+			return 1;
+		// Allow `idx[ptr]`
+		if( IRM_GetRegType(State->Handle, base)->Class != TYPECLASS_POINTER ) {
+			tReg t = base; base = index; index = t;
+		}
+		const tType	*ptype = IRM_GetRegType(State->Handle, base);
+		if( ptype->Class != TYPECLASS_POINTER ) {
+			CompileError(Node, "Indexing a non-pointer");
+			return 1;
+		}
+		index = Compile_int_Scale(State, index, Compile_int_PointeeSize(ptype));
+		LV->Type = ptype->Pointer;
+		LV->Address = AllocateRegister(State, ptype);
+		IRM_AppendBinOp(State->Handle, IRMOP_ADD, 0, LV->Address, base, index);
+		return 0; }
+	case NODETYPE_MEMBER: {
+		tLValue	st;
+		if( Compile_int_GetLValue(State, Node->Member.Struct, &st) )
+			return 1;
+		if( st.Type->Class != TYPECLASS_STRUCTURE && st.Type->Class != TYPECLASS_UNION ) {
+			CompileError(Node, "Accessing member '%s' of a non-structure", Node->Member.Name);
+			return 1;
+		}
+		const tStruct	*info = st.Type->StructUnion;
+		 int	i;
+		for( i = 0; i < info->nFields; i ++ )
+		{
+			if( info->Entries[i].Name && strcmp(info->Entries[i].Name, Node->Member.Name) == 0 )
+				break;
+		}
+		if( i == info->nFields ) {
+			CompileError(Node, "No member '%s'", Node->Member.Name);
+			return 1;
+		}
+		size_t	ofs = Types_GetFieldOffset(st.Type, i);
+		if( st.Local >= 0 ) {
+			st.Address = AllocateRegister(State, Types_CreatePointerType(st.Type));
+			IRM_AppendLocalAddr(State->Handle, st.Address, st.Local);
+		}
+		LV->Type = info->Entries[i].Type;
+		LV->Address = AllocateRegister(State, Types_CreatePointerType(LV->Type));
+		IRM_AppendBinOp(State->Handle, IRMOP_ADD, 0, LV->Address, st.Address, Compile_int_Constant(State, TYPE_SIZE, ofs));
+		return 0; }
+	default:
+		CompileError(Node, "Expression is not assignable");
+		return 1;
+	}
+}
+
+/**
+ * \brief Read the value of a location
+ * \note Arrays and functions decay to pointers instead of being loaded
+ */
+tReg Compile_int_LoadLValue(tCompileState *State, tLValue *LV)
+{
+	tReg	ret;
+	if( LV->Type->Class == TYPECLASS_ARRAY || LV->Type->Class == TYPECLASS_FUNCTION )
+	{
+		const tType	*ptype = (LV->Type->Class == TYPECLASS_ARRAY
+			? Types_CreatePointerType(LV->Type->Array.Type)
+			: Types_CreatePointerType(LV->Type));
+		ret = AllocateRegister(State, ptype);
+		if( LV->Local >= 0 )
+			IRM_AppendLocalAddr(State->Handle, ret, LV->Local);
+		else
+			IRM_AppendUniOp(State->Handle, IRMOP_COPY, 0, ret, LV->Address);
+		return ret;
+	}
+
+	ret = AllocateRegister(State, LV->Type);
+	if( LV->Local >= 0 )
+		IRM_AppendLoadLocal(State->Handle, ret, LV->Local);
+	else
+		IRM_AppendLoad(State->Handle, ret, LV->Address);
+	return ret;
+}
+
+void Compile_int_StoreLValue(tCompileState *State, tLValue *LV, tReg Value)
+{
+	if( LV->Local >= 0 )
+		IRM_AppendStoreLocal(State->Handle, LV->Local, Value);
+	else
+		IRM_AppendStore(State->Handle, LV->Address, Value);
+}
+
+/**
+ * \brief Convert a register to another type (if required)
+ */
+tReg Compile_int_Convert(tCompileState *State, tReg Reg, const tType *Type)
+{
+	const tType	*cur = IRM_GetRegType(State->Handle, Reg);
+	if( cur == Type )
+		return Reg;
+	// Qualifiers don't change the representation
+	if( cur->Class == Type->Class )
+	{
+		switch(cur->Class)
+		{
+		case TYPECLASS_INTEGER:
+			if( cur->Integer.Size == Type->Integer.Size && cur->Integer.bSigned == Type->Integer.bSigned )
+				return Reg;
+			break;
+		case TYPECLASS_POINTER:
+			return Reg;
+		default:
+			break;
+		}
+	}
+	tReg	ret = AllocateRegister(State, Type);
+	IRM_AppendUniOp(State->Handle, IRMOP_CAST, (Compile_int_IsSigned(cur) ? IRMFLAG_SIGNED : 0), ret, Reg);
+	return ret;
+}
+
+tReg Compile_int_Scale(tCompileState *State, tReg Reg, size_t Scale)
+{
+	Reg = Compile_int_Convert(State, Reg, TYPE_PTRDIFF);
+	if( Scale == 1 )
+		return Reg;
+	tReg	ret = AllocateRegister(State, TYPE_PTRDIFF);
+	IRM_AppendBinOp(State->Handle, IRMOP_MUL, 0, ret, Reg, Compile_int_Constant(State, TYPE_PTRDIFF, Scale));
+	return ret;
+}
+
+tReg Compile_int_Constant(tCompileState *State, const tType *Type, uint64_t Value)
+{
+	tReg	ret = AllocateRegister(State, Type);
+	IRM_AppendConstant(State->Handle, ret, Value);
+	return ret;
+}
+
+/**
+ * \brief Determine the type of an arithmetic operation (usual arithmetic conversions)
+ */
+const tType *Compile_int_ArithType(const tType *Left, const tType *Right)
+{
+	enum eIntegerSize	lsize = INTSIZE_INT, rsize = INTSIZE_INT;
+	bool	lsigned = true, rsigned = true;
+	if( Left->Class == TYPECLASS_INTEGER ) {
+		lsize = Left->Integer.Size;
+		lsigned = Left->Integer.bSigned;
+	}
+	if( Right->Class == TYPECLASS_INTEGER ) {
+		rsize = Right->Integer.Size;
+		rsigned = Right->Integer.bSigned;
+	}
+	// Integer promotion
+	if( lsize < INTSIZE_INT ) {
+		lsize = INTSIZE_INT;
+		lsigned = true;
+	}
+	if( rsize < INTSIZE_INT ) {
+		rsize = INTSIZE_INT;
+		rsigned = true;
+	}
+	if( lsize == rsize )
+		return Types_CreateIntegerType(lsigned && rsigned, lsize);
+	if( lsize > rsize )
+		return Types_CreateIntegerType(lsigned, lsize);
+	return Types_CreateIntegerType(rsigned, rsize);
+}
+
+bool Compile_int_IsSigned(const tType *Type)
+{
+	if( Type->Class == TYPECLASS_INTEGER )
+		return Type->Integer.bSigned;
+	if( Type->Class == TYPECLASS_ENUM )
+		return true;
+	return false;
+}
+
+size_t Compile_int_PointeeSize(const tType *Type)
+{
+	size_t	ret = Types_GetSizeOf(Type->Pointer);
+	// `void*` arithmetic is a GNU extension, treated as byte sized
+	return (ret ? ret : 1);
+}
+
+void Compile_InitSubState(tCompileState *ParentState, tCompileState *ChildState)
+{
+	ChildState->Handle = ParentState->Handle;
+	ChildState->Parent = ParentState;
+	ChildState->Scope = IRM_AddScope(ParentState->Handle, ParentState->Scope);
+	ChildState->Locals = NULL;
+	ChildState->BreakTarget = NULL;
+	ChildState->ContinueTarget = NULL;
+}
+void Compile_ClearSubState(tCompileState *ChildState)
+{
+	while( ChildState->Locals )
+	{
+		tCompileLocal	*cl = ChildState->Locals;
+		ChildState->Locals = cl->Next;
+		free(cl);
+	}
+}
+/**
+ * \brief Find a local variable in the current scope chain
+ * \return Local index, or -1 if not a local (or a block scope static/extern)
+ */
+int Compile_int_FindLocal(tCompileState *State, const char *Name)
+{
+	for( ; State; State = State->Parent )
+	{
+		for( tCompileLocal *cl = State->Locals; cl; cl = cl->Next )
+		{
+			if( strcmp(cl->Name, Name) == 0 )
+				return cl->Local;
+		}
+	}
+	return -1;
+}
+/**
+ * \brief Resolve a name that isn't a local to its global symbol
+ * \note Block scope static/extern declarations hide outer locals and globals
+ */
+tSymbol *Compile_int_ResolveSymbol(tCompileState *State, const char *Name)
+{
+	for( tCompileState *st = State; st; st = st->Parent )
+	{
+		for( tCompileLocal *cl = st->Locals; cl; cl = cl->Next )
+		{
+			if( strcmp(cl->Name, Name) == 0 )
+				return cl->Global;
+		}
+	}
+	return Symbol_ResolveSymbol(Name);
+}
+bool Compile_GetLocalSymbol(tCompileState *State, tReg *OutReg, const char *Name)
+{
+	 int	lcl = Compile_int_FindLocal(State, Name);
+	if( lcl < 0 )
+		return false;
+	tLValue	lv = {.Local = lcl, .Type = State->Handle->Locals[lcl].Type};
+	*OutReg = Compile_int_LoadLValue(State, &lv);
+	return true;
+}
+tReg AllocateRegister(tCompileState *State, const tType *Type)
+{
+	return IRM_AllocateRegister(State->Handle, Type);
 }
 
@@ -0,0 +1,611 @@
+/*
+ * Acess C Compiler
+ * - By John Hodge (thePowersGang)
+ *
+ * consteval.c
+ * - Compile-time evaluation of constant expressions and initialisers
+ *
+ * Evaluates the AST directly. Values are integers, or addresses (a global
+ * or string literal plus an offset) that become relocations in the image of
+ * an initialised object. Every node visited and every byte of image counts
+ * against a budget, so a pathological initialiser fails instead of hanging
+ * the compiler.
+ */
+#include <global.h>
+#include <ast.h>
+#include <symbol.h>
+#include <consteval.h>
+#include <string.h>
+
+// === CONSTANTS ===
+#define CONSTEVAL_MAX_STEPS	(16*1024*1024)	//!< Nodes evaluated per expression/initialiser
+#define CONSTEVAL_MAX_SIZE	(256*1024*1024)	//!< Largest initialised object (bytes)
+
+// === MACROS ===
+#define CONSTEVAL_ERROR(State, ...)	do{ if(!(State)->bQuiet) CompileError(__VA_ARGS__); }while(0)
+
+// === IMPORTS ===
+extern void	CompileError(tAST_Node *Node, const char *format, ...);
+
+// === TYPES ===
+typedef struct
+{
+	int64_t	Int;	//!< Value, or offset from the address base
+	const char	*Symbol;	//!< Address of this global
+	 int	String;	//!< Address of this string literal (-1 if none)
+	const tType	*Type;	//!< NULL for plain int
+} tConstValue;
+
+typedef struct
+{
+	 int	Steps;
+	bool	bQuiet;	//!< Don't report why an expression isn't constant
+	tConstImage	*Image;	//!< (NULL when evaluating a lone expression)
+} tConstEvalState;
+
+typedef struct sConstGlobal
+{
+	struct sConstGlobal	*Next;
+	const tSymbol	*Sym;
+	bool	bKnown;	//!< Image was built (initialiser is constant)
+	tConstImage	Image;
+} tConstGlobal;
+
+// === PROTOTYPES ===
+ int	ConstEval_Integer(tAST_Node *Node, int64_t *Value);
+ int	ConstEval_TryInteger(tAST_Node *Node, int64_t *Value);
+ int	ConstEval_int_Integer(tAST_Node *Node, int64_t *Value, bool bQuiet);
+ int	ConstEval_Initialiser(tConstImage *Image, const tType *Type, tAST_Node *Value);
+void	ConstEval_FreeImage(tConstImage *Image);
+ int	ConstEval_TryInitialiser(tConstImage *Image, const tType *Type, tAST_Node *Value);
+ int	ConstEval_ReadGlobal(const tSymbol *Sym, int64_t Offset, size_t Size, uint64_t *Value, const tSymbol **Target);
+ int	ConstEval_int_Initialiser(tConstImage *Image, const tType *Type, tAST_Node *Value, bool bQuiet);
+void	ConstEval_int_Init(tConstEvalState *State, tConstImage *Image);
+ int	ConstEval_int_Store(tConstEvalState *State, size_t Offset, const tType *Type, tAST_Node *Value);
+ int	ConstEval_int_StoreScalar(tConstEvalState *State, size_t Offset, const tType *Type, tAST_Node *Value);
+ int	ConstEval_int_Eval(tConstEvalState *State, tAST_Node *Node, tConstValue *Out);
+ int	ConstEval_int_Address(tConstEvalState *State, tAST_Node *Node, tConstValue *Out);
+ int	ConstEval_int_Symbol(tConstEvalState *State, tAST_Node *Node, tConstValue *Out);
+size_t	ConstEval_int_PointeeSize(const tConstValue *Value);
+ int	ConstEval_int_Field(const tType *Type, const char *Name, size_t *Offset, const tType **FieldType);
+
+// === GLOBALS ===
+tConstGlobal	*gpConstEval_Globals;	//!< Images of globals read by ConstEval_ReadGlobal
+
+// === CODE ===
+/**
+ * \brief Evaluate an integer constant expression (array sizes, enum values, ...)
+ */
+int ConstEval_Integer(tAST_Node *Node, int64_t *Value)
+{
+	return ConstEval_int_Integer(Node, Value, false);
+}
+
+/**
+ * \brief Evaluate an expression if it is an integer constant (no error if it isn't)
+ */
+int ConstEval_TryInteger(tAST_Node *Node, int64_t *Value)
+{
+	return ConstEval_int_Integer(Node, Value, true);
+}
+
+int ConstEval_int_Integer(tAST_Node *Node, int64_t *Value, bool bQuiet)
+{
+	tConstEvalState	state;
+	tConstValue	val;
+	ConstEval_int_Init(&state, NULL);
+	state.bQuiet = bQuiet;
+	if( ConstEval_int_Eval(&state, Node, &val) )
+		return 1;
+	if( val.Symbol || val.String >= 0 ) {
+		CONSTEVAL_ERROR(&state, Node, "Expected an integer constant, got an address");
+		return 1;
+	}
+	*Value = val.Int;
+	return 0;
+}
+
+/**
+ * \brief Build the image of a static object
+ */
+int ConstEval_Initialiser(tConstImage *Image, const tType *Type, tAST_Node *Value)
+{
+	return ConstEval_int_Initialiser(Image, Type, Value, false);
+}
+
+/**
+ * \brief Build the image of a static object if its initialiser is constant (no error if it isn't)
+ */
+int ConstEval_TryInitialiser(tConstImage *Image, const tType *Type, tAST_Node *Value)
+{
+	return ConstEval_int_Initialiser(Image, Type, Value, true);
+}
+
+int ConstEval_int_Initialiser(tConstImage *Image, const tType *Type, tAST_Node *Value, bool bQuiet)
+{
+	tConstEvalState	state;
+	memset(Image, 0, sizeof(*Image));
+	Image->Size = Types_GetSizeOf(Type);
+	if( Image->Size > CONSTEVAL_MAX_SIZE ) {
+		if( !bQuiet )
+			CompileError(Value, "Initialised object is too large (%zi bytes)", Image->Size);
+		return 1;
+	}
+	Image->Data = calloc(1, Image->Size + 1);
+	if( !Value )
+		return 0;
+	ConstEval_int_Init(&state, Image);
+	state.bQuiet = bQuiet;
+	if( ConstEval_int_Store(&state, 0, Type, Value) ) {
+		ConstEval_FreeImage(Image);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * \brief Read Size bytes at Offset in the initial contents of a global
+ * \param Value	Integer read, or the addend if the field holds an address
+ * \param Target	Set to the global addressed by the field (NULL for a plain integer)
+ * \return Non-zero if the contents aren't known (no error is reported)
+ *
+ * Only meaningful for globals that are never written (tSymbol.bReadOnly). The
+ * image of each global is built on first use and kept for later reads.
+ */
+int ConstEval_ReadGlobal(const tSymbol *Sym, int64_t Offset, size_t Size, uint64_t *Value, const tSymbol **Target)
+{
+	tConstGlobal	*g;
+	for( g = gpConstEval_Globals; g; g = g->Next )
+	{
+		if( g->Sym == Sym )
+			break;
+	}
+	if( !g )
+	{
+		g = malloc( sizeof(tConstGlobal) );
+		g->Sym = Sym;
+		g->bKnown = (ConstEval_int_Initialiser(&g->Image, Sym->Type, Sym->Value, true) == 0);
+		g->Next = gpConstEval_Globals;
+		gpConstEval_Globals = g;
+	}
+	if( !g->bKnown )
+		return 1;
+	if( Offset < 0 || Size > 8 || Offset + Size > g->Image.Size )
+		return 1;
+	
+	// Fields holding an address are only known if they name another global
+	for( int i = 0; i < g->Image.nRelocs; i ++ )
+	{
+		const tConstReloc	*r = &g->Image.Relocs[i];
+		if( r->Offset >= Offset + Size )
+			break;
+		if( r->Offset + r->Size <= Offset )
+			continue;
+		if( r->Offset != Offset || r->Size != Size || !r->Symbol )
+			return 1;
+		*Target = Symbol_ResolveSymbol(r->Symbol);
+		if( !*Target )
+			return 1;
+		*Value = r->Addend;
+		return 0;
+	}
+	
+	*Value = 0;
+	for( size_t i = Size; i --; )
+		*Value = (*Value << 8) | g->Image.Data[Offset + i];
+	*Target = NULL;
+	return 0;
+}
+
+void ConstEval_FreeImage(tConstImage *Image)
+{
+	free(Image->Data);
+	free(Image->Relocs);
+	free(Image->Strings);
+	memset(Image, 0, sizeof(*Image));
+}
+
+void ConstEval_int_Init(tConstEvalState *State, tConstImage *Image)
+{
+	State->Steps = 0;
+	State->bQuiet = false;
+	State->Image = Image;
+}
+
+// --- Initialisers ---
+/**
+ * \brief Store an initialiser (possibly braced) at Offset in the image
+ *
+ * Structures are packed, so fields follow each other directly.
+ */
+int ConstEval_int_Store(tConstEvalState *State, size_t Offset, const tType *Type, tAST_Node *Value)
+{
+	if( ++State->Steps > CONSTEVAL_MAX_STEPS ) {
+		CONSTEVAL_ERROR(State, Value, "Initialiser is too complex to evaluate");
+		return 1;
+	}
+	switch(Type->Class)
+	{
+	case TYPECLASS_ARRAY: {
+		const tType	*ele = Type->Array.Type;
+		size_t	ele_size = Types_GetSizeOf(ele);
+		size_t	i = 0;
+		if( Value->Type == NODETYPE_STRING && ele_size == 1 )
+		{
+			// String literal into a character array (NUL included if it fits)
+			size_t	len = Value->String.Length;
+			if( len > Type->Array.Count )
+				len = Type->Array.Count;
+			memcpy(State->Image->Data + Offset, Value->String.Data, len);
+			return 0;
+		}
+		if( Value->Type == NODETYPE_BLOB )
+		{
+			// Already evaluated by the parser
+			size_t	len = Value->Blob.Length;
+			if( Types_GetSizeOf(Value->Blob.Type) != ele_size ) {
+				CONSTEVAL_ERROR(State, Value, "Initialiser doesn't match the array's element type");
+				return 1;
+			}
+			if( len > Type->Array.Count * ele_size )
+				len = Type->Array.Count * ele_size;
+			memcpy(State->Image->Data + Offset, Value->Blob.Data, len);
+			return 0;
+		}
+		if( Value->Type != NODETYPE_BLOCK ) {
+			CONSTEVAL_ERROR(State, Value, "Array initialiser must be braced");
+			return 1;
+		}
+		for( tAST_Node *val = Value->CodeBlock.FirstStatement; val; val = val->NextSibling, i ++ )
+		{
+			if( i == Type->Array.Count ) {
+				CONSTEVAL_ERROR(State, Value, "Excess elements in initialiser");
+				return 1;
+			}
+			if( ConstEval_int_Store(State, Offset + i*ele_size, ele, val) )
+				return 1;
+		}
+		return 0; }
+	case TYPECLASS_STRUCTURE:
+	case TYPECLASS_UNION: {
+		const tStruct	*str = Type->StructUnion;
+		 int	i = 0;
+		if( Value->Type != NODETYPE_BLOCK ) {
+			CONSTEVAL_ERROR(State, Value, "Structure initialiser must be braced");
+			return 1;
+		}
+		for( tAST_Node *val = Value->CodeBlock.FirstStatement; val; val = val->NextSibling, i ++ )
+		{
+			if( i == str->nFields || (Type->Class == TYPECLASS_UNION && i == 1) ) {
+				CONSTEVAL_ERROR(State, Value, "Excess elements in initialiser");
+				return 1;
+			}
+			if( ConstEval_int_Store(State, Offset + Types_GetFieldOffset(Type, i), str->Entries[i].Type, val) )
+				return 1;
+		}
+		return 0; }
+	default:
+		// `int x = {1};` is valid C
+		if( Value->Type == NODETYPE_BLOCK ) {
+			if( !Value->CodeBlock.FirstStatement ) {
+				CONSTEVAL_ERROR(State, Value, "Empty scalar initialiser");
+				return 1;
+			}
+			Value = Value->CodeBlock.FirstStatement;
+		}
+		return ConstEval_int_StoreScalar(State, Offset, Type, Value);
+	}
+}
+
+int ConstEval_int_StoreScalar(tConstEvalState *State, size_t Offset, const tType *Type, tAST_Node *Value)
+{
+	tConstImage	*img = State->Image;
+	size_t	size = Types_GetSizeOf(Type);
+	tConstValue	val;
+	if( size > 8 || Type->Class == TYPECLASS_REAL ) {
+		CONSTEVAL_ERROR(State, Value, "Unsupported type in static initialiser");
+		return 1;
+	}
+	if( ConstEval_int_Eval(State, Value, &val) )
+		return 1;
+
+	if( val.Symbol || val.String >= 0 )
+	{
+		if( size != 4 && size != 8 ) {
+			CONSTEVAL_ERROR(State, Value, "Address doesn't fit in a %zi byte field", size);
+			return 1;
+		}
+		img->Relocs = realloc(img->Relocs, (img->nRelocs+1)*sizeof(tConstReloc));
+		img->Relocs[img->nRelocs++] = (tConstReloc){
+			.Offset = Offset, .Size = size,
+			.Symbol = val.Symbol, .String = val.String, .Addend = val.Int
+			};
+		return 0;
+	}
+	// (little endian)
+	for( size_t i = 0; i < size; i ++ )
+		img->Data[Offset + i] = (uint64_t)val.Int >> (i*8);
+	return 0;
+}
+
+// --- Expressions ---
+int ConstEval_int_Eval(tConstEvalState *State, tAST_Node *Node, tConstValue *Out)
+{
+	tConstValue	left, right;
+	if( ++State->Steps > CONSTEVAL_MAX_STEPS ) {
+		CONSTEVAL_ERROR(State, Node, "Expression is too complex to evaluate");
+		return 1;
+	}
+	Out->Int = 0;
+	Out->Symbol = NULL;
+	Out->String = -1;
+	Out->Type = NULL;
+	switch(Node->Type)
+	{
+	case NODETYPE_INTEGER:
+		Out->Int = Node->Integer.Value;
+		return 0;
+	case NODETYPE_STRING:
+		if( !State->Image )
+			break;
+		State->Image->Strings = realloc(State->Image->Strings, (State->Image->nStrings+1)*sizeof(tAST_Node*));
+		State->Image->Strings[State->Image->nStrings] = Node;
+		Out->String = State->Image->nStrings ++;
+		Out->Type = Types_CreatePointerType(Types_CreateIntegerType(true, INTSIZE_CHAR));
+		return 0;
+	case NODETYPE_SYMBOL:
+		return ConstEval_int_Symbol(State, Node, Out);
+	case NODETYPE_ADDROF:
+		return ConstEval_int_Address(State, Node->UniOp.Value, Out);
+
+	case NODETYPE_CAST:
+		if( ConstEval_int_Eval(State, Node->Cast.Value, Out) )
+			return 1;
+		if( Node->Cast.Type->Class == TYPECLASS_POINTER ) {
+			Out->Type = Node->Cast.Type;
+			return 0;
+		}
+		if( Node->Cast.Type->Class != TYPECLASS_INTEGER && Node->Cast.Type->Class != TYPECLASS_ENUM )
+			break;
+		if( Out->Symbol || Out->String >= 0 ) {
+			// Addresses can only be kept whole (long is pointer sized)
+			if( Types_GetSizeOf(Node->Cast.Type) < Types_GetSizeOf(Types_CreateIntegerType(false, INTSIZE_LONG)) )
+				break;
+		}
+		else {
+			size_t	bits = Types_GetSizeOf(Node->Cast.Type) * 8;
+			if( Node->Cast.Type->Class == TYPECLASS_INTEGER && Node->Cast.Type->Integer.Size == INTSIZE_BOOL )
+				Out->Int = !!Out->Int;
+			else if( bits < 64 ) {
+				uint64_t	mask = (1ULL << bits) - 1;
+				Out->Int &= mask;
+				if( Node->Cast.Type->Class == TYPECLASS_INTEGER && Node->Cast.Type->Integer.bSigned && (Out->Int >> (bits-1)) )
+					Out->Int |= ~mask;
+			}
+		}
+		Out->Type = Node->Cast.Type;
+		return 0;
+
+	case NODETYPE_NEGATE:
+	case NODETYPE_BWNOT:
+	case NODETYPE_LOGICNOT:
+		if( ConstEval_int_Eval(State, Node->UniOp.Value, &left) )
+			return 1;
+		if( left.Symbol || left.String >= 0 )
+			break;
+		switch(Node->Type)
+		{
+		case NODETYPE_NEGATE:	Out->Int = -left.Int;	break;
+		case NODETYPE_BWNOT:	Out->Int = ~left.Int;	break;
+		default:	Out->Int = !left.Int;	break;
+		}
+		Out->Type = (Node->Type == NODETYPE_LOGICNOT ? NULL : left.Type);
+		return 0;
+
+	case NODETYPE_BOOLAND:
+	case NODETYPE_BOOLOR:
+		if( ConstEval_int_Eval(State, Node->BinOp.Left, &left) )
+			return 1;
+		if( left.Symbol || left.String >= 0 )
+			break;
+		if( !left.Int == (Node->Type == NODETYPE_BOOLAND) ) {
+			// Short circuited
+			Out->Int = (Node->Type == NODETYPE_BOOLOR);
+			return 0;
+		}
+		if( ConstEval_int_Eval(State, Node->BinOp.Right, &right) )
+			return 1;
+		if( right.Symbol || right.String >= 0 )
+			break;
+		Out->Int = !!right.Int;
+		return 0;
+
+	case NODETYPE_CONDITIONAL:
+		if( ConstEval_int_Eval(State, Node->If.Test, &left) )
+			return 1;
+		if( left.Symbol || left.String >= 0 )
+			break;
+		return ConstEval_int_Eval(State, (left.Int ? Node->If.True : Node->If.False), Out);
+
+	case NODETYPE_ADD:
+	case NODETYPE_SUBTRACT:
+		if( ConstEval_int_Eval(State, Node->BinOp.Left, &left) || ConstEval_int_Eval(State, Node->BinOp.Right, &right) )
+			return 1;
+		if( right.Symbol || right.String >= 0 )
+		{
+			if( Node->Type == NODETYPE_ADD && !left.Symbol && left.String < 0 ) {
+				// int + pointer
+				tConstValue	tmp = left;
+				left = right;
+				right = tmp;
+			}
+			else if( Node->Type == NODETYPE_SUBTRACT && left.Symbol == right.Symbol && left.String == right.String
+			      && (left.Symbol == NULL || strcmp(left.Symbol, right.Symbol) == 0) ) {
+				// Difference of two addresses in the same object
+				Out->Int = (left.Int - right.Int) / (int64_t)ConstEval_int_PointeeSize(&left);
+				return 0;
+			}
+			else
+				break;
+		}
+		*Out = left;
+		if( left.Symbol || left.String >= 0 || (left.Type && left.Type->Class == TYPECLASS_POINTER) )
+			right.Int *= ConstEval_int_PointeeSize(&left);
+		else if( right.Type && (!left.Type || Types_GetSizeOf(right.Type) > Types_GetSizeOf(left.Type)) )
+			Out->Type = right.Type;
+		Out->Int = (Node->Type == NODETYPE_ADD ? left.Int + right.Int : left.Int - right.Int);
+		return 0;
+
+	case NODETYPE_MULTIPLY ... NODETYPE_GREATERTHANEQU:
+		if( ConstEval_int_Eval(State, Node->BinOp.Left, &left) || ConstEval_int_Eval(State, Node->BinOp.Right, &right) )
+			return 1;
+		if( left.Symbol || left.String >= 0 || right.Symbol || right.String >= 0 )
+			break;
+		Out->Type = (right.Type && (!left.Type || Types_GetSizeOf(right.Type) > Types_GetSizeOf(left.Type)) ? right.Type : left.Type);
+		switch(Node->Type)
+		{
+		case NODETYPE_MULTIPLY:	Out->Int = left.Int * right.Int;	break;
+		case NODETYPE_DIVIDE:
+		case NODETYPE_MODULO:
+			if( right.Int == 0 ) {
+				CONSTEVAL_ERROR(State, Node, "Division by zero in constant expression");
+				return 1;
+			}
+			if( right.Int == -1 )	// (INT64_MIN / -1 traps)
+				Out->Int = (Node->Type == NODETYPE_DIVIDE ? -(uint64_t)left.Int : 0);
+			else
+				Out->Int = (Node->Type == NODETYPE_DIVIDE ? left.Int / right.Int : left.Int % right.Int);
+			break;
+		case NODETYPE_BWOR:	Out->Int = left.Int | right.Int;	break;
+		case NODETYPE_BWAND:	Out->Int = left.Int & right.Int;	break;
+		case NODETYPE_BWXOR:	Out->Int = left.Int ^ right.Int;	break;
+		case NODETYPE_BITSHIFTLEFT:	Out->Int = (uint64_t)left.Int << (right.Int & 63);	break;
+		case NODETYPE_BITSHIFTRIGHT:	Out->Int = left.Int >> (right.Int & 63);	break;
+		case NODETYPE_EQUALS:	Out->Int = left.Int == right.Int;	break;
+		case NODETYPE_NOTEQUALS:	Out->Int = left.Int != right.Int;	break;
+		case NODETYPE_LESSTHAN:	Out->Int = left.Int < right.Int;	break;
+		case NODETYPE_LESSTHANEQU:	Out->Int = left.Int <= right.Int;	break;
+		case NODETYPE_GREATERTHAN:	Out->Int = left.Int > right.Int;	break;
+		case NODETYPE_GREATERTHANEQU:	Out->Int = left.Int >= right.Int;	break;
+		default:	break;
+		}
+		if( Node->Type >= NODETYPE_EQUALS )
+			Out->Type = NULL;
+		return 0;
+
+	default:
+		break;
+	}
+	CONSTEVAL_ERROR(State, Node, "Expression is not constant");
+	return 1;
+}
+
+/**
+ * \brief Address of an lvalue (&x, &arr[2], &s.field)
+ */
+int ConstEval_int_Address(tConstEvalState *State, tAST_Node *Node, tConstValue *Out)
+{
+	if( ++State->Steps > CONSTEVAL_MAX_STEPS ) {
+		CONSTEVAL_ERROR(State, Node, "Expression is too complex to evaluate");
+		return 1;
+	}
+	switch(Node->Type)
+	{
+	case NODETYPE_SYMBOL: {
+		tSymbol	*sym = Symbol_ResolveSymbol(Node->Symbol.Name);
+		if( !sym ) {
+			CONSTEVAL_ERROR(State, Node, "Undefined reference to %s", Node->Symbol.Name);
+			return 1;
+		}
+		Out->Int = 0;
+		Out->Symbol = sym->Name;
+		Out->String = -1;
+		Out->Type = Types_CreatePointerType(sym->Type);
+		return 0; }
+	case NODETYPE_DEREF:
+		return ConstEval_int_Eval(State, Node->UniOp.Value, Out);
+	case NODETYPE_INDEX: {
+		tConstValue	idx;
+		if( ConstEval_int_Eval(State, Node->BinOp.Left, Out) || ConstEval_int_Eval(State, Node->BinOp.Right, &idx) )
+			return 1;
+		if( idx.Symbol || idx.String >= 0 || (!Out->Symbol && Out->String < 0) )
+			break;
+		Out->Int += idx.Int * ConstEval_int_PointeeSize(Out);
+		return 0; }
+	case NODETYPE_MEMBER: {
+		size_t	ofs;
+		const tType	*type;
+		if( ConstEval_int_Address(State, Node->Member.Struct, Out) )
+			return 1;
+		if( ConstEval_int_Field(Out->Type->Pointer, Node->Member.Name, &ofs, &type) ) {
+			CONSTEVAL_ERROR(State, Node, "No member '%s' in structure", Node->Member.Name);
+			return 1;
+		}
+		Out->Int += ofs;
+		Out->Type = Types_CreatePointerType(type);
+		return 0; }
+	default:
+		break;
+	}
+	CONSTEVAL_ERROR(State, Node, "Address is not constant");
+	return 1;
+}
+
+/**
+ * \brief Named value: enumeration constant, or array/function (which decay to addresses)
+ */
+int ConstEval_int_Symbol(tConstEvalState *State, tAST_Node *Node, tConstValue *Out)
+{
+	uint64_t	enum_val;
+	if( Types_GetEnumValue(Node->Symbol.Name, &enum_val) ) {
+		Out->Int = enum_val;
+		return 0;
+	}
+	tSymbol	*sym = Symbol_ResolveSymbol(Node->Symbol.Name);
+	if( !sym ) {
+		CONSTEVAL_ERROR(State, Node, "Undefined reference to %s", Node->Symbol.Name);
+		return 1;
+	}
+	if( sym->Type->Class == TYPECLASS_ARRAY ) {
+		Out->Symbol = sym->Name;
+		Out->Type = Types_CreatePointerType(sym->Type->Array.Type);
+		return 0;
+	}
+	if( sym->Type->Class == TYPECLASS_FUNCTION ) {
+		Out->Symbol = sym->Name;
+		Out->Type = Types_CreatePointerType(sym->Type);
+		return 0;
+	}
+	CONSTEVAL_ERROR(State, Node, "Value of '%s' is not constant", Node->Symbol.Name);
+	return 1;
+}
+
+/**
+ * \brief Scale for pointer arithmetic on a value
+ */
+size_t ConstEval_int_PointeeSize(const tConstValue *Value)
+{
+	if( !Value->Type || Value->Type->Class != TYPECLASS_POINTER )
+		return 1;
+	size_t	size = Types_GetSizeOf(Value->Type->Pointer);
+	return (size ? size : 1);
+}
+
+/**
+ * \brief Find a structure/union field
+ * \return Non-zero if there isn't one
+ */
+int ConstEval_int_Field(const tType *Type, const char *Name, size_t *Offset, const tType **FieldType)
+{
+	if( Type->Class != TYPECLASS_STRUCTURE && Type->Class != TYPECLASS_UNION )
+		return 1;
+	for( int i = 0; i < Type->StructUnion->nFields; i ++ )
+	{
+		if( Type->StructUnion->Entries[i].Name && strcmp(Type->StructUnion->Entries[i].Name, Name) == 0 ) {
+			*Offset = Types_GetFieldOffset(Type, i);
+			*FieldType = Type->StructUnion->Entries[i].Type;
+			return 0;
+		}
+	}
+	return 1;
+}
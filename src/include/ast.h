@@ -24,12 +24,13 @@ enum eAST_NodeTypes
 	NODETYPE_LOCALVAR,
 	NODETYPE_SYMBOL,
 	NODETYPE_STRING,
+	NODETYPE_BLOB,	// Constant data (braced initialiser folded by the parser)
 
-	//  7 -- Branches --
+	//  8 -- Branches --
 	NODETYPE_BLOCK,	// Code Block { <code>; }
 	NODETYPE_FUNCTIONCALL,	// <fcn>(<args>)
 	
-	//  9 Statements
+	// 10 Statements
 	NODETYPE_IF,	// "if" statement
 	NODETYPE_FOR,	// "for" statement
 	NODETYPE_WHILE,	// "while" statement
@@ -40,7 +41,7 @@ enum eAST_NodeTypes
 	NODETYPE_BREAK,
 	NODETYPE_CONTINUE,
 
-	// 18 Unary Operations
+	// 19 Unary Operations
 	NODETYPE_NEGATE,
 	NODETYPE_BWNOT,
 	NODETYPE_LOGICNOT,
@@ -54,7 +55,7 @@ enum eAST_NodeTypes
 	
 	NODETYPE_CAST,
 
-	// 28 Binary Operations
+	// 29 Binary Operations
 	NODETYPE_ASSIGNOP,	//!< Special
 	NODETYPE_ASSIGN,	//!< Special
 	NODETYPE_INDEX,	//!< Special
@@ -84,19 +85,26 @@ enum eAST_NodeTypes
 	NODETYPE_CONDITIONAL,
 };
 
+//! `#pragma unroll` without a count: unroll as far as the trip count allows
+#define FOR_UNROLL_FULL	-1
+
 struct sAST_Node
 {
 	enum eAST_NodeTypes	Type;
 
+	char	*File;	//!< Where it was parsed (for diagnostics, a reference)
 	 int	Line;
 	struct sAST_Node	*NextSibling;	//!< Valid for Code Blocks and Function Calls
 
+	 int	RegNeed;	//!< Cached by AST_RegisterNeed (0 = not yet computed)
+	bool	bSideEffects;	//!< Valid once RegNeed is set
+
 	union
 	{
 		// Leaves
 		struct {
-			uint64_t	Value;
-			const tType	*Type;
+			uint64_t	Value;	//!< Sign-extended if the type is signed
+			const tType	*Type;	//!< NULL to pick from the value (see AST_GetIntegerType)
 		}	Integer;
 
 		struct {
@@ -104,6 +112,12 @@ struct sAST_Node
 			void	*Data;
 		}	String;
 
+		struct {
+			const tType	*Type;	//!< Element type
+			size_t	Length;	//!< (in bytes)
+			void	*Data;
+		}	Blob;
+
 		struct {
 			tSymbol	*Sym;
 		}	LocalVariable;
@@ -173,6 +187,7 @@ struct sAST_Node
 			struct sAST_Node	*Test;	//!< Condition for continuing
 			struct sAST_Node	*Next;	//!< Increment/Itterate
 			struct sAST_Node	*Action;	//!< Body
+			 int	Unroll;	//!< `#pragma unroll` hint (0 = none, see FOR_UNROLL_FULL)
 		}	For;
 
 		struct {
@@ -185,8 +200,16 @@ struct sAST_Node
 
 extern void	AST_DumpTree(tAST_Node *Node, int Depth);
 extern tAST_Node	*AST_NewNode(int Type);
+//! Set the source position given to new nodes (the parser's current token)
+extern void	AST_SetPosition(char *File, int Line);
 #define AST_FreeNode	AST_DeleteNode
 extern void	AST_DeleteNode(tAST_Node *Node);
+//! Registers needed to evaluate an expression (Sethi-Ullman number)
+extern  int	AST_RegisterNeed(tAST_Node *Node);
+//! Check if evaluating an expression modifies anything (calls, assignments, increments)
+extern bool	AST_HasSideEffects(tAST_Node *Node);
+//! Decide if the right operand of a binary operation should be evaluated first
+extern bool	AST_EvalRightFirst(tAST_Node *Left, tAST_Node *Right);
 extern tAST_Node	*AST_AppendNode(tAST_Node *Parent, tAST_Node *Child);
 extern tAST_Node	*AST_NewNoOp(void);
 extern tAST_Node	*AST_NewCodeBlock(void);
@@ -207,7 +230,9 @@ extern tAST_Node	*AST_NewCast(const tType *Type, tAST_Node *Value);
 extern tAST_Node	*AST_NewSymbol(const char *Name);
 extern tAST_Node	*AST_NewLocalVar(tSymbol *Sym);
 extern tAST_Node	*AST_NewString(void *Data, size_t Length);
+extern tAST_Node	*AST_NewBlob(const tType *Type, void *Data, size_t Length);
 extern tAST_Node	*AST_NewInteger(uint64_t Value);
+extern const tType	*AST_GetIntegerType(const tAST_Node *Node);
 extern tAST_Node	*AST_NewArrayIndex(tAST_Node *Var, tAST_Node *Index);
 extern tAST_Node	*AST_NewMember(tAST_Node *Struct, const char *Name, size_t NameLen);
 
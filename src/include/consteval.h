@@ -0,0 +1,55 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * include/consteval.h
+ * - Compile-time evaluation of constant expressions and initialisers
+ */
+#ifndef _CONSTEVAL_H_
+#define _CONSTEVAL_H_
+
+#include <ast.h>
+#include <types.h>
+#include <symbol.h>
+
+/**
+ * \brief Address stored in an initialiser (patched by the assembler/linker)
+ */
+typedef struct sConstReloc
+{
+	size_t	Offset;	//!< Position in the image
+	 int	Size;	//!< Width of the field (in bytes)
+	const char	*Symbol;	//!< Global symbol (NULL for a string literal)
+	 int	String;	//!< Index into tConstImage.Strings (if Symbol is NULL)
+	int64_t	Addend;
+} tConstReloc;
+
+/**
+ * \brief Contents of an initialised object
+ */
+typedef struct sConstImage
+{
+	size_t	Size;
+	uint8_t	*Data;
+	 int	nRelocs;	//!< (in order of Offset)
+	tConstReloc	*Relocs;
+	 int	nStrings;	//!< String literals the image points to
+	tAST_Node	**Strings;
+} tConstImage;
+
+// consteval.c
+//! Evaluate an integer constant expression
+extern  int	ConstEval_Integer(tAST_Node *Node, int64_t *Value);
+//! Same, but silently fails if the expression isn't an integer constant
+extern  int	ConstEval_TryInteger(tAST_Node *Node, int64_t *Value);
+//! Build the image of an object of type Type initialised from Value (zeroed if NULL)
+extern  int	ConstEval_Initialiser(tConstImage *Image, const tType *Type, tAST_Node *Value);
+//! Same, but silently fails if the initialiser isn't constant
+extern  int	ConstEval_TryInitialiser(tConstImage *Image, const tType *Type, tAST_Node *Value);
+extern void	ConstEval_FreeImage(tConstImage *Image);
+//! Read a field of a global's initial contents (an integer, or the address of another global)
+extern  int	ConstEval_ReadGlobal(const tSymbol *Sym, int64_t Offset, size_t Size, uint64_t *Value, const tSymbol **Target);
+
+#endif
@@ -1,16 +1,270 @@
 /*
- * TODO
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * include/irm.h
+ * - Infinite Register Machine (intermediate representation)
  */
 #ifndef _IRM_H_
 #define _IRM_H_
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <symbol.h>
 
 typedef struct sIRMState*	tIRMHandle;
+typedef struct sIRMBlock	tIRMBlock;
+typedef struct sIRMOp	tIRMOp;
 typedef int	tIRMReg;
 
+#define IRM_REG_VOID	0
+
+enum eIRMOpcodes
+{
+	IRMOP_NOP,
+
+	// -- Values
+	IRMOP_CONST,	//!< Dst = Imm
+	IRMOP_STRING,	//!< Dst = &"String"
+	IRMOP_SYMADDR,	//!< Dst = &Sym
+	IRMOP_LOCALADDR,	//!< Dst = &Locals[Local]
+	IRMOP_ARGUMENT,	//!< Dst = Argument #Imm
+	IRMOP_COPY,	//!< Dst = Src[0]
+	IRMOP_PHI,	//!< Dst = phi(Args[]), one entry per predecessor
+
+	// -- Memory
+	IRMOP_LOADLOCAL,	//!< Dst = Locals[Local]
+	IRMOP_STORELOCAL,	//!< Locals[Local] = Src[0]
+	IRMOP_LOAD,	//!< Dst = *Src[0]
+	IRMOP_STORE,	//!< *Src[0] = Src[1]
+
+	// -- Unary
+	IRMOP_NEG,
+	IRMOP_NOT,
+	IRMOP_CAST,	//!< Dst = (Dst's type)Src[0]
+
+	// -- Binary
+	IRMOP_ADD,
+	IRMOP_SUB,
+	IRMOP_MUL,
+	IRMOP_DIV,
+	IRMOP_MOD,
+	IRMOP_AND,
+	IRMOP_OR,
+	IRMOP_XOR,
+	IRMOP_SHL,
+	IRMOP_SHR,
+	IRMOP_CMPEQ,
+	IRMOP_CMPNE,
+	IRMOP_CMPLT,
+	IRMOP_CMPLE,
+	IRMOP_CMPGT,
+	IRMOP_CMPGE,
+
+	IRMOP_SELECT,	//!< Dst = Src[0] ? Args[0] : Args[1] (both already evaluated)
+
+	IRMOP_CALL,	//!< Dst = Src[0](Args[])
+
+	// -- Terminators (always the last op in a block)
+	IRMOP_JUMP,	//!< goto Block->Succ[0]
+	IRMOP_BRANCH,	//!< Src[0] ? Block->Succ[0] : Block->Succ[1]
+	IRMOP_SWITCH,	//!< goto Block->Succ[ Table.Targets[Src[0]] ] (pointer sized Src[0] < Table.Count, checked beforehand)
+	IRMOP_RETURN,	//!< return Src[0]
+
+	NUM_IRMOPS
+};
+
+#define IRMFLAG_SIGNED	0x01	//!< Operation is on signed values (DIV/MOD/SHR/CMP*/CAST)
+#define IRMFLAG_FOLDED	0x02	//!< Computed inside the instructions of its users (set by instruction selection)
+
+struct sIRMOp
+{
+	tIRMOp	*Next;
+	tIRMOp	*Prev;
+	tIRMBlock	*Block;
+
+	enum eIRMOpcodes	Op;
+	unsigned int	Flags;
+	tIRMReg	Dst;
+	tIRMReg	Src[2];
+
+	union {
+		uint64_t	Imm;
+		 int	Local;
+		const tSymbol	*Sym;
+		struct {
+			size_t	Length;
+			const char	*Data;
+		}	String;
+		struct {
+			 int	Count;
+			 int	*Targets;	//!< Indexes into Block->Succ
+		}	Table;
+	};
+
+	 int	nArgs;
+	tIRMReg	*Args;
+
+	 int	Index;	//!< Linear position (set by the register allocator)
+
+	// Instruction selection (set by the backend)
+	 int	Form;	//!< Target specific instruction form
+	uint32_t	FoldMask;	//!< Uses (IRM_GetUse indexes) computed inside this instruction
+};
+
+struct sIRMBlock
+{
+	 int	Index;	//!< Position in tIRMHandle->Blocks (reverse postorder after IRM_UpdateCFG)
+
+	tIRMOp	*FirstOp;
+	tIRMOp	*LastOp;
+
+	 int	nSucc;
+	 int	SuccSpace;
+	tIRMBlock	**Succ;	//!< Distinct successors
+	 int	nPred;
+	 int	PredSpace;
+	tIRMBlock	**Pred;
+
+	// Dominator tree (see IRM_ComputeDominators)
+	tIRMBlock	*IDom;
+	tIRMBlock	*FirstChild;
+	tIRMBlock	*NextSibling;
+	 int	DomPre, DomPost;	//!< Dominator tree DFS numbering (for IRM_Dominates)
+	 int	nFrontier;
+	tIRMBlock	**Frontier;
+};
+
+typedef struct sIRMLocal
+{
+	const char	*Name;	//!< NULL for compiler temporaries
+	const tType	*Type;
+	bool	bAddressTaken;
+	 int	Scope;	//!< Block scope it was declared in (0 = function, see IRM_AddScope)
+} tIRMLocal;
+
+typedef struct sIRMRegInfo
+{
+	const tType	*Type;
+} tIRMRegInfo;
+
+struct sIRMState
+{
+	const char	*Name;
+	 int	nArgs;
+
+	 int	nRegs;
+	 int	RegSpace;
+	tIRMRegInfo	*Regs;
+
+	 int	nLocals;
+	 int	LocalSpace;
+	tIRMLocal	*Locals;
+
+	 int	nScopes;
+	 int	*ScopeParents;	//!< [nScopes] Enclosing scope (-1 for the function scope)
+
+	 int	nBlocks;
+	 int	BlockSpace;
+	tIRMBlock	**Blocks;	//!< Blocks[0] is the entry block
+
+	tIRMBlock	*CurBlock;	//!< Append point
+
+	bool	bIsSSA;
+};
+
+// --- Construction
+extern tIRMHandle	IRM_CreateFunction(const char *Name, int NArgs);
+extern void	IRM_FreeFunction(tIRMHandle Handle);
+extern tIRMReg	IRM_AllocateRegister(tIRMHandle Handle, const tType *Type);
+extern const tType	*IRM_GetRegType(tIRMHandle Handle, tIRMReg Register);
+extern  int	IRM_AddLocal(tIRMHandle Handle, const tType *Type, const char *Name);
+extern  int	IRM_AddScope(tIRMHandle Handle, int Parent);
+extern bool	IRM_ScopeContains(tIRMHandle Handle, int Outer, int Inner);
+extern tIRMBlock	*IRM_CreateBlock(tIRMHandle Handle);
+extern void	IRM_SetBlock(tIRMHandle Handle, tIRMBlock *Block);
+
 extern void	IRM_AppendConstant(tIRMHandle Handle, tIRMReg Register, uint64_t Value);
 extern void	IRM_AppendCharacterConstant(tIRMHandle Handle, tIRMReg Register, size_t Length, const char *Data);
 extern void	IRM_AppendSymbol(tIRMHandle Handle, tIRMReg Register, const tSymbol *Symbol);
+extern void	IRM_AppendLocalAddr(tIRMHandle Handle, tIRMReg Register, int Local);
+extern void	IRM_AppendArgument(tIRMHandle Handle, tIRMReg Register, int Index);
+extern void	IRM_AppendLoadLocal(tIRMHandle Handle, tIRMReg Register, int Local);
+extern void	IRM_AppendStoreLocal(tIRMHandle Handle, int Local, tIRMReg Value);
+extern void	IRM_AppendLoad(tIRMHandle Handle, tIRMReg Register, tIRMReg Address);
+extern void	IRM_AppendStore(tIRMHandle Handle, tIRMReg Address, tIRMReg Value);
+extern void	IRM_AppendUniOp(tIRMHandle Handle, enum eIRMOpcodes Op, unsigned int Flags, tIRMReg Register, tIRMReg Value);
+extern void	IRM_AppendBinOp(tIRMHandle Handle, enum eIRMOpcodes Op, unsigned int Flags, tIRMReg Register, tIRMReg Left, tIRMReg Right);
+extern void	IRM_AppendCall(tIRMHandle Handle, tIRMReg Register, tIRMReg Function, int NArgs, const tIRMReg *Args);
+extern void	IRM_AppendJump(tIRMHandle Handle, tIRMBlock *Target);
+extern void	IRM_AppendBranch(tIRMHandle Handle, tIRMReg Condition, tIRMBlock *True, tIRMBlock *False);
+extern void	IRM_AppendSwitch(tIRMHandle Handle, tIRMReg Index, int Count, tIRMBlock * const *Targets);
+extern void	IRM_AppendReturn(tIRMHandle Handle, tIRMReg Value);
+
+// --- Manipulation
+extern tIRMOp	*IRM_NewOp(enum eIRMOpcodes Op);
+extern void	IRM_InsertOpBefore(tIRMBlock *Block, tIRMOp *Before, tIRMOp *Op);
+extern void	IRM_RemoveOp(tIRMOp *Op);
+extern void	IRM_FreeOp(tIRMOp *Op);
+extern bool	IRM_IsTerminator(const tIRMOp *Op);
+extern  int	IRM_GetUseCount(const tIRMOp *Op);
+extern tIRMReg	*IRM_GetUse(tIRMOp *Op, int Index);
+extern  int	IRM_GetPredIndex(const tIRMBlock *Block, const tIRMBlock *Pred);
+extern  int	IRM_GetSuccIndex(const tIRMBlock *Block, const tIRMBlock *Succ);
+extern tIRMBlock	*IRM_SplitEdge(tIRMHandle Handle, tIRMBlock *From, int SuccIndex);
+
+// --- Analysis
+extern void	IRM_UpdateCFG(tIRMHandle Handle);
+extern void	IRM_ComputeDominators(tIRMHandle Handle);
+extern bool	IRM_Dominates(const tIRMBlock *A, const tIRMBlock *B);
+extern tIRMBlock	*IRM_CommonDominator(tIRMBlock *A, tIRMBlock *B);
+
+// --- Tail recursion (opt/tailcall.c)
+extern  int	IRM_EliminateTailRecursion(tIRMHandle Handle, const tSymbol *Self);
+
+// --- SSA (opt/ssa.c)
+extern void	IRM_EnterSSA(tIRMHandle Handle);
+extern void	IRM_LeaveSSA(tIRMHandle Handle);
+extern  int	IRM_RemoveDeadCode(tIRMHandle Handle);
+
+// --- Constant propagation (opt/sccp.c)
+extern  int	IRM_PropagateConstants(tIRMHandle Handle);
+extern uint64_t	IRM_NormaliseConstant(const tType *Type, uint64_t Value);
+extern bool	IRM_FoldOperation(enum eIRMOpcodes Op, unsigned int Flags, const tType *Type, uint64_t Left, uint64_t Right, uint64_t *Result);
+
+// --- Value numbering and alias analysis (opt/gvn.c)
+enum eIRMMemBase
+{
+	IRMMEM_LOCAL,
+	IRMMEM_SYMBOL,
+	IRMMEM_REGISTER,	//!< Arbitrary pointer
+};
+//! \brief Decomposed memory address: base + constant offset
+typedef struct sIRMMemLocation
+{
+	enum eIRMMemBase	BaseType;
+	union {
+		 int	Local;
+		const tSymbol	*Sym;
+		tIRMReg	Reg;
+	};
+	 int64_t	Offset;
+	size_t	Size;
+} tIRMMemLocation;
+
+extern  int	IRM_NumberValues(tIRMHandle Handle);
+extern void	IRM_GetMemLocation(tIRMHandle Handle, tIRMOp * const *Defs, const tIRMOp *Op, tIRMMemLocation *Loc);
+extern bool	IRM_SameMemLocation(const tIRMMemLocation *A, const tIRMMemLocation *B);
+extern bool	IRM_MayAlias(const tIRMMemLocation *A, const tIRMMemLocation *B);
+
+// --- If-conversion (opt/select.c)
+extern  int	IRM_FormSelects(tIRMHandle Handle);
+
+// --- Debug
+extern const char	*IRM_GetOpName(enum eIRMOpcodes Op);
+extern void	IRM_DumpFunction(FILE *fp, tIRMHandle Handle);
 
 #endif
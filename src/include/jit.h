@@ -0,0 +1,28 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * include/jit.h
+ * - In-process execution of compiled code
+ */
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include <output.h>
+
+typedef struct sJitImage	tJitImage;
+
+// output/jit.c
+//! Map an assembled object into memory (external symbols come from the host process)
+extern tJitImage	*JIT_Load(const tOutput_Object *Object);
+//! Address of a global symbol in a loaded image (NULL if not defined)
+extern void	*JIT_GetSymbol(tJitImage *Image, const char *Name);
+extern void	JIT_Free(tJitImage *Image);
+//! Load an object and call Entry (as int Entry(int argc, char **argv))
+extern  int	JIT_Run(const tOutput_Object *Object, const char *Entry, int argc, char **argv);
+//! Compile a C source buffer for the host machine and load it (NULL on failure)
+extern tJitImage	*JIT_CompileSource(const char *Name, const char *Source, size_t Length);
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * include/link.h
+ * - Static linker
+ */
+#ifndef _LINK_H_
+#define _LINK_H_
+
+#include <output.h>
+
+// Special symbol sections
+#define LINK_UNDEF	-1
+#define LINK_ABS	-2
+#define LINK_COMMON	-3	//!< Value is the alignment, Size the size
+
+enum eLinkKind
+{
+	LINK_NONE = -1,	//!< Not loaded
+	LINK_TEXT,
+	LINK_RODATA,
+	LINK_DATA,
+	LINK_BSS,
+	NUM_LINK_KINDS
+};
+
+typedef struct sLinkSection
+{
+	char	*Name;
+	 int	Kind;
+	const uint8_t	*Data;	//!< NULL for LINK_BSS
+	uint64_t	Size;
+	uint64_t	Align;
+	bool	bDiscarded;	//!< Member of a duplicate COMDAT group
+	 int	nRelocs;
+	tOutput_Reloc	*Relocs;	//!< (Addends are always explicit)
+	uint64_t	Addr;	//!< Assigned by the layout
+} tLinkSection;
+
+typedef struct sLinkSymbol
+{
+	char	*Name;
+	 int	Section;	//!< Section index, or LINK_UNDEF/LINK_ABS/LINK_COMMON
+	uint64_t	Value;
+	uint64_t	Size;
+	bool	bGlobal;
+	bool	bWeak;
+	bool	bFunc;
+} tLinkSymbol;
+
+typedef struct sLinkGroup
+{
+	char	*Signature;
+	 int	nMembers;
+	 int	*Members;
+} tLinkGroup;
+
+typedef struct sLinkObject
+{
+	struct sLinkObject	*Next;
+	char	*Name;
+	bool	bLoaded;	//!< Part of the link (archive members are loaded on demand)
+	 int	nSections;
+	tLinkSection	*Sections;
+	 int	nSymbols;
+	tLinkSymbol	*Symbols;
+	 int	nGroups;
+	tLinkGroup	*Groups;
+} tLinkObject;
+
+typedef struct sLinkImageSymbol
+{
+	const char	*Name;
+	uint64_t	Addr;
+	bool	bFunc;
+} tLinkImageSymbol;
+
+//! \brief Linked program (two segments: headers+code+constants, then data+bss)
+typedef struct sLinkImage
+{
+	 int	Bits;
+	 int	Machine;
+	uint64_t	Entry;
+	uint64_t	TextAddr;
+	size_t	TextSize;	//!< (Includes the file headers)
+	size_t	TextStart;	//!< Offset of the first section in Text
+	uint8_t	*Text;
+	uint64_t	DataAddr;
+	size_t	DataSize;	//!< Initialised part of the data segment
+	size_t	BssSize;
+	uint8_t	*Data;
+	 int	nSymbols;
+	tLinkImageSymbol	*Symbols;
+} tLinkImage;
+
+// output/elf.c
+extern tLinkObject	*Output_ReadELF(const uint8_t *Data, size_t Size, const char *Name, int Bits, int Machine);
+extern size_t	Output_ELFExecHeaderSize(int Bits);
+extern  int	Output_WriteELFExecutable(FILE *OutFile, const tLinkImage *Image);
+
+// output/link.c
+extern  int	Link_WriteExecutable(const tOutput_Object *Object, const char * const *Inputs, int nInputs, const char *File);
+
+#endif
@@ -11,41 +11,110 @@
 #define _OUTPUT_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <types.h>
 
-// === Output Format Type
-typedef struct sOutputFormat
-{
-	char	*Name;
-	 int	(*GenProlouge)(FILE *OutFile);
-	 int	(*GenFunction)(FILE *OutFile, tFunction *Func);
-}	tOutputFormat;
+#define OUTPUT_MAX_SECTIONS	8
 
-#if 0
-typedef struct sElf_x86_Reloc
+// === Object file contents (filled by an architecture's assembler)
+typedef struct sOutput_Reloc
 {
-	char	*Name;
-	 int	Size;
-	uint	Offset;
-	uint	Addend;
+	 int	Symbol;	//!< Index into tOutput_Object.Symbols
+	 int	Size;	//!< Width of the field (in bits)
+	bool	bRelative;	//!< Value is relative to the end of the field
+	bool	bBranch;	//!< Target of a call/jmp (can go through a PLT entry or stub)
+	uint64_t	Offset;
+	int64_t	Addend;
 }	tOutput_Reloc;
 
-typedef struct sElf_x86_Function
+typedef struct sOutput_Section
 {
+	const char	*Name;
+	bool	bWritable;
+	bool	bExecutable;
+	bool	bNoBits;	//!< Zero filled at load time (.bss), Code is unused
+	 int	Align;
+
 	size_t	CodeLength;
 	size_t	CodeSpace;
 	uint8_t	*Code;
-	
+
 	 int	nRelocs;
 	 int	RelocSpace;
 	tOutput_Reloc	*Relocs;
-}	tOutput_Function;
+}	tOutput_Section;
+
+typedef struct sOutput_Symbol
+{
+	char	*Name;
+	 int	Section;	//!< -1 for undefined (external) symbols
+	bool	bGlobal;
+	bool	bSection;	//!< Section symbol (relocations against local labels use these)
+	uint64_t	Value;
+	uint64_t	Size;	//!< Bytes covered by a function/variable (0 if unknown)
+}	tOutput_Symbol;
+
+typedef struct sOutput_Object
+{
+	 int	Bits;	//!< 32 or 64
+	 int	Machine;	//!< ELF machine number
+	 int	nSections;
+	tOutput_Section	Sections[OUTPUT_MAX_SECTIONS];
+	 int	nSymbols;
+	 int	SymbolSpace;
+	tOutput_Symbol	*Symbols;
+}	tOutput_Object;
+
+// === Assembly text writer
+typedef struct sAsmOut
+{
+	FILE	*File;	//!< Flushed to when full (NULL: all text is kept in Data)
+	char	*Data;
+	size_t	Length;
+	size_t	Space;
+}	tAsmOut;
+
+// === Output Format Type
+typedef struct sOutputFormat
+{
+	char	*Name;
+	 int	(*GenProlouge)(tAsmOut *OutFile);
+	 int	(*GenFunction)(tAsmOut *OutFile, tFunction *Func);
+	//! Assemble the generated text into an object (NULL if the text can't be assembled in-process)
+	 int	(*Assemble)(const char *Text, size_t Length, tOutput_Object *Object);
+	//! Assembly for the program entrypoint used by --link when no _start is supplied
+	const char	*StartCode;
+	tTypeLayout	Layout;
+}	tOutputFormat;
 
 // === Functions ===
-extern void	Output_AppendCode(tOutput_Function *Func, uint8_t Byte);
-extern void	Output_AppendAbs16(tOutput_Function *Func, uint16_t Value);
-extern void	Output_AppendAbs32(tOutput_Function *Func, uint32_t Value);
-extern void Output_AppendReloc16(tOutput_Function *Func, int16_t Addend, char *SymName);
-extern void Output_AppendReloc32(tOutput_Function *Func, int32_t Addend, char *SymName);
-#endif
+//! Generate code for all defined functions and assemble it
+extern  int	Output_GenerateObject(tOutput_Object *Object);
+extern  int	Output_AddSection(tOutput_Object *Object, const char *Name);
+extern  int	Output_AddSymbol(tOutput_Object *Object, const char *Name, int Section, uint64_t Value, bool bGlobal);
+extern void	Output_FreeObject(tOutput_Object *Object);
+extern void	Output_AppendCode(tOutput_Section *Sect, uint8_t Byte);
+extern void	Output_AppendData(tOutput_Section *Sect, const void *Data, size_t Length);
+extern void	Output_AppendAbs16(tOutput_Section *Sect, uint16_t Value);
+extern void	Output_AppendAbs32(tOutput_Section *Sect, uint32_t Value);
+extern void	Output_AppendAbs64(tOutput_Section *Sect, uint64_t Value);
+extern void	Output_AppendReloc(tOutput_Section *Sect, int Bits, bool bRelative, bool bBranch, int64_t Addend, int Symbol);
+extern void	Output_Int_AddReloc(tOutput_Section *Sect, int Bits, bool bRelative, bool bBranch, uint64_t Offset, int64_t Addend, int Symbol);
+
+// output/asmout.c
+extern bool	gbVerboseAsm;	//!< -fverbose-asm: Explanatory comments in the assembly
+extern void	AsmOut_Open(tAsmOut *Out, FILE *File);
+extern void	AsmOut_Close(tAsmOut *Out);
+extern void	AsmOut_Free(tAsmOut *Out);
+extern void	AsmOut_Write(tAsmOut *Out, const char *Data, size_t Length);
+extern void	AsmOut_Str(tAsmOut *Out, const char *String);
+extern void	AsmOut_Int(tAsmOut *Out, int64_t Value);
+extern void	AsmOut_Hex(tAsmOut *Out, uint64_t Value);
+extern void	AsmOut_Printf(tAsmOut *Out, const char *Format, ...) __attribute__((format(printf, 2, 3)));
+extern char	*AsmOut_FmtInt(char *Dest, int64_t Value);
+extern char	*AsmOut_FmtHex(char *Dest, uint64_t Value);
+
+// output/elf.c
+extern  int	Output_WriteELF(FILE *OutFile, const tOutput_Object *Object);
 
 #endif
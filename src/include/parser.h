@@ -7,6 +7,7 @@ PARSER.H
 #define _PARSER_H
 
 #include <global.h>
+#include <stdbool.h>
 
 typedef struct sParser	tParser;
 
@@ -24,11 +25,14 @@ struct sParser
 		enum eTokens	Token;
 		
 		long long int	Integer;
+		bool	bDecimal;	//!< TOK_CONST_NUM was written in decimal
 		
 		const char	*TokenStart;
 		size_t	TokenLen;
 		char	LocalBuffer[64];	// Functionally the max identifier length
 	} Cur, Prev, Next;
+	
+	 int	UnrollHint;	//!< From `#pragma unroll`, applies to the next statement
 };
 
 extern void	SyntaxError_T(tParser *Parser, enum eTokens Tok, const char *reason, ...);
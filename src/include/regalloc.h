@@ -0,0 +1,97 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * include/regalloc.h
+ * - Linear scan register allocation over the IRM
+ */
+#ifndef _REGALLOC_H_
+#define _REGALLOC_H_
+
+#include <irm.h>
+
+#define RA_MAX_REGS	32
+
+/**
+ * \brief Positions
+ *
+ * Operation N is at position 4N. Operands are read at 4N, the result is
+ * written at 4N+2 and moves inserted by the allocator run at 4N-1 (the
+ * gap before the operation).
+ */
+#define RA_POS_USE(n)	((n)*4)
+#define RA_POS_DEF(n)	((n)*4+2)
+#define RA_POS_GAP(n)	((n)*4-1)
+
+//! \brief Register constraints for an operation (filled by the target)
+typedef struct sRAConstraints
+{
+	uint32_t	ClobberUse;	//!< Clobbered while operands are read (operands can't be in these)
+	uint32_t	ClobberDef;	//!< Clobbered by the operation (values live across can't be in these)
+	uint32_t	ClobberAll;	//!< Clobbered for the whole operation (including the result)
+	uint32_t	LiveIn;	//!< Hold values from the function's entry until the operation reads them
+	 int	DstHint;	//!< Preferred register for the result (-1 for none)
+	 int	SrcHint[2];	//!< Preferred register for Src[0]/Src[1]
+	uint32_t	SrcNeedsReg;	//!< Bitmask of operand indexes that should be reloaded into a register
+} tRAConstraints;
+
+typedef struct sRegAllocTarget
+{
+	 int	nRegs;	//!< Number of physical register numbers (allocatable or not)
+	uint32_t	Allocatable;
+	uint32_t	CallerSaved;	//!< Preferred when a value doesn't live across a call
+	const char * const	*RegNames;	//!< For debug output
+	void	(*GetConstraints)(tIRMHandle Handle, const tIRMOp *Op, tRAConstraints *Constraints);
+} tRegAllocTarget;
+
+//! \brief Location of a value, a register or a (4-byte) spill slot
+typedef struct sRALocation
+{
+	 int	Reg;	//!< Physical register, or -1 if in memory
+	 int	Slot;	//!< Spill slot index (Reg == -1)
+} tRALocation;
+
+typedef struct sRAMove
+{
+	tRALocation	Dst;
+	tRALocation	Src;
+} tRAMove;
+
+//! \brief Set of moves that happen simultaneously
+typedef struct sRAMoveList
+{
+	 int	nMoves;
+	 int	Space;
+	tRAMove	*Moves;
+} tRAMoveList;
+
+typedef struct sRAInterval	tRAInterval;
+
+typedef struct sRegAllocation
+{
+	tIRMHandle	Handle;
+	const tRegAllocTarget	*Target;
+
+	 int	nOps;
+	tIRMOp	**Ops;	//!< Operations in layout order (indexed by op->Index)
+
+	tRAInterval	**Intervals;	//!< [nRegs] First (by position) piece of each IRM register
+	 int	nSpillSlots;
+	 int	*SpillSlots;	//!< [nRegs] Slot used by the register (-1 if never spilt)
+
+	tRAMoveList	*GapMoves;	//!< [nOps] Moves to make before each operation
+	tRAMoveList	*EntryMoves;	//!< [nBlocks] Moves at the start of a block (after the label)
+	tRAMoveList	*ExitMoves;	//!< [nBlocks] Moves before a block's terminator
+
+	uint32_t	*BusyRegs;	//!< [nOps] Registers holding a value during each operation
+	uint32_t	UsedRegs;	//!< All registers assigned to values
+} tRegAllocation;
+
+extern tRegAllocation	*RA_Allocate(tIRMHandle Handle, const tRegAllocTarget *Target);
+extern void	RA_Free(tRegAllocation *RA);
+extern tRALocation	RA_GetLocation(tRegAllocation *RA, tIRMReg Reg, int Position);
+extern void	RA_SequentialiseMoves(tRAMoveList *List, void (*Emit)(void *Ptr, const tRAMove *Move, bool Swap), void *Ptr);
+
+#endif
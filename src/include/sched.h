@@ -0,0 +1,38 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * include/sched.h
+ * - List scheduling of IRM blocks
+ */
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include <irm.h>
+
+#define SCHED_MAX_UOPS	3
+#define SCHED_MAX_PORTS	8
+
+//! \brief Execution model of one instruction (filled by the target)
+typedef struct sSchedModel
+{
+	 int	Latency;	//!< Cycles until the result can be used
+	 int	nUops;
+	uint8_t	UopPorts[SCHED_MAX_UOPS];	//!< Ports each micro-op can issue to (bitmask)
+} tSchedModel;
+
+typedef struct sSchedTarget
+{
+	 int	IssueWidth;	//!< Micro-ops issued per cycle
+	 int	nPorts;
+	 int	nRegs;	//!< Registers available to values (scheduling keeps pressure below this)
+	 int	StoreLatency;	//!< Cycles from a store until an aliasing load can read it
+	//! Model of an instruction, nFoldedLoads is the number of folded loads it performs
+	void	(*GetModel)(tIRMHandle Handle, const tIRMOp *Op, int nFoldedLoads, tSchedModel *Model);
+} tSchedTarget;
+
+extern  int	Sched_ScheduleFunction(tIRMHandle Handle, const tSchedTarget *Target);
+
+#endif
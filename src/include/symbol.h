@@ -49,6 +49,10 @@ struct sSymbol
 	 int	Offset;
 	
 	tAST_Node	*Value;
+	
+	bool	bReadOnly;	//!< Global whose contents are never changed at runtime
+	bool	bDirectOnly;	//!< Function only ever called directly from this file (free to use its own calling convention)
+	struct sSymbol	*Global;	//!< Block scope static/extern: the global that holds the variable
 };
 
 struct sCodeBlock
@@ -64,6 +68,8 @@ struct sFunction
 	enum eLinkage	Linkage;
 	tSymbol	Sym;
 
+	struct sIRMState	*IRM;	//!< Lowered code (NULL if not compiled to IRM)
+
 	const char *ArgNames[];
 };
 
@@ -86,7 +92,7 @@ extern tType	*Symbol_GetEnum(char *Name);
 extern tSymbol	*Symbol_ResolveSymbol(const char *Name);
 extern  int	Symbol_AddGlobalVariable(const tType *Type, enum eLinkage Linkage, const char *Name, tAST_Node *InitValue);
 
-extern  int	Symbol_AddFunction(const tType *FcnType, enum eLinkage Linkage, const char *Name, tAST_Node *Code);
+extern  int	Symbol_AddFunction(const tType *FcnType, enum eLinkage Linkage, const char *Name, char **ArgNames, tAST_Node *Code);
 
 extern void	Symbol_SetFunction(tFunction *Fcn);
 extern void	Symbol_SetFunctionCode(tFunction *Fcn, void *Block);
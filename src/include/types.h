@@ -119,6 +119,16 @@ struct sEnumValue
 	uint64_t	Value;
 };
 
+/**
+ * \brief Target data layout (sizes that depend on the output architecture)
+ */
+typedef struct sTypeLayout
+{
+	size_t	LongSize;
+	size_t	PointerSize;
+	bool	bAlignFields;	//!< Fields are padded to their alignment (otherwise packed)
+} tTypeLayout;
+
 struct sEnum
 {
 	char	*Tag;
@@ -145,6 +155,12 @@ extern void	Types_DerefType(tType *Type);
 
 //! \brief Get the size of a type in memory
 extern size_t	Types_GetSizeOf(const tType *Type);
+//! \brief Get the alignment of a type in memory
+extern size_t	Types_GetAlignOf(const tType *Type);
+//! \brief Get the offset of a structure/union's field
+extern size_t	Types_GetFieldOffset(const tType *Type, int Index);
+//! \brief Select the target's data layout (before anything is compiled)
+extern void	Types_SetLayout(const tTypeLayout *Layout);
 
 extern tType	*Types_CreateVoid(void);
 extern tType	*Types_CreateIntegerType(bool bSigned, enum eIntegerSize Size);
@@ -158,6 +174,8 @@ extern tStruct	*Types_GetStructUnion(bool IsUnion, const char *Tag, bool Create)
 extern int	Types_AddStructField(tStruct *StructUnion, const tType *Type, const char *Name);
 extern tEnum	*Types_GetEnum(const char *Tag, bool Create);
 extern int	Types_AddEnumValue(tEnum *Enum, const char *Name, uint64_t Value);
+//! \brief Value of a named enumeration constant (false if there isn't one)
+extern bool	Types_GetEnumValue(const char *Name, uint64_t *Value);
 
 extern const tType	*Types_Merge(const tType *Outer, const tType *Inner);
 
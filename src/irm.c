@@ -1,25 +1,780 @@
 /*
+ * Acess C Compiler
+ * - By John Hodge (thePowersGang)
+ *
+ * irm.c
+ * - Infinite Register Machine (storage, CFG and dominator analysis)
  */
+#include <global.h>
 #include <irm.h>
+#include <string.h>
+#include <assert.h>
 
-// === TYPES ===
-struct sIRMState
-{
+#define REG_STEP	32
+#define LOCAL_STEP	8
+#define BLOCK_STEP	16
+
+// === PROTOTYPES ===
+void	IRM_int_AppendOp(tIRMHandle Handle, tIRMOp *Op);
+void	IRM_int_AddPred(tIRMBlock *Block, tIRMBlock *Pred);
+tIRMBlock	*IRM_int_Intersect(tIRMBlock *B1, tIRMBlock *B2);
+
+// === GLOBALS ===
+const char * const csaIRMOpNames[NUM_IRMOPS] = {
+	"nop",
+	"const", "string", "symaddr", "localaddr", "arg", "copy", "phi",
+	"ldlocal", "stlocal", "load", "store",
+	"neg", "not", "cast",
+	"add", "sub", "mul", "div", "mod", "and", "or", "xor", "shl", "shr",
+	"cmpeq", "cmpne", "cmplt", "cmple", "cmpgt", "cmpge",
+	"select",
+	"call",
+	"jump", "branch", "switch", "return"
+};
+//! Number of Src[] entries read by each opcode
+const int	caIRMOpSrcCount[NUM_IRMOPS] = {
+	[IRMOP_COPY] = 1,
+	[IRMOP_STORELOCAL] = 1,
+	[IRMOP_LOAD] = 1,
+	[IRMOP_STORE] = 2,
+	[IRMOP_NEG] = 1, [IRMOP_NOT] = 1, [IRMOP_CAST] = 1,
+	[IRMOP_ADD ... IRMOP_CMPGE] = 2,
+	[IRMOP_SELECT] = 1,
+	[IRMOP_CALL] = 1,
+	[IRMOP_BRANCH] = 1,
+	[IRMOP_SWITCH] = 1,
+	[IRMOP_RETURN] = 1,
 };
 
 // === CODE ===
-tIRMHandle IRM_CreateFunction(const char *Name)
+tIRMHandle IRM_CreateFunction(const char *Name, int NArgs)
+{
+	tIRMHandle ret = calloc(1, sizeof(struct sIRMState));
+	ret->Name = Name;
+	ret->nArgs = NArgs;
+	ret->nRegs = 1;	// Register 0 is IRM_REG_VOID
+	ret->RegSpace = REG_STEP;
+	ret->Regs = calloc(ret->RegSpace, sizeof(tIRMRegInfo));
+	ret->nScopes = 1;
+	ret->ScopeParents = malloc(sizeof(int));
+	ret->ScopeParents[0] = -1;
+
+	ret->CurBlock = IRM_CreateBlock(ret);
+	return ret;
+}
+
+void IRM_FreeFunction(tIRMHandle Handle)
+{
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		tIRMBlock *blk = Handle->Blocks[i];
+		while( blk->FirstOp )
+		{
+			tIRMOp *op = blk->FirstOp;
+			IRM_RemoveOp(op);
+			IRM_FreeOp(op);
+		}
+		free(blk->Succ);
+		free(blk->Pred);
+		free(blk->Frontier);
+		free(blk);
+	}
+	free(Handle->Blocks);
+	free(Handle->Locals);
+	free(Handle->ScopeParents);
+	free(Handle->Regs);
+	free(Handle);
+}
+
+tIRMReg IRM_AllocateRegister(tIRMHandle Handle, const tType *Type)
+{
+	if( Handle->nRegs == Handle->RegSpace )
+	{
+		Handle->RegSpace += REG_STEP;
+		Handle->Regs = realloc(Handle->Regs, Handle->RegSpace*sizeof(tIRMRegInfo));
+		assert(Handle->Regs);
+	}
+	Handle->Regs[Handle->nRegs].Type = Type;
+	return Handle->nRegs ++;
+}
+
+const tType *IRM_GetRegType(tIRMHandle Handle, tIRMReg Register)
+{
+	assert( 0 <= Register && Register < Handle->nRegs );
+	return Handle->Regs[Register].Type;
+}
+
+int IRM_AddLocal(tIRMHandle Handle, const tType *Type, const char *Name)
+{
+	if( Handle->nLocals == Handle->LocalSpace )
+	{
+		Handle->LocalSpace += LOCAL_STEP;
+		Handle->Locals = realloc(Handle->Locals, Handle->LocalSpace*sizeof(tIRMLocal));
+		assert(Handle->Locals);
+	}
+	tIRMLocal *lcl = &Handle->Locals[Handle->nLocals];
+	lcl->Name = Name;
+	lcl->Type = Type;
+	// Aggregates are always accessed via their address
+	lcl->bAddressTaken = (Type->Class == TYPECLASS_ARRAY
+		|| Type->Class == TYPECLASS_STRUCTURE || Type->Class == TYPECLASS_UNION);
+	lcl->Scope = 0;
+	return Handle->nLocals ++;
+}
+
+/**
+ * \brief Create a block scope nested in Parent
+ */
+int IRM_AddScope(tIRMHandle Handle, int Parent)
+{
+	Handle->ScopeParents = realloc(Handle->ScopeParents, (Handle->nScopes+1)*sizeof(int));
+	Handle->ScopeParents[Handle->nScopes] = Parent;
+	return Handle->nScopes ++;
+}
+
+/**
+ * \brief Check if Inner is Outer or nested inside it
+ *
+ * Locals in scopes where neither contains the other are never alive at the
+ * same time, so they can share storage.
+ */
+bool IRM_ScopeContains(tIRMHandle Handle, int Outer, int Inner)
+{
+	for( ; Inner >= 0; Inner = Handle->ScopeParents[Inner] )
+	{
+		if( Inner == Outer )
+			return true;
+	}
+	return false;
+}
+
+tIRMBlock *IRM_CreateBlock(tIRMHandle Handle)
+{
+	if( Handle->nBlocks == Handle->BlockSpace )
+	{
+		Handle->BlockSpace += BLOCK_STEP;
+		Handle->Blocks = realloc(Handle->Blocks, Handle->BlockSpace*sizeof(tIRMBlock*));
+		assert(Handle->Blocks);
+	}
+	tIRMBlock *ret = calloc(1, sizeof(tIRMBlock));
+	ret->Index = Handle->nBlocks;
+	ret->SuccSpace = 2;
+	ret->Succ = calloc(ret->SuccSpace, sizeof(tIRMBlock*));
+	Handle->Blocks[Handle->nBlocks++] = ret;
+	return ret;
+}
+
+void IRM_SetBlock(tIRMHandle Handle, tIRMBlock *Block)
+{
+	Handle->CurBlock = Block;
+}
+
+// --- Appending ---
+void IRM_int_AppendOp(tIRMHandle Handle, tIRMOp *Op)
 {
-	return NULL;
+	// Code following a terminator (e.g. after a `return`) goes into a
+	// fresh block, which is then dropped as unreachable by IRM_UpdateCFG
+	if( Handle->CurBlock->LastOp && IRM_IsTerminator(Handle->CurBlock->LastOp) )
+		Handle->CurBlock = IRM_CreateBlock(Handle);
+	IRM_InsertOpBefore(Handle->CurBlock, NULL, Op);
 }
 
 void IRM_AppendConstant(tIRMHandle Handle, tIRMReg Register, uint64_t Value)
 {
+	tIRMOp *op = IRM_NewOp(IRMOP_CONST);
+	op->Dst = Register;
+	op->Imm = Value;
+	IRM_int_AppendOp(Handle, op);
 }
 void IRM_AppendCharacterConstant(tIRMHandle Handle, tIRMReg Register, size_t Length, const char *Data)
 {
+	tIRMOp *op = IRM_NewOp(IRMOP_STRING);
+	op->Dst = Register;
+	op->String.Length = Length;
+	op->String.Data = Data;
+	IRM_int_AppendOp(Handle, op);
 }
+/**
+ * \brief Load the address of a global symbol
+ */
 void IRM_AppendSymbol(tIRMHandle Handle, tIRMReg Register, const tSymbol *Symbol)
 {
+	tIRMOp *op = IRM_NewOp(IRMOP_SYMADDR);
+	op->Dst = Register;
+	op->Sym = Symbol;
+	IRM_int_AppendOp(Handle, op);
+}
+void IRM_AppendLocalAddr(tIRMHandle Handle, tIRMReg Register, int Local)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_LOCALADDR);
+	op->Dst = Register;
+	op->Local = Local;
+	Handle->Locals[Local].bAddressTaken = true;
+	IRM_int_AppendOp(Handle, op);
+}
+void IRM_AppendArgument(tIRMHandle Handle, tIRMReg Register, int Index)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_ARGUMENT);
+	op->Dst = Register;
+	op->Imm = Index;
+	IRM_int_AppendOp(Handle, op);
+}
+void IRM_AppendLoadLocal(tIRMHandle Handle, tIRMReg Register, int Local)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_LOADLOCAL);
+	op->Dst = Register;
+	op->Local = Local;
+	IRM_int_AppendOp(Handle, op);
+}
+void IRM_AppendStoreLocal(tIRMHandle Handle, int Local, tIRMReg Value)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_STORELOCAL);
+	op->Src[0] = Value;
+	op->Local = Local;
+	IRM_int_AppendOp(Handle, op);
+}
+void IRM_AppendLoad(tIRMHandle Handle, tIRMReg Register, tIRMReg Address)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_LOAD);
+	op->Dst = Register;
+	op->Src[0] = Address;
+	IRM_int_AppendOp(Handle, op);
+}
+void IRM_AppendStore(tIRMHandle Handle, tIRMReg Address, tIRMReg Value)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_STORE);
+	op->Src[0] = Address;
+	op->Src[1] = Value;
+	IRM_int_AppendOp(Handle, op);
+}
+void IRM_AppendUniOp(tIRMHandle Handle, enum eIRMOpcodes Op, unsigned int Flags, tIRMReg Register, tIRMReg Value)
+{
+	assert( caIRMOpSrcCount[Op] == 1 );
+	tIRMOp *op = IRM_NewOp(Op);
+	op->Flags = Flags;
+	op->Dst = Register;
+	op->Src[0] = Value;
+	IRM_int_AppendOp(Handle, op);
+}
+void IRM_AppendBinOp(tIRMHandle Handle, enum eIRMOpcodes Op, unsigned int Flags, tIRMReg Register, tIRMReg Left, tIRMReg Right)
+{
+	assert( IRMOP_ADD <= Op && Op <= IRMOP_CMPGE );
+	tIRMOp *op = IRM_NewOp(Op);
+	op->Flags = Flags;
+	op->Dst = Register;
+	op->Src[0] = Left;
+	op->Src[1] = Right;
+	IRM_int_AppendOp(Handle, op);
+}
+void IRM_AppendCall(tIRMHandle Handle, tIRMReg Register, tIRMReg Function, int NArgs, const tIRMReg *Args)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_CALL);
+	op->Dst = Register;
+	op->Src[0] = Function;
+	op->nArgs = NArgs;
+	op->Args = malloc(NArgs * sizeof(tIRMReg));
+	memcpy(op->Args, Args, NArgs * sizeof(tIRMReg));
+	IRM_int_AppendOp(Handle, op);
+}
+
+void IRM_AppendJump(tIRMHandle Handle, tIRMBlock *Target)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_JUMP);
+	IRM_int_AppendOp(Handle, op);
+	tIRMBlock *blk = op->Block;
+	blk->nSucc = 1;
+	blk->Succ[0] = Target;
+	IRM_int_AddPred(Target, blk);
+}
+void IRM_AppendBranch(tIRMHandle Handle, tIRMReg Condition, tIRMBlock *True, tIRMBlock *False)
+{
+	if( True == False ) {
+		IRM_AppendJump(Handle, True);
+		return ;
+	}
+	tIRMOp *op = IRM_NewOp(IRMOP_BRANCH);
+	op->Src[0] = Condition;
+	IRM_int_AppendOp(Handle, op);
+	tIRMBlock *blk = op->Block;
+	blk->nSucc = 2;
+	blk->Succ[0] = True;
+	blk->Succ[1] = False;
+	IRM_int_AddPred(True, blk);
+	IRM_int_AddPred(False, blk);
+}
+/**
+ * \brief Jump to Targets[Index] (\a Index must already be known to be less than \a Count)
+ */
+void IRM_AppendSwitch(tIRMHandle Handle, tIRMReg Index, int Count, tIRMBlock * const *Targets)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_SWITCH);
+	op->Src[0] = Index;
+	op->Table.Count = Count;
+	op->Table.Targets = malloc(Count * sizeof(int));
+	IRM_int_AppendOp(Handle, op);
+	tIRMBlock *blk = op->Block;
+	blk->nSucc = 0;
+	for( int i = 0; i < Count; i ++ )
+	{
+		 int	sidx = IRM_GetSuccIndex(blk, Targets[i]);
+		if( sidx < 0 )
+		{
+			if( blk->nSucc == blk->SuccSpace ) {
+				blk->SuccSpace *= 2;
+				blk->Succ = realloc(blk->Succ, blk->SuccSpace*sizeof(tIRMBlock*));
+				assert(blk->Succ);
+			}
+			sidx = blk->nSucc ++;
+			blk->Succ[sidx] = Targets[i];
+			IRM_int_AddPred(Targets[i], blk);
+		}
+		op->Table.Targets[i] = sidx;
+	}
+}
+void IRM_AppendReturn(tIRMHandle Handle, tIRMReg Value)
+{
+	tIRMOp *op = IRM_NewOp(IRMOP_RETURN);
+	op->Src[0] = Value;
+	IRM_int_AppendOp(Handle, op);
+	op->Block->nSucc = 0;
+}
+
+// --- Manipulation ---
+tIRMOp *IRM_NewOp(enum eIRMOpcodes Op)
+{
+	tIRMOp *ret = calloc(1, sizeof(tIRMOp));
+	ret->Op = Op;
+	return ret;
+}
+
+/**
+ * \brief Link \a Op into \a Block before \a Before (NULL appends)
+ */
+void IRM_InsertOpBefore(tIRMBlock *Block, tIRMOp *Before, tIRMOp *Op)
+{
+	Op->Block = Block;
+	Op->Next = Before;
+	if( Before ) {
+		Op->Prev = Before->Prev;
+		Before->Prev = Op;
+	}
+	else {
+		Op->Prev = Block->LastOp;
+		Block->LastOp = Op;
+	}
+	if( Op->Prev )
+		Op->Prev->Next = Op;
+	else
+		Block->FirstOp = Op;
+}
+
+void IRM_RemoveOp(tIRMOp *Op)
+{
+	tIRMBlock *blk = Op->Block;
+	if( Op->Prev )
+		Op->Prev->Next = Op->Next;
+	else
+		blk->FirstOp = Op->Next;
+	if( Op->Next )
+		Op->Next->Prev = Op->Prev;
+	else
+		blk->LastOp = Op->Prev;
+	Op->Next = Op->Prev = NULL;
+	Op->Block = NULL;
+}
+
+void IRM_FreeOp(tIRMOp *Op)
+{
+	assert( !Op->Block );
+	if( Op->Op == IRMOP_SWITCH )
+		free(Op->Table.Targets);
+	free(Op->Args);
+	free(Op);
+}
+
+bool IRM_IsTerminator(const tIRMOp *Op)
+{
+	return Op->Op == IRMOP_JUMP || Op->Op == IRMOP_BRANCH || Op->Op == IRMOP_SWITCH || Op->Op == IRMOP_RETURN;
+}
+
+/**
+ * \brief Get the number of registers read by an operation
+ * \note May include IRM_REG_VOID entries (e.g. `return;`)
+ */
+int IRM_GetUseCount(const tIRMOp *Op)
+{
+	return caIRMOpSrcCount[Op->Op] + ((Op->Op == IRMOP_CALL || Op->Op == IRMOP_PHI || Op->Op == IRMOP_SELECT) ? Op->nArgs : 0);
+}
+
+tIRMReg *IRM_GetUse(tIRMOp *Op, int Index)
+{
+	 int	nsrc = caIRMOpSrcCount[Op->Op];
+	if( Index < nsrc )
+		return &Op->Src[Index];
+	assert( Index - nsrc < Op->nArgs );
+	return &Op->Args[Index - nsrc];
+}
+
+int IRM_GetPredIndex(const tIRMBlock *Block, const tIRMBlock *Pred)
+{
+	for( int i = 0; i < Block->nPred; i ++ )
+	{
+		if( Block->Pred[i] == Pred )
+			return i;
+	}
+	return -1;
+}
+
+int IRM_GetSuccIndex(const tIRMBlock *Block, const tIRMBlock *Succ)
+{
+	for( int i = 0; i < Block->nSucc; i ++ )
+	{
+		if( Block->Succ[i] == Succ )
+			return i;
+	}
+	return -1;
+}
+
+void IRM_int_AddPred(tIRMBlock *Block, tIRMBlock *Pred)
+{
+	if( Block->nPred == Block->PredSpace )
+	{
+		Block->PredSpace = (Block->PredSpace ? Block->PredSpace*2 : 2);
+		Block->Pred = realloc(Block->Pred, Block->PredSpace*sizeof(tIRMBlock*));
+		assert(Block->Pred);
+	}
+	Block->Pred[Block->nPred++] = Pred;
+}
+
+/**
+ * \brief Insert an empty block on the edge From->Succ[SuccIndex]
+ * \note Phi operands in the target stay in the same position
+ */
+tIRMBlock *IRM_SplitEdge(tIRMHandle Handle, tIRMBlock *From, int SuccIndex)
+{
+	tIRMBlock *to = From->Succ[SuccIndex];
+	tIRMBlock *new = IRM_CreateBlock(Handle);
+
+	 int	idx = IRM_GetPredIndex(to, From);
+	assert(idx >= 0);
+	to->Pred[idx] = new;
+	From->Succ[SuccIndex] = new;
+	IRM_int_AddPred(new, From);
+
+	tIRMOp *op = IRM_NewOp(IRMOP_JUMP);
+	IRM_InsertOpBefore(new, NULL, op);
+	new->nSucc = 1;
+	new->Succ[0] = to;
+	return new;
+}
+
+// --- Analysis ---
+/**
+ * \brief Rebuild predecessor lists, drop unreachable blocks and renumber in reverse postorder
+ */
+void IRM_UpdateCFG(tIRMHandle Handle)
+{
+	 int	nblocks = Handle->nBlocks;
+	tIRMBlock	***old_preds = malloc(nblocks * sizeof(tIRMBlock**));
+	 int	*old_npreds = malloc(nblocks * sizeof(int));
+	char	*visited = calloc(nblocks, 1);
+	tIRMBlock	**stack = malloc(nblocks * sizeof(tIRMBlock*));
+	 int	*stack_succ = malloc(nblocks * sizeof(int));
+	tIRMBlock	**order = malloc(nblocks * sizeof(tIRMBlock*));
+	 int	sp = 0, n_order = nblocks;
+
+	for( int i = 0; i < nblocks; i ++ )
+		Handle->Blocks[i]->Index = i;
+
+	// Iterative DFS (avoids recursion depth issues on large functions)
+	// - Postorder is filled from the back, yielding reverse postorder
+	stack[sp] = Handle->Blocks[0];
+	stack_succ[sp] = 0;
+	sp ++;
+	visited[0] = 1;
+	while( sp > 0 )
+	{
+		tIRMBlock *blk = stack[sp-1];
+		if( stack_succ[sp-1] < blk->nSucc )
+		{
+			tIRMBlock *succ = blk->Succ[ stack_succ[sp-1]++ ];
+			if( !visited[succ->Index] ) {
+				visited[succ->Index] = 1;
+				stack[sp] = succ;
+				stack_succ[sp] = 0;
+				sp ++;
+			}
+		}
+		else
+		{
+			order[--n_order] = blk;
+			sp --;
+		}
+	}
+
+	// Save old predecessor lists (for phi operand reordering) and reset
+	for( int i = 0; i < nblocks; i ++ )
+	{
+		tIRMBlock *blk = Handle->Blocks[i];
+		old_preds[i] = blk->Pred;
+		old_npreds[i] = blk->nPred;
+		blk->Pred = NULL;
+		blk->nPred = 0;
+		blk->PredSpace = 0;
+	}
+	for( int i = n_order; i < nblocks; i ++ )
+	{
+		tIRMBlock *blk = order[i];
+		for( int j = 0; j < blk->nSucc; j ++ )
+			IRM_int_AddPred(blk->Succ[j], blk);
+	}
+
+	// Reorder phi operands to match the new predecessor lists
+	for( int i = n_order; i < nblocks; i ++ )
+	{
+		tIRMBlock *blk = order[i];
+		 int	oidx = blk->Index;
+		for( tIRMOp *op = blk->FirstOp; op && op->Op == IRMOP_PHI; op = op->Next )
+		{
+			tIRMReg	*args = malloc(blk->nPred * sizeof(tIRMReg));
+			for( int j = 0; j < blk->nPred; j ++ )
+			{
+				 int	k;
+				for( k = 0; k < old_npreds[oidx] && old_preds[oidx][k] != blk->Pred[j]; k ++ )
+					;
+				assert( k < old_npreds[oidx] );
+				args[j] = op->Args[k];
+			}
+			free(op->Args);
+			op->Args = args;
+			op->nArgs = blk->nPred;
+		}
+	}
+
+	// Free unreachable blocks
+	for( int i = 0; i < nblocks; i ++ )
+	{
+		tIRMBlock *blk = Handle->Blocks[i];
+		free(old_preds[i]);
+		if( visited[i] )
+			continue ;
+		while( blk->FirstOp )
+		{
+			tIRMOp *op = blk->FirstOp;
+			IRM_RemoveOp(op);
+			IRM_FreeOp(op);
+		}
+		free(blk->Succ);
+		free(blk->Pred);
+		free(blk->Frontier);
+		if( Handle->CurBlock == blk )
+			Handle->CurBlock = NULL;
+		free(blk);
+	}
+
+	Handle->nBlocks = nblocks - n_order;
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		Handle->Blocks[i] = order[n_order + i];
+		Handle->Blocks[i]->Index = i;
+	}
+
+	free(old_preds);
+	free(old_npreds);
+	free(visited);
+	free(stack);
+	free(stack_succ);
+	free(order);
+}
+
+tIRMBlock *IRM_int_Intersect(tIRMBlock *B1, tIRMBlock *B2)
+{
+	while( B1 != B2 )
+	{
+		while( B1->Index > B2->Index )
+			B1 = B1->IDom;
+		while( B2->Index > B1->Index )
+			B2 = B2->IDom;
+	}
+	return B1;
+}
+
+/**
+ * \brief Compute the dominator tree and dominance frontiers
+ * \note Uses the Cooper-Harvey-Kennedy iterative algorithm, requires IRM_UpdateCFG
+ */
+void IRM_ComputeDominators(tIRMHandle Handle)
+{
+	tIRMBlock	*entry = Handle->Blocks[0];
+
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		tIRMBlock *blk = Handle->Blocks[i];
+		blk->IDom = NULL;
+		blk->FirstChild = NULL;
+		blk->NextSibling = NULL;
+		blk->nFrontier = 0;
+	}
+	entry->IDom = entry;
+
+	bool	changed = true;
+	while( changed )
+	{
+		changed = false;
+		for( int i = 1; i < Handle->nBlocks; i ++ )
+		{
+			tIRMBlock *blk = Handle->Blocks[i];
+			tIRMBlock *new_idom = NULL;
+			for( int j = 0; j < blk->nPred; j ++ )
+			{
+				tIRMBlock *pred = blk->Pred[j];
+				if( !pred->IDom )
+					continue ;
+				if( !new_idom )
+					new_idom = pred;
+				else
+					new_idom = IRM_int_Intersect(pred, new_idom);
+			}
+			if( blk->IDom != new_idom ) {
+				blk->IDom = new_idom;
+				changed = true;
+			}
+		}
+	}
+
+	// Build child lists (reverse iteration keeps children in block order)
+	for( int i = Handle->nBlocks; i -- > 1; )
+	{
+		tIRMBlock *blk = Handle->Blocks[i];
+		blk->NextSibling = blk->IDom->FirstChild;
+		blk->IDom->FirstChild = blk;
+	}
+	entry->IDom = NULL;
+
+	// Number the tree for constant-time dominance queries
+	{
+		tIRMBlock	**stack = malloc(Handle->nBlocks * sizeof(tIRMBlock*));
+		tIRMBlock	**next_child = malloc(Handle->nBlocks * sizeof(tIRMBlock*));
+		 int	sp = 0, num = 0;
+		entry->DomPre = num ++;
+		stack[sp] = entry;
+		next_child[sp] = entry->FirstChild;
+		sp ++;
+		while( sp > 0 )
+		{
+			tIRMBlock *child = next_child[sp-1];
+			if( child )
+			{
+				next_child[sp-1] = child->NextSibling;
+				child->DomPre = num ++;
+				stack[sp] = child;
+				next_child[sp] = child->FirstChild;
+				sp ++;
+			}
+			else
+			{
+				stack[sp-1]->DomPost = num ++;
+				sp --;
+			}
+		}
+		free(stack);
+		free(next_child);
+	}
+
+	// Dominance frontiers
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		tIRMBlock *blk = Handle->Blocks[i];
+		if( blk->nPred < 2 )
+			continue ;
+		for( int j = 0; j < blk->nPred; j ++ )
+		{
+			tIRMBlock *runner = blk->Pred[j];
+			while( runner != blk->IDom )
+			{
+				if( runner->nFrontier == 0 || runner->Frontier[runner->nFrontier-1] != blk )
+				{
+					runner->Frontier = realloc(runner->Frontier, (runner->nFrontier+1)*sizeof(tIRMBlock*));
+					runner->Frontier[runner->nFrontier++] = blk;
+				}
+				runner = runner->IDom;
+			}
+		}
+	}
 }
 
+bool IRM_Dominates(const tIRMBlock *A, const tIRMBlock *B)
+{
+	return A->DomPre <= B->DomPre && B->DomPost <= A->DomPost;
+}
+
+/**
+ * \brief Nearest block dominating both A and B
+ */
+tIRMBlock *IRM_CommonDominator(tIRMBlock *A, tIRMBlock *B)
+{
+	while( !IRM_Dominates(A, B) )
+		A = A->IDom;
+	return A;
+}
+
+// --- Debug ---
+const char *IRM_GetOpName(enum eIRMOpcodes Op)
+{
+	if( Op >= NUM_IRMOPS )
+		return "?";
+	return csaIRMOpNames[Op];
+}
+
+void IRM_DumpFunction(FILE *fp, tIRMHandle Handle)
+{
+	fprintf(fp, "%s(%i args)%s:\n", Handle->Name, Handle->nArgs, (Handle->bIsSSA ? " [SSA]" : ""));
+	for( int i = 0; i < Handle->nLocals; i ++ )
+	{
+		fprintf(fp, " local %i '%s' ", i, (Handle->Locals[i].Name ? Handle->Locals[i].Name : ""));
+		Types_Print(fp, Handle->Locals[i].Type);
+		fprintf(fp, "%s\n", (Handle->Locals[i].bAddressTaken ? " (address taken)" : ""));
+	}
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		tIRMBlock *blk = Handle->Blocks[i];
+		fprintf(fp, ".b%i:", blk->Index);
+		if( blk->nPred ) {
+			fprintf(fp, "\t; preds");
+			for( int j = 0; j < blk->nPred; j ++ )
+				fprintf(fp, " .b%i", blk->Pred[j]->Index);
+		}
+		fprintf(fp, "\n");
+		for( tIRMOp *op = blk->FirstOp; op; op = op->Next )
+		{
+			fprintf(fp, "\t");
+			if( op->Dst != IRM_REG_VOID )
+				fprintf(fp, "%%%i = ", op->Dst);
+			fprintf(fp, "%s%s", IRM_GetOpName(op->Op), (op->Flags & IRMFLAG_SIGNED ? ".s" : ""));
+			switch(op->Op)
+			{
+			case IRMOP_CONST:	fprintf(fp, " 0x%llx", (unsigned long long)op->Imm);	break;
+			case IRMOP_ARGUMENT:	fprintf(fp, " #%i", (int)op->Imm);	break;
+			case IRMOP_STRING:	fprintf(fp, " \"%.*s\"", (int)op->String.Length, op->String.Data);	break;
+			case IRMOP_SYMADDR:	fprintf(fp, " %s", op->Sym->Name);	break;
+			case IRMOP_LOCALADDR:
+			case IRMOP_LOADLOCAL:
+			case IRMOP_STORELOCAL:
+				fprintf(fp, " [local %i]", op->Local);
+				break;
+			case IRMOP_SWITCH:	fprintf(fp, " [%i entries]", op->Table.Count);	break;
+			default:
+				break;
+			}
+			for( int j = 0; j < IRM_GetUseCount(op); j ++ )
+			{
+				tIRMReg r = *IRM_GetUse(op, j);
+				if( r != IRM_REG_VOID )
+					fprintf(fp, "%s %%%i", (j == 0 ? "" : ","), r);
+			}
+			for( int j = 0; j < (IRM_IsTerminator(op) ? blk->nSucc : 0); j ++ )
+				fprintf(fp, "%s .b%i", (j == 0 && op->Op == IRMOP_JUMP ? "" : ","), blk->Succ[j]->Index);
+			fprintf(fp, "\n");
+		}
+	}
+}
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
 #include <parser.h>
 
 // == Imported Functions ===
@@ -18,11 +19,24 @@ extern void	Symbol_DumpTree(void);
 extern void	Optimiser_ProcessTree(void);
 extern int	SetOutputArch(const char *Name);
 extern void	GenerateOutput(const char *File);
+extern void	Compile_ProcessFunctions(void);
+extern void	Optimiser_PrintStats(FILE *fp);
+extern bool	gbVerboseAsm;
 
 // Parser Variables
 const char	*gsInputFile = NULL;
-const char	*gsOutputFile = "out.asm";
+const char	*gsOutputFile = NULL;
 const char	*gsOutputArch;
+ int	giOptimiseLevel = 0;
+bool	gbDumpIRM = false;
+bool	gbPrintStats = false;
+bool	gbOutputAssembly = false;
+bool	gbLinkExecutable = false;
+bool	gbJitExecute = false;
+bool	gbOmitFramePointer = false;
+const char	*gsJitEntry = "main";
+const char	**gasLinkInputs;	//!< Extra objects/archives for --link
+ int	giNumLinkInputs;
 
 int ParseCommandLine(int argc, char *argv[]);
 void PrintUsage(const char *exename);
@@ -70,6 +84,11 @@ int main(int argc, char *argv[])
 	
 	Symbol_DumpTree();
 
+	if( giOptimiseLevel >= 1 )
+		Compile_ProcessFunctions();
+	if( gbPrintStats )
+		Optimiser_PrintStats(stderr);
+
 	// Output
 	GenerateOutput(gsOutputFile);
 
@@ -90,8 +109,9 @@ int ParseCommandLine(int argc, char *argv[])
 			if( !gsInputFile )
 				gsInputFile = arg;
 			else {
-				fprintf(stderr, "Extra file passed ('%s')\n", arg);
-				return 1;
+				// Later files are linker inputs (checked once --link is known)
+				gasLinkInputs = realloc(gasLinkInputs, (giNumLinkInputs+1)*sizeof(char*));
+				gasLinkInputs[giNumLinkInputs++] = arg;
 			}
 		}
 		else if(arg[1] != '-')
@@ -108,6 +128,24 @@ int ParseCommandLine(int argc, char *argv[])
 			case 'o':
 				gsOutputFile = argv[++i];
 				break;
+			case 'S':
+				gbOutputAssembly = true;
+				break;
+			case 'O':
+				giOptimiseLevel = (arg[2] ? atoi(arg+2) : 1);
+				break;
+			case 'f':
+				if( strcmp(arg, "-fverbose-asm") == 0 ) {
+					gbVerboseAsm = true;
+					break;
+				}
+				if( strcmp(arg, "-fomit-frame-pointer") == 0 ) {
+					gbOmitFramePointer = true;
+					break;
+				}
+				fprintf(stderr, "Unknown command line option '%s'\n", arg);
+				PrintUsage(argv[0]);
+				return 1;
 			default:
 				fprintf(stderr, "Unknown command line option '-%c'\n", arg[1]);
 				PrintUsage(argv[0]);
@@ -124,6 +162,21 @@ int ParseCommandLine(int argc, char *argv[])
 				PrintUsage(argv[0]);
 				exit(0);
 			}
+			else if( strcmp(arg, "--dump-irm") == 0 ) {
+				gbDumpIRM = true;
+			}
+			else if( strcmp(arg, "--stats") == 0 ) {
+				gbPrintStats = true;
+			}
+			else if( strcmp(arg, "--link") == 0 ) {
+				gbLinkExecutable = true;
+			}
+			else if( strcmp(arg, "--jit") == 0 ) {
+				gbJitExecute = true;
+			}
+			else if( strcmp(arg, "--entry") == 0 ) {
+				gsJitEntry = argv[++i];
+			}
 			else
 			{
 				fprintf(stderr, "Unknown command line option '%s'\n", arg);
@@ -138,6 +191,23 @@ int ParseCommandLine(int argc, char *argv[])
 		fprintf(stderr, "An input filename is required.\n");
 		return -1;
 	}
+	if( giNumLinkInputs && !gbLinkExecutable )
+	{
+		fprintf(stderr, "Extra file passed ('%s')\n", gasLinkInputs[0]);
+		return 1;
+	}
+	if( (gbLinkExecutable || gbJitExecute) && gbOutputAssembly )
+	{
+		fprintf(stderr, "-S can't be used with --link or --jit\n");
+		return 1;
+	}
+	if( gbLinkExecutable && gbJitExecute )
+	{
+		fprintf(stderr, "--link and --jit can't be used together\n");
+		return 1;
+	}
+	if(!gsOutputFile)
+		gsOutputFile = (gbOutputAssembly ? "out.asm" : (gbLinkExecutable ? "a.out" : "out.o"));
 	
 	return 0;
 }
@@ -145,8 +215,17 @@ int ParseCommandLine(int argc, char *argv[])
 void PrintUsage(const char *exename)
 {
 	fprintf(stderr, 
-		"Usage: %s [-o <output file>] <input file>\n"
-		" -o <output file>\t Specify Output file\n"
+		"Usage: %s [-o <output file>] <input file> [--link <objects/archives>...]\n"
+		" -o <output file>\t Specify Output file (default out.o, out.asm with -S, a.out with --link)\n"
+		" -S\t\t Output assembly instead of an object file\n"
+		" --link\t\t Link with the listed objects into a static executable\n"
+		" --jit\t\t Run the program in-process instead of writing output\n"
+		" --entry <name>\t Function called by --jit (default main)\n"
+		" -O<level>\t Optimisation level (0: direct from AST, 1: via SSA IRM)\n"
+		" --dump-irm\t Print the IRM of each function after optimisation\n"
+		" --stats\t Print optimiser statistics\n"
+		" -fverbose-asm\t Comment the generated assembly\n"
+		" -fomit-frame-pointer\t Address the frame off esp, ebp is a general register (-O1 x86)\n"
 		" -h\t\t Print this message\n"
 		"", exename );
 }
@@ -14,17 +14,31 @@
 #include <ast.h>
 #include <symbol.h>
 #include <optimiser.h>
+#include <irm.h>
 
 // === IMPORTS ===
 extern tAST_Node	*Opt1_Optimise(tAST_Node *Node);
 extern tAST_Node	*Opt2_Optimise(tAST_Node *Node);
 extern tFunction	*gpFunctions;
+extern bool	gbDumpIRM;
 
 // === PROTOTYPES ===
 void	Optimiser_ProcessTree(void);
 void	Optimiser_DoPass(tOptimiseCallback *Callback);
 tAST_Node	*Optimiser_ProcessNode(tOptimiseCallback *Callback, tAST_Node *Node);
 void	Optimiser_Expand(tAST_Node *Node, tOptimiseCallback *Callback);
+void	Optimiser_ProcessIRM(tFunction *Func);
+void	Optimiser_PrintStats(FILE *fp);
+
+// === GLOBALS ===
+struct {
+	 int	Functions;
+	 int	TailCalls;
+	 int	ConstantsFolded;
+	 int	ValuesNumbered;
+	 int	Selects;
+	 int	DeadOps;
+} gOptimiserStats;
 
 // === CODE ===
 void Optimiser_ProcessTree(void)
@@ -42,6 +56,35 @@ tAST_Node *Optimiser_StaticOpt(tAST_Node *Node)
 	return Optimiser_ProcessNode(Opt1_Optimise, Node);
 }
 
+/**
+ * \brief Run the IRM optimisation passes on a function
+ */
+void Optimiser_ProcessIRM(tFunction *Func)
+{
+	tIRMHandle	IRM = Func->IRM;
+	gOptimiserStats.Functions ++;
+	gOptimiserStats.TailCalls += IRM_EliminateTailRecursion(IRM, &Func->Sym);
+	IRM_EnterSSA(IRM);
+	gOptimiserStats.ConstantsFolded += IRM_PropagateConstants(IRM);
+	gOptimiserStats.ValuesNumbered += IRM_NumberValues(IRM);
+	gOptimiserStats.Selects += IRM_FormSelects(IRM);
+	gOptimiserStats.DeadOps += IRM_RemoveDeadCode(IRM);
+	if( gbDumpIRM )
+		IRM_DumpFunction(stdout, IRM);
+	IRM_LeaveSSA(IRM);
+}
+
+void Optimiser_PrintStats(FILE *fp)
+{
+	fprintf(fp, "Optimiser statistics:\n");
+	fprintf(fp, " %6i functions optimised\n", gOptimiserStats.Functions);
+	fprintf(fp, " %6i tail recursive calls turned into loops\n", gOptimiserStats.TailCalls);
+	fprintf(fp, " %6i operations/branches constant folded\n", gOptimiserStats.ConstantsFolded);
+	fprintf(fp, " %6i redundant operations/loads eliminated (GVN)\n", gOptimiserStats.ValuesNumbered);
+	fprintf(fp, " %6i branches converted to selects\n", gOptimiserStats.Selects);
+	fprintf(fp, " %6i dead operations removed\n", gOptimiserStats.DeadOps);
+}
+
 void Optimiser_DoPass(tOptimiseCallback *Callback)
 {
 	for(tFunction *fcn = gpFunctions; fcn; fcn = fcn->Next)
@@ -60,17 +103,18 @@ void Optimiser_DoPass(tOptimiseCallback *Callback)
 
 void Optimiser_ProcessNodeList(tOptimiseCallback *Callback, tAST_Node **FirstPtr)
 {
-	for(tAST_Node *tmp = *FirstPtr, *prev = NULL; tmp; prev = tmp)
+	tAST_Node	**pnp = FirstPtr;
+	for(tAST_Node *tmp = *FirstPtr; tmp; )
 	{
+		tAST_Node *next = tmp->NextSibling;
 		tAST_Node *new = Optimiser_ProcessNode(Callback, tmp);
 		if(new != tmp)
 		{
-			if(prev)
-				prev->NextSibling = new;
-			else
-				*FirstPtr = new;
+			new->NextSibling = next;
+			*pnp = new;
 		}
-		tmp = new->NextSibling;
+		pnp = &new->NextSibling;
+		tmp = next;
 	}
 }
 
@@ -87,6 +131,7 @@ tAST_Node *Optimiser_ProcessNode(tOptimiseCallback *Callback, tAST_Node *Node)
 	case NODETYPE_LOCALVAR:
 	case NODETYPE_SYMBOL:
 	case NODETYPE_STRING:
+	case NODETYPE_BLOB:
 		break;
 	
 	// List nodes
@@ -106,6 +151,7 @@ tAST_Node *Optimiser_ProcessNode(tOptimiseCallback *Callback, tAST_Node *Node)
 		REPLACE( Node->If.False );
 		break;
 	case NODETYPE_WHILE:
+	case NODETYPE_DOWHILE:
 		REPLACE( Node->While.Test );
 		REPLACE( Node->While.Action );
 		break;
@@ -118,19 +164,40 @@ tAST_Node *Optimiser_ProcessNode(tOptimiseCallback *Callback, tAST_Node *Node)
 	case NODETYPE_RETURN:	// UniOp
 		REPLACE(Node->UniOp.Value);
 		break;
+	case NODETYPE_SWITCH:
+		REPLACE(Node->Switch.Condition);
+		Optimiser_ProcessNodeList(Callback, &Node->Switch.FirstStatement);
+		break;
+	case NODETYPE_CASE:
+	case NODETYPE_BREAK:
+	case NODETYPE_CONTINUE:
+		break;
 	
 	// Unary Ops
 	case NODETYPE_NEGATE ... NODETYPE_PREDEC:
 		REPLACE( Node->UniOp.Value );
 		break;
+	case NODETYPE_CAST:
+		REPLACE( Node->Cast.Value );
+		break;
 	
 	
 	// Binary Operations
-	case NODETYPE_ASSIGNOP ... NODETYPE_BOOLAND:
+	case NODETYPE_MEMBER:
+		REPLACE( Node->Member.Struct );
+		break;
+	case NODETYPE_ASSIGNOP ... NODETYPE_INDEX:
+	case NODETYPE_ADD ... NODETYPE_BOOLAND:
 		REPLACE( Node->BinOp.Left );
 		REPLACE( Node->BinOp.Right );
 		break;
 	
+	case NODETYPE_CONDITIONAL:
+		REPLACE( Node->If.Test );
+		REPLACE( Node->If.True );
+		REPLACE( Node->If.False );
+		break;
+	
 	default:
 		fprintf(stderr, "Optimiser_ProcessNode - TODO: Handle node type 0x%x\n", Node->Type);
 		break;
@@ -0,0 +1,537 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * This code is published under the terms of the BSD Licence. For more
+ * information see the file COPYING.
+ *
+ * optimiser/gvn.c - Global Value Numbering
+ *
+ * Dominator-tree scoped value numbering over the SSA IRM. A pure
+ * operation that matches one already computed in a dominating block is
+ * replaced by the earlier result. Loads are tracked per path and reused
+ * until a possibly aliasing store or a call intervenes.
+ *
+ * The address decomposition/alias checks used for this are shared with
+ * the backends (IRM_GetMemLocation, IRM_MayAlias).
+ *
+ * Loads from globals that are never written (tSymbol.bReadOnly) are
+ * replaced by the value in the global's initialiser, so calls through
+ * constant function pointer tables become direct calls.
+ */
+#include <global.h>
+#include <irm.h>
+#include <consteval.h>
+#include <string.h>
+#include <assert.h>
+
+typedef struct sValueEntry	tValueEntry;
+typedef struct sAvailLoad	tAvailLoad;
+typedef struct sMemState	tMemState;
+
+struct sValueEntry
+{
+	tValueEntry	*Next;	//!< Next in hash chain
+	tValueEntry	*Older;	//!< Previous entry on the scope stack
+	tIRMOp	*Op;	//!< Defining operation (Dst holds the value)
+	unsigned int	Hash;
+};
+
+struct sAvailLoad
+{
+	tIRMMemLocation	Loc;
+	tIRMReg	Value;
+};
+
+struct sMemState
+{
+	 int	nLoads;
+	 int	Space;
+	tAvailLoad	*Loads;
+};
+
+typedef struct sGVNState
+{
+	tIRMHandle	Handle;
+	tIRMOp	**Defs;	//!< [nRegs]
+	tIRMReg	*Map;	//!< [nRegs] Replacement register
+	unsigned int	nBuckets;	//!< Power of two, scaled to the function size
+	tValueEntry	**Buckets;
+	tValueEntry	*Top;	//!< Scope stack
+	 int	nEliminated;
+} tGVNState;
+
+// === PROTOTYPES ===
+ int	IRM_NumberValues(tIRMHandle Handle);
+void	GVN_int_VisitBlock(tGVNState *State, tIRMBlock *Block, const tMemState *InMem);
+bool	GVN_int_FoldReadOnlyLoad(tGVNState *State, tIRMOp *Op);
+tIRMReg	GVN_int_InsertBefore(tGVNState *State, tIRMOp *Before, tIRMOp *Op, const tType *Type);
+bool	GVN_int_IsPure(const tIRMOp *Op);
+unsigned int	GVN_int_Hash(const tIRMOp *Op);
+bool	GVN_int_Equal(tGVNState *State, const tIRMOp *A, const tIRMOp *B);
+void	IRM_GetIRMMemLocation(tIRMHandle Handle, tIRMOp * const *Defs, const tIRMOp *Op, tIRMMemLocation *Loc);
+bool	IRM_SameMemLocation(const tIRMMemLocation *A, const tIRMMemLocation *B);
+bool	IRM_MayAlias(const tIRMMemLocation *A, const tIRMMemLocation *B);
+void	GVN_int_AddLoad(tMemState *Mem, const tIRMMemLocation *Loc, tIRMReg Value);
+void	GVN_int_KillAliases(tMemState *Mem, const tIRMMemLocation *Loc);
+
+// === CODE ===
+/**
+ * \brief Eliminate redundant computations and loads
+ * \return Number of operations removed
+ */
+int IRM_NumberValues(tIRMHandle Handle)
+{
+	assert( Handle->bIsSSA );
+	tGVNState	state = {
+		.Handle = Handle,
+		.Defs = calloc(Handle->nRegs, sizeof(tIRMOp*)),
+		.Map = malloc(Handle->nRegs * sizeof(tIRMReg)),
+	};
+	for( int i = 0; i < Handle->nRegs; i ++ )
+		state.Map[i] = i;
+	state.nBuckets = 256;
+	while( state.nBuckets < Handle->nRegs )
+		state.nBuckets *= 2;
+	state.Buckets = calloc(state.nBuckets, sizeof(tValueEntry*));
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			if( op->Dst != IRM_REG_VOID )
+				state.Defs[op->Dst] = op;
+		}
+	}
+
+	IRM_ComputeDominators(Handle);
+	tMemState	mem = {0};
+	GVN_int_VisitBlock(&state, Handle->Blocks[0], &mem);
+
+	// Phi operands (and uses in blocks visited before the replacement
+	// was found) may still refer to removed values
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			for( int j = 0; j < IRM_GetUseCount(op); j ++ )
+			{
+				tIRMReg	*use = IRM_GetUse(op, j);
+				while( state.Map[*use] != *use )
+					*use = state.Map[*use];
+			}
+		}
+	}
+
+	free(state.Defs);
+	free(state.Map);
+	free(state.Buckets);
+	return state.nEliminated;
+}
+
+void GVN_int_VisitBlock(tGVNState *State, tIRMBlock *Block, const tMemState *InMem)
+{
+	tIRMHandle	h = State->Handle;
+	tValueEntry	*scope_start = State->Top;
+	tMemState	mem = {
+		.nLoads = InMem->nLoads,
+		.Space = InMem->nLoads,
+		.Loads = malloc(InMem->nLoads * sizeof(tAvailLoad) + 1),
+	};
+	if( InMem->nLoads )
+		memcpy(mem.Loads, InMem->Loads, InMem->nLoads * sizeof(tAvailLoad));
+
+	for( tIRMOp *op = Block->FirstOp, *next; op; op = next )
+	{
+		next = op->Next;
+
+		// Operands are defined in dominating blocks, so already numbered
+		for( int j = 0; j < (op->Op == IRMOP_PHI ? 0 : IRM_GetUseCount(op)); j ++ )
+		{
+			tIRMReg	*use = IRM_GetUse(op, j);
+			*use = State->Map[*use];
+		}
+
+		// A folded load is then numbered like any other constant
+		if( op->Op == IRMOP_LOAD && GVN_int_FoldReadOnlyLoad(State, op) )
+			State->nEliminated ++;
+
+		tIRMReg	replacement = IRM_REG_VOID;
+		switch(op->Op)
+		{
+		case IRMOP_PHI: {
+			// A phi whose operands are all the same value (or itself) is that value
+			tIRMReg	val = IRM_REG_VOID;
+			bool	unique = true;
+			for( int j = 0; j < op->nArgs && unique; j ++ )
+			{
+				tIRMReg	arg = State->Map[op->Args[j]];
+				if( arg == op->Dst || arg == val )
+					continue ;
+				if( val != IRM_REG_VOID )
+					unique = false;
+				val = arg;
+			}
+			if( unique && val != IRM_REG_VOID )
+				replacement = val;
+			break; }
+		case IRMOP_LOAD:
+		case IRMOP_LOADLOCAL: {
+			if( IRM_GetRegType(h, op->Dst)->bVolatile )
+				break;
+			tIRMMemLocation	loc;
+			IRM_GetMemLocation(h, State->Defs, op, &loc);
+			for( int i = mem.nLoads; i --; )
+			{
+				if( !IRM_SameMemLocation(&mem.Loads[i].Loc, &loc) )
+					continue ;
+				replacement = mem.Loads[i].Value;
+				break;
+			}
+			if( replacement == IRM_REG_VOID )
+				GVN_int_AddLoad(&mem, &loc, op->Dst);
+			break; }
+		case IRMOP_STORE:
+		case IRMOP_STORELOCAL: {
+			tIRMMemLocation	loc;
+			IRM_GetMemLocation(h, State->Defs, op, &loc);
+			GVN_int_KillAliases(&mem, &loc);
+			// Store to load forwarding
+			tIRMReg	val = (op->Op == IRMOP_STORE ? op->Src[1] : op->Src[0]);
+			const tType	*type = IRM_GetRegType(h, val);
+			if( !type->bVolatile && Types_GetSizeOf(type) == loc.Size )
+				GVN_int_AddLoad(&mem, &loc, val);
+			break; }
+		case IRMOP_CALL:
+			// The callee can modify any memory it can see
+			mem.nLoads = 0;
+			break;
+		default:
+			if( !GVN_int_IsPure(op) )
+				break;
+			unsigned int	hash = GVN_int_Hash(op);
+			for( tValueEntry *ent = State->Buckets[hash & (State->nBuckets-1)]; ent; ent = ent->Next )
+			{
+				if( ent->Hash == hash && GVN_int_Equal(State, ent->Op, op) ) {
+					replacement = ent->Op->Dst;
+					break;
+				}
+			}
+			if( replacement == IRM_REG_VOID )
+			{
+				tValueEntry	*ent = malloc(sizeof(tValueEntry));
+				ent->Op = op;
+				ent->Hash = hash;
+				ent->Next = State->Buckets[hash & (State->nBuckets-1)];
+				State->Buckets[hash & (State->nBuckets-1)] = ent;
+				ent->Older = State->Top;
+				State->Top = ent;
+			}
+			break;
+		}
+
+		if( replacement != IRM_REG_VOID )
+		{
+			State->Map[op->Dst] = replacement;
+			State->Defs[op->Dst] = NULL;
+			IRM_RemoveOp(op);
+			IRM_FreeOp(op);
+			State->nEliminated ++;
+		}
+	}
+
+	for( tIRMBlock *child = Block->FirstChild; child; child = child->NextSibling )
+	{
+		// Loads are only still valid if every path to the child comes from here
+		if( child->nPred == 1 && child->Pred[0] == Block ) {
+			GVN_int_VisitBlock(State, child, &mem);
+		}
+		else {
+			tMemState	empty = {0};
+			GVN_int_VisitBlock(State, child, &empty);
+		}
+	}
+
+	// Leave scope
+	while( State->Top != scope_start )
+	{
+		tValueEntry	*ent = State->Top;
+		State->Top = ent->Older;
+		assert( State->Buckets[ent->Hash & (State->nBuckets-1)] == ent );
+		State->Buckets[ent->Hash & (State->nBuckets-1)] = ent->Next;
+		free(ent);
+	}
+	free(mem.Loads);
+}
+
+/**
+ * \brief Replace a load from a read-only global with the value it was initialised to
+ */
+bool GVN_int_FoldReadOnlyLoad(tGVNState *State, tIRMOp *Op)
+{
+	const tType	*type = IRM_GetRegType(State->Handle, Op->Dst);
+	if( type->bVolatile )
+		return false;
+	if( type->Class != TYPECLASS_INTEGER && type->Class != TYPECLASS_ENUM && type->Class != TYPECLASS_POINTER )
+		return false;
+	
+	tIRMMemLocation	loc;
+	IRM_GetMemLocation(State->Handle, State->Defs, Op, &loc);
+	if( loc.BaseType != IRMMEM_SYMBOL || !loc.Sym->bReadOnly )
+		return false;
+	
+	uint64_t	val;
+	const tSymbol	*target;
+	if( ConstEval_ReadGlobal(loc.Sym, loc.Offset, loc.Size, &val, &target) )
+		return false;
+	if( target && val != 0 )
+	{
+		// Address into the target (e.g. `&arr[2]`), the offset is pointer sized like in compile.c
+		const tType	*int_type = Types_CreateIntegerType(false, INTSIZE_INT);
+		const tType	*size_type = (Types_GetSizeOf(type) == Types_GetSizeOf(int_type) ? int_type
+			: Types_CreateIntegerType(false, INTSIZE_LONG));
+		tIRMOp	*addr = IRM_NewOp(IRMOP_SYMADDR);
+		addr->Sym = target;
+		tIRMOp	*ofs = IRM_NewOp(IRMOP_CONST);
+		ofs->Imm = IRM_NormaliseConstant(size_type, val);
+		Op->Op = IRMOP_ADD;
+		Op->Src[0] = GVN_int_InsertBefore(State, Op, addr, type);
+		Op->Src[1] = GVN_int_InsertBefore(State, Op, ofs, size_type);
+		return true;
+	}
+	else if( target )
+	{
+		Op->Op = IRMOP_SYMADDR;
+		Op->Sym = target;
+	}
+	else
+	{
+		Op->Op = IRMOP_CONST;
+		Op->Imm = IRM_NormaliseConstant(type, val);
+	}
+	Op->Src[0] = IRM_REG_VOID;
+	return true;
+}
+
+/**
+ * \brief Insert a new value-producing operation before \a Before
+ * \return Register holding the result
+ */
+tIRMReg GVN_int_InsertBefore(tGVNState *State, tIRMOp *Before, tIRMOp *Op, const tType *Type)
+{
+	tIRMHandle	h = State->Handle;
+	Op->Dst = IRM_AllocateRegister(h, Type);
+	State->Defs = realloc(State->Defs, h->nRegs * sizeof(tIRMOp*));
+	State->Map = realloc(State->Map, h->nRegs * sizeof(tIRMReg));
+	State->Defs[Op->Dst] = Op;
+	State->Map[Op->Dst] = Op->Dst;
+	IRM_InsertOpBefore(Before->Block, Before, Op);
+	return Op->Dst;
+}
+
+bool GVN_int_IsPure(const tIRMOp *Op)
+{
+	switch(Op->Op)
+	{
+	case IRMOP_CONST:
+	case IRMOP_SYMADDR:
+	case IRMOP_LOCALADDR:
+	case IRMOP_ARGUMENT:
+	case IRMOP_NEG:
+	case IRMOP_NOT:
+	case IRMOP_CAST:
+	case IRMOP_ADD ... IRMOP_CMPGE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static inline bool GVN_int_IsCommutative(enum eIRMOpcodes Op)
+{
+	switch(Op)
+	{
+	case IRMOP_ADD:
+	case IRMOP_MUL:
+	case IRMOP_AND:
+	case IRMOP_OR:
+	case IRMOP_XOR:
+	case IRMOP_CMPEQ:
+	case IRMOP_CMPNE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+unsigned int GVN_int_Hash(const tIRMOp *Op)
+{
+	unsigned int	ret = Op->Op * 31 + Op->Flags;
+	switch(Op->Op)
+	{
+	case IRMOP_CONST:
+	case IRMOP_ARGUMENT:
+		ret = ret * 31 + (unsigned int)Op->Imm + (unsigned int)(Op->Imm >> 32);
+		break;
+	case IRMOP_SYMADDR:
+		ret = ret * 31 + (unsigned int)(uintptr_t)Op->Sym;
+		break;
+	case IRMOP_LOCALADDR:
+		ret = ret * 31 + Op->Local;
+		break;
+	default:
+		// Order independent for commutative operations
+		if( GVN_int_IsCommutative(Op->Op) )
+			ret = ret * 31 + Op->Src[0] + Op->Src[1];
+		else
+			ret = (ret * 31 + Op->Src[0]) * 31 + Op->Src[1];
+		break;
+	}
+	return ret;
+}
+
+bool GVN_int_Equal(tGVNState *State, const tIRMOp *A, const tIRMOp *B)
+{
+	tIRMHandle	h = State->Handle;
+	if( A->Op != B->Op || A->Flags != B->Flags )
+		return false;
+	// Same operation on different result types (e.g. casts, narrow adds) differs
+	const tType	*ta = IRM_GetRegType(h, A->Dst), *tb = IRM_GetRegType(h, B->Dst);
+	if( ta != tb && (Types_GetSizeOf(ta) != Types_GetSizeOf(tb) || ta->Class != tb->Class) )
+		return false;
+	if( ta != tb && ta->Class == TYPECLASS_INTEGER && ta->Integer.bSigned != tb->Integer.bSigned )
+		return false;
+	switch(A->Op)
+	{
+	case IRMOP_CONST:
+	case IRMOP_ARGUMENT:
+		return A->Imm == B->Imm;
+	case IRMOP_SYMADDR:
+		return A->Sym == B->Sym;
+	case IRMOP_LOCALADDR:
+		return A->Local == B->Local;
+	default:
+		if( A->Src[0] == B->Src[0] && A->Src[1] == B->Src[1] )
+			return true;
+		return GVN_int_IsCommutative(A->Op) && A->Src[0] == B->Src[1] && A->Src[1] == B->Src[0];
+	}
+}
+
+/**
+ * \brief Decompose the address accessed by a load/store
+ * \param Defs	Definition of each register (NULL if it has more than one)
+ */
+void IRM_GetMemLocation(tIRMHandle Handle, tIRMOp * const *Defs, const tIRMOp *Op, tIRMMemLocation *Loc)
+{
+	Loc->Offset = 0;
+	switch(Op->Op)
+	{
+	case IRMOP_LOADLOCAL:
+	case IRMOP_STORELOCAL:
+		Loc->BaseType = IRMMEM_LOCAL;
+		Loc->Local = Op->Local;
+		Loc->Size = Types_GetSizeOf(Handle->Locals[Op->Local].Type);
+		return ;
+	case IRMOP_LOAD:
+		Loc->Size = Types_GetSizeOf(IRM_GetRegType(Handle, Op->Dst));
+		break;
+	case IRMOP_STORE:
+		Loc->Size = Types_GetSizeOf(IRM_GetRegType(Handle, Op->Src[1]));
+		break;
+	default:
+		assert( !"IRM_GetMemLocation on non-memory op" );
+	}
+
+	tIRMReg	addr = Op->Src[0];
+	for( ;; )
+	{
+		const tIRMOp	*def = Defs[addr];
+		if( def && def->Op == IRMOP_ADD )
+		{
+			const tIRMOp	*rhs = Defs[def->Src[1]];
+			if( rhs && rhs->Op == IRMOP_CONST ) {
+				Loc->Offset += (int64_t)rhs->Imm;
+				addr = def->Src[0];
+				continue ;
+			}
+		}
+		else if( def && def->Op == IRMOP_LOCALADDR )
+		{
+			Loc->BaseType = IRMMEM_LOCAL;
+			Loc->Local = def->Local;
+			return ;
+		}
+		else if( def && def->Op == IRMOP_SYMADDR )
+		{
+			Loc->BaseType = IRMMEM_SYMBOL;
+			Loc->Sym = def->Sym;
+			return ;
+		}
+		break;
+	}
+	Loc->BaseType = IRMMEM_REGISTER;
+	Loc->Reg = addr;
+}
+
+static inline bool IRM_int_SameMemBase(const tIRMMemLocation *A, const tIRMMemLocation *B)
+{
+	if( A->BaseType != B->BaseType )
+		return false;
+	switch(A->BaseType)
+	{
+	case IRMMEM_LOCAL:	return A->Local == B->Local;
+	case IRMMEM_SYMBOL:	return A->Sym == B->Sym;
+	case IRMMEM_REGISTER:	return A->Reg == B->Reg;
+	}
+	return false;
+}
+
+bool IRM_SameMemLocation(const tIRMMemLocation *A, const tIRMMemLocation *B)
+{
+	return IRM_int_SameMemBase(A, B) && A->Offset == B->Offset && A->Size == B->Size;
+}
+
+/**
+ * \brief Check if two accesses can overlap
+ *
+ * Register based locations are only comparable if the register holds
+ * the same value at both accesses (always true in SSA form).
+ */
+bool IRM_MayAlias(const tIRMMemLocation *A, const tIRMMemLocation *B)
+{
+	// Arbitrary pointers can point anywhere (including into other objects)
+	if( A->BaseType == IRMMEM_REGISTER || B->BaseType == IRMMEM_REGISTER )
+	{
+		if( !IRM_int_SameMemBase(A, B) )
+			return true;
+	}
+	else if( !IRM_int_SameMemBase(A, B) )
+	{
+		// Distinct named objects never overlap
+		return false;
+	}
+	// Same base, check the byte ranges
+	return A->Offset < B->Offset + (int64_t)B->Size && B->Offset < A->Offset + (int64_t)A->Size;
+}
+
+void GVN_int_AddLoad(tMemState *Mem, const tIRMMemLocation *Loc, tIRMReg Value)
+{
+	if( Mem->nLoads == Mem->Space )
+	{
+		Mem->Space += 8;
+		Mem->Loads = realloc(Mem->Loads, Mem->Space * sizeof(tAvailLoad));
+	}
+	Mem->Loads[Mem->nLoads].Loc = *Loc;
+	Mem->Loads[Mem->nLoads].Value = Value;
+	Mem->nLoads ++;
+}
+
+void GVN_int_KillAliases(tMemState *Mem, const tIRMMemLocation *Loc)
+{
+	 int	j = 0;
+	for( int i = 0; i < Mem->nLoads; i ++ )
+	{
+		if( !IRM_MayAlias(&Mem->Loads[i].Loc, Loc) )
+			Mem->Loads[j++] = Mem->Loads[i];
+	}
+	Mem->nLoads = j;
+}
@@ -13,11 +13,20 @@
 #include <global.h>
 #include <ast.h>
 #include <optimiser.h>
+#include <irm.h>
+
+// === IMPORTS ===
+extern const tType	*Compile_int_ArithType(const tType *Left, const tType *Right);
+
+// === PROTOTYPES ===
+tAST_Node	*Opt1_Optimise(tAST_Node *Node);
+bool	Opt1_int_FoldBinOp(tAST_Node *Node, uint64_t *Value, const tType **Type);
 
 // === CODE ===
 tAST_Node *Opt1_Optimise(tAST_Node *Node)
 {
 	uint64_t	val;
+	const tType	*type;
 	
 	DEBUG("Node=%p{%i}", Node, Node->Type);
 
@@ -25,80 +34,101 @@ tAST_Node *Opt1_Optimise(tAST_Node *Node)
 	{
 	// -- Unary Operations
 	case NODETYPE_NEGATE:
-		if( Node->UniOp.Value->Type != NODETYPE_INTEGER )	return Node;
-		val = 0 - Node->UniOp.Value->Integer.Value;
-		goto unaryop_common;
 	case NODETYPE_BWNOT:
 		if( Node->UniOp.Value->Type != NODETYPE_INTEGER )	return Node;
-		val = ~Node->UniOp.Value->Integer.Value;
+		type = Compile_int_ArithType(AST_GetIntegerType(Node->UniOp.Value), AST_GetIntegerType(Node->UniOp.Value));
+		val = (Node->Type == NODETYPE_NEGATE ? 0 - Node->UniOp.Value->Integer.Value : ~Node->UniOp.Value->Integer.Value);
 		goto unaryop_common;
 	
 	case NODETYPE_CAST:
 		Node->Cast.Value = Opt1_Optimise(Node->Cast.Value);
 		if( Node->Cast.Value->Type != NODETYPE_INTEGER )	return Node;
+		type = Node->Cast.Type;
+		if( type->Class != TYPECLASS_INTEGER || type->Integer.Size == INTSIZE_BOOL )
+			return Node;
 		val = Node->Cast.Value->Integer.Value;
-		switch(Node->Cast.Type->Class)
-		{
-		case TYPECLASS_INTEGER:
-			switch(Node->Cast.Type->Integer.Size)
-			{
-			case INTSIZE_BOOL:	return Node;
-			case INTSIZE_CHAR:	val &= 0xFF;	break;
-			case INTSIZE_SHORT:	val &= 0xFFFF;	break;
-			case INTSIZE_INT:	val &= 0xFFFFFFFF;	break;
-			case INTSIZE_LONG:	val &= 0xFFFFFFFF;	break;
-			case INTSIZE_LONGLONG:	break;
-			}
-			break;
-		default:	return Node;
-		}
 		goto unaryop_common;
 	
 	unaryop_common:
 		AST_DeleteNode(Node->UniOp.Value);
 		Node->Type = NODETYPE_INTEGER;
-		Node->Integer.Value = val;
+		Node->Integer.Value = IRM_NormaliseConstant(type, val);
+		Node->Integer.Type = type;
 		break;
 	
 	// -- Binary Operations
-	#define OPT_BINOP(op) \
-		Node->BinOp.Left = Opt1_Optimise(Node->BinOp.Left);\
-		Node->BinOp.Right = Opt1_Optimise(Node->BinOp.Right);\
-		if( Node->BinOp.Left->Type != NODETYPE_INTEGER )	return Node; \
-		if( Node->BinOp.Right->Type != NODETYPE_INTEGER )	return Node; \
-		val = Node->BinOp.Left->Integer.Value op Node->BinOp.Right->Integer.Value; \
-		DEBUG("> %li %s %li = %li", Node->BinOp.Left->Integer.Value, #op, Node->BinOp.Right->Integer.Value, val);\
-		goto binop_common;
-	case NODETYPE_ADD:	OPT_BINOP(+)
-	case NODETYPE_SUBTRACT:	OPT_BINOP(-)
-	case NODETYPE_MULTIPLY:	OPT_BINOP(*)
-	case NODETYPE_DIVIDE:	OPT_BINOP(/)	// TODO: Avoid #div0
-	case NODETYPE_MODULO:	OPT_BINOP(%)
-	
-	case NODETYPE_BWOR:	OPT_BINOP(|)
-	case NODETYPE_BWAND:	OPT_BINOP(&)
-	case NODETYPE_BWXOR:	OPT_BINOP(^)
-	case NODETYPE_BITSHIFTLEFT:	OPT_BINOP(<<);
-	case NODETYPE_BITSHIFTRIGHT:	OPT_BINOP(>>);
-	case NODETYPE_EQUALS:   	OPT_BINOP(==);
-	case NODETYPE_NOTEQUALS:	OPT_BINOP(!=);
-	
-	// TODO: Signed-ness
-	case NODETYPE_LESSTHAN: 	OPT_BINOP(<)
-	case NODETYPE_LESSTHANEQU:	OPT_BINOP(<=)
-	case NODETYPE_GREATERTHAN:	OPT_BINOP(>)
-	case NODETYPE_GREATERTHANEQU:	OPT_BINOP(>=)
-	case NODETYPE_BOOLOR:	OPT_BINOP(||)
-	case NODETYPE_BOOLAND:	OPT_BINOP(&&)
-	
-	binop_common:
+	case NODETYPE_ADD ... NODETYPE_BOOLAND:
+		Node->BinOp.Left = Opt1_Optimise(Node->BinOp.Left);
+		Node->BinOp.Right = Opt1_Optimise(Node->BinOp.Right);
+		if( Node->BinOp.Left->Type != NODETYPE_INTEGER )	return Node;
+		if( Node->BinOp.Right->Type != NODETYPE_INTEGER )	return Node;
+		if( !Opt1_int_FoldBinOp(Node, &val, &type) )
+			return Node;
+		DEBUG("> %li %i %li = %li", Node->BinOp.Left->Integer.Value, Node->Type, Node->BinOp.Right->Integer.Value, val);
 		AST_DeleteNode(Node->BinOp.Left);
 		AST_DeleteNode(Node->BinOp.Right);
 		Node->Type = NODETYPE_INTEGER;
 		Node->Integer.Value = val;
+		Node->Integer.Type = type;
 		break;
 	default:
 		return Node;
 	}
 	return Node;
 }
+
+/**
+ * \brief Evaluate a binary operation on two constants, in their C types
+ * \return false if it can't be done at compile time (e.g. division by zero)
+ */
+bool Opt1_int_FoldBinOp(tAST_Node *Node, uint64_t *Value, const tType **Type)
+{
+	const tType	*int_type = Types_CreateIntegerType(true, INTSIZE_INT);
+	const tType	*ltype = AST_GetIntegerType(Node->BinOp.Left);
+	const tType	*rtype = AST_GetIntegerType(Node->BinOp.Right);
+	uint64_t	left = Node->BinOp.Left->Integer.Value;
+	uint64_t	right = Node->BinOp.Right->Integer.Value;
+	enum eIRMOpcodes	op;
+	switch(Node->Type)
+	{
+	case NODETYPE_ADD:	op = IRMOP_ADD;	break;
+	case NODETYPE_SUBTRACT:	op = IRMOP_SUB;	break;
+	case NODETYPE_MULTIPLY:	op = IRMOP_MUL;	break;
+	case NODETYPE_DIVIDE:	op = IRMOP_DIV;	break;
+	case NODETYPE_MODULO:	op = IRMOP_MOD;	break;
+	case NODETYPE_BWOR:	op = IRMOP_OR; 	break;
+	case NODETYPE_BWAND:	op = IRMOP_AND;	break;
+	case NODETYPE_BWXOR:	op = IRMOP_XOR;	break;
+	case NODETYPE_BITSHIFTLEFT:	op = IRMOP_SHL;	break;
+	case NODETYPE_BITSHIFTRIGHT:	op = IRMOP_SHR;	break;
+	case NODETYPE_EQUALS:   	op = IRMOP_CMPEQ;	break;
+	case NODETYPE_NOTEQUALS:	op = IRMOP_CMPNE;	break;
+	case NODETYPE_LESSTHAN: 	op = IRMOP_CMPLT;	break;
+	case NODETYPE_LESSTHANEQU:	op = IRMOP_CMPLE;	break;
+	case NODETYPE_GREATERTHAN:	op = IRMOP_CMPGT;	break;
+	case NODETYPE_GREATERTHANEQU:	op = IRMOP_CMPGE;	break;
+	case NODETYPE_BOOLOR:
+		*Value = (left || right);
+		*Type = int_type;
+		return true;
+	case NODETYPE_BOOLAND:
+		*Value = (left && right);
+		*Type = int_type;
+		return true;
+	default:
+		return false;
+	}
+
+	// Shifts have the type of the (promoted) left operand, others use the usual conversions
+	const tType	*type;
+	if( op == IRMOP_SHL || op == IRMOP_SHR )
+		type = Compile_int_ArithType(ltype, ltype);
+	else
+		type = Compile_int_ArithType(ltype, rtype);
+	left = IRM_NormaliseConstant(type, left);
+	if( op != IRMOP_SHL && op != IRMOP_SHR )
+		right = IRM_NormaliseConstant(type, right);
+	unsigned int	flags = (type->Integer.bSigned ? IRMFLAG_SIGNED : 0);
+	*Type = (op >= IRMOP_CMPEQ ? int_type : type);
+	return IRM_FoldOperation(op, flags, *Type, left, right, Value);
+}
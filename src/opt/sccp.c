@@ -0,0 +1,460 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * This code is published under the terms of the BSD Licence. For more
+ * information see the file COPYING.
+ *
+ * optimiser/sccp.c - Sparse Conditional Constant Propagation
+ *
+ * Wegman-Zadeck SCCP over the SSA IRM. Values are only propagated along
+ * edges that are known to be executable, so constants assigned before a
+ * branch fold the branch, and phis only merge reachable definitions.
+ */
+#include <global.h>
+#include <irm.h>
+#include <string.h>
+#include <assert.h>
+
+enum eLatticeState
+{
+	LATTICE_TOP,	//!< No (executable) definition seen yet
+	LATTICE_CONST,
+	LATTICE_BOTTOM,	//!< Not constant
+};
+
+typedef struct sLattice
+{
+	enum eLatticeState	State;
+	uint64_t	Value;
+} tLattice;
+
+typedef struct sSCCPState
+{
+	tIRMHandle	Handle;
+	tLattice	*Values;	//!< [nRegs]
+	 int	*nUsers;	//!< [nRegs]
+	tIRMOp	***Users;	//!< [nRegs][nUsers]
+	bool	*BlockExecuted;	//!< [nBlocks]
+	 int	*EdgeBase;	//!< [nBlocks] Index of each block's first outgoing edge in EdgeExecuted
+	bool	*EdgeExecuted;	//!< [nEdges]
+
+	// Worklists
+	 int	nFlowWork;
+	tIRMBlock	**FlowWork;	//!< Blocks to visit (pairs of from/to)
+	 int	nSSAWork;
+	tIRMReg	*SSAWork;
+	bool	*SSAQueued;
+} tSCCPState;
+
+// === PROTOTYPES ===
+ int	IRM_PropagateConstants(tIRMHandle Handle);
+void	SCCP_int_BuildDefUse(tSCCPState *State);
+void	SCCP_int_MarkEdge(tSCCPState *State, tIRMBlock *From, int SuccIndex);
+void	SCCP_int_VisitOp(tSCCPState *State, tIRMOp *Op);
+void	SCCP_int_SetValue(tSCCPState *State, tIRMReg Reg, const tLattice *Value);
+bool	SCCP_int_Evaluate(tSCCPState *State, tIRMOp *Op, tLattice *Result);
+ int	SCCP_int_Rewrite(tSCCPState *State);
+uint64_t	IRM_NormaliseConstant(const tType *Type, uint64_t Value);
+bool	IRM_FoldOperation(enum eIRMOpcodes Op, unsigned int Flags, const tType *Type, uint64_t Left, uint64_t Right, uint64_t *Result);
+
+// === CODE ===
+/**
+ * \brief Propagate constants, fold constant branches and drop unreachable blocks
+ * \return Number of operations/branches folded
+ */
+int IRM_PropagateConstants(tIRMHandle Handle)
+{
+	assert( Handle->bIsSSA );
+	 int	*edge_base = malloc(Handle->nBlocks * sizeof(int));
+	 int	nedges = 0;
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		edge_base[i] = nedges;
+		nedges += Handle->Blocks[i]->nSucc;
+	}
+	tSCCPState	state = {
+		.Handle = Handle,
+		.Values = calloc(Handle->nRegs, sizeof(tLattice)),
+		.nUsers = calloc(Handle->nRegs, sizeof(int)),
+		.Users = calloc(Handle->nRegs, sizeof(tIRMOp**)),
+		.BlockExecuted = calloc(Handle->nBlocks, sizeof(bool)),
+		.EdgeBase = edge_base,
+		.EdgeExecuted = calloc(nedges, sizeof(bool)),
+		.FlowWork = malloc(nedges*2 * sizeof(tIRMBlock*) + sizeof(tIRMBlock*)*2),
+		.SSAWork = malloc(Handle->nRegs * sizeof(tIRMReg)),
+		.SSAQueued = calloc(Handle->nRegs, sizeof(bool)),
+	};
+	SCCP_int_BuildDefUse(&state);
+
+	// The entry block is always executed
+	state.FlowWork[state.nFlowWork++] = NULL;
+	state.FlowWork[state.nFlowWork++] = Handle->Blocks[0];
+
+	while( state.nFlowWork > 0 || state.nSSAWork > 0 )
+	{
+		if( state.nFlowWork > 0 )
+		{
+			tIRMBlock	*to = state.FlowWork[--state.nFlowWork];
+			state.nFlowWork --;
+			if( state.BlockExecuted[to->Index] )
+			{
+				// Only the phis can change on a new incoming edge
+				for( tIRMOp *op = to->FirstOp; op && op->Op == IRMOP_PHI; op = op->Next )
+					SCCP_int_VisitOp(&state, op);
+				continue ;
+			}
+			state.BlockExecuted[to->Index] = true;
+			for( tIRMOp *op = to->FirstOp; op; op = op->Next )
+				SCCP_int_VisitOp(&state, op);
+		}
+		else
+		{
+			tIRMReg	reg = state.SSAWork[--state.nSSAWork];
+			state.SSAQueued[reg] = false;
+			for( int i = 0; i < state.nUsers[reg]; i ++ )
+			{
+				tIRMOp	*op = state.Users[reg][i];
+				if( state.BlockExecuted[op->Block->Index] )
+					SCCP_int_VisitOp(&state, op);
+			}
+		}
+	}
+
+	 int	ret = SCCP_int_Rewrite(&state);
+
+	for( int i = 0; i < Handle->nRegs; i ++ )
+		free(state.Users[i]);
+	free(state.Values);
+	free(state.nUsers);
+	free(state.Users);
+	free(state.BlockExecuted);
+	free(state.EdgeBase);
+	free(state.EdgeExecuted);
+	free(state.FlowWork);
+	free(state.SSAWork);
+	free(state.SSAQueued);
+	return ret;
+}
+
+void SCCP_int_BuildDefUse(tSCCPState *State)
+{
+	tIRMHandle	h = State->Handle;
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = h->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			for( int j = 0; j < IRM_GetUseCount(op); j ++ )
+			{
+				tIRMReg	r = *IRM_GetUse(op, j);
+				if( r == IRM_REG_VOID )
+					continue ;
+				// Avoid duplicate entries for ops that use a register twice
+				if( State->nUsers[r] && State->Users[r][State->nUsers[r]-1] == op )
+					continue ;
+				State->Users[r] = realloc(State->Users[r], (State->nUsers[r]+1)*sizeof(tIRMOp*));
+				State->Users[r][State->nUsers[r]++] = op;
+			}
+		}
+	}
+}
+
+void SCCP_int_MarkEdge(tSCCPState *State, tIRMBlock *From, int SuccIndex)
+{
+	bool	*edge = &State->EdgeExecuted[State->EdgeBase[From->Index] + SuccIndex];
+	if( *edge )
+		return ;
+	*edge = true;
+	State->FlowWork[State->nFlowWork++] = From;
+	State->FlowWork[State->nFlowWork++] = From->Succ[SuccIndex];
+}
+
+void SCCP_int_SetValue(tSCCPState *State, tIRMReg Reg, const tLattice *Value)
+{
+	tLattice	*cur = &State->Values[Reg];
+	// Values only ever move down the lattice
+	if( cur->State == LATTICE_BOTTOM )
+		return ;
+	if( cur->State == Value->State && (cur->State != LATTICE_CONST || cur->Value == Value->Value) )
+		return ;
+	if( cur->State == LATTICE_CONST && Value->State == LATTICE_CONST )
+		cur->State = LATTICE_BOTTOM;	// Two different constants
+	else if( Value->State != LATTICE_TOP )
+		*cur = *Value;
+	else
+		return ;
+	if( !State->SSAQueued[Reg] ) {
+		State->SSAQueued[Reg] = true;
+		State->SSAWork[State->nSSAWork++] = Reg;
+	}
+}
+
+void SCCP_int_VisitOp(tSCCPState *State, tIRMOp *Op)
+{
+	tIRMBlock	*blk = Op->Block;
+	switch(Op->Op)
+	{
+	case IRMOP_JUMP:
+		SCCP_int_MarkEdge(State, blk, 0);
+		break;
+	case IRMOP_BRANCH: {
+		tLattice	*cond = &State->Values[Op->Src[0]];
+		if( cond->State == LATTICE_BOTTOM ) {
+			SCCP_int_MarkEdge(State, blk, 0);
+			SCCP_int_MarkEdge(State, blk, 1);
+		}
+		else if( cond->State == LATTICE_CONST ) {
+			SCCP_int_MarkEdge(State, blk, (cond->Value ? 0 : 1));
+		}
+		break; }
+	case IRMOP_SWITCH: {
+		tLattice	*idx = &State->Values[Op->Src[0]];
+		if( idx->State == LATTICE_CONST && idx->Value < (uint64_t)Op->Table.Count ) {
+			SCCP_int_MarkEdge(State, blk, Op->Table.Targets[idx->Value]);
+		}
+		else if( idx->State != LATTICE_TOP ) {
+			for( int i = 0; i < blk->nSucc; i ++ )
+				SCCP_int_MarkEdge(State, blk, i);
+		}
+		break; }
+	case IRMOP_RETURN:
+		break;
+	default:
+		if( Op->Dst != IRM_REG_VOID )
+		{
+			tLattice	val;
+			SCCP_int_Evaluate(State, Op, &val);
+			SCCP_int_SetValue(State, Op->Dst, &val);
+		}
+		break;
+	}
+}
+
+/**
+ * \brief Evaluate an operation over the lattice
+ */
+bool SCCP_int_Evaluate(tSCCPState *State, tIRMOp *Op, tLattice *Result)
+{
+	tIRMHandle	h = State->Handle;
+	const tType	*type = IRM_GetRegType(h, Op->Dst);
+	Result->State = LATTICE_BOTTOM;
+	Result->Value = 0;
+
+	switch(Op->Op)
+	{
+	case IRMOP_CONST:
+		Result->State = LATTICE_CONST;
+		Result->Value = IRM_NormaliseConstant(type, Op->Imm);
+		return true;
+	case IRMOP_PHI: {
+		Result->State = LATTICE_TOP;
+		tIRMBlock	*blk = Op->Block;
+		for( int i = 0; i < Op->nArgs; i ++ )
+		{
+			tIRMBlock	*pred = blk->Pred[i];
+			 int	sidx = IRM_GetSuccIndex(pred, blk);
+			if( !State->EdgeExecuted[State->EdgeBase[pred->Index] + sidx] )
+				continue ;
+			const tLattice	*in = &State->Values[Op->Args[i]];
+			if( in->State == LATTICE_TOP )
+				continue ;
+			if( in->State == LATTICE_BOTTOM
+			 || (Result->State == LATTICE_CONST && Result->Value != in->Value) ) {
+				Result->State = LATTICE_BOTTOM;
+				return true;
+			}
+			*Result = *in;
+		}
+		return true; }
+	case IRMOP_COPY:
+		*Result = State->Values[Op->Src[0]];
+		return true;
+	case IRMOP_NEG:
+	case IRMOP_NOT:
+	case IRMOP_CAST:
+	case IRMOP_ADD ... IRMOP_CMPGE: {
+		 int	nsrc = IRM_GetUseCount(Op);
+		uint64_t	vals[2] = {0, 0};
+		for( int i = 0; i < nsrc; i ++ )
+		{
+			const tLattice	*in = &State->Values[Op->Src[i]];
+			if( in->State == LATTICE_BOTTOM )
+				return true;
+			if( in->State == LATTICE_TOP ) {
+				Result->State = LATTICE_TOP;
+				return true;
+			}
+			vals[i] = in->Value;
+		}
+		if( !IRM_FoldOperation(Op->Op, Op->Flags, type, vals[0], vals[1], &Result->Value) )
+			return true;	// e.g. division by zero, left for runtime
+		Result->State = LATTICE_CONST;
+		return true; }
+	default:
+		// Memory, calls and addresses are not known at compile time
+		return true;
+	}
+}
+
+/**
+ * \brief Truncate (and sign-extend) a constant to the size of a type
+ */
+uint64_t IRM_NormaliseConstant(const tType *Type, uint64_t Value)
+{
+	size_t	size = Types_GetSizeOf(Type);
+	bool	is_signed = (Type->Class == TYPECLASS_INTEGER && Type->Integer.bSigned);
+	if( size == 0 || size >= 8 )
+		return Value;
+	 int	bits = size * 8;
+	Value &= (1ULL << bits) - 1;
+	if( is_signed && (Value & (1ULL << (bits-1))) )
+		Value |= ~0ULL << bits;
+	return Value;
+}
+
+/**
+ * \brief Evaluate an arithmetic IRM operation on constants
+ * \param Type	Result type
+ * \return false if the operation cannot be folded (e.g. division by zero)
+ */
+bool IRM_FoldOperation(enum eIRMOpcodes Op, unsigned int Flags, const tType *Type, uint64_t Left, uint64_t Right, uint64_t *Result)
+{
+	bool	is_signed = !!(Flags & IRMFLAG_SIGNED);
+	uint64_t	ret;
+	switch(Op)
+	{
+	case IRMOP_NEG:	ret = -Left;	break;
+	case IRMOP_NOT:	ret = ~Left;	break;
+	// Source values are already sign-extended if the source type was signed
+	case IRMOP_CAST:	ret = Left;	break;
+	case IRMOP_ADD:	ret = Left + Right;	break;
+	case IRMOP_SUB:	ret = Left - Right;	break;
+	case IRMOP_MUL:	ret = Left * Right;	break;
+	case IRMOP_DIV:
+	case IRMOP_MOD:
+		if( Right == 0 )
+			return false;
+		if( is_signed ) {
+			// INT64_MIN / -1 overflows
+			if( (int64_t)Right == -1 ) {
+				ret = (Op == IRMOP_DIV ? -Left : 0);
+				break;
+			}
+			ret = (Op == IRMOP_DIV ? (uint64_t)((int64_t)Left / (int64_t)Right) : (uint64_t)((int64_t)Left % (int64_t)Right));
+		}
+		else {
+			ret = (Op == IRMOP_DIV ? Left / Right : Left % Right);
+		}
+		break;
+	case IRMOP_AND:	ret = Left & Right;	break;
+	case IRMOP_OR:	ret = Left | Right;	break;
+	case IRMOP_XOR:	ret = Left ^ Right;	break;
+	case IRMOP_SHL:
+		ret = (Right >= 64 ? 0 : Left << Right);
+		break;
+	case IRMOP_SHR:
+		if( Right >= 64 )
+			ret = (is_signed && (int64_t)Left < 0 ? ~0ULL : 0);
+		else if( is_signed )
+			ret = (uint64_t)((int64_t)Left >> Right);
+		else
+			ret = Left >> Right;
+		break;
+	#define CMP(op)	(is_signed ? (int64_t)Left op (int64_t)Right : Left op Right)
+	case IRMOP_CMPEQ:	ret = (Left == Right);	break;
+	case IRMOP_CMPNE:	ret = (Left != Right);	break;
+	case IRMOP_CMPLT:	ret = CMP(<);	break;
+	case IRMOP_CMPLE:	ret = CMP(<=);	break;
+	case IRMOP_CMPGT:	ret = CMP(>);	break;
+	case IRMOP_CMPGE:	ret = CMP(>=);	break;
+	#undef CMP
+	default:
+		return false;
+	}
+	*Result = IRM_NormaliseConstant(Type, ret);
+	return true;
+}
+
+/**
+ * \brief Apply the results: replace constant values and fold known branches
+ */
+int SCCP_int_Rewrite(tSCCPState *State)
+{
+	tIRMHandle	h = State->Handle;
+	 int	ret = 0;
+
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		tIRMBlock	*blk = h->Blocks[i];
+		if( !State->BlockExecuted[i] )
+			continue ;	// Dropped by IRM_UpdateCFG
+		for( tIRMOp *op = blk->FirstOp; op; op = op->Next )
+		{
+			if( op->Op == IRMOP_CONST || op->Dst == IRM_REG_VOID )
+				continue ;
+			const tLattice	*val = &State->Values[op->Dst];
+			if( val->State != LATTICE_CONST )
+				continue ;
+			// Only pure operations can produce constants, so this is safe
+			assert( op->Op != IRMOP_CALL && op->Op != IRMOP_LOAD );
+			if( op->Op == IRMOP_PHI ) {
+				// Constants can't go in the phi group, move to after it
+				tIRMOp	*new = IRM_NewOp(IRMOP_CONST);
+				new->Dst = op->Dst;
+				new->Imm = val->Value;
+				tIRMOp	*after = op;
+				while( after->Next && after->Next->Op == IRMOP_PHI )
+					after = after->Next;
+				IRM_InsertOpBefore(blk, after->Next, new);
+				op->Dst = IRM_REG_VOID;	// Removed by dead code elimination
+			}
+			else {
+				op->Op = IRMOP_CONST;
+				op->Flags = 0;
+				op->Imm = val->Value;
+				op->Src[0] = op->Src[1] = IRM_REG_VOID;
+			}
+			ret ++;
+		}
+
+		// Fold branches/switches where only one edge is executable
+		tIRMOp	*term = blk->LastOp;
+		const bool	*edges = &State->EdgeExecuted[State->EdgeBase[i]];
+		 int	taken = -1, nexec = 0;
+		for( int j = 0; j < blk->nSucc; j ++ )
+		{
+			if( edges[j] ) {
+				taken = j;
+				nexec ++;
+			}
+		}
+		if( (term->Op == IRMOP_BRANCH || term->Op == IRMOP_SWITCH) && nexec == 1 )
+		{
+			if( term->Op == IRMOP_SWITCH )
+				free(term->Table.Targets);
+			term->Op = IRMOP_JUMP;
+			term->Src[0] = IRM_REG_VOID;
+			blk->Succ[0] = blk->Succ[taken];
+			blk->nSucc = 1;
+			ret ++;
+		}
+	}
+
+	// Phis with no destination are now dead
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		tIRMBlock	*blk = h->Blocks[i];
+		for( tIRMOp *op = blk->FirstOp, *next; op && op->Op == IRMOP_PHI; op = next )
+		{
+			next = op->Next;
+			if( op->Dst == IRM_REG_VOID ) {
+				IRM_RemoveOp(op);
+				IRM_FreeOp(op);
+			}
+		}
+	}
+
+	if( ret )
+		IRM_UpdateCFG(h);
+	return ret;
+}
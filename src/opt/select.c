@@ -0,0 +1,267 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * This code is published under the terms of the BSD Licence. For more
+ * information see the file COPYING.
+ *
+ * optimiser/select.c - If-conversion
+ *
+ * Short conditional code that only exists to pick between two values
+ * (e.g. `a < b ? a : b`, `if(x < 0) x = -x;`) is flattened into the block
+ * containing the branch, and the phis at the join become IRMOP_SELECTs
+ * that the backend can emit without a jump (setcc/cmov).
+ *
+ * Both sides are then always evaluated, so only a few cheap operations that
+ * cannot trap or touch global memory are moved. A predictable branch is
+ * nearly free, so long arms are left alone.
+ */
+#include <global.h>
+#include <irm.h>
+#include <assert.h>
+
+#define SELECT_MAX_ARM_COST	3	//!< Non-constant operations allowed in each arm
+#define SELECT_MAX_PHIS	3	//!< Values chosen at the join
+
+// === PROTOTYPES ===
+ int	IRM_FormSelects(tIRMHandle Handle);
+ int	Select_int_ArmCost(tIRMHandle Handle, const tIRMBlock *Arm);
+bool	Select_int_IsSelectable(const tType *Type);
+bool	Select_int_Convert(tIRMHandle Handle, tIRMBlock *Head);
+
+// === CODE ===
+/**
+ * \brief Replace branches around cheap value computations with selects
+ * \return Number of branches removed
+ */
+int IRM_FormSelects(tIRMHandle Handle)
+{
+	 int	ret = 0;
+	bool	changed;
+	// Flattening an inner if can make the enclosing one convertible
+	do {
+		changed = false;
+		for( int i = 0; i < Handle->nBlocks; i ++ )
+		{
+			while( Select_int_Convert(Handle, Handle->Blocks[i]) ) {
+				changed = true;
+				ret ++;
+			}
+		}
+		if( changed )
+			IRM_UpdateCFG(Handle);
+	} while( changed );
+	return ret;
+}
+
+/**
+ * \brief Cost of unconditionally executing \a Arm
+ * \return -1 if the arm can't be speculated
+ */
+int Select_int_ArmCost(tIRMHandle Handle, const tIRMBlock *Arm)
+{
+	 int	cost = 0;
+	if( Arm->nPred != 1 || Arm->LastOp->Op != IRMOP_JUMP )
+		return -1;
+	for( tIRMOp *op = Arm->FirstOp; op != Arm->LastOp; op = op->Next )
+	{
+		switch( op->Op )
+		{
+		case IRMOP_CONST:
+		case IRMOP_STRING:
+		case IRMOP_SYMADDR:
+		case IRMOP_LOCALADDR:
+			break;
+		case IRMOP_LOADLOCAL:
+			if( IRM_GetRegType(Handle, op->Dst)->bVolatile )
+				return -1;
+			cost ++;
+			break;
+		case IRMOP_COPY:
+		case IRMOP_NEG:
+		case IRMOP_NOT:
+		case IRMOP_CAST:
+		case IRMOP_ADD:
+		case IRMOP_SUB:
+		case IRMOP_MUL:
+		case IRMOP_AND:
+		case IRMOP_OR:
+		case IRMOP_XOR:
+		case IRMOP_SHL:
+		case IRMOP_SHR:
+		case IRMOP_CMPEQ ... IRMOP_CMPGE:
+		case IRMOP_SELECT:
+			cost ++;
+			break;
+		// Division can trap, memory accesses can fault or alias, calls have effects
+		default:
+			return -1;
+		}
+	}
+	return cost;
+}
+
+/**
+ * \brief Check that the backend can pick a value of this type without branching
+ */
+bool Select_int_IsSelectable(const tType *Type)
+{
+	switch( Type->Class )
+	{
+	case TYPECLASS_INTEGER:
+	case TYPECLASS_POINTER:
+	case TYPECLASS_ENUM:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * \brief If-convert the diamond/triangle headed by \a Head
+ * \return true if the branch was removed
+ */
+bool Select_int_Convert(tIRMHandle Handle, tIRMBlock *Head)
+{
+	tIRMOp	*br = Head->LastOp;
+	if( !br || br->Op != IRMOP_BRANCH )
+		return false;
+
+	tIRMBlock	*t = Head->Succ[0], *f = Head->Succ[1];
+	tIRMBlock	*join;
+	tIRMBlock	*arms[2];	// Blocks on the true/false paths (NULL for a direct edge)
+	if( t == f || t == Head || f == Head )
+		return false;
+	if( t->nSucc == 1 && f->nSucc == 1 && t->Succ[0] == f->Succ[0] ) {
+		join = t->Succ[0];
+		arms[0] = t;
+		arms[1] = f;
+	}
+	else if( t->nSucc == 1 && t->Succ[0] == f ) {
+		join = f;
+		arms[0] = t;
+		arms[1] = NULL;
+	}
+	else if( f->nSucc == 1 && f->Succ[0] == t ) {
+		join = t;
+		arms[0] = NULL;
+		arms[1] = f;
+	}
+	else
+		return false;
+	if( join == Head || join->nPred != 2 )
+		return false;
+
+	for( int i = 0; i < 2; i ++ )
+	{
+		if( !arms[i] )
+			continue ;
+		 int	cost = Select_int_ArmCost(Handle, arms[i]);
+		if( cost < 0 || cost > SELECT_MAX_ARM_COST )
+			return false;
+	}
+
+	// Each phi in the join becomes a select
+	 int	tidx = (join->Pred[0] == (arms[0] ? arms[0] : Head) ? 0 : 1);
+	 int	nphis = 0;
+	for( tIRMOp *op = join->FirstOp; op && op->Op == IRMOP_PHI; op = op->Next )
+	{
+		if( !Select_int_IsSelectable(IRM_GetRegType(Handle, op->Dst)) )
+			return false;
+		nphis ++;
+	}
+	if( nphis > SELECT_MAX_PHIS )
+		return false;
+
+	// Hoist the arms above the branch
+	for( int i = 0; i < 2; i ++ )
+	{
+		if( !arms[i] )
+			continue ;
+		while( arms[i]->FirstOp != arms[i]->LastOp )
+		{
+			tIRMOp	*op = arms[i]->FirstOp;
+			IRM_RemoveOp(op);
+			IRM_InsertOpBefore(Head, br, op);
+		}
+	}
+
+	// A comparison is repeated for each select, so the backend can fold it into every one
+	tIRMOp	*cmp = NULL;
+	bool	cond_used = false;
+	for( tIRMOp *op = br->Prev; op; op = op->Prev )
+	{
+		if( op->Dst == br->Src[0] ) {
+			if( op->Op >= IRMOP_CMPEQ && op->Op <= IRMOP_CMPGE )
+				cmp = op;
+			break;
+		}
+	}
+
+	while( join->FirstOp && join->FirstOp->Op == IRMOP_PHI )
+	{
+		tIRMOp	*phi = join->FirstOp;
+		tIRMReg	tv = phi->Args[tidx], fv = phi->Args[1-tidx];
+		tIRMOp	*sel;
+		IRM_RemoveOp(phi);
+		if( tv == fv ) {
+			sel = IRM_NewOp(IRMOP_COPY);
+			sel->Src[0] = tv;
+		}
+		else {
+			sel = IRM_NewOp(IRMOP_SELECT);
+			sel->Src[0] = br->Src[0];
+			if( cmp && cond_used ) {
+				tIRMOp	*copy = IRM_NewOp(cmp->Op);
+				copy->Flags = cmp->Flags;
+				copy->Src[0] = cmp->Src[0];
+				copy->Src[1] = cmp->Src[1];
+				copy->Dst = IRM_AllocateRegister(Handle, IRM_GetRegType(Handle, cmp->Dst));
+				IRM_InsertOpBefore(Head, br, copy);
+				sel->Src[0] = copy->Dst;
+			}
+			cond_used = true;
+			sel->nArgs = 2;
+			sel->Args = malloc( 2 * sizeof(tIRMReg) );
+			sel->Args[0] = tv;
+			sel->Args[1] = fv;
+		}
+		sel->Dst = phi->Dst;
+		IRM_InsertOpBefore(Head, br, sel);
+		IRM_FreeOp(phi);
+	}
+
+	// Append the join to the head (the arms and the join become unreachable)
+	IRM_RemoveOp(br);
+	IRM_FreeOp(br);
+	while( join->FirstOp )
+	{
+		tIRMOp	*op = join->FirstOp;
+		IRM_RemoveOp(op);
+		IRM_InsertOpBefore(Head, NULL, op);
+	}
+	// (swap the arrays, the join may end in a switch)
+	tIRMBlock	**succs = Head->Succ;
+	 int	space = Head->SuccSpace;
+	Head->Succ = join->Succ;
+	Head->SuccSpace = join->SuccSpace;
+	Head->nSucc = join->nSucc;
+	join->Succ = succs;
+	join->SuccSpace = space;
+	for( int i = 0; i < Head->nSucc; i ++ )
+	{
+		tIRMBlock	*succ = Head->Succ[i];
+		for( int j = 0; j < succ->nPred; j ++ )
+		{
+			if( succ->Pred[j] == join )
+				succ->Pred[j] = Head;
+		}
+	}
+	join->nSucc = 0;
+	for( int i = 0; i < 2; i ++ )
+	{
+		if( arms[i] )
+			arms[i]->nSucc = 0;
+	}
+	return true;
+}
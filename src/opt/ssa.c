@@ -0,0 +1,563 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * This code is published under the terms of the BSD Licence. For more
+ * information see the file COPYING.
+ *
+ * optimiser/ssa.c - SSA construction and destruction
+ *
+ * Promotes non-address-taken locals to registers (pruned SSA, phi
+ * placement using dominance frontiers) and converts back to plain copies
+ * once the SSA optimisations have run.
+ */
+#include <global.h>
+#include <irm.h>
+#include <string.h>
+#include <assert.h>
+
+typedef uint32_t	tBitWord;
+#define BITS_PER_WORD	32
+#define BIT_TEST(set,b)	((set)[(b)/BITS_PER_WORD] & (1U << ((b)%BITS_PER_WORD)))
+#define BIT_SET(set,b)	((set)[(b)/BITS_PER_WORD] |= (1U << ((b)%BITS_PER_WORD)))
+
+typedef struct sRenameUndo
+{
+	 int	Local;
+	tIRMReg	Prev;	//!< Value the local had before the block redefined it
+} tRenameUndo;
+
+typedef struct sRenameFrame
+{
+	tIRMBlock	*Block;
+	 int	UndoMark;	//!< -1 before the block is renamed, then the undo log length on entry
+} tRenameFrame;
+
+typedef struct sSSAState
+{
+	tIRMHandle	Handle;
+	 int	nWords;	//!< Words per local bitset
+	tBitWord	*LiveIn;	//!< [nBlocks][nWords]
+	tIRMReg	*Undef;	//!< Per-local undefined value (created on demand)
+	tIRMReg	*Current;	//!< Per-local current value while renaming (top of its definition stack)
+	 int	nUndo;
+	 int	UndoSpace;
+	tRenameUndo	*Undo;	//!< Definitions pushed by the blocks being renamed, undone on leaving them
+} tSSAState;
+
+typedef struct sParallelCopy
+{
+	tIRMReg	Dst;
+	tIRMReg	Src;
+} tParallelCopy;
+
+// === PROTOTYPES ===
+void	IRM_EnterSSA(tIRMHandle Handle);
+void	IRM_LeaveSSA(tIRMHandle Handle);
+ int	IRM_RemoveDeadCode(tIRMHandle Handle);
+bool	SSA_int_IsPromotable(tIRMHandle Handle, int Local);
+void	SSA_int_ComputeLiveness(tSSAState *State);
+void	SSA_int_PlacePhis(tSSAState *State);
+void	SSA_int_Rename(tSSAState *State);
+void	SSA_int_RenameBlock(tSSAState *State, tIRMBlock *Block);
+void	SSA_int_SetValue(tSSAState *State, int Local, tIRMReg Value);
+tIRMReg	SSA_int_GetValue(tSSAState *State, int Local);
+void	SSA_int_PropagateCopies(tIRMHandle Handle);
+void	SSA_int_EmitParallelCopy(tIRMHandle Handle, tIRMBlock *Block, int nCopies, tParallelCopy *Copies);
+
+// === CODE ===
+/**
+ * \brief Convert a function to SSA form
+ */
+void IRM_EnterSSA(tIRMHandle Handle)
+{
+	if( Handle->bIsSSA )
+		return ;
+	tSSAState	state = {
+		.Handle = Handle,
+		.nWords = (Handle->nLocals + BITS_PER_WORD - 1) / BITS_PER_WORD,
+		.Undef = calloc(Handle->nLocals + 1, sizeof(tIRMReg)),
+		.Current = calloc(Handle->nLocals + 1, sizeof(tIRMReg)),
+	};
+
+	IRM_ComputeDominators(Handle);
+	SSA_int_ComputeLiveness(&state);
+	SSA_int_PlacePhis(&state);
+	SSA_int_Rename(&state);
+	SSA_int_PropagateCopies(Handle);
+
+	free(state.LiveIn);
+	free(state.Undef);
+	free(state.Current);
+	free(state.Undo);
+	Handle->bIsSSA = true;
+}
+
+bool SSA_int_IsPromotable(tIRMHandle Handle, int Local)
+{
+	return !Handle->Locals[Local].bAddressTaken;
+}
+
+/**
+ * \brief Determine which locals are live on entry to each block (used to prune phis)
+ */
+void SSA_int_ComputeLiveness(tSSAState *State)
+{
+	tIRMHandle	h = State->Handle;
+	 int	nw = State->nWords;
+	tBitWord	*uevar = calloc(h->nBlocks * nw + 1, sizeof(tBitWord));
+	tBitWord	*kill = calloc(h->nBlocks * nw + 1, sizeof(tBitWord));
+	State->LiveIn = calloc(h->nBlocks * nw + 1, sizeof(tBitWord));
+
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = h->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			if( op->Op == IRMOP_LOADLOCAL && !BIT_TEST(kill + i*nw, op->Local) )
+				BIT_SET(uevar + i*nw, op->Local);
+			else if( op->Op == IRMOP_STORELOCAL )
+				BIT_SET(kill + i*nw, op->Local);
+		}
+	}
+
+	// Iterate to a fixed point, backwards over the RPO for quicker convergence
+	bool	changed = true;
+	while( changed )
+	{
+		changed = false;
+		for( int i = h->nBlocks; i --; )
+		{
+			tIRMBlock	*blk = h->Blocks[i];
+			tBitWord	*live = State->LiveIn + i*nw;
+			for( int w = 0; w < nw; w ++ )
+			{
+				tBitWord	out = 0;
+				for( int j = 0; j < blk->nSucc; j ++ )
+					out |= State->LiveIn[blk->Succ[j]->Index*nw + w];
+				tBitWord	in = uevar[i*nw+w] | (out & ~kill[i*nw+w]);
+				if( in != live[w] ) {
+					live[w] = in;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	free(uevar);
+	free(kill);
+}
+
+/**
+ * \brief Insert phi operations on the iterated dominance frontier of each store
+ */
+void SSA_int_PlacePhis(tSSAState *State)
+{
+	tIRMHandle	h = State->Handle;
+	tIRMBlock	**worklist = malloc(h->nBlocks * sizeof(tIRMBlock*));
+	 int	*has_phi = malloc(h->nBlocks * sizeof(int));
+	 int	*queued = malloc(h->nBlocks * sizeof(int));
+
+	for( int i = 0; i < h->nBlocks; i ++ )
+		has_phi[i] = queued[i] = -1;
+
+	// Blocks that store to each local, collected in one pass (def_blocks[def_start[lcl] .. def_start[lcl+1]])
+	 int	*def_start = calloc(h->nLocals + 1, sizeof(int));
+	 int	*last_def = malloc((h->nLocals + 1) * sizeof(int));
+	for( int lcl = 0; lcl < h->nLocals; lcl ++ )
+		last_def[lcl] = -1;
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = h->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			if( op->Op == IRMOP_STORELOCAL && last_def[op->Local] != i ) {
+				last_def[op->Local] = i;
+				def_start[op->Local] ++;
+			}
+		}
+	}
+	 int	ndefs = 0;
+	for( int lcl = 0; lcl < h->nLocals; lcl ++ )
+	{
+		 int	count = def_start[lcl];
+		def_start[lcl] = ndefs;
+		ndefs += count;
+		last_def[lcl] = -1;
+	}
+	def_start[h->nLocals] = ndefs;
+	tIRMBlock	**def_blocks = malloc(ndefs * sizeof(tIRMBlock*) + 1);
+	 int	*def_fill = malloc((h->nLocals + 1) * sizeof(int));
+	memcpy(def_fill, def_start, h->nLocals * sizeof(int));
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = h->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			if( op->Op == IRMOP_STORELOCAL && last_def[op->Local] != i ) {
+				last_def[op->Local] = i;
+				def_blocks[def_fill[op->Local]++] = h->Blocks[i];
+			}
+		}
+	}
+	free(def_fill);
+	free(last_def);
+
+	for( int lcl = 0; lcl < h->nLocals; lcl ++ )
+	{
+		if( !SSA_int_IsPromotable(h, lcl) )
+			continue ;
+
+		// Seed with the blocks that store to the local
+		 int	nwork = 0;
+		for( int i = def_start[lcl]; i < def_start[lcl+1]; i ++ )
+		{
+			worklist[nwork++] = def_blocks[i];
+			queued[def_blocks[i]->Index] = lcl;
+		}
+
+		while( nwork > 0 )
+		{
+			tIRMBlock	*blk = worklist[--nwork];
+			for( int j = 0; j < blk->nFrontier; j ++ )
+			{
+				tIRMBlock	*df = blk->Frontier[j];
+				if( has_phi[df->Index] == lcl )
+					continue ;
+				// Pruned SSA - no phi if the value is dead on entry
+				if( !BIT_TEST(State->LiveIn + df->Index*State->nWords, lcl) )
+					continue ;
+
+				tIRMOp	*phi = IRM_NewOp(IRMOP_PHI);
+				phi->Dst = IRM_AllocateRegister(h, h->Locals[lcl].Type);
+				phi->Local = lcl;
+				phi->nArgs = df->nPred;
+				phi->Args = calloc(df->nPred, sizeof(tIRMReg));
+				IRM_InsertOpBefore(df, df->FirstOp, phi);
+				has_phi[df->Index] = lcl;
+
+				if( queued[df->Index] != lcl ) {
+					queued[df->Index] = lcl;
+					worklist[nwork++] = df;
+				}
+			}
+		}
+	}
+
+	free(def_blocks);
+	free(def_start);
+	free(worklist);
+	free(has_phi);
+	free(queued);
+}
+
+/**
+ * \brief Get the reaching definition of a local, creating an undefined value if needed
+ */
+tIRMReg SSA_int_GetValue(tSSAState *State, int Local)
+{
+	if( State->Current[Local] != IRM_REG_VOID )
+		return State->Current[Local];
+	if( State->Undef[Local] == IRM_REG_VOID )
+	{
+		// Reading an uninitialised variable, any value is valid - use zero
+		tIRMBlock	*entry = State->Handle->Blocks[0];
+		tIRMOp	*op = IRM_NewOp(IRMOP_CONST);
+		op->Dst = IRM_AllocateRegister(State->Handle, State->Handle->Locals[Local].Type);
+		op->Imm = 0;
+		IRM_InsertOpBefore(entry, entry->FirstOp, op);
+		State->Undef[Local] = op->Dst;
+	}
+	return State->Undef[Local];
+}
+
+/**
+ * \brief Rename local accesses into registers, walking the dominator tree
+ *
+ * The walk uses an explicit stack, and each block's definitions are undone
+ * from a shared log when it is left. This keeps the work and memory
+ * proportional to the number of definitions rather than depth*locals.
+ */
+void SSA_int_Rename(tSSAState *State)
+{
+	tIRMHandle	h = State->Handle;
+	// Each block is on the stack at most twice (before and after its children)
+	tRenameFrame	*stack = malloc(2 * h->nBlocks * sizeof(tRenameFrame));
+	 int	depth = 0;
+	stack[depth++] = (tRenameFrame){h->Blocks[0], -1};
+	while( depth > 0 )
+	{
+		tRenameFrame	*frame = &stack[--depth];
+		if( frame->UndoMark >= 0 )
+		{
+			// Leaving the block, restore the definitions from before it
+			while( State->nUndo > frame->UndoMark )
+			{
+				tRenameUndo	*undo = &State->Undo[--State->nUndo];
+				State->Current[undo->Local] = undo->Prev;
+			}
+			continue ;
+		}
+
+		tIRMBlock	*blk = frame->Block;
+		stack[depth++] = (tRenameFrame){blk, State->nUndo};
+		SSA_int_RenameBlock(State, blk);
+		for( tIRMBlock *child = blk->FirstChild; child; child = child->NextSibling )
+			stack[depth++] = (tRenameFrame){child, -1};
+	}
+	free(stack);
+}
+
+/**
+ * \brief Rename the accesses in one block and fill in its successors' phi operands
+ */
+void SSA_int_RenameBlock(tSSAState *State, tIRMBlock *Block)
+{
+	tIRMHandle	h = State->Handle;
+	for( tIRMOp *op = Block->FirstOp, *next; op; op = next )
+	{
+		next = op->Next;
+		switch(op->Op)
+		{
+		case IRMOP_PHI:
+			SSA_int_SetValue(State, op->Local, op->Dst);
+			break;
+		case IRMOP_LOADLOCAL:
+			if( !SSA_int_IsPromotable(h, op->Local) )
+				break;
+			op->Op = IRMOP_COPY;
+			op->Src[0] = SSA_int_GetValue(State, op->Local);
+			break;
+		case IRMOP_STORELOCAL:
+			if( !SSA_int_IsPromotable(h, op->Local) )
+				break;
+			SSA_int_SetValue(State, op->Local, op->Src[0]);
+			IRM_RemoveOp(op);
+			IRM_FreeOp(op);
+			break;
+		default:
+			break;
+		}
+	}
+
+	for( int i = 0; i < Block->nSucc; i ++ )
+	{
+		tIRMBlock	*succ = Block->Succ[i];
+		 int	idx = IRM_GetPredIndex(succ, Block);
+		for( tIRMOp *op = succ->FirstOp; op && op->Op == IRMOP_PHI; op = op->Next )
+			op->Args[idx] = SSA_int_GetValue(State, op->Local);
+	}
+}
+
+/**
+ * \brief Push a new definition of a local (logged so the block can undo it)
+ */
+void SSA_int_SetValue(tSSAState *State, int Local, tIRMReg Value)
+{
+	if( State->nUndo == State->UndoSpace ) {
+		State->UndoSpace = State->UndoSpace * 2 + 64;
+		State->Undo = realloc(State->Undo, State->UndoSpace * sizeof(tRenameUndo));
+	}
+	State->Undo[State->nUndo].Local = Local;
+	State->Undo[State->nUndo].Prev = State->Current[Local];
+	State->nUndo ++;
+	State->Current[Local] = Value;
+}
+
+/**
+ * \brief Replace uses of copied registers with the original
+ */
+void SSA_int_PropagateCopies(tIRMHandle Handle)
+{
+	tIRMReg	*map = malloc(Handle->nRegs * sizeof(tIRMReg));
+	for( int i = 0; i < Handle->nRegs; i ++ )
+		map[i] = i;
+
+	// Collect copies (only between same-sized values)
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp, *next; op; op = next )
+		{
+			next = op->Next;
+			if( op->Op != IRMOP_COPY )
+				continue ;
+			if( Types_GetSizeOf(IRM_GetRegType(Handle, op->Dst)) != Types_GetSizeOf(IRM_GetRegType(Handle, op->Src[0])) )
+				continue ;
+			map[op->Dst] = op->Src[0];
+			IRM_RemoveOp(op);
+			IRM_FreeOp(op);
+		}
+	}
+
+	// Rewrite uses, following copy chains
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			for( int j = 0; j < IRM_GetUseCount(op); j ++ )
+			{
+				tIRMReg	*use = IRM_GetUse(op, j);
+				while( map[*use] != *use )
+					*use = map[*use];
+			}
+		}
+	}
+
+	free(map);
+}
+
+/**
+ * \brief Remove side-effect free operations whose results are never used
+ * \return Number of operations removed
+ */
+int IRM_RemoveDeadCode(tIRMHandle Handle)
+{
+	 int	*uses = calloc(Handle->nRegs, sizeof(int));
+	 int	ret = 0;
+
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			for( int j = 0; j < IRM_GetUseCount(op); j ++ )
+				uses[ *IRM_GetUse(op, j) ] ++;
+		}
+	}
+
+	// Removing an op can make its operands dead, so iterate until stable
+	bool	changed = true;
+	while( changed )
+	{
+		changed = false;
+		for( int i = Handle->nBlocks; i --; )
+		{
+			for( tIRMOp *op = Handle->Blocks[i]->LastOp, *prev; op; op = prev )
+			{
+				prev = op->Prev;
+				switch(op->Op)
+				{
+				case IRMOP_STORELOCAL:
+				case IRMOP_STORE:
+				case IRMOP_CALL:
+				case IRMOP_JUMP:
+				case IRMOP_BRANCH:
+				case IRMOP_SWITCH:
+				case IRMOP_RETURN:
+					continue ;
+				// Division can trap, but removing an unused one is allowed
+				default:
+					break;
+				}
+				if( op->Dst != IRM_REG_VOID && uses[op->Dst] > 0 )
+					continue ;
+				for( int j = 0; j < IRM_GetUseCount(op); j ++ )
+					uses[ *IRM_GetUse(op, j) ] --;
+				IRM_RemoveOp(op);
+				IRM_FreeOp(op);
+				changed = true;
+				ret ++;
+			}
+		}
+	}
+
+	free(uses);
+	return ret;
+}
+
+/**
+ * \brief Convert out of SSA form, replacing phis with copies on incoming edges
+ */
+void IRM_LeaveSSA(tIRMHandle Handle)
+{
+	if( !Handle->bIsSSA )
+		return ;
+
+	 int	nblocks = Handle->nBlocks;	// Split edges are appended, and have no phis
+	for( int i = 0; i < nblocks; i ++ )
+	{
+		tIRMBlock	*blk = Handle->Blocks[i];
+		 int	nphis = 0;
+		for( tIRMOp *op = blk->FirstOp; op && op->Op == IRMOP_PHI; op = op->Next )
+			nphis ++;
+		if( nphis == 0 )
+			continue ;
+
+		tParallelCopy	copies[nphis];
+		for( int j = 0; j < blk->nPred; j ++ )
+		{
+			tIRMBlock	*pred = blk->Pred[j];
+			// Critical edge, the copies need their own block
+			if( pred->nSucc > 1 ) {
+				pred = IRM_SplitEdge(Handle, pred, IRM_GetSuccIndex(pred, blk));
+			}
+
+			 int	n = 0;
+			for( tIRMOp *op = blk->FirstOp; op && op->Op == IRMOP_PHI; op = op->Next, n ++ )
+			{
+				copies[n].Dst = op->Dst;
+				copies[n].Src = op->Args[j];
+			}
+			SSA_int_EmitParallelCopy(Handle, pred, nphis, copies);
+		}
+
+		while( blk->FirstOp && blk->FirstOp->Op == IRMOP_PHI )
+		{
+			tIRMOp	*op = blk->FirstOp;
+			IRM_RemoveOp(op);
+			IRM_FreeOp(op);
+		}
+	}
+
+	Handle->bIsSSA = false;
+	IRM_UpdateCFG(Handle);
+}
+
+/**
+ * \brief Sequentialise a set of simultaneous copies before the block's terminator
+ * \note Cycles (e.g. swaps) are broken using a new temporary register
+ */
+void SSA_int_EmitParallelCopy(tIRMHandle Handle, tIRMBlock *Block, int nCopies, tParallelCopy *Copies)
+{
+	tIRMOp	*term = Block->LastOp;
+	assert( term && IRM_IsTerminator(term) );
+
+	 int	npending = 0;
+	tParallelCopy	pending[nCopies];
+	for( int i = 0; i < nCopies; i ++ )
+	{
+		if( Copies[i].Dst != Copies[i].Src )
+			pending[npending++] = Copies[i];
+	}
+
+	while( npending > 0 )
+	{
+		// Find a copy whose destination is not needed by another pending copy
+		 int	i;
+		for( i = 0; i < npending; i ++ )
+		{
+			 int	j;
+			for( j = 0; j < npending && pending[j].Src != pending[i].Dst; j ++ )
+				;
+			if( j == npending )
+				break;
+		}
+
+		tIRMOp	*op = IRM_NewOp(IRMOP_COPY);
+		if( i < npending )
+		{
+			op->Dst = pending[i].Dst;
+			op->Src[0] = pending[i].Src;
+			pending[i] = pending[--npending];
+		}
+		else
+		{
+			// Only cycles remain, save one destination to a temporary
+			tIRMReg	saved = pending[0].Dst;
+			op->Dst = IRM_AllocateRegister(Handle, IRM_GetRegType(Handle, saved));
+			op->Src[0] = saved;
+			for( int j = 0; j < npending; j ++ )
+			{
+				if( pending[j].Src == saved )
+					pending[j].Src = op->Dst;
+			}
+		}
+		IRM_InsertOpBefore(Block, term, op);
+	}
+}
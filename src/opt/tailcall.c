@@ -0,0 +1,166 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * This code is published under the terms of the BSD Licence. For more
+ * information see the file COPYING.
+ *
+ * optimiser/tailcall.c - Tail recursion elimination
+ *
+ * `return f(...)` inside f is replaced by storing the new arguments to the
+ * parameter locals and jumping back to the top of the function, so the
+ * recursion runs as a loop in a single frame. Runs before SSA
+ * construction, which then turns the parameters into phis at the loop
+ * header.
+ *
+ * Other calls in tail position are left to the backend (sibling calls).
+ */
+#include <global.h>
+#include <irm.h>
+#include <assert.h>
+
+// === PROTOTYPES ===
+ int	IRM_EliminateTailRecursion(tIRMHandle Handle, const tSymbol *Self);
+bool	TailCall_int_IsSelfCall(tIRMHandle Handle, tIRMOp * const *Defs, const tSymbol *Self, const tIRMOp *Call);
+tIRMBlock	*TailCall_int_SplitEntry(tIRMHandle Handle);
+
+// === CODE ===
+/**
+ * \brief Turn self-recursive tail calls into jumps to the start of the function
+ * \return Number of calls removed
+ */
+int IRM_EliminateTailRecursion(tIRMHandle Handle, const tSymbol *Self)
+{
+	 int	ret = 0;
+	// A pointer into the frame might be passed down, every call needs its own locals
+	for( int i = 0; i < Handle->nLocals; i ++ )
+	{
+		if( Handle->Locals[i].bAddressTaken )
+			return 0;
+	}
+
+	// Call targets, if defined once (not yet in SSA form)
+	 int	*ndefs = calloc(Handle->nRegs, sizeof(int));
+	tIRMOp	**defs = calloc(Handle->nRegs, sizeof(tIRMOp*));
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			if( op->Dst == IRM_REG_VOID )
+				continue ;
+			ndefs[op->Dst] ++;
+			defs[op->Dst] = op;
+		}
+	}
+	for( int r = 0; r < Handle->nRegs; r ++ )
+	{
+		if( ndefs[r] != 1 )
+			defs[r] = NULL;
+	}
+
+	tIRMBlock	*header = NULL;
+	 int	nblocks = Handle->nBlocks;
+	for( int i = 0; i < nblocks; i ++ )
+	{
+		tIRMBlock	*blk = Handle->Blocks[i];
+		tIRMOp	*ret_op = blk->LastOp;
+		if( !ret_op || ret_op->Op != IRMOP_RETURN || !ret_op->Prev )
+			continue ;
+		tIRMOp	*call = ret_op->Prev;
+		if( call->Op != IRMOP_CALL || !TailCall_int_IsSelfCall(Handle, defs, Self, call) )
+			continue ;
+		if( ret_op->Src[0] != IRM_REG_VOID && ret_op->Src[0] != call->Dst )
+			continue ;
+
+		if( !header ) {
+			header = TailCall_int_SplitEntry(Handle);
+			// (the entry block may have been the one being converted)
+			blk = ret_op->Block;
+		}
+
+		// Arguments were converted to the parameter types by the caller
+		for( int a = 0; a < call->nArgs; a ++ )
+		{
+			tIRMOp	*store = IRM_NewOp(IRMOP_STORELOCAL);
+			store->Local = a;
+			store->Src[0] = call->Args[a];
+			IRM_InsertOpBefore(blk, call, store);
+		}
+		IRM_RemoveOp(call);
+		IRM_FreeOp(call);
+		IRM_RemoveOp(ret_op);
+		IRM_FreeOp(ret_op);
+		IRM_InsertOpBefore(blk, NULL, IRM_NewOp(IRMOP_JUMP));
+		blk->nSucc = 1;
+		blk->Succ[0] = header;
+		ret ++;
+	}
+	free(defs);
+	free(ndefs);
+
+	if( ret )
+		IRM_UpdateCFG(Handle);
+	return ret;
+}
+
+/**
+ * \brief Check if \a Call is a direct call to \a Self with the declared arguments
+ */
+bool TailCall_int_IsSelfCall(tIRMHandle Handle, tIRMOp * const *Defs, const tSymbol *Self, const tIRMOp *Call)
+{
+	const tIRMOp	*target = Defs[Call->Src[0]];
+	// (a function name decays to a copy of its address)
+	while( target && target->Op == IRMOP_COPY )
+		target = Defs[target->Src[0]];
+	if( !target || target->Op != IRMOP_SYMADDR || target->Sym != Self )
+		return false;
+	// (extra variadic arguments have nowhere to go)
+	return Call->nArgs == Handle->nArgs;
+}
+
+/**
+ * \brief Move everything after the argument stores in the entry block into a new block
+ * \return New block (the target of the converted calls)
+ *
+ * The parameters are the first locals, initialised from the argument
+ * registers (see Compile_ConvertFunction).
+ */
+tIRMBlock *TailCall_int_SplitEntry(tIRMHandle Handle)
+{
+	tIRMBlock	*entry = Handle->Blocks[0];
+	tIRMBlock	*header = IRM_CreateBlock(Handle);
+	tIRMOp	*first = entry->FirstOp;
+	while( first && (first->Op == IRMOP_ARGUMENT || first->Op == IRMOP_STORELOCAL) )
+		first = first->Next;
+	assert( first );	// (always ends in a terminator)
+	while( first )
+	{
+		tIRMOp	*op = first;
+		first = op->Next;
+		IRM_RemoveOp(op);
+		IRM_InsertOpBefore(header, NULL, op);
+	}
+
+	// The header takes over the entry's successors (and any edges back to the entry)
+	tIRMBlock	**succs = header->Succ;
+	 int	space = header->SuccSpace;
+	header->Succ = entry->Succ;
+	header->SuccSpace = entry->SuccSpace;
+	header->nSucc = entry->nSucc;
+	entry->Succ = succs;
+	entry->SuccSpace = space;
+	entry->nSucc = 0;
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		tIRMBlock	*blk = Handle->Blocks[i];
+		for( int j = 0; j < blk->nSucc; j ++ )
+		{
+			if( blk->Succ[j] == entry )
+				blk->Succ[j] = header;
+		}
+	}
+	IRM_InsertOpBefore(entry, NULL, IRM_NewOp(IRMOP_JUMP));
+	entry->nSucc = 1;
+	entry->Succ[0] = header;
+	return header;
+}
@@ -18,22 +18,29 @@
 #define	WORDSIZE	8
 
 // === PROTOTYPES ===
- int	VM16CISC_GenerateFunction(FILE *OutFile, tFunction *Func);
-void	VM16CISC_ProcessBlock(FILE *OutFile, int CurBPOfs, tAST_Node *Node);
-void	VM16CISC_ProcessNode(FILE *OutFile, int CurBPOfs, tAST_Node *Node);
-void	VM16CISC_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers);
-void	VM16CISC_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers);
-void	VM16CISC_SaveTo(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers);
+ int	VM16CISC_GenerateFunction(tAsmOut *OutFile, tFunction *Func);
+void	VM16CISC_ProcessBlock(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node);
+void	VM16CISC_ProcessNode(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node);
+void	VM16CISC_DoAction(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers);
+void	VM16CISC_GetAddress(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers);
+void	VM16CISC_SaveTo(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers);
  int	VM16CISC_Int_AllocReg(uint16_t *Registers);
 
+// === GLOBALS ===
+//! Numbers the current function's local labels
+ int	giVM16CISC_LabelCount;
+//! Numbers string literals (their labels are file scope)
+ int	giVM16CISC_StringCount;
+
 // === CODE ===
-int VM16CISC_GenerateProlouge(FILE *OutFile)
+int VM16CISC_GenerateProlouge(tAsmOut *OutFile)
 {
 	tSymbol	*sym;
 	tFunction	*func;
-	fprintf(OutFile, "; File Generated by Acess CC\n");
-	fprintf(OutFile, "\n");
-	fprintf(OutFile, "[section .data]\n");
+	giVM16CISC_StringCount = 0;
+	AsmOut_Str(OutFile, "; File Generated by Acess CC\n");
+	AsmOut_Str(OutFile, "\n");
+	AsmOut_Str(OutFile, "[section .data]\n");
 	for(sym = gpGlobalSymbols;
 		sym;
 		sym = sym->Next
@@ -41,30 +48,30 @@ int VM16CISC_GenerateProlouge(FILE *OutFile)
 	{
 		if(sym->Type->Linkage == 2)	continue;
 		if(sym->Type->Linkage != 1)
-			fprintf(OutFile, "[global %s]\n", sym->Name);
-		fprintf(
+			AsmOut_Printf(OutFile, "[global %s]\n", sym->Name);
+		AsmOut_Printf(
 			OutFile,
 			"%s:\ttimes %li d64 0\n",
 			sym->Name,
 			sym->Type->Size
 			);
 	}
-	fprintf(OutFile, "\n");
-	fprintf(OutFile, "[section .rodata]\n");
-	fprintf(OutFile, "\n");
-	fprintf(OutFile, "\n");
-	fprintf(OutFile, "[section .text]\n");
+	AsmOut_Str(OutFile, "\n");
+	AsmOut_Str(OutFile, "[section .rodata]\n");
+	AsmOut_Str(OutFile, "\n");
+	AsmOut_Str(OutFile, "\n");
+	AsmOut_Str(OutFile, "[section .text]\n");
 	for(func = gpFunctions;
 		func;
 		func = func->Next)
 	{
 		if(func->Return->Linkage != 2)	continue;
-		fprintf(OutFile, "[extern %s]\n", func->Name);
+		AsmOut_Printf(OutFile, "[extern %s]\n", func->Name);
 	}
 	return 0;
 }
 
-int VM16CISC_GenerateFunction(FILE *OutFile, tFunction *Func)
+int VM16CISC_GenerateFunction(tAsmOut *OutFile, tFunction *Func)
 {
 	// int	curBP = 0;
 	
@@ -72,28 +79,30 @@ int VM16CISC_GenerateFunction(FILE *OutFile, tFunction *Func)
 	//	Func, Func->Name, Func->Code);
 	
 	// --- Function Prolouge
-	fprintf(OutFile, "\n");
-	fprintf(OutFile, "; Function '%s'\n", Func->Name);
+	AsmOut_Str(OutFile, "\n");
+	if( gbVerboseAsm )
+		AsmOut_Printf(OutFile, "; Function '%s'\n", Func->Name);
 	if(Func->Return->Linkage != 1)
-		fprintf(OutFile, "[global %s]\n", Func->Name);
-	fprintf(OutFile, "%s:\n", Func->Name);
-	fprintf(OutFile, "\tPUSH R13\n");
-	fprintf(OutFile, "\tMOV R13, R14\n");
+		AsmOut_Printf(OutFile, "[global %s]\n", Func->Name);
+	AsmOut_Printf(OutFile, "%s:\n", Func->Name);
+	AsmOut_Str(OutFile, "\tPUSH R13\n");
+	AsmOut_Str(OutFile, "\tMOV R13, R14\n");
 	// F*** keeping SP unchanged throughout the function
 	
 	// --- Process function block
+	giVM16CISC_LabelCount = 0;
 	VM16CISC_ProcessBlock(OutFile, 0, Func->Code);
 	
 	// --- Function Epilouge
-	fprintf(OutFile, ".ret:\n");
+	AsmOut_Str(OutFile, ".ret:\n");
 	// --(lea esp, [R13])--
-	fprintf(OutFile, "\tPOP R13\n");
-	fprintf(OutFile, "\tRET\n");
+	AsmOut_Str(OutFile, "\tPOP R13\n");
+	AsmOut_Str(OutFile, "\tRET\n");
 	
 	return 0;
 }
 
-void VM16CISC_ProcessBlock(FILE *OutFile, int CurBPOfs, tAST_Node *Node)
+void VM16CISC_ProcessBlock(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node)
 {
 	tAST_Node	*tmp;
 	
@@ -118,25 +127,28 @@ void VM16CISC_ProcessBlock(FILE *OutFile, int CurBPOfs, tAST_Node *Node)
 /**
  * \brief Generates code from a root node (assign, return, for, while, function, ...)
  */
-void VM16CISC_ProcessNode(FILE *OutFile, int CurBPOfs, tAST_Node *Node)
+void VM16CISC_ProcessNode(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node)
 {
 	switch(Node->Type)
 	{
 	case NODETYPE_IF:
+		{
+		 int	label = giVM16CISC_LabelCount ++;
 		VM16CISC_DoAction(OutFile, CurBPOfs, Node->If.Test, DEF_REGISTERS);
-		fprintf(OutFile, "\tTEST R1, R1\n");
-		fprintf(OutFile, "\tJZ .if_%p_false\n", Node);
+		AsmOut_Str(OutFile, "\tTEST R1, R1\n");
+		AsmOut_Printf(OutFile, "\tJZ .if%i_false\n", label);
 		VM16CISC_ProcessBlock(OutFile, CurBPOfs, Node->If.True);
-		fprintf(OutFile, "\tJMP .if_%p_end\n", Node);
-		fprintf(OutFile, ".if_%p_false:\n", Node);
+		AsmOut_Printf(OutFile, "\tJMP .if%i_end\n", label);
+		AsmOut_Printf(OutFile, ".if%i_false:\n", label);
 		VM16CISC_ProcessBlock(OutFile, CurBPOfs, Node->If.False);
-		fprintf(OutFile, ".if_%p_end:\n", Node);
-		fprintf(OutFile, "\n");
+		AsmOut_Printf(OutFile, ".if%i_end:\n", label);
+		AsmOut_Str(OutFile, "\n");
+		}
 		break;
 	
 	case NODETYPE_RETURN:
 		VM16CISC_DoAction(OutFile, CurBPOfs, Node->UniOp.Value, DEF_REGISTERS);
-		fprintf(OutFile, "\tJMP .ret\n");
+		AsmOut_Str(OutFile, "\tJMP .ret\n");
 		break;
 	default:
 		VM16CISC_DoAction(OutFile, CurBPOfs, Node, DEF_REGISTERS);
@@ -145,45 +157,48 @@ void VM16CISC_ProcessNode(FILE *OutFile, int CurBPOfs, tAST_Node *Node)
 	}
 }
 
-void VM16CISC_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers)
+void VM16CISC_DoAction(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers)
 {
 	tAST_Node	*child;
 	 int	reg, ofs, i;
 	switch( Node->Type )
 	{
 	case NODETYPE_INTEGER:
-		fprintf(OutFile, "\tMOV R1, 0x%lx\n", Node->Integer.Value);
+		AsmOut_Printf(OutFile, "\tMOV R1, 0x%lx\n", Node->Integer.Value);
 		break;
 	
 	case NODETYPE_STRING:
 		{
+		 int	str = giVM16CISC_StringCount ++;
 		 int	inString = 0;
-		fprintf(OutFile, "[section .rodata]\n_str_%p:\td8 ", Node->String.Data);
+		AsmOut_Printf(OutFile, "[section .rodata]\n_str%i:\td8 ", str);
 		for( i = 0; i < Node->String.Length; i++) {
 			uint8_t	ch = ((char*)Node->String.Data)[i];
 			if( ' ' <= ch && ch < 0x7F )
 			{
-				if(inString == 0)	fprintf(OutFile, "\"");
+				if(inString == 0)	AsmOut_Str(OutFile, "\"");
 				inString = 1;
 				if(ch == '"')
-					fprintf(OutFile, "\\\"");
+					AsmOut_Str(OutFile, "\\\"");
 				else
-					fprintf(OutFile, "%c", ch);
+					AsmOut_Write(OutFile, (char*)&ch, 1);
 			}
 			else {
-				if(inString == 1)	fprintf(OutFile, "\", ");
+				if(inString == 1)	AsmOut_Str(OutFile, "\", ");
 				inString = 0;
-				fprintf(OutFile, "%i, ", ch);
+				AsmOut_Int(OutFile, ch);
+				AsmOut_Str(OutFile, ", ");
 			}
 		}
-		if(inString == 1)	fprintf(OutFile, "\", ");
-		fprintf(OutFile, "0\n[section .text]\n");
-		fprintf(OutFile, "\tMOV R1, _str_%p\n", Node->String.Data);
+		if(inString == 1)	AsmOut_Str(OutFile, "\", ");
+		AsmOut_Str(OutFile, "0\n[section .text]\n");
+		AsmOut_Printf(OutFile, "\tMOV R1, _str%i\n", str);
 		}
 		break;
 	
 	case NODETYPE_LOCALVAR:
-		fprintf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
 		if( Node->LocalVariable.Sym->Offset < 0 ) {
 			ofs = -Node->LocalVariable.Sym->Offset + 1;	// [R13] == OldR13, [R13+8] == RetAddr
 		}
@@ -193,14 +208,15 @@ void VM16CISC_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Re
 		ofs *= WORDSIZE;
 		
 		if(ofs < 0)
-			fprintf(OutFile, "\tMOV R1, WORD [R13-0x%x]\n", -ofs);
+			AsmOut_Printf(OutFile, "\tMOV R1, WORD [R13-0x%x]\n", -ofs);
 		else
-			fprintf(OutFile, "\tmov R1, WORD [R13+0x%x]\n", ofs);
+			AsmOut_Printf(OutFile, "\tmov R1, WORD [R13+0x%x]\n", ofs);
 		break;
 	
 	case NODETYPE_SYMBOL:
-		fprintf(OutFile, "\t; NODETYPE_SYMBOL ('%s')\n", Node->Symbol.Name);
-		fprintf(OutFile, "\tMOV R1, WORD [$%s]\n", Node->Symbol.Name);
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; NODETYPE_SYMBOL ('%s')\n", Node->Symbol.Name);
+		AsmOut_Printf(OutFile, "\tMOV R1, WORD [$%s]\n", Node->Symbol.Name);
 		break;
 	
 	
@@ -215,7 +231,7 @@ void VM16CISC_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Re
 			i ++;
 		}
 		ofs = i;
-		fprintf(OutFile, "\tSUB R14, 0x%x\n", ofs*WORDSIZE);
+		AsmOut_Printf(OutFile, "\tSUB R14, 0x%x\n", ofs*WORDSIZE);
 		i = 0;
 		for(child = Node->FunctionCall.FirstArgument;
 			child;
@@ -223,17 +239,21 @@ void VM16CISC_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Re
 			)
 		{
 			VM16CISC_ProcessNode(OutFile, CurBPOfs, child);
-			fprintf(OutFile, "\tMOV WORD [R14+0x%x], R1\t; Argument %i for %p\n", i*WORDSIZE, i, Node);
+			AsmOut_Printf(OutFile, "\tMOV WORD [R14+0x%x], R1", i*WORDSIZE);
+			if( gbVerboseAsm )
+				AsmOut_Printf(OutFile, "\t; Argument %i", i);
+			AsmOut_Str(OutFile, "\n");
 			i ++;
 		}
 		VM16CISC_GetAddress(OutFile, CurBPOfs, Node->FunctionCall.Function, DEF_REGISTERS);
-		fprintf(OutFile, "\tCALL R1\n");
-		fprintf(OutFile, "\tADD R14, 0x%x\n", ofs*WORDSIZE);
+		AsmOut_Str(OutFile, "\tCALL R1\n");
+		AsmOut_Printf(OutFile, "\tADD R14, 0x%x\n", ofs*WORDSIZE);
 		break;
 	
 	// Assignment
 	case NODETYPE_ASSIGN:
-		fprintf(OutFile, "\t; NODETYPE_ASSIGN (%p = %p)\n", Node->Assign.To, Node->Assign.From);
+		if( gbVerboseAsm )
+			AsmOut_Str(OutFile, "\t; NODETYPE_ASSIGN\n");
 		VM16CISC_DoAction(OutFile, CurBPOfs, Node->Assign.From, Registers);
 		VM16CISC_SaveTo(OutFile, CurBPOfs, Node->Assign.To, Registers);
 		break;
@@ -241,13 +261,14 @@ void VM16CISC_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Re
 	// Simple Binary Operations
 	case NODETYPE_ADD:
 	case NODETYPE_SUBTRACT:
-		fprintf(OutFile, "\t; 0x%03x (%p, %p)\n", Node->Type, Node->BinOp.Left, Node->BinOp.Right);
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; 0x%03x\n", Node->Type);
 		// Get the left
 		VM16CISC_DoAction(OutFile, CurBPOfs, Node->BinOp.Left, Registers);
 		
 		// Save it to a register
 		reg = VM16CISC_Int_AllocReg(&Registers);
-		fprintf(OutFile, "\tMOV R%i, R1\n", reg);
+		AsmOut_Printf(OutFile, "\tMOV R%i, R1\n", reg);
 		
 		// Get the right
 		VM16CISC_DoAction(OutFile, CurBPOfs, Node->BinOp.Right, Registers);
@@ -256,10 +277,10 @@ void VM16CISC_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Re
 		switch(Node->Type)
 		{
 		case NODETYPE_ADD:
-			fprintf(OutFile, "\tADD R1, R%i\n", reg);
+			AsmOut_Printf(OutFile, "\tADD R1, R%i\n", reg);
 			break;
 		case NODETYPE_SUBTRACT:
-			fprintf(OutFile, "\tSUB R1, R%i\n", reg);
+			AsmOut_Printf(OutFile, "\tSUB R1, R%i\n", reg);
 			break;
 		}
 		
@@ -273,7 +294,7 @@ void VM16CISC_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Re
 	}
 }
 
-void VM16CISC_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers)
+void VM16CISC_GetAddress(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers)
 {
 	 int	ofs;
 	switch( Node->Type )
@@ -284,11 +305,12 @@ void VM16CISC_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t
 		break;
 	
 	case NODETYPE_SYMBOL:
-		fprintf(OutFile, "\tMOV R1, $%s\n", Node->Symbol.Name);
+		AsmOut_Printf(OutFile, "\tMOV R1, $%s\n", Node->Symbol.Name);
 		break;
 	
 	case NODETYPE_LOCALVAR:
-		fprintf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
 		if( Node->LocalVariable.Sym->Offset < 0 ) {
 			ofs = -Node->LocalVariable.Sym->Offset + 1;	// [R13] == OldR13, [R13+4] == RetAddr
 		}
@@ -298,9 +320,9 @@ void VM16CISC_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t
 		ofs *= WORDSIZE;
 		
 		if(ofs < 0)
-			fprintf(OutFile, "\tLEA R1, [R13-0x%x]\n", -ofs);
+			AsmOut_Printf(OutFile, "\tLEA R1, [R13-0x%x]\n", -ofs);
 		else
-			fprintf(OutFile, "\tLEA R1, [R13+0x%x]\n", ofs);
+			AsmOut_Printf(OutFile, "\tLEA R1, [R13+0x%x]\n", ofs);
 		break;
 	
 	default:
@@ -312,7 +334,7 @@ void VM16CISC_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t
 /**
  * 
  */
-void VM16CISC_SaveTo(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers)
+void VM16CISC_SaveTo(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Registers)
 {
 	 int	reg, ofs;
 	switch( Node->Type )
@@ -320,29 +342,30 @@ void VM16CISC_SaveTo(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Regi
 	case NODETYPE_DEREF:
 		// Save R1 somewhere
 		reg = VM16CISC_Int_AllocReg(&Registers);
-		fprintf(OutFile, "\tMOV R%i, R1\n", reg);
+		AsmOut_Printf(OutFile, "\tMOV R%i, R1\n", reg);
 		
 		// Get Address
 		VM16CISC_DoAction(OutFile, CurBPOfs, Node->UniOp.Value, Registers);
 		#if 0
 		switch( GetPtrSize( Node->UniOp.Value ) )
 		{
-		//case  8: fprintf(OutFile, "mov BYTE [R1], R%i\n", reg);	break;
-		case 16: fprintf(OutFile, "mov DBYTE [R1], R%i\n", reg);	break;
-		case 32: fprintf(OutFile, "mov HWORD [R1], R%i\n", reg);	break;
+		//case  8: AsmOut_Printf(OutFile, "mov BYTE [R1], R%i\n", reg);	break;
+		case 16: AsmOut_Printf(OutFile, "mov DBYTE [R1], R%i\n", reg);	break;
+		case 32: AsmOut_Printf(OutFile, "mov HWORD [R1], R%i\n", reg);	break;
 		default: fprintf(stderr, "ARRRGH!!!!\n");	exit(1);
 		}
 		#else
-		fprintf(OutFile, "\tmov WORD [R1], R%i\n", reg);
+		AsmOut_Printf(OutFile, "\tmov WORD [R1], R%i\n", reg);
 		#endif
 		break;
 	
 	case NODETYPE_SYMBOL:
-		fprintf(OutFile, "\tmov WORD [$%s], R1\n", Node->Symbol.Name);
+		AsmOut_Printf(OutFile, "\tmov WORD [$%s], R1\n", Node->Symbol.Name);
 		break;
 	
 	case NODETYPE_LOCALVAR:
-		fprintf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
 		if( Node->LocalVariable.Sym->Offset < 0 ) {
 			ofs = -Node->LocalVariable.Sym->Offset + 1;	// [R13] == OldR13, [R13+4] == RetAddr
 		}
@@ -352,9 +375,9 @@ void VM16CISC_SaveTo(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint16_t Regi
 		ofs *= 4;
 		
 		if(ofs < 0)
-			fprintf(OutFile, "\tmov WORD [R13-0x%x], R1\n", -ofs);
+			AsmOut_Printf(OutFile, "\tmov WORD [R13-0x%x], R1\n", -ofs);
 		else
-			fprintf(OutFile, "\tmov WORD [R13+0x%x], R1\n", ofs);
+			AsmOut_Printf(OutFile, "\tmov WORD [R13+0x%x], R1\n", ofs);
 		break;
 	
 	default:
@@ -13,111 +13,144 @@
 #include <ast.h>
 #include <symbol.h>
 #include <output.h>
+#include <consteval.h>
+
+// === IMPORTS ===
+extern int	X86_IRM_GenerateFunction(tAsmOut *OutFile, tFunction *Func, int Bits);
 
 // === PROTOTYPES ===
- int	X86_GenerateFunction(FILE *OutFile, tFunction *Func);
-void	X86_ProcessBlock(FILE *OutFile, int CurBPOfs, tAST_Node *Node);
-void	X86_ProcessNode(FILE *OutFile, int CurBPOfs, tAST_Node *Node);
-void	X86_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers);
-void	X86_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers);
-void	X86_SaveTo(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers);
+ int	X86_GenerateProlouge(tAsmOut *OutFile);
+ int	X86_64_GenerateProlouge(tAsmOut *OutFile);
+ int	X86_int_GenerateProlouge(tAsmOut *OutFile, int Bits);
+ int	X86_GenerateFunction(tAsmOut *OutFile, tFunction *Func);
+ int	X86_64_GenerateFunction(tAsmOut *OutFile, tFunction *Func);
+void	X86_ProcessBlock(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node);
+void	X86_ProcessNode(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node);
+void	X86_DoAction(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers);
+void	X86_GetAddress(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers);
+void	X86_SaveTo(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers);
  int	X86_Int_AllocReg(uint8_t *Registers);
+bool	X86_int_IsLeafOperand(tAST_Node *Node);
+void	X86_int_LeafOp(tAsmOut *OutFile, const char *Op, tAST_Node *Node);
+void	X86_int_Directive(tAsmOut *OutFile, const char *Directive, const char *Name);
+const char	*X86_int_DataSection(const tSymbol *Sym);
+void	X86_int_EmitVariable(tAsmOut *OutFile, const char *Section, const tSymbol *Sym);
+void	X86_int_EmitInit(tAsmOut *OutFile, const char *Section, const tType *Type, tAST_Node *Value);
+void	X86_int_EmitBlob(tAsmOut *OutFile, const tType *Type, tAST_Node *Value);
+void	X86_int_EmitBytes(tAsmOut *OutFile, const void *Data, size_t Bytes);
+void	X86_int_EmitZeros(tAsmOut *OutFile, size_t Bytes);
 
 const char * const csaRegB[] = {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"};
-const char * const csaRegX[] = {"ax", "cx", "dx", "bx", "sp", "bp", "di", "si"};
-const char * const csaRegEX[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "edi", "esi"};
+const char * const csaRegX[] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"};
+const char * const csaRegEX[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"};
+//! Registers holding intermediate values (EAX is the accumulator)
+#define X86_EXPR_REGS	((1 << 1)|(1 << 2)|(1 << 3))	// ECX, EDX, EBX
+
+// === GLOBALS ===
+//! Numbers the current function's local labels
+ int	giX86_LabelCount;
+//! Numbers string literals (their labels are file scope)
+ int	giX86_StringCount;
 
 // === CODE ===
-int X86_GenerateProlouge(FILE *OutFile)
+int X86_GenerateProlouge(tAsmOut *OutFile)
 {
-	fprintf(OutFile, "; File Generated by Acess CC\n");
-	fprintf(OutFile, "[bits 32]\n");
-	fprintf(OutFile, "\n");
-	fprintf(OutFile, "[section .data]\n");
-	for(tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
-	{
-		// Ignore constants
-		if( sym->Type->bConst )
-			continue ;
-		// Global and statics only
-		if(sym->Linkage == LINKAGE_GLOBAL)
-			fprintf(OutFile, "[global %s]\n", sym->Name);
-		else if( sym->Linkage == LINKAGE_STATIC )
-			;
-		else
-			continue ;
-		
-		fprintf(
-			OutFile,
-			"%s:\ttimes %zi dd 0\n",
-			sym->Name,
-			Types_GetSizeOf(sym->Type)
-			);
-	}
-	fprintf(OutFile, "\n");
-	fprintf(OutFile, "[section .rodata]\n");
-	for(tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
+	return X86_int_GenerateProlouge(OutFile, 32);
+}
+
+int X86_64_GenerateProlouge(tAsmOut *OutFile)
+{
+	return X86_int_GenerateProlouge(OutFile, 64);
+}
+
+int X86_int_GenerateProlouge(tAsmOut *OutFile, int Bits)
+{
+	giX86_StringCount = 0;
+	AsmOut_Str(OutFile, "; File Generated by Acess CC\n");
+	AsmOut_Printf(OutFile, "[bits %i]\n", Bits);
+	AsmOut_Str(OutFile, "\n");
+	static const char * const	sections[] = {".data", ".bss", ".rodata"};
+	for( int i = 0; i < 3; i ++ )
 	{
-		// Ignore non-constants
-		if( !sym->Type->bConst )
-			continue ;
-		// Global and statics only
-		if(sym->Linkage == LINKAGE_GLOBAL)
-			fprintf(OutFile, "[global %s]\n", sym->Name);
-		else if( sym->Linkage == LINKAGE_STATIC )
-			;
-		else
-			continue ;
-		
-		// TODO: dump node sym->InitValue
-		fprintf(
-			OutFile,
-			"%s:\ttimes %zi dd 0\n",
-			sym->Name,
-			Types_GetSizeOf(sym->Type)
-			);
+		AsmOut_Str(OutFile, "[section ");
+		AsmOut_Str(OutFile, sections[i]);
+		AsmOut_Str(OutFile, "]\n");
+		for(tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
+		{
+			// Ignore functions
+			if( sym->Type->Class == TYPECLASS_FUNCTION )
+				continue ;
+			// Global and statics only
+			if( sym->Linkage != LINKAGE_GLOBAL && sym->Linkage != LINKAGE_STATIC )
+				continue ;
+			if( X86_int_DataSection(sym) == sections[i] )
+				X86_int_EmitVariable(OutFile, sections[i], sym);
+		}
+		AsmOut_Str(OutFile, "\n");
 	}
-	fprintf(OutFile, "\n");
-	fprintf(OutFile, "[section .text]\n");
+	AsmOut_Str(OutFile, "[section .text]\n");
 	for(tFunction *func = gpFunctions; func; func = func->Next)
 	{
 		if(func->Linkage == LINKAGE_EXTERNAL)
-			fprintf(OutFile, "[extern %s]\n", func->Sym.Name);
+			X86_int_Directive(OutFile, "extern", func->Sym.Name);
 		else
 			;
 	}
+	// `extern` variables that were never defined here are only referenced
+	for(tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
+	{
+		if( sym->Type->Class != TYPECLASS_FUNCTION && sym->Linkage == LINKAGE_EXTERNAL )
+			X86_int_Directive(OutFile, "extern", sym->Name);
+	}
 	return 0;
 }
 
-int X86_GenerateFunction(FILE *OutFile, tFunction *Func)
+/**
+ * \brief x86-64 (System V ABI), only generated from the IRM
+ */
+int X86_64_GenerateFunction(tAsmOut *OutFile, tFunction *Func)
+{
+	if( !Func->IRM ) {
+		fprintf(stderr, "ERROR: x86-64 code needs the IRM backend (-O1)\n");
+		exit(1);
+	}
+	return X86_IRM_GenerateFunction(OutFile, Func, 64);
+}
+
+int X86_GenerateFunction(tAsmOut *OutFile, tFunction *Func)
 {
 	// int	curBP = 0;
 	
 	//printf("X86_GenerateFunction: (Func=%p{Name:'%s',Code:%p,...})\n",
 	//	Func, Func->Name, Func->Code);
 	
+	// Optimised functions are generated from the IRM
+	if( Func->IRM )
+		return X86_IRM_GenerateFunction(OutFile, Func, 32);
+	
 	// --- Function Prolouge
-	fprintf(OutFile, "\n");
+	AsmOut_Str(OutFile, "\n");
 	if(Func->Linkage == LINKAGE_GLOBAL)
-		fprintf(OutFile, "[global %s]\n", Func->Sym.Name);
-	fprintf(OutFile, "%s:\n", Func->Sym.Name);
-	fprintf(OutFile, "\tpush ebp\n");
-	fprintf(OutFile, "\tmov ebp, esp\n");
+		X86_int_Directive(OutFile, "global", Func->Sym.Name);
+	AsmOut_Printf(OutFile, "$%s:\n", Func->Sym.Name);
+	AsmOut_Str(OutFile, "\tpush ebp\n");
+	AsmOut_Str(OutFile, "\tmov ebp, esp\n");
 	// CBF keeping SP unchanged throughout the function
 	
 	// --- Process function block
+	giX86_LabelCount = 0;
 	X86_ProcessBlock(OutFile, 0, Func->Sym.Value);
 	
 	// --- Function Epilouge
-	fprintf(OutFile, ".ret:\n");
+	AsmOut_Str(OutFile, ".ret:\n");
 	// --(lea esp, [ebp])--
-	fprintf(OutFile, "\tpop ebp\n");
-	fprintf(OutFile, "\tret\n");
+	AsmOut_Str(OutFile, "\tpop ebp\n");
+	AsmOut_Str(OutFile, "\tret\n");
 	
 	return 0;
 }
 
-void X86_ProcessBlock(FILE *OutFile, int CurBPOfs, tAST_Node *Node)
+void X86_ProcessBlock(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node)
 {
 	tAST_Node	*tmp;
 	
@@ -142,34 +175,37 @@ void X86_ProcessBlock(FILE *OutFile, int CurBPOfs, tAST_Node *Node)
 /**
  * \brief Generates code from a root node (assign, return, for, while, function, ...)
  */
-void X86_ProcessNode(FILE *OutFile, int CurBPOfs, tAST_Node *Node)
+void X86_ProcessNode(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node)
 {
 	switch(Node->Type)
 	{
 	case NODETYPE_IF:
-		X86_DoAction(OutFile, CurBPOfs, Node->If.Test, 0x18);
-		fprintf(OutFile, "\tcmp eax, 0\n");
-		fprintf(OutFile, "\tjz .if_%p_false\n", Node);
+		{
+		 int	label = giX86_LabelCount ++;
+		X86_DoAction(OutFile, CurBPOfs, Node->If.Test, X86_EXPR_REGS);
+		AsmOut_Str(OutFile, "\tcmp eax, 0\n");
+		AsmOut_Printf(OutFile, "\tjz .if%i_false\n", label);
 		X86_ProcessBlock(OutFile, CurBPOfs, Node->If.True);
-		fprintf(OutFile, "\tjmp .if_%p_end\n", Node);
-		fprintf(OutFile, ".if_%p_false:\n", Node);
+		AsmOut_Printf(OutFile, "\tjmp .if%i_end\n", label);
+		AsmOut_Printf(OutFile, ".if%i_false:\n", label);
 		X86_ProcessBlock(OutFile, CurBPOfs, Node->If.False);
-		fprintf(OutFile, ".if_%p_end:\n", Node);
-		fprintf(OutFile, "\n");
+		AsmOut_Printf(OutFile, ".if%i_end:\n", label);
+		AsmOut_Str(OutFile, "\n");
+		}
 		break;
 	
 	case NODETYPE_RETURN:
-		X86_DoAction(OutFile, CurBPOfs, Node->UniOp.Value, 0x18);
-		fprintf(OutFile, "\tjmp .ret\n");
+		X86_DoAction(OutFile, CurBPOfs, Node->UniOp.Value, X86_EXPR_REGS);
+		AsmOut_Str(OutFile, "\tjmp .ret\n");
 		break;
 	default:
-		X86_DoAction(OutFile, CurBPOfs, Node, 0x18);
+		X86_DoAction(OutFile, CurBPOfs, Node, X86_EXPR_REGS);
 		//fprintf(stderr, "X86_ProcessNode: Unexpected 0x%03x\n", Node->Type);
 		return;
 	}
 }
 
-void X86_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers)
+void X86_DoAction(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers)
 {
 	tAST_Node	*child;
 	 int	reg, ofs, i;
@@ -177,29 +213,35 @@ void X86_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Register
 	{
 	case NODETYPE_INTEGER:
 		#if SUPPORT_LLINT
-		if(Node->Integer.Value > ((uint64_t)1<<32)) {
+		if(Types_GetSizeOf(AST_GetIntegerType(Node)) > 4) {
 			// mov edx, value >> 32
-			fprintf(OutFile, "\tmov edx, 0x%08x", (uint32_t)(Node->Integer.Value >> 32));
+			AsmOut_Printf(OutFile, "\tmov edx, 0x%08x", (uint32_t)(Node->Integer.Value >> 32));
 		}
 		#else
-		if(Node->Integer.Value > ((uint64_t)1<<32)) {
+		if(Types_GetSizeOf(AST_GetIntegerType(Node)) > 4) {
 			fprintf(stderr, "ERROR: double native integers are unsupported\n");
 			exit(-1);
 		}
 		#endif
-		fprintf(OutFile, "\tmov eax, 0x%08x\n", (uint32_t)Node->Integer.Value & 0xFFFFFFFF);
+		AsmOut_Printf(OutFile, "\tmov eax, 0x%08x\n", (uint32_t)Node->Integer.Value & 0xFFFFFFFF);
 		break;
 	
 	case NODETYPE_STRING:
-		fprintf(OutFile, "[section .rodata]\n_str_%p:\tdb ", Node->String.Data);
-		for( i = 0; i < Node->String.Length; i++)
-			fprintf(OutFile, "%i, ", ((char*)Node->String.Data)[i]);
-		fprintf(OutFile, "0\n[section .text]\n");
-		fprintf(OutFile, "\tmov eax, _str_%p\n", Node->String.Data);
+		{
+		 int	str = giX86_StringCount ++;
+		AsmOut_Printf(OutFile, "[section .rodata]\n..@str%i:\tdb ", str);
+		for( i = 0; i < Node->String.Length; i++) {
+			AsmOut_Int(OutFile, ((char*)Node->String.Data)[i]);
+			AsmOut_Str(OutFile, ", ");
+		}
+		AsmOut_Str(OutFile, "0\n[section .text]\n");
+		AsmOut_Printf(OutFile, "\tmov eax, ..@str%i\n", str);
+		}
 		break;
 	
 	case NODETYPE_LOCALVAR:
-		fprintf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
 		if( Node->LocalVariable.Sym->Offset < 0 ) {
 			ofs = -Node->LocalVariable.Sym->Offset + 1;	// [EBP] == OldEBP, [EBP+4] == RetAddr
 		}
@@ -209,14 +251,15 @@ void X86_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Register
 		ofs *= 4;
 		
 		if(ofs < 0)
-			fprintf(OutFile, "\tmov eax, [ebp-0x%x]\n", -ofs);
+			AsmOut_Printf(OutFile, "\tmov eax, [ebp-0x%x]\n", -ofs);
 		else
-			fprintf(OutFile, "\tmov eax, [ebp+0x%x]\n", ofs);
+			AsmOut_Printf(OutFile, "\tmov eax, [ebp+0x%x]\n", ofs);
 		break;
 	
 	case NODETYPE_SYMBOL:
-		fprintf(OutFile, "\t; NODETYPE_SYMBOL ('%s')\n", Node->Symbol.Name);
-		fprintf(OutFile, "\tmov eax, [%s]\n", Node->Symbol.Name);
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; NODETYPE_SYMBOL ('%s')\n", Node->Symbol.Name);
+		AsmOut_Printf(OutFile, "\tmov eax, [$%s]\n", Node->Symbol.Name);
 		break;
 	
 	
@@ -231,7 +274,7 @@ void X86_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Register
 			i ++;
 		}
 		ofs = i;
-		fprintf(OutFile, "\tsub esp, 0x%x\n", ofs*4);
+		AsmOut_Printf(OutFile, "\tsub esp, 0x%x\n", ofs*4);
 		i = 0;
 		for(child = Node->FunctionCall.FirstArgument;
 			child;
@@ -239,51 +282,63 @@ void X86_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Register
 			)
 		{
 			X86_ProcessNode(OutFile, CurBPOfs, child);
-			fprintf(OutFile, "\tmov [esp+0x%x], eax\t; Argument %i for %p\n", i*4, i, Node);
+			AsmOut_Printf(OutFile, "\tmov [esp+0x%x], eax", i*4);
+			if( gbVerboseAsm )
+				AsmOut_Printf(OutFile, "\t; Argument %i", i);
+			AsmOut_Str(OutFile, "\n");
 			i ++;
 		}
-		X86_GetAddress(OutFile, CurBPOfs, Node->FunctionCall.Function, 0x18);
-		fprintf(OutFile, "\tcall eax\n");
-		fprintf(OutFile, "\tadd esp, 0x%x\n", ofs*4);
+		// Named functions are called directly
+		if( Node->FunctionCall.Function->Type == NODETYPE_SYMBOL ) {
+			AsmOut_Printf(OutFile, "\tcall $%s\n", Node->FunctionCall.Function->Symbol.Name);
+		}
+		else {
+			X86_GetAddress(OutFile, CurBPOfs, Node->FunctionCall.Function, X86_EXPR_REGS);
+			AsmOut_Str(OutFile, "\tcall eax\n");
+		}
+		AsmOut_Printf(OutFile, "\tadd esp, 0x%x\n", ofs*4);
 		break;
 	
 	// Assignment
 	case NODETYPE_ASSIGN:
-		fprintf(OutFile, "\t; NODETYPE_ASSIGN (%p = %p)\n", Node->Assign.To, Node->Assign.From);
+		if( gbVerboseAsm )
+			AsmOut_Str(OutFile, "\t; NODETYPE_ASSIGN\n");
 		X86_DoAction(OutFile, CurBPOfs, Node->Assign.From, Registers);
 		X86_SaveTo(OutFile, CurBPOfs, Node->Assign.To, Registers);
 		break;
 	
 	// Simple Binary Operations
 	case NODETYPE_ADD:
-	case NODETYPE_SUBTRACT:
-		fprintf(OutFile, "\t; 0x%03x (%p, %p)\n", Node->Type, Node->BinOp.Left, Node->BinOp.Right);
-		// Get the left
-		X86_DoAction(OutFile, CurBPOfs, Node->BinOp.Left, Registers);
-		
-		// Save it to a register
-		reg = X86_Int_AllocReg(&Registers);
-		fprintf(OutFile, "\tmov %s, eax\n", csaRegEX[reg]);
-		
-		// Get the right
-		X86_DoAction(OutFile, CurBPOfs, Node->BinOp.Right, Registers);
-		
-		// Do operation
-		switch(Node->Type)
+	case NODETYPE_SUBTRACT: {
+		const char	*op = (Node->Type == NODETYPE_ADD ? "add" : "sub");
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; 0x%03x\n", Node->Type);
+		// A leaf on the right is used directly
+		if( X86_int_IsLeafOperand(Node->BinOp.Right) )
 		{
-		case NODETYPE_ADD:
-			fprintf(OutFile, "\tadd eax, %s\n", csaRegEX[reg]);
-			break;
-		case NODETYPE_SUBTRACT:
-			fprintf(OutFile, "\tsub eax, %s\n", csaRegEX[reg]);
-			break;
-		default:
-			exit(1);
-			break;
+			X86_DoAction(OutFile, CurBPOfs, Node->BinOp.Left, Registers);
+			X86_int_LeafOp(OutFile, op, Node->BinOp.Right);
 		}
-		
-		Registers &= ~(1<<reg);
-		break;
+		// Otherwise the side needing more registers goes first (Sethi-Ullman)
+		else if( AST_EvalRightFirst(Node->BinOp.Left, Node->BinOp.Right) )
+		{
+			X86_DoAction(OutFile, CurBPOfs, Node->BinOp.Right, Registers);
+			reg = X86_Int_AllocReg(&Registers);
+			AsmOut_Printf(OutFile, "\tmov %s, eax\n", csaRegEX[reg]);
+			X86_DoAction(OutFile, CurBPOfs, Node->BinOp.Left, Registers);
+			AsmOut_Printf(OutFile, "\t%s eax, %s\n", op, csaRegEX[reg]);
+		}
+		else
+		{
+			X86_DoAction(OutFile, CurBPOfs, Node->BinOp.Left, Registers);
+			reg = X86_Int_AllocReg(&Registers);
+			AsmOut_Printf(OutFile, "\tmov %s, eax\n", csaRegEX[reg]);
+			X86_DoAction(OutFile, CurBPOfs, Node->BinOp.Right, Registers);
+			// Left is in the scratch register
+			AsmOut_Printf(OutFile, "\t%s %s, eax\n", op, csaRegEX[reg]);
+			AsmOut_Printf(OutFile, "\tmov eax, %s\n", csaRegEX[reg]);
+		}
+		break; }
 	
 	default:
 		fprintf(stderr, "X86_DoAction: Unknown node 0x%03x\n", Node->Type);
@@ -292,7 +347,7 @@ void X86_DoAction(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Register
 	}
 }
 
-void X86_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers)
+void X86_GetAddress(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers)
 {
 	 int	ofs;
 	switch( Node->Type )
@@ -303,11 +358,12 @@ void X86_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Regist
 		break;
 	
 	case NODETYPE_SYMBOL:
-		fprintf(OutFile, "\tmov eax, $%s\n", Node->Symbol.Name);
+		AsmOut_Printf(OutFile, "\tmov eax, $%s\n", Node->Symbol.Name);
 		break;
 	
 	case NODETYPE_LOCALVAR:
-		fprintf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
 		if( Node->LocalVariable.Sym->Offset < 0 ) {
 			ofs = -Node->LocalVariable.Sym->Offset + 1;	// [EBP] == OldEBP, [EBP+4] == RetAddr
 		}
@@ -317,9 +373,9 @@ void X86_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Regist
 		ofs *= 4;
 		
 		if(ofs < 0)
-			fprintf(OutFile, "\tlea eax, [ebp-0x%x]\n", -ofs);
+			AsmOut_Printf(OutFile, "\tlea eax, [ebp-0x%x]\n", -ofs);
 		else
-			fprintf(OutFile, "\tlea eax, [ebp+0x%x]\n", ofs);
+			AsmOut_Printf(OutFile, "\tlea eax, [ebp+0x%x]\n", ofs);
 		break;
 	
 	default:
@@ -331,7 +387,7 @@ void X86_GetAddress(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Regist
 /**
  * 
  */
-void X86_SaveTo(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers)
+void X86_SaveTo(tAsmOut *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers)
 {
 	 int	reg, ofs;
 	switch( Node->Type )
@@ -339,29 +395,30 @@ void X86_SaveTo(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers)
 	case NODETYPE_DEREF:
 		// Save EAX somewhere
 		reg = X86_Int_AllocReg(&Registers);
-		fprintf(OutFile, "\tmov %s, eax\n", csaRegEX[reg]);
+		AsmOut_Printf(OutFile, "\tmov %s, eax\n", csaRegEX[reg]);
 		
 		// Get Address
 		X86_DoAction(OutFile, CurBPOfs, Node->UniOp.Value, Registers);
 		#if 0
 		switch( GetPtrSize( Node->UniOp.Value ) )
 		{
-		//case  8: fprintf(OutFile, "mov BYTE [eax], %s\n", csaRegB[reg]);	break;
-		case 16: fprintf(OutFile, "mov WORD [eax], %s\n", csaRegX[reg]);	break;
-		case 32: fprintf(OutFile, "mov DWORD [eax], %s\n", csaRegEX[reg]);	break;
+		//case  8: AsmOut_Printf(OutFile, "mov BYTE [eax], %s\n", csaRegB[reg]);	break;
+		case 16: AsmOut_Printf(OutFile, "mov WORD [eax], %s\n", csaRegX[reg]);	break;
+		case 32: AsmOut_Printf(OutFile, "mov DWORD [eax], %s\n", csaRegEX[reg]);	break;
 		default: fprintf(stderr, "ARRRGH!!!!\n");	exit(1);
 		}
 		#else
-		fprintf(OutFile, "\tmov DWORD [eax], %s\n", csaRegEX[reg]);
+		AsmOut_Printf(OutFile, "\tmov DWORD [eax], %s\n", csaRegEX[reg]);
 		#endif
 		break;
 	
 	case NODETYPE_SYMBOL:
-		fprintf(OutFile, "\tmov [$%s], eax\n", Node->Symbol.Name);
+		AsmOut_Printf(OutFile, "\tmov [$%s], eax\n", Node->Symbol.Name);
 		break;
 	
 	case NODETYPE_LOCALVAR:
-		fprintf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
+		if( gbVerboseAsm )
+			AsmOut_Printf(OutFile, "\t; NODETYPE_LOCALVAR ('%s')\n", Node->LocalVariable.Sym->Name);
 		if( Node->LocalVariable.Sym->Offset < 0 ) {
 			ofs = -Node->LocalVariable.Sym->Offset + 1;	// [EBP] == OldEBP, [EBP+4] == RetAddr
 		}
@@ -371,9 +428,9 @@ void X86_SaveTo(FILE *OutFile, int CurBPOfs, tAST_Node *Node, uint8_t Registers)
 		ofs *= 4;
 		
 		if(ofs < 0)
-			fprintf(OutFile, "\tmov [ebp-0x%x], eax\n", -ofs);
+			AsmOut_Printf(OutFile, "\tmov [ebp-0x%x], eax\n", -ofs);
 		else
-			fprintf(OutFile, "\tmov [ebp+0x%x], eax\n", ofs);
+			AsmOut_Printf(OutFile, "\tmov [ebp+0x%x], eax\n", ofs);
 		break;
 	
 	default:
@@ -392,7 +449,7 @@ int X86_Int_AllocReg(uint8_t *Registers)
 	for(i = 0; i < 8; i++)
 	{
 		if(*Registers & (1 << i)) {
-			*Registers |= (1 << i);
+			*Registers &= ~(1 << i);
 			return i;
 		}
 	}
@@ -400,3 +457,240 @@ int X86_Int_AllocReg(uint8_t *Registers)
 	exit(1);
 	return 0;
 }
+
+/**
+ * \brief Check if a value can be used directly as the source of an instruction
+ */
+bool X86_int_IsLeafOperand(tAST_Node *Node)
+{
+	switch( Node->Type )
+	{
+	case NODETYPE_INTEGER:
+		return Types_GetSizeOf(AST_GetIntegerType(Node)) <= 4;
+	case NODETYPE_LOCALVAR:
+	case NODETYPE_SYMBOL:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * \brief Emit "<Op> eax, <leaf>" (see X86_int_IsLeafOperand)
+ */
+void X86_int_LeafOp(tAsmOut *OutFile, const char *Op, tAST_Node *Node)
+{
+	 int	ofs;
+	switch( Node->Type )
+	{
+	case NODETYPE_INTEGER:
+		AsmOut_Printf(OutFile, "\t%s eax, 0x%08x\n", Op, (uint32_t)Node->Integer.Value);
+		break;
+	case NODETYPE_LOCALVAR:
+		if( Node->LocalVariable.Sym->Offset < 0 ) {
+			ofs = -Node->LocalVariable.Sym->Offset + 1;	// [EBP] == OldEBP, [EBP+4] == RetAddr
+		}
+		else {
+			ofs = Node->LocalVariable.Sym->Offset - 1;
+		}
+		ofs *= 4;
+		
+		if(ofs < 0)
+			AsmOut_Printf(OutFile, "\t%s eax, [ebp-0x%x]\n", Op, -ofs);
+		else
+			AsmOut_Printf(OutFile, "\t%s eax, [ebp+0x%x]\n", Op, ofs);
+		break;
+	case NODETYPE_SYMBOL:
+		AsmOut_Printf(OutFile, "\t%s eax, [$%s]\n", Op, Node->Symbol.Name);
+		break;
+	default:
+		fprintf(stderr, "X86_int_LeafOp: Node 0x%03x isn't a leaf\n", Node->Type);
+		exit(1);
+	}
+}
+
+/**
+ * \brief Write a "[directive $name]" line
+ * \note Symbols are always written as "$name", in case they are spelt like a register or keyword
+ */
+void X86_int_Directive(tAsmOut *OutFile, const char *Directive, const char *Name)
+{
+	AsmOut_Str(OutFile, "[");
+	AsmOut_Str(OutFile, Directive);
+	AsmOut_Str(OutFile, " $");
+	AsmOut_Str(OutFile, Name);
+	AsmOut_Str(OutFile, "]\n");
+}
+
+// --- Global variables ---
+/**
+ * \brief Section a variable's storage goes in
+ */
+const char *X86_int_DataSection(const tSymbol *Sym)
+{
+	if( Sym->Type->bConst )
+		return ".rodata";
+	if( !Sym->Value )
+		return ".bss";
+	return ".data";
+}
+
+/**
+ * \brief Label, alignment and contents of a global variable
+ */
+void X86_int_EmitVariable(tAsmOut *OutFile, const char *Section, const tSymbol *Sym)
+{
+	size_t	align = Types_GetAlignOf(Sym->Type);
+	if(Sym->Linkage == LINKAGE_GLOBAL)
+		X86_int_Directive(OutFile, "global", Sym->Name);
+	if( align > 1 ) {
+		AsmOut_Str(OutFile, "align ");
+		AsmOut_Int(OutFile, align);
+		AsmOut_Str(OutFile, "\n");
+	}
+	AsmOut_Str(OutFile, "$");
+	AsmOut_Str(OutFile, Sym->Name);
+	if( strcmp(Section, ".bss") == 0 ) {
+		AsmOut_Str(OutFile, ":\tresb ");
+		AsmOut_Int(OutFile, Types_GetSizeOf(Sym->Type));
+		AsmOut_Str(OutFile, "\n");
+		return ;
+	}
+	AsmOut_Str(OutFile, ":\n");
+	X86_int_EmitInit(OutFile, Section, Sym->Type, Sym->Value);
+}
+
+/**
+ * \brief Emit an object initialised from Value (zeroed if NULL)
+ *
+ * The initialiser is evaluated to a byte image by ConstEval, written out as
+ * db lines with the relocations (addresses) as dd/dq in between.
+ */
+void X86_int_EmitInit(tAsmOut *OutFile, const char *Section, const tType *Type, tAST_Node *Value)
+{
+	tConstImage	img;
+	 int	first_str = giX86_StringCount;
+	if( Value && Value->Type == NODETYPE_BLOB && Type->Class == TYPECLASS_ARRAY
+	 && Types_GetSizeOf(Value->Blob.Type) == Types_GetSizeOf(Type->Array.Type) )
+	{
+		X86_int_EmitBlob(OutFile, Type, Value);
+		return ;
+	}
+	if( ConstEval_Initialiser(&img, Type, Value) )
+		exit(1);
+	giX86_StringCount += img.nStrings;
+
+	size_t	ofs = 0;
+	for( int r = 0; r <= img.nRelocs; r ++ )
+	{
+		size_t	end = (r < img.nRelocs ? img.Relocs[r].Offset : img.Size);
+		X86_int_EmitBytes(OutFile, img.Data + ofs, end - ofs);
+		if( r == img.nRelocs )
+			break;
+		const tConstReloc	*rel = &img.Relocs[r];
+		AsmOut_Str(OutFile, (rel->Size == 8 ? "\tdq " : "\tdd "));
+		if( rel->Symbol ) {
+			AsmOut_Str(OutFile, "$");
+			AsmOut_Str(OutFile, rel->Symbol);
+		}
+		else
+			AsmOut_Printf(OutFile, "_str%i", first_str + rel->String);
+		if( rel->Addend > 0 )
+			AsmOut_Str(OutFile, "+");
+		if( rel->Addend )
+			AsmOut_Int(OutFile, rel->Addend);
+		AsmOut_Str(OutFile, "\n");
+		ofs = end + rel->Size;
+	}
+
+	// String literals the object points at
+	if( img.nStrings )
+	{
+		AsmOut_Str(OutFile, "[section .rodata]\n");
+		for( int i = 0; i < img.nStrings; i ++ )
+		{
+			const tAST_Node	*str = img.Strings[i];
+			AsmOut_Printf(OutFile, "_str%i:\n", first_str + i);
+			X86_int_EmitBytes(OutFile, str->String.Data, str->String.Length);
+			AsmOut_Str(OutFile, "\tdb 0\n");
+		}
+		AsmOut_Str(OutFile, "[section ");
+		AsmOut_Str(OutFile, Section);
+		AsmOut_Str(OutFile, "]\n");
+	}
+	ConstEval_FreeImage(&img);
+}
+
+/**
+ * \brief Emit an array initialised by the parser, as one directive of its element size
+ */
+void X86_int_EmitBlob(tAsmOut *OutFile, const tType *Type, tAST_Node *Value)
+{
+	static const char * const	data_dirs[] = {[1] = "\tdb ", [2] = "\tdw ", [4] = "\tdd ", [8] = "\tdq "};
+	const tType	*ele = Value->Blob.Type;
+	size_t	ele_size = Types_GetSizeOf(ele);
+	size_t	size = Types_GetSizeOf(Type);
+	size_t	len = (Value->Blob.Length < size ? Value->Blob.Length : size);
+	const uint8_t	*data = Value->Blob.Data;
+	bool	is_signed = (ele->Class == TYPECLASS_INTEGER && ele->Integer.bSigned);
+
+	// Trailing zeros are left to `times`
+	while( len && data[len-1] == 0 )
+		len --;
+	len = (len + ele_size - 1) / ele_size * ele_size;
+
+	if( len )
+		AsmOut_Str(OutFile, data_dirs[ele_size]);
+	for( size_t ofs = 0; ofs < len; ofs += ele_size )
+	{
+		uint64_t	val = 0;
+		for( size_t j = ele_size; j --; )
+			val = (val << 8) | data[ofs + j];
+		// (printed signed, it reads better)
+		if( is_signed && ele_size < 8 && (val >> (ele_size*8 - 1)) )
+			val -= 1ULL << (ele_size*8);
+		AsmOut_Int(OutFile, val);
+		AsmOut_Str(OutFile, (ofs + ele_size < len ? ", " : "\n"));
+	}
+	X86_int_EmitZeros(OutFile, size - len);
+}
+
+/**
+ * \brief Emit raw bytes, one db per stretch of data (long runs of zero use `times`)
+ */
+void X86_int_EmitBytes(tAsmOut *OutFile, const void *Data, size_t Bytes)
+{
+	const uint8_t	*data = Data;
+	size_t	i = 0;
+	while( i < Bytes )
+	{
+		size_t	zeros = 0;
+		while( i + zeros < Bytes && data[i + zeros] == 0 )
+			zeros ++;
+		if( zeros >= 16 || i + zeros == Bytes ) {
+			X86_int_EmitZeros(OutFile, zeros);
+			i += zeros;
+			continue ;
+		}
+		// Up to the next run of zeros worth using `times` for
+		size_t	end = i;
+		for( zeros = 0; end < Bytes && zeros < 16; end ++ )
+			zeros = (data[end] == 0 ? zeros + 1 : 0);
+		if( zeros == 16 )
+			end -= 16;
+		AsmOut_Str(OutFile, "\tdb ");
+		for( ; i < end; i ++ ) {
+			AsmOut_Int(OutFile, data[i]);
+			AsmOut_Str(OutFile, (i + 1 < end ? ", " : "\n"));
+		}
+	}
+}
+
+void X86_int_EmitZeros(tAsmOut *OutFile, size_t Bytes)
+{
+	if( Bytes == 0 )
+		return ;
+	AsmOut_Str(OutFile, "\ttimes ");
+	AsmOut_Int(OutFile, Bytes);
+	AsmOut_Str(OutFile, " db 0\n");
+}
@@ -0,0 +1,1561 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * output/arch/x86_asm.c
+ * - In-process assembler for the x86 backends
+ *
+ * Assembles the NASM subset emitted by x86.c/x86_irm.c (instructions, labels,
+ * [section]/[global]/[extern]/[bits] and db/dw/dd/times/resb/align) into a
+ * tOutput_Object, so no external assembler is needed. [bits 64] selects
+ * x86-64 (REX prefixes, r8-r15 and [rel sym] RIP-relative addresses) for the
+ * whole file.
+ *
+ * Statements are parsed once, then encoded repeatedly to size the jumps:
+ * every jump starts in its rel8 form and is widened when its target turns out
+ * to be out of range, until nothing changes. A final pass writes the bytes
+ * and relocations. Local labels (".name") are scoped to the preceding
+ * non-local label as in NASM, and are resolved within the section or
+ * relocated against the section symbol. "..@name" labels are local to the
+ * file without opening a new scope. Undefined symbols are treated as
+ * external.
+ */
+#include <global.h>
+#include <symbol.h>
+#include <output.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdarg.h>
+
+// === CONSTANTS ===
+#define ASM_HASH_SIZE	4096
+#define ASM_MAX_OPERANDS	3
+
+// Register flags
+#define ASMREG_LONG	0x1	//!< Only exists in 64-bit mode
+#define ASMREG_REX	0x2	//!< Byte register that needs a REX prefix (spl/bpl/sil/dil)
+#define ASMREG_HIGH	0x4	//!< ah-bh, can't be encoded with a REX prefix
+
+enum eAsmOpdType
+{
+	ASMOPD_NONE,
+	ASMOPD_REG,
+	ASMOPD_MEM,
+	ASMOPD_IMM,
+};
+
+enum eAsmStmtType
+{
+	ASMSTMT_INSN,
+	ASMSTMT_LABEL,
+	ASMSTMT_SECTION,
+	ASMSTMT_DATA,	//!< db/dw/dd/dq
+	ASMSTMT_RESERVE,	//!< resb/resw/resd/resq
+	ASMSTMT_ALIGN,
+};
+
+enum eAsmClass
+{
+	ASMCLS_FIXED,	//!< No operands, Op is the opcode (two bytes if > 0xFF)
+	ASMCLS_ALU,	//!< add/or/adc/sbb/and/sub/xor/cmp, Op is the /n extension
+	ASMCLS_MOV,
+	ASMCLS_TEST,
+	ASMCLS_XCHG,
+	ASMCLS_LEA,
+	ASMCLS_MOVX,	//!< movzx/movsx, Op is the second opcode byte for a byte source
+	ASMCLS_MOVSXD,
+	ASMCLS_IMUL,
+	ASMCLS_UNARY,	//!< F6/F7 group (not/neg/mul/div/idiv)
+	ASMCLS_INCDEC,	//!< FE/FF group
+	ASMCLS_SHIFT,	//!< C0/C1/D0-D3 group
+	ASMCLS_PUSH,
+	ASMCLS_POP,
+	ASMCLS_CALL,
+	ASMCLS_JMP,
+	ASMCLS_JCC,	//!< Op is the condition code
+	ASMCLS_SETCC,
+	ASMCLS_CMOVCC,
+	ASMCLS_RET,
+	ASMCLS_INT,
+};
+
+// === TYPES ===
+typedef struct
+{
+	 int	Sym;	//!< Symbol index (-1 for a plain number)
+	int64_t	Value;
+} tAsmExpr;
+
+typedef struct
+{
+	uint8_t	Type;
+	uint8_t	Size;	//!< Operand size in bytes (0 if not given)
+	int8_t	Reg;	//!< Register, or memory base register (-1 if none)
+	int8_t	Index;	//!< Memory index register (-1 if none)
+	uint8_t	Scale;
+	uint8_t	RegFlags;	//!< ASMREG_* flags of a register operand
+	bool	bRipRel;	//!< [rel disp], relative to the next instruction
+	tAsmExpr	Expr;	//!< Immediate value or memory displacement
+} tAsmOperand;
+
+typedef struct
+{
+	uint8_t	Type;
+	uint8_t	Class;
+	uint8_t	nOpd;
+	bool	bLong;	//!< Jump needs its rel32 form
+	uint8_t	Sect;	//!< Section it was placed in
+	uint16_t	Op;
+	 int	Line;
+	uint32_t	Times;
+	uint32_t	Offset;	//!< Offset in its section (from the last pass)
+	union {
+		tAsmOperand	Opd[ASM_MAX_OPERANDS];
+		 int	Label;	//!< ASMSTMT_LABEL
+		 int	Section;	//!< ASMSTMT_SECTION
+		uint64_t	Count;	//!< ASMSTMT_RESERVE (bytes), ASMSTMT_ALIGN
+		struct {
+			 int	ItemSize;
+			 int	nItems;
+			tAsmExpr	*Items;
+		} Data;
+	};
+} tAsmStmt;
+
+typedef struct
+{
+	char	*Name;
+	 int	Next;	//!< Hash chain
+	 int	Section;	//!< -1 if not (yet) defined
+	uint64_t	Offset;
+	bool	bLocal;	//!< '.' label, resolved without a symbol of its own
+	bool	bGlobal;
+	 int	ObjSym;	//!< Object symbol index (-1 if not created)
+} tAsmSym;
+
+typedef struct
+{
+	tOutput_Object	*Object;
+	 int	Line;
+	const char	*Scope;	//!< Last non-local label
+	 int	Bits;	//!< 32 or 64, from [bits]
+
+	 int	nStmts;
+	 int	StmtSpace;
+	tAsmStmt	*Stmts;
+
+	 int	nSyms;
+	 int	SymSpace;
+	tAsmSym	*Syms;
+	 int	Hash[ASM_HASH_SIZE];
+
+	// Encoding
+	bool	bEmit;	//!< Final pass, write the bytes
+	 int	CurSect;
+	uint64_t	Pos[OUTPUT_MAX_SECTIONS];
+} tAsmState;
+
+typedef struct
+{
+	const char	*Name;
+	uint8_t	Class;
+	uint16_t	Op;
+} tAsmMnemonic;
+
+// === PROTOTYPES ===
+ int	X86_Assemble(const char *Text, size_t Length, tOutput_Object *Object);
+void	Asm_X86_int_Error(tAsmState *State, const char *Fmt, ...);
+void	Asm_X86_int_ParseLine(tAsmState *State, char *Line);
+void	Asm_X86_int_ParseDirective(tAsmState *State, char *Word, char *Arg);
+void	Asm_X86_int_ParseData(tAsmState *State, tAsmStmt *Stmt, int ItemSize, char *Args);
+void	Asm_X86_int_ParseOperand(tAsmState *State, char *Str, tAsmOperand *Opd);
+void	Asm_X86_int_ParseExpr(tAsmState *State, char *Str, tAsmExpr *Expr);
+ int	Asm_X86_int_ParseReg(tAsmState *State, const char *Name, int *Size, int *Flags);
+ int	Asm_X86_int_Symbol(tAsmState *State, const char *Name);
+tAsmStmt	*Asm_X86_int_NewStmt(tAsmState *State, int Type);
+ int	Asm_X86_int_CondCode(const char *Name);
+void	Asm_X86_int_Pass(tAsmState *State);
+void	Asm_X86_int_SetSizes(tAsmState *State);
+void	Asm_X86_int_Statement(tAsmState *State, tAsmStmt *Stmt);
+void	Asm_X86_int_Insn(tAsmState *State, tAsmStmt *Stmt);
+void	Asm_X86_int_Byte(tAsmState *State, uint8_t Byte);
+void	Asm_X86_int_Value(tAsmState *State, const tAsmExpr *Expr, int Size, bool bRelative, bool bBranch);
+void	Asm_X86_int_ModRM(tAsmState *State, int RegField, const tAsmOperand *RM, int ImmSize);
+ int	Asm_X86_int_JumpDisp(tAsmState *State, const tAsmStmt *Stmt, int Size, int64_t *Disp);
+
+// === GLOBALS ===
+const tAsmMnemonic	caX86Mnemonics[] = {
+	{"add", ASMCLS_ALU, 0}, {"or", ASMCLS_ALU, 1}, {"adc", ASMCLS_ALU, 2}, {"sbb", ASMCLS_ALU, 3},
+	{"and", ASMCLS_ALU, 4}, {"sub", ASMCLS_ALU, 5}, {"xor", ASMCLS_ALU, 6}, {"cmp", ASMCLS_ALU, 7},
+	{"mov", ASMCLS_MOV, 0},
+	{"test", ASMCLS_TEST, 0},
+	{"xchg", ASMCLS_XCHG, 0},
+	{"lea", ASMCLS_LEA, 0},
+	{"movzx", ASMCLS_MOVX, 0xB6}, {"movsx", ASMCLS_MOVX, 0xBE}, {"movsxd", ASMCLS_MOVSXD, 0x63},
+	{"imul", ASMCLS_IMUL, 5},
+	{"not", ASMCLS_UNARY, 2}, {"neg", ASMCLS_UNARY, 3}, {"mul", ASMCLS_UNARY, 4},
+	{"div", ASMCLS_UNARY, 6}, {"idiv", ASMCLS_UNARY, 7},
+	{"inc", ASMCLS_INCDEC, 0}, {"dec", ASMCLS_INCDEC, 1},
+	{"rol", ASMCLS_SHIFT, 0}, {"ror", ASMCLS_SHIFT, 1}, {"rcl", ASMCLS_SHIFT, 2}, {"rcr", ASMCLS_SHIFT, 3},
+	{"shl", ASMCLS_SHIFT, 4}, {"sal", ASMCLS_SHIFT, 4}, {"shr", ASMCLS_SHIFT, 5}, {"sar", ASMCLS_SHIFT, 7},
+	{"push", ASMCLS_PUSH, 0}, {"pop", ASMCLS_POP, 0},
+	{"call", ASMCLS_CALL, 0}, {"jmp", ASMCLS_JMP, 0},
+	{"ret", ASMCLS_RET, 0}, {"int", ASMCLS_INT, 0},
+	{"leave", ASMCLS_FIXED, 0xC9}, {"cdq", ASMCLS_FIXED, 0x99}, {"cwde", ASMCLS_FIXED, 0x98},
+	{"nop", ASMCLS_FIXED, 0x90}, {"int3", ASMCLS_FIXED, 0xCC}, {"hlt", ASMCLS_FIXED, 0xF4},
+	{"ud2", ASMCLS_FIXED, 0x0F0B}, {"syscall", ASMCLS_FIXED, 0x0F05},
+	{"cqo", ASMCLS_FIXED, 0x4899}, {"cdqe", ASMCLS_FIXED, 0x4898},	// (REX.W forms)
+};
+#define NUM_X86_MNEMONICS	(sizeof(caX86Mnemonics)/sizeof(caX86Mnemonics[0]))
+
+//! Entrypoint for linked executables (Linux i386: argc/argv on the stack, exit via int 0x80)
+const char	gsX86_StartCode[] =
+	"[section .text]\n"
+	"[global _start]\n"
+	"_start:\n"
+	"\txor ebp, ebp\n"
+	"\tmov eax, [esp]\n"
+	"\tlea ecx, [esp+4]\n"
+	"\tand esp, -16\n"
+	"\tsub esp, 8\n"
+	"\tpush ecx\n"
+	"\tpush eax\n"
+	"\tcall main\n"
+	"\tmov ebx, eax\n"
+	"\tmov eax, 1\n"
+	"\tint 0x80\n"
+	;
+//! Entrypoint for linked x86-64 executables (argc at [rsp], exit via syscall)
+const char	gsX86_64_StartCode[] =
+	"[bits 64]\n"
+	"[section .text]\n"
+	"[global _start]\n"
+	"_start:\n"
+	"\txor ebp, ebp\n"
+	"\tmov rdi, [rsp]\n"
+	"\tlea rsi, [rsp+8]\n"
+	"\tand rsp, -16\n"
+	"\tcall main\n"
+	"\tmov edi, eax\n"
+	"\tmov eax, 60\n"
+	"\tsyscall\n"
+	;
+
+const struct {
+	const char	*Name;
+	 int	Code;
+} caX86AsmCondCodes[] = {
+	{"o", 0}, {"no", 1}, {"b", 2}, {"c", 2}, {"nae", 2}, {"ae", 3}, {"nb", 3}, {"nc", 3},
+	{"e", 4}, {"z", 4}, {"ne", 5}, {"nz", 5}, {"be", 6}, {"na", 6}, {"a", 7}, {"nbe", 7},
+	{"s", 8}, {"ns", 9}, {"p", 10}, {"pe", 10}, {"np", 11}, {"po", 11},
+	{"l", 12}, {"nge", 12}, {"ge", 13}, {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15}, {"nle", 15},
+};
+
+const struct {
+	const char	*Name;
+	 int	Num;
+	 int	Size;
+	 int	Flags;
+} caX86AsmRegs[] = {
+	{"eax", 0, 4}, {"ecx", 1, 4}, {"edx", 2, 4}, {"ebx", 3, 4},
+	{"esp", 4, 4}, {"ebp", 5, 4}, {"esi", 6, 4}, {"edi", 7, 4},
+	{"ax", 0, 2}, {"cx", 1, 2}, {"dx", 2, 2}, {"bx", 3, 2},
+	{"sp", 4, 2}, {"bp", 5, 2}, {"si", 6, 2}, {"di", 7, 2},
+	{"al", 0, 1}, {"cl", 1, 1}, {"dl", 2, 1}, {"bl", 3, 1},
+	{"ah", 4, 1, ASMREG_HIGH}, {"ch", 5, 1, ASMREG_HIGH}, {"dh", 6, 1, ASMREG_HIGH}, {"bh", 7, 1, ASMREG_HIGH},
+	// x86-64
+	{"rax", 0, 8, ASMREG_LONG}, {"rcx", 1, 8, ASMREG_LONG}, {"rdx", 2, 8, ASMREG_LONG}, {"rbx", 3, 8, ASMREG_LONG},
+	{"rsp", 4, 8, ASMREG_LONG}, {"rbp", 5, 8, ASMREG_LONG}, {"rsi", 6, 8, ASMREG_LONG}, {"rdi", 7, 8, ASMREG_LONG},
+	{"spl", 4, 1, ASMREG_LONG|ASMREG_REX}, {"bpl", 5, 1, ASMREG_LONG|ASMREG_REX},
+	{"sil", 6, 1, ASMREG_LONG|ASMREG_REX}, {"dil", 7, 1, ASMREG_LONG|ASMREG_REX},
+	#define X86_ASM_EXTREGS(n)	{"r"#n, n, 8, ASMREG_LONG}, {"r"#n"d", n, 4, ASMREG_LONG}, \
+		{"r"#n"w", n, 2, ASMREG_LONG}, {"r"#n"b", n, 1, ASMREG_LONG}
+	X86_ASM_EXTREGS(8), X86_ASM_EXTREGS(9), X86_ASM_EXTREGS(10), X86_ASM_EXTREGS(11),
+	X86_ASM_EXTREGS(12), X86_ASM_EXTREGS(13), X86_ASM_EXTREGS(14), X86_ASM_EXTREGS(15),
+	#undef X86_ASM_EXTREGS
+};
+
+// === CODE ===
+/**
+ * \brief Assemble x86 NASM-style text into an object
+ */
+int X86_Assemble(const char *Text, size_t Length, tOutput_Object *Object)
+{
+	tAsmState	state = {.Object = Object, .Scope = "", .Bits = 32};
+	memset(state.Hash, -1, sizeof(state.Hash));
+	Object->Bits = 32;
+	Object->Machine = 3;	// EM_386
+
+	// Parse (in a writable copy, split into lines)
+	char	*text = malloc(Length + 1);
+	memcpy(text, Text, Length);
+	text[Length] = '\0';
+	char	*line = text;
+	while( line )
+	{
+		char	*end = strchr(line, '\n');
+		if( end )
+			*end = '\0';
+		state.Line ++;
+		Asm_X86_int_ParseLine(&state, line);
+		line = (end ? end + 1 : NULL);
+	}
+	free(text);
+
+	// Size jumps until nothing needs widening
+	bool	changed;
+	do {
+		Asm_X86_int_Pass(&state);
+		changed = false;
+		for( int i = 0; i < state.nStmts; i ++ )
+		{
+			tAsmStmt	*stmt = &state.Stmts[i];
+			int64_t	disp;
+			if( stmt->Type != ASMSTMT_INSN || stmt->bLong )
+				continue ;
+			if( stmt->Class != ASMCLS_JMP && stmt->Class != ASMCLS_JCC )
+				continue ;
+			if( stmt->Opd[0].Type != ASMOPD_IMM )
+				continue ;
+			if( !Asm_X86_int_JumpDisp(&state, stmt, 2, &disp) || disp < -128 || disp > 127 ) {
+				stmt->bLong = true;
+				changed = true;
+			}
+		}
+	} while( changed );
+
+	// Symbols for the non-local labels (values are final now)
+	for( int i = 0; i < state.nSyms; i ++ )
+	{
+		tAsmSym	*sym = &state.Syms[i];
+		if( sym->bLocal || sym->Section < 0 )
+			continue ;
+		sym->ObjSym = Output_AddSymbol(Object, sym->Name, sym->Section, sym->Offset, sym->bGlobal);
+	}
+
+	state.bEmit = true;
+	Asm_X86_int_Pass(&state);
+	Asm_X86_int_SetSizes(&state);
+
+	for( int i = 0; i < state.nStmts; i ++ )
+	{
+		if( state.Stmts[i].Type == ASMSTMT_DATA )
+			free(state.Stmts[i].Data.Items);
+	}
+	for( int i = 0; i < state.nSyms; i ++ )
+		free(state.Syms[i].Name);
+	free(state.Syms);
+	free(state.Stmts);
+	return 0;
+}
+
+void Asm_X86_int_Error(tAsmState *State, const char *Fmt, ...)
+{
+	va_list	args;
+	va_start(args, Fmt);
+	fprintf(stderr, "ERROR: x86 assembler, line %i: ", State->Line);
+	vfprintf(stderr, Fmt, args);
+	fprintf(stderr, "\n");
+	va_end(args);
+	exit(1);
+}
+
+// --- Parsing ---
+static char *Asm_X86_int_Trim(char *Str)
+{
+	while( isspace(*Str) )
+		Str ++;
+	size_t	len = strlen(Str);
+	while( len > 0 && isspace(Str[len-1]) )
+		Str[--len] = '\0';
+	return Str;
+}
+
+static bool Asm_X86_int_IsIdentChar(char Ch)
+{
+	return isalnum(Ch) || Ch == '_' || Ch == '.' || Ch == '$' || Ch == '?' || Ch == '@' || Ch == '#' || Ch == '~';
+}
+
+/**
+ * \brief Split off the first word of a string
+ * \return Remainder of the string (after whitespace)
+ */
+static char *Asm_X86_int_Word(char *Str)
+{
+	while( *Str && !isspace(*Str) )
+		Str ++;
+	if( *Str ) {
+		*Str++ = '\0';
+		while( isspace(*Str) )
+			Str ++;
+	}
+	return Str;
+}
+
+void Asm_X86_int_ParseLine(tAsmState *State, char *Line)
+{
+	// Strip the comment
+	char	quote = 0;
+	for( char *p = Line; *p; p ++ )
+	{
+		if( quote ) {
+			if( *p == quote )
+				quote = 0;
+		}
+		else if( *p == '"' || *p == '\'' )
+			quote = *p;
+		else if( *p == ';' ) {
+			*p = '\0';
+			break;
+		}
+	}
+	Line = Asm_X86_int_Trim(Line);
+	if( !*Line )
+		return ;
+
+	if( *Line == '[' )
+	{
+		char	*end = strchr(Line, ']');
+		if( !end )
+			Asm_X86_int_Error(State, "Missing ']'");
+		*end = '\0';
+		Line = Asm_X86_int_Trim(Line + 1);
+		char	*arg = Asm_X86_int_Word(Line);
+		Asm_X86_int_ParseDirective(State, Line, arg);
+		return ;
+	}
+
+	// Label
+	char	*p = Line;
+	while( Asm_X86_int_IsIdentChar(*p) )
+		p ++;
+	if( *p == ':' && p != Line )
+	{
+		*p = '\0';
+		tAsmStmt	*stmt = Asm_X86_int_NewStmt(State, ASMSTMT_LABEL);
+		const char	*name = (*Line == '$' ? Line + 1 : Line);
+		 int	sym = Asm_X86_int_Symbol(State, name);
+		if( *name != '.' )
+			State->Scope = State->Syms[sym].Name;
+		if( State->Syms[sym].Section >= 0 )
+			Asm_X86_int_Error(State, "'%s' redefined", State->Syms[sym].Name);
+		// (The section is set by the passes, this marks it as defined)
+		State->Syms[sym].Section = 0;
+		stmt->Label = sym;
+		Line = Asm_X86_int_Trim(p + 1);
+		if( !*Line )
+			return ;
+	}
+
+	uint32_t	times = 1;
+	char	*args = Asm_X86_int_Word(Line);
+	if( strcasecmp(Line, "times") == 0 )
+	{
+		char	*end;
+		times = strtoul(args, &end, 0);
+		if( end == args )
+			Asm_X86_int_Error(State, "Bad 'times' count");
+		Line = Asm_X86_int_Trim(end);
+		args = Asm_X86_int_Word(Line);
+	}
+
+	static const char	*data_dirs[] = {"db", "dw", "dd", "dq"};
+	static const char	*res_dirs[] = {"resb", "resw", "resd", "resq"};
+	for( int i = 0; i < 4; i ++ )
+	{
+		if( strcasecmp(Line, data_dirs[i]) == 0 ) {
+			tAsmStmt	*stmt = Asm_X86_int_NewStmt(State, ASMSTMT_DATA);
+			stmt->Times = times;
+			Asm_X86_int_ParseData(State, stmt, 1 << i, args);
+			return ;
+		}
+		if( strcasecmp(Line, res_dirs[i]) == 0 ) {
+			tAsmStmt	*stmt = Asm_X86_int_NewStmt(State, ASMSTMT_RESERVE);
+			stmt->Times = times;
+			stmt->Count = strtoull(args, NULL, 0) << i;
+			return ;
+		}
+	}
+	if( strcasecmp(Line, "align") == 0 ) {
+		tAsmStmt	*stmt = Asm_X86_int_NewStmt(State, ASMSTMT_ALIGN);
+		stmt->Count = strtoull(args, NULL, 0);
+		if( stmt->Count == 0 || (stmt->Count & (stmt->Count - 1)) )
+			Asm_X86_int_Error(State, "Alignment must be a power of two");
+		return ;
+	}
+	if( strcasecmp(Line, "section") == 0 || strcasecmp(Line, "segment") == 0
+	 || strcasecmp(Line, "global") == 0 || strcasecmp(Line, "extern") == 0 || strcasecmp(Line, "bits") == 0 )
+	{
+		Asm_X86_int_ParseDirective(State, Line, args);
+		return ;
+	}
+
+	// Instruction
+	tAsmStmt	*stmt = Asm_X86_int_NewStmt(State, ASMSTMT_INSN);
+	stmt->Times = times;
+	for( char *c = Line; *c; c ++ )
+		*c = tolower(*c);
+	const tAsmMnemonic	*mn = NULL;
+	for( int i = 0; i < NUM_X86_MNEMONICS; i ++ )
+	{
+		if( strcmp(caX86Mnemonics[i].Name, Line) == 0 ) {
+			mn = &caX86Mnemonics[i];
+			break;
+		}
+	}
+	if( mn ) {
+		stmt->Class = mn->Class;
+		stmt->Op = mn->Op;
+	}
+	else if( Line[0] == 'j' && Asm_X86_int_CondCode(Line+1) >= 0 ) {
+		stmt->Class = ASMCLS_JCC;
+		stmt->Op = Asm_X86_int_CondCode(Line+1);
+	}
+	else if( strncmp(Line, "set", 3) == 0 && Asm_X86_int_CondCode(Line+3) >= 0 ) {
+		stmt->Class = ASMCLS_SETCC;
+		stmt->Op = Asm_X86_int_CondCode(Line+3);
+	}
+	else if( strncmp(Line, "cmov", 4) == 0 && Asm_X86_int_CondCode(Line+4) >= 0 ) {
+		stmt->Class = ASMCLS_CMOVCC;
+		stmt->Op = Asm_X86_int_CondCode(Line+4);
+	}
+	else
+		Asm_X86_int_Error(State, "Unknown instruction '%s'", Line);
+
+	// Operands
+	while( *args )
+	{
+		char	*comma = strchr(args, ',');
+		if( comma )
+			*comma = '\0';
+		if( stmt->nOpd == ASM_MAX_OPERANDS )
+			Asm_X86_int_Error(State, "Too many operands");
+		Asm_X86_int_ParseOperand(State, args, &stmt->Opd[stmt->nOpd++]);
+		if( !comma )
+			break;
+		args = comma + 1;
+	}
+}
+
+void Asm_X86_int_ParseDirective(tAsmState *State, char *Word, char *Arg)
+{
+	Arg = Asm_X86_int_Trim(Arg);
+	if( strcasecmp(Word, "bits") == 0 ) {
+		 int	bits = strtol(Arg, NULL, 0);
+		if( bits != 32 && bits != 64 )
+			Asm_X86_int_Error(State, "Only 32-bit and 64-bit code is supported");
+		if( bits != State->Bits && State->nStmts > 0 )
+			Asm_X86_int_Error(State, "[bits] can only be changed before any code");
+		State->Bits = bits;
+		State->Object->Bits = bits;
+		State->Object->Machine = (bits == 64 ? 62 : 3);	// EM_X86_64 / EM_386
+	}
+	else if( strcasecmp(Word, "section") == 0 || strcasecmp(Word, "segment") == 0 ) {
+		Asm_X86_int_Word(Arg);	// (attributes are ignored)
+		tAsmStmt	*stmt = Asm_X86_int_NewStmt(State, ASMSTMT_SECTION);
+		stmt->Section = Output_AddSection(State->Object, Arg);
+	}
+	else if( strcasecmp(Word, "global") == 0 ) {
+		 int	sym = Asm_X86_int_Symbol(State, (*Arg == '$' ? Arg + 1 : Arg));
+		State->Syms[sym].bGlobal = true;
+	}
+	else if( strcasecmp(Word, "extern") == 0 ) {
+		// Undefined symbols are external anyway
+	}
+	else
+		Asm_X86_int_Error(State, "Unknown directive '%s'", Word);
+}
+
+/**
+ * \brief Parse a comma separated list of values (and strings for db)
+ */
+void Asm_X86_int_ParseData(tAsmState *State, tAsmStmt *Stmt, int ItemSize, char *Args)
+{
+	 int	space = 0;
+	Stmt->Data.ItemSize = ItemSize;
+	Stmt->Data.nItems = 0;
+	Stmt->Data.Items = NULL;
+	while( *Args )
+	{
+		char	*item = Args;
+		char	quote = 0;
+		while( *Args && (quote || *Args != ',') )
+		{
+			if( quote ) {
+				if( *Args == quote )
+					quote = 0;
+			}
+			else if( *Args == '"' || *Args == '\'' )
+				quote = *Args;
+			Args ++;
+		}
+		if( *Args )
+			*Args++ = '\0';
+		item = Asm_X86_int_Trim(item);
+
+		size_t	len = strlen(item);
+		 int	count = 1;
+		if( *item == '"' || *item == '\'' ) {
+			if( len < 2 || item[len-1] != item[0] )
+				Asm_X86_int_Error(State, "Unterminated string");
+			count = len - 2;
+		}
+		if( Stmt->Data.nItems + count > space ) {
+			space = (Stmt->Data.nItems + count) * 2;
+			Stmt->Data.Items = realloc(Stmt->Data.Items, space * sizeof(tAsmExpr));
+		}
+		if( *item == '"' || *item == '\'' ) {
+			for( int i = 0; i < count; i ++ )
+				Stmt->Data.Items[Stmt->Data.nItems++] = (tAsmExpr){-1, (uint8_t)item[1+i]};
+		}
+		else
+			Asm_X86_int_ParseExpr(State, item, &Stmt->Data.Items[Stmt->Data.nItems++]);
+	}
+}
+
+void Asm_X86_int_ParseOperand(tAsmState *State, char *Str, tAsmOperand *Opd)
+{
+	static const char	*size_names[] = {"byte", "word", "dword", "qword"};
+	Str = Asm_X86_int_Trim(Str);
+	memset(Opd, 0, sizeof(*Opd));
+	Opd->Reg = -1;
+	Opd->Index = -1;
+	Opd->Expr.Sym = -1;
+
+	// Size/distance keywords
+	for( ;; )
+	{
+		char	*rest = Str;
+		while( isalpha(*rest) )
+			rest ++;
+		if( !*rest || !(isspace(*rest) || *rest == '[') )
+			break;
+		 int	len = rest - Str;
+		bool	found = false;
+		for( int i = 0; i < 4; i ++ )
+		{
+			if( strlen(size_names[i]) == len && strncasecmp(Str, size_names[i], len) == 0 ) {
+				Opd->Size = 1 << i;
+				found = true;
+			}
+		}
+		if( (len == 5 && strncasecmp(Str, "short", 5) == 0) || (len == 4 && strncasecmp(Str, "near", 4) == 0) )
+			found = true;
+		if( !found )
+			break;
+		Str = Asm_X86_int_Trim(rest);
+	}
+
+	if( *Str == '[' )
+	{
+		char	*end = strchr(Str, ']');
+		if( !end )
+			Asm_X86_int_Error(State, "Missing ']'");
+		*end = '\0';
+		Opd->Type = ASMOPD_MEM;
+		Opd->Scale = 1;
+		Opd->Expr.Value = 0;
+
+		// Terms of the address
+		char	*p = Asm_X86_int_Trim(Str + 1);
+		if( strncasecmp(p, "rel", 3) == 0 && isspace(p[3]) ) {
+			if( State->Bits != 64 )
+				Asm_X86_int_Error(State, "RIP-relative addresses need 64-bit mode");
+			Opd->bRipRel = true;
+			p += 4;
+		}
+		while( *p )
+		{
+			 int	sign = 1;
+			while( isspace(*p) || *p == '+' || *p == '-' ) {
+				if( *p == '-' )
+					sign = -sign;
+				p ++;
+			}
+			char	*term = p;
+			while( *p && *p != '+' && *p != '-' )
+				p ++;
+			char	saved = *p;
+			*p = '\0';
+			term = Asm_X86_int_Trim(term);
+
+			 int	size, flags, reg, scale = 1;
+			 int	addr_size = State->Bits / 8;
+			char	*star = strchr(term, '*');
+			if( star ) {
+				*star = '\0';
+				char	*a = Asm_X86_int_Trim(term), *b = Asm_X86_int_Trim(star + 1);
+				if( (reg = Asm_X86_int_ParseReg(State, a, &size, &flags)) >= 0 )
+					scale = strtol(b, NULL, 0);
+				else {
+					reg = Asm_X86_int_ParseReg(State, b, &size, &flags);
+					scale = strtol(a, NULL, 0);
+				}
+				if( reg < 0 || sign < 0 || size != addr_size || (scale != 1 && scale != 2 && scale != 4 && scale != 8) || Opd->Index >= 0 )
+					Asm_X86_int_Error(State, "Bad scaled index '%s*%s'", a, b);
+				Opd->Index = reg;
+				Opd->Scale = scale;
+			}
+			else if( (reg = Asm_X86_int_ParseReg(State, term, &size, &flags)) >= 0 ) {
+				if( sign < 0 || size != addr_size )
+					Asm_X86_int_Error(State, "Bad address register '%s'", term);
+				if( Opd->Reg < 0 )
+					Opd->Reg = reg;
+				else if( Opd->Index < 0 )
+					Opd->Index = reg;
+				else
+					Asm_X86_int_Error(State, "Too many registers in address");
+			}
+			else {
+				tAsmExpr	e;
+				Asm_X86_int_ParseExpr(State, term, &e);
+				if( e.Sym >= 0 ) {
+					if( Opd->Expr.Sym >= 0 || sign < 0 )
+						Asm_X86_int_Error(State, "Can't relocate '%s'", term);
+					Opd->Expr.Sym = e.Sym;
+				}
+				Opd->Expr.Value += sign * e.Value;
+			}
+			*p = saved;
+		}
+		if( Opd->bRipRel && (Opd->Reg >= 0 || Opd->Index >= 0) )
+			Asm_X86_int_Error(State, "RIP-relative addresses can't use registers");
+		if( Opd->Index == 4 ) {
+			// esp can't be an index, swap it with the base if possible
+			if( Opd->Scale != 1 || Opd->Reg == 4 )
+				Asm_X86_int_Error(State, "esp can't be an index register");
+			Opd->Index = Opd->Reg;
+			Opd->Reg = 4;
+		}
+		return ;
+	}
+
+	 int	size, flags;
+	 int	reg = Asm_X86_int_ParseReg(State, Str, &size, &flags);
+	if( reg >= 0 ) {
+		Opd->Type = ASMOPD_REG;
+		Opd->Reg = reg;
+		Opd->Size = size;
+		Opd->RegFlags = flags;
+		return ;
+	}
+
+	Opd->Type = ASMOPD_IMM;
+	Asm_X86_int_ParseExpr(State, Str, &Opd->Expr);
+}
+
+/**
+ * \brief Parse [symbol] [(+|-) number]... (or a number on its own)
+ */
+void Asm_X86_int_ParseExpr(tAsmState *State, char *Str, tAsmExpr *Expr)
+{
+	Expr->Sym = -1;
+	Expr->Value = 0;
+	char	*p = Asm_X86_int_Trim(Str);
+	if( !*p )
+		Asm_X86_int_Error(State, "Missing value");
+	while( *p )
+	{
+		 int	sign = 1;
+		while( isspace(*p) || *p == '+' || *p == '-' ) {
+			if( *p == '-' )
+				sign = -sign;
+			p ++;
+		}
+		if( isdigit(*p) ) {
+			char	*end;
+			Expr->Value += sign * (int64_t)strtoull(p, &end, 0);
+			p = end;
+		}
+		else if( *p == '\'' && p[1] && p[2] == '\'' ) {
+			Expr->Value += sign * (uint8_t)p[1];
+			p += 3;
+		}
+		else if( Asm_X86_int_IsIdentChar(*p) ) {
+			char	*start = (*p == '$' ? p + 1 : p);
+			char	*end = start;
+			while( Asm_X86_int_IsIdentChar(*end) )
+				end ++;
+			char	saved = *end;
+			*end = '\0';
+			if( Expr->Sym >= 0 || sign < 0 )
+				Asm_X86_int_Error(State, "Can't relocate '%s'", start);
+			Expr->Sym = Asm_X86_int_Symbol(State, start);
+			*end = saved;
+			p = end;
+		}
+		else
+			Asm_X86_int_Error(State, "Unexpected '%c' in expression", *p);
+		while( isspace(*p) )
+			p ++;
+	}
+}
+
+int Asm_X86_int_ParseReg(tAsmState *State, const char *Name, int *Size, int *Flags)
+{
+	for( int i = 0; i < sizeof(caX86AsmRegs)/sizeof(caX86AsmRegs[0]); i ++ )
+	{
+		if( strcasecmp(caX86AsmRegs[i].Name, Name) == 0 ) {
+			if( (caX86AsmRegs[i].Flags & ASMREG_LONG) && State->Bits != 64 )
+				Asm_X86_int_Error(State, "'%s' needs 64-bit mode", Name);
+			*Size = caX86AsmRegs[i].Size;
+			*Flags = caX86AsmRegs[i].Flags;
+			return caX86AsmRegs[i].Num;
+		}
+	}
+	return -1;
+}
+
+int Asm_X86_int_CondCode(const char *Name)
+{
+	for( int i = 0; i < sizeof(caX86AsmCondCodes)/sizeof(caX86AsmCondCodes[0]); i ++ )
+	{
+		if( strcmp(caX86AsmCondCodes[i].Name, Name) == 0 )
+			return caX86AsmCondCodes[i].Code;
+	}
+	return -1;
+}
+
+/**
+ * \brief Look up (or create) a symbol, qualifying local labels with their scope
+ */
+int Asm_X86_int_Symbol(tAsmState *State, const char *Name)
+{
+	char	*full = NULL;
+	bool	local = (*Name == '.');
+	// "..@name" labels are global to the file but don't open a new scope
+	if( local && strncmp(Name, "..@", 3) != 0 ) {
+		full = malloc(strlen(State->Scope) + strlen(Name) + 1);
+		strcpy(full, State->Scope);
+		strcat(full, Name);
+		Name = full;
+	}
+
+	uint32_t	hash = 5381;
+	for( const char *p = Name; *p; p ++ )
+		hash = hash * 33 + (uint8_t)*p;
+	hash %= ASM_HASH_SIZE;
+	for( int i = State->Hash[hash]; i != -1; i = State->Syms[i].Next )
+	{
+		if( strcmp(State->Syms[i].Name, Name) == 0 ) {
+			free(full);
+			return i;
+		}
+	}
+
+	if( State->nSyms + 1 > State->SymSpace ) {
+		State->SymSpace = State->SymSpace * 2 + 64;
+		State->Syms = realloc(State->Syms, State->SymSpace * sizeof(tAsmSym));
+	}
+	tAsmSym	*sym = &State->Syms[State->nSyms];
+	sym->Name = (full ? full : strdup(Name));
+	sym->Section = -1;
+	sym->Offset = 0;
+	sym->bLocal = local;
+	sym->bGlobal = false;
+	sym->ObjSym = -1;
+	sym->Next = State->Hash[hash];
+	State->Hash[hash] = State->nSyms;
+	return State->nSyms ++;
+}
+
+tAsmStmt *Asm_X86_int_NewStmt(tAsmState *State, int Type)
+{
+	if( State->nStmts + 1 > State->StmtSpace ) {
+		State->StmtSpace = State->StmtSpace * 2 + 256;
+		State->Stmts = realloc(State->Stmts, State->StmtSpace * sizeof(tAsmStmt));
+	}
+	tAsmStmt	*stmt = &State->Stmts[State->nStmts++];
+	memset(stmt, 0, sizeof(*stmt));
+	stmt->Type = Type;
+	stmt->Line = State->Line;
+	stmt->Times = 1;
+	return stmt;
+}
+
+// --- Encoding ---
+/**
+ * \brief Encode every statement (writing the output on the final pass)
+ */
+void Asm_X86_int_Pass(tAsmState *State)
+{
+	memset(State->Pos, 0, sizeof(State->Pos));
+	State->CurSect = -1;
+	for( int i = 0; i < State->nStmts; i ++ )
+	{
+		tAsmStmt	*stmt = &State->Stmts[i];
+		State->Line = stmt->Line;
+		if( stmt->Type == ASMSTMT_SECTION ) {
+			State->CurSect = stmt->Section;
+			continue ;
+		}
+		if( State->CurSect < 0 )
+			State->CurSect = Output_AddSection(State->Object, ".text");
+		stmt->Sect = State->CurSect;
+		stmt->Offset = State->Pos[State->CurSect];
+		for( uint32_t t = 0; t < stmt->Times; t ++ )
+			Asm_X86_int_Statement(State, stmt);
+	}
+}
+
+/**
+ * \brief Set the sizes of the non-local labels' symbols (after the final pass)
+ *
+ * A label covers what follows it in its section, up to the next label that
+ * isn't one of its own local labels. Alignment padding before that label
+ * isn't counted.
+ */
+void Asm_X86_int_SetSizes(tAsmState *State)
+{
+	 int	nsect = State->Object->nSections;
+	 int	open[OUTPUT_MAX_SECTIONS];	// Label being sized (-1 for none)
+	uint64_t	end[OUTPUT_MAX_SECTIONS];	// End of its contents so far
+	bool	in_data[OUTPUT_MAX_SECTIONS];	// Last statement was code/data (it ends where the next one starts)
+	for( int s = 0; s < nsect; s ++ ) {
+		open[s] = -1;
+		in_data[s] = false;
+	}
+	// (one more iteration, with no statement, closes every section)
+	for( int i = 0; i <= State->nStmts; i ++ )
+	{
+		const tAsmStmt	*stmt = (i < State->nStmts ? &State->Stmts[i] : NULL);
+		if( stmt && stmt->Type == ASMSTMT_SECTION )
+			continue ;
+		for( int s = (stmt ? stmt->Sect : 0); s < (stmt ? stmt->Sect + 1 : nsect); s ++ )
+		{
+			if( in_data[s] )
+				end[s] = (stmt ? stmt->Offset : State->Pos[s]);
+			in_data[s] = stmt && (stmt->Type == ASMSTMT_INSN || stmt->Type == ASMSTMT_DATA || stmt->Type == ASMSTMT_RESERVE);
+			if( stmt && stmt->Type != ASMSTMT_LABEL )
+				continue ;
+			const tAsmSym	*label = (stmt ? &State->Syms[stmt->Label] : NULL);
+			if( label && label->bLocal && open[s] >= 0 ) {
+				const char	*scope = State->Syms[open[s]].Name;
+				size_t	len = strlen(scope);
+				if( strncmp(label->Name, scope, len) == 0 && label->Name[len] == '.' )
+					continue ;
+			}
+			if( open[s] >= 0 ) {
+				const tAsmSym	*sym = &State->Syms[open[s]];
+				State->Object->Symbols[sym->ObjSym].Size = (end[s] > sym->Offset ? end[s] - sym->Offset : 0);
+			}
+			open[s] = (label && !label->bLocal ? stmt->Label : -1);
+			end[s] = (label ? label->Offset : 0);
+		}
+	}
+}
+
+void Asm_X86_int_Statement(tAsmState *State, tAsmStmt *Stmt)
+{
+	tOutput_Section	*sect = &State->Object->Sections[State->CurSect];
+	switch( Stmt->Type )
+	{
+	case ASMSTMT_LABEL:
+		State->Syms[Stmt->Label].Section = State->CurSect;
+		State->Syms[Stmt->Label].Offset = State->Pos[State->CurSect];
+		break;
+	case ASMSTMT_DATA:
+		for( int i = 0; i < Stmt->Data.nItems; i ++ )
+			Asm_X86_int_Value(State, &Stmt->Data.Items[i], Stmt->Data.ItemSize, false, false);
+		break;
+	case ASMSTMT_RESERVE:
+		for( uint64_t i = 0; i < Stmt->Count; i ++ )
+			Asm_X86_int_Byte(State, 0);
+		break;
+	case ASMSTMT_ALIGN:
+		if( Stmt->Count > sect->Align )
+			sect->Align = Stmt->Count;
+		while( State->Pos[State->CurSect] % Stmt->Count )
+			Asm_X86_int_Byte(State, sect->bExecutable ? 0x90 : 0);
+		break;
+	case ASMSTMT_INSN:
+		Asm_X86_int_Insn(State, Stmt);
+		break;
+	}
+}
+
+void Asm_X86_int_Byte(tAsmState *State, uint8_t Byte)
+{
+	tOutput_Section	*sect = &State->Object->Sections[State->CurSect];
+	State->Pos[State->CurSect] ++;
+	if( !State->bEmit )
+		return ;
+	if( sect->bNoBits )
+		sect->CodeLength ++;
+	else
+		Output_AppendCode(sect, Byte);
+}
+
+/**
+ * \brief Emit a value, relocated if it refers to a symbol
+ * \param bRelative	Value is relative to the end of the field (jumps/calls, RIP-relative operands)
+ * \param bBranch	Field is a call/jmp target
+ */
+void Asm_X86_int_Value(tAsmState *State, const tAsmExpr *Expr, int Size, bool bRelative, bool bBranch)
+{
+	int64_t	value = Expr->Value;
+	if( Expr->Sym >= 0 )
+	{
+		tAsmSym	*sym = &State->Syms[Expr->Sym];
+		if( Size != 4 && Size != 8 )
+			Asm_X86_int_Error(State, "'%s' can't be used in a %i byte field", sym->Name, Size);
+		if( bRelative && sym->Section == State->CurSect ) {
+			// Resolved here
+			value += sym->Offset - (State->Pos[State->CurSect] + Size);
+		}
+		else if( State->bEmit ) {
+			 int	objsym = sym->ObjSym;
+			if( sym->bLocal ) {
+				if( sym->Section < 0 )
+					Asm_X86_int_Error(State, "Undefined label '%s'", sym->Name);
+				// Local labels are relocated against their section's symbol
+				objsym = -1;
+				for( int i = 0; i < State->Object->nSymbols && objsym < 0; i ++ )
+				{
+					if( State->Object->Symbols[i].bSection && State->Object->Symbols[i].Section == sym->Section )
+						objsym = i;
+				}
+				value += sym->Offset;
+			}
+			else if( objsym < 0 )
+				objsym = sym->ObjSym = Output_AddSymbol(State->Object, sym->Name, -1, 0, true);
+			if( bRelative )
+				value -= Size;
+			Output_AppendReloc(&State->Object->Sections[State->CurSect], Size * 8, bRelative, bBranch, value, objsym);
+			State->Pos[State->CurSect] += Size;
+			return ;
+		}
+	}
+	else if( bRelative )
+		Asm_X86_int_Error(State, "Jump to an absolute address");
+	for( int i = 0; i < Size; i ++ )
+		Asm_X86_int_Byte(State, (value >> (i*8)) & 0xFF);
+}
+
+/**
+ * \brief Emit a ModR/M byte (and SIB/displacement) for a register or memory operand
+ * \param ImmSize	Size of the immediate following the operand (RIP-relative displacements skip it)
+ */
+void Asm_X86_int_ModRM(tAsmState *State, int RegField, const tAsmOperand *RM, int ImmSize)
+{
+	RegField &= 7;
+	if( RM->Type == ASMOPD_REG ) {
+		Asm_X86_int_Byte(State, 0xC0 | (RegField << 3) | (RM->Reg & 7));
+		return ;
+	}
+	if( RM->Type != ASMOPD_MEM )
+		Asm_X86_int_Error(State, "Expected a register or memory operand");
+
+	 int	base = RM->Reg, index = RM->Index;
+	const tAsmExpr	*disp = &RM->Expr;
+	if( RM->bRipRel ) {
+		tAsmExpr	rel = *disp;
+		rel.Value -= ImmSize;
+		Asm_X86_int_Byte(State, (RegField << 3) | 5);
+		Asm_X86_int_Value(State, &rel, 4, true, false);
+		return ;
+	}
+	if( base < 0 && index < 0 ) {
+		if( State->Bits == 64 ) {
+			// (mod=00 rm=101 is RIP-relative, absolute addresses need a SIB)
+			Asm_X86_int_Byte(State, (RegField << 3) | 4);
+			Asm_X86_int_Byte(State, 0x25);
+		}
+		else
+			Asm_X86_int_Byte(State, (RegField << 3) | 5);
+		Asm_X86_int_Value(State, disp, 4, false, false);
+		return ;
+	}
+
+	 int	mod;
+	if( base < 0 )
+		mod = 0;	// (index only, always disp32)
+	else if( disp->Sym >= 0 || disp->Value < -128 || disp->Value > 127 )
+		mod = 2;
+	else if( disp->Value != 0 || (base & 7) == 5 )
+		mod = 1;
+	else
+		mod = 0;
+
+	if( index >= 0 || (base & 7) == 4 )
+	{
+		static const uint8_t	scale_bits[9] = {0, 0, 1, 0, 2, 0, 0, 0, 3};
+		Asm_X86_int_Byte(State, (mod << 6) | (RegField << 3) | 4);
+		Asm_X86_int_Byte(State, (scale_bits[RM->Scale] << 6) | ((index >= 0 ? index & 7 : 4) << 3) | (base >= 0 ? base & 7 : 5));
+	}
+	else
+		Asm_X86_int_Byte(State, (mod << 6) | (RegField << 3) | (base & 7));
+
+	if( base < 0 || mod == 2 )
+		Asm_X86_int_Value(State, disp, 4, false, false);
+	else if( mod == 1 )
+		Asm_X86_int_Byte(State, disp->Value & 0xFF);
+}
+
+/**
+ * \brief Get the displacement of a jump in its short (Size = 2) or long form
+ * \return false if the target isn't in the same section
+ */
+int Asm_X86_int_JumpDisp(tAsmState *State, const tAsmStmt *Stmt, int Size, int64_t *Disp)
+{
+	const tAsmExpr	*target = &Stmt->Opd[0].Expr;
+	if( target->Sym < 0 )
+		return 0;
+	const tAsmSym	*sym = &State->Syms[target->Sym];
+	if( sym->Section != Stmt->Sect )
+		return 0;
+	*Disp = sym->Offset + target->Value - (Stmt->Offset + Size);
+	return 1;
+}
+
+static bool Asm_X86_int_IsAbsolute(const tAsmOperand *Opd)
+{
+	return Opd->Type == ASMOPD_MEM && Opd->Reg < 0 && Opd->Index < 0 && !Opd->bRipRel;
+}
+
+static bool Asm_X86_int_FitsInt8(const tAsmExpr *Expr)
+{
+	return Expr->Sym < 0 && Expr->Value >= -128 && Expr->Value <= 127;
+}
+
+static bool Asm_X86_int_FitsInt32(const tAsmExpr *Expr)
+{
+	return Expr->Sym >= 0 || (Expr->Value >= INT32_MIN && Expr->Value <= INT32_MAX);
+}
+
+/**
+ * \brief Operand size of an instruction (from its register or size keyword operands)
+ */
+static int Asm_X86_int_OpSize(tAsmState *State, const tAsmStmt *Stmt, int nOpds)
+{
+	 int	size = 0;
+	for( int i = 0; i < nOpds; i ++ )
+	{
+		const tAsmOperand	*opd = &Stmt->Opd[i];
+		if( opd->Type == ASMOPD_IMM || opd->Size == 0 )
+			continue ;
+		if( size && opd->Size != size )
+			Asm_X86_int_Error(State, "Mismatched operand sizes");
+		size = opd->Size;
+	}
+	if( size == 0 )
+		Asm_X86_int_Error(State, "Operation size not specified");
+	if( size == 8 && State->Bits != 64 )
+		Asm_X86_int_Error(State, "64-bit operands need 64-bit mode");
+	return size;
+}
+
+/**
+ * \brief Emit the operand size and REX prefixes
+ * \param Reg	Operand in the ModR/M reg field (or NULL)
+ * \param RM	Operand in the ModR/M r/m field, or the register added to the opcode (or NULL)
+ */
+static void Asm_X86_int_Prefix(tAsmState *State, int Size, const tAsmOperand *Reg, const tAsmOperand *RM)
+{
+	uint8_t	rex = (Size == 8 ? 0x08 : 0);	// REX.W
+	bool	need_rex = false, no_rex = false;
+	if( Size == 2 )
+		Asm_X86_int_Byte(State, 0x66);
+	if( Reg && Reg->Type == ASMOPD_REG ) {
+		if( Reg->Reg & 8 )
+			rex |= 0x04;	// REX.R
+		need_rex |= !!(Reg->RegFlags & ASMREG_REX);
+		no_rex |= !!(Reg->RegFlags & ASMREG_HIGH);
+	}
+	if( RM && RM->Type == ASMOPD_REG ) {
+		if( RM->Reg & 8 )
+			rex |= 0x01;	// REX.B
+		need_rex |= !!(RM->RegFlags & ASMREG_REX);
+		no_rex |= !!(RM->RegFlags & ASMREG_HIGH);
+	}
+	else if( RM && RM->Type == ASMOPD_MEM ) {
+		if( RM->Index >= 8 )
+			rex |= 0x02;	// REX.X
+		if( RM->Reg >= 8 )
+			rex |= 0x01;
+	}
+	if( !rex && !need_rex )
+		return ;
+	if( no_rex )
+		Asm_X86_int_Error(State, "ah-bh can't be used with 64-bit registers");
+	Asm_X86_int_Byte(State, 0x40 | rex);
+}
+
+/**
+ * \brief Emit an immediate operand (64-bit operations take a sign extended imm32)
+ */
+static void Asm_X86_int_Imm(tAsmState *State, const tAsmExpr *Expr, int Size)
+{
+	if( Size == 8 ) {
+		if( !Asm_X86_int_FitsInt32(Expr) )
+			Asm_X86_int_Error(State, "Immediate doesn't fit in 32 bits");
+		Size = 4;
+	}
+	Asm_X86_int_Value(State, Expr, Size, false, false);
+}
+
+static void Asm_X86_int_Expect(tAsmState *State, const tAsmStmt *Stmt, int nOpd, uint8_t Type0, uint8_t Type1)
+{
+	if( Stmt->nOpd != nOpd )
+		Asm_X86_int_Error(State, "Expected %i operands", nOpd);
+	if( Type0 != ASMOPD_NONE && Stmt->Opd[0].Type != Type0 )
+		Asm_X86_int_Error(State, "Invalid first operand");
+	if( Type1 != ASMOPD_NONE && Stmt->Opd[1].Type != Type1 )
+		Asm_X86_int_Error(State, "Invalid second operand");
+}
+
+void Asm_X86_int_Insn(tAsmState *State, tAsmStmt *Stmt)
+{
+	const tAsmOperand	*a = &Stmt->Opd[0], *b = &Stmt->Opd[1];
+	 int	size, imm_size;
+	int64_t	disp;
+	switch( Stmt->Class )
+	{
+	case ASMCLS_FIXED:
+		Asm_X86_int_Expect(State, Stmt, 0, ASMOPD_NONE, ASMOPD_NONE);
+		if( (Stmt->Op >> 8) == 0x48 && State->Bits != 64 )
+			Asm_X86_int_Error(State, "Instruction needs 64-bit mode");
+		if( Stmt->Op > 0xFF )
+			Asm_X86_int_Byte(State, Stmt->Op >> 8);
+		Asm_X86_int_Byte(State, Stmt->Op & 0xFF);
+		break;
+	case ASMCLS_RET:
+		if( Stmt->nOpd == 0 )
+			Asm_X86_int_Byte(State, 0xC3);
+		else {
+			Asm_X86_int_Expect(State, Stmt, 1, ASMOPD_IMM, ASMOPD_NONE);
+			Asm_X86_int_Byte(State, 0xC2);
+			Asm_X86_int_Value(State, &a->Expr, 2, false, false);
+		}
+		break;
+	case ASMCLS_INT:
+		Asm_X86_int_Expect(State, Stmt, 1, ASMOPD_IMM, ASMOPD_NONE);
+		Asm_X86_int_Byte(State, 0xCD);
+		Asm_X86_int_Value(State, &a->Expr, 1, false, false);
+		break;
+
+	case ASMCLS_ALU:
+		Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_NONE, ASMOPD_NONE);
+		if( b->Type == ASMOPD_IMM ) {
+			size = Asm_X86_int_OpSize(State, Stmt, 1);
+			imm_size = (size == 8 ? 4 : size);
+			Asm_X86_int_Prefix(State, size, NULL, a);
+			if( size == 1 ) {
+				Asm_X86_int_Byte(State, 0x80);
+				Asm_X86_int_ModRM(State, Stmt->Op, a, 1);
+				Asm_X86_int_Value(State, &b->Expr, 1, false, false);
+			}
+			else if( Asm_X86_int_FitsInt8(&b->Expr) ) {
+				Asm_X86_int_Byte(State, 0x83);
+				Asm_X86_int_ModRM(State, Stmt->Op, a, 1);
+				Asm_X86_int_Value(State, &b->Expr, 1, false, false);
+			}
+			else if( a->Type == ASMOPD_REG && a->Reg == 0 ) {
+				// (short form for eax)
+				Asm_X86_int_Byte(State, Stmt->Op*8 + 5);
+				Asm_X86_int_Imm(State, &b->Expr, size);
+			}
+			else {
+				Asm_X86_int_Byte(State, 0x81);
+				Asm_X86_int_ModRM(State, Stmt->Op, a, imm_size);
+				Asm_X86_int_Imm(State, &b->Expr, size);
+			}
+		}
+		else if( b->Type == ASMOPD_REG ) {
+			size = Asm_X86_int_OpSize(State, Stmt, 2);
+			Asm_X86_int_Prefix(State, size, b, a);
+			Asm_X86_int_Byte(State, Stmt->Op*8 + (size == 1 ? 0 : 1));
+			Asm_X86_int_ModRM(State, b->Reg, a, 0);
+		}
+		else if( a->Type == ASMOPD_REG ) {
+			size = Asm_X86_int_OpSize(State, Stmt, 2);
+			Asm_X86_int_Prefix(State, size, a, b);
+			Asm_X86_int_Byte(State, Stmt->Op*8 + (size == 1 ? 2 : 3));
+			Asm_X86_int_ModRM(State, a->Reg, b, 0);
+		}
+		else
+			Asm_X86_int_Error(State, "Invalid operands");
+		break;
+
+	case ASMCLS_MOV:
+		Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_NONE, ASMOPD_NONE);
+		if( b->Type == ASMOPD_IMM ) {
+			size = Asm_X86_int_OpSize(State, Stmt, 1);
+			Asm_X86_int_Prefix(State, size, NULL, a);
+			if( a->Type == ASMOPD_REG && (size != 8 || !Asm_X86_int_FitsInt32(&b->Expr) || b->Expr.Sym >= 0) ) {
+				// (mov r64, imm64 when it doesn't fit a sign extended imm32)
+				Asm_X86_int_Byte(State, (size == 1 ? 0xB0 : 0xB8) + (a->Reg & 7));
+				Asm_X86_int_Value(State, &b->Expr, size, false, false);
+			}
+			else {
+				Asm_X86_int_Byte(State, (size == 1 ? 0xC6 : 0xC7));
+				Asm_X86_int_ModRM(State, 0, a, (size == 8 ? 4 : size));
+				Asm_X86_int_Imm(State, &b->Expr, size);
+			}
+		}
+		else if( State->Bits == 32 && Asm_X86_int_IsAbsolute(a) && b->Reg == 0 ) {
+			// (mov [addr], al/eax)
+			size = Asm_X86_int_OpSize(State, Stmt, 2);
+			Asm_X86_int_Prefix(State, size, NULL, NULL);
+			Asm_X86_int_Byte(State, (size == 1 ? 0xA2 : 0xA3));
+			Asm_X86_int_Value(State, &a->Expr, 4, false, false);
+		}
+		else if( State->Bits == 32 && Asm_X86_int_IsAbsolute(b) && a->Type == ASMOPD_REG && a->Reg == 0 ) {
+			size = Asm_X86_int_OpSize(State, Stmt, 2);
+			Asm_X86_int_Prefix(State, size, NULL, NULL);
+			Asm_X86_int_Byte(State, (size == 1 ? 0xA0 : 0xA1));
+			Asm_X86_int_Value(State, &b->Expr, 4, false, false);
+		}
+		else if( b->Type == ASMOPD_REG ) {
+			size = Asm_X86_int_OpSize(State, Stmt, 2);
+			Asm_X86_int_Prefix(State, size, b, a);
+			Asm_X86_int_Byte(State, (size == 1 ? 0x88 : 0x89));
+			Asm_X86_int_ModRM(State, b->Reg, a, 0);
+		}
+		else if( a->Type == ASMOPD_REG ) {
+			size = Asm_X86_int_OpSize(State, Stmt, 2);
+			Asm_X86_int_Prefix(State, size, a, b);
+			Asm_X86_int_Byte(State, (size == 1 ? 0x8A : 0x8B));
+			Asm_X86_int_ModRM(State, a->Reg, b, 0);
+		}
+		else
+			Asm_X86_int_Error(State, "Invalid operands");
+		break;
+
+	case ASMCLS_TEST:
+		Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_NONE, ASMOPD_NONE);
+		if( b->Type == ASMOPD_IMM ) {
+			size = Asm_X86_int_OpSize(State, Stmt, 1);
+			Asm_X86_int_Prefix(State, size, NULL, a);
+			if( a->Type == ASMOPD_REG && a->Reg == 0 )
+				Asm_X86_int_Byte(State, (size == 1 ? 0xA8 : 0xA9));
+			else {
+				Asm_X86_int_Byte(State, (size == 1 ? 0xF6 : 0xF7));
+				Asm_X86_int_ModRM(State, 0, a, (size == 8 ? 4 : size));
+			}
+			Asm_X86_int_Imm(State, &b->Expr, size);
+		}
+		else {
+			// (commutative, the register goes in the reg field)
+			if( b->Type != ASMOPD_REG ) {
+				const tAsmOperand *t = a;
+				a = b;
+				b = t;
+			}
+			if( b->Type != ASMOPD_REG )
+				Asm_X86_int_Error(State, "Invalid operands");
+			size = Asm_X86_int_OpSize(State, Stmt, 2);
+			Asm_X86_int_Prefix(State, size, b, a);
+			Asm_X86_int_Byte(State, (size == 1 ? 0x84 : 0x85));
+			Asm_X86_int_ModRM(State, b->Reg, a, 0);
+		}
+		break;
+
+	case ASMCLS_XCHG:
+		Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_NONE, ASMOPD_NONE);
+		if( b->Type != ASMOPD_REG ) {
+			const tAsmOperand *t = a;
+			a = b;
+			b = t;
+		}
+		if( b->Type != ASMOPD_REG || a->Type == ASMOPD_IMM )
+			Asm_X86_int_Error(State, "Invalid operands");
+		size = Asm_X86_int_OpSize(State, Stmt, 2);
+		Asm_X86_int_Prefix(State, size, b, a);
+		Asm_X86_int_Byte(State, (size == 1 ? 0x86 : 0x87));
+		Asm_X86_int_ModRM(State, b->Reg, a, 0);
+		break;
+
+	case ASMCLS_LEA:
+		Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_REG, ASMOPD_MEM);
+		size = Asm_X86_int_OpSize(State, Stmt, 1);
+		Asm_X86_int_Prefix(State, size, a, b);
+		Asm_X86_int_Byte(State, 0x8D);
+		Asm_X86_int_ModRM(State, a->Reg, b, 0);
+		break;
+
+	case ASMCLS_MOVX:
+		Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_REG, ASMOPD_NONE);
+		if( b->Type == ASMOPD_IMM || b->Size == 0 )
+			Asm_X86_int_Error(State, "Source size not specified");
+		if( b->Size >= a->Size || b->Size > 2 )
+			Asm_X86_int_Error(State, "Invalid operand sizes");
+		size = Asm_X86_int_OpSize(State, Stmt, 1);
+		Asm_X86_int_Prefix(State, size, a, b);
+		Asm_X86_int_Byte(State, 0x0F);
+		Asm_X86_int_Byte(State, Stmt->Op + (b->Size == 2));
+		Asm_X86_int_ModRM(State, a->Reg, b, 0);
+		break;
+
+	case ASMCLS_MOVSXD:
+		Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_REG, ASMOPD_NONE);
+		if( a->Size != 8 || b->Type == ASMOPD_IMM || (b->Size != 0 && b->Size != 4) )
+			Asm_X86_int_Error(State, "Invalid operand sizes");
+		Asm_X86_int_OpSize(State, Stmt, 1);
+		Asm_X86_int_Prefix(State, 8, a, b);
+		Asm_X86_int_Byte(State, Stmt->Op);
+		Asm_X86_int_ModRM(State, a->Reg, b, 0);
+		break;
+
+	case ASMCLS_IMUL:
+		if( Stmt->nOpd == 1 )
+			goto unary;
+		if( Stmt->nOpd == 2 && b->Type != ASMOPD_IMM ) {
+			Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_REG, ASMOPD_NONE);
+			size = Asm_X86_int_OpSize(State, Stmt, 2);
+			if( size == 1 )
+				Asm_X86_int_Error(State, "Invalid operand size");
+			Asm_X86_int_Prefix(State, size, a, b);
+			Asm_X86_int_Byte(State, 0x0F);
+			Asm_X86_int_Byte(State, 0xAF);
+			Asm_X86_int_ModRM(State, a->Reg, b, 0);
+		}
+		else {
+			// imul r, r/m, imm (imul r, imm is imul r, r, imm)
+			const tAsmOperand	*src = (Stmt->nOpd == 3 ? b : a);
+			const tAsmOperand	*imm = &Stmt->Opd[Stmt->nOpd - 1];
+			if( a->Type != ASMOPD_REG || imm->Type != ASMOPD_IMM || src->Type == ASMOPD_IMM )
+				Asm_X86_int_Error(State, "Invalid operands");
+			size = Asm_X86_int_OpSize(State, Stmt, Stmt->nOpd - 1);
+			if( size == 1 )
+				Asm_X86_int_Error(State, "Invalid operand size");
+			bool	short_imm = Asm_X86_int_FitsInt8(&imm->Expr);
+			Asm_X86_int_Prefix(State, size, a, src);
+			Asm_X86_int_Byte(State, (short_imm ? 0x6B : 0x69));
+			Asm_X86_int_ModRM(State, a->Reg, src, (short_imm ? 1 : (size == 8 ? 4 : size)));
+			if( short_imm )
+				Asm_X86_int_Value(State, &imm->Expr, 1, false, false);
+			else
+				Asm_X86_int_Imm(State, &imm->Expr, size);
+		}
+		break;
+
+	case ASMCLS_UNARY:
+	unary:
+		Asm_X86_int_Expect(State, Stmt, 1, ASMOPD_NONE, ASMOPD_NONE);
+		size = Asm_X86_int_OpSize(State, Stmt, 1);
+		Asm_X86_int_Prefix(State, size, NULL, a);
+		Asm_X86_int_Byte(State, (size == 1 ? 0xF6 : 0xF7));
+		Asm_X86_int_ModRM(State, Stmt->Op, a, 0);
+		break;
+
+	case ASMCLS_INCDEC:
+		Asm_X86_int_Expect(State, Stmt, 1, ASMOPD_NONE, ASMOPD_NONE);
+		size = Asm_X86_int_OpSize(State, Stmt, 1);
+		Asm_X86_int_Prefix(State, size, NULL, a);
+		Asm_X86_int_Byte(State, (size == 1 ? 0xFE : 0xFF));
+		Asm_X86_int_ModRM(State, Stmt->Op, a, 0);
+		break;
+
+	case ASMCLS_SHIFT:
+		Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_NONE, ASMOPD_NONE);
+		size = Asm_X86_int_OpSize(State, Stmt, 1);
+		Asm_X86_int_Prefix(State, size, NULL, a);
+		if( b->Type == ASMOPD_REG ) {
+			if( b->Reg != 1 || b->Size != 1 )
+				Asm_X86_int_Error(State, "Shift count must be cl");
+			Asm_X86_int_Byte(State, (size == 1 ? 0xD2 : 0xD3));
+			Asm_X86_int_ModRM(State, Stmt->Op, a, 0);
+		}
+		else if( b->Type != ASMOPD_IMM || b->Expr.Sym >= 0 )
+			Asm_X86_int_Error(State, "Invalid shift count");
+		else if( b->Expr.Value == 1 ) {
+			Asm_X86_int_Byte(State, (size == 1 ? 0xD0 : 0xD1));
+			Asm_X86_int_ModRM(State, Stmt->Op, a, 0);
+		}
+		else {
+			Asm_X86_int_Byte(State, (size == 1 ? 0xC0 : 0xC1));
+			Asm_X86_int_ModRM(State, Stmt->Op, a, 1);
+			Asm_X86_int_Value(State, &b->Expr, 1, false, false);
+		}
+		break;
+
+	case ASMCLS_PUSH:
+	case ASMCLS_POP:
+		Asm_X86_int_Expect(State, Stmt, 1, ASMOPD_NONE, ASMOPD_NONE);
+		// (always the full stack width, so no REX.W)
+		if( a->Size != 0 && a->Size != State->Bits/8 )
+			Asm_X86_int_Error(State, "Only %i-bit values can be pushed/popped", State->Bits);
+		if( a->Type == ASMOPD_REG ) {
+			Asm_X86_int_Prefix(State, 4, NULL, a);
+			Asm_X86_int_Byte(State, (Stmt->Class == ASMCLS_PUSH ? 0x50 : 0x58) + (a->Reg & 7));
+		}
+		else if( a->Type == ASMOPD_MEM ) {
+			Asm_X86_int_Prefix(State, 4, NULL, a);
+			Asm_X86_int_Byte(State, (Stmt->Class == ASMCLS_PUSH ? 0xFF : 0x8F));
+			Asm_X86_int_ModRM(State, (Stmt->Class == ASMCLS_PUSH ? 6 : 0), a, 0);
+		}
+		else if( Stmt->Class == ASMCLS_PUSH && Asm_X86_int_FitsInt8(&a->Expr) ) {
+			Asm_X86_int_Byte(State, 0x6A);
+			Asm_X86_int_Value(State, &a->Expr, 1, false, false);
+		}
+		else if( Stmt->Class == ASMCLS_PUSH ) {
+			Asm_X86_int_Byte(State, 0x68);
+			Asm_X86_int_Imm(State, &a->Expr, State->Bits/8);
+		}
+		else
+			Asm_X86_int_Error(State, "Can't pop into an immediate");
+		break;
+
+	case ASMCLS_CALL:
+	case ASMCLS_JMP:
+		Asm_X86_int_Expect(State, Stmt, 1, ASMOPD_NONE, ASMOPD_NONE);
+		if( a->Type != ASMOPD_IMM ) {
+			if( a->Size != 0 && a->Size != State->Bits/8 )
+				Asm_X86_int_Error(State, "Invalid operand size");
+			Asm_X86_int_Prefix(State, 4, NULL, a);
+			Asm_X86_int_Byte(State, 0xFF);
+			Asm_X86_int_ModRM(State, (Stmt->Class == ASMCLS_CALL ? 2 : 4), a, 0);
+		}
+		else if( Stmt->Class == ASMCLS_JMP && !Stmt->bLong ) {
+			Asm_X86_int_Byte(State, 0xEB);
+			goto short_jump;
+		}
+		else {
+			Asm_X86_int_Byte(State, (Stmt->Class == ASMCLS_CALL ? 0xE8 : 0xE9));
+			Asm_X86_int_Value(State, &a->Expr, 4, true, true);
+		}
+		break;
+
+	case ASMCLS_JCC:
+		Asm_X86_int_Expect(State, Stmt, 1, ASMOPD_IMM, ASMOPD_NONE);
+		if( Stmt->bLong ) {
+			Asm_X86_int_Byte(State, 0x0F);
+			Asm_X86_int_Byte(State, 0x80 + Stmt->Op);
+			Asm_X86_int_Value(State, &a->Expr, 4, true, true);
+			break;
+		}
+		Asm_X86_int_Byte(State, 0x70 + Stmt->Op);
+	short_jump:
+		// (only range checked on the final pass, earlier passes may have stale label offsets)
+		disp = 0;
+		if( State->bEmit && (!Asm_X86_int_JumpDisp(State, Stmt, 2, &disp) || disp < -128 || disp > 127) )
+			Asm_X86_int_Error(State, "BUG: Short jump out of range");
+		Asm_X86_int_Byte(State, disp & 0xFF);
+		break;
+
+	case ASMCLS_SETCC:
+		Asm_X86_int_Expect(State, Stmt, 1, ASMOPD_NONE, ASMOPD_NONE);
+		if( a->Type == ASMOPD_IMM || (a->Size != 0 && a->Size != 1) )
+			Asm_X86_int_Error(State, "set%s needs a byte operand", "cc");
+		Asm_X86_int_Prefix(State, 1, NULL, a);
+		Asm_X86_int_Byte(State, 0x0F);
+		Asm_X86_int_Byte(State, 0x90 + Stmt->Op);
+		Asm_X86_int_ModRM(State, 0, a, 0);
+		break;
+
+	case ASMCLS_CMOVCC:
+		Asm_X86_int_Expect(State, Stmt, 2, ASMOPD_REG, ASMOPD_NONE);
+		if( b->Type == ASMOPD_IMM )
+			Asm_X86_int_Error(State, "Invalid operands");
+		size = Asm_X86_int_OpSize(State, Stmt, 2);
+		Asm_X86_int_Prefix(State, size, a, b);
+		Asm_X86_int_Byte(State, 0x0F);
+		Asm_X86_int_Byte(State, 0x40 + Stmt->Op);
+		Asm_X86_int_ModRM(State, a->Reg, b, 0);
+		break;
+	}
+}
@@ -0,0 +1,3567 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * output/arch/x86_irm.c
+ * - x86 code generation from the IRM (used when optimising)
+ *
+ * Values are kept in 32-bit registers, sign/zero extended according to
+ * their type. Register assignment is done by the linear scan allocator,
+ * anything it spills lives in an [ebp-N] slot and is used as a memory
+ * operand (or through a scratch register when x86 needs one).
+ *
+ * Before allocation, instructions are selected by tiling each block's
+ * expression trees (see X86_IRM_SelectInstructions): constants become
+ * immediates, single-use loads become memory operands and address
+ * arithmetic is folded into [base+index*scale+disp] operands or lea.
+ *
+ * The same code emits x86-64 (System V) when called with Bits = 64. Values
+ * wider than 32 bits use the 64-bit registers, narrower ones stay in 32-bit
+ * form (writes to a 32-bit register clear the upper half). Symbols are only
+ * reached RIP relative ([rel sym]), so they are never immediates, and
+ * register arguments are stored to home slots below rbp by the prologue.
+ *
+ * Static functions that are only called directly (tSymbol.bDirectOnly) use
+ * a private convention instead: the first arguments are passed in
+ * registers and read straight from them, and calls to one generated
+ * earlier in the file only clobber the registers it actually writes.
+ *
+ * A call directly followed by a return of its value is a sibling call:
+ * its stack arguments are stored over this function's own (if they fit),
+ * the frame is torn down and the callee is jumped to, so it returns
+ * straight to our caller.
+ */
+#include <global.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <limits.h>
+#include <symbol.h>
+#include <output.h>
+#include <irm.h>
+#include <regalloc.h>
+#include <sched.h>
+
+#define REG_EAX	0
+#define REG_ECX	1
+#define REG_EDX	2
+#define REG_EBX	3
+#define REG_ESP	4
+#define REG_EBP	5
+#define REG_ESI	6
+#define REG_EDI	7
+#define REG_R8	8
+#define REG_R9	9
+#define REG_R10	10
+#define REG_R11	11
+#define REGBIT(r)	(1U << (r))
+
+#define X86_ALLOCATABLE	(REGBIT(REG_EAX)|REGBIT(REG_ECX)|REGBIT(REG_EDX)|REGBIT(REG_EBX)|REGBIT(REG_ESI)|REGBIT(REG_EDI))
+#define X86_CALLER_SAVED	(REGBIT(REG_EAX)|REGBIT(REG_ECX)|REGBIT(REG_EDX))
+#define X86_CALLEE_SAVED	(REGBIT(REG_EBX)|REGBIT(REG_ESI)|REGBIT(REG_EDI))
+#define X86_BYTE_REGS	(REGBIT(REG_EAX)|REGBIT(REG_ECX)|REGBIT(REG_EDX)|REGBIT(REG_EBX))
+#define X86_NOFP_ALLOCATABLE	(X86_ALLOCATABLE|REGBIT(REG_EBP))	//!< -fomit-frame-pointer
+#define X86_NOFP_CALLEE_SAVED	(X86_CALLEE_SAVED|REGBIT(REG_EBP))
+
+#define X86_64_ALLOCATABLE	(0xFFFF & ~(REGBIT(REG_ESP)|REGBIT(REG_EBP)))
+#define X86_64_CALLER_SAVED	(REGBIT(REG_EAX)|REGBIT(REG_ECX)|REGBIT(REG_EDX)|REGBIT(REG_ESI)|REGBIT(REG_EDI)|0x0F00)	// + r8-r11
+#define X86_64_CALLEE_SAVED	(REGBIT(REG_EBX)|0xF000)	// + r12-r15
+#define X86_64_NOFP_ALLOCATABLE	(X86_64_ALLOCATABLE|REGBIT(REG_EBP))
+#define X86_64_NOFP_CALLEE_SAVED	(X86_64_CALLEE_SAVED|REGBIT(REG_EBP))
+#define X86_64_NREGARGS	6
+#define X86_64_RED_ZONE	128	//!< Bytes below rsp a leaf function can use without moving it
+
+// Execution ports of the scheduling model
+#define X86_PORT_ALU0	0x1	//!< ALU, multiply and divide
+#define X86_PORT_ALU1	0x2
+#define X86_PORT_LOAD	0x4
+#define X86_PORT_STORE	0x8
+#define X86_PORT_ALU	(X86_PORT_ALU0|X86_PORT_ALU1)
+#define X86_LOAD_LATENCY	3
+
+//! \brief Instruction forms chosen by selection (tIRMOp.Form)
+enum eX86Forms
+{
+	X86FORM_DEFAULT,
+	X86FORM_SWAP,	//!< Commutative operation with the operands exchanged
+	X86FORM_LEA,	//!< ADD/SUB/MUL computed as an address with lea
+	X86FORM_SHIFT,	//!< MUL by a power of two as shl
+	X86FORM_TEST,	//!< Comparison with zero / branch on an AND, using test
+	X86FORM_CMP,	//!< Branch on a comparison, using cmp + jcc
+};
+
+enum eX86OperandTypes
+{
+	X86OPD_REG,
+	X86OPD_IMM,
+	X86OPD_MEM,
+};
+
+typedef struct sX86Operand
+{
+	enum eX86OperandTypes	Type;
+	 int	Reg;	//!< X86OPD_REG
+	 int	Base, Index, Scale;	//!< X86OPD_MEM address registers (-1 if unused)
+	 int64_t	Disp;	//!< Immediate value or displacement
+	const char	*Sym;	//!< Symbol added to Disp
+	 int	String;	//!< String label added to Disp (-1 for none)
+	 int	Size;	//!< Register/immediate width (4 or 8), memory access size (0 for a bare address)
+	bool	bSigned;	//!< Narrow memory operands are sign extended
+} tX86Operand;
+
+typedef struct sX86IRMState
+{
+	tAsmOut	*OutFile;
+	tIRMHandle	Handle;
+	tRegAllocation	*RA;
+	tIRMOp	**Defs;	//!< [nRegs] Definition of each register (folded values have one)
+
+	 int	*LocalOffsets;	//!< [nLocals] ebp relative, 0 if the local has no stack slot
+	 int	SpillBase;	//!< ebp offset of the spill area
+	 int	FrameSize;
+	uint32_t	UsedRegs;	//!< Registers written (decides callee-saved saves)
+	uint32_t	HomeArgs;	//!< x86-64: Register arguments stored to their home slot
+	bool	bCalls;	//!< Not a leaf function
+	bool	bPushed;	//!< A scratch register was saved on the stack (x86-64: no red zone)
+	bool	bFrameEscapes;	//!< The address of a local is taken (so calls can't reuse the frame)
+
+	// Prologue (see X86_IRM_int_SizeFrame and X86_IRM_int_PlaceFrame)
+	tIRMBlock	*FrameBlock;	//!< Block the prologue runs at the start of (NULL for none)
+	uint32_t	Saved;	//!< Callee-saved registers saved by the prologue
+	 int	FrameAlloc;	//!< Bytes the prologue subtracts from esp
+	 int	FrameDepth;	//!< Entry esp minus esp after the prologue
+	bool	bFramed;	//!< The current block runs after the prologue
+	bool	bNeedFrame;	//!< The current block uses the frame (or a callee-saved register)
+
+	// Current operation
+	 int	Pos;	//!< Allocator position the operands are read at
+	uint32_t	Busy;	//!< Registers holding values
+	uint32_t	OpRegs;	//!< Registers used by the operands/result
+	uint32_t	Scratch;	//!< Scratch registers handed out
+	 int	nPushed;
+	 int	Pushed[4];
+} tX86IRMState;
+
+//! \brief Where a calling convention passes the arguments
+typedef struct sX86CallConv
+{
+	 int	nRegArgs;
+	 int	ArgRegs[8];	//!< Registers for the first nRegArgs arguments
+	bool	bHomed;	//!< Callee stores register arguments to memory (instead of reading the registers)
+} tX86CallConv;
+
+//! \brief Code generated for a bDirectOnly function, used by calls to it
+typedef struct sX86Callee
+{
+	struct sX86Callee	*Next;
+	const tSymbol	*Sym;
+	uint32_t	Clobbers;	//!< Registers changed by a call
+} tX86Callee;
+
+//! \brief Target variant, 32-bit cdecl or x86-64 System V
+typedef struct sX86Mode
+{
+	 int	Bits;
+	 int	WordSize;	//!< Size of pointers, stack slots and pushes
+	 int	nRegs;
+	bool	bOmitFP;	//!< Frame addressed off esp, ebp is allocatable
+	uint32_t	Allocatable;
+	uint32_t	CallerSaved;
+	uint32_t	CalleeSaved;
+	uint32_t	ByteRegs;	//!< Registers with an addressable low byte
+	const char * const	*RegNames[9];	//!< [Size] Register names by operand size (1, 2, 4, 8)
+	const tRegAllocTarget	*RegAlloc;
+	const tSchedTarget	*Sched;
+	const tX86CallConv	*CallConv;	//!< Standard (external) convention
+	const tX86CallConv	*LocalCallConv;	//!< For bDirectOnly functions
+} tX86Mode;
+
+// --- Instruction selection ---
+/**
+ * \brief Nonterminals, how an operation's value is consumed by its user
+ *
+ * Address choices also carry the shape of the (partial) address, see
+ * the X86_SHAPE_* macros.
+ */
+enum eX86NonTerms
+{
+	X86NT_REG,	//!< In a register, computed by its own instruction
+	X86NT_IMM,	//!< Immediate operand
+	X86NT_MEM,	//!< Memory operand (folded load)
+	X86NT_ADDR,	//!< Part of an address
+};
+#define X86_KID(nt, shape)	((nt) | ((shape) << 2))
+#define X86_KID_NT(k)	((k) & 3)
+#define X86_KID_SHAPE(k)	((k) >> 2)
+
+#define X86_NSHAPES	16
+#define X86_SHAPE_REGS(s)	((s) & 3)	//!< Unscaled registers (base, or base+index)
+#define X86_SHAPE_SCALED	0x4	//!< Index register with a scale > 1
+#define X86_SHAPE_SYM	0x8	//!< Symbolic displacement
+
+#define X86_ACCEPT_IMM	0x1
+#define X86_ACCEPT_MEM	0x2	//!< Full width (32/64-bit) memory operand
+#define X86_ACCEPT_MEMX	0x4	//!< Memory operand of any size (loaded with extension)
+
+#define X86_COST_INF	0x100000
+#define X86COST_MOV	1	//!< Copy needed by a two-address form
+#define X86COST_MEMOP	1	//!< Load folded into another instruction
+#define X86COST_LEA	2
+#define X86COST_SHIFT	2	//!< Shift by an immediate
+
+typedef struct sX86SelNode
+{
+	bool	bFoldable;	//!< Can be evaluated by its only user instead of by itself
+	 int	nEmbedded;	//!< Users that embedded this (rematerialisable) value
+
+	 int	RegCost;	//!< Cost of the operation's own instruction(s)
+	 int	Form;
+	uint8_t	Kids[3];	//!< How the first uses (IRM_GetUse) are consumed by Form
+	uint8_t	TestKids[2];	//!< BRANCH/SELECT on an AND/comparison: how its operands are consumed
+	uint8_t	LeaShape;	//!< X86FORM_LEA: address shape used
+
+	 int	MemCost;	//!< As a memory operand
+	uint8_t	MemKid;	//!< LOAD: address choice for Src[0]
+	 int	AddrCost[X86_NSHAPES];	//!< As (part of) an address, by shape
+	uint8_t	AddrKids[X86_NSHAPES][2];
+} tX86SelNode;
+
+typedef struct sX86Selector
+{
+	tIRMHandle	Handle;
+	tIRMOp	**Defs;	//!< [nRegs] Definition (only meaningful if nDefs == 1)
+	 int	*nDefs;	//!< [nRegs]
+	 int	*nUses;	//!< [nRegs]
+	tIRMOp	**Users;	//!< [nRegs] Last user
+	tX86SelNode	*Nodes;	//!< [nOps] by op->Index
+	 int	*MemEpoch;	//!< [nOps] Memory writes before each op in its block
+	 int	*ReadLimit;	//!< [nOps] First later op in the block that redefines an operand
+} tX86Selector;
+
+// === IMPORTS ===
+extern const char * const csaRegB[];
+extern const char * const csaRegX[];
+extern const char * const csaRegEX[];
+extern bool	gbOmitFramePointer;
+
+// === PROTOTYPES ===
+ int	X86_IRM_GenerateFunction(tAsmOut *OutFile, tFunction *Func, int Bits);
+void	X86_IRM_GetConstraints(tIRMHandle Handle, const tIRMOp *Op, tRAConstraints *Constraints);
+void	X86_IRM_GetSchedModel(tIRMHandle Handle, const tIRMOp *Op, int nFoldedLoads, tSchedModel *Model);
+void	X86_IRM_SelectInstructions(tIRMHandle Handle);
+static tIRMOp	*X86_IRM_int_SelDef(tX86Selector *S, tIRMReg Reg);
+void	X86_IRM_int_SelLabel(tX86Selector *S, tIRMOp *Op);
+void	X86_IRM_int_SelLabelAddress(tX86Selector *S, tIRMOp *Op);
+void	X86_IRM_int_SelLabelBinOp(tX86Selector *S, tIRMOp *Op);
+void	X86_IRM_int_SelLabelCompare(tX86Selector *S, tIRMOp *Op);
+void	X86_IRM_int_SelLabelBranch(tX86Selector *S, tIRMOp *Op);
+void	X86_IRM_int_SelLabelSelect(tX86Selector *S, tIRMOp *Op);
+ int	X86_IRM_int_SelKidCost(tX86Selector *S, tIRMOp *User, tIRMReg Reg, int Accept, uint8_t *Choice);
+ int	X86_IRM_int_SelAddrCost(tX86Selector *S, tIRMOp *User, tIRMReg Reg, int Shape, uint8_t *Choice);
+ int	X86_IRM_int_SelBestAddr(tX86Selector *S, tIRMOp *User, tIRMReg Reg, uint8_t *Choice);
+void	X86_IRM_int_SelReduce(tX86Selector *S, tIRMOp *Op);
+void	X86_IRM_int_SelReduceKid(tX86Selector *S, tIRMOp *User, int Use, uint8_t Choice);
+void	X86_IRM_int_SelReduceAddress(tX86Selector *S, tIRMOp *Op, int Shape);
+const tX86CallConv	*X86_IRM_int_CallConv(const tSymbol *Sym);
+ int	X86_IRM_int_ArgReg(const tIRMOp *Op);
+void	X86_IRM_int_AddCallee(tX86IRMState *State, const tSymbol *Sym);
+const tX86Callee	*X86_IRM_int_FindCallee(const tSymbol *Sym);
+void	X86_IRM_int_SinkArguments(tIRMHandle Handle);
+void	X86_IRM_int_HoistRegArguments(tIRMHandle Handle);
+bool	X86_IRM_int_InCycle(tIRMHandle Handle, tIRMBlock *Block, tIRMBlock **Stack, bool *Seen);
+void	X86_IRM_int_EmitBody(tX86IRMState *State, bool *Needs);
+void	X86_IRM_int_SizeFrame(tX86IRMState *State);
+tIRMBlock	*X86_IRM_int_PlaceFrame(tX86IRMState *State, const bool *Needs);
+void	X86_IRM_int_EmitPrologue(tX86IRMState *State, tAsmOut *Out);
+void	X86_IRM_int_EmitEpilogue(tX86IRMState *State, tAsmOut *Out);
+void	X86_IRM_int_EmitTeardown(tX86IRMState *State, tAsmOut *Out);
+void	X86_IRM_int_EmitHomeArgs(tX86IRMState *State, tAsmOut *Out);
+void	X86_IRM_int_LayoutFrame(tX86IRMState *State);
+void	X86_IRM_int_LocalLiveness(tX86IRMState *State, int *Start, int *End);
+bool	X86_IRM_int_LocalsInterfere(tX86IRMState *State, int A, int B, const int *Start, const int *End);
+void	X86_IRM_int_EmitBlock(tX86IRMState *State, tIRMBlock *Block, tIRMBlock *Next);
+void	X86_IRM_int_EmitOp(tX86IRMState *State, tIRMOp *Op, tIRMBlock *Next);
+void	X86_IRM_int_EmitCall64(tX86IRMState *State, tIRMOp *Op, const tX86Operand *Dst);
+void	X86_IRM_int_EmitLocalCall(tX86IRMState *State, tIRMOp *Op, const tX86Operand *Dst);
+bool	X86_IRM_int_IsTailCall(tX86IRMState *State, const tIRMOp *Op);
+void	X86_IRM_int_EmitTailJump(tX86IRMState *State, tX86Operand Target, int NStack);
+void	X86_IRM_int_EmitString(tX86IRMState *State, tIRMOp *Op);
+void	X86_IRM_int_EmitCompare(tX86IRMState *State, tX86Operand A, tX86Operand B);
+void	X86_IRM_int_EmitSelect(tX86IRMState *State, tIRMOp *Op, const tX86Operand *Dst);
+void	X86_IRM_int_EmitMoves(tX86IRMState *State, tRAMoveList *List);
+void	X86_IRM_int_EmitMove(void *Ptr, const tRAMove *Move, bool Swap);
+ int	X86_IRM_int_GetScratch(tX86IRMState *State, uint32_t Avoid);
+void	X86_IRM_int_ReleaseScratch(tX86IRMState *State);
+void	X86_IRM_int_MarkOperands(tX86IRMState *State, tIRMOp *Op);
+tX86Operand	X86_IRM_int_Src(tX86IRMState *State, tIRMOp *Op, int Use);
+tX86Operand	X86_IRM_int_Memory(tX86IRMState *State, tIRMOp *Load);
+void	X86_IRM_int_Address(tX86IRMState *State, tIRMOp *Op, int Use, tX86Operand *Mem);
+void	X86_IRM_int_AddressOf(tX86IRMState *State, tIRMOp *Op, tX86Operand *Mem);
+ int	X86_IRM_int_LeafReg(tX86IRMState *State, tIRMOp *Op, int Use);
+void	X86_IRM_int_AddReg(tX86Operand *Mem, int Reg, int Scale);
+const char	*X86_IRM_int_Format(const tX86Operand *Opd);
+static bool	X86_IRM_int_UsesReg(const tX86Operand *Opd, int Reg);
+void	X86_IRM_int_EmitJumpTable(tX86IRMState *State, tIRMOp *Op, const char *Label);
+void	X86_IRM_int_Insn(tAsmOut *Out, const char *Mnemonic, const char *A, const char *B);
+void	X86_IRM_int_InsnInt(tAsmOut *Out, const char *Mnemonic, const char *A, int Value);
+void	X86_IRM_int_InsnLabel(tAsmOut *Out, const char *Mnemonic, int Block);
+void	X86_IRM_int_ToReg(tX86IRMState *State, tX86Operand *Opd);
+void	X86_IRM_int_ToRM32(tX86IRMState *State, tX86Operand *Opd);
+void	X86_IRM_int_Mov(tX86IRMState *State, const tX86Operand *Dst, const tX86Operand *Src);
+void	X86_IRM_int_Lea(tX86IRMState *State, const tX86Operand *Dst, tX86Operand Mem);
+void	X86_IRM_int_BinOp(tX86IRMState *State, const char *Mnemonic, bool bCommutative, const tX86Operand *Dst, tX86Operand Left, tX86Operand Right);
+void	X86_IRM_int_Store(tX86IRMState *State, const tX86Operand *Mem, tX86Operand Value);
+void	X86_IRM_int_Truncate(tX86IRMState *State, int Reg, const tType *Type);
+size_t	X86_IRM_int_CheckSize(tIRMHandle Handle, tIRMReg Reg);
+ int	X86_IRM_int_Width(tIRMHandle Handle, tIRMReg Reg);
+const char	*X86_IRM_int_RegName(int Reg, int Size);
+tX86Operand	X86_IRM_int_FrameOpd(tX86IRMState *State, int Disp, int Size);
+tX86Operand	X86_IRM_int_LocalOpd(tX86IRMState *State, int Local, int Size);
+tX86Operand	X86_IRM_int_SpillOpd(tX86IRMState *State, int Slot, int Size);
+static inline bool	X86_IRM_int_IsSigned(const tType *Type) {
+	return (Type->Class == TYPECLASS_INTEGER && Type->Integer.bSigned) || Type->Class == TYPECLASS_ENUM;
+}
+static inline bool	X86_IRM_int_IsFolded(const tIRMOp *Op, int Use) {
+	return Use < 32 && (Op->FoldMask & (1U << Use));
+}
+static inline bool	X86_IRM_int_FitsImm(uint64_t Value) {
+	return (int64_t)Value == (int32_t)Value;
+}
+//! \brief Immediate that is just a number (not an address)
+static inline bool	X86_IRM_int_IsNumber(const tX86Operand *Opd) {
+	return Opd->Type == X86OPD_IMM && !Opd->Sym && Opd->String < 0;
+}
+static inline tX86Operand	X86_IRM_int_RegOpd(int Reg, int Size) {
+	return (tX86Operand){.Type = X86OPD_REG, .Reg = Reg, .Base = -1, .Index = -1, .String = -1, .Size = Size};
+}
+static inline tX86Operand	X86_IRM_int_ImmOpd(uint64_t Value, int Size) {
+	return (tX86Operand){.Type = X86OPD_IMM, .Reg = -1, .Base = -1, .Index = -1, .Disp = Value, .String = -1, .Size = Size};
+}
+static inline tX86Operand	X86_IRM_int_MemOpd(int Base, int32_t Disp, int Size) {
+	return (tX86Operand){.Type = X86OPD_MEM, .Reg = -1, .Base = Base, .Index = -1, .Disp = Disp, .String = -1, .Size = Size};
+}
+
+// === GLOBALS ===
+const tRegAllocTarget	gX86_RegAllocTarget = {
+	.nRegs = 8,
+	.Allocatable = X86_ALLOCATABLE,
+	.CallerSaved = X86_CALLER_SAVED,
+	.RegNames = csaRegEX,
+	.GetConstraints = X86_IRM_GetConstraints,
+};
+/**
+ * \brief Scheduling model, a narrow (two-issue) core
+ *
+ * Latencies of the usual lowering of each operation, X86_IRM_GetSchedModel
+ * adjusts them for the selected form and folded loads.
+ */
+const tSchedTarget	gX86_SchedTarget = {
+	.IssueWidth = 2,
+	.nPorts = 4,
+	.nRegs = 6,
+	.StoreLatency = 4,	// Store forwarding
+	.GetModel = X86_IRM_GetSchedModel,
+};
+const char * const csaX86_64RegB[] = {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+	"r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+const char * const csaX86_64RegX[] = {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+	"r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"};
+const char * const csaX86_64RegEX[] = {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+	"r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+const char * const csaX86_64RegR[] = {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+	"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+const tRegAllocTarget	gX86_64_RegAllocTarget = {
+	.nRegs = 16,
+	.Allocatable = X86_64_ALLOCATABLE,
+	.CallerSaved = X86_64_CALLER_SAVED,
+	.RegNames = csaX86_64RegR,
+	.GetConstraints = X86_IRM_GetConstraints,
+};
+const tRegAllocTarget	gX86_NoFP_RegAllocTarget = {
+	.nRegs = 8,
+	.Allocatable = X86_NOFP_ALLOCATABLE,
+	.CallerSaved = X86_CALLER_SAVED,
+	.RegNames = csaRegEX,
+	.GetConstraints = X86_IRM_GetConstraints,
+};
+const tRegAllocTarget	gX86_64_NoFP_RegAllocTarget = {
+	.nRegs = 16,
+	.Allocatable = X86_64_NOFP_ALLOCATABLE,
+	.CallerSaved = X86_64_CALLER_SAVED,
+	.RegNames = csaX86_64RegR,
+	.GetConstraints = X86_IRM_GetConstraints,
+};
+const tSchedTarget	gX86_64_SchedTarget = {
+	.IssueWidth = 2,
+	.nPorts = 4,
+	.nRegs = 14,
+	.StoreLatency = 4,
+	.GetModel = X86_IRM_GetSchedModel,
+};
+const tX86CallConv	gX86_Cdecl = {
+	.nRegArgs = 0,
+};
+const tX86CallConv	gX86_RegParm = {	// (gcc's regparm(3))
+	.nRegArgs = 3,
+	.ArgRegs = {REG_EAX, REG_EDX, REG_ECX},
+};
+const tX86CallConv	gX86_64_SysV = {
+	.nRegArgs = X86_64_NREGARGS,
+	.ArgRegs = {REG_EDI, REG_ESI, REG_EDX, REG_ECX, REG_R8, REG_R9},
+	.bHomed = true,
+};
+const tX86CallConv	gX86_64_Local = {
+	.nRegArgs = 8,
+	.ArgRegs = {REG_EDI, REG_ESI, REG_EDX, REG_ECX, REG_R8, REG_R9, REG_R10, REG_R11},
+};
+const tX86Mode	gX86_Mode32 = {
+	.Bits = 32, .WordSize = 4, .nRegs = 8,
+	.Allocatable = X86_ALLOCATABLE, .CallerSaved = X86_CALLER_SAVED, .CalleeSaved = X86_CALLEE_SAVED,
+	.ByteRegs = X86_BYTE_REGS,
+	.RegNames = {[1] = csaRegB, [2] = csaRegX, [4] = csaRegEX},
+	.RegAlloc = &gX86_RegAllocTarget,
+	.Sched = &gX86_SchedTarget,
+	.CallConv = &gX86_Cdecl, .LocalCallConv = &gX86_RegParm,
+};
+const tX86Mode	gX86_Mode64 = {
+	.Bits = 64, .WordSize = 8, .nRegs = 16,
+	.Allocatable = X86_64_ALLOCATABLE, .CallerSaved = X86_64_CALLER_SAVED, .CalleeSaved = X86_64_CALLEE_SAVED,
+	.ByteRegs = X86_64_ALLOCATABLE,	// (REX gives every register a low byte)
+	.RegNames = {[1] = csaX86_64RegB, [2] = csaX86_64RegX, [4] = csaX86_64RegEX, [8] = csaX86_64RegR},
+	.RegAlloc = &gX86_64_RegAllocTarget,
+	.Sched = &gX86_64_SchedTarget,
+	.CallConv = &gX86_64_SysV, .LocalCallConv = &gX86_64_Local,
+};
+const tX86Mode	gX86_Mode32NoFP = {
+	.Bits = 32, .WordSize = 4, .nRegs = 8, .bOmitFP = true,
+	.Allocatable = X86_NOFP_ALLOCATABLE, .CallerSaved = X86_CALLER_SAVED, .CalleeSaved = X86_NOFP_CALLEE_SAVED,
+	.ByteRegs = X86_BYTE_REGS,
+	.RegNames = {[1] = csaRegB, [2] = csaRegX, [4] = csaRegEX},
+	.RegAlloc = &gX86_NoFP_RegAllocTarget,
+	.Sched = &gX86_SchedTarget,
+	.CallConv = &gX86_Cdecl, .LocalCallConv = &gX86_RegParm,
+};
+const tX86Mode	gX86_Mode64NoFP = {
+	.Bits = 64, .WordSize = 8, .nRegs = 16, .bOmitFP = true,
+	.Allocatable = X86_64_NOFP_ALLOCATABLE, .CallerSaved = X86_64_CALLER_SAVED, .CalleeSaved = X86_64_NOFP_CALLEE_SAVED,
+	.ByteRegs = X86_64_NOFP_ALLOCATABLE,
+	.RegNames = {[1] = csaX86_64RegB, [2] = csaX86_64RegX, [4] = csaX86_64RegEX, [8] = csaX86_64RegR},
+	.RegAlloc = &gX86_64_NoFP_RegAllocTarget,
+	.Sched = &gX86_64_SchedTarget,
+	.CallConv = &gX86_64_SysV, .LocalCallConv = &gX86_64_Local,
+};
+//! \brief Variant of the function being generated
+const tX86Mode	*gpX86Mode = &gX86_Mode32;
+//! \brief Convention the function being generated is called with
+const tX86CallConv	*gpX86CallConv = &gX86_Cdecl;
+//! \brief Functions already generated that calls can use the private convention with
+tX86Callee	*gpX86Callees;
+//! \brief Bytes pushed by the current operation (esp based operands are relative to esp before them)
+ int	giX86PushDepth;
+const tSchedModel	caX86SchedModels[NUM_IRMOPS] = {
+	[IRMOP_CONST] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_STRING] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_SYMADDR] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_LOCALADDR] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_COPY] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_ARGUMENT] = {X86_LOAD_LATENCY, 1, {X86_PORT_LOAD}},
+	[IRMOP_LOADLOCAL] = {X86_LOAD_LATENCY, 1, {X86_PORT_LOAD}},
+	[IRMOP_LOAD] = {X86_LOAD_LATENCY, 1, {X86_PORT_LOAD}},
+	[IRMOP_STORELOCAL] = {1, 1, {X86_PORT_STORE}},
+	[IRMOP_STORE] = {1, 1, {X86_PORT_STORE}},
+	[IRMOP_NEG] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_NOT] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_CAST] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_ADD] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_SUB] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_MUL] = {3, 1, {X86_PORT_ALU0}},
+	[IRMOP_DIV] = {25, 3, {X86_PORT_ALU0, X86_PORT_ALU, X86_PORT_ALU}},
+	[IRMOP_MOD] = {25, 3, {X86_PORT_ALU0, X86_PORT_ALU, X86_PORT_ALU}},
+	[IRMOP_AND] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_OR] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_XOR] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_SHL] = {1, 2, {X86_PORT_ALU, X86_PORT_ALU}},	// mov ecx, shl
+	[IRMOP_SHR] = {1, 2, {X86_PORT_ALU, X86_PORT_ALU}},
+	[IRMOP_CMPEQ ... IRMOP_CMPGE] = {3, 3, {X86_PORT_ALU, X86_PORT_ALU, X86_PORT_ALU}},	// cmp, setcc, movzx
+	[IRMOP_SELECT] = {2, 2, {X86_PORT_ALU, X86_PORT_ALU}},	// mov, cmovcc
+	[IRMOP_CALL] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_JUMP] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_BRANCH] = {1, 1, {X86_PORT_ALU}},
+	[IRMOP_SWITCH] = {1, 2, {X86_PORT_ALU, X86_PORT_ALU}},	// (lea), jmp [table+idx]
+	[IRMOP_RETURN] = {1, 1, {X86_PORT_ALU}},
+};
+const char * const csaX86SetCC[] = {"sete", "setne", "setl", "setle", "setg", "setge"};
+const char * const csaX86UnsignedSetCC[] = {"sete", "setne", "setb", "setbe", "seta", "setae"};
+const char * const csaX86JCC[] = {"je", "jne", "jl", "jle", "jg", "jge"};
+const char * const csaX86UnsignedJCC[] = {"je", "jne", "jb", "jbe", "ja", "jae"};
+const char * const csaX86CMovCC[] = {"cmove", "cmovne", "cmovl", "cmovle", "cmovg", "cmovge"};
+const char * const csaX86UnsignedCMovCC[] = {"cmove", "cmovne", "cmovb", "cmovbe", "cmova", "cmovae"};
+const int	caX86InverseCC[] = {1, 0, 5, 4, 3, 2};	//!< Condition that is true when the other is false
+//! \brief Cost of each operation's usual lowering (roughly cycles, a simple ALU operation is 2)
+const int	caX86OpCosts[NUM_IRMOPS] = {
+	[IRMOP_CONST] = 1, [IRMOP_STRING] = 1, [IRMOP_SYMADDR] = 1, [IRMOP_LOCALADDR] = 2,
+	[IRMOP_ARGUMENT] = 2, [IRMOP_COPY] = 1,
+	[IRMOP_LOADLOCAL] = 2, [IRMOP_STORELOCAL] = 2, [IRMOP_LOAD] = 2, [IRMOP_STORE] = 2,
+	[IRMOP_NEG] = 2, [IRMOP_NOT] = 2, [IRMOP_CAST] = 1,
+	[IRMOP_ADD] = 2, [IRMOP_SUB] = 2, [IRMOP_MUL] = 6, [IRMOP_DIV] = 40, [IRMOP_MOD] = 40,
+	[IRMOP_AND] = 2, [IRMOP_OR] = 2, [IRMOP_XOR] = 2,
+	[IRMOP_SHL] = 3, [IRMOP_SHR] = 3,	// Count moved to ecx
+	[IRMOP_CMPEQ ... IRMOP_CMPGE] = 4,	// cmp, setcc, movzx
+	[IRMOP_SELECT] = 3,	// mov, cmovcc
+	[IRMOP_CALL] = 4,
+	[IRMOP_JUMP] = 1, [IRMOP_BRANCH] = 2, [IRMOP_SWITCH] = 4, [IRMOP_RETURN] = 1,
+};
+
+// === CODE ===
+/**
+ * \brief Generate a function from its (non-SSA) IRM
+ * \param Bits	32 for i386 cdecl, 64 for x86-64 System V
+ */
+int X86_IRM_GenerateFunction(tAsmOut *OutFile, tFunction *Func, int Bits)
+{
+	tIRMHandle	h = Func->IRM;
+	if( Bits == 64 )
+		gpX86Mode = (gbOmitFramePointer ? &gX86_Mode64NoFP : &gX86_Mode64);
+	else
+		gpX86Mode = (gbOmitFramePointer ? &gX86_Mode32NoFP : &gX86_Mode32);
+	gpX86CallConv = X86_IRM_int_CallConv(&Func->Sym);
+	IRM_ComputeDominators(h);
+	X86_IRM_int_SinkArguments(h);
+	X86_IRM_SelectInstructions(h);
+	Sched_ScheduleFunction(h, gpX86Mode->Sched);
+	X86_IRM_int_HoistRegArguments(h);
+
+	tX86IRMState	state = {
+		.Handle = h,
+		.RA = RA_Allocate(h, gpX86Mode->RegAlloc),
+		};
+	state.UsedRegs = state.RA->UsedRegs;
+	state.Defs = calloc(h->nRegs, sizeof(tIRMOp*));
+	for( int i = 0; i < state.RA->nOps; i ++ )
+	{
+		tIRMOp	*op = state.RA->Ops[i];
+		if( op->Dst != IRM_REG_VOID )
+			state.Defs[op->Dst] = op;
+		if( op->Op == IRMOP_CALL )
+			state.bCalls = true;
+		if( op->Op == IRMOP_LOCALADDR )
+			state.bFrameEscapes = true;
+	}
+	X86_IRM_int_LayoutFrame(&state);
+
+	// Body first (into memory), the prologue depends on the registers it touched and
+	// on which blocks need it. Generated again if that moves the prologue or changes
+	// the esp offsets or saved registers used (by sibling calls, which tear the frame down).
+	tAsmOut	body;
+	bool	*needs = malloc(h->nBlocks * sizeof(bool));
+	state.FrameBlock = h->Blocks[0];
+	X86_IRM_int_SizeFrame(&state);
+	for( int pass = 0; ; pass ++ )
+	{
+		 int	depth = state.FrameDepth;
+		uint32_t	saved = state.Saved;
+		assert( pass < 4 );
+		AsmOut_Open(&body, NULL);
+		state.OutFile = &body;
+		X86_IRM_int_EmitBody(&state, needs);
+
+		tIRMBlock	*frame_block = X86_IRM_int_PlaceFrame(&state, needs);
+		X86_IRM_int_SizeFrame(&state);
+		if( frame_block == state.FrameBlock && state.Saved == saved
+		 && (!gpX86Mode->bOmitFP || state.FrameDepth == depth) )
+			break;
+		state.FrameBlock = frame_block;
+		AsmOut_Free(&body);
+	}
+	free(needs);
+
+	AsmOut_Str(OutFile, "\n");
+	if(Func->Linkage == LINKAGE_GLOBAL)
+		AsmOut_Printf(OutFile, "[global $%s]\n", Func->Sym.Name);
+	AsmOut_Printf(OutFile, "$%s:\n", Func->Sym.Name);
+	state.bFramed = false;
+	if( state.FrameBlock == h->Blocks[0] )
+		X86_IRM_int_EmitPrologue(&state, OutFile);
+	else
+		X86_IRM_int_EmitHomeArgs(&state, OutFile);
+	AsmOut_Write(OutFile, body.Data, body.Length);
+	if( state.FrameBlock )
+		X86_IRM_int_EmitEpilogue(&state, OutFile);
+	if( Func->Sym.bDirectOnly )
+		X86_IRM_int_AddCallee(&state, &Func->Sym);
+
+	AsmOut_Free(&body);
+	free(state.Defs);
+	free(state.LocalOffsets);
+	RA_Free(state.RA);
+	return 0;
+}
+
+/**
+ * \brief Calling convention used for calls to a function
+ */
+const tX86CallConv *X86_IRM_int_CallConv(const tSymbol *Sym)
+{
+	return (Sym && Sym->bDirectOnly ? gpX86Mode->LocalCallConv : gpX86Mode->CallConv);
+}
+
+/**
+ * \brief Register an ARGUMENT operation reads (-1 if it's in memory)
+ */
+int X86_IRM_int_ArgReg(const tIRMOp *Op)
+{
+	if( gpX86CallConv->bHomed || Op->Imm >= gpX86CallConv->nRegArgs )
+		return -1;
+	return gpX86CallConv->ArgRegs[Op->Imm];
+}
+
+/**
+ * \brief Record the registers a bDirectOnly function changes
+ *
+ * Everything written that the prologue doesn't save: values, scratch
+ * registers and the clobbers of its instructions (including its calls).
+ */
+void X86_IRM_int_AddCallee(tX86IRMState *State, const tSymbol *Sym)
+{
+	uint32_t	clobbers = State->UsedRegs | REGBIT(REG_EAX);
+	for( int i = 0; i < State->RA->nOps; i ++ )
+	{
+		tIRMOp	*op = State->RA->Ops[i];
+		tRAConstraints	c = {.DstHint = -1, .SrcHint = {-1, -1}};
+		if( op->Flags & IRMFLAG_FOLDED )
+			continue ;
+		X86_IRM_GetConstraints(State->Handle, op, &c);
+		clobbers |= c.ClobberUse | c.ClobberDef | c.ClobberAll;
+	}
+	tX86Callee	*callee = malloc(sizeof(tX86Callee));
+	callee->Sym = Sym;
+	callee->Clobbers = clobbers & ~State->Saved & ~REGBIT(REG_ESP);
+	callee->Next = gpX86Callees;
+	gpX86Callees = callee;
+}
+
+const tX86Callee *X86_IRM_int_FindCallee(const tSymbol *Sym)
+{
+	for( const tX86Callee *callee = gpX86Callees; callee; callee = callee->Next )
+	{
+		if( callee->Sym == Sym )
+			return callee;
+	}
+	return NULL;
+}
+
+/**
+ * \brief Move reads of register arguments to the start of the function
+ *
+ * Nothing (a clobber in particular) can then come between the entry and
+ * the read. The allocator keeps the registers free until then.
+ */
+void X86_IRM_int_HoistRegArguments(tIRMHandle Handle)
+{
+	tIRMBlock	*entry = Handle->Blocks[0];
+	tIRMOp	*next;
+	for( tIRMOp *op = entry->FirstOp; op; op = next )
+	{
+		next = op->Next;
+		if( op->Op != IRMOP_ARGUMENT || X86_IRM_int_ArgReg(op) < 0 )
+			continue ;
+		IRM_RemoveOp(op);
+		IRM_InsertOpBefore(entry, entry->FirstOp, op);
+	}
+}
+
+/**
+ * \brief Move argument loads out of the entry block, down to their uses
+ *
+ * Each goes to the start of the nearest block dominating all of its uses
+ * that isn't in a loop. This keeps early exits from holding the arguments
+ * the rest of the function needs (in callee-saved registers), so the
+ * prologue can be shrink-wrapped past them. Argument slots are never
+ * written, so the load can be done anywhere.
+ */
+void X86_IRM_int_SinkArguments(tIRMHandle Handle)
+{
+	tIRMBlock	*entry = Handle->Blocks[0];
+	if( Handle->nBlocks == 1 )
+		return ;
+	 int	*ndefs = calloc(Handle->nRegs, sizeof(int));
+	tIRMBlock	**targets = calloc(Handle->nRegs, sizeof(tIRMBlock*));
+	tIRMBlock	**stack = malloc(Handle->nBlocks * sizeof(tIRMBlock*));
+	bool	*seen = malloc(Handle->nBlocks * sizeof(bool));
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		tIRMBlock	*blk = Handle->Blocks[i];
+		for( tIRMOp *op = blk->FirstOp; op; op = op->Next )
+		{
+			if( op->Dst != IRM_REG_VOID )
+				ndefs[op->Dst] ++;
+			for( int u = IRM_GetUseCount(op); u --; )
+			{
+				tIRMReg	r = *IRM_GetUse(op, u);
+				if( r != IRM_REG_VOID )
+					targets[r] = (targets[r] ? IRM_CommonDominator(targets[r], blk) : blk);
+			}
+		}
+	}
+
+	tIRMOp	*next;
+	for( tIRMOp *op = entry->FirstOp; op; op = next )
+	{
+		next = op->Next;
+		if( op->Op != IRMOP_ARGUMENT || ndefs[op->Dst] != 1 || !targets[op->Dst] )
+			continue ;
+		if( X86_IRM_int_ArgReg(op) >= 0 )
+			continue ;
+		tIRMBlock	*blk = targets[op->Dst];
+		while( blk != entry && X86_IRM_int_InCycle(Handle, blk, stack, seen) )
+			blk = blk->IDom;
+		if( blk == entry )
+			continue ;
+		IRM_RemoveOp(op);
+		IRM_InsertOpBefore(blk, blk->FirstOp, op);
+	}
+	free(seen);
+	free(stack);
+	free(targets);
+	free(ndefs);
+}
+
+/**
+ * \brief Check if a block can be reached from itself
+ * \param Stack,Seen	Work space, [nBlocks]
+ */
+bool X86_IRM_int_InCycle(tIRMHandle Handle, tIRMBlock *Block, tIRMBlock **Stack, bool *Seen)
+{
+	 int	depth = 0;
+	memset(Seen, 0, Handle->nBlocks * sizeof(bool));
+	Stack[depth++] = Block;
+	while( depth )
+	{
+		tIRMBlock	*blk = Stack[--depth];
+		for( int i = 0; i < blk->nSucc; i ++ )
+		{
+			tIRMBlock	*succ = blk->Succ[i];
+			if( succ == Block )
+				return true;
+			if( !Seen[succ->Index] ) {
+				Seen[succ->Index] = true;
+				Stack[depth++] = succ;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * \brief Generate the blocks, noting which need the frame
+ */
+void X86_IRM_int_EmitBody(tX86IRMState *State, bool *Needs)
+{
+	tIRMHandle	h = State->Handle;
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		tIRMBlock	*blk = h->Blocks[i];
+		uint32_t	used = State->UsedRegs;
+		State->UsedRegs = 0;
+		State->bNeedFrame = false;
+		State->bFramed = (State->FrameBlock && IRM_Dominates(State->FrameBlock, blk));
+		X86_IRM_int_EmitBlock(State, blk, (i + 1 < h->nBlocks ? h->Blocks[i+1] : NULL));
+		Needs[i] = State->bNeedFrame || (State->UsedRegs & gpX86Mode->CalleeSaved);
+		State->UsedRegs |= used;
+	}
+}
+
+/**
+ * \brief Work out the callee-saved registers and stack space the prologue sets up
+ *
+ * The layout is the same with or without a frame pointer, the ebp slot is
+ * just left unused (x86-64 needs it for alignment anyway).
+ * x86-64 callee-saved registers are saved with mov below the locals, the
+ * frame is padded to keep rsp 16-byte aligned. Leaf functions that fit in
+ * the red zone don't move rsp at all.
+ */
+void X86_IRM_int_SizeFrame(tX86IRMState *State)
+{
+	 int	nsaved = 0;
+	State->Saved = State->UsedRegs & gpX86Mode->CalleeSaved;
+	for( int r = 0; r < gpX86Mode->nRegs; r ++ )
+		nsaved += !!(State->Saved & REGBIT(r));
+
+	if( gpX86Mode->Bits == 64 )
+	{
+		 int	size = (State->FrameSize + nsaved*8 + 15) & ~15;
+		// (+8 for the return address, or the ebp slot when it isn't pushed)
+		bool	in_red_zone = !State->bCalls && !State->bPushed && size + (gpX86Mode->bOmitFP ? 8 : 0) <= X86_64_RED_ZONE;
+		if( gpX86Mode->bOmitFP )
+			State->FrameAlloc = (in_red_zone ? 0 : size + 8);
+		else
+			State->FrameAlloc = (in_red_zone ? 0 : size);
+		State->FrameDepth = (gpX86Mode->bOmitFP ? 0 : 8) + State->FrameAlloc;
+	}
+	else
+	{
+		if( gpX86Mode->bOmitFP )
+			State->FrameAlloc = (State->FrameSize > 0 ? State->FrameSize + 4 : 0);
+		else
+			State->FrameAlloc = State->FrameSize;
+		State->FrameDepth = (gpX86Mode->bOmitFP ? 0 : 4) + State->FrameAlloc + nsaved*4;
+	}
+}
+
+/**
+ * \brief Shrink-wrapping, find where the prologue goes
+ *
+ * The prologue is placed at the start of the nearest block dominating
+ * every block that needs the frame, as long as paths from there can only
+ * leave through a return (so the epilogue always runs). Blocks before it
+ * (early exits in particular) return without one. Returns NULL if nothing
+ * needs a frame.
+ */
+tIRMBlock *X86_IRM_int_PlaceFrame(tX86IRMState *State, const bool *Needs)
+{
+	tIRMHandle	h = State->Handle;
+	tIRMBlock	*entry = h->Blocks[0];
+	tIRMBlock	*ret = NULL;
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		if( !Needs[i] )
+			continue ;
+		ret = (ret ? IRM_CommonDominator(ret, h->Blocks[i]) : h->Blocks[i]);
+	}
+
+	while( ret && ret != entry )
+	{
+		bool	ok = true;
+		// Not repeated by a loop
+		for( int i = 0; ok && i < ret->nPred; i ++ )
+			ok = !IRM_Dominates(ret, ret->Pred[i]);
+		// and closed, the epilogue is needed on every exit from the region
+		for( int i = 0; ok && i < h->nBlocks; i ++ )
+		{
+			tIRMBlock	*blk = h->Blocks[i];
+			if( !IRM_Dominates(ret, blk) )
+				continue ;
+			for( int j = 0; j < blk->nSucc; j ++ )
+				ok = ok && IRM_Dominates(ret, blk->Succ[j]);
+		}
+		if( ok )
+			break;
+		ret = ret->IDom;
+	}
+	return ret;
+}
+
+/**
+ * \brief Set up the frame (State->FrameBlock's start)
+ */
+void X86_IRM_int_EmitPrologue(tX86IRMState *State, tAsmOut *Out)
+{
+	const char	*sp = X86_IRM_int_RegName(REG_ESP, gpX86Mode->WordSize);
+	bool	framed = State->bFramed;
+	if( !gpX86Mode->bOmitFP ) {
+		X86_IRM_int_Insn(Out, "push", X86_IRM_int_RegName(REG_EBP, gpX86Mode->WordSize), NULL);
+		X86_IRM_int_Insn(Out, "mov", X86_IRM_int_RegName(REG_EBP, gpX86Mode->WordSize), sp);
+	}
+	if( State->FrameAlloc > 0 )
+		X86_IRM_int_InsnInt(Out, "sub", sp, State->FrameAlloc);
+	State->bFramed = true;
+	if( gpX86Mode->Bits == 64 )
+	{
+		 int	ofs = State->FrameSize;
+		for( int r = 0; r < 16; r ++ )
+		{
+			if( State->Saved & REGBIT(r) ) {
+				ofs += 8;
+				tX86Operand	slot = X86_IRM_int_FrameOpd(State, -ofs, 8);
+				X86_IRM_int_Insn(Out, "mov", X86_IRM_int_Format(&slot), csaX86_64RegR[r]);
+			}
+		}
+		if( State->FrameBlock == State->Handle->Blocks[0] )
+			X86_IRM_int_EmitHomeArgs(State, Out);
+	}
+	else
+	{
+		for( int r = 0; r < 8; r ++ )
+		{
+			if( State->Saved & REGBIT(r) )
+				X86_IRM_int_Insn(Out, "push", csaRegEX[r], NULL);
+		}
+	}
+	State->bFramed = framed;
+}
+
+/**
+ * \brief Shared return path of the blocks after the prologue
+ */
+void X86_IRM_int_EmitEpilogue(tX86IRMState *State, tAsmOut *Out)
+{
+	AsmOut_Str(Out, ".ret:\n");
+	State->bFramed = true;
+	X86_IRM_int_EmitTeardown(State, Out);
+	AsmOut_Str(Out, "\tret\n");
+}
+
+/**
+ * \brief Undo the prologue (esp back at the return address)
+ */
+void X86_IRM_int_EmitTeardown(tX86IRMState *State, tAsmOut *Out)
+{
+	const char	*sp = X86_IRM_int_RegName(REG_ESP, gpX86Mode->WordSize);
+	if( gpX86Mode->Bits == 64 )
+	{
+		 int	ofs = State->FrameSize;
+		for( int r = 0; r < 16; r ++ )
+		{
+			if( State->Saved & REGBIT(r) ) {
+				ofs += 8;
+				tX86Operand	slot = X86_IRM_int_FrameOpd(State, -ofs, 8);
+				X86_IRM_int_Insn(Out, "mov", csaX86_64RegR[r], X86_IRM_int_Format(&slot));
+			}
+		}
+	}
+	else
+	{
+		for( int r = 8; r --; )
+		{
+			if( State->Saved & REGBIT(r) )
+				X86_IRM_int_Insn(Out, "pop", csaRegEX[r], NULL);
+		}
+	}
+	if( !gpX86Mode->bOmitFP )
+		AsmOut_Str(Out, "\tleave\n");
+	else if( State->FrameAlloc > 0 )
+		X86_IRM_int_InsnInt(Out, "add", sp, State->FrameAlloc);
+}
+
+/**
+ * \brief x86-64: Store the register arguments that are read to their home slots
+ *
+ * Done on entry when the prologue is shrink-wrapped, the slots are then in
+ * the red zone until it runs.
+ */
+void X86_IRM_int_EmitHomeArgs(tX86IRMState *State, tAsmOut *Out)
+{
+	if( !gpX86CallConv->bHomed )
+		return ;
+	for( int i = 0; i < gpX86CallConv->nRegArgs; i ++ )
+	{
+		if( State->HomeArgs & REGBIT(i) ) {
+			tX86Operand	slot = X86_IRM_int_FrameOpd(State, -8*(i+1), 8);
+			X86_IRM_int_Insn(Out, "mov", X86_IRM_int_Format(&slot), csaX86_64RegR[gpX86CallConv->ArgRegs[i]]);
+		}
+	}
+}
+
+/**
+ * \brief Register constraints of the calling convention and the x86 instruction set
+ */
+void X86_IRM_GetConstraints(tIRMHandle Handle, const tIRMOp *Op, tRAConstraints *Constraints)
+{
+	switch(Op->Op)
+	{
+	case IRMOP_CALL: {
+		// Direct calls keep the callee in Op->Sym (see X86_IRM_int_SelReduce)
+		const tX86Callee	*callee = (Op->Sym ? X86_IRM_int_FindCallee(Op->Sym) : NULL);
+		const tX86CallConv	*conv = X86_IRM_int_CallConv(Op->Sym);
+		Constraints->ClobberDef = (callee ? callee->Clobbers : gpX86Mode->CallerSaved);
+		for( int i = 0; i < Op->nArgs && i < conv->nRegArgs; i ++ )
+			Constraints->ClobberDef |= REGBIT(conv->ArgRegs[i]);
+		Constraints->DstHint = REG_EAX;
+		break; }
+	case IRMOP_ARGUMENT: {
+		 int	reg = X86_IRM_int_ArgReg(Op);
+		if( reg >= 0 ) {
+			Constraints->LiveIn = REGBIT(reg);
+			Constraints->DstHint = reg;
+		}
+		break; }
+	case IRMOP_DIV:
+	case IRMOP_MOD:
+		// Dividend/quotient in eax, remainder in edx
+		Constraints->ClobberUse = REGBIT(REG_EAX)|REGBIT(REG_EDX);
+		Constraints->DstHint = (Op->Op == IRMOP_DIV ? REG_EAX : REG_EDX);
+		break;
+	case IRMOP_SHL:
+	case IRMOP_SHR:
+		// Count in cl, unless it's an immediate
+		if( Op->FoldMask & 0x2 )
+			break;
+		Constraints->ClobberAll = REGBIT(REG_ECX);
+		Constraints->SrcNeedsReg = 0x1;
+		break;
+	case IRMOP_RETURN:
+		Constraints->SrcHint[0] = REG_EAX;
+		break;
+	case IRMOP_SWITCH:
+		// x86-64 loads the table address into a register first (one is kept free for it)
+		Constraints->SrcNeedsReg = 0x1;
+		if( gpX86Mode->Bits == 64 )
+			Constraints->ClobberAll = REGBIT(REG_ECX);
+		break;
+	case IRMOP_LOAD:
+	case IRMOP_NEG:
+	case IRMOP_NOT:
+	case IRMOP_CAST:
+		Constraints->SrcNeedsReg = 0x1;
+		break;
+	case IRMOP_STORE:
+	case IRMOP_ADD ... IRMOP_MUL:
+	case IRMOP_AND ... IRMOP_XOR:
+	case IRMOP_CMPEQ ... IRMOP_CMPGE:
+		Constraints->SrcNeedsReg = 0x3;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * \brief Execution model of an instruction in its selected form
+ */
+void X86_IRM_GetSchedModel(tIRMHandle Handle, const tIRMOp *Op, int nFoldedLoads, tSchedModel *Model)
+{
+	*Model = caX86SchedModels[Op->Op];
+	if( Op->Op == IRMOP_ARGUMENT && X86_IRM_int_ArgReg(Op) >= 0 )
+		*Model = caX86SchedModels[IRMOP_COPY];
+	switch(Op->Form)
+	{
+	case X86FORM_LEA:
+	case X86FORM_SHIFT:
+		Model->Latency = 1;
+		Model->nUops = 1;
+		Model->UopPorts[0] = X86_PORT_ALU;
+		break;
+	case X86FORM_TEST:
+		if( Op->Op == IRMOP_BRANCH )
+			break;
+		Model->nUops = 3;
+		break;
+	default:
+		break;
+	}
+	// Immediate shift counts don't need ecx
+	if( (Op->Op == IRMOP_SHL || Op->Op == IRMOP_SHR) && (Op->FoldMask & 0x2) )
+		Model->nUops = 1;
+
+	// Loads folded in as memory operands
+	for( int i = 0; i < nFoldedLoads && Model->nUops < SCHED_MAX_UOPS; i ++ )
+		Model->UopPorts[Model->nUops++] = X86_PORT_LOAD;
+	if( nFoldedLoads )
+		Model->Latency += X86_LOAD_LATENCY;
+}
+
+// --- Instruction selection ---
+/**
+ * \brief Select instruction forms by tiling expression trees (bottom-up rewriting)
+ *
+ * Each block is labelled bottom-up: every operation records the cheapest
+ * way to compute it into a register, to use it as a memory operand and to
+ * use it as part of an address (per address shape), with the choices made
+ * for its operands. Operations are then reduced from the roots down,
+ * marking operands that are computed inside their user (tIRMOp.FoldMask)
+ * and operations that no longer need their own instruction
+ * (IRMFLAG_FOLDED).
+ *
+ * Constants, symbol/string addresses and local addresses can be folded
+ * into any number of users. Anything else is only folded into its single
+ * user in the same block, and loads only when nothing in between writes
+ * memory.
+ */
+void X86_IRM_SelectInstructions(tIRMHandle Handle)
+{
+	tX86Selector	sel = {.Handle = Handle};
+	 int	nops = 0;
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			op->Index = nops ++;
+			op->Form = X86FORM_DEFAULT;
+			op->FoldMask = 0;
+			op->Flags &= ~IRMFLAG_FOLDED;
+		}
+	}
+
+	sel.Defs = calloc(Handle->nRegs, sizeof(tIRMOp*));
+	sel.nDefs = calloc(Handle->nRegs, sizeof(int));
+	sel.nUses = calloc(Handle->nRegs, sizeof(int));
+	sel.Users = calloc(Handle->nRegs, sizeof(tIRMOp*));
+	sel.Nodes = calloc(nops, sizeof(tX86SelNode));
+	sel.MemEpoch = calloc(nops, sizeof(int));
+	sel.ReadLimit = calloc(nops, sizeof(int));
+
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		 int	epoch = 0;
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			sel.MemEpoch[op->Index] = epoch;
+			if( op->Op == IRMOP_STORE || op->Op == IRMOP_STORELOCAL || op->Op == IRMOP_CALL )
+				epoch ++;
+			if( op->Dst != IRM_REG_VOID ) {
+				sel.Defs[op->Dst] = op;
+				sel.nDefs[op->Dst] ++;
+			}
+			 int	nuse = IRM_GetUseCount(op);
+			for( int j = 0; j < nuse; j ++ )
+			{
+				tIRMReg	r = *IRM_GetUse(op, j);
+				if( r == IRM_REG_VOID )
+					continue ;
+				sel.nUses[r] ++;
+				sel.Users[r] = op;
+			}
+		}
+	}
+
+	// Next redefinition (in the block) of each operation's operands
+	 int	*next_def = malloc(Handle->nRegs * sizeof(int));
+	 int	*next_def_block = malloc(Handle->nRegs * sizeof(int));
+	for( int r = 0; r < Handle->nRegs; r ++ )
+		next_def_block[r] = -1;
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->LastOp; op; op = op->Prev )
+		{
+			 int	limit = INT_MAX;
+			 int	nuse = IRM_GetUseCount(op);
+			for( int j = 0; j < nuse; j ++ )
+			{
+				tIRMReg	r = *IRM_GetUse(op, j);
+				if( r != IRM_REG_VOID && next_def_block[r] == i && next_def[r] < limit )
+					limit = next_def[r];
+			}
+			sel.ReadLimit[op->Index] = limit;
+			if( op->Dst != IRM_REG_VOID ) {
+				next_def[op->Dst] = op->Index;
+				next_def_block[op->Dst] = i;
+			}
+		}
+	}
+	free(next_def);
+	free(next_def_block);
+
+	// Which operations can be evaluated by their user
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			tX86SelNode	*n = &sel.Nodes[op->Index];
+			tIRMReg	dst = op->Dst;
+
+			// Operands of folded operations are read by the final user
+			 int	nuse = IRM_GetUseCount(op);
+			for( int j = 0; j < nuse; j ++ )
+			{
+				tIRMOp	*def = X86_IRM_int_SelDef(&sel, *IRM_GetUse(op, j));
+				if( def && def->Block == op->Block && sel.Nodes[def->Index].bFoldable
+				 && sel.ReadLimit[def->Index] < sel.ReadLimit[op->Index] )
+					sel.ReadLimit[op->Index] = sel.ReadLimit[def->Index];
+			}
+
+			if( dst == IRM_REG_VOID || sel.nDefs[dst] != 1 || sel.nUses[dst] != 1 )
+				continue ;
+			tIRMOp	*user = sel.Users[dst];
+			if( user->Block != op->Block )
+				continue ;
+			if( Types_GetSizeOf(IRM_GetRegType(Handle, dst)) > gpX86Mode->WordSize )
+				continue ;
+			// - and they must not be redefined before it
+			if( sel.ReadLimit[op->Index] < user->Index )
+				continue ;
+			switch(op->Op)
+			{
+			case IRMOP_LOAD:
+			case IRMOP_LOADLOCAL:
+				if( sel.MemEpoch[user->Index] != sel.MemEpoch[op->Index] )
+					continue ;
+				break;
+			case IRMOP_ARGUMENT:	// Argument slots are never written
+				if( X86_IRM_int_ArgReg(op) >= 0 )
+					continue ;
+				break;
+			case IRMOP_ADD:
+			case IRMOP_SUB:
+			case IRMOP_MUL:
+			case IRMOP_SHL:
+			case IRMOP_AND:
+				break;
+			case IRMOP_CMPEQ ... IRMOP_CMPGE:	// Into a branch/select on it
+				if( user->Op != IRMOP_BRANCH && !(user->Op == IRMOP_SELECT && user->Src[0] == dst) )
+					continue ;
+				break;
+			default:
+				continue ;
+			}
+			n->bFoldable = true;
+		}
+	}
+
+	// Label (operands come before their users in a block)
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+			X86_IRM_int_SelLabel(&sel, op);
+	}
+
+	// Reduce from the roots (users are reached before what they fold)
+	for( int i = Handle->nBlocks; i --; )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->LastOp; op; op = op->Prev )
+		{
+			if( !(op->Flags & IRMFLAG_FOLDED) )
+				X86_IRM_int_SelReduce(&sel, op);
+		}
+	}
+
+	// Rematerialised values embedded by every user need no instruction
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			tX86SelNode	*n = &sel.Nodes[op->Index];
+			if( op->Dst != IRM_REG_VOID && n->nEmbedded > 0 && n->nEmbedded == sel.nUses[op->Dst] )
+				op->Flags |= IRMFLAG_FOLDED;
+		}
+	}
+
+	free(sel.Defs);
+	free(sel.nDefs);
+	free(sel.nUses);
+	free(sel.Users);
+	free(sel.Nodes);
+	free(sel.MemEpoch);
+	free(sel.ReadLimit);
+}
+
+static tIRMOp *X86_IRM_int_SelDef(tX86Selector *S, tIRMReg Reg)
+{
+	if( Reg == IRM_REG_VOID || S->nDefs[Reg] != 1 )
+		return NULL;
+	return S->Defs[Reg];
+}
+
+/**
+ * \brief Can a value be an immediate operand
+ *
+ * x86-64 immediates are sign extended 32-bit values, and symbol addresses
+ * are only reachable RIP relative (so never immediates).
+ */
+static bool X86_IRM_int_SelIsImm(tX86Selector *S, const tIRMOp *Def)
+{
+	if( !Def )
+		return false;
+	if( Def->Op == IRMOP_CONST )
+		return Types_GetSizeOf(IRM_GetRegType(S->Handle, Def->Dst)) <= 4 || X86_IRM_int_FitsImm(Def->Imm);
+	if( Def->Op == IRMOP_SYMADDR || Def->Op == IRMOP_STRING )
+		return gpX86Mode->Bits == 32;
+	return false;
+}
+
+static bool X86_IRM_int_SelIsRemat(const tIRMOp *Def)
+{
+	return Def && (Def->Op == IRMOP_CONST || Def->Op == IRMOP_SYMADDR || Def->Op == IRMOP_STRING
+		|| Def->Op == IRMOP_LOCALADDR);
+}
+
+//! \brief Constant value of a register (if it's defined by a CONST that fits an immediate)
+static bool X86_IRM_int_SelConst(tX86Selector *S, tIRMReg Reg, uint32_t *Value)
+{
+	tIRMOp	*def = X86_IRM_int_SelDef(S, Reg);
+	if( !def || def->Op != IRMOP_CONST || !X86_IRM_int_SelIsImm(S, def) )
+		return false;
+	*Value = def->Imm;
+	return true;
+}
+
+/**
+ * \brief Operands a call argument can take
+ *
+ * x86-64 pushes them as qwords (so not memory), register arguments are
+ * moved into place all together (from registers or immediates).
+ */
+static int X86_IRM_int_SelArgAccept(const tX86CallConv *Conv, int Index)
+{
+	return X86_ACCEPT_IMM | (gpX86Mode->Bits == 32 && Index >= Conv->nRegArgs ? X86_ACCEPT_MEM : 0);
+}
+
+//! \brief Function a call is made to directly (NULL if it's through a pointer)
+static const tSymbol *X86_IRM_int_SelCallee(tX86Selector *S, tIRMOp *Call)
+{
+	tIRMOp	*def = X86_IRM_int_SelDef(S, Call->Src[0]);
+	return (def && def->Op == IRMOP_SYMADDR ? def->Sym : NULL);
+}
+
+/**
+ * \brief Cheapest operand for a call target
+ *
+ * A known function is called directly (rel32, in both modes), and a
+ * pointer loaded once is called through memory.
+ */
+static int X86_IRM_int_SelCallTarget(tX86Selector *S, tIRMOp *Call, uint8_t *Choice)
+{
+	if( X86_IRM_int_SelCallee(S, Call) ) {
+		*Choice = X86_KID(X86NT_IMM, 0);
+		return 0;
+	}
+	return X86_IRM_int_SelKidCost(S, Call, Call->Src[0], X86_ACCEPT_MEM, Choice);
+}
+
+/**
+ * \brief Combine two partial address shapes (-1 if x86 can't encode the result)
+ */
+static int X86_IRM_int_SelCombine(int A, int B)
+{
+	 int	regs = X86_SHAPE_REGS(A) + X86_SHAPE_REGS(B);
+	 int	scaled = !!(A & X86_SHAPE_SCALED) + !!(B & X86_SHAPE_SCALED);
+	 int	syms = !!(A & X86_SHAPE_SYM) + !!(B & X86_SHAPE_SYM);
+	if( scaled > 1 || syms > 1 || regs + scaled > 2 )
+		return -1;
+	// RIP relative addresses have no registers
+	if( gpX86Mode->Bits == 64 && syms && regs + scaled )
+		return -1;
+	return regs | (scaled ? X86_SHAPE_SCALED : 0) | (syms ? X86_SHAPE_SYM : 0);
+}
+
+/**
+ * \brief Cost of computing a register for User (0 if it's shared or from another block)
+ */
+static int X86_IRM_int_SelRegCost(tX86Selector *S, tIRMOp *User, tIRMReg Reg)
+{
+	tIRMOp	*def = X86_IRM_int_SelDef(S, Reg);
+	if( !def || S->nUses[Reg] != 1 || def->Block != User->Block )
+		return 0;
+	return S->Nodes[def->Index].RegCost;
+}
+
+/**
+ * \brief Cheapest way for User to consume a register
+ * \param Accept	Operand kinds User can take besides a register (X86_ACCEPT_*)
+ */
+int X86_IRM_int_SelKidCost(tX86Selector *S, tIRMOp *User, tIRMReg Reg, int Accept, uint8_t *Choice)
+{
+	 int	best = X86_IRM_int_SelRegCost(S, User, Reg);
+	*Choice = X86_KID(X86NT_REG, 0);
+
+	tIRMOp	*def = X86_IRM_int_SelDef(S, Reg);
+	if( !def )
+		return best;
+	tX86SelNode	*n = &S->Nodes[def->Index];
+	if( (Accept & X86_ACCEPT_IMM) && X86_IRM_int_SelIsImm(S, def) ) {
+		best = 0;
+		*Choice = X86_KID(X86NT_IMM, 0);
+	}
+	if( (Accept & (X86_ACCEPT_MEM|X86_ACCEPT_MEMX)) && n->bFoldable && S->Users[Reg] == User && n->MemCost < best )
+	{
+		size_t	size = Types_GetSizeOf(IRM_GetRegType(S->Handle, Reg));
+		if( size == 4 || size == gpX86Mode->WordSize || (Accept & X86_ACCEPT_MEMX) ) {
+			best = n->MemCost;
+			*Choice = X86_KID(X86NT_MEM, 0);
+		}
+	}
+	return best;
+}
+
+/**
+ * \brief Cost for User to use a register as an address component of a shape
+ */
+int X86_IRM_int_SelAddrCost(tX86Selector *S, tIRMOp *User, tIRMReg Reg, int Shape, uint8_t *Choice)
+{
+	 int	best = X86_COST_INF;
+	if( Shape == 1 ) {
+		best = X86_IRM_int_SelRegCost(S, User, Reg);
+		*Choice = X86_KID(X86NT_REG, 0);
+	}
+	tIRMOp	*def = X86_IRM_int_SelDef(S, Reg);
+	if( !def )
+		return best;
+	tX86SelNode	*n = &S->Nodes[def->Index];
+	if( !X86_IRM_int_SelIsRemat(def) && !(n->bFoldable && S->Users[Reg] == User) )
+		return best;
+	// Folding wins ties, it saves a register
+	if( n->AddrCost[Shape] <= best ) {
+		best = n->AddrCost[Shape];
+		*Choice = X86_KID(X86NT_ADDR, Shape);
+	}
+	return best;
+}
+
+/**
+ * \brief Cheapest complete address for User's register
+ */
+int X86_IRM_int_SelBestAddr(tX86Selector *S, tIRMOp *User, tIRMReg Reg, uint8_t *Choice)
+{
+	 int	best = X86_COST_INF, best_regs = 0;
+	for( int s = 0; s < X86_NSHAPES; s ++ )
+	{
+		uint8_t	c;
+		 int	cost = X86_IRM_int_SelAddrCost(S, User, Reg, s, &c);
+		// Ties go to the address using fewer registers
+		if( cost < best || (cost == best && X86_SHAPE_REGS(s) < best_regs) ) {
+			best = cost;
+			best_regs = X86_SHAPE_REGS(s);
+			*Choice = c;
+		}
+	}
+	return best;
+}
+
+/**
+ * \brief Compute the costs/choices of an operation (its operands are already labelled)
+ */
+void X86_IRM_int_SelLabel(tX86Selector *S, tIRMOp *Op)
+{
+	tX86SelNode	*n = &S->Nodes[Op->Index];
+	uint32_t	val;
+	n->RegCost = caX86OpCosts[Op->Op];
+	n->Form = X86FORM_DEFAULT;
+	n->Kids[0] = n->Kids[1] = n->Kids[2] = X86_KID(X86NT_REG, 0);
+	n->MemCost = X86_COST_INF;
+
+	X86_IRM_int_SelLabelAddress(S, Op);
+
+	switch(Op->Op)
+	{
+	case IRMOP_LOAD:
+		n->RegCost += X86_IRM_int_SelBestAddr(S, Op, Op->Src[0], &n->Kids[0]);
+		n->MemCost = X86COST_MEMOP + X86_IRM_int_SelBestAddr(S, Op, Op->Src[0], &n->MemKid);
+		break;
+	case IRMOP_LOADLOCAL:
+	case IRMOP_ARGUMENT:
+		n->MemCost = X86COST_MEMOP;
+		break;
+	case IRMOP_STORE:
+		n->RegCost += X86_IRM_int_SelBestAddr(S, Op, Op->Src[0], &n->Kids[0]);
+		n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Src[1], X86_ACCEPT_IMM, &n->Kids[1]);
+		break;
+	case IRMOP_STORELOCAL:
+		n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_IMM, &n->Kids[0]);
+		break;
+	case IRMOP_COPY:
+	case IRMOP_NEG:
+	case IRMOP_NOT:
+		n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_IMM|X86_ACCEPT_MEMX, &n->Kids[0]);
+		break;
+	case IRMOP_RETURN:
+		if( Op->Src[0] != IRM_REG_VOID )
+			n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_IMM|X86_ACCEPT_MEMX, &n->Kids[0]);
+		break;
+	case IRMOP_CAST:
+		n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_MEMX, &n->Kids[0]);
+		break;
+	case IRMOP_ADD ... IRMOP_MUL:
+	case IRMOP_AND ... IRMOP_XOR:
+		X86_IRM_int_SelLabelBinOp(S, Op);
+		break;
+	case IRMOP_DIV:
+	case IRMOP_MOD:
+		// Divisor is r/m32
+		n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_IMM|X86_ACCEPT_MEMX, &n->Kids[0]);
+		n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Src[1], X86_ACCEPT_MEM, &n->Kids[1]);
+		break;
+	case IRMOP_SHL:
+	case IRMOP_SHR:
+		n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_IMM|X86_ACCEPT_MEMX, &n->Kids[0]);
+		// Only a constant count can be an immediate
+		n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Src[1],
+			(X86_IRM_int_SelConst(S, Op->Src[1], &val) ? X86_ACCEPT_IMM : 0)|X86_ACCEPT_MEMX, &n->Kids[1]);
+		if( X86_KID_NT(n->Kids[1]) == X86NT_IMM )
+			n->RegCost += X86COST_SHIFT - caX86OpCosts[Op->Op];
+		break;
+	case IRMOP_CMPEQ ... IRMOP_CMPGE:
+		X86_IRM_int_SelLabelCompare(S, Op);
+		break;
+	case IRMOP_CALL: {
+		const tX86CallConv	*conv = X86_IRM_int_CallConv(X86_IRM_int_SelCallee(S, Op));
+		n->RegCost += X86_IRM_int_SelCallTarget(S, Op, &n->Kids[0]);
+		for( int i = 0; i < Op->nArgs; i ++ )
+		{
+			uint8_t	c;
+			n->RegCost += X86_IRM_int_SelKidCost(S, Op, Op->Args[i], X86_IRM_int_SelArgAccept(conv, i), &c);
+		}
+		break; }
+	case IRMOP_SELECT:
+		X86_IRM_int_SelLabelSelect(S, Op);
+		break;
+	case IRMOP_BRANCH:
+		X86_IRM_int_SelLabelBranch(S, Op);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * \brief Costs of an operation as part of an address
+ */
+void X86_IRM_int_SelLabelAddress(tX86Selector *S, tIRMOp *Op)
+{
+	tX86SelNode	*n = &S->Nodes[Op->Index];
+	uint32_t	val;
+	for( int s = 0; s < X86_NSHAPES; s ++ )
+		n->AddrCost[s] = X86_COST_INF;
+
+	switch(Op->Op)
+	{
+	case IRMOP_CONST:
+		if( X86_IRM_int_SelIsImm(S, Op) )
+			n->AddrCost[0] = 0;
+		return ;
+	case IRMOP_SYMADDR:
+	case IRMOP_STRING:
+		n->AddrCost[X86_SHAPE_SYM] = 0;
+		return ;
+	case IRMOP_LOCALADDR:
+		// ebp + offset
+		n->AddrCost[1] = 0;
+		return ;
+	case IRMOP_ADD:
+	case IRMOP_SUB:
+	case IRMOP_SHL:
+	case IRMOP_MUL:
+		break;
+	default:
+		return ;
+	}
+	// (4-byte values can still use lea in 64-bit code, they are never part of a pointer)
+	size_t	size = Types_GetSizeOf(IRM_GetRegType(S->Handle, Op->Dst));
+	if( size != 4 && size != gpX86Mode->WordSize )
+		return ;
+
+	switch(Op->Op)
+	{
+	case IRMOP_ADD:
+		for( int a = 0; a < X86_NSHAPES; a ++ )
+		{
+			uint8_t	ca, cb;
+			 int	cost_a = X86_IRM_int_SelAddrCost(S, Op, Op->Src[0], a, &ca);
+			if( cost_a >= X86_COST_INF )
+				continue ;
+			for( int b = 0; b < X86_NSHAPES; b ++ )
+			{
+				 int	shape = X86_IRM_int_SelCombine(a, b);
+				if( shape < 0 )
+					continue ;
+				 int	cost = cost_a + X86_IRM_int_SelAddrCost(S, Op, Op->Src[1], b, &cb);
+				if( cost < n->AddrCost[shape] ) {
+					n->AddrCost[shape] = cost;
+					n->AddrKids[shape][0] = ca;
+					n->AddrKids[shape][1] = cb;
+				}
+			}
+		}
+		break;
+	case IRMOP_SUB:
+		// x - constant
+		if( !X86_IRM_int_SelConst(S, Op->Src[1], &val) )
+			break;
+		for( int a = 0; a < X86_NSHAPES; a ++ )
+		{
+			uint8_t	ca;
+			 int	cost = X86_IRM_int_SelAddrCost(S, Op, Op->Src[0], a, &ca);
+			if( cost < n->AddrCost[a] ) {
+				n->AddrCost[a] = cost;
+				n->AddrKids[a][0] = ca;
+				n->AddrKids[a][1] = X86_KID(X86NT_IMM, 0);
+			}
+		}
+		break;
+	case IRMOP_SHL:
+	case IRMOP_MUL: {
+		// Scaled index (x*3/5/9 uses the register as base and index)
+		if( !X86_IRM_int_SelConst(S, Op->Src[1], &val) )
+			break;
+		 int	shape;
+		if( Op->Op == IRMOP_SHL )
+			shape = (val >= 1 && val <= 3 ? X86_SHAPE_SCALED : -1);
+		else if( val == 2 || val == 4 || val == 8 )
+			shape = X86_SHAPE_SCALED;
+		else if( val == 3 || val == 5 || val == 9 )
+			shape = 1 | X86_SHAPE_SCALED;
+		else
+			shape = -1;
+		if( shape < 0 )
+			break;
+		n->AddrCost[shape] = X86_IRM_int_SelRegCost(S, Op, Op->Src[0]);
+		n->AddrKids[shape][0] = X86_KID(X86NT_REG, 0);
+		n->AddrKids[shape][1] = X86_KID(X86NT_IMM, 0);
+		break; }
+	default:
+		break;
+	}
+}
+
+/**
+ * \brief Two-address ALU forms, immediate/memory operands, lea and shifts
+ */
+void X86_IRM_int_SelLabelBinOp(tX86Selector *S, tIRMOp *Op)
+{
+	tX86SelNode	*n = &S->Nodes[Op->Index];
+	bool	commutative = (Op->Op != IRMOP_SUB);
+	 int	base = caX86OpCosts[Op->Op];
+	uint32_t	val;
+
+	n->RegCost = X86_COST_INF;
+	for( int swap = 0; swap < (commutative ? 2 : 1); swap ++ )
+	{
+		tIRMReg	left = Op->Src[swap], right = Op->Src[!swap];
+		uint8_t	kl, kr;
+		 int	cost;
+		if( Op->Op == IRMOP_MUL && X86_IRM_int_SelConst(S, right, &val) )
+		{
+			// imul r, r/m32, imm32 (three operand)
+			cost = base + X86_IRM_int_SelKidCost(S, Op, left, X86_ACCEPT_MEM, &kl);
+			kr = X86_KID(X86NT_IMM, 0);
+		}
+		else
+		{
+			cost = base + X86_IRM_int_SelKidCost(S, Op, left, X86_ACCEPT_IMM|X86_ACCEPT_MEMX, &kl);
+			cost += X86_IRM_int_SelKidCost(S, Op, right,
+				(Op->Op == IRMOP_MUL ? X86_ACCEPT_MEM : X86_ACCEPT_IMM|X86_ACCEPT_MEM), &kr);
+			// The left value has to be copied if it's still needed
+			if( X86_KID_NT(kl) == X86NT_REG && S->nUses[left] > 1 )
+				cost += X86COST_MOV;
+		}
+		if( cost < n->RegCost ) {
+			n->RegCost = cost;
+			n->Form = (swap ? X86FORM_SWAP : X86FORM_DEFAULT);
+			n->Kids[swap] = kl;
+			n->Kids[!swap] = kr;
+		}
+	}
+
+	// Multiply by a power of two
+	if( Op->Op == IRMOP_MUL && X86_IRM_int_SelConst(S, Op->Src[1], &val) && val && !(val & (val - 1)) )
+	{
+		uint8_t	kl;
+		 int	cost = X86COST_SHIFT + X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_IMM|X86_ACCEPT_MEMX, &kl);
+		if( X86_KID_NT(kl) == X86NT_REG && S->nUses[Op->Src[0]] > 1 )
+			cost += X86COST_MOV;
+		if( cost < n->RegCost ) {
+			n->RegCost = cost;
+			n->Form = X86FORM_SHIFT;
+			n->Kids[0] = kl;
+			n->Kids[1] = X86_KID(X86NT_IMM, 0);
+		}
+	}
+
+	// Address arithmetic with lea (three operand, leaves the flags alone)
+	if( Op->Op == IRMOP_ADD || Op->Op == IRMOP_SUB || Op->Op == IRMOP_MUL )
+	{
+		for( int s = 0; s < X86_NSHAPES; s ++ )
+		{
+			 int	cost = X86COST_LEA + n->AddrCost[s];
+			if( cost < n->RegCost || (n->Form == X86FORM_LEA && cost == n->RegCost && X86_SHAPE_REGS(s) < X86_SHAPE_REGS(n->LeaShape)) ) {
+				n->RegCost = cost;
+				n->Form = X86FORM_LEA;
+				n->LeaShape = s;
+			}
+		}
+	}
+}
+
+/**
+ * \brief cmp r/m32, r/imm/m32 (not both memory), or test against zero
+ */
+void X86_IRM_int_SelLabelCompare(tX86Selector *S, tIRMOp *Op)
+{
+	tX86SelNode	*n = &S->Nodes[Op->Index];
+	 int	base = caX86OpCosts[Op->Op];
+	uint8_t	kl, kr;
+	uint32_t	val;
+
+	 int	cl = X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_MEM, &kl);
+	 int	cr = X86_IRM_int_SelKidCost(S, Op, Op->Src[1], X86_ACCEPT_IMM|X86_ACCEPT_MEM, &kr);
+	if( X86_KID_NT(kl) == X86NT_MEM && X86_KID_NT(kr) == X86NT_MEM )
+	{
+		uint8_t	kl2, kr2;
+		 int	cl2 = X86_IRM_int_SelKidCost(S, Op, Op->Src[0], 0, &kl2);
+		 int	cr2 = X86_IRM_int_SelKidCost(S, Op, Op->Src[1], X86_ACCEPT_IMM, &kr2);
+		if( cl2 + cr <= cl + cr2 ) {
+			cl = cl2;	kl = kl2;
+		}
+		else {
+			cr = cr2;	kr = kr2;
+		}
+	}
+	n->RegCost = base + cl + cr;
+	n->Kids[0] = kl;
+	n->Kids[1] = kr;
+
+	if( (Op->Op == IRMOP_CMPEQ || Op->Op == IRMOP_CMPNE)
+	 && X86_IRM_int_SelConst(S, Op->Src[1], &val) && val == 0 )
+	{
+		n->RegCost = base - 1 + X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_MEM, &n->Kids[0]);
+		n->Kids[1] = X86_KID(X86NT_IMM, 0);
+		n->Form = X86FORM_TEST;
+	}
+}
+
+/**
+ * \brief Branch on a register/memory value, on an AND with test, or on a comparison with cmp + jcc
+ */
+void X86_IRM_int_SelLabelBranch(tX86Selector *S, tIRMOp *Op)
+{
+	tX86SelNode	*n = &S->Nodes[Op->Index];
+	 int	base = caX86OpCosts[Op->Op];
+	n->RegCost = base + X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_MEMX, &n->Kids[0]);
+
+	tIRMOp	*def = X86_IRM_int_SelDef(S, Op->Src[0]);
+	if( !def || !S->Nodes[def->Index].bFoldable || S->Users[Op->Src[0]] != Op )
+		return ;
+	// (the folded operation's operands are read at the branch)
+	 int	mem = (S->MemEpoch[def->Index] == S->MemEpoch[Op->Index] ? X86_ACCEPT_MEM : 0);
+	if( def->Op >= IRMOP_CMPEQ && def->Op <= IRMOP_CMPGE )
+	{
+		// cmp r/m, r/imm + jcc, never worse than materialising the flag and testing it
+		uint8_t	ka, kb;
+		 int	cost = base;
+		cost += X86_IRM_int_SelKidCost(S, def, def->Src[0], mem, &ka);
+		cost += X86_IRM_int_SelKidCost(S, def, def->Src[1],
+			X86_ACCEPT_IMM|(X86_KID_NT(ka) == X86NT_MEM ? 0 : mem), &kb);
+		n->RegCost = cost;
+		n->Form = X86FORM_CMP;
+		n->TestKids[0] = ka;
+		n->TestKids[1] = kb;
+		return ;
+	}
+	if( def->Op != IRMOP_AND )
+		return ;
+	// test r/m32, r32/imm32
+	for( int swap = 0; swap < 2; swap ++ )
+	{
+		uint8_t	ka, kb;
+		 int	cost = base;
+		cost += X86_IRM_int_SelKidCost(S, def, def->Src[swap], mem, &ka);
+		cost += X86_IRM_int_SelKidCost(S, def, def->Src[!swap], X86_ACCEPT_IMM, &kb);
+		if( cost < n->RegCost ) {
+			n->RegCost = cost;
+			n->Form = X86FORM_TEST;
+			n->TestKids[swap] = ka;
+			n->TestKids[!swap] = kb;
+		}
+	}
+}
+
+/**
+ * \brief Select on a register/memory value, or on a comparison folded into a cmp
+ *
+ * The arms can be immediates (materialised by the emitter) or memory
+ * (cmovcc r, r/m).
+ */
+void X86_IRM_int_SelLabelSelect(tX86Selector *S, tIRMOp *Op)
+{
+	tX86SelNode	*n = &S->Nodes[Op->Index];
+	 int	base = caX86OpCosts[Op->Op];
+	 int	arms = X86_IRM_int_SelKidCost(S, Op, Op->Args[0], X86_ACCEPT_IMM|X86_ACCEPT_MEM, &n->Kids[1])
+		+ X86_IRM_int_SelKidCost(S, Op, Op->Args[1], X86_ACCEPT_IMM|X86_ACCEPT_MEM, &n->Kids[2]);
+	n->RegCost = base + arms + X86_IRM_int_SelKidCost(S, Op, Op->Src[0], X86_ACCEPT_MEM, &n->Kids[0]);
+
+	tIRMOp	*def = X86_IRM_int_SelDef(S, Op->Src[0]);
+	if( !def || !S->Nodes[def->Index].bFoldable || S->Users[Op->Src[0]] != Op
+	 || def->Op < IRMOP_CMPEQ || def->Op > IRMOP_CMPGE )
+		return ;
+	 int	mem = (S->MemEpoch[def->Index] == S->MemEpoch[Op->Index] ? X86_ACCEPT_MEM : 0);
+	uint8_t	ka, kb;
+	 int	cost = base + arms;
+	cost += X86_IRM_int_SelKidCost(S, def, def->Src[0], mem, &ka);
+	cost += X86_IRM_int_SelKidCost(S, def, def->Src[1],
+		X86_ACCEPT_IMM|(X86_KID_NT(ka) == X86NT_MEM ? 0 : mem), &kb);
+	n->RegCost = cost;
+	n->Form = X86FORM_CMP;
+	n->TestKids[0] = ka;
+	n->TestKids[1] = kb;
+}
+
+/**
+ * \brief Apply the chosen form of a root operation
+ */
+void X86_IRM_int_SelReduce(tX86Selector *S, tIRMOp *Op)
+{
+	tX86SelNode	*n = &S->Nodes[Op->Index];
+	Op->Form = n->Form;
+	switch(Op->Op)
+	{
+	case IRMOP_CALL: {
+		// (the allocator and the emitter need to know the callee)
+		Op->Sym = X86_IRM_int_SelCallee(S, Op);
+		const tX86CallConv	*conv = X86_IRM_int_CallConv(Op->Sym);
+		X86_IRM_int_SelReduceKid(S, Op, 0, n->Kids[0]);
+		for( int i = 0; i < Op->nArgs; i ++ )
+		{
+			uint8_t	c;
+			X86_IRM_int_SelKidCost(S, Op, Op->Args[i], X86_IRM_int_SelArgAccept(conv, i), &c);
+			X86_IRM_int_SelReduceKid(S, Op, 1 + i, c);
+		}
+		break; }
+	case IRMOP_BRANCH:
+		if( n->Form == X86FORM_TEST || n->Form == X86FORM_CMP ) {
+			tIRMOp	*def = S->Defs[Op->Src[0]];
+			Op->FoldMask |= 0x1;
+			def->Flags |= IRMFLAG_FOLDED;
+			X86_IRM_int_SelReduceKid(S, def, 0, n->TestKids[0]);
+			X86_IRM_int_SelReduceKid(S, def, 1, n->TestKids[1]);
+		}
+		else
+			X86_IRM_int_SelReduceKid(S, Op, 0, n->Kids[0]);
+		break;
+	case IRMOP_SELECT:
+		if( n->Form == X86FORM_CMP ) {
+			tIRMOp	*def = S->Defs[Op->Src[0]];
+			Op->FoldMask |= 0x1;
+			def->Flags |= IRMFLAG_FOLDED;
+			X86_IRM_int_SelReduceKid(S, def, 0, n->TestKids[0]);
+			X86_IRM_int_SelReduceKid(S, def, 1, n->TestKids[1]);
+		}
+		else
+			X86_IRM_int_SelReduceKid(S, Op, 0, n->Kids[0]);
+		X86_IRM_int_SelReduceKid(S, Op, 1, n->Kids[1]);
+		X86_IRM_int_SelReduceKid(S, Op, 2, n->Kids[2]);
+		break;
+	default:
+		if( n->Form == X86FORM_LEA ) {
+			X86_IRM_int_SelReduceAddress(S, Op, n->LeaShape);
+			break;
+		}
+		for( int i = 0; i < 2 && i < IRM_GetUseCount(Op); i ++ )
+			X86_IRM_int_SelReduceKid(S, Op, i, n->Kids[i]);
+		break;
+	}
+}
+
+/**
+ * \brief Fold an operand into its user as chosen
+ */
+void X86_IRM_int_SelReduceKid(tX86Selector *S, tIRMOp *User, int Use, uint8_t Choice)
+{
+	if( X86_KID_NT(Choice) == X86NT_REG || Use >= 32 )
+		return ;
+	tIRMReg	reg = *IRM_GetUse(User, Use);
+	tIRMOp	*def = S->Defs[reg];
+	tX86SelNode	*n = &S->Nodes[def->Index];
+
+	User->FoldMask |= 1U << Use;
+	if( X86_IRM_int_SelIsRemat(def) ) {
+		n->nEmbedded ++;
+		return ;
+	}
+	def->Flags |= IRMFLAG_FOLDED;
+	switch( X86_KID_NT(Choice) )
+	{
+	case X86NT_MEM:
+		if( def->Op == IRMOP_LOAD )
+			X86_IRM_int_SelReduceKid(S, def, 0, n->MemKid);
+		break;
+	case X86NT_ADDR:
+		X86_IRM_int_SelReduceAddress(S, def, X86_KID_SHAPE(Choice));
+		break;
+	default:
+		break;
+	}
+}
+
+void X86_IRM_int_SelReduceAddress(tX86Selector *S, tIRMOp *Op, int Shape)
+{
+	tX86SelNode	*n = &S->Nodes[Op->Index];
+	switch(Op->Op)
+	{
+	case IRMOP_ADD:
+	case IRMOP_SUB:
+	case IRMOP_SHL:
+	case IRMOP_MUL:
+		X86_IRM_int_SelReduceKid(S, Op, 0, n->AddrKids[Shape][0]);
+		X86_IRM_int_SelReduceKid(S, Op, 1, n->AddrKids[Shape][1]);
+		break;
+	default:
+		break;
+	}
+}
+
+// --- Frame and emission ---
+/**
+ * \brief Assign stack slots to locals that are still in memory, then spill slots
+ *
+ * Locals are sized and aligned from the target layout, and share a slot when
+ * they are never alive at the same time. For locals that have their address
+ * taken that means being declared in unrelated block scopes, for the rest it
+ * is their live ranges (first to last position they are live at) not
+ * overlapping. x86-64 register arguments get the first slots below rbp, the
+ * prologue stores them there.
+ */
+void X86_IRM_int_LayoutFrame(tX86IRMState *State)
+{
+	tIRMHandle	h = State->Handle;
+	tRegAllocation	*ra = State->RA;
+	 int	word = gpX86Mode->WordSize;
+	 int	ofs = 0;
+	 int	*start = malloc(h->nLocals * sizeof(int) + 1);
+	 int	*end = malloc(h->nLocals * sizeof(int) + 1);
+	State->LocalOffsets = calloc(h->nLocals, sizeof(int));
+	for( int i = 0; i < h->nLocals; i ++ ) {
+		start[i] = INT_MAX;
+		end[i] = -1;
+	}
+
+	// Where each access really happens (folded loads run inside their user)
+	 int	*exec_pos = malloc(ra->nOps * sizeof(int) + 1);
+	 int	*use_pos = calloc(h->nRegs, sizeof(int));
+	for( int i = ra->nOps; i --; )
+	{
+		tIRMOp	*op = ra->Ops[i];
+		exec_pos[i] = i;
+		if( (op->Flags & IRMFLAG_FOLDED) && op->Dst != IRM_REG_VOID && use_pos[op->Dst] > i )
+			exec_pos[i] = use_pos[op->Dst];
+		for( int u = IRM_GetUseCount(op); u --; )
+		{
+			tIRMReg	r = *IRM_GetUse(op, u);
+			if( r != IRM_REG_VOID && use_pos[r] < exec_pos[i] )
+				use_pos[r] = exec_pos[i];
+		}
+	}
+	for( int i = 0; i < ra->nOps; i ++ )
+	{
+		tIRMOp	*op = ra->Ops[i];
+		if( op->Op == IRMOP_LOADLOCAL || op->Op == IRMOP_STORELOCAL || op->Op == IRMOP_LOCALADDR ) {
+			State->LocalOffsets[op->Local] = 1;
+			if( start[op->Local] > i )
+				start[op->Local] = i;
+			if( end[op->Local] < exec_pos[i] )
+				end[op->Local] = exec_pos[i];
+		}
+		if( gpX86CallConv->bHomed && op->Op == IRMOP_ARGUMENT && op->Imm < gpX86CallConv->nRegArgs ) {
+			State->HomeArgs |= REGBIT(op->Imm);
+			if( ofs < 8*((int)op->Imm + 1) )
+				ofs = 8*((int)op->Imm + 1);
+		}
+	}
+	free(use_pos);
+	free(exec_pos);
+
+	// Values carried between blocks (around loops in particular)
+	X86_IRM_int_LocalLiveness(State, start, end);
+
+	// Greedy colouring, largest first (then by first use)
+	 int	*order = malloc(h->nLocals * sizeof(int) + 1);
+	 int	*slot_of = malloc(h->nLocals * sizeof(int) + 1);
+	size_t	*sizes = malloc(h->nLocals * sizeof(size_t) + 1);
+	 int	nOrder = 0;
+	for( int i = 0; i < h->nLocals; i ++ )
+	{
+		if( !State->LocalOffsets[i] )
+			continue ;
+		sizes[i] = Types_GetSizeOf(h->Locals[i].Type);
+		 int	j = nOrder ++;
+		for( ; j > 0; j -- )
+		{
+			 int	prev = order[j-1];
+			if( sizes[prev] > sizes[i] || (sizes[prev] == sizes[i] && start[prev] <= start[i]) )
+				break;
+			order[j] = prev;
+		}
+		order[j] = i;
+	}
+	struct {
+		 int	Ofs;	//!< ebp relative
+		 int	Size;
+	}	*slots = malloc(nOrder * sizeof(*slots) + 1);
+	 int	nSlots = 0;
+	 int	frame_align = word;
+	for( int i = 0; i < nOrder; i ++ )
+	{
+		 int	lcl = order[i];
+		 int	size = sizes[lcl];
+		 int	align = Types_GetAlignOf(h->Locals[lcl].Type);
+		if( size == 0 )
+			size = word;
+		if( align > frame_align )
+			frame_align = align;
+		// Smallest slot it fits in that isn't in use while it is
+		 int	best = -1;
+		for( int s = 0; s < nSlots; s ++ )
+		{
+			if( slots[s].Size < size || (-slots[s].Ofs) % align )
+				continue ;
+			if( best >= 0 && slots[best].Size <= slots[s].Size )
+				continue ;
+			bool	free_slot = true;
+			for( int j = 0; j < i && free_slot; j ++ )
+			{
+				if( slot_of[order[j]] == s && X86_IRM_int_LocalsInterfere(State, lcl, order[j], start, end) )
+					free_slot = false;
+			}
+			if( free_slot )
+				best = s;
+		}
+		if( best < 0 ) {
+			ofs = (ofs + size + align-1) & ~(align-1);
+			best = nSlots ++;
+			slots[best].Ofs = -ofs;
+			slots[best].Size = size;
+		}
+		slot_of[lcl] = best;
+		State->LocalOffsets[lcl] = slots[best].Ofs;
+	}
+	free(slots);
+	free(slot_of);
+	free(sizes);
+	free(order);
+	free(start);
+	free(end);
+
+	ofs = (ofs + word-1) & ~(word-1);
+	State->SpillBase = -ofs;
+	ofs += ra->nSpillSlots * word;
+	State->FrameSize = (ofs + frame_align-1) & ~(frame_align-1);
+}
+
+/**
+ * \brief Check if two locals can be alive at the same time
+ */
+bool X86_IRM_int_LocalsInterfere(tX86IRMState *State, int A, int B, const int *Start, const int *End)
+{
+	tIRMHandle	h = State->Handle;
+	const tIRMLocal	*a = &h->Locals[A], *b = &h->Locals[B];
+	if( a->bAddressTaken || b->bAddressTaken ) {
+		// Pointers can outlive the accesses, so only the scopes say anything
+		if( !a->bAddressTaken || !b->bAddressTaken )
+			return true;
+		return IRM_ScopeContains(h, a->Scope, b->Scope) || IRM_ScopeContains(h, b->Scope, a->Scope);
+	}
+	return Start[A] <= End[B] && Start[B] <= End[A];
+}
+
+/**
+ * \brief Extend local lifetimes over the blocks they are live into or out of
+ */
+void X86_IRM_int_LocalLiveness(tX86IRMState *State, int *Start, int *End)
+{
+	tIRMHandle	h = State->Handle;
+	 int	nw = (h->nLocals + 31) / 32;
+	uint32_t	*sets = calloc(4 * h->nBlocks * nw + 1, sizeof(uint32_t));
+	#define LIVE_SET(n, b)	(sets + ((n)*h->nBlocks + (b))*nw)
+	#define GEN	0
+	#define KILL	1
+	#define IN	2
+	#define OUT	3
+	for( int b = 0; b < h->nBlocks; b ++ )
+	{
+		uint32_t	*gen = LIVE_SET(GEN, b), *kill = LIVE_SET(KILL, b);
+		for( tIRMOp *op = h->Blocks[b]->FirstOp; op; op = op->Next )
+		{
+			 int	l = op->Local;
+			if( op->Op == IRMOP_LOADLOCAL && !(kill[l/32] & (1U << l%32)) )
+				gen[l/32] |= 1U << l%32;
+			if( op->Op == IRMOP_STORELOCAL )
+				kill[l/32] |= 1U << l%32;
+		}
+	}
+	bool	changed;
+	do {
+		changed = false;
+		for( int b = h->nBlocks; b --; )
+		{
+			tIRMBlock	*blk = h->Blocks[b];
+			uint32_t	*out = LIVE_SET(OUT, b), *in = LIVE_SET(IN, b);
+			for( int s = 0; s < blk->nSucc; s ++ )
+			{
+				uint32_t	*succ_in = LIVE_SET(IN, blk->Succ[s]->Index);
+				for( int w = 0; w < nw; w ++ )
+					out[w] |= succ_in[w];
+			}
+			for( int w = 0; w < nw; w ++ )
+			{
+				uint32_t	v = LIVE_SET(GEN, b)[w] | (out[w] & ~LIVE_SET(KILL, b)[w]);
+				if( v != in[w] ) {
+					in[w] = v;
+					changed = true;
+				}
+			}
+		}
+	} while( changed );
+
+	for( int b = 0; b < h->nBlocks; b ++ )
+	{
+		tIRMBlock	*blk = h->Blocks[b];
+		if( !blk->FirstOp )
+			continue ;
+		for( int l = 0; l < h->nLocals; l ++ )
+		{
+			if( (LIVE_SET(IN, b)[l/32] & (1U << l%32)) && Start[l] > blk->FirstOp->Index )
+				Start[l] = blk->FirstOp->Index;
+			if( (LIVE_SET(OUT, b)[l/32] & (1U << l%32)) && End[l] < blk->LastOp->Index )
+				End[l] = blk->LastOp->Index;
+		}
+	}
+	#undef LIVE_SET
+	#undef GEN
+	#undef KILL
+	#undef IN
+	#undef OUT
+	free(sets);
+}
+
+void X86_IRM_int_EmitBlock(tX86IRMState *State, tIRMBlock *Block, tIRMBlock *Next)
+{
+	AsmOut_Str(State->OutFile, ".b");
+	AsmOut_Int(State->OutFile, Block->Index);
+	AsmOut_Str(State->OutFile, ":\n");
+	// (the entry block's prologue goes before its label, it might be a loop header)
+	if( Block == State->FrameBlock && Block->Index != 0 )
+		X86_IRM_int_EmitPrologue(State, State->OutFile);
+	X86_IRM_int_EmitMoves(State, &State->RA->EntryMoves[Block->Index]);
+	for( tIRMOp *op = Block->FirstOp; op; op = op->Next )
+	{
+		X86_IRM_int_EmitMoves(State, &State->RA->GapMoves[op->Index]);
+		if( op == Block->LastOp )
+			X86_IRM_int_EmitMoves(State, &State->RA->ExitMoves[Block->Index]);
+		X86_IRM_int_EmitOp(State, op, Next);
+		// (the callee returns for us)
+		if( op->Op == IRMOP_CALL && X86_IRM_int_IsTailCall(State, op) )
+			break;
+	}
+}
+
+void X86_IRM_int_EmitOp(tX86IRMState *State, tIRMOp *Op, tIRMBlock *Next)
+{
+	tAsmOut	*out = State->OutFile;
+	tIRMHandle	h = State->Handle;
+	tRegAllocation	*ra = State->RA;
+	 int	idx = Op->Index;
+	tX86Operand	dst = X86_IRM_int_RegOpd(-1, 4), src[2], mem;
+
+	if( Op->Flags & IRMFLAG_FOLDED ) {
+		// Computed by its users, but strings still need their data
+		if( Op->Op == IRMOP_STRING )
+			X86_IRM_int_EmitString(State, Op);
+		return ;
+	}
+
+	State->Pos = RA_POS_USE(idx);
+	State->Busy = ra->BusyRegs[idx];
+	State->OpRegs = 0;
+	X86_IRM_int_MarkOperands(State, Op);
+	if( (State->Busy | State->OpRegs) & gpX86Mode->CalleeSaved )
+		State->bNeedFrame = true;
+	if( Op->Dst != IRM_REG_VOID ) {
+		X86_IRM_int_CheckSize(h, Op->Dst);
+		 int	width = X86_IRM_int_Width(h, Op->Dst);
+		tRALocation	loc = RA_GetLocation(ra, Op->Dst, RA_POS_DEF(idx));
+		if( loc.Reg >= 0 ) {
+			dst = X86_IRM_int_RegOpd(loc.Reg, width);
+			State->OpRegs |= REGBIT(loc.Reg);
+			State->UsedRegs |= REGBIT(loc.Reg);
+		}
+		else
+			dst = X86_IRM_int_SpillOpd(State, ra->SpillSlots[Op->Dst], width);
+	}
+
+	switch(Op->Op)
+	{
+	case IRMOP_NOP:
+		break;
+	case IRMOP_PHI:
+		fprintf(stderr, "BUG: x86 backend given a function in SSA form\n");
+		exit(1);
+
+	// -- Values
+	case IRMOP_CONST:
+		src[0] = X86_IRM_int_ImmOpd(Op->Imm, dst.Size);
+		X86_IRM_int_Mov(State, &dst, &src[0]);
+		break;
+	case IRMOP_STRING:
+	case IRMOP_SYMADDR:
+		if( Op->Op == IRMOP_STRING )
+			X86_IRM_int_EmitString(State, Op);
+		src[0] = X86_IRM_int_ImmOpd(0, 4);
+		if( Op->Op == IRMOP_STRING )
+			src[0].String = Op->Index;
+		else
+			src[0].Sym = Op->Sym->Name;
+		if( gpX86Mode->Bits == 64 ) {
+			// lea reg, [rel sym]
+			mem = X86_IRM_int_MemOpd(-1, 0, 0);
+			mem.Sym = src[0].Sym;
+			mem.String = src[0].String;
+			X86_IRM_int_Lea(State, &dst, mem);
+		}
+		else
+			X86_IRM_int_Mov(State, &dst, &src[0]);
+		break;
+	case IRMOP_LOCALADDR:
+		X86_IRM_int_Lea(State, &dst, X86_IRM_int_LocalOpd(State, Op->Local, 0));
+		break;
+	case IRMOP_ARGUMENT:
+		if( X86_IRM_int_ArgReg(Op) >= 0 ) {
+			src[0] = X86_IRM_int_RegOpd(X86_IRM_int_ArgReg(Op), dst.Size);
+			X86_IRM_int_Mov(State, &dst, &src[0]);
+			break;
+		}
+		// fall through
+	case IRMOP_LOADLOCAL:
+	case IRMOP_LOAD:
+		src[0] = X86_IRM_int_Memory(State, Op);
+		X86_IRM_int_Mov(State, &dst, &src[0]);
+		break;
+	case IRMOP_COPY:
+		src[0] = X86_IRM_int_Src(State, Op, 0);
+		X86_IRM_int_Mov(State, &dst, &src[0]);
+		break;
+
+	// -- Memory
+	case IRMOP_STORELOCAL:
+		mem = X86_IRM_int_LocalOpd(State, Op->Local, Types_GetSizeOf(h->Locals[Op->Local].Type));
+		X86_IRM_int_Store(State, &mem, X86_IRM_int_Src(State, Op, 0));
+		break;
+	case IRMOP_STORE:
+		mem = X86_IRM_int_MemOpd(-1, 0, Types_GetSizeOf(IRM_GetRegType(h, Op->Src[1])));
+		X86_IRM_int_Address(State, Op, 0, &mem);
+		X86_IRM_int_Store(State, &mem, X86_IRM_int_Src(State, Op, 1));
+		break;
+
+	// -- Unary
+	case IRMOP_NEG:
+	case IRMOP_NOT:
+		src[0] = X86_IRM_int_Src(State, Op, 0);
+		X86_IRM_int_Mov(State, &dst, &src[0]);
+		X86_IRM_int_Insn(out, (Op->Op == IRMOP_NEG ? "neg" : "not"), X86_IRM_int_Format(&dst), NULL);
+		break;
+	case IRMOP_CAST: {
+		const tType	*type = IRM_GetRegType(h, Op->Dst);
+		size_t	size = Types_GetSizeOf(type);
+		src[0] = X86_IRM_int_Src(State, Op, 0);
+		uint32_t	byteregs = gpX86Mode->ByteRegs;
+		if( type->Class == TYPECLASS_INTEGER && type->Integer.Size == INTSIZE_BOOL )
+		{
+			 int	r = (dst.Type == X86OPD_REG && (byteregs & REGBIT(dst.Reg))) ? dst.Reg : X86_IRM_int_GetScratch(State, ~byteregs);
+			if( src[0].Type == X86OPD_REG )
+				X86_IRM_int_Insn(out, "test", X86_IRM_int_Format(&src[0]), X86_IRM_int_Format(&src[0]));
+			else
+				X86_IRM_int_Insn(out, "cmp", X86_IRM_int_Format(&src[0]), "0");
+			X86_IRM_int_Insn(out, "setne", X86_IRM_int_RegName(r, 1), NULL);
+			X86_IRM_int_Insn(out, "movzx", X86_IRM_int_RegName(r, 4), X86_IRM_int_RegName(r, 1));
+			src[1] = X86_IRM_int_RegOpd(r, 4);
+			X86_IRM_int_Mov(State, &dst, &src[1]);
+		}
+		else if( size > 4 && src[0].Size <= 4 )
+		{
+			// Widening to 64 bits, the low half is already extended for the source type
+			tX86Operand	tmp = (dst.Type == X86OPD_REG ? dst : X86_IRM_int_RegOpd(X86_IRM_int_GetScratch(State, 0), 8));
+			tX86Operand	low = X86_IRM_int_RegOpd(tmp.Reg, 4);
+			if( Op->Flags & IRMFLAG_SIGNED ) {
+				X86_IRM_int_Mov(State, &low, &src[0]);
+				X86_IRM_int_Insn(out, "movsxd", X86_IRM_int_RegName(tmp.Reg, 8), X86_IRM_int_RegName(tmp.Reg, 4));
+			}
+			else if( src[0].Type == X86OPD_REG )
+				// (always written, a 32-bit mov clears the upper half)
+				X86_IRM_int_Insn(out, "mov", X86_IRM_int_RegName(tmp.Reg, 4), X86_IRM_int_RegName(src[0].Reg, 4));
+			else
+				X86_IRM_int_Mov(State, &low, &src[0]);
+			X86_IRM_int_Mov(State, &dst, &tmp);
+		}
+		else if( size >= 4 )
+		{
+			// Narrower sources are already extended (and wider ones are truncated by the move)
+			X86_IRM_int_Mov(State, &dst, &src[0]);
+		}
+		else
+		{
+			tX86Operand	tmp = (dst.Type == X86OPD_REG ? dst : X86_IRM_int_RegOpd(X86_IRM_int_GetScratch(State, 0), 4));
+			X86_IRM_int_Mov(State, &tmp, &src[0]);
+			X86_IRM_int_Truncate(State, tmp.Reg, type);
+			X86_IRM_int_Mov(State, &dst, &tmp);
+		}
+		break; }
+
+	// -- Binary
+	case IRMOP_ADD:
+	case IRMOP_SUB:
+	case IRMOP_AND:
+	case IRMOP_OR:
+	case IRMOP_XOR: {
+		static const char * const names[] = {
+			[IRMOP_ADD] = "add", [IRMOP_SUB] = "sub",
+			[IRMOP_AND] = "and", [IRMOP_OR] = "or", [IRMOP_XOR] = "xor"
+			};
+		if( Op->Form == X86FORM_LEA ) {
+			mem = X86_IRM_int_MemOpd(-1, 0, 0);
+			X86_IRM_int_AddressOf(State, Op, &mem);
+			X86_IRM_int_Lea(State, &dst, mem);
+			break;
+		}
+		 int	l = (Op->Form == X86FORM_SWAP);
+		X86_IRM_int_BinOp(State, names[Op->Op], (Op->Op != IRMOP_SUB), &dst,
+			X86_IRM_int_Src(State, Op, l), X86_IRM_int_Src(State, Op, !l));
+		break; }
+	case IRMOP_MUL: {
+		if( Op->Form == X86FORM_LEA ) {
+			mem = X86_IRM_int_MemOpd(-1, 0, 0);
+			X86_IRM_int_AddressOf(State, Op, &mem);
+			X86_IRM_int_Lea(State, &dst, mem);
+			break;
+		}
+		 int	l = (Op->Form == X86FORM_SWAP);
+		src[0] = X86_IRM_int_Src(State, Op, l);
+		src[1] = X86_IRM_int_Src(State, Op, !l);
+		if( Op->Form == X86FORM_SHIFT ) {
+			 int	shift = 0;
+			while( ((uint32_t)src[1].Disp >> shift) > 1 )
+				shift ++;
+			X86_IRM_int_Mov(State, &dst, &src[0]);
+			X86_IRM_int_InsnInt(out, "shl", X86_IRM_int_Format(&dst), shift);
+			break;
+		}
+		// imul only has a register destination
+		 int	r = (dst.Type == X86OPD_REG ? dst.Reg : X86_IRM_int_GetScratch(State, 0));
+		tX86Operand	rd = X86_IRM_int_RegOpd(r, dst.Size);
+		const char	*rname = X86_IRM_int_Format(&rd);
+		if( src[1].Type == X86OPD_IMM ) {
+			X86_IRM_int_ToRM32(State, &src[0]);
+			AsmOut_Printf(out, "\timul %s, %s, %s\n", rname, X86_IRM_int_Format(&src[0]), X86_IRM_int_Format(&src[1]));
+		}
+		else if( src[1].Type == X86OPD_REG && src[1].Reg == r ) {
+			if( src[0].Type == X86OPD_IMM )
+				AsmOut_Printf(out, "\timul %s, %s, %s\n", rname, rname, X86_IRM_int_Format(&src[0]));
+			else {
+				X86_IRM_int_ToRM32(State, &src[0]);
+				X86_IRM_int_Insn(out, "imul", rname, X86_IRM_int_Format(&src[0]));
+			}
+		}
+		else {
+			if( src[1].Type == X86OPD_MEM && (src[1].Base == r || src[1].Index == r) )
+				X86_IRM_int_ToReg(State, &src[1]);
+			X86_IRM_int_Mov(State, &rd, &src[0]);
+			X86_IRM_int_ToRM32(State, &src[1]);
+			X86_IRM_int_Insn(out, "imul", rname, X86_IRM_int_Format(&src[1]));
+		}
+		X86_IRM_int_Mov(State, &dst, &rd);
+		break; }
+	case IRMOP_DIV:
+	case IRMOP_MOD: {
+		// The allocator keeps eax/edx free of operands and live values here
+		tX86Operand	eax = X86_IRM_int_RegOpd(REG_EAX, dst.Size);
+		src[0] = X86_IRM_int_Src(State, Op, 0);
+		src[1] = X86_IRM_int_Src(State, Op, 1);
+		X86_IRM_int_Mov(State, &eax, &src[0]);
+		X86_IRM_int_ToRM32(State, &src[1]);
+		if( Op->Flags & IRMFLAG_SIGNED ) {
+			X86_IRM_int_Insn(out, (dst.Size == 8 ? "cqo" : "cdq"), NULL, NULL);
+			X86_IRM_int_Insn(out, "idiv", X86_IRM_int_Format(&src[1]), NULL);
+		}
+		else {
+			AsmOut_Str(out, "\txor edx, edx\n");
+			X86_IRM_int_Insn(out, "div", X86_IRM_int_Format(&src[1]), NULL);
+		}
+		src[0] = X86_IRM_int_RegOpd(Op->Op == IRMOP_DIV ? REG_EAX : REG_EDX, dst.Size);
+		X86_IRM_int_Mov(State, &dst, &src[0]);
+		break; }
+	case IRMOP_SHL:
+	case IRMOP_SHR: {
+		const char	*mnem = (Op->Op == IRMOP_SHL ? "shl" : (Op->Flags & IRMFLAG_SIGNED ? "sar" : "shr"));
+		src[0] = X86_IRM_int_Src(State, Op, 0);
+		src[1] = X86_IRM_int_Src(State, Op, 1);
+		if( src[1].Type == X86OPD_IMM ) {
+			X86_IRM_int_Mov(State, &dst, &src[0]);
+			X86_IRM_int_InsnInt(out, mnem, X86_IRM_int_Format(&dst), (int)(src[1].Disp & (dst.Size*8 - 1)));
+			break;
+		}
+		// Count first, the result may share the count's register
+		tX86Operand	ecx = X86_IRM_int_RegOpd(REG_ECX, 4);
+		X86_IRM_int_Mov(State, &ecx, &src[1]);
+		X86_IRM_int_Mov(State, &dst, &src[0]);
+		X86_IRM_int_Insn(out, mnem, X86_IRM_int_Format(&dst), "cl");
+		break; }
+	case IRMOP_CMPEQ ... IRMOP_CMPGE: {
+		 int	cc = Op->Op - IRMOP_CMPEQ;
+		uint32_t	byteregs = gpX86Mode->ByteRegs;
+		 int	r = (dst.Type == X86OPD_REG && (byteregs & REGBIT(dst.Reg))) ? dst.Reg : X86_IRM_int_GetScratch(State, ~byteregs);
+		src[0] = X86_IRM_int_Src(State, Op, 0);
+		if( Op->Form == X86FORM_TEST && src[0].Type == X86OPD_REG ) {
+			X86_IRM_int_Insn(out, "test", X86_IRM_int_Format(&src[0]), X86_IRM_int_Format(&src[0]));
+		}
+		else {
+			src[1] = X86_IRM_int_Src(State, Op, 1);
+			X86_IRM_int_ToRM32(State, &src[0]);
+			if( src[1].Type == X86OPD_MEM && (src[0].Type == X86OPD_MEM || src[1].Size < 4) )
+				X86_IRM_int_ToReg(State, &src[1]);
+			X86_IRM_int_Insn(out, "cmp", X86_IRM_int_Format(&src[0]), X86_IRM_int_Format(&src[1]));
+		}
+		X86_IRM_int_Insn(out, (Op->Flags & IRMFLAG_SIGNED ? csaX86SetCC : csaX86UnsignedSetCC)[cc],
+			X86_IRM_int_RegName(r, 1), NULL);
+		X86_IRM_int_Insn(out, "movzx", X86_IRM_int_RegName(r, 4), X86_IRM_int_RegName(r, 1));
+		src[0] = X86_IRM_int_RegOpd(r, 4);
+		X86_IRM_int_Mov(State, &dst, &src[0]);
+		break; }
+
+	case IRMOP_SELECT:
+		X86_IRM_int_EmitSelect(State, Op, &dst);
+		break;
+
+	case IRMOP_CALL: {
+		bool	tail = X86_IRM_int_IsTailCall(State, Op);
+		// (x86-64 pushes would overwrite the red zone, a 32-bit sibling call can run before the prologue)
+		if( !tail || gpX86Mode->Bits == 64 )
+			State->bNeedFrame = true;
+		if( Op->Sym && Op->Sym->bDirectOnly ) {
+			X86_IRM_int_EmitLocalCall(State, Op, &dst);
+			break;
+		}
+		if( gpX86Mode->Bits == 64 ) {
+			X86_IRM_int_EmitCall64(State, Op, &dst);
+			break;
+		}
+		for( int i = Op->nArgs; i --; )
+		{
+			tX86Operand	arg = X86_IRM_int_Src(State, Op, 1 + i);
+			if( arg.Type == X86OPD_IMM )
+				X86_IRM_int_Insn(out, "push dword", X86_IRM_int_Format(&arg), NULL);
+			else
+				X86_IRM_int_Insn(out, "push", X86_IRM_int_Format(&arg), NULL);
+			giX86PushDepth += 4;
+		}
+		src[0] = X86_IRM_int_Src(State, Op, 0);
+		if( tail ) {
+			X86_IRM_int_EmitTailJump(State, src[0], Op->nArgs);
+			break;
+		}
+		X86_IRM_int_Insn(out, "call", X86_IRM_int_Format(&src[0]), NULL);
+		if( Op->nArgs )
+			X86_IRM_int_InsnInt(out, "add", "esp", Op->nArgs*4);
+		giX86PushDepth -= Op->nArgs*4;
+		if( Op->Dst != IRM_REG_VOID ) {
+			src[0] = X86_IRM_int_RegOpd(REG_EAX, 4);
+			X86_IRM_int_Mov(State, &dst, &src[0]);
+		}
+		break; }
+
+	// -- Terminators
+	case IRMOP_JUMP:
+		if( Op->Block->Succ[0] != Next )
+			X86_IRM_int_InsnLabel(out, "jmp", Op->Block->Succ[0]->Index);
+		break;
+	case IRMOP_BRANCH: {
+		tIRMBlock	*t = Op->Block->Succ[0], *f = Op->Block->Succ[1];
+		if( Op->Form == X86FORM_CMP )
+		{
+			tIRMOp	*cmp = State->Defs[Op->Src[0]];
+			 int	cc = cmp->Op - IRMOP_CMPEQ;
+			X86_IRM_int_EmitCompare(State, X86_IRM_int_Src(State, cmp, 0), X86_IRM_int_Src(State, cmp, 1));
+			// (pop leaves the flags alone, but must happen before leaving the block)
+			X86_IRM_int_ReleaseScratch(State);
+			const char * const	*jcc = (cmp->Flags & IRMFLAG_SIGNED ? csaX86JCC : csaX86UnsignedJCC);
+			if( t == Next ) {
+				X86_IRM_int_InsnLabel(out, jcc[caX86InverseCC[cc]], f->Index);
+			}
+			else {
+				X86_IRM_int_InsnLabel(out, jcc[cc], t->Index);
+				if( f != Next )
+					X86_IRM_int_InsnLabel(out, "jmp", f->Index);
+			}
+			break;
+		}
+		if( Op->Form == X86FORM_TEST )
+		{
+			tIRMOp	*and = State->Defs[Op->Src[0]];
+			src[0] = X86_IRM_int_Src(State, and, 0);
+			src[1] = X86_IRM_int_Src(State, and, 1);
+			if( src[0].Type == X86OPD_IMM || src[1].Type == X86OPD_MEM ) {
+				tX86Operand	tmp = src[0];
+				src[0] = src[1];
+				src[1] = tmp;
+			}
+			X86_IRM_int_Insn(out, "test", X86_IRM_int_Format(&src[0]), X86_IRM_int_Format(&src[1]));
+		}
+		else
+		{
+			src[0] = X86_IRM_int_Src(State, Op, 0);
+			if( src[0].Type == X86OPD_REG )
+				X86_IRM_int_Insn(out, "test", X86_IRM_int_Format(&src[0]), X86_IRM_int_Format(&src[0]));
+			else
+				X86_IRM_int_Insn(out, "cmp", X86_IRM_int_Format(&src[0]), "0");
+		}
+		if( t == Next ) {
+			X86_IRM_int_InsnLabel(out, "jz", f->Index);
+		}
+		else {
+			X86_IRM_int_InsnLabel(out, "jnz", t->Index);
+			if( f != Next )
+				X86_IRM_int_InsnLabel(out, "jmp", f->Index);
+		}
+		break; }
+	case IRMOP_SWITCH: {
+		// Index is pointer sized (see Compile_int_SwitchLeaf)
+		tX86Operand	idx = X86_IRM_int_Src(State, Op, 0);
+		if( idx.Type != X86OPD_REG )
+			X86_IRM_int_ToReg(State, &idx);
+		char	table[16];
+		snprintf(table, sizeof(table), ".jt%i", Op->Index);
+		if( gpX86Mode->Bits == 64 ) {
+			 int	base = X86_IRM_int_GetScratch(State, REGBIT(idx.Reg));
+			AsmOut_Str(out, "\tlea ");
+			AsmOut_Str(out, X86_IRM_int_RegName(base, 8));
+			AsmOut_Str(out, ", [rel ");
+			AsmOut_Str(out, table);
+			AsmOut_Str(out, "]\n\tjmp [");
+			AsmOut_Str(out, X86_IRM_int_RegName(base, 8));
+			AsmOut_Str(out, "+");
+			AsmOut_Str(out, X86_IRM_int_RegName(idx.Reg, 8));
+			AsmOut_Str(out, "*8]\n");
+		}
+		else {
+			AsmOut_Str(out, "\tjmp [");
+			AsmOut_Str(out, X86_IRM_int_RegName(idx.Reg, 4));
+			AsmOut_Str(out, "*4+");
+			AsmOut_Str(out, table);
+			AsmOut_Str(out, "]\n");
+		}
+		// (a scratch register saved on the stack couldn't be restored after the jump)
+		assert( State->nPushed == 0 );
+		X86_IRM_int_EmitJumpTable(State, Op, table);
+		break; }
+	case IRMOP_RETURN:
+		if( Op->Src[0] != IRM_REG_VOID ) {
+			src[0] = X86_IRM_int_Src(State, Op, 0);
+			tX86Operand	eax = X86_IRM_int_RegOpd(REG_EAX, (src[0].Size > 4 ? 8 : 4));
+			X86_IRM_int_Mov(State, &eax, &src[0]);
+		}
+		// (blocks before a shrink-wrapped prologue return directly)
+		if( !State->bFramed )
+			AsmOut_Str(out, "\tret\n");
+		else if( Next )
+			AsmOut_Str(out, "\tjmp .ret\n");
+		break;
+
+	case NUM_IRMOPS:
+		break;
+	}
+
+	X86_IRM_int_ReleaseScratch(State);
+	assert( giX86PushDepth == 0 );
+}
+
+/**
+ * \brief Set the flags for `cmp A, B` (as a test if B is zero, the flags come out the same)
+ */
+void X86_IRM_int_EmitCompare(tX86IRMState *State, tX86Operand A, tX86Operand B)
+{
+	if( A.Type == X86OPD_REG && X86_IRM_int_IsNumber(&B) && B.Disp == 0 ) {
+		X86_IRM_int_Insn(State->OutFile, "test", X86_IRM_int_Format(&A), X86_IRM_int_Format(&A));
+		return ;
+	}
+	X86_IRM_int_ToRM32(State, &A);
+	if( B.Type == X86OPD_MEM && (A.Type == X86OPD_MEM || B.Size < 4) )
+		X86_IRM_int_ToReg(State, &B);
+	X86_IRM_int_Insn(State->OutFile, "cmp", X86_IRM_int_Format(&A), X86_IRM_int_Format(&B));
+}
+
+/**
+ * \brief Pick one of two values without branching
+ *
+ * Constant arms are computed from a carry mask (sbb) when the condition is
+ * an unsigned comparison or a test against zero, or from setcc when they
+ * differ by one. Otherwise the false value is moved into place and the
+ * true one conditionally moved over it (cmovcc).
+ */
+void X86_IRM_int_EmitSelect(tX86IRMState *State, tIRMOp *Op, const tX86Operand *Dst)
+{
+	tAsmOut	*out = State->OutFile;
+	tIRMOp	*cmp = (Op->Form == X86FORM_CMP ? State->Defs[Op->Src[0]] : NULL);
+	tX86Operand	t = X86_IRM_int_Src(State, Op, 1), f = X86_IRM_int_Src(State, Op, 2);
+	tX86Operand	a, b, r;
+	 int	size = Dst->Size;
+	 int	cc = 1;	// (a plain value is tested with `!= 0`)
+	bool	is_signed = false;
+
+	if( cmp ) {
+		cc = cmp->Op - IRMOP_CMPEQ;
+		is_signed = !!(cmp->Flags & IRMFLAG_SIGNED);
+		a = X86_IRM_int_Src(State, cmp, 0);
+		b = X86_IRM_int_Src(State, cmp, 1);
+	}
+	else {
+		a = X86_IRM_int_Src(State, Op, 0);
+		b = X86_IRM_int_ImmOpd(0, a.Size);
+	}
+
+	if( X86_IRM_int_IsNumber(&t) && X86_IRM_int_IsNumber(&f) )
+	{
+		int64_t	tv = t.Disp, fv = f.Disp;
+		if( size == 4 ) {
+			tv = (int32_t)tv;
+			fv = (int32_t)fv;
+		}
+
+		// CF is set by `cmp a, b` if a < b (unsigned), and by `cmp a, 1` if a is zero
+		 int	carry = -1;	// CF matches the condition (1) or its inverse (0)
+		tX86Operand	cb = b;
+		if( !is_signed && (cc == 2 || cc == 5) )
+			carry = (cc == 2);
+		else if( cc <= 1 && X86_IRM_int_IsNumber(&b) && b.Disp == 0 ) {
+			carry = (cc == 0);
+			cb.Disp = 1;
+		}
+		if( carry >= 0 )
+		{
+			// sbb gives -1 with CF set, masked to the difference from the CF clear value
+			int64_t	set = (carry ? tv : fv), clear = (carry ? fv : tv);
+			int64_t	mask = (size == 4 ? (int32_t)(set - clear) : set - clear);
+			if( X86_IRM_int_FitsImm(mask) )
+			{
+				r = (Dst->Type == X86OPD_REG ? *Dst : X86_IRM_int_RegOpd(X86_IRM_int_GetScratch(State, 0), size));
+				X86_IRM_int_EmitCompare(State, a, cb);
+				X86_IRM_int_Insn(out, "sbb", X86_IRM_int_Format(&r), X86_IRM_int_Format(&r));
+				if( mask != -1 )
+					X86_IRM_int_InsnInt(out, "and", X86_IRM_int_Format(&r), mask);
+				if( clear != 0 )
+					X86_IRM_int_InsnInt(out, "add", X86_IRM_int_Format(&r), clear);
+				X86_IRM_int_Mov(State, Dst, &r);
+				return ;
+			}
+		}
+
+		int64_t	diff = (size == 4 ? (int32_t)(tv - fv) : tv - fv);
+		if( diff == 1 || diff == -1 )
+		{
+			// t = f + 1 is f + cond, t = f - 1 is t + !cond
+			uint32_t	byteregs = gpX86Mode->ByteRegs;
+			 int	reg = (Dst->Type == X86OPD_REG && (byteregs & REGBIT(Dst->Reg))) ? Dst->Reg : X86_IRM_int_GetScratch(State, ~byteregs);
+			bool	clear_first = !X86_IRM_int_UsesReg(&a, reg) && !X86_IRM_int_UsesReg(&b, reg);
+			if( diff == -1 )
+				cc = caX86InverseCC[cc];
+			r = X86_IRM_int_RegOpd(reg, size);
+			if( clear_first )
+				X86_IRM_int_Insn(out, "xor", X86_IRM_int_RegName(reg, 4), X86_IRM_int_RegName(reg, 4));
+			X86_IRM_int_EmitCompare(State, a, b);
+			X86_IRM_int_Insn(out, (is_signed ? csaX86SetCC : csaX86UnsignedSetCC)[cc], X86_IRM_int_RegName(reg, 1), NULL);
+			if( !clear_first )
+				X86_IRM_int_Insn(out, "movzx", X86_IRM_int_RegName(reg, 4), X86_IRM_int_RegName(reg, 1));
+			if( (diff == 1 ? fv : tv) != 0 )
+				X86_IRM_int_InsnInt(out, "add", X86_IRM_int_Format(&r), (diff == 1 ? fv : tv));
+			X86_IRM_int_Mov(State, Dst, &r);
+			return ;
+		}
+	}
+
+	 int	reg = (Dst->Type == X86OPD_REG ? Dst->Reg : X86_IRM_int_GetScratch(State, 0));
+	r = X86_IRM_int_RegOpd(reg, size);
+	// The result register is written after the compare, so it mustn't hold the true value
+	if( X86_IRM_int_UsesReg(&t, reg) && !X86_IRM_int_UsesReg(&f, reg) ) {
+		tX86Operand	tmp = t;
+		t = f;
+		f = tmp;
+		cc = caX86InverseCC[cc];
+	}
+	if( t.Type == X86OPD_IMM || (t.Type == X86OPD_MEM && t.Size < 4) || X86_IRM_int_UsesReg(&t, reg) )
+		X86_IRM_int_ToReg(State, &t);
+	X86_IRM_int_EmitCompare(State, a, b);
+	// (the flags are live, so no xor for zero)
+	if( X86_IRM_int_IsNumber(&f) && f.Disp == 0 )
+		X86_IRM_int_Insn(out, "mov", X86_IRM_int_Format(&r), "0");
+	else
+		X86_IRM_int_Mov(State, &r, &f);
+	X86_IRM_int_Insn(out, (is_signed ? csaX86CMovCC : csaX86UnsignedCMovCC)[cc], X86_IRM_int_Format(&r), X86_IRM_int_Format(&t));
+	X86_IRM_int_Mov(State, Dst, &r);
+}
+
+/**
+ * \brief System V call
+ *
+ * Arguments past the first six are pushed (as qwords, right to left) like
+ * cdecl. The register ones are then moved into place together, as for
+ * X86_IRM_int_EmitLocalCall. A target that reads one of those registers (or
+ * eax) is moved along with them, into r11 (and r10 for an index).
+ */
+void X86_IRM_int_EmitCall64(tX86IRMState *State, tIRMOp *Op, const tX86Operand *Dst)
+{
+	const int	*arg_regs = gX86_64_SysV.ArgRegs;
+	tAsmOut	*out = State->OutFile;
+	 int	nregs = (Op->nArgs < X86_64_NREGARGS ? Op->nArgs : X86_64_NREGARGS);
+	 int	nstack = Op->nArgs - nregs;
+	bool	tail = X86_IRM_int_IsTailCall(State, Op);
+	 int	pad = (tail ? 0 : (nstack % 2) * 8);	// rsp must be 16-byte aligned at the call
+	uint32_t	argmask = REGBIT(REG_EAX);
+
+	if( pad )
+		X86_IRM_int_InsnInt(out, "sub", "rsp", pad);
+	giX86PushDepth += pad;
+	for( int i = Op->nArgs; i -- > nregs; )
+	{
+		tX86Operand	arg = X86_IRM_int_Src(State, Op, 1 + i);
+		// The callee ignores the upper half of narrow values
+		if( arg.Type == X86OPD_IMM ) {
+			arg.Disp = (arg.Size == 4 ? (int32_t)arg.Disp : arg.Disp);
+			arg.Size = 8;
+			X86_IRM_int_Insn(out, "push qword", X86_IRM_int_Format(&arg), NULL);
+		}
+		else {
+			arg.Size = 8;
+			X86_IRM_int_Insn(out, "push", X86_IRM_int_Format(&arg), NULL);
+		}
+		giX86PushDepth += 8;
+	}
+	for( int i = 0; i < nregs; i ++ )
+		argmask |= REGBIT(arg_regs[i]);
+
+	tRAMove	moves[X86_64_NREGARGS + 2];
+	tRAMoveList	list = {.Moves = moves, .Space = X86_64_NREGARGS + 2};
+	for( int i = 0; i < nregs; i ++ )
+	{
+		if( X86_IRM_int_IsFolded(Op, 1 + i) )
+			continue ;
+		moves[list.nMoves].Dst = (tRALocation){.Reg = arg_regs[i], .Slot = -1};
+		moves[list.nMoves].Src = RA_GetLocation(State->RA, Op->Args[i], State->Pos);
+		list.nMoves ++;
+	}
+	// The argument registers are about to be overwritten
+	tX86Operand	target = X86_IRM_int_Src(State, Op, 0);
+	 int	*target_regs[2] = {NULL, NULL};
+	if( target.Type == X86OPD_REG )
+		target_regs[0] = &target.Reg;
+	else if( target.Type == X86OPD_MEM ) {
+		target_regs[0] = &target.Base;
+		target_regs[1] = &target.Index;
+	}
+	const int	temps[2] = {REG_R11, REG_R10};
+	for( int i = 0; i < 2; i ++ )
+	{
+		if( !target_regs[i] || *target_regs[i] < 0 || !(argmask & REGBIT(*target_regs[i])) )
+			continue ;
+		moves[list.nMoves].Dst = (tRALocation){.Reg = temps[i], .Slot = -1};
+		moves[list.nMoves].Src = (tRALocation){.Reg = *target_regs[i], .Slot = -1};
+		list.nMoves ++;
+		*target_regs[i] = temps[i];
+	}
+	X86_IRM_int_EmitMoves(State, &list);
+	for( int i = 0; i < nregs; i ++ )
+	{
+		if( !X86_IRM_int_IsFolded(Op, 1 + i) )
+			continue ;
+		tX86Operand	arg = X86_IRM_int_Src(State, Op, 1 + i);
+		tX86Operand	reg = X86_IRM_int_RegOpd(arg_regs[i], arg.Size);
+		X86_IRM_int_Mov(State, &reg, &arg);
+	}
+
+	AsmOut_Str(out, "\txor eax, eax\n");	// No vector registers (for variadic callees)
+	if( tail ) {
+		X86_IRM_int_EmitTailJump(State, target, nstack);
+		return ;
+	}
+	X86_IRM_int_Insn(out, "call", X86_IRM_int_Format(&target), NULL);
+	if( nstack )
+		X86_IRM_int_InsnInt(out, "add", "rsp", nstack*8 + pad);
+	giX86PushDepth -= nstack*8 + pad;
+	if( Op->Dst != IRM_REG_VOID ) {
+		tX86Operand	rax = X86_IRM_int_RegOpd(REG_EAX, Dst->Size);
+		X86_IRM_int_Mov(State, Dst, &rax);
+	}
+}
+
+/**
+ * \brief Call a bDirectOnly function (private convention)
+ *
+ * Arguments past the register ones are pushed as for the standard
+ * convention. The register ones are then moved into place together (their
+ * sources may be each other's destinations), immediates last.
+ */
+void X86_IRM_int_EmitLocalCall(tX86IRMState *State, tIRMOp *Op, const tX86Operand *Dst)
+{
+	const tX86CallConv	*conv = gpX86Mode->LocalCallConv;
+	tAsmOut	*out = State->OutFile;
+	const char	*sp = X86_IRM_int_RegName(REG_ESP, gpX86Mode->WordSize);
+	 int	nregs = (Op->nArgs < conv->nRegArgs ? Op->nArgs : conv->nRegArgs);
+	 int	nstack = Op->nArgs - nregs;
+	bool	tail = X86_IRM_int_IsTailCall(State, Op);
+	 int	pad = (gpX86Mode->Bits == 64 && !tail ? (nstack % 2) * 8 : 0);	// (x86-64 keeps rsp 16-byte aligned)
+
+	if( pad )
+		X86_IRM_int_InsnInt(out, "sub", sp, pad);
+	giX86PushDepth += pad;
+	for( int i = Op->nArgs; i -- > nregs; )
+	{
+		tX86Operand	arg = X86_IRM_int_Src(State, Op, 1 + i);
+		if( arg.Type == X86OPD_IMM ) {
+			if( gpX86Mode->Bits == 64 ) {
+				arg.Disp = (arg.Size == 4 ? (int32_t)arg.Disp : arg.Disp);
+				arg.Size = 8;
+			}
+			X86_IRM_int_Insn(out, (gpX86Mode->Bits == 64 ? "push qword" : "push dword"), X86_IRM_int_Format(&arg), NULL);
+		}
+		else {
+			arg.Size = gpX86Mode->WordSize;
+			X86_IRM_int_Insn(out, "push", X86_IRM_int_Format(&arg), NULL);
+		}
+		giX86PushDepth += gpX86Mode->WordSize;
+	}
+
+	tRAMove	moves[conv->nRegArgs];
+	tRAMoveList	list = {.Moves = moves, .Space = conv->nRegArgs};
+	for( int i = 0; i < nregs; i ++ )
+	{
+		if( X86_IRM_int_IsFolded(Op, 1 + i) )
+			continue ;
+		moves[list.nMoves].Dst = (tRALocation){.Reg = conv->ArgRegs[i], .Slot = -1};
+		moves[list.nMoves].Src = RA_GetLocation(State->RA, Op->Args[i], State->Pos);
+		list.nMoves ++;
+	}
+	X86_IRM_int_EmitMoves(State, &list);
+	for( int i = 0; i < nregs; i ++ )
+	{
+		if( !X86_IRM_int_IsFolded(Op, 1 + i) )
+			continue ;
+		tX86Operand	arg = X86_IRM_int_Src(State, Op, 1 + i);
+		tX86Operand	reg = X86_IRM_int_RegOpd(conv->ArgRegs[i], arg.Size);
+		X86_IRM_int_Mov(State, &reg, &arg);
+	}
+
+	tX86Operand	target = X86_IRM_int_ImmOpd(0, gpX86Mode->WordSize);
+	target.Sym = Op->Sym->Name;
+	if( tail ) {
+		X86_IRM_int_EmitTailJump(State, target, nstack);
+		return ;
+	}
+	X86_IRM_int_Insn(out, "call", X86_IRM_int_Format(&target), NULL);
+	if( nstack*gpX86Mode->WordSize + pad )
+		X86_IRM_int_InsnInt(out, "add", sp, nstack*gpX86Mode->WordSize + pad);
+	giX86PushDepth -= nstack*gpX86Mode->WordSize + pad;
+	if( Op->Dst != IRM_REG_VOID ) {
+		tX86Operand	eax = X86_IRM_int_RegOpd(REG_EAX, Dst->Size);
+		X86_IRM_int_Mov(State, Dst, &eax);
+	}
+}
+
+/**
+ * \brief Check if a call can be made as a sibling call (a jump, see X86_IRM_int_EmitTailJump)
+ */
+bool X86_IRM_int_IsTailCall(tX86IRMState *State, const tIRMOp *Op)
+{
+	const tIRMOp	*ret = Op->Next;
+	if( !ret || ret->Op != IRMOP_RETURN )
+		return false;
+	if( ret->Src[0] != IRM_REG_VOID && ret->Src[0] != Op->Dst )
+		return false;
+	// The frame is gone by the time the callee runs
+	if( State->bFrameEscapes )
+		return false;
+	// Stack arguments are passed in the slots we were called with (the caller frees them)
+	 int	nstack = Op->nArgs - X86_IRM_int_CallConv(Op->Sym)->nRegArgs;
+	 int	avail = State->Handle->nArgs - gpX86CallConv->nRegArgs;
+	return nstack <= 0 || nstack <= avail;
+}
+
+/**
+ * \brief Finish a sibling call, in place of the `call`
+ * \param Target	Callee (a symbol, or a register/memory operand)
+ * \param NStack	Stack arguments pushed, first argument on top
+ *
+ * Register arguments are already in place. The pushed ones are popped
+ * into this function's argument slots (all pushes are done before any
+ * slot is written, so they can be read by the arguments too).
+ */
+void X86_IRM_int_EmitTailJump(tX86IRMState *State, tX86Operand Target, int NStack)
+{
+	tAsmOut	*out = State->OutFile;
+	 int	word = gpX86Mode->WordSize;
+	// (neither is used to pass arguments where the target can be a register)
+	 int	target_reg = (gpX86Mode->Bits == 64 ? REG_R11 : REG_EAX);
+	if( Target.Type != X86OPD_IMM && !(Target.Type == X86OPD_REG && Target.Reg == target_reg) ) {
+		tX86Operand	reg = X86_IRM_int_RegOpd(target_reg, word);
+		X86_IRM_int_Mov(State, &reg, &Target);
+		Target = reg;
+	}
+	for( int i = 0; i < NStack; i ++ )
+	{
+		// (pop computes an esp based address after moving esp)
+		giX86PushDepth -= word;
+		tX86Operand	slot = X86_IRM_int_FrameOpd(State, (2 + i) * word, word);
+		X86_IRM_int_Insn(out, "pop", X86_IRM_int_Format(&slot), NULL);
+	}
+	assert( giX86PushDepth == 0 && State->nPushed == 0 );
+	if( State->bFramed )
+		X86_IRM_int_EmitTeardown(State, out);
+	X86_IRM_int_Insn(out, "jmp", X86_IRM_int_Format(&Target), NULL);
+}
+
+void X86_IRM_int_EmitString(tX86IRMState *State, tIRMOp *Op)
+{
+	tAsmOut	*out = State->OutFile;
+	AsmOut_Str(out, "[section .rodata]\n.str");
+	AsmOut_Int(out, Op->Index);
+	AsmOut_Str(out, ":\tdb ");
+	for( size_t i = 0; i < Op->String.Length; i ++ ) {
+		AsmOut_Int(out, (uint8_t)Op->String.Data[i]);
+		AsmOut_Str(out, ", ");
+	}
+	AsmOut_Str(out, "0\n[section .text]\n");
+}
+
+/**
+ * \brief Emit the block addresses for a switch into .rodata
+ * \note Entries skip blocks that only jump on (the edges split by the allocator)
+ */
+void X86_IRM_int_EmitJumpTable(tX86IRMState *State, tIRMOp *Op, const char *Label)
+{
+	tAsmOut	*out = State->OutFile;
+	tRegAllocation	*ra = State->RA;
+	AsmOut_Str(out, "[section .rodata]\nalign ");
+	AsmOut_Int(out, gpX86Mode->WordSize);
+	AsmOut_Str(out, "\n");
+	AsmOut_Str(out, Label);
+	AsmOut_Str(out, ":");
+	for( int i = 0; i < Op->Table.Count; i ++ )
+	{
+		tIRMBlock	*blk = Op->Block->Succ[ Op->Table.Targets[i] ];
+		for( int depth = 0; depth < 4; depth ++ )
+		{
+			tIRMOp	*jmp = blk->FirstOp;
+			if( blk == State->FrameBlock || jmp != blk->LastOp || jmp->Op != IRMOP_JUMP )
+				break;
+			if( ra->EntryMoves[blk->Index].nMoves || ra->ExitMoves[blk->Index].nMoves || ra->GapMoves[jmp->Index].nMoves )
+				break;
+			blk = blk->Succ[0];
+		}
+		AsmOut_Str(out, (i % 8 == 0 ? "\n\t" : ", "));
+		AsmOut_Str(out, (i % 8 == 0 ? (gpX86Mode->Bits == 64 ? "dq " : "dd ") : ""));
+		AsmOut_Str(out, ".b");
+		AsmOut_Int(out, blk->Index);
+	}
+	AsmOut_Str(out, "\n[section .text]\n");
+}
+
+// --- Moves inserted by the allocator ---
+void X86_IRM_int_EmitMoves(tX86IRMState *State, tRAMoveList *List)
+{
+	if( List->nMoves == 0 )
+		return ;
+	RA_SequentialiseMoves(List, X86_IRM_int_EmitMove, State);
+}
+
+void X86_IRM_int_EmitMove(void *Ptr, const tRAMove *Move, bool Swap)
+{
+	tX86IRMState	*state = Ptr;
+	tX86Operand	opd[2];
+	const tRALocation	*locs[2] = {&Move->Dst, &Move->Src};
+	for( int i = 0; i < 2; i ++ )
+	{
+		// (whole registers/slots, the move doesn't know the value's width)
+		if( locs[i]->Reg >= 0 )
+			opd[i] = X86_IRM_int_RegOpd(locs[i]->Reg, gpX86Mode->WordSize);
+		else
+			opd[i] = X86_IRM_int_SpillOpd(state, locs[i]->Slot, gpX86Mode->WordSize);
+	}
+	if( Move->Dst.Reg >= 0 )
+		state->UsedRegs |= REGBIT(Move->Dst.Reg);
+	if( Move->Src.Reg >= 0 && (gpX86Mode->CalleeSaved & REGBIT(Move->Src.Reg)) )
+		state->bNeedFrame = true;
+	if( Swap ) {
+		X86_IRM_int_Insn(state->OutFile, "xchg", X86_IRM_int_Format(&opd[0]), X86_IRM_int_Format(&opd[1]));
+		return ;
+	}
+	// Spill slots are never moved to each other, so this is always legal
+	X86_IRM_int_Insn(state->OutFile, "mov", X86_IRM_int_Format(&opd[0]), X86_IRM_int_Format(&opd[1]));
+}
+
+// --- Helpers ---
+/**
+ * \brief Get a register that can be clobbered in the current operation
+ * \param Avoid	Registers that must not be returned
+ *
+ * If every register is holding something, one is saved on the stack until
+ * the operation is complete.
+ */
+int X86_IRM_int_GetScratch(tX86IRMState *State, uint32_t Avoid)
+{
+	uint32_t	avail = gpX86Mode->Allocatable & ~(State->Busy | State->OpRegs | State->Scratch | Avoid);
+	for( int r = 0; r < gpX86Mode->nRegs; r ++ )
+	{
+		if( avail & REGBIT(r) ) {
+			State->Scratch |= REGBIT(r);
+			State->UsedRegs |= REGBIT(r);
+			return r;
+		}
+	}
+	avail = gpX86Mode->Allocatable & ~(State->OpRegs | State->Scratch | Avoid);
+	for( int r = 0; r < gpX86Mode->nRegs; r ++ )
+	{
+		if( avail & REGBIT(r) ) {
+			assert( State->nPushed < 4 );
+			X86_IRM_int_Insn(State->OutFile, "push", X86_IRM_int_RegName(r, gpX86Mode->WordSize), NULL);
+			giX86PushDepth += gpX86Mode->WordSize;
+			// (x86-64: the home slots are in the red zone before the prologue)
+			if( gpX86Mode->Bits == 64 )
+				State->bNeedFrame = true;
+			State->bPushed = true;
+			State->Pushed[State->nPushed++] = r;
+			State->Scratch |= REGBIT(r);
+			State->UsedRegs |= REGBIT(r);
+			return r;
+		}
+	}
+	fprintf(stderr, "BUG: No x86 scratch register available\n");
+	exit(1);
+}
+
+void X86_IRM_int_ReleaseScratch(tX86IRMState *State)
+{
+	while( State->nPushed ) {
+		X86_IRM_int_Insn(State->OutFile, "pop", X86_IRM_int_RegName(State->Pushed[--State->nPushed], gpX86Mode->WordSize), NULL);
+		giX86PushDepth -= gpX86Mode->WordSize;
+	}
+	State->Scratch = 0;
+}
+
+/**
+ * \brief Mark the registers read by an operation (including through folded operands)
+ */
+void X86_IRM_int_MarkOperands(tX86IRMState *State, tIRMOp *Op)
+{
+	 int	nuse = IRM_GetUseCount(Op);
+	for( int j = 0; j < nuse; j ++ )
+	{
+		tIRMReg	r = *IRM_GetUse(Op, j);
+		if( r == IRM_REG_VOID )
+			continue ;
+		if( X86_IRM_int_IsFolded(Op, j) ) {
+			X86_IRM_int_MarkOperands(State, State->Defs[r]);
+			continue ;
+		}
+		tRALocation	loc = RA_GetLocation(State->RA, r, State->Pos);
+		if( loc.Reg >= 0 )
+			State->OpRegs |= REGBIT(loc.Reg);
+	}
+}
+
+/**
+ * \brief Operand for one of an operation's uses (register, spill slot, immediate or memory)
+ */
+tX86Operand X86_IRM_int_Src(tX86IRMState *State, tIRMOp *Op, int Use)
+{
+	tIRMReg	r = *IRM_GetUse(Op, Use);
+	tX86Operand	ret;
+	X86_IRM_int_CheckSize(State->Handle, r);
+	if( !X86_IRM_int_IsFolded(Op, Use) )
+	{
+		tRALocation	loc = RA_GetLocation(State->RA, r, State->Pos);
+		if( loc.Reg >= 0 )
+			return X86_IRM_int_RegOpd(loc.Reg, X86_IRM_int_Width(State->Handle, r));
+		return X86_IRM_int_SpillOpd(State, loc.Slot, X86_IRM_int_Width(State->Handle, r));
+	}
+
+	tIRMOp	*def = State->Defs[r];
+	switch(def->Op)
+	{
+	case IRMOP_CONST:
+		return X86_IRM_int_ImmOpd(def->Imm, X86_IRM_int_Width(State->Handle, r));
+	case IRMOP_SYMADDR:
+		ret = X86_IRM_int_ImmOpd(0, 4);
+		ret.Sym = def->Sym->Name;
+		return ret;
+	case IRMOP_STRING:
+		ret = X86_IRM_int_ImmOpd(0, 4);
+		ret.String = def->Index;
+		return ret;
+	case IRMOP_LOAD:
+	case IRMOP_LOADLOCAL:
+	case IRMOP_ARGUMENT:
+		return X86_IRM_int_Memory(State, def);
+	default:
+		fprintf(stderr, "BUG: %s folded as an x86 operand\n", IRM_GetOpName(def->Op));
+		exit(1);
+	}
+}
+
+/**
+ * \brief Memory operand read by a load
+ */
+tX86Operand X86_IRM_int_Memory(tX86IRMState *State, tIRMOp *Load)
+{
+	const tType	*type = IRM_GetRegType(State->Handle, Load->Dst);
+	size_t	size = Types_GetSizeOf(type);
+	tX86Operand	ret;
+	if( (size != 1 && size != 2 && size != 4 && size != 8) || size > gpX86Mode->WordSize ) {
+		fprintf(stderr, "ERROR: x86 backend can't load a %zi byte value\n", size);
+		exit(1);
+	}
+	switch(Load->Op)
+	{
+	case IRMOP_ARGUMENT: {
+		 int	nregs = gpX86CallConv->nRegArgs;
+		assert( X86_IRM_int_ArgReg(Load) < 0 );
+		if( gpX86Mode->Bits == 64 ) {
+			// System V: Register arguments are in their home slots, the rest above the return address
+			if( Load->Imm < nregs )
+				ret = X86_IRM_int_FrameOpd(State, -8*((int)Load->Imm + 1), size);
+			else
+				ret = X86_IRM_int_FrameOpd(State, 16 + ((int)Load->Imm - nregs)*8, size);
+			break;
+		}
+		// cdecl: [ebp] = saved ebp, [ebp+4] = return address
+		ret = X86_IRM_int_FrameOpd(State, 8 + ((int)Load->Imm - nregs)*4, size);
+		break; }
+	case IRMOP_LOADLOCAL:
+		ret = X86_IRM_int_LocalOpd(State, Load->Local, size);
+		break;
+	default:
+		ret = X86_IRM_int_MemOpd(-1, 0, size);
+		X86_IRM_int_Address(State, Load, 0, &ret);
+		break;
+	}
+	ret.bSigned = X86_IRM_int_IsSigned(type);
+	return ret;
+}
+
+/**
+ * \brief Add a use (register or folded expression) to an address
+ */
+void X86_IRM_int_Address(tX86IRMState *State, tIRMOp *Op, int Use, tX86Operand *Mem)
+{
+	if( X86_IRM_int_IsFolded(Op, Use) )
+		X86_IRM_int_AddressOf(State, State->Defs[*IRM_GetUse(Op, Use)], Mem);
+	else
+		X86_IRM_int_AddReg(Mem, X86_IRM_int_LeafReg(State, Op, Use), 1);
+}
+
+/**
+ * \brief Add the value of an address expression to an address
+ */
+void X86_IRM_int_AddressOf(tX86IRMState *State, tIRMOp *Op, tX86Operand *Mem)
+{
+	uint32_t	val;
+	switch(Op->Op)
+	{
+	case IRMOP_CONST:
+		Mem->Disp += (int32_t)Op->Imm;
+		break;
+	case IRMOP_SYMADDR:
+		Mem->Sym = Op->Sym->Name;
+		break;
+	case IRMOP_STRING:
+		Mem->String = Op->Index;
+		break;
+	case IRMOP_LOCALADDR: {
+		tX86Operand	local = X86_IRM_int_LocalOpd(State, Op->Local, 0);
+		X86_IRM_int_AddReg(Mem, local.Base, 1);
+		Mem->Disp += local.Disp;
+		break; }
+	case IRMOP_ADD:
+		X86_IRM_int_Address(State, Op, 0, Mem);
+		X86_IRM_int_Address(State, Op, 1, Mem);
+		break;
+	case IRMOP_SUB:
+		X86_IRM_int_Address(State, Op, 0, Mem);
+		Mem->Disp -= (int32_t)State->Defs[Op->Src[1]]->Imm;
+		break;
+	case IRMOP_SHL:
+		val = State->Defs[Op->Src[1]]->Imm;
+		X86_IRM_int_AddReg(Mem, X86_IRM_int_LeafReg(State, Op, 0), 1 << val);
+		break;
+	case IRMOP_MUL: {
+		val = State->Defs[Op->Src[1]]->Imm;
+		 int	r = X86_IRM_int_LeafReg(State, Op, 0);
+		if( val == 3 || val == 5 || val == 9 ) {
+			X86_IRM_int_AddReg(Mem, r, 1);
+			val --;
+		}
+		X86_IRM_int_AddReg(Mem, r, val);
+		break; }
+	default:
+		fprintf(stderr, "BUG: %s folded into an x86 address\n", IRM_GetOpName(Op->Op));
+		exit(1);
+	}
+}
+
+/**
+ * \brief Register holding a use (reloading it into a scratch register if it was spilt)
+ */
+int X86_IRM_int_LeafReg(tX86IRMState *State, tIRMOp *Op, int Use)
+{
+	tIRMReg	r = *IRM_GetUse(Op, Use);
+	tRALocation	loc = RA_GetLocation(State->RA, r, State->Pos);
+	if( loc.Reg >= 0 )
+		return loc.Reg;
+	 int	tmp = X86_IRM_int_GetScratch(State, 0);
+	tX86Operand	slot = X86_IRM_int_SpillOpd(State, loc.Slot, gpX86Mode->WordSize);
+	X86_IRM_int_Insn(State->OutFile, "mov", X86_IRM_int_RegName(tmp, gpX86Mode->WordSize), X86_IRM_int_Format(&slot));
+	return tmp;
+}
+
+void X86_IRM_int_AddReg(tX86Operand *Mem, int Reg, int Scale)
+{
+	if( Scale > 1 ) {
+		assert( Mem->Index < 0 );
+		Mem->Index = Reg;
+		Mem->Scale = Scale;
+	}
+	else if( Mem->Base < 0 ) {
+		Mem->Base = Reg;
+	}
+	else {
+		assert( Mem->Index < 0 );
+		// ebp can't be encoded as an index without a base, esp can't be one at all
+		if( Reg == REG_EBP || Reg == REG_ESP ) {
+			Mem->Index = Mem->Base;
+			Mem->Base = Reg;
+		}
+		else
+			Mem->Index = Reg;
+		Mem->Scale = 1;
+	}
+}
+
+/**
+ * \brief Append a string to a Format buffer (cut short if it doesn't fit)
+ */
+static char *X86_IRM_int_Append(char *Dest, const char *End, const char *String)
+{
+	while( *String && Dest < End )
+		*Dest++ = *String++;
+	return Dest;
+}
+
+/**
+ * \brief Append a signed displacement ("+N" or "-N")
+ */
+static char *X86_IRM_int_AppendDisp(char *Dest, int Disp)
+{
+	if( Disp >= 0 )
+		*Dest++ = '+';
+	return AsmOut_FmtInt(Dest, Disp);
+}
+
+/**
+ * \brief Format an operand for NASM
+ */
+const char *X86_IRM_int_Format(const tX86Operand *Opd)
+{
+	static char	bufs[4][256];
+	static int	cur;
+	char	*ret = bufs[cur++ % 4];
+	// Leaves room for the numbers and punctuation after the last name
+	const char	*end = ret + sizeof(bufs[0]) - 32;
+	char	*p = ret;
+	switch(Opd->Type)
+	{
+	case X86OPD_REG:
+		return X86_IRM_int_RegName(Opd->Reg, Opd->Size);
+	case X86OPD_IMM:
+		// Symbols are written as "$name", in case they are spelt like a register or keyword
+		if( Opd->Sym )
+			p = X86_IRM_int_Append(X86_IRM_int_Append(p, end, "$"), end, Opd->Sym);
+		else if( Opd->String >= 0 )
+			p = AsmOut_FmtInt(X86_IRM_int_Append(p, end, ".str"), Opd->String);
+		else if( Opd->Size == 8 )
+			p = AsmOut_FmtHex(p, Opd->Disp);
+		else
+			p = AsmOut_FmtHex(p, (uint32_t)Opd->Disp);
+		if( (Opd->Sym || Opd->String >= 0) && Opd->Disp )
+			p = X86_IRM_int_AppendDisp(p, Opd->Disp);
+		*p = '\0';
+		return ret;
+	case X86OPD_MEM: {
+		static const char * const size_names[] = {[1] = "byte ", [2] = "word ", [4] = "dword ", [8] = "qword "};
+		const char * const	*addr_regs = gpX86Mode->RegNames[gpX86Mode->WordSize];
+		bool	bSep = false;
+		if( Opd->Size )
+			p = X86_IRM_int_Append(p, end, size_names[Opd->Size]);
+		*p++ = '[';
+		// Symbols are RIP relative in 64-bit code (selection keeps registers out of those)
+		if( gpX86Mode->Bits == 64 && (Opd->Sym || Opd->String >= 0) )
+			p = X86_IRM_int_Append(p, end, "rel ");
+		if( Opd->Base >= 0 ) {
+			p = X86_IRM_int_Append(p, end, addr_regs[Opd->Base]);
+			bSep = true;
+		}
+		if( Opd->Index >= 0 ) {
+			assert( Opd->Index != REG_ESP );
+			if( bSep )	*p++ = '+';
+			p = X86_IRM_int_Append(p, end, addr_regs[Opd->Index]);
+			if( Opd->Scale > 1 ) {
+				*p++ = '*';
+				p = AsmOut_FmtInt(p, Opd->Scale);
+			}
+			bSep = true;
+		}
+		if( Opd->Sym ) {
+			if( bSep )	*p++ = '+';
+			p = X86_IRM_int_Append(X86_IRM_int_Append(p, end, "$"), end, Opd->Sym);
+			bSep = true;
+		}
+		else if( Opd->String >= 0 ) {
+			if( bSep )	*p++ = '+';
+			p = AsmOut_FmtInt(X86_IRM_int_Append(p, end, ".str"), Opd->String);
+			bSep = true;
+		}
+		if( !bSep )
+			p = AsmOut_FmtHex(p, (uint32_t)Opd->Disp);
+		else if( Opd->Disp + (Opd->Base == REG_ESP ? giX86PushDepth : 0) )
+			p = X86_IRM_int_AppendDisp(p, Opd->Disp + (Opd->Base == REG_ESP ? giX86PushDepth : 0));
+		*p++ = ']';
+		*p = '\0';
+		return ret; }
+	}
+	return "";
+}
+
+/**
+ * \brief Write one instruction line (either operand may be NULL)
+ */
+void X86_IRM_int_Insn(tAsmOut *Out, const char *Mnemonic, const char *A, const char *B)
+{
+	AsmOut_Str(Out, "\t");
+	AsmOut_Str(Out, Mnemonic);
+	if( A ) {
+		AsmOut_Str(Out, " ");
+		AsmOut_Str(Out, A);
+	}
+	if( B ) {
+		AsmOut_Str(Out, ", ");
+		AsmOut_Str(Out, B);
+	}
+	AsmOut_Str(Out, "\n");
+}
+
+void X86_IRM_int_InsnInt(tAsmOut *Out, const char *Mnemonic, const char *A, int Value)
+{
+	AsmOut_Str(Out, "\t");
+	AsmOut_Str(Out, Mnemonic);
+	AsmOut_Str(Out, " ");
+	AsmOut_Str(Out, A);
+	AsmOut_Str(Out, ", ");
+	AsmOut_Int(Out, Value);
+	AsmOut_Str(Out, "\n");
+}
+
+//! \brief Jump to a block's label
+void X86_IRM_int_InsnLabel(tAsmOut *Out, const char *Mnemonic, int Block)
+{
+	AsmOut_Str(Out, "\t");
+	AsmOut_Str(Out, Mnemonic);
+	AsmOut_Str(Out, " .b");
+	AsmOut_Int(Out, Block);
+	AsmOut_Str(Out, "\n");
+}
+
+static bool X86_IRM_int_SameOpd(const tX86Operand *A, const tX86Operand *B)
+{
+	if( A->Type != B->Type )
+		return false;
+	if( A->Type == X86OPD_REG )
+		return A->Reg == B->Reg;
+	return A->Base == B->Base && A->Index == B->Index && (A->Index < 0 || A->Scale == B->Scale)
+		&& A->Disp == B->Disp && A->Sym == B->Sym && A->String == B->String && A->Size == B->Size;
+}
+
+static bool X86_IRM_int_UsesReg(const tX86Operand *Opd, int Reg)
+{
+	if( Reg < 0 )
+		return false;
+	if( Opd->Type == X86OPD_REG )
+		return Opd->Reg == Reg;
+	return Opd->Type == X86OPD_MEM && (Opd->Base == Reg || Opd->Index == Reg);
+}
+
+/**
+ * \brief Move an operand into a scratch register
+ */
+void X86_IRM_int_ToReg(tX86IRMState *State, tX86Operand *Opd)
+{
+	tX86Operand	tmp = X86_IRM_int_RegOpd(X86_IRM_int_GetScratch(State, 0), (Opd->Size > 4 ? 8 : 4));
+	X86_IRM_int_Mov(State, &tmp, Opd);
+	*Opd = tmp;
+}
+
+/**
+ * \brief Make an operand usable as r/m32 or r/m64 (immediates and narrow memory go through a register)
+ */
+void X86_IRM_int_ToRM32(tX86IRMState *State, tX86Operand *Opd)
+{
+	if( Opd->Type == X86OPD_IMM || (Opd->Type == X86OPD_MEM && Opd->Size < 4) )
+		X86_IRM_int_ToReg(State, Opd);
+}
+
+/**
+ * \brief Move a value into a register or spill slot (extending narrow memory operands)
+ */
+void X86_IRM_int_Mov(tX86IRMState *State, const tX86Operand *Dst, const tX86Operand *Src)
+{
+	tAsmOut	*out = State->OutFile;
+	if( X86_IRM_int_SameOpd(Dst, Src) )
+		return ;
+	// Registers and immediates are used at the destination's width (truncating wider values)
+	tX86Operand	src = *Src;
+	if( src.Type != X86OPD_MEM || src.Size > Dst->Size )
+		src.Size = Dst->Size;
+	if( Dst->Type == X86OPD_REG )
+	{
+		State->UsedRegs |= REGBIT(Dst->Reg);
+		// (32-bit writes clear the upper half)
+		if( src.Type == X86OPD_IMM && !src.Sym && src.String < 0 && src.Disp == 0 )
+			X86_IRM_int_Insn(out, "xor", X86_IRM_int_RegName(Dst->Reg, 4), X86_IRM_int_RegName(Dst->Reg, 4));
+		else if( src.Type == X86OPD_MEM && src.Size < 4 )
+			X86_IRM_int_Insn(out, (src.bSigned ? "movsx" : "movzx"), X86_IRM_int_RegName(Dst->Reg, 4), X86_IRM_int_Format(&src));
+		else
+			X86_IRM_int_Insn(out, "mov", X86_IRM_int_Format(Dst), X86_IRM_int_Format(&src));
+		return ;
+	}
+	if( src.Type == X86OPD_MEM || (src.Type == X86OPD_IMM && src.Size == 8 && !X86_IRM_int_FitsImm(src.Disp)) ) {
+		X86_IRM_int_ToReg(State, &src);
+		X86_IRM_int_Mov(State, Dst, &src);
+		return ;
+	}
+	X86_IRM_int_Insn(out, "mov", X86_IRM_int_Format(Dst), X86_IRM_int_Format(&src));
+}
+
+void X86_IRM_int_Lea(tX86IRMState *State, const tX86Operand *Dst, tX86Operand Mem)
+{
+	tX86Operand	r = (Dst->Type == X86OPD_REG ? *Dst : X86_IRM_int_RegOpd(X86_IRM_int_GetScratch(State, 0), Dst->Size));
+	Mem.Size = 0;
+	State->UsedRegs |= REGBIT(r.Reg);
+	X86_IRM_int_Insn(State->OutFile, "lea", X86_IRM_int_Format(&r), X86_IRM_int_Format(&Mem));
+	X86_IRM_int_Mov(State, Dst, &r);
+}
+
+/**
+ * \brief Two-operand ALU instruction for a three-address operation
+ */
+void X86_IRM_int_BinOp(tX86IRMState *State, const char *Mnemonic, bool bCommutative, const tX86Operand *Dst, tX86Operand Left, tX86Operand Right)
+{
+	tAsmOut	*out = State->OutFile;
+	bool	dst_is_left = X86_IRM_int_SameOpd(Dst, &Left);
+	bool	dst_is_right = !dst_is_left && X86_IRM_int_SameOpd(Dst, &Right);
+
+	if( dst_is_right && bCommutative )
+	{
+		Right = Left;
+	}
+	else if( dst_is_right && !X86_IRM_int_UsesReg(&Left, Dst->Reg) )
+	{
+		// a - b into b's location: -b + a
+		X86_IRM_int_Insn(out, "neg", X86_IRM_int_Format(Dst), NULL);
+		Mnemonic = "add";
+		Right = Left;
+	}
+	else if( !dst_is_left )
+	{
+		// Writing the destination first must not clobber the right operand (or its address),
+		// and memory-memory forms don't exist
+		if( dst_is_right || X86_IRM_int_UsesReg(&Right, Dst->Reg) || (Dst->Type == X86OPD_MEM && Right.Type == X86OPD_MEM) )
+		{
+			// Work in a register, then store
+			tX86Operand	tmp = X86_IRM_int_RegOpd(X86_IRM_int_GetScratch(State, 0), Dst->Size);
+			X86_IRM_int_Mov(State, &tmp, &Left);
+			X86_IRM_int_BinOp(State, Mnemonic, bCommutative, &tmp, tmp, Right);
+			X86_IRM_int_Mov(State, Dst, &tmp);
+			return ;
+		}
+		X86_IRM_int_Mov(State, Dst, &Left);
+	}
+
+	if( Right.Type == X86OPD_MEM && (Right.Size < 4 || Dst->Type == X86OPD_MEM) )
+		X86_IRM_int_ToReg(State, &Right);
+	X86_IRM_int_Insn(out, Mnemonic, X86_IRM_int_Format(Dst), X86_IRM_int_Format(&Right));
+}
+
+/**
+ * \brief Store the low bytes of a value to memory
+ */
+void X86_IRM_int_Store(tX86IRMState *State, const tX86Operand *Mem, tX86Operand Value)
+{
+	tAsmOut	*out = State->OutFile;
+	 int	size = Mem->Size;
+	if( (size != 1 && size != 2 && size != 4 && size != 8) || size > gpX86Mode->WordSize ) {
+		fprintf(stderr, "ERROR: x86 backend can't store a %i byte value\n", size);
+		exit(1);
+	}
+	if( Value.Type == X86OPD_IMM && (size == 4 || (!Value.Sym && Value.String < 0)) ) {
+		if( size < 4 )
+			Value.Disp &= (size == 1 ? 0xFF : 0xFFFF);
+		Value.Size = (size == 8 ? 8 : 4);
+		X86_IRM_int_Insn(out, "mov", X86_IRM_int_Format(Mem), X86_IRM_int_Format(&Value));
+		return ;
+	}
+	// Byte stores need a register with a low byte (eax-ebx in 32-bit code)
+	uint32_t	need = (size == 1 ? gpX86Mode->ByteRegs : gpX86Mode->Allocatable);
+	if( Value.Type != X86OPD_REG || !(need & REGBIT(Value.Reg)) ) {
+		tX86Operand	tmp = X86_IRM_int_RegOpd(X86_IRM_int_GetScratch(State, ~need), (size == 8 ? 8 : 4));
+		X86_IRM_int_Mov(State, &tmp, &Value);
+		Value = tmp;
+	}
+	X86_IRM_int_Insn(out, "mov", X86_IRM_int_Format(Mem), X86_IRM_int_RegName(Value.Reg, size));
+}
+
+/**
+ * \brief Re-extend the low bytes of a register for a narrower type
+ */
+void X86_IRM_int_Truncate(tX86IRMState *State, int Reg, const tType *Type)
+{
+	tAsmOut	*out = State->OutFile;
+	bool	is_signed = X86_IRM_int_IsSigned(Type);
+	const char	*name = X86_IRM_int_RegName(Reg, 4);
+	if( Types_GetSizeOf(Type) == 2 ) {
+		X86_IRM_int_Insn(out, (is_signed ? "movsx" : "movzx"), name, X86_IRM_int_RegName(Reg, 2));
+	}
+	else if( !is_signed ) {
+		X86_IRM_int_Insn(out, "and", name, "0xFF");
+	}
+	else if( gpX86Mode->ByteRegs & REGBIT(Reg) ) {
+		X86_IRM_int_Insn(out, "movsx", name, X86_IRM_int_RegName(Reg, 1));
+	}
+	else {
+		X86_IRM_int_Insn(out, "shl", name, "24");
+		X86_IRM_int_Insn(out, "sar", name, "24");
+	}
+}
+
+/**
+ * \brief Reject values that don't fit in a register
+ */
+size_t X86_IRM_int_CheckSize(tIRMHandle Handle, tIRMReg Reg)
+{
+	size_t	size = Types_GetSizeOf(IRM_GetRegType(Handle, Reg));
+	if( size > gpX86Mode->WordSize ) {
+		fprintf(stderr, "ERROR: %s: %zi byte values are not supported by the %i-bit x86 backend\n",
+			Handle->Name, size, gpX86Mode->Bits);
+		exit(1);
+	}
+	return size;
+}
+
+/**
+ * \brief Register width of a value (narrower values are held extended to 32 bits)
+ */
+int X86_IRM_int_Width(tIRMHandle Handle, tIRMReg Reg)
+{
+	return (Types_GetSizeOf(IRM_GetRegType(Handle, Reg)) > 4 ? 8 : 4);
+}
+
+const char *X86_IRM_int_RegName(int Reg, int Size)
+{
+	return gpX86Mode->RegNames[Size][Reg];
+}
+
+/**
+ * \brief Operand in the frame
+ * \param Disp	Offset from the frame pointer (the saved ebp, the return address is above it)
+ *
+ * Without a frame pointer, or before a shrink-wrapped prologue, the frame
+ * is addressed relative to esp.
+ */
+tX86Operand X86_IRM_int_FrameOpd(tX86IRMState *State, int Disp, int Size)
+{
+	if( State->bFramed && !gpX86Mode->bOmitFP )
+		return X86_IRM_int_MemOpd(REG_EBP, Disp, Size);
+	Disp += (State->bFramed ? State->FrameDepth : 0) - gpX86Mode->WordSize;
+	return X86_IRM_int_MemOpd(REG_ESP, Disp, Size);
+}
+
+tX86Operand X86_IRM_int_LocalOpd(tX86IRMState *State, int Local, int Size)
+{
+	State->bNeedFrame = true;
+	return X86_IRM_int_FrameOpd(State, State->LocalOffsets[Local], Size);
+}
+
+tX86Operand X86_IRM_int_SpillOpd(tX86IRMState *State, int Slot, int Size)
+{
+	State->bNeedFrame = true;
+	return X86_IRM_int_FrameOpd(State, State->SpillBase - (Slot + 1) * gpX86Mode->WordSize, Size);
+}
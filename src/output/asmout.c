@@ -0,0 +1,164 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * output/asmout.c
+ * - Buffered assembly text writer used by the backends
+ *
+ * Text is collected in one large buffer, which is either flushed to a file
+ * whenever it fills (-S) or kept in memory for the integrated assembler.
+ * Integers are formatted by hand, the common emission paths never go
+ * through printf style format parsing.
+ */
+#include <global.h>
+#include <symbol.h>
+#include <output.h>
+#include <string.h>
+#include <stdarg.h>
+
+// === CONSTANTS ===
+#define ASMOUT_BUFFER_SIZE	(256*1024)
+
+// === PROTOTYPES ===
+void	AsmOut_Open(tAsmOut *Out, FILE *File);
+void	AsmOut_Close(tAsmOut *Out);
+void	AsmOut_Free(tAsmOut *Out);
+void	AsmOut_int_Reserve(tAsmOut *Out, size_t Bytes);
+void	AsmOut_Write(tAsmOut *Out, const char *Data, size_t Length);
+void	AsmOut_Str(tAsmOut *Out, const char *String);
+void	AsmOut_Int(tAsmOut *Out, int64_t Value);
+void	AsmOut_Hex(tAsmOut *Out, uint64_t Value);
+void	AsmOut_Printf(tAsmOut *Out, const char *Format, ...);
+char	*AsmOut_FmtInt(char *Dest, int64_t Value);
+char	*AsmOut_FmtHex(char *Dest, uint64_t Value);
+
+// === GLOBALS ===
+bool	gbVerboseAsm = false;
+
+// === CODE ===
+/**
+ * \brief Start writing to a file (or to memory if File is NULL)
+ */
+void AsmOut_Open(tAsmOut *Out, FILE *File)
+{
+	Out->File = File;
+	Out->Space = (File ? ASMOUT_BUFFER_SIZE : ASMOUT_BUFFER_SIZE/4);
+	Out->Data = malloc(Out->Space);
+	Out->Length = 0;
+}
+
+/**
+ * \brief Flush everything to the file (in memory text stays in Data)
+ */
+void AsmOut_Close(tAsmOut *Out)
+{
+	if( !Out->File )
+		return ;
+	fwrite(Out->Data, 1, Out->Length, Out->File);
+	Out->Length = 0;
+}
+
+void AsmOut_Free(tAsmOut *Out)
+{
+	free(Out->Data);
+	Out->Data = NULL;
+	Out->Length = Out->Space = 0;
+}
+
+/**
+ * \brief Make room for Bytes more characters (slow path of the inline writers)
+ */
+void AsmOut_int_Reserve(tAsmOut *Out, size_t Bytes)
+{
+	if( Out->Length + Bytes <= Out->Space )
+		return ;
+	if( Out->File ) {
+		fwrite(Out->Data, 1, Out->Length, Out->File);
+		Out->Length = 0;
+	}
+	while( Out->Length + Bytes > Out->Space )
+		Out->Space *= 2;
+	Out->Data = realloc(Out->Data, Out->Space);
+}
+
+void AsmOut_Write(tAsmOut *Out, const char *Data, size_t Length)
+{
+	AsmOut_int_Reserve(Out, Length);
+	memcpy(Out->Data + Out->Length, Data, Length);
+	Out->Length += Length;
+}
+
+void AsmOut_Str(tAsmOut *Out, const char *String)
+{
+	AsmOut_Write(Out, String, strlen(String));
+}
+
+void AsmOut_Int(tAsmOut *Out, int64_t Value)
+{
+	AsmOut_int_Reserve(Out, 24);
+	Out->Length = AsmOut_FmtInt(Out->Data + Out->Length, Value) - Out->Data;
+}
+
+void AsmOut_Hex(tAsmOut *Out, uint64_t Value)
+{
+	AsmOut_int_Reserve(Out, 24);
+	Out->Length = AsmOut_FmtHex(Out->Data + Out->Length, Value) - Out->Data;
+}
+
+/**
+ * \brief Formatted output, for the uncommon lines
+ */
+void AsmOut_Printf(tAsmOut *Out, const char *Format, ...)
+{
+	va_list	args;
+	va_start(args, Format);
+	 int	len = vsnprintf(Out->Data + Out->Length, Out->Space - Out->Length, Format, args);
+	va_end(args);
+	if( Out->Length + len >= Out->Space ) {
+		AsmOut_int_Reserve(Out, len + 1);
+		va_start(args, Format);
+		vsnprintf(Out->Data + Out->Length, Out->Space - Out->Length, Format, args);
+		va_end(args);
+	}
+	Out->Length += len;
+}
+
+/**
+ * \brief Format a signed decimal integer (not terminated)
+ * \return End of the written text
+ */
+char *AsmOut_FmtInt(char *Dest, int64_t Value)
+{
+	char	tmp[20];
+	 int	n = 0;
+	uint64_t	u = Value;
+	if( Value < 0 ) {
+		*Dest++ = '-';
+		u = -u;
+	}
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while( u );
+	while( n )
+		*Dest++ = tmp[--n];
+	return Dest;
+}
+
+/**
+ * \brief Format an unsigned integer as 0x... (not terminated)
+ * \return End of the written text
+ */
+char *AsmOut_FmtHex(char *Dest, uint64_t Value)
+{
+	 int	shift = 0;
+	*Dest++ = '0';
+	*Dest++ = 'x';
+	while( shift < 60 && (Value >> (shift + 4)) )
+		shift += 4;
+	for( ; shift >= 0; shift -= 4 )
+		*Dest++ = "0123456789abcdef"[(Value >> shift) & 0xF];
+	return Dest;
+}
@@ -10,6 +10,8 @@
 #include <global.h>
 #include <symbol.h>
 #include <output.h>
+#include <link.h>
+#include <jit.h>
 #include <string.h>
 
 #define _CONCAT(a,b)	a##b
@@ -18,6 +20,7 @@
 // === CONSTANTS ===
 #define CODE_STEP	1024
 #define RELOC_STEP	16
+#define SYMBOL_STEP	64
 
 //#define OUTPUT_FORMAT	VM16CISC
 #define OUTPUT_FORMAT	X86
@@ -25,25 +28,35 @@
 // === IMPORTS ===
 extern tFunction	*gpFunctions;
 extern tSymbol	*gpGlobalSymbols;
-extern int	X86_GenerateFunction(FILE *OutFile, tFunction *Func);
-extern int	X86_GenerateProlouge(FILE *OutFile);
-extern int	VM16CISC_GenerateFunction(FILE *OutFile, tFunction *Func);
-extern int	VM16CISC_GenerateProlouge(FILE *OutFile);
+extern int	X86_GenerateFunction(tAsmOut *OutFile, tFunction *Func);
+extern int	X86_GenerateProlouge(tAsmOut *OutFile);
+extern int	X86_64_GenerateFunction(tAsmOut *OutFile, tFunction *Func);
+extern int	X86_64_GenerateProlouge(tAsmOut *OutFile);
+extern int	X86_Assemble(const char *Text, size_t Length, tOutput_Object *Object);
+extern const char	gsX86_StartCode[];
+extern const char	gsX86_64_StartCode[];
+extern int	VM16CISC_GenerateFunction(tAsmOut *OutFile, tFunction *Func);
+extern int	VM16CISC_GenerateProlouge(tAsmOut *OutFile);
+extern bool	gbOutputAssembly;
+extern bool	gbLinkExecutable;
+extern const char	**gasLinkInputs;
+extern int	giNumLinkInputs;
+extern bool	gbJitExecute;
+extern const char	*gsJitEntry;
+extern const char	*gsInputFile;
 
 // === PROTOTYPES ===
  int	SetOutputArch(char *Name);
 void	GenerateOutput(char *File);
-#if 0
-void	Output_AppendCode(tOutput_Function *Func, uint8_t Byte);
-void	Output_AppendReloc16(tOutput_Function *Func, int16_t Addend, char *SymName);
-void	Output_AppendReloc32(tOutput_Function *Func, int32_t Addend, char *SymName);
-void	Output_Int_AddReloc(tOutput_Function *Func, int Bits, uint Offset, uint Addend, char *Name);
-#endif
+ int	Output_GenerateObject(tOutput_Object *Object);
+void	Output_int_GenerateCode(tAsmOut *Out);
+void	Output_int_Reserve(tOutput_Section *Sect, size_t Bytes);
 
 // === GLOBALS ===
 const tOutputFormat	caOutputFormats[] = {
-	{"X86", X86_GenerateProlouge, X86_GenerateFunction},
-	//{"VM16CISC", VM16CISC_GenerateProlouge, VM16CISC_GenerateFunction},
+	{"X86", X86_GenerateProlouge, X86_GenerateFunction, X86_Assemble, gsX86_StartCode, {.LongSize = 4, .PointerSize = 4}},
+	{"X86_64", X86_64_GenerateProlouge, X86_64_GenerateFunction, X86_Assemble, gsX86_64_StartCode, {.LongSize = 8, .PointerSize = 8, .bAlignFields = true}},
+	//{"VM16CISC", VM16CISC_GenerateProlouge, VM16CISC_GenerateFunction, NULL},
 };
 #define NUM_OUTPUT_FORMATS	(sizeof(caOutputFormats)/sizeof(caOutputFormats[0]))
 
@@ -56,6 +69,7 @@ int SetOutputArch(char *Name)
 	{
 		if(strcmp(caOutputFormats[i].Name, Name) == 0) {
 			gpOutputFormat = &caOutputFormats[i];
+			Types_SetLayout(&gpOutputFormat->Layout);
 			return 0;
 		}
 	}
@@ -73,131 +87,257 @@ int SetOutputArch(char *Name)
 	return -1;
 }
 
+/**
+ * \brief Generate code for all functions
+ *
+ * The generated assembly is written out directly with -S, otherwise it is
+ * assembled in-process and written as a relocatable object (or linked into
+ * an executable with --link, or run directly with --jit).
+ */
 void GenerateOutput(char *File)
 {
-	tFunction	*func;
 	FILE	*fp = stdout;
 	
-	if( File && (fp = fopen(File, "w")) == NULL )
+	if( !gbOutputAssembly && !gpOutputFormat->Assemble ) {
+		fprintf(stderr, "ERROR: '%s' can only generate assembly (use -S)\n", gpOutputFormat->Name);
+		exit(1);
+	}
+	
+	if( gbOutputAssembly ) {
+		if( File && (fp = fopen(File, "w")) == NULL )
+		{
+			fprintf(stderr, "ERROR: Unable to open '%s' for writing\n", File);
+			perror("GenerateOutput()");
+			exit(1);
+		}
+		tAsmOut	out;
+		AsmOut_Open(&out, fp);
+		Output_int_GenerateCode(&out);
+		AsmOut_Close(&out);
+		AsmOut_Free(&out);
+		if( fp != stdout )
+			fclose(fp);
+		return ;
+	}
+	
+	tOutput_Object	obj = {0};
+	if( Output_GenerateObject(&obj) )
+		exit(1);
+	
+	if( gbJitExecute ) {
+		char	*argv[] = {(char*)gsInputFile, NULL};
+		 int	ret = JIT_Run(&obj, gsJitEntry, 1, argv);
+		Output_FreeObject(&obj);
+		exit(ret);
+	}
+	
+	if( gbLinkExecutable ) {
+		if( Link_WriteExecutable(&obj, gasLinkInputs, giNumLinkInputs, File) )
+			exit(1);
+		Output_FreeObject(&obj);
+		return ;
+	}
+	
+	if( File && (fp = fopen(File, "wb")) == NULL )
 	{
 		fprintf(stderr, "ERROR: Unable to open '%s' for writing\n", File);
 		perror("GenerateOutput()");
+		exit(1);
 	}
+	Output_WriteELF(fp, &obj);
+	if( fp != stdout )
+		fclose(fp);
+	Output_FreeObject(&obj);
+}
+
+/**
+ * \brief Generate code for all functions and assemble it in-process
+ * \return Non-zero if it couldn't be assembled
+ */
+int Output_GenerateObject(tOutput_Object *Object)
+{
+	tAsmOut	out;
+	if( !gpOutputFormat->Assemble ) {
+		fprintf(stderr, "ERROR: '%s' can only generate assembly\n", gpOutputFormat->Name);
+		return 1;
+	}
+	AsmOut_Open(&out, NULL);
+	Output_int_GenerateCode(&out);
+	AsmOut_Close(&out);
+	 int	ret = gpOutputFormat->Assemble(out.Data, out.Length, Object);
+	AsmOut_Free(&out);
+	return ret;
+}
+
+void Output_int_GenerateCode(tAsmOut *Out)
+{
+	//CONCAT(OUTPUT_FORMAT, _GenerateProlouge)(Out);
+	gpOutputFormat->GenProlouge(Out);
 	
-	//CONCAT(OUTPUT_FORMAT, _GenerateProlouge)(fp);
-	gpOutputFormat->GenProlouge(fp);
-	
-	for(func = gpFunctions; func; func = func->Next )
+	for( tFunction *func = gpFunctions; func; func = func->Next )
 	{
 		if( func->Sym.Value == NULL )
 			continue;
 		
-		//CONCAT(OUTPUT_FORMAT,_GenerateFunction)(fp, func);
-		gpOutputFormat->GenFunction(fp, func);
+		//CONCAT(OUTPUT_FORMAT,_GenerateFunction)(Out, func);
+		gpOutputFormat->GenFunction(Out, func);
 	}
 }
 
-#if 0
-void Output_AppendCode(tOutput_Function *Func, uint8_t Byte)
+// --- Object contents ---
+/**
+ * \brief Add a section to an object (returning the existing one if already present)
+ */
+int Output_AddSection(tOutput_Object *Object, const char *Name)
 {
-	printf("Output_AppendCode: (Func=%p, Byte=0x%02x)\n", Func, Byte);
-	if( Func->CodeLength + 1 > Func->CodeSpace )
+	for( int i = 0; i < Object->nSections; i ++ )
 	{
-		Func->CodeSpace += CODE_STEP;
-		Func->Code = realloc(Func->Code, Func->CodeSpace);
-		if(!Func->Code)	perror("Unable to allocate space");
+		if( strcmp(Object->Sections[i].Name, Name) == 0 )
+			return i;
 	}
+	if( Object->nSections == OUTPUT_MAX_SECTIONS ) {
+		fprintf(stderr, "ERROR: Too many output sections (adding '%s')\n", Name);
+		exit(1);
+	}
+	
+	tOutput_Section	*sect = &Object->Sections[Object->nSections];
+	memset(sect, 0, sizeof(*sect));
+	sect->Name = strdup(Name);
+	sect->Align = 4;
+	if( strcmp(Name, ".text") == 0 ) {
+		sect->bExecutable = true;
+		sect->Align = 16;
+	}
+	else if( strcmp(Name, ".bss") == 0 ) {
+		sect->bWritable = true;
+		sect->bNoBits = true;
+	}
+	else if( strcmp(Name, ".rodata") != 0 )
+		sect->bWritable = true;
 	
-	Func->Code[Func->CodeLength++] = Byte;
+	// Every section has a symbol, for relocations against its local labels
+	Output_AddSymbol(Object, sect->Name, Object->nSections, 0, false);
+	Object->Symbols[Object->nSymbols-1].bSection = true;
+	return Object->nSections ++;
 }
 
-void Output_AppendAbs16(tOutput_Function *Func, uint16_t Value)
+/**
+ * \brief Add a symbol (Section = -1 for an external reference)
+ * \return Index of the symbol
+ */
+int Output_AddSymbol(tOutput_Object *Object, const char *Name, int Section, uint64_t Value, bool bGlobal)
 {
-	printf("Output_AppendAbs16: (Func=%p, Value=0x%04x)\n", Func, Value);
-	if( Func->CodeLength + 2 > Func->CodeSpace )
+	if( Object->nSymbols + 1 > Object->SymbolSpace )
 	{
-		Func->CodeSpace += CODE_STEP;
-		Func->Code = realloc(Func->Code, Func->CodeSpace);
-		if(!Func->Code)	perror("Unable to allocate space");
+		Object->SymbolSpace += SYMBOL_STEP;
+		Object->Symbols = realloc(Object->Symbols, Object->SymbolSpace * sizeof(tOutput_Symbol));
+		if(!Object->Symbols)	perror("Unable to allocate space");
 	}
 	
-	//if( Func->LittleEndian ) {
-		Func->Code[Func->CodeLength + 0] = Value&0xFF;
-		Func->Code[Func->CodeLength + 1] = Value>>8;
-	//}
-	
-	Func->CodeLength += 2;
+	tOutput_Symbol	*sym = &Object->Symbols[Object->nSymbols];
+	sym->Name = strdup(Name);
+	sym->Section = Section;
+	sym->Value = Value;
+	sym->Size = 0;
+	sym->bGlobal = bGlobal;
+	sym->bSection = false;
+	return Object->nSymbols ++;
 }
 
-void Output_AppendAbs32(tOutput_Function *Func, uint32_t Value)
+void Output_FreeObject(tOutput_Object *Object)
 {
-	printf("Output_AppendAbs32: (Func=%p, Value=0x%08x)\n", Func, Value);
-	if( Func->CodeLength + 4 > Func->CodeSpace )
+	for( int i = 0; i < Object->nSections; i ++ )
 	{
-		Func->CodeSpace += CODE_STEP;
-		Func->Code = realloc(Func->Code, Func->CodeSpace);
-		if(!Func->Code)	perror("Unable to allocate space");
+		free((char*)Object->Sections[i].Name);
+		free(Object->Sections[i].Code);
+		free(Object->Sections[i].Relocs);
 	}
-	
-	//if( Func->LittleEndian ) {
-		Func->Code[Func->CodeLength + 0] = Value & 0xFF;
-		Func->Code[Func->CodeLength + 1] = (Value >>  8) & 0xFF;
-		Func->Code[Func->CodeLength + 2] = (Value >> 16) & 0xFF;
-		Func->Code[Func->CodeLength + 3] = (Value >> 24) & 0xFF;
-	//}
-	
-	Func->CodeLength += 4;
+	for( int i = 0; i < Object->nSymbols; i ++ )
+		free(Object->Symbols[i].Name);
+	free(Object->Symbols);
+	memset(Object, 0, sizeof(*Object));
 }
 
-void Output_AppendReloc16(tOutput_Function *Func, int16_t Addend, char *SymName)
+void Output_int_Reserve(tOutput_Section *Sect, size_t Bytes)
 {
-	printf("Output_AppendReloc16: (Func=%p, Addend=0x%04x, SymName='%s')\n", Func, Addend, SymName);
-	if( Func->CodeLength + 2 > Func->CodeSpace )
+	if( Sect->CodeLength + Bytes > Sect->CodeSpace )
 	{
-		Func->CodeSpace += CODE_STEP;
-		Func->Code = realloc(Func->Code, Func->CodeSpace);
-		if(!Func->Code)	perror("Unable to allocate space");
+		while( Sect->CodeLength + Bytes > Sect->CodeSpace )
+			Sect->CodeSpace += Sect->CodeSpace / 2 + CODE_STEP;
+		Sect->Code = realloc(Sect->Code, Sect->CodeSpace);
+		if(!Sect->Code)	perror("Unable to allocate space");
 	}
-	
-	Func->Code[Func->CodeLength + 0] = 0;
-	Func->Code[Func->CodeLength + 1] = 0;
-	
-	Output_Int_AddReloc(Func, 16, Func->CodeLength, Addend, SymName);
-	Func->CodeLength += 2;
 }
 
-void Output_AppendReloc32(tOutput_Function *Func, int32_t Addend, char *SymName)
+void Output_AppendCode(tOutput_Section *Sect, uint8_t Byte)
 {
-	printf("Output_AppendReloc32: (Func=%p, Addend=0x%08x, SymName='%s')\n", Func, Addend, SymName);
-	if( Func->CodeLength + 4 > Func->CodeSpace )
-	{
-		Func->CodeSpace += CODE_STEP;
-		Func->Code = realloc(Func->Code, Func->CodeSpace);
-		if(!Func->Code)	perror("Unable to allocate space");
-	}
+	Output_int_Reserve(Sect, 1);
+	Sect->Code[Sect->CodeLength++] = Byte;
+}
+
+void Output_AppendData(tOutput_Section *Sect, const void *Data, size_t Length)
+{
+	Output_int_Reserve(Sect, Length);
+	if( Data )
+		memcpy(Sect->Code + Sect->CodeLength, Data, Length);
+	else
+		memset(Sect->Code + Sect->CodeLength, 0, Length);
+	Sect->CodeLength += Length;
+}
+
+void Output_AppendAbs16(tOutput_Section *Sect, uint16_t Value)
+{
+	Output_int_Reserve(Sect, 2);
+	//if( Func->LittleEndian ) {
+		Sect->Code[Sect->CodeLength + 0] = Value&0xFF;
+		Sect->Code[Sect->CodeLength + 1] = Value>>8;
+	//}
 	
-	Func->Code[Func->CodeLength + 0] = 0;
-	Func->Code[Func->CodeLength + 1] = 0;
-	Func->Code[Func->CodeLength + 2] = 0;
-	Func->Code[Func->CodeLength + 3] = 0;
+	Sect->CodeLength += 2;
+}
+
+void Output_AppendAbs32(tOutput_Section *Sect, uint32_t Value)
+{
+	Output_int_Reserve(Sect, 4);
+	//if( Func->LittleEndian ) {
+		Sect->Code[Sect->CodeLength + 0] = Value & 0xFF;
+		Sect->Code[Sect->CodeLength + 1] = (Value >>  8) & 0xFF;
+		Sect->Code[Sect->CodeLength + 2] = (Value >> 16) & 0xFF;
+		Sect->Code[Sect->CodeLength + 3] = (Value >> 24) & 0xFF;
+	//}
 	
-	Output_Int_AddReloc(Func, 32, Func->CodeLength, Addend, SymName);
-	Func->CodeLength += 4;
+	Sect->CodeLength += 4;
+}
+
+void Output_AppendAbs64(tOutput_Section *Sect, uint64_t Value)
+{
+	Output_AppendAbs32(Sect, Value & 0xFFFFFFFF);
+	Output_AppendAbs32(Sect, Value >> 32);
+}
+
+/**
+ * \brief Append a relocated field (zero filled, the addend is kept in the relocation)
+ */
+void Output_AppendReloc(tOutput_Section *Sect, int Bits, bool bRelative, bool bBranch, int64_t Addend, int Symbol)
+{
+	Output_Int_AddReloc(Sect, Bits, bRelative, bBranch, Sect->CodeLength, Addend, Symbol);
+	Output_AppendData(Sect, NULL, Bits / 8);
 }
 
-void Output_Int_AddReloc(tOutput_Function *Func, int Bits, uint Offset, uint Addend, char *Name)
+void Output_Int_AddReloc(tOutput_Section *Sect, int Bits, bool bRelative, bool bBranch, uint64_t Offset, int64_t Addend, int Symbol)
 {
-	if( Func->nRelocs + 1 > Func->RelocSpace )
+	if( Sect->nRelocs + 1 > Sect->RelocSpace )
 	{
-		Func->RelocSpace += RELOC_STEP;
-		Func->Relocs = realloc(Func->Relocs, Func->RelocSpace);
-		if(!Func->Relocs)	perror("Unable to allocate space");
+		Sect->RelocSpace += RELOC_STEP;
+		Sect->Relocs = realloc(Sect->Relocs, Sect->RelocSpace * sizeof(tOutput_Reloc));
+		if(!Sect->Relocs)	perror("Unable to allocate space");
 	}
 	
-	Func->Relocs[Func->nRelocs].Name = Name;
-	Func->Relocs[Func->nRelocs].Size = Bits;
-	Func->Relocs[Func->nRelocs].Addend = Addend;
-	Func->Relocs[Func->nRelocs].Offset = Offset;
-	Func->nRelocs ++;
+	Sect->Relocs[Sect->nRelocs].Symbol = Symbol;
+	Sect->Relocs[Sect->nRelocs].Size = Bits;
+	Sect->Relocs[Sect->nRelocs].bRelative = bRelative;
+	Sect->Relocs[Sect->nRelocs].bBranch = bBranch;
+	Sect->Relocs[Sect->nRelocs].Addend = Addend;
+	Sect->Relocs[Sect->nRelocs].Offset = Offset;
+	Sect->nRelocs ++;
 }
-#endif
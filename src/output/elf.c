@@ -0,0 +1,724 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * output/elf.c
+ * - ELF relocatable object writer
+ *
+ * Writes a tOutput_Object (from an architecture's assembler) as an ELF32 or
+ * ELF64 ET_REL file. ELF32 objects use REL relocations (addend stored in the
+ * section data), ELF64 objects use RELA.
+ *
+ * Also reads relocatable objects and writes static executables for the
+ * linker (output/link.c).
+ */
+#include <global.h>
+#include <symbol.h>
+#include <output.h>
+#include <link.h>
+#include <string.h>
+
+// === CONSTANTS ===
+#define EM_386	3
+#define EM_X86_64	62
+
+#define SHT_PROGBITS	1
+#define SHT_SYMTAB	2
+#define SHT_STRTAB	3
+#define SHT_RELA	4
+#define SHT_NOBITS	8
+#define SHT_REL	9
+#define SHT_GROUP	17
+
+#define SHN_ABS	0xFFF1
+#define SHN_COMMON	0xFFF2
+#define SHN_LORESERVE	0xFF00
+
+#define SHF_WRITE	0x1
+#define SHF_ALLOC	0x2
+#define SHF_EXECINSTR	0x4
+#define SHF_INFO_LINK	0x40
+
+#define STB_LOCAL	0
+#define STB_GLOBAL	1
+#define STB_WEAK	2
+#define STT_NOTYPE	0
+#define STT_OBJECT	1
+#define STT_FUNC	2
+#define STT_SECTION	3
+
+#define PT_LOAD	1
+#define PF_X	1
+#define PF_W	2
+#define PF_R	4
+
+// === TYPES ===
+typedef struct
+{
+	const tOutput_Object	*Object;
+	bool	b64;
+	tOutput_Section	File;	//!< Image being built
+	tOutput_Section	StrTab;
+	tOutput_Section	ShStrTab;
+	 int	*SymMap;	//!< Object symbol index to ELF symbol index
+	 int	nLocalSyms;	//!< ELF symbols before the first global
+	 int	nElfSyms;
+} tElfState;
+
+// === PROTOTYPES ===
+ int	Output_WriteELF(FILE *OutFile, const tOutput_Object *Object);
+void	Elf_int_Align(tOutput_Section *Buf, int Align);
+void	Elf_int_PutAddr(tElfState *State, tOutput_Section *Buf, uint64_t Value);
+ int	Elf_int_AddString(tOutput_Section *Table, const char *String);
+ int	Elf_int_RelocType(const tOutput_Object *Object, const tOutput_Reloc *Reloc);
+void	Elf_int_WriteSymbols(tElfState *State, tOutput_Section *SymTab);
+void	Elf_int_SectionHeader(tElfState *State, int Name, uint32_t Type, uint64_t Flags, uint64_t Addr,
+	uint64_t Offset, uint64_t Size, uint32_t Link, uint32_t Info, uint64_t Align, uint64_t EntSize);
+void	Elf_int_Header(tElfState *State, tOutput_Section *Buf, int Type, int Machine, uint64_t Entry,
+	int nPHdrs, uint64_t ShOff, int nSHdrs);
+tLinkObject	*Output_ReadELF(const uint8_t *Data, size_t Size, const char *Name, int Bits, int Machine);
+ int	Elf_int_MapReloc(int Machine, uint32_t Type, tOutput_Reloc *Reloc);
+size_t	Output_ELFExecHeaderSize(int Bits);
+ int	Output_WriteELFExecutable(FILE *OutFile, const tLinkImage *Image);
+
+// === CODE ===
+/**
+ * \brief Write an object as an ELF relocatable file
+ */
+int Output_WriteELF(FILE *OutFile, const tOutput_Object *Object)
+{
+	tElfState	state = {.Object = Object, .b64 = (Object->Bits == 64)};
+	tOutput_Section	*file = &state.File;
+	 int	nsect = Object->nSections;
+	uint64_t	sect_ofs[OUTPUT_MAX_SECTIONS];
+	uint64_t	rel_ofs[OUTPUT_MAX_SECTIONS];
+	size_t	rel_size[OUTPUT_MAX_SECTIONS];
+	 int	ehsize = (state.b64 ? 64 : 52);
+	 int	relsize = (state.b64 ? 24 : 8);
+
+	Output_AppendCode(&state.StrTab, 0);
+	Output_AppendCode(&state.ShStrTab, 0);
+
+	// Header is filled in last
+	Output_AppendData(file, NULL, ehsize);
+
+	// Section contents (REL addends are stored in the data)
+	for( int i = 0; i < nsect; i ++ )
+	{
+		const tOutput_Section	*sect = &Object->Sections[i];
+		Elf_int_Align(file, sect->Align);
+		sect_ofs[i] = file->CodeLength;
+		if( sect->bNoBits )
+			continue ;
+		Output_AppendData(file, sect->Code, sect->CodeLength);
+		if( state.b64 )
+			continue ;
+		for( int r = 0; r < sect->nRelocs; r ++ )
+		{
+			const tOutput_Reloc	*rel = &sect->Relocs[r];
+			uint8_t	*p = file->Code + sect_ofs[i] + rel->Offset;
+			uint64_t	v = rel->Addend;
+			for( int b = 0; b < rel->Size / 8; b ++ )
+				p[b] = (v >> (b*8)) & 0xFF;
+		}
+	}
+
+	// Symbols: section symbols and locals, then globals
+	tOutput_Section	symtab = {0};
+	Elf_int_WriteSymbols(&state, &symtab);
+
+	// Relocations
+	for( int i = 0; i < nsect; i ++ )
+	{
+		const tOutput_Section	*sect = &Object->Sections[i];
+		Elf_int_Align(file, state.b64 ? 8 : 4);
+		rel_ofs[i] = file->CodeLength;
+		for( int r = 0; r < sect->nRelocs; r ++ )
+		{
+			const tOutput_Reloc	*rel = &sect->Relocs[r];
+			uint32_t	type = Elf_int_RelocType(Object, rel);
+			uint32_t	sym = state.SymMap[rel->Symbol];
+			if( state.b64 ) {
+				Output_AppendAbs64(file, rel->Offset);
+				Output_AppendAbs64(file, ((uint64_t)sym << 32) | type);
+				Output_AppendAbs64(file, rel->Addend);
+			}
+			else {
+				Output_AppendAbs32(file, rel->Offset);
+				Output_AppendAbs32(file, (sym << 8) | type);
+			}
+		}
+		rel_size[i] = file->CodeLength - rel_ofs[i];
+	}
+
+	Elf_int_Align(file, state.b64 ? 8 : 4);
+	uint64_t	symtab_ofs = file->CodeLength;
+	Output_AppendData(file, symtab.Code, symtab.CodeLength);
+	uint64_t	strtab_ofs = file->CodeLength;
+	Output_AppendData(file, state.StrTab.Code, state.StrTab.CodeLength);
+
+	// Section names
+	 int	sect_name[OUTPUT_MAX_SECTIONS], rel_name[OUTPUT_MAX_SECTIONS];
+	 int	nrel = 0;
+	for( int i = 0; i < nsect; i ++ )
+		sect_name[i] = Elf_int_AddString(&state.ShStrTab, Object->Sections[i].Name);
+	for( int i = 0; i < nsect; i ++ )
+	{
+		char	name[64];
+		if( Object->Sections[i].nRelocs == 0 )
+			continue ;
+		snprintf(name, sizeof(name), "%s%s", (state.b64 ? ".rela" : ".rel"), Object->Sections[i].Name);
+		rel_name[i] = Elf_int_AddString(&state.ShStrTab, name);
+		nrel ++;
+	}
+	 int	symtab_name = Elf_int_AddString(&state.ShStrTab, ".symtab");
+	 int	strtab_name = Elf_int_AddString(&state.ShStrTab, ".strtab");
+	 int	gnustack_name = Elf_int_AddString(&state.ShStrTab, ".note.GNU-stack");
+	 int	shstrtab_name = Elf_int_AddString(&state.ShStrTab, ".shstrtab");
+	uint64_t	shstrtab_ofs = file->CodeLength;
+	Output_AppendData(file, state.ShStrTab.Code, state.ShStrTab.CodeLength);
+
+	// Section headers
+	 int	symtab_idx = 1 + nsect + nrel;
+	 int	shnum = symtab_idx + 4;
+	Elf_int_Align(file, state.b64 ? 8 : 4);
+	uint64_t	shoff = file->CodeLength;
+	Elf_int_SectionHeader(&state, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	for( int i = 0; i < nsect; i ++ )
+	{
+		const tOutput_Section	*sect = &Object->Sections[i];
+		uint64_t	flags = SHF_ALLOC;
+		if( sect->bWritable )	flags |= SHF_WRITE;
+		if( sect->bExecutable )	flags |= SHF_EXECINSTR;
+		Elf_int_SectionHeader(&state, sect_name[i], (sect->bNoBits ? SHT_NOBITS : SHT_PROGBITS), flags, 0,
+			sect_ofs[i], sect->CodeLength, 0, 0, sect->Align, 0);
+	}
+	for( int i = 0; i < nsect; i ++ )
+	{
+		if( Object->Sections[i].nRelocs == 0 )
+			continue ;
+		Elf_int_SectionHeader(&state, rel_name[i], (state.b64 ? SHT_RELA : SHT_REL), SHF_INFO_LINK, 0,
+			rel_ofs[i], rel_size[i], symtab_idx, 1 + i, (state.b64 ? 8 : 4), relsize);
+	}
+	Elf_int_SectionHeader(&state, symtab_name, SHT_SYMTAB, 0, 0, symtab_ofs, symtab.CodeLength,
+		symtab_idx + 1, state.nLocalSyms, (state.b64 ? 8 : 4), (state.b64 ? 24 : 16));
+	Elf_int_SectionHeader(&state, strtab_name, SHT_STRTAB, 0, 0, strtab_ofs, state.StrTab.CodeLength,
+		0, 0, 1, 0);
+	// Empty, so the linker doesn't assume this object needs an executable stack
+	Elf_int_SectionHeader(&state, gnustack_name, SHT_PROGBITS, 0, 0, shstrtab_ofs, 0, 0, 0, 1, 0);
+	Elf_int_SectionHeader(&state, shstrtab_name, SHT_STRTAB, 0, 0, shstrtab_ofs, state.ShStrTab.CodeLength,
+		0, 0, 1, 0);
+
+	// ELF header
+	tOutput_Section	ehdr = {0};
+	Elf_int_Header(&state, &ehdr, 1 /*ET_REL*/, Object->Machine, 0, 0, shoff, shnum);
+	memcpy(file->Code, ehdr.Code, ehsize);
+
+	 int	rv = 0;
+	if( fwrite(file->Code, 1, file->CodeLength, OutFile) != file->CodeLength ) {
+		perror("Output_WriteELF");
+		rv = -1;
+	}
+
+	free(ehdr.Code);
+	free(symtab.Code);
+	free(file->Code);
+	free(state.StrTab.Code);
+	free(state.ShStrTab.Code);
+	free(state.SymMap);
+	return rv;
+}
+
+void Elf_int_Align(tOutput_Section *Buf, int Align)
+{
+	while( Align > 1 && Buf->CodeLength % Align )
+		Output_AppendCode(Buf, 0);
+}
+
+void Elf_int_PutAddr(tElfState *State, tOutput_Section *Buf, uint64_t Value)
+{
+	if( State->b64 )
+		Output_AppendAbs64(Buf, Value);
+	else
+		Output_AppendAbs32(Buf, Value);
+}
+
+int Elf_int_AddString(tOutput_Section *Table, const char *String)
+{
+	 int	ofs = Table->CodeLength;
+	Output_AppendData(Table, String, strlen(String) + 1);
+	return ofs;
+}
+
+int Elf_int_RelocType(const tOutput_Object *Object, const tOutput_Reloc *Reloc)
+{
+	switch( Object->Machine )
+	{
+	case EM_386:
+		if( Reloc->Size == 32 && Reloc->bBranch )
+			return 4;	// R_386_PLT32
+		if( Reloc->Size == 32 )
+			return Reloc->bRelative ? 2 : 1;	// R_386_PC32 / R_386_32
+		if( Reloc->Size == 16 )
+			return Reloc->bRelative ? 21 : 20;	// R_386_PC16 / R_386_16
+		break;
+	case EM_X86_64:
+		if( Reloc->Size == 64 && !Reloc->bRelative )
+			return 1;	// R_X86_64_64
+		if( Reloc->Size == 32 && Reloc->bBranch )
+			return 4;	// R_X86_64_PLT32
+		if( Reloc->Size == 32 )
+			return Reloc->bRelative ? 2 : 11;	// R_X86_64_PC32 / R_X86_64_32S
+		break;
+	}
+	fprintf(stderr, "ERROR: ELF machine %i has no %i bit%s relocation\n",
+		Object->Machine, Reloc->Size, (Reloc->bRelative ? " relative" : ""));
+	exit(1);
+}
+
+/**
+ * \brief Build the symbol table (locals must come before globals)
+ */
+void Elf_int_WriteSymbols(tElfState *State, tOutput_Section *SymTab)
+{
+	const tOutput_Object	*obj = State->Object;
+	State->SymMap = malloc(obj->nSymbols * sizeof(int));
+	State->nElfSyms = 1;
+	// Null symbol
+	Output_AppendData(SymTab, NULL, State->b64 ? 24 : 16);
+	for( int pass = 0; pass < 2; pass ++ )
+	{
+		for( int i = 0; i < obj->nSymbols; i ++ )
+		{
+			const tOutput_Symbol	*sym = &obj->Symbols[i];
+			bool	global = sym->bGlobal || sym->Section < 0;
+			if( global != (pass == 1) )
+				continue ;
+			State->SymMap[i] = State->nElfSyms ++;
+
+			uint32_t	name = (sym->bSection ? 0 : Elf_int_AddString(&State->StrTab, sym->Name));
+			uint8_t	type = STT_NOTYPE;
+			if( sym->bSection )
+				type = STT_SECTION;
+			else if( sym->Section >= 0 )
+				type = (obj->Sections[sym->Section].bExecutable ? STT_FUNC : STT_OBJECT);
+			uint8_t	info = ((global ? STB_GLOBAL : STB_LOCAL) << 4) | type;
+			uint16_t	shndx = (sym->Section < 0 ? 0 : 1 + sym->Section);
+			if( State->b64 ) {
+				Output_AppendAbs32(SymTab, name);
+				Output_AppendCode(SymTab, info);
+				Output_AppendCode(SymTab, 0);
+				Output_AppendAbs16(SymTab, shndx);
+				Output_AppendAbs64(SymTab, sym->Value);
+				Output_AppendAbs64(SymTab, sym->Size);
+			}
+			else {
+				Output_AppendAbs32(SymTab, name);
+				Output_AppendAbs32(SymTab, sym->Value);
+				Output_AppendAbs32(SymTab, sym->Size);
+				Output_AppendCode(SymTab, info);
+				Output_AppendCode(SymTab, 0);
+				Output_AppendAbs16(SymTab, shndx);
+			}
+		}
+		if( pass == 0 )
+			State->nLocalSyms = State->nElfSyms;
+	}
+}
+
+void Elf_int_SectionHeader(tElfState *State, int Name, uint32_t Type, uint64_t Flags, uint64_t Addr,
+	uint64_t Offset, uint64_t Size, uint32_t Link, uint32_t Info, uint64_t Align, uint64_t EntSize)
+{
+	tOutput_Section	*buf = &State->File;
+	Output_AppendAbs32(buf, Name);
+	Output_AppendAbs32(buf, Type);
+	Elf_int_PutAddr(State, buf, Flags);
+	Elf_int_PutAddr(State, buf, Addr);
+	Elf_int_PutAddr(State, buf, Offset);
+	Elf_int_PutAddr(State, buf, Size);
+	Output_AppendAbs32(buf, Link);
+	Output_AppendAbs32(buf, Info);
+	Elf_int_PutAddr(State, buf, Align);
+	Elf_int_PutAddr(State, buf, EntSize);
+}
+
+void Elf_int_Header(tElfState *State, tOutput_Section *Buf, int Type, int Machine, uint64_t Entry,
+	int nPHdrs, uint64_t ShOff, int nSHdrs)
+{
+	static const uint8_t	ident[] = {0x7F, 'E', 'L', 'F'};
+	 int	ehsize = (State->b64 ? 64 : 52);
+	Output_AppendData(Buf, ident, 4);
+	Output_AppendCode(Buf, State->b64 ? 2 : 1);	// EI_CLASS
+	Output_AppendCode(Buf, 1);	// EI_DATA (little endian)
+	Output_AppendCode(Buf, 1);	// EI_VERSION
+	Output_AppendData(Buf, NULL, 9);
+	Output_AppendAbs16(Buf, Type);
+	Output_AppendAbs16(Buf, Machine);
+	Output_AppendAbs32(Buf, 1);
+	Elf_int_PutAddr(State, Buf, Entry);
+	Elf_int_PutAddr(State, Buf, nPHdrs ? ehsize : 0);	// e_phoff
+	Elf_int_PutAddr(State, Buf, ShOff);
+	Output_AppendAbs32(Buf, 0);	// e_flags
+	Output_AppendAbs16(Buf, ehsize);
+	Output_AppendAbs16(Buf, nPHdrs ? (State->b64 ? 56 : 32) : 0);
+	Output_AppendAbs16(Buf, nPHdrs);
+	Output_AppendAbs16(Buf, State->b64 ? 64 : 40);
+	Output_AppendAbs16(Buf, nSHdrs);
+	Output_AppendAbs16(Buf, nSHdrs - 1);	// e_shstrndx (always last)
+}
+
+// --- Relocatable object input ---
+static uint64_t Elf_int_Get(const uint8_t *Data, size_t Size, uint64_t Ofs, int Bytes, const char *Name)
+{
+	if( Ofs + Bytes > Size || Ofs + Bytes < Ofs ) {
+		fprintf(stderr, "ERROR: %s: Truncated ELF file\n", Name);
+		exit(1);
+	}
+	uint64_t	ret = 0;
+	for( int i = Bytes; i --; )
+		ret = (ret << 8) | Data[Ofs + i];
+	return ret;
+}
+
+/**
+ * \brief Read an ELF relocatable object
+ * \note Section contents point into Data, which must stay valid
+ */
+tLinkObject *Output_ReadELF(const uint8_t *Data, size_t Size, const char *Name, int Bits, int Machine)
+{
+	#define GET(ofs, bytes)	Elf_int_Get(Data, Size, (ofs), (bytes), Name)
+	if( Size < 16 || memcmp(Data, "\x7F" "ELF", 4) != 0 ) {
+		fprintf(stderr, "ERROR: %s: Not an ELF file\n", Name);
+		exit(1);
+	}
+	bool	b64 = (Data[4] == 2);
+	 int	addr = (b64 ? 8 : 4);
+	if( (b64 ? 64 : 32) != Bits || GET(18, 2) != Machine || Data[5] != 1 ) {
+		fprintf(stderr, "ERROR: %s: Wrong ELF class or machine for this target\n", Name);
+		exit(1);
+	}
+	if( GET(16, 2) != 1 ) {
+		fprintf(stderr, "ERROR: %s: Not a relocatable object\n", Name);
+		exit(1);
+	}
+	uint64_t	shoff = GET(b64 ? 0x28 : 0x20, addr);
+	 int	shentsize = GET(b64 ? 0x3A : 0x2E, 2);
+	 int	shnum = GET(b64 ? 0x3C : 0x30, 2);
+	 int	shstrndx = GET(b64 ? 0x3E : 0x32, 2);
+	#define SH(i, field)	(shoff + (uint64_t)(i) * shentsize + (field))
+	#define SH_TYPE(i)	GET(SH(i, 4), 4)
+	#define SH_FLAGS(i)	GET(SH(i, 8), addr)
+	#define SH_OFFSET(i)	GET(SH(i, b64 ? 0x18 : 0x10), addr)
+	#define SH_SIZE(i)	GET(SH(i, b64 ? 0x20 : 0x14), addr)
+	#define SH_LINK(i)	GET(SH(i, b64 ? 0x28 : 0x18), 4)
+	#define SH_INFO(i)	GET(SH(i, b64 ? 0x2C : 0x1C), 4)
+	#define SH_ALIGN(i)	GET(SH(i, b64 ? 0x30 : 0x20), addr)
+
+	tLinkObject	*obj = calloc(1, sizeof(tLinkObject));
+	obj->Name = strdup(Name);
+	obj->nSections = shnum;
+	obj->Sections = calloc(shnum, sizeof(tLinkSection));
+	uint64_t	shstr = SH_OFFSET(shstrndx);
+	 int	symtab = -1;
+	for( int i = 1; i < shnum; i ++ )
+	{
+		tLinkSection	*sect = &obj->Sections[i];
+		uint32_t	type = SH_TYPE(i);
+		uint64_t	flags = SH_FLAGS(i);
+		const char	*name = (const char*)Data + shstr + GET(SH(i, 0), 4);
+		sect->Name = strdup( (shstr + GET(SH(i, 0), 4) < Size) ? name : "?" );
+		sect->Size = SH_SIZE(i);
+		sect->Align = SH_ALIGN(i);
+		sect->Kind = LINK_NONE;
+		if( type == SHT_SYMTAB )
+			symtab = i;
+		if( !(flags & SHF_ALLOC) || type == SHT_GROUP )
+			continue ;
+		if( type == SHT_NOBITS )
+			sect->Kind = LINK_BSS;
+		else {
+			if( SH_OFFSET(i) + sect->Size > Size ) {
+				fprintf(stderr, "ERROR: %s: Section '%s' is truncated\n", Name, sect->Name);
+				exit(1);
+			}
+			sect->Data = Data + SH_OFFSET(i);
+			if( flags & SHF_EXECINSTR )
+				sect->Kind = LINK_TEXT;
+			else if( flags & SHF_WRITE )
+				sect->Kind = LINK_DATA;
+			else
+				sect->Kind = LINK_RODATA;
+		}
+	}
+
+	// Symbols
+	if( symtab >= 0 )
+	{
+		 int	entsize = (b64 ? 24 : 16);
+		uint64_t	ofs = SH_OFFSET(symtab);
+		uint64_t	strtab = SH_OFFSET(SH_LINK(symtab));
+		obj->nSymbols = SH_SIZE(symtab) / entsize;
+		obj->Symbols = calloc(obj->nSymbols, sizeof(tLinkSymbol));
+		for( int i = 1; i < obj->nSymbols; i ++ )
+		{
+			tLinkSymbol	*sym = &obj->Symbols[i];
+			uint64_t	ent = ofs + (uint64_t)i * entsize;
+			uint8_t	info = GET(ent + (b64 ? 4 : 12), 1);
+			uint16_t	shndx = GET(ent + (b64 ? 6 : 14), 2);
+			uint64_t	nameofs = strtab + GET(ent, 4);
+			sym->Name = strdup( nameofs < Size ? (const char*)Data + nameofs : "?" );
+			sym->Value = GET(ent + (b64 ? 8 : 4), addr);
+			sym->Size = GET(ent + (b64 ? 16 : 8), addr);
+			sym->bGlobal = (info >> 4) == STB_GLOBAL || (info >> 4) == STB_WEAK;
+			sym->bWeak = (info >> 4) == STB_WEAK;
+			sym->bFunc = (info & 0xF) == STT_FUNC;
+			if( shndx == 0 )
+				sym->Section = LINK_UNDEF;
+			else if( shndx == SHN_ABS )
+				sym->Section = LINK_ABS;
+			else if( shndx == SHN_COMMON )
+				sym->Section = LINK_COMMON;
+			else if( shndx >= SHN_LORESERVE || shndx >= shnum ) {
+				fprintf(stderr, "ERROR: %s: Unsupported section index 0x%x for '%s'\n", Name, shndx, sym->Name);
+				exit(1);
+			}
+			else
+				sym->Section = shndx;
+		}
+	}
+
+	// Relocations and COMDAT groups
+	for( int i = 1; i < shnum; i ++ )
+	{
+		uint32_t	type = SH_TYPE(i);
+		uint64_t	ofs = SH_OFFSET(i);
+		uint64_t	size = SH_SIZE(i);
+		if( type == SHT_GROUP )
+		{
+			 int	sig = SH_INFO(i);
+			if( !(GET(ofs, 4) & 1) || sig >= obj->nSymbols )
+				continue ;	// (only COMDAT groups matter)
+			tLinkGroup	*grp;
+			obj->Groups = realloc(obj->Groups, (obj->nGroups + 1) * sizeof(tLinkGroup));
+			grp = &obj->Groups[obj->nGroups++];
+			grp->Signature = strdup(obj->Symbols[sig].Name);
+			grp->nMembers = size / 4 - 1;
+			grp->Members = malloc(grp->nMembers * sizeof(int));
+			for( int j = 0; j < grp->nMembers; j ++ )
+				grp->Members[j] = GET(ofs + 4 + j*4, 4);
+			continue ;
+		}
+		if( type != SHT_REL && type != SHT_RELA )
+			continue ;
+		 int	target = SH_INFO(i);
+		if( target <= 0 || target >= shnum || obj->Sections[target].Kind == LINK_NONE )
+			continue ;
+		tLinkSection	*sect = &obj->Sections[target];
+		 int	entsize = (type == SHT_RELA ? 3 : 2) * addr;
+		 int	n = size / entsize;
+		sect->Relocs = realloc(sect->Relocs, (sect->nRelocs + n) * sizeof(tOutput_Reloc));
+		for( int j = 0; j < n; j ++ )
+		{
+			tOutput_Reloc	*rel = &sect->Relocs[sect->nRelocs++];
+			uint64_t	ent = ofs + (uint64_t)j * entsize;
+			uint64_t	info = GET(ent + addr, addr);
+			uint32_t	rtype = (b64 ? info & 0xFFFFFFFF : info & 0xFF);
+			rel->Offset = GET(ent, addr);
+			rel->Symbol = (b64 ? info >> 32 : info >> 8);
+			if( rel->Symbol >= obj->nSymbols || rel->Offset >= sect->Size ) {
+				fprintf(stderr, "ERROR: %s: Bad relocation in '%s'\n", Name, sect->Name);
+				exit(1);
+			}
+			if( !Elf_int_MapReloc(Machine, rtype, rel) ) {
+				fprintf(stderr, "ERROR: %s: Unsupported relocation type %i in '%s' (PIC code isn't supported)\n",
+					Name, rtype, sect->Name);
+				exit(1);
+			}
+			if( type == SHT_RELA )
+				rel->Addend = GET(ent + 2*addr, addr);
+			else {
+				// Sign extended addend from the section data
+				 int	bits = rel->Size;
+				uint64_t	v = (sect->Data ? GET((sect->Data - Data) + rel->Offset, bits/8) : 0);
+				if( bits < 64 && (v >> (bits-1)) & 1 )
+					v |= ~0ULL << bits;
+				rel->Addend = v;
+			}
+		}
+	}
+	return obj;
+	#undef GET
+	#undef SH
+	#undef SH_TYPE
+	#undef SH_FLAGS
+	#undef SH_OFFSET
+	#undef SH_SIZE
+	#undef SH_LINK
+	#undef SH_INFO
+	#undef SH_ALIGN
+}
+
+/**
+ * \brief Convert a machine relocation type to a field size and kind
+ */
+int Elf_int_MapReloc(int Machine, uint32_t Type, tOutput_Reloc *Reloc)
+{
+	Reloc->bRelative = false;
+	Reloc->bBranch = false;
+	switch( Machine )
+	{
+	case EM_386:
+		switch(Type)
+		{
+		case 1:	Reloc->Size = 32;	return 1;	// R_386_32
+		case 2:	Reloc->Size = 32;	Reloc->bRelative = true;	return 1;	// R_386_PC32
+		case 4:	Reloc->Size = 32;	Reloc->bRelative = Reloc->bBranch = true;	return 1;	// R_386_PLT32
+		case 20:	Reloc->Size = 16;	return 1;	// R_386_16
+		case 21:	Reloc->Size = 16;	Reloc->bRelative = true;	return 1;	// R_386_PC16
+		}
+		break;
+	case EM_X86_64:
+		switch(Type)
+		{
+		case 1:	Reloc->Size = 64;	return 1;	// R_X86_64_64
+		case 2:	Reloc->Size = 32;	Reloc->bRelative = true;	return 1;	// R_X86_64_PC32
+		case 4:	Reloc->Size = 32;	Reloc->bRelative = Reloc->bBranch = true;	return 1;	// R_X86_64_PLT32
+		case 10:	// R_X86_64_32
+		case 11:	Reloc->Size = 32;	return 1;	// R_X86_64_32S
+		case 24:	Reloc->Size = 64;	Reloc->bRelative = true;	return 1;	// R_X86_64_PC64
+		}
+		break;
+	}
+	return 0;
+}
+
+// --- Executable output ---
+size_t Output_ELFExecHeaderSize(int Bits)
+{
+	return (Bits == 64 ? 64 + 2*56 : 52 + 2*32);
+}
+
+static void Elf_int_ProgramHeader(tElfState *State, tOutput_Section *Buf, uint32_t Flags,
+	uint64_t Offset, uint64_t Addr, uint64_t FileSize, uint64_t MemSize)
+{
+	Output_AppendAbs32(Buf, PT_LOAD);
+	if( State->b64 )
+		Output_AppendAbs32(Buf, Flags);
+	Elf_int_PutAddr(State, Buf, Offset);
+	Elf_int_PutAddr(State, Buf, Addr);
+	Elf_int_PutAddr(State, Buf, Addr);	// p_paddr
+	Elf_int_PutAddr(State, Buf, FileSize);
+	Elf_int_PutAddr(State, Buf, MemSize);
+	if( !State->b64 )
+		Output_AppendAbs32(Buf, Flags);
+	Elf_int_PutAddr(State, Buf, 0x1000);
+}
+
+/**
+ * \brief Write a linked image as a static ELF executable
+ *
+ * The code segment starts at file offset zero (its first bytes are the
+ * headers) and the data segment follows on the next page. Section headers
+ * and a symbol table are added so the result can be disassembled.
+ */
+int Output_WriteELFExecutable(FILE *OutFile, const tLinkImage *Image)
+{
+	tElfState	state = {.b64 = (Image->Bits == 64)};
+	tOutput_Section	*file = &state.File;
+	uint64_t	data_ofs = Image->DataAddr - Image->TextAddr;
+
+	Output_AppendData(file, Image->Text, Image->TextSize);
+	Output_AppendData(file, NULL, data_ofs - Image->TextSize);
+	Output_AppendData(file, Image->Data, Image->DataSize);
+
+	// Symbols (all global, in the section containing them)
+	tOutput_Section	symtab = {0};
+	Output_AppendCode(&state.StrTab, 0);
+	Output_AppendCode(&state.ShStrTab, 0);
+	Output_AppendData(&symtab, NULL, state.b64 ? 24 : 16);
+	for( int i = 0; i < Image->nSymbols; i ++ )
+	{
+		const tLinkImageSymbol	*sym = &Image->Symbols[i];
+		uint32_t	name = Elf_int_AddString(&state.StrTab, sym->Name);
+		uint8_t	info = (STB_GLOBAL << 4) | (sym->bFunc ? STT_FUNC : STT_OBJECT);
+		uint16_t	shndx;
+		if( sym->Addr < Image->DataAddr )
+			shndx = 1;
+		else if( sym->Addr < Image->DataAddr + Image->DataSize )
+			shndx = 2;
+		else
+			shndx = 3;
+		if( state.b64 ) {
+			Output_AppendAbs32(&symtab, name);
+			Output_AppendCode(&symtab, info);
+			Output_AppendCode(&symtab, 0);
+			Output_AppendAbs16(&symtab, shndx);
+			Output_AppendAbs64(&symtab, sym->Addr);
+			Output_AppendAbs64(&symtab, 0);
+		}
+		else {
+			Output_AppendAbs32(&symtab, name);
+			Output_AppendAbs32(&symtab, sym->Addr);
+			Output_AppendAbs32(&symtab, 0);
+			Output_AppendCode(&symtab, info);
+			Output_AppendCode(&symtab, 0);
+			Output_AppendAbs16(&symtab, shndx);
+		}
+	}
+	 int	text_name = Elf_int_AddString(&state.ShStrTab, ".text");
+	 int	data_name = Elf_int_AddString(&state.ShStrTab, ".data");
+	 int	bss_name = Elf_int_AddString(&state.ShStrTab, ".bss");
+	 int	symtab_name = Elf_int_AddString(&state.ShStrTab, ".symtab");
+	 int	strtab_name = Elf_int_AddString(&state.ShStrTab, ".strtab");
+	 int	shstrtab_name = Elf_int_AddString(&state.ShStrTab, ".shstrtab");
+
+	Elf_int_Align(file, state.b64 ? 8 : 4);
+	uint64_t	symtab_ofs = file->CodeLength;
+	Output_AppendData(file, symtab.Code, symtab.CodeLength);
+	uint64_t	strtab_ofs = file->CodeLength;
+	Output_AppendData(file, state.StrTab.Code, state.StrTab.CodeLength);
+	uint64_t	shstrtab_ofs = file->CodeLength;
+	Output_AppendData(file, state.ShStrTab.Code, state.ShStrTab.CodeLength);
+
+	Elf_int_Align(file, state.b64 ? 8 : 4);
+	uint64_t	shoff = file->CodeLength;
+	Elf_int_SectionHeader(&state, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+	Elf_int_SectionHeader(&state, text_name, SHT_PROGBITS, SHF_ALLOC|SHF_EXECINSTR,
+		Image->TextAddr + Image->TextStart, Image->TextStart,
+		Image->TextSize - Image->TextStart, 0, 0, 16, 0);
+	Elf_int_SectionHeader(&state, data_name, SHT_PROGBITS, SHF_ALLOC|SHF_WRITE, Image->DataAddr, data_ofs,
+		Image->DataSize, 0, 0, 16, 0);
+	Elf_int_SectionHeader(&state, bss_name, SHT_NOBITS, SHF_ALLOC|SHF_WRITE,
+		Image->DataAddr + Image->DataSize, data_ofs + Image->DataSize,
+		Image->BssSize, 0, 0, 16, 0);
+	Elf_int_SectionHeader(&state, symtab_name, SHT_SYMTAB, 0, 0, symtab_ofs, symtab.CodeLength,
+		5, 1, (state.b64 ? 8 : 4), (state.b64 ? 24 : 16));
+	Elf_int_SectionHeader(&state, strtab_name, SHT_STRTAB, 0, 0, strtab_ofs, state.StrTab.CodeLength, 0, 0, 1, 0);
+	Elf_int_SectionHeader(&state, shstrtab_name, SHT_STRTAB, 0, 0, shstrtab_ofs, state.ShStrTab.CodeLength, 0, 0, 1, 0);
+
+	// File and program headers
+	tOutput_Section	hdr = {0};
+	Elf_int_Header(&state, &hdr, 2 /*ET_EXEC*/, Image->Machine, Image->Entry, 2, shoff, 7);
+	Elf_int_ProgramHeader(&state, &hdr, PF_R|PF_X, 0, Image->TextAddr, Image->TextSize, Image->TextSize);
+	Elf_int_ProgramHeader(&state, &hdr, PF_R|PF_W, data_ofs, Image->DataAddr,
+		Image->DataSize, Image->DataSize + Image->BssSize);
+	if( hdr.CodeLength > Image->TextStart ) {
+		fprintf(stderr, "BUG: ELF headers don't fit before the code\n");
+		exit(1);
+	}
+	memcpy(file->Code, hdr.Code, hdr.CodeLength);
+
+	 int	rv = 0;
+	if( fwrite(file->Code, 1, file->CodeLength, OutFile) != file->CodeLength ) {
+		perror("Output_WriteELFExecutable");
+		rv = -1;
+	}
+	free(hdr.Code);
+	free(symtab.Code);
+	free(file->Code);
+	free(state.StrTab.Code);
+	free(state.ShStrTab.Code);
+	return rv;
+}
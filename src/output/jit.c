@@ -0,0 +1,382 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * output/jit.c
+ * - In-process execution of compiled code (--jit, or JIT_CompileSource)
+ *
+ * Maps an assembled object into an anonymous mapping (code first, then
+ * data), resolves undefined symbols against the host process with dlsym and
+ * applies the relocations in place. Calls and jumps to host functions go
+ * through small jump stubs placed after the code, as the host libraries can
+ * be further away than a rel32 reaches. RIP-relative data references can't
+ * be redirected like that, so when there are any the image is mapped within
+ * rel32 range of the host symbols they use. The code pages are made
+ * read+execute once everything is patched.
+ *
+ * Only works when the target machine matches the one the compiler runs on.
+ */
+#define _GNU_SOURCE
+#include <global.h>
+#include <symbol.h>
+#include <output.h>
+#include <jit.h>
+#include <parser.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <sys/mman.h>
+
+// === CONSTANTS ===
+#define JIT_PAGE_SIZE	0x1000
+#define JIT_STUB_SIZE	16
+#define JIT_REL32_RANGE	0x7FFF0000	// (with some room for addends)
+#if defined(__x86_64__)
+# define JIT_HOST_MACHINE	62	// EM_X86_64
+# define JIT_HOST_ARCH	"X86_64"
+#elif defined(__i386__)
+# define JIT_HOST_MACHINE	3	// EM_386
+# define JIT_HOST_ARCH	"X86"
+#else
+# define JIT_HOST_MACHINE	-1
+# define JIT_HOST_ARCH	NULL
+#endif
+
+// === TYPES ===
+typedef struct
+{
+	char	*Name;
+	void	*Addr;
+} tJitSymbol;
+
+struct sJitImage
+{
+	uint8_t	*Base;
+	size_t	Size;
+	 int	nSymbols;
+	tJitSymbol	*Symbols;
+};
+
+// === IMPORTS ===
+extern bool	gbPrintStats;
+extern void	InitialiseData(void);
+extern void	Optimiser_ProcessTree(void);
+extern void	Compile_ProcessFunctions(void);
+extern int	SetOutputArch(const char *Name);
+
+// === PROTOTYPES ===
+tJitImage	*JIT_Load(const tOutput_Object *Object);
+void	*JIT_GetSymbol(tJitImage *Image, const char *Name);
+void	JIT_Free(tJitImage *Image);
+ int	JIT_Run(const tOutput_Object *Object, const char *Entry, int argc, char **argv);
+tJitImage	*JIT_CompileSource(const char *Name, const char *Source, size_t Length);
+void	*JIT_int_Map(size_t Size, bool bNearHost, uint64_t HostLow, uint64_t HostHigh);
+void	JIT_int_WriteStub(const tOutput_Object *Object, uint8_t *Stub, uint64_t Target);
+double	JIT_int_Time(clockid_t Clock);
+
+// === CODE ===
+/**
+ * \brief Map an object into memory and link it against the host process
+ */
+tJitImage *JIT_Load(const tOutput_Object *Object)
+{
+	if( Object->Machine != JIT_HOST_MACHINE || Object->Bits != 8*sizeof(void*) ) {
+		fprintf(stderr, "ERROR: JIT needs code for the host machine (target is ELF machine %i, %i bit)\n",
+			Object->Machine, Object->Bits);
+		return NULL;
+	}
+
+	// Host symbols
+	uint64_t	*addrs = malloc(Object->nSymbols * sizeof(uint64_t) + 1);
+	 int	nErrors = 0;
+	for( int i = 0; i < Object->nSymbols; i ++ )
+	{
+		const tOutput_Symbol	*sym = &Object->Symbols[i];
+		if( sym->Section >= 0 )
+			continue ;
+		void	*host = dlsym(RTLD_DEFAULT, sym->Name);
+		if( !host ) {
+			fprintf(stderr, "ERROR: JIT: Unresolved symbol '%s'\n", sym->Name);
+			nErrors ++;
+		}
+		addrs[i] = (uintptr_t)host;
+	}
+	if( nErrors ) {
+		free(addrs);
+		return NULL;
+	}
+
+	// Branches to host functions get a stub, other relative references need the image nearby
+	 int	*stubs = malloc(Object->nSymbols * sizeof(int) + 1);
+	 int	nStubs = 0;
+	bool	near_host = false;
+	uint64_t	host_low = UINT64_MAX, host_high = 0;
+	for( int i = 0; i < Object->nSymbols; i ++ )
+		stubs[i] = -1;
+	for( int i = 0; i < Object->nSections; i ++ )
+	{
+		const tOutput_Section	*sect = &Object->Sections[i];
+		for( int r = 0; r < sect->nRelocs; r ++ )
+		{
+			const tOutput_Reloc	*rel = &sect->Relocs[r];
+			if( !rel->bRelative || Object->Symbols[rel->Symbol].Section >= 0 )
+				continue ;
+			if( rel->bBranch ) {
+				if( stubs[rel->Symbol] < 0 )
+					stubs[rel->Symbol] = nStubs ++;
+				continue ;
+			}
+			near_host = true;
+			if( addrs[rel->Symbol] < host_low )	host_low = addrs[rel->Symbol];
+			if( addrs[rel->Symbol] > host_high )	host_high = addrs[rel->Symbol];
+		}
+	}
+
+	// Layout: executable sections, stubs, then (on a new page) the rest
+	uint64_t	sect_ofs[OUTPUT_MAX_SECTIONS];
+	size_t	ofs = 0, stub_ofs, exec_size;
+	for( int pass = 0; pass < 2; pass ++ )
+	{
+		for( int i = 0; i < Object->nSections; i ++ )
+		{
+			const tOutput_Section	*sect = &Object->Sections[i];
+			if( sect->bExecutable != (pass == 0) )
+				continue ;
+			ofs = (ofs + sect->Align - 1) & ~(size_t)(sect->Align - 1);
+			sect_ofs[i] = ofs;
+			ofs += sect->CodeLength;
+		}
+		if( pass == 0 ) {
+			ofs = (ofs + JIT_STUB_SIZE - 1) & ~(size_t)(JIT_STUB_SIZE - 1);
+			stub_ofs = ofs;
+			ofs += nStubs * JIT_STUB_SIZE;
+			ofs = (ofs + JIT_PAGE_SIZE - 1) & ~(size_t)(JIT_PAGE_SIZE - 1);
+			exec_size = ofs;
+		}
+	}
+
+	tJitImage	*image = calloc(1, sizeof(tJitImage));
+	image->Size = (ofs ? ofs : 1);
+	image->Base = JIT_int_Map(image->Size, near_host, host_low, host_high);
+	if( image->Base == MAP_FAILED ) {
+		perror("JIT_Load - mmap");
+		free(addrs);
+		free(stubs);
+		free(image);
+		return NULL;
+	}
+
+	// Symbol addresses
+	for( int i = 0; i < Object->nSymbols; i ++ )
+	{
+		const tOutput_Symbol	*sym = &Object->Symbols[i];
+		if( sym->Section >= 0 ) {
+			addrs[i] = (uintptr_t)image->Base + sect_ofs[sym->Section] + sym->Value;
+			if( sym->bGlobal && !sym->bSection ) {
+				image->Symbols = realloc(image->Symbols, (image->nSymbols+1) * sizeof(tJitSymbol));
+				image->Symbols[image->nSymbols].Name = strdup(sym->Name);
+				image->Symbols[image->nSymbols].Addr = (void*)(uintptr_t)addrs[i];
+				image->nSymbols ++;
+			}
+			continue ;
+		}
+		if( stubs[i] >= 0 ) {
+			uint8_t	*stub = image->Base + stub_ofs + stubs[i]*JIT_STUB_SIZE;
+			JIT_int_WriteStub(Object, stub, addrs[i]);
+			addrs[i] = (uintptr_t)stub;
+		}
+	}
+
+	// Contents and relocations
+	for( int i = 0; i < Object->nSections && !nErrors; i ++ )
+	{
+		const tOutput_Section	*sect = &Object->Sections[i];
+		uint8_t	*dest = image->Base + sect_ofs[i];
+		if( sect->bNoBits )
+			continue ;
+		memcpy(dest, sect->Code, sect->CodeLength);
+		for( int r = 0; r < sect->nRelocs; r ++ )
+		{
+			const tOutput_Reloc	*rel = &sect->Relocs[r];
+			int64_t	value = addrs[rel->Symbol] + rel->Addend;
+			if( rel->bRelative )
+				value -= (uintptr_t)dest + rel->Offset;
+			if( rel->Size < 64 )
+			{
+				int64_t	max = (rel->bRelative ? 1LL << (rel->Size-1) : 1LL << rel->Size);
+				if( value >= max || value < -(1LL << (rel->Size-1)) ) {
+					fprintf(stderr, "ERROR: JIT: Reference to '%s' is out of range\n",
+						Object->Symbols[rel->Symbol].Name);
+					nErrors ++;
+					break;
+				}
+			}
+			for( int b = 0; b < rel->Size/8; b ++ )
+				dest[rel->Offset + b] = ((uint64_t)value >> (b*8)) & 0xFF;
+		}
+	}
+	free(addrs);
+	free(stubs);
+
+	if( !nErrors && exec_size && mprotect(image->Base, exec_size, PROT_READ|PROT_EXEC) ) {
+		perror("JIT_Load - mprotect");
+		nErrors ++;
+	}
+	if( nErrors ) {
+		JIT_Free(image);
+		return NULL;
+	}
+	return image;
+}
+
+void *JIT_GetSymbol(tJitImage *Image, const char *Name)
+{
+	for( int i = 0; i < Image->nSymbols; i ++ )
+	{
+		if( strcmp(Image->Symbols[i].Name, Name) == 0 )
+			return Image->Symbols[i].Addr;
+	}
+	return NULL;
+}
+
+void JIT_Free(tJitImage *Image)
+{
+	munmap(Image->Base, Image->Size);
+	for( int i = 0; i < Image->nSymbols; i ++ )
+		free(Image->Symbols[i].Name);
+	free(Image->Symbols);
+	free(Image);
+}
+
+/**
+ * \brief Load an object and call its entrypoint
+ * \return Entrypoint's return value (-1 if it couldn't be called)
+ */
+int JIT_Run(const tOutput_Object *Object, const char *Entry, int argc, char **argv)
+{
+	double	load_start = JIT_int_Time(CLOCK_MONOTONIC);
+	tJitImage	*image = JIT_Load(Object);
+	if( !image )
+		return -1;
+	 int	(*entry)(int, char**) = JIT_GetSymbol(image, Entry);
+	if( !entry ) {
+		fprintf(stderr, "ERROR: JIT: Entrypoint '%s' isn't defined\n", Entry);
+		JIT_Free(image);
+		return -1;
+	}
+	if( gbPrintStats ) {
+		// (process CPU time covers everything from startup to here)
+		fprintf(stderr, "JIT: load %.3f ms, compile-to-call %.3f ms\n",
+			(JIT_int_Time(CLOCK_MONOTONIC) - load_start) * 1000,
+			JIT_int_Time(CLOCK_PROCESS_CPUTIME_ID) * 1000);
+	}
+	fflush(stdout);
+	 int	ret = entry(argc, argv);
+	fflush(stdout);
+	JIT_Free(image);
+	return ret;
+}
+
+/**
+ * \brief Compile C source for the host machine and load it
+ * \param Name	Filename used in diagnostics
+ * \return Loaded image (look functions up with JIT_GetSymbol), NULL if it couldn't be assembled or linked
+ *
+ * Runs the same passes as the command line with -O1. They build the
+ * process-wide symbol tables, so as with the command line there is one
+ * translation unit per process.
+ */
+tJitImage *JIT_CompileSource(const char *Name, const char *Source, size_t Length)
+{
+	if( !JIT_HOST_ARCH || SetOutputArch(JIT_HOST_ARCH) < 0 ) {
+		fprintf(stderr, "ERROR: JIT: No code generator for the host machine\n");
+		return NULL;
+	}
+	FILE	*fp = fmemopen((void*)Source, Length, "r");
+	if( !fp ) {
+		perror("JIT_CompileSource()");
+		return NULL;
+	}
+	InitialiseData();
+	tParser	parser = {
+		.FP = fp,
+		.Cur = {.Filename = CreateRef(Name, strlen(Name)), .Line = 1}
+	};
+	Parse_CodeRoot(&parser);
+	fclose(fp);
+	Optimiser_ProcessTree();
+	Compile_ProcessFunctions();
+
+	tOutput_Object	obj = {0};
+	if( Output_GenerateObject(&obj) ) {
+		Output_FreeObject(&obj);
+		return NULL;
+	}
+	tJitImage	*image = JIT_Load(&obj);
+	Output_FreeObject(&obj);
+	return image;
+}
+
+/**
+ * \brief Allocate the (writable) mapping for an image
+ * \param bNearHost	Image has RIP-relative references to host data in [HostLow, HostHigh]
+ *
+ * Otherwise the image goes in the low 2GB (where available) so 32-bit
+ * absolute references to it fit. If no nearby mapping can be found, the
+ * relocation range check reports the references that can't be reached.
+ */
+void *JIT_int_Map(size_t Size, bool bNearHost, uint64_t HostLow, uint64_t HostHigh)
+{
+	 int	flags = MAP_PRIVATE|MAP_ANONYMOUS;
+	if( !bNearHost )
+	{
+		#ifdef MAP_32BIT
+		flags |= MAP_32BIT;	// Keeps 32-bit absolute references to the image in range
+		#endif
+		return mmap(NULL, Size, PROT_READ|PROT_WRITE, flags, -1, 0);
+	}
+
+	// Try below the lowest symbol, moving down until the range would be exceeded
+	uint64_t	hint = (HostLow - Size) & ~(uint64_t)(JIT_PAGE_SIZE - 1);
+	for( int try = 0; try < 64 && HostLow > Size && HostHigh - hint < JIT_REL32_RANGE; try ++ )
+	{
+		void	*ret = mmap((void*)(uintptr_t)hint, Size, PROT_READ|PROT_WRITE, flags, -1, 0);
+		if( ret == MAP_FAILED )
+			return ret;
+		uint64_t	base = (uintptr_t)ret;
+		if( base + Size <= HostLow && HostHigh - base < JIT_REL32_RANGE )
+			return ret;
+		munmap(ret, Size);
+		hint -= 0x1000000;
+	}
+	return mmap(NULL, Size, PROT_READ|PROT_WRITE, flags, -1, 0);
+}
+
+/**
+ * \brief Write an absolute jump to a host function
+ */
+void JIT_int_WriteStub(const tOutput_Object *Object, uint8_t *Stub, uint64_t Target)
+{
+	// jmp [addr] with the target stored straight after the instruction
+	Stub[0] = 0xFF;
+	Stub[1] = 0x25;
+	if( Object->Bits == 64 ) {
+		memset(Stub + 2, 0, 4);	// (RIP relative, +0)
+		memcpy(Stub + 6, &Target, 8);
+	}
+	else {
+		uint32_t	ptr = (uintptr_t)(Stub + 6);
+		uint32_t	target = Target;
+		memcpy(Stub + 2, &ptr, 4);
+		memcpy(Stub + 6, &target, 4);
+	}
+}
+
+double JIT_int_Time(clockid_t Clock)
+{
+	struct timespec	ts;
+	clock_gettime(Clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -0,0 +1,586 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * See COPYING for licence
+ *
+ * output/link.c
+ * - Static linker (--link)
+ *
+ * Links the compiled object with extra ELF relocatable objects and ar
+ * archives into a static executable. Plain objects are always loaded,
+ * archive members only when they define a symbol that is still undefined
+ * (repeated until nothing changes, so member order doesn't matter). Strong
+ * definitions override weak ones, common symbols are merged and placed at
+ * the end of .bss, and duplicate COMDAT groups are discarded.
+ *
+ * Sections are merged by kind into two segments: code and constants
+ * (following the file headers), then data and bss on the next page.
+ */
+#include <global.h>
+#include <symbol.h>
+#include <output.h>
+#include <link.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// === CONSTANTS ===
+#define LINK_HASH_SIZE	1024
+#define LINK_PAGE_SIZE	0x1000
+#define LINK_BASE_32	0x08048000
+#define LINK_BASE_64	0x400000
+
+// === TYPES ===
+typedef struct sLinkGlobal
+{
+	struct sLinkGlobal	*Next;	//!< Hash chain
+	struct sLinkGlobal	*ListNext;	//!< In definition order
+	const char	*Name;
+	tLinkObject	*Object;	//!< Defining object (NULL if undefined)
+	 int	Symbol;
+	bool	bWeak;	//!< Definition is weak
+	bool	bStrongRef;	//!< Referenced by a non-weak undefined symbol
+	uint64_t	CommonSize;	//!< Non-zero for common symbols (merged)
+	uint64_t	CommonAlign;
+	uint64_t	Addr;
+} tLinkGlobal;
+
+typedef struct
+{
+	 int	Bits;
+	 int	Machine;
+	tLinkObject	*Objects;
+	tLinkObject	**LastObject;
+	tLinkGlobal	*Hash[LINK_HASH_SIZE];
+	tLinkGlobal	*Globals;
+	tLinkGlobal	**LastGlobal;
+	char	**Groups;	//!< COMDAT signatures already loaded
+	 int	nGroups;
+	 int	nBuffers;
+	uint8_t	**Buffers;	//!< Input file contents (sections point into these)
+	tOutput_Object	StartObject;
+} tLinkState;
+
+// === IMPORTS ===
+extern const tOutputFormat	*gpOutputFormat;
+extern const char	*gsInputFile;
+
+// === PROTOTYPES ===
+ int	Link_WriteExecutable(const tOutput_Object *Object, const char * const *Inputs, int nInputs, const char *File);
+tLinkObject	*Link_int_FromOutput(const tOutput_Object *Object, const char *Name);
+void	Link_int_AddInput(tLinkState *State, const char *Path);
+void	Link_int_ReadArchive(tLinkState *State, const uint8_t *Data, size_t Size, const char *Path);
+void	Link_int_AppendObject(tLinkState *State, tLinkObject *Obj);
+tLinkGlobal	*Link_int_Global(tLinkState *State, const char *Name);
+void	Link_int_Load(tLinkState *State, tLinkObject *Obj);
+bool	Link_int_WantMember(tLinkState *State, tLinkObject *Obj);
+uint64_t	Link_int_SymbolAddr(tLinkState *State, tLinkObject *Obj, int Sym);
+void	Link_int_Relocate(tLinkState *State, tLinkObject *Obj, tLinkSection *Sect, uint8_t *Dest);
+void	Link_int_FreeObject(tLinkObject *Obj);
+
+// === CODE ===
+/**
+ * \brief Link an assembled object with extra inputs and write an executable
+ */
+int Link_WriteExecutable(const tOutput_Object *Object, const char * const *Inputs, int nInputs, const char *File)
+{
+	tLinkState	state = {.Bits = Object->Bits, .Machine = Object->Machine};
+	state.LastObject = &state.Objects;
+	state.LastGlobal = &state.Globals;
+
+	// Plain objects are loaded in command line order, then the entrypoint
+	tLinkObject	*main_obj = Link_int_FromOutput(Object, gsInputFile ? gsInputFile : "<input>");
+	Link_int_AppendObject(&state, main_obj);
+	Link_int_Load(&state, main_obj);
+	for( int i = 0; i < nInputs; i ++ )
+		Link_int_AddInput(&state, Inputs[i]);
+	tLinkGlobal	*start = Link_int_Global(&state, "_start");
+	if( !start->Object )
+	{
+		if( !gpOutputFormat->StartCode ) {
+			fprintf(stderr, "ERROR: '%s' has no built-in entrypoint, supply a _start\n", gpOutputFormat->Name);
+			return 1;
+		}
+		const char	*code = gpOutputFormat->StartCode;
+		if( gpOutputFormat->Assemble(code, strlen(code), &state.StartObject) )
+			return 1;
+		tLinkObject	*obj = Link_int_FromOutput(&state.StartObject, "<_start>");
+		Link_int_AppendObject(&state, obj);
+		Link_int_Load(&state, obj);
+	}
+
+	// Pull in archive members until nothing more is resolved
+	bool	changed;
+	do {
+		changed = false;
+		for( tLinkObject *obj = state.Objects; obj; obj = obj->Next )
+		{
+			if( !obj->bLoaded && Link_int_WantMember(&state, obj) ) {
+				Link_int_Load(&state, obj);
+				changed = true;
+			}
+		}
+	} while( changed );
+
+	 int	nUndef = 0;
+	for( tLinkGlobal *g = state.Globals; g; g = g->ListNext )
+	{
+		if( g->Object || !g->bStrongRef )
+			continue ;
+		fprintf(stderr, "ERROR: Undefined reference to '%s'\n", g->Name);
+		nUndef ++;
+	}
+	if( nUndef )
+		return 1;
+
+	// Layout: headers, text, rodata | data, bss, commons
+	tLinkImage	image = {.Bits = state.Bits, .Machine = state.Machine};
+	image.TextAddr = (state.Bits == 64 ? LINK_BASE_64 : LINK_BASE_32);
+	image.TextStart = Output_ELFExecHeaderSize(state.Bits);
+	uint64_t	addr = image.TextAddr + image.TextStart;
+	for( int kind = 0; kind < NUM_LINK_KINDS; kind ++ )
+	{
+		if( kind == LINK_DATA ) {
+			image.TextSize = addr - image.TextAddr;
+			image.DataAddr = image.TextAddr + ((image.TextSize + LINK_PAGE_SIZE-1) & ~(uint64_t)(LINK_PAGE_SIZE-1));
+			addr = image.DataAddr;
+		}
+		if( kind == LINK_BSS )
+			image.DataSize = addr - image.DataAddr;
+		for( tLinkObject *obj = state.Objects; obj; obj = obj->Next )
+		{
+			if( !obj->bLoaded )
+				continue ;
+			for( int i = 0; i < obj->nSections; i ++ )
+			{
+				tLinkSection	*sect = &obj->Sections[i];
+				if( sect->Kind != kind || sect->bDiscarded )
+					continue ;
+				if( sect->Align > 1 )
+					addr = (addr + sect->Align - 1) & ~(sect->Align - 1);
+				sect->Addr = addr;
+				addr += sect->Size;
+			}
+		}
+	}
+	for( tLinkGlobal *g = state.Globals; g; g = g->ListNext )
+	{
+		if( !g->Object || !g->CommonSize )
+			continue ;
+		addr = (addr + g->CommonAlign - 1) & ~(g->CommonAlign - 1);
+		g->Addr = addr;
+		addr += g->CommonSize;
+	}
+	image.BssSize = addr - image.DataAddr - image.DataSize;
+
+	// Copy and relocate the section contents
+	image.Text = calloc(1, image.TextSize);
+	image.Data = calloc(1, image.DataSize ? image.DataSize : 1);
+	for( tLinkObject *obj = state.Objects; obj; obj = obj->Next )
+	{
+		if( !obj->bLoaded )
+			continue ;
+		for( int i = 0; i < obj->nSections; i ++ )
+		{
+			tLinkSection	*sect = &obj->Sections[i];
+			if( sect->Kind == LINK_NONE || sect->Kind == LINK_BSS || sect->bDiscarded || !sect->Size )
+				continue ;
+			uint8_t	*dest;
+			if( sect->Kind == LINK_DATA )
+				dest = image.Data + (sect->Addr - image.DataAddr);
+			else
+				dest = image.Text + (sect->Addr - image.TextAddr);
+			memcpy(dest, sect->Data, sect->Size);
+			Link_int_Relocate(&state, obj, sect, dest);
+		}
+	}
+
+	// Symbols for the output (debugging aid only)
+	for( tLinkGlobal *g = state.Globals; g; g = g->ListNext )
+	{
+		if( !g->Object )
+			continue ;
+		tLinkSymbol	*sym = &g->Object->Symbols[g->Symbol];
+		if( sym->Section == LINK_ABS )
+			continue ;
+		image.Symbols = realloc(image.Symbols, (image.nSymbols+1) * sizeof(tLinkImageSymbol));
+		image.Symbols[image.nSymbols].Name = g->Name;
+		image.Symbols[image.nSymbols].Addr = Link_int_SymbolAddr(&state, g->Object, g->Symbol);
+		image.Symbols[image.nSymbols].bFunc = sym->bFunc;
+		image.nSymbols ++;
+	}
+	image.Entry = Link_int_SymbolAddr(&state, start->Object, start->Symbol);
+
+	 int	rv = 0;
+	FILE	*fp = fopen(File, "wb");
+	if( !fp ) {
+		fprintf(stderr, "ERROR: Unable to open '%s' for writing\n", File);
+		perror("Link_WriteExecutable()");
+		rv = 1;
+	}
+	else {
+		if( Output_WriteELFExecutable(fp, &image) )
+			rv = 1;
+		fclose(fp);
+		chmod(File, 0755);
+	}
+
+	// Cleanup
+	free(image.Text);
+	free(image.Data);
+	free(image.Symbols);
+	while( state.Objects ) {
+		tLinkObject	*next = state.Objects->Next;
+		Link_int_FreeObject(state.Objects);
+		state.Objects = next;
+	}
+	while( state.Globals ) {
+		tLinkGlobal	*next = state.Globals->ListNext;
+		free(state.Globals);
+		state.Globals = next;
+	}
+	for( int i = 0; i < state.nGroups; i ++ )
+		free(state.Groups[i]);
+	free(state.Groups);
+	for( int i = 0; i < state.nBuffers; i ++ )
+		free(state.Buffers[i]);
+	free(state.Buffers);
+	if( state.StartObject.nSections )
+		Output_FreeObject(&state.StartObject);
+	return rv;
+}
+
+/**
+ * \brief Wrap an in-memory object (section N becomes link section N+1, as in ELF)
+ */
+tLinkObject *Link_int_FromOutput(const tOutput_Object *Object, const char *Name)
+{
+	tLinkObject	*obj = calloc(1, sizeof(tLinkObject));
+	obj->Name = strdup(Name);
+	obj->nSections = Object->nSections + 1;
+	obj->Sections = calloc(obj->nSections, sizeof(tLinkSection));
+	obj->Sections[0].Kind = LINK_NONE;
+	for( int i = 0; i < Object->nSections; i ++ )
+	{
+		const tOutput_Section	*src = &Object->Sections[i];
+		tLinkSection	*sect = &obj->Sections[1 + i];
+		sect->Name = strdup(src->Name);
+		if( src->bNoBits )
+			sect->Kind = LINK_BSS;
+		else if( src->bExecutable )
+			sect->Kind = LINK_TEXT;
+		else if( src->bWritable )
+			sect->Kind = LINK_DATA;
+		else
+			sect->Kind = LINK_RODATA;
+		sect->Data = (src->bNoBits ? NULL : src->Code);
+		sect->Size = src->CodeLength;
+		sect->Align = src->Align;
+		sect->nRelocs = src->nRelocs;
+		sect->Relocs = malloc(src->nRelocs * sizeof(tOutput_Reloc) + 1);
+		if( src->nRelocs )
+			memcpy(sect->Relocs, src->Relocs, src->nRelocs * sizeof(tOutput_Reloc));
+	}
+	// Symbol indices are kept, so the relocations can be used as-is
+	obj->nSymbols = Object->nSymbols;
+	obj->Symbols = calloc(obj->nSymbols + 1, sizeof(tLinkSymbol));
+	for( int i = 0; i < Object->nSymbols; i ++ )
+	{
+		const tOutput_Symbol	*src = &Object->Symbols[i];
+		tLinkSymbol	*sym = &obj->Symbols[i];
+		sym->Name = strdup(src->Name ? src->Name : "");
+		sym->Section = (src->Section < 0 ? LINK_UNDEF : 1 + src->Section);
+		sym->Value = src->Value;
+		sym->bGlobal = src->bGlobal || src->Section < 0;
+		sym->bFunc = (src->Section >= 0 && Object->Sections[src->Section].bExecutable);
+	}
+	return obj;
+}
+
+/**
+ * \brief Read an object or archive named on the command line
+ */
+void Link_int_AddInput(tLinkState *State, const char *Path)
+{
+	FILE	*fp = fopen(Path, "rb");
+	if( !fp ) {
+		fprintf(stderr, "ERROR: Unable to open '%s'\n", Path);
+		exit(1);
+	}
+	fseek(fp, 0, SEEK_END);
+	long	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	uint8_t	*data = malloc(size + 1);
+	if( size < 0 || fread(data, 1, size, fp) != (size_t)size ) {
+		fprintf(stderr, "ERROR: Unable to read '%s'\n", Path);
+		exit(1);
+	}
+	fclose(fp);
+	State->Buffers = realloc(State->Buffers, (State->nBuffers+1) * sizeof(uint8_t*));
+	State->Buffers[State->nBuffers++] = data;
+
+	if( size >= 8 && memcmp(data, "!<arch>\n", 8) == 0 ) {
+		Link_int_ReadArchive(State, data, size, Path);
+	}
+	else {
+		tLinkObject	*obj = Output_ReadELF(data, size, Path, State->Bits, State->Machine);
+		Link_int_AppendObject(State, obj);
+		Link_int_Load(State, obj);
+	}
+}
+
+/**
+ * \brief Add the members of an ar archive (loaded later, when needed)
+ */
+void Link_int_ReadArchive(tLinkState *State, const uint8_t *Data, size_t Size, const char *Path)
+{
+	const char	*longnames = NULL;
+	size_t	longnames_size = 0;
+	size_t	ofs = 8;
+	while( ofs + 60 <= Size )
+	{
+		const char	*hdr = (const char*)Data + ofs;
+		size_t	size = strtoul(hdr + 48, NULL, 10);
+		const uint8_t	*member = Data + ofs + 60;
+		if( ofs + 60 + size > Size || memcmp(hdr + 58, "`\n", 2) != 0 ) {
+			fprintf(stderr, "ERROR: %s: Corrupt archive\n", Path);
+			exit(1);
+		}
+		ofs += 60 + size + (size & 1);
+
+		char	name[256];
+		 int	len = 0;
+		if( memcmp(hdr, "// ", 3) == 0 ) {
+			longnames = (const char*)member;
+			longnames_size = size;
+			continue ;
+		}
+		if( hdr[0] == '/' && (hdr[1] == ' ' || memcmp(hdr, "/SYM64/", 7) == 0) )
+			continue ;	// Symbol index (not needed, every member is scanned)
+		if( hdr[0] == '/' && longnames ) {
+			size_t	n = strtoul(hdr + 1, NULL, 10);
+			while( n + len < longnames_size && longnames[n+len] != '/' && longnames[n+len] != '\n'
+				&& len < (int)sizeof(name) - 1 )
+			{
+				name[len] = longnames[n+len];
+				len ++;
+			}
+		}
+		else {
+			while( len < 16 && hdr[len] != '/' && hdr[len] != ' ' ) {
+				name[len] = hdr[len];
+				len ++;
+			}
+		}
+		name[len] = '\0';
+
+		char	*fullname = malloc(strlen(Path) + len + 3);
+		sprintf(fullname, "%s(%s)", Path, name);
+		tLinkObject	*obj = Output_ReadELF(member, size, fullname, State->Bits, State->Machine);
+		free(fullname);
+		Link_int_AppendObject(State, obj);
+	}
+}
+
+void Link_int_AppendObject(tLinkState *State, tLinkObject *Obj)
+{
+	*State->LastObject = Obj;
+	State->LastObject = &Obj->Next;
+}
+
+/**
+ * \brief Look up (or create) a global symbol table entry
+ */
+tLinkGlobal *Link_int_Global(tLinkState *State, const char *Name)
+{
+	unsigned int	hash = 0;
+	for( const char *p = Name; *p; p ++ )
+		hash = hash * 31 + (unsigned char)*p;
+	hash %= LINK_HASH_SIZE;
+	for( tLinkGlobal *g = State->Hash[hash]; g; g = g->Next )
+	{
+		if( strcmp(g->Name, Name) == 0 )
+			return g;
+	}
+	tLinkGlobal	*g = calloc(1, sizeof(tLinkGlobal));
+	g->Name = Name;
+	g->Next = State->Hash[hash];
+	State->Hash[hash] = g;
+	*State->LastGlobal = g;
+	State->LastGlobal = &g->ListNext;
+	return g;
+}
+
+/**
+ * \brief Add an object to the link and enter its symbols
+ */
+void Link_int_Load(tLinkState *State, tLinkObject *Obj)
+{
+	Obj->bLoaded = true;
+
+	// Drop COMDAT groups that have already been seen
+	for( int i = 0; i < Obj->nGroups; i ++ )
+	{
+		tLinkGroup	*grp = &Obj->Groups[i];
+		bool	seen = false;
+		for( int j = 0; j < State->nGroups && !seen; j ++ )
+			seen = (strcmp(State->Groups[j], grp->Signature) == 0);
+		if( !seen ) {
+			State->Groups = realloc(State->Groups, (State->nGroups+1) * sizeof(char*));
+			State->Groups[State->nGroups++] = strdup(grp->Signature);
+			continue ;
+		}
+		for( int j = 0; j < grp->nMembers; j ++ )
+		{
+			if( grp->Members[j] > 0 && grp->Members[j] < Obj->nSections )
+				Obj->Sections[grp->Members[j]].bDiscarded = true;
+		}
+	}
+
+	for( int i = 0; i < Obj->nSymbols; i ++ )
+	{
+		tLinkSymbol	*sym = &Obj->Symbols[i];
+		if( !sym->bGlobal || !sym->Name[0] )
+			continue ;
+		tLinkGlobal	*g = Link_int_Global(State, sym->Name);
+		if( sym->Section == LINK_UNDEF ) {
+			if( !sym->bWeak )
+				g->bStrongRef = true;
+			continue ;
+		}
+		if( sym->Section > 0 && (Obj->Sections[sym->Section].bDiscarded
+				|| Obj->Sections[sym->Section].Kind == LINK_NONE) )
+			continue ;
+
+		if( sym->Section == LINK_COMMON )
+		{
+			// Commons merge with each other and yield to real definitions
+			if( g->Object && !g->CommonSize )
+				continue ;
+			if( !g->Object ) {
+				g->Object = Obj;
+				g->Symbol = i;
+			}
+			if( sym->Size > g->CommonSize )
+				g->CommonSize = sym->Size;
+			if( sym->Value > g->CommonAlign || !g->CommonAlign )
+				g->CommonAlign = (sym->Value ? sym->Value : 1);
+			continue ;
+		}
+		if( g->Object && !g->CommonSize )
+		{
+			if( sym->bWeak )
+				continue ;
+			if( !g->bWeak ) {
+				fprintf(stderr, "ERROR: Multiple definitions of '%s' (%s and %s)\n",
+					g->Name, g->Object->Name, Obj->Name);
+				exit(1);
+			}
+		}
+		g->Object = Obj;
+		g->Symbol = i;
+		g->bWeak = sym->bWeak;
+		g->CommonSize = 0;
+	}
+}
+
+/**
+ * \brief Check if an archive member defines a symbol that is still needed
+ */
+bool Link_int_WantMember(tLinkState *State, tLinkObject *Obj)
+{
+	for( int i = 0; i < Obj->nSymbols; i ++ )
+	{
+		tLinkSymbol	*sym = &Obj->Symbols[i];
+		if( !sym->bGlobal || sym->Section == LINK_UNDEF || sym->Section == LINK_COMMON )
+			continue ;
+		tLinkGlobal	*g = Link_int_Global(State, sym->Name);
+		if( !g->Object && g->bStrongRef )
+			return true;
+	}
+	return false;
+}
+
+/**
+ * \brief Final address of a symbol referenced from an object
+ */
+uint64_t Link_int_SymbolAddr(tLinkState *State, tLinkObject *Obj, int Sym)
+{
+	tLinkSymbol	*sym = &Obj->Symbols[Sym];
+	if( sym->bGlobal && sym->Name[0] )
+	{
+		tLinkGlobal	*g = Link_int_Global(State, sym->Name);
+		if( !g->Object )
+			return 0;	// Undefined weak reference
+		if( g->CommonSize )
+			return g->Addr;
+		Obj = g->Object;
+		sym = &Obj->Symbols[g->Symbol];
+	}
+	switch( sym->Section )
+	{
+	case LINK_ABS:
+		return sym->Value;
+	case LINK_UNDEF:
+	case LINK_COMMON:
+		break;
+	default:
+		if( Obj->Sections[sym->Section].bDiscarded )
+			break;
+		return Obj->Sections[sym->Section].Addr + sym->Value;
+	}
+	fprintf(stderr, "ERROR: %s: Reference to '%s' which isn't in the output\n", Obj->Name, sym->Name);
+	exit(1);
+}
+
+/**
+ * \brief Apply a section's relocations to its copy in the image
+ */
+void Link_int_Relocate(tLinkState *State, tLinkObject *Obj, tLinkSection *Sect, uint8_t *Dest)
+{
+	for( int i = 0; i < Sect->nRelocs; i ++ )
+	{
+		const tOutput_Reloc	*rel = &Sect->Relocs[i];
+		 int	bytes = rel->Size / 8;
+		if( rel->Offset + bytes > Sect->Size ) {
+			fprintf(stderr, "ERROR: %s: Relocation outside of '%s'\n", Obj->Name, Sect->Name);
+			exit(1);
+		}
+		int64_t	value = Link_int_SymbolAddr(State, Obj, rel->Symbol) + rel->Addend;
+		if( rel->bRelative )
+			value -= Sect->Addr + rel->Offset;
+		if( rel->Size < 64 )
+		{
+			// Absolute fields may be zero or sign extended, relative ones are signed
+			int64_t	max = (rel->bRelative ? 1LL << (rel->Size-1) : 1LL << rel->Size);
+			if( value >= max || value < -(1LL << (rel->Size-1)) ) {
+				fprintf(stderr, "ERROR: %s: Relocation against '%s' in '%s' overflows %i bits\n",
+					Obj->Name, Obj->Symbols[rel->Symbol].Name, Sect->Name, rel->Size);
+				exit(1);
+			}
+		}
+		for( int b = 0; b < bytes; b ++ )
+			Dest[rel->Offset + b] = ((uint64_t)value >> (b*8)) & 0xFF;
+	}
+}
+
+void Link_int_FreeObject(tLinkObject *Obj)
+{
+	for( int i = 0; i < Obj->nSections; i ++ )
+	{
+		free(Obj->Sections[i].Name);
+		free(Obj->Sections[i].Relocs);
+	}
+	for( int i = 0; i < Obj->nSymbols; i ++ )
+		free(Obj->Symbols[i].Name);
+	for( int i = 0; i < Obj->nGroups; i ++ )
+	{
+		free(Obj->Groups[i].Signature);
+		free(Obj->Groups[i].Members);
+	}
+	free(Obj->Sections);
+	free(Obj->Symbols);
+	free(Obj->Groups);
+	free(Obj->Name);
+	free(Obj);
+}
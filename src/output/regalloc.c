@@ -0,0 +1,1235 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * This code is published under the terms of the BSD Licence. For more
+ * information see the file COPYING.
+ *
+ * output/regalloc.c - Linear scan register allocation
+ *
+ * Allocates physical registers to IRM registers (after IRM_LeaveSSA) using
+ * live intervals with lifetime holes, in the style of Wimmer's linear scan.
+ * Intervals are split when a register is only free for part of their
+ * lifetime; split pieces may live in a spill slot and are reloaded before
+ * uses that want a register. Moves needed at split points and along CFG
+ * edges are recorded for the target to emit.
+ *
+ * Liveness is computed per register by walking backwards from uses, so
+ * the cost is proportional to the total size of the live ranges rather
+ * than registers*blocks.
+ *
+ * Operations marked IRMFLAG_FOLDED by instruction selection are computed
+ * inside their users, so they get no register; the registers they read are
+ * treated as operands of the instruction that absorbed them.
+ */
+#include <global.h>
+#include <regalloc.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#define POS_MAX	INT_MAX
+
+typedef struct sRARange
+{
+	 int	From, To;	//!< [From, To)
+} tRARange;
+
+typedef struct sRAUse
+{
+	 int	Pos;
+	bool	bNeedsReg;
+} tRAUse;
+
+struct sRAInterval
+{
+	tRAInterval	*NextSplit;	//!< Next piece of the same IRM register
+	tIRMReg	VReg;	//!< IRM register (IRM_REG_VOID for fixed intervals)
+	 int	Reg;	//!< Assigned register, -1 if in memory
+	 int	Hint;	//!< Preferred register (-1 for none)
+	tIRMReg	HintVReg;	//!< Prefer the register holding this value at HintPos
+	 int	HintPos;
+
+	 int	nRanges;
+	 int	RangeSpace;
+	tRARange	*Ranges;
+	 int	CurRange;	//!< Scan cursor, ranges before this end before the current position
+
+	 int	nUses;
+	 int	UseSpace;
+	tRAUse	*Uses;
+};
+
+//! \brief Register read by an instruction (possibly through folded operations)
+typedef struct sRAOperand
+{
+	tIRMReg	Reg;
+	 int	Use;	//!< Top level use index
+	bool	bFolded;	//!< Read by a folded operation (e.g. an address component)
+} tRAOperand;
+
+typedef struct sRAState
+{
+	tRegAllocation	*RA;
+	tIRMHandle	Handle;
+	const tRegAllocTarget	*Target;
+
+	 int	*BlockFrom;	//!< [nBlocks]
+	 int	*BlockTo;	//!< [nBlocks]
+	 int	*nLiveIn;	//!< [nBlocks]
+	 int	*LiveInSpace;	//!< [nBlocks]
+	tIRMReg	**LiveIn;	//!< [nBlocks][nLiveIn]
+	tIRMReg	*VisitIn;	//!< [nBlocks] Last register found live-in (marks never need clearing)
+	tIRMReg	*VisitOut;	//!< [nBlocks] Last register found live-out
+	tIRMBlock	**Stack;	//!< [nBlocks]
+	tIRMOp	**Defs;	//!< [nRegs] A definition of each register (folded values have only one)
+
+	 int	nOperands, OperandSpace;
+	tRAOperand	*Operands;	//!< Registers read by the current operation
+
+	tRAInterval	*Fixed[RA_MAX_REGS];
+
+	 int	nUnhandled, UnhandledSpace;
+	tRAInterval	**Unhandled;	//!< Binary heap ordered by start position
+	 int	nActive, ActiveSpace;
+	tRAInterval	**Active;
+	 int	nInactive, InactiveSpace;
+	tRAInterval	**Inactive;
+} tRAState;
+
+// === PROTOTYPES ===
+tRegAllocation	*RA_Allocate(tIRMHandle Handle, const tRegAllocTarget *Target);
+void	RA_Free(tRegAllocation *RA);
+tRALocation	RA_GetLocation(tRegAllocation *RA, tIRMReg Reg, int Position);
+void	RA_SequentialiseMoves(tRAMoveList *List, void (*Emit)(void *Ptr, const tRAMove *Move, bool Swap), void *Ptr);
+void	RA_int_SplitCriticalEdges(tIRMHandle Handle);
+void	RA_int_Number(tRAState *State);
+void	RA_int_CollectOperands(tRAState *State, const tIRMOp *Op);
+void	RA_int_CollectOperands_r(tRAState *State, const tIRMOp *Op, int TopUse);
+void	RA_int_BuildIntervals(tRAState *State);
+void	RA_int_ComputeLiveness(tRAState *State, tIRMReg VReg, int nUses, tIRMOp **Uses, int nDefs, tIRMOp **Defs);
+void	RA_int_ApplyConstraints(tRAState *State);
+void	RA_int_LinearScan(tRAState *State);
+bool	RA_int_TryAllocateFree(tRAState *State, tRAInterval *Cur);
+void	RA_int_AllocateBlocked(tRAState *State, tRAInterval *Cur);
+void	RA_int_SpillFrom(tRAState *State, tRAInterval *It, int Pos);
+void	RA_int_Resolve(tRAState *State);
+void	RA_int_ComputeBusy(tRAState *State);
+tRAInterval	*RA_int_NewInterval(tIRMReg VReg);
+void	RA_int_FreeInterval(tRAInterval *It);
+void	RA_int_AddRange(tRAInterval *It, int From, int To);
+void	RA_int_NormaliseRanges(tRAInterval *It);
+void	RA_int_AddUse(tRAInterval *It, int Pos, bool bNeedsReg);
+tRAInterval	*RA_int_Split(tRAInterval *It, int Pos);
+ int	RA_int_SplitPosBefore(int Pos);
+static inline int	RA_int_Start(const tRAInterval *It) { return It->Ranges[0].From; }
+static inline int	RA_int_End(const tRAInterval *It) { return It->Ranges[It->nRanges-1].To; }
+bool	RA_int_Covers(tRAInterval *It, int Pos);
+ int	RA_int_NextIntersection(const tRAInterval *A, const tRAInterval *B);
+ int	RA_int_NextUse(const tRAInterval *It, int Pos, bool bRegOnly);
+void	RA_int_PushUnhandled(tRAState *State, tRAInterval *It);
+tRAInterval	*RA_int_PopUnhandled(tRAState *State);
+void	RA_int_ListAppend(tRAInterval ***List, int *Count, int *Space, tRAInterval *It);
+void	RA_int_AddMove(tRAMoveList *List, tRALocation Dst, tRALocation Src);
+bool	RA_int_LocEqual(tRALocation A, tRALocation B);
+tRALocation	RA_int_PieceLocation(tRegAllocation *RA, const tRAInterval *Piece);
+
+// === CODE ===
+/**
+ * \brief Allocate registers for a function
+ *
+ * Critical edges are split so that resolution moves always have a block
+ * to live in, and every operation's Index is set to its linear position.
+ */
+tRegAllocation *RA_Allocate(tIRMHandle Handle, const tRegAllocTarget *Target)
+{
+	assert( !Handle->bIsSSA );
+	assert( Target->nRegs <= RA_MAX_REGS );
+
+	RA_int_SplitCriticalEdges(Handle);
+
+	tRegAllocation	*ra = calloc(1, sizeof(tRegAllocation));
+	ra->Handle = Handle;
+	ra->Target = Target;
+
+	tRAState	state = {
+		.RA = ra,
+		.Handle = Handle,
+		.Target = Target,
+		};
+
+	RA_int_Number(&state);
+
+	ra->Intervals = calloc(Handle->nRegs, sizeof(tRAInterval*));
+	ra->SpillSlots = malloc(Handle->nRegs * sizeof(int));
+	for( int i = 0; i < Handle->nRegs; i ++ )
+		ra->SpillSlots[i] = -1;
+	ra->GapMoves = calloc(ra->nOps, sizeof(tRAMoveList));
+	ra->EntryMoves = calloc(Handle->nBlocks, sizeof(tRAMoveList));
+	ra->ExitMoves = calloc(Handle->nBlocks, sizeof(tRAMoveList));
+	ra->BusyRegs = calloc(ra->nOps, sizeof(uint32_t));
+
+	RA_int_BuildIntervals(&state);
+	RA_int_ApplyConstraints(&state);
+	RA_int_LinearScan(&state);
+	RA_int_Resolve(&state);
+	RA_int_ComputeBusy(&state);
+
+	for( int i = 0; i < Target->nRegs; i ++ )
+	{
+		if( state.Fixed[i] )
+			RA_int_FreeInterval(state.Fixed[i]);
+	}
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+		free(state.LiveIn[i]);
+	free(state.LiveIn);
+	free(state.nLiveIn);
+	free(state.LiveInSpace);
+	free(state.VisitIn);
+	free(state.VisitOut);
+	free(state.Stack);
+	free(state.Defs);
+	free(state.Operands);
+	free(state.BlockFrom);
+	free(state.BlockTo);
+	free(state.Unhandled);
+	free(state.Active);
+	free(state.Inactive);
+
+	return ra;
+}
+
+void RA_Free(tRegAllocation *RA)
+{
+	for( int i = 0; i < RA->Handle->nRegs; i ++ )
+	{
+		tRAInterval	*next;
+		for( tRAInterval *it = RA->Intervals[i]; it; it = next )
+		{
+			next = it->NextSplit;
+			RA_int_FreeInterval(it);
+		}
+	}
+	for( int i = 0; i < RA->nOps; i ++ )
+		free(RA->GapMoves[i].Moves);
+	for( int i = 0; i < RA->Handle->nBlocks; i ++ )
+	{
+		free(RA->EntryMoves[i].Moves);
+		free(RA->ExitMoves[i].Moves);
+	}
+	free(RA->GapMoves);
+	free(RA->EntryMoves);
+	free(RA->ExitMoves);
+	free(RA->BusyRegs);
+	free(RA->Intervals);
+	free(RA->SpillSlots);
+	free(RA->Ops);
+	free(RA);
+}
+
+/**
+ * \brief Get the location of an IRM register at a position
+ */
+tRALocation RA_GetLocation(tRegAllocation *RA, tIRMReg Reg, int Position)
+{
+	const tRAInterval	*piece = RA->Intervals[Reg];
+	assert(piece);
+	while( piece->NextSplit && RA_int_Start(piece->NextSplit) <= Position )
+		piece = piece->NextSplit;
+	return RA_int_PieceLocation(RA, piece);
+}
+
+tRALocation RA_int_PieceLocation(tRegAllocation *RA, const tRAInterval *Piece)
+{
+	tRALocation	ret = {.Reg = Piece->Reg, .Slot = -1};
+	if( ret.Reg < 0 )
+		ret.Slot = RA->SpillSlots[Piece->VReg];
+	return ret;
+}
+
+/**
+ * \brief Emit a parallel move list as a sequence of moves and swaps
+ *
+ * Each location is the source of at most one move, and spill slots are
+ * never part of a cycle (each register has its own slot), so cycles are
+ * broken with register swaps.
+ */
+void RA_SequentialiseMoves(tRAMoveList *List, void (*Emit)(void *Ptr, const tRAMove *Move, bool Swap), void *Ptr)
+{
+	 int	n = 0;
+	tRAMove	*pending = malloc(List->nMoves * sizeof(tRAMove));
+	for( int i = 0; i < List->nMoves; i ++ )
+	{
+		if( !RA_int_LocEqual(List->Moves[i].Dst, List->Moves[i].Src) )
+			pending[n++] = List->Moves[i];
+	}
+
+	while( n > 0 )
+	{
+		bool	progress = false;
+		for( int i = 0; i < n; )
+		{
+			bool	is_read = false;
+			for( int j = 0; j < n; j ++ )
+			{
+				if( j != i && RA_int_LocEqual(pending[j].Src, pending[i].Dst) ) {
+					is_read = true;
+					break;
+				}
+			}
+			if( is_read ) {
+				i ++;
+				continue ;
+			}
+			Emit(Ptr, &pending[i], false);
+			pending[i] = pending[--n];
+			progress = true;
+		}
+		if( progress || n == 0 )
+			continue ;
+
+		// Only cycles remain, swap the first move's registers
+		tRAMove	move = pending[0];
+		assert(move.Dst.Reg >= 0 && move.Src.Reg >= 0);
+		Emit(Ptr, &move, true);
+		pending[0] = pending[--n];
+		for( int j = 0; j < n; j ++ )
+		{
+			if( RA_int_LocEqual(pending[j].Src, move.Dst) )
+				pending[j].Src = move.Src;
+		}
+	}
+	free(pending);
+}
+
+// --- Setup ---
+void RA_int_SplitCriticalEdges(tIRMHandle Handle)
+{
+	 int	nblocks = Handle->nBlocks;
+	bool	split = false;
+	for( int i = 0; i < nblocks; i ++ )
+	{
+		tIRMBlock	*blk = Handle->Blocks[i];
+		if( blk->nSucc < 2 )
+			continue ;
+		for( int j = 0; j < blk->nSucc; j ++ )
+		{
+			if( blk->Succ[j]->nPred > 1 ) {
+				IRM_SplitEdge(Handle, blk, j);
+				split = true;
+			}
+		}
+	}
+	// Renumber so the new blocks are laid out next to their targets, the
+	// backend's frame placement needs the dominator tree to cover them too
+	if( split ) {
+		IRM_UpdateCFG(Handle);
+		IRM_ComputeDominators(Handle);
+	}
+}
+
+/**
+ * \brief Assign linear positions to operations (blocks in layout order)
+ */
+void RA_int_Number(tRAState *State)
+{
+	tIRMHandle	h = State->Handle;
+	tRegAllocation	*ra = State->RA;
+
+	ra->nOps = 0;
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = h->Blocks[i]->FirstOp; op; op = op->Next )
+			ra->nOps ++;
+	}
+	ra->Ops = malloc(ra->nOps * sizeof(tIRMOp*));
+	State->BlockFrom = malloc(h->nBlocks * sizeof(int));
+	State->BlockTo = malloc(h->nBlocks * sizeof(int));
+	State->nLiveIn = calloc(h->nBlocks, sizeof(int));
+	State->LiveInSpace = calloc(h->nBlocks, sizeof(int));
+	State->LiveIn = calloc(h->nBlocks, sizeof(tIRMReg*));
+	State->VisitIn = calloc(h->nBlocks, sizeof(tIRMReg));
+	State->VisitOut = calloc(h->nBlocks, sizeof(tIRMReg));
+	State->Stack = malloc(h->nBlocks * sizeof(tIRMBlock*));
+	State->Defs = calloc(h->nRegs, sizeof(tIRMOp*));
+
+	 int	idx = 0;
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		tIRMBlock	*blk = h->Blocks[i];
+		assert( blk->FirstOp );
+		State->BlockFrom[i] = RA_POS_USE(idx);
+		for( tIRMOp *op = blk->FirstOp; op; op = op->Next )
+		{
+			op->Index = idx;
+			ra->Ops[idx++] = op;
+			if( op->Dst != IRM_REG_VOID )
+				State->Defs[op->Dst] = op;
+		}
+		State->BlockTo[i] = RA_POS_USE(idx);
+	}
+}
+
+/**
+ * \brief Collect the registers an operation reads, looking through folded operands
+ */
+void RA_int_CollectOperands(tRAState *State, const tIRMOp *Op)
+{
+	State->nOperands = 0;
+	RA_int_CollectOperands_r(State, Op, -1);
+}
+
+void RA_int_CollectOperands_r(tRAState *State, const tIRMOp *Op, int TopUse)
+{
+	 int	nuse = IRM_GetUseCount(Op);
+	for( int j = 0; j < nuse; j ++ )
+	{
+		tIRMReg	r = *IRM_GetUse((tIRMOp*)Op, j);
+		if( r == IRM_REG_VOID )
+			continue ;
+		 int	top = (TopUse < 0 ? j : TopUse);
+		if( j < 32 && (Op->FoldMask & (1U << j)) ) {
+			assert( State->Defs[r] );
+			RA_int_CollectOperands_r(State, State->Defs[r], top);
+			continue ;
+		}
+		if( State->nOperands == State->OperandSpace ) {
+			State->OperandSpace = State->OperandSpace*2 + 8;
+			State->Operands = realloc(State->Operands, State->OperandSpace * sizeof(tRAOperand));
+		}
+		tRAOperand	*o = &State->Operands[State->nOperands++];
+		o->Reg = r;
+		o->Use = top;
+		o->bFolded = (TopUse >= 0);
+	}
+}
+
+// --- Liveness ---
+/**
+ * \brief Build live ranges and use positions for every IRM register
+ */
+void RA_int_BuildIntervals(tRAState *State)
+{
+	tIRMHandle	h = State->Handle;
+	tRegAllocation	*ra = State->RA;
+	 int	nregs = h->nRegs;
+
+	// Bucket uses and definitions by register
+	 int	*use_start = calloc(nregs+1, sizeof(int));
+	 int	*def_start = calloc(nregs+1, sizeof(int));
+	for( int i = 0; i < ra->nOps; i ++ )
+	{
+		tIRMOp	*op = ra->Ops[i];
+		if( op->Flags & IRMFLAG_FOLDED )
+			continue ;
+		RA_int_CollectOperands(State, op);
+		for( int j = 0; j < State->nOperands; j ++ )
+			use_start[State->Operands[j].Reg+1] ++;
+		if( op->Dst != IRM_REG_VOID )
+			def_start[op->Dst+1] ++;
+	}
+	for( int i = 0; i < nregs; i ++ )
+	{
+		use_start[i+1] += use_start[i];
+		def_start[i+1] += def_start[i];
+	}
+	tIRMOp	**uses = malloc((use_start[nregs]+1) * sizeof(tIRMOp*));
+	tIRMOp	**defs = malloc((def_start[nregs]+1) * sizeof(tIRMOp*));
+	 int	*use_fill = malloc(nregs * sizeof(int));
+	 int	*def_fill = malloc(nregs * sizeof(int));
+	memcpy(use_fill, use_start, nregs * sizeof(int));
+	memcpy(def_fill, def_start, nregs * sizeof(int));
+	for( int i = 0; i < ra->nOps; i ++ )
+	{
+		tIRMOp	*op = ra->Ops[i];
+		if( op->Flags & IRMFLAG_FOLDED )
+			continue ;
+		RA_int_CollectOperands(State, op);
+		for( int j = 0; j < State->nOperands; j ++ )
+			uses[use_fill[State->Operands[j].Reg]++] = op;
+		if( op->Dst != IRM_REG_VOID )
+			defs[def_fill[op->Dst]++] = op;
+	}
+
+	for( tIRMReg r = 1; r < nregs; r ++ )
+	{
+		 int	nuses = use_start[r+1] - use_start[r];
+		 int	ndefs = def_start[r+1] - def_start[r];
+		if( nuses == 0 && ndefs == 0 )
+			continue ;
+		ra->Intervals[r] = RA_int_NewInterval(r);
+		RA_int_ComputeLiveness(State, r, nuses, uses + use_start[r], ndefs, defs + def_start[r]);
+		RA_int_NormaliseRanges(ra->Intervals[r]);
+	}
+
+	free(uses);
+	free(defs);
+	free(use_start);
+	free(def_start);
+	free(use_fill);
+	free(def_fill);
+}
+
+/**
+ * \brief Latest definition of a register in a block before a position
+ */
+static tIRMOp *RA_int_LastDef(tIRMBlock *Block, int Before, int nDefs, tIRMOp **Defs)
+{
+	tIRMOp	*ret = NULL;
+	for( int i = 0; i < nDefs; i ++ )
+	{
+		if( Defs[i]->Block == Block && Defs[i]->Index < Before && (!ret || Defs[i]->Index > ret->Index) )
+			ret = Defs[i];
+	}
+	return ret;
+}
+
+/**
+ * \brief Compute the live ranges of one register by walking back from its uses
+ */
+void RA_int_ComputeLiveness(tRAState *State, tIRMReg VReg, int nUses, tIRMOp **Uses, int nDefs, tIRMOp **Defs)
+{
+	tRAInterval	*it = State->RA->Intervals[VReg];
+	tIRMReg	*visit_in = State->VisitIn;
+	tIRMReg	*visit_out = State->VisitOut;
+	tIRMBlock	**stack = State->Stack;
+	 int	sp = 0;
+
+	// Walk from each use back to the reaching definitions
+	for( int i = 0; i < nUses; i ++ )
+	{
+		tIRMOp	*use = Uses[i];
+		tIRMBlock	*blk = use->Block;
+		tIRMOp	*def = RA_int_LastDef(blk, use->Index, nDefs, Defs);
+		if( def ) {
+			RA_int_AddRange(it, RA_POS_DEF(def->Index), RA_POS_USE(use->Index)+1);
+			continue ;
+		}
+		RA_int_AddRange(it, State->BlockFrom[blk->Index], RA_POS_USE(use->Index)+1);
+		if( visit_in[blk->Index] == VReg )
+			continue ;
+		visit_in[blk->Index] = VReg;
+		stack[sp++] = blk;
+		while( sp > 0 )
+		{
+			tIRMBlock	*b = stack[--sp];
+			// Record live-in for edge resolution
+			 int	bi = b->Index;
+			if( State->nLiveIn[bi] == State->LiveInSpace[bi] ) {
+				State->LiveInSpace[bi] = State->LiveInSpace[bi]*2 + 4;
+				State->LiveIn[bi] = realloc(State->LiveIn[bi], State->LiveInSpace[bi]*sizeof(tIRMReg));
+			}
+			State->LiveIn[bi][State->nLiveIn[bi]++] = VReg;
+
+			for( int p = 0; p < b->nPred; p ++ )
+			{
+				tIRMBlock	*pred = b->Pred[p];
+				if( visit_out[pred->Index] == VReg )
+					continue ;
+				visit_out[pred->Index] = VReg;
+				tIRMOp	*pdef = RA_int_LastDef(pred, INT_MAX, nDefs, Defs);
+				if( pdef ) {
+					RA_int_AddRange(it, RA_POS_DEF(pdef->Index), State->BlockTo[pred->Index]);
+					continue ;
+				}
+				RA_int_AddRange(it, State->BlockFrom[pred->Index], State->BlockTo[pred->Index]);
+				if( visit_in[pred->Index] != VReg ) {
+					visit_in[pred->Index] = VReg;
+					stack[sp++] = pred;
+				}
+			}
+		}
+	}
+
+	// Definitions (dead ones still need a register to write to)
+	for( int i = 0; i < nDefs; i ++ )
+		RA_int_AddRange(it, RA_POS_DEF(Defs[i]->Index), RA_POS_DEF(Defs[i]->Index)+1);
+}
+
+/**
+ * \brief Record use positions, hints and the fixed intervals for clobbers
+ */
+void RA_int_ApplyConstraints(tRAState *State)
+{
+	tRegAllocation	*ra = State->RA;
+	const tRegAllocTarget	*tgt = State->Target;
+
+	for( int i = 0; i < ra->nOps; i ++ )
+	{
+		tIRMOp	*op = ra->Ops[i];
+		if( op->Flags & IRMFLAG_FOLDED )
+			continue ;
+		tRAConstraints	c = {.DstHint = -1, .SrcHint = {-1, -1}};
+		tgt->GetConstraints(State->Handle, op, &c);
+
+		RA_int_CollectOperands(State, op);
+		for( int j = 0; j < State->nOperands; j ++ )
+		{
+			const tRAOperand	*o = &State->Operands[j];
+			tRAInterval	*it = ra->Intervals[o->Reg];
+			// Components of folded operands (addresses) always want a register
+			bool	needs_reg = o->bFolded || (o->Use < 2 && (c.SrcNeedsReg & (1 << o->Use)));
+			if( it->nUses == 0 || it->Uses[it->nUses-1].Pos != RA_POS_USE(i) )
+				RA_int_AddUse(it, RA_POS_USE(i), needs_reg);
+			else if( needs_reg )
+				it->Uses[it->nUses-1].bNeedsReg = true;
+			if( !o->bFolded && o->Use < 2 && c.SrcHint[o->Use] >= 0 && it->Hint < 0 )
+				it->Hint = c.SrcHint[o->Use];
+		}
+		if( op->Dst != IRM_REG_VOID )
+		{
+			tRAInterval	*it = ra->Intervals[op->Dst];
+			RA_int_AddUse(it, RA_POS_DEF(i), false);
+			if( c.DstHint >= 0 )
+				it->Hint = c.DstHint;
+			else if( op->Op == IRMOP_COPY && it->HintVReg == IRM_REG_VOID ) {
+				it->HintVReg = op->Src[0];
+				it->HintPos = RA_POS_USE(i);
+			}
+		}
+
+		for( int r = 0; r < tgt->nRegs; r ++ )
+		{
+			uint32_t	bit = 1U << r;
+			 int	from, to;
+			if( c.LiveIn & bit ) {
+				from = 0;	to = RA_POS_USE(i)+1;
+			}
+			else if( c.ClobberAll & bit ) {
+				from = RA_POS_USE(i);	to = RA_POS_DEF(i)+1;
+			}
+			else if( c.ClobberUse & bit ) {
+				from = RA_POS_USE(i);	to = RA_POS_USE(i)+1;
+			}
+			else if( c.ClobberDef & bit ) {
+				from = RA_POS_USE(i)+1;	to = RA_POS_DEF(i);
+			}
+			else
+				continue ;
+			if( !State->Fixed[r] )
+				State->Fixed[r] = RA_int_NewInterval(IRM_REG_VOID);
+			State->Fixed[r]->Reg = r;
+			RA_int_AddRange(State->Fixed[r], from, to);
+		}
+	}
+}
+
+// --- Linear scan ---
+void RA_int_LinearScan(tRAState *State)
+{
+	tRegAllocation	*ra = State->RA;
+	for( int i = 1; i < State->Handle->nRegs; i ++ )
+	{
+		if( ra->Intervals[i] )
+			RA_int_PushUnhandled(State, ra->Intervals[i]);
+	}
+
+	tRAInterval	*cur;
+	while( (cur = RA_int_PopUnhandled(State)) )
+	{
+		 int	pos = RA_int_Start(cur);
+
+		// Retire and reactivate intervals
+		for( int i = 0; i < State->nActive; )
+		{
+			tRAInterval	*it = State->Active[i];
+			if( RA_int_End(it) <= pos ) {
+				State->Active[i] = State->Active[--State->nActive];
+			}
+			else if( !RA_int_Covers(it, pos) ) {
+				State->Active[i] = State->Active[--State->nActive];
+				RA_int_ListAppend(&State->Inactive, &State->nInactive, &State->InactiveSpace, it);
+			}
+			else
+				i ++;
+		}
+		for( int i = 0; i < State->nInactive; )
+		{
+			tRAInterval	*it = State->Inactive[i];
+			if( RA_int_End(it) <= pos ) {
+				State->Inactive[i] = State->Inactive[--State->nInactive];
+			}
+			else if( RA_int_Covers(it, pos) ) {
+				State->Inactive[i] = State->Inactive[--State->nInactive];
+				RA_int_ListAppend(&State->Active, &State->nActive, &State->ActiveSpace, it);
+			}
+			else
+				i ++;
+		}
+		for( int r = 0; r < State->Target->nRegs; r ++ )
+		{
+			if( State->Fixed[r] )
+				RA_int_Covers(State->Fixed[r], pos);
+		}
+
+		if( !RA_int_TryAllocateFree(State, cur) )
+			RA_int_AllocateBlocked(State, cur);
+		if( cur->Reg >= 0 ) {
+			ra->UsedRegs |= 1U << cur->Reg;
+			RA_int_ListAppend(&State->Active, &State->nActive, &State->ActiveSpace, cur);
+		}
+	}
+}
+
+/**
+ * \brief Pick a register that is free for (the start of) an interval
+ */
+bool RA_int_TryAllocateFree(tRAState *State, tRAInterval *Cur)
+{
+	const tRegAllocTarget	*tgt = State->Target;
+	 int	free_until[RA_MAX_REGS];
+	 int	pos = RA_int_Start(Cur);
+	 int	end = RA_int_End(Cur);
+
+	for( int r = 0; r < tgt->nRegs; r ++ )
+		free_until[r] = (tgt->Allocatable & (1U << r)) ? POS_MAX : 0;
+	for( int i = 0; i < State->nActive; i ++ )
+		free_until[State->Active[i]->Reg] = 0;
+	for( int i = 0; i < State->nInactive; i ++ )
+	{
+		tRAInterval	*it = State->Inactive[i];
+		 int	inter = RA_int_NextIntersection(it, Cur);
+		if( inter < free_until[it->Reg] )
+			free_until[it->Reg] = inter;
+	}
+	for( int r = 0; r < tgt->nRegs; r ++ )
+	{
+		if( !State->Fixed[r] )	continue ;
+		 int	inter = RA_int_NextIntersection(State->Fixed[r], Cur);
+		if( inter < free_until[r] )
+			free_until[r] = inter;
+	}
+
+	// Hints: explicit, then the register holding a copy's source
+	 int	hint = Cur->Hint;
+	if( hint < 0 && Cur->HintVReg != IRM_REG_VOID && State->RA->Intervals[Cur->HintVReg] )
+	{
+		tRALocation	loc = RA_GetLocation(State->RA, Cur->HintVReg, Cur->HintPos);
+		hint = loc.Reg;
+	}
+
+	 int	reg = -1;
+	if( hint >= 0 && free_until[hint] >= end )
+		reg = hint;
+	// Whole interval fits: caller-saved first, then callee-saved already in use (no extra save)
+	for( int pass = 0; reg < 0 && pass < 3; pass ++ )
+	{
+		for( int r = 0; r < tgt->nRegs; r ++ )
+		{
+			uint32_t	bit = 1U << r;
+			if( free_until[r] < end )	continue ;
+			if( pass == 0 && !(tgt->CallerSaved & bit) )	continue ;
+			if( pass == 1 && !(State->RA->UsedRegs & bit) )	continue ;
+			reg = r;
+			break;
+		}
+	}
+	if( reg < 0 )
+	{
+		reg = (hint >= 0 ? hint : 0);
+		for( int r = 0; r < tgt->nRegs; r ++ )
+		{
+			if( free_until[r] > free_until[reg] )
+				reg = r;
+		}
+	}
+
+	if( free_until[reg] <= pos )
+		return false;
+	if( free_until[reg] < end )
+	{
+		// Register is only free for the first part, split before it's needed
+		 int	split = RA_int_SplitPosBefore(free_until[reg]);
+		if( split <= pos )
+			return false;
+		tRAInterval	*child = RA_int_Split(Cur, split);
+		if( child )
+			RA_int_PushUnhandled(State, child);
+	}
+	Cur->Reg = reg;
+	return true;
+}
+
+/**
+ * \brief No register free: spill either the current interval or the one used furthest away
+ */
+void RA_int_AllocateBlocked(tRAState *State, tRAInterval *Cur)
+{
+	const tRegAllocTarget	*tgt = State->Target;
+	 int	next_use[RA_MAX_REGS];
+	 int	block_pos[RA_MAX_REGS];
+	 int	pos = RA_int_Start(Cur);
+
+	for( int r = 0; r < tgt->nRegs; r ++ )
+		next_use[r] = block_pos[r] = (tgt->Allocatable & (1U << r)) ? POS_MAX : 0;
+	for( int i = 0; i < State->nActive; i ++ )
+	{
+		tRAInterval	*it = State->Active[i];
+		 int	u = RA_int_NextUse(it, pos, false);
+		if( u < next_use[it->Reg] )
+			next_use[it->Reg] = u;
+	}
+	for( int i = 0; i < State->nInactive; i ++ )
+	{
+		tRAInterval	*it = State->Inactive[i];
+		if( RA_int_NextIntersection(it, Cur) == POS_MAX )
+			continue ;
+		 int	u = RA_int_NextUse(it, pos, false);
+		if( u < next_use[it->Reg] )
+			next_use[it->Reg] = u;
+	}
+	for( int r = 0; r < tgt->nRegs; r ++ )
+	{
+		if( !State->Fixed[r] )	continue ;
+		 int	inter = RA_int_NextIntersection(State->Fixed[r], Cur);
+		if( inter < block_pos[r] )	block_pos[r] = inter;
+		if( inter < next_use[r] )	next_use[r] = inter;
+	}
+
+	// A piece starting just before a use that needs a register (a reload) can't
+	// stay in memory, it takes a register that isn't fixed at that use
+	 int	reg_use = RA_int_NextUse(Cur, pos, true);
+	bool	must_have_reg = (RA_int_SplitPosBefore(reg_use) <= pos);
+	if( must_have_reg )
+	{
+		for( int r = 0; r < tgt->nRegs; r ++ )
+		{
+			if( block_pos[r] <= reg_use )
+				next_use[r] = 0;
+		}
+	}
+
+	 int	reg = (Cur->Hint >= 0 ? Cur->Hint : 0);
+	for( int r = 0; r < tgt->nRegs; r ++ )
+	{
+		if( next_use[r] > next_use[reg] )
+			reg = r;
+	}
+
+	 int	first_use = RA_int_NextUse(Cur, pos, false);
+	 int	split = POS_MAX;
+	if( block_pos[reg] < RA_int_End(Cur) )
+		split = RA_int_SplitPosBefore(block_pos[reg]);
+
+	if( !must_have_reg && (next_use[reg] < first_use || split <= pos) )
+	{
+		// Everything else is needed sooner, keep this one in memory until it needs a register
+		Cur->Reg = -1;
+		 int	u = RA_int_NextUse(Cur, pos+1, true);
+		if( u != POS_MAX )
+		{
+			 int	at = RA_int_SplitPosBefore(u);
+			if( at > pos ) {
+				tRAInterval	*child = RA_int_Split(Cur, at);
+				if( child )
+					RA_int_PushUnhandled(State, child);
+			}
+		}
+		return ;
+	}
+
+	Cur->Reg = reg;
+	if( split != POS_MAX ) {
+		tRAInterval	*child = RA_int_Split(Cur, split);
+		if( child )
+			RA_int_PushUnhandled(State, child);
+	}
+
+	// Evict the intervals currently holding the register
+	for( int i = 0; i < State->nActive; )
+	{
+		tRAInterval	*it = State->Active[i];
+		if( it->Reg == reg ) {
+			State->Active[i] = State->Active[--State->nActive];
+			RA_int_SpillFrom(State, it, pos);
+		}
+		else
+			i ++;
+	}
+	for( int i = 0; i < State->nInactive; )
+	{
+		tRAInterval	*it = State->Inactive[i];
+		if( it->Reg == reg && RA_int_NextIntersection(it, Cur) != POS_MAX ) {
+			State->Inactive[i] = State->Inactive[--State->nInactive];
+			RA_int_SpillFrom(State, it, pos);
+		}
+		else
+			i ++;
+	}
+}
+
+/**
+ * \brief Move the remainder of an interval (from Pos) to its spill slot
+ *
+ * The part that is spilt gets reloaded (split again) before its next use
+ * that needs a register.
+ */
+void RA_int_SpillFrom(tRAState *State, tRAInterval *It, int Pos)
+{
+	// (Pos is already a gap when the new interval is a split piece, going back a
+	// further operation would take the register away from uses already handled)
+	 int	at = ((Pos & 3) == 3 ? Pos : RA_int_SplitPosBefore(Pos));
+	tRAInterval	*piece;
+	if( at <= RA_int_Start(It) )
+		piece = It;
+	else
+		piece = RA_int_Split(It, at);
+	if( !piece )
+		return ;
+	piece->Reg = -1;
+
+	 int	u = RA_int_NextUse(piece, Pos+1, true);
+	if( u == POS_MAX )
+		return ;
+	 int	reload = RA_int_SplitPosBefore(u);
+	if( reload > Pos && reload > RA_int_Start(piece) ) {
+		tRAInterval	*child = RA_int_Split(piece, reload);
+		if( child )
+			RA_int_PushUnhandled(State, child);
+	}
+	else if( RA_int_Start(piece) > Pos ) {
+		// Not live yet, let it compete for a register again
+		RA_int_PushUnhandled(State, piece);
+	}
+}
+
+// --- Resolution ---
+/**
+ * \brief Record moves at split points and on CFG edges
+ */
+void RA_int_Resolve(tRAState *State)
+{
+	tRegAllocation	*ra = State->RA;
+	tIRMHandle	h = State->Handle;
+
+	// Spill slots
+	for( int r = 1; r < h->nRegs; r ++ )
+	{
+		for( tRAInterval *it = ra->Intervals[r]; it; it = it->NextSplit )
+		{
+			if( it->Reg < 0 ) {
+				ra->SpillSlots[r] = ra->nSpillSlots ++;
+				break;
+			}
+		}
+	}
+
+	// Split points inside blocks (block starts are handled by the edge moves)
+	for( int r = 1; r < h->nRegs; r ++ )
+	{
+		for( tRAInterval *it = ra->Intervals[r]; it && it->NextSplit; it = it->NextSplit )
+		{
+			tRAInterval	*next = it->NextSplit;
+			 int	start = RA_int_Start(next);
+			if( (start & 3) != 3 )
+				continue ;
+			 int	op = (start + 1) / 4;
+			if( op >= ra->nOps || ra->Ops[op]->Block->FirstOp == ra->Ops[op] )
+				continue ;
+			tRALocation	src = RA_int_PieceLocation(ra, it);
+			tRALocation	dst = RA_int_PieceLocation(ra, next);
+			if( !RA_int_LocEqual(src, dst) )
+				RA_int_AddMove(&ra->GapMoves[op], dst, src);
+		}
+	}
+
+	// Edges
+	for( int i = 0; i < h->nBlocks; i ++ )
+	{
+		tIRMBlock	*blk = h->Blocks[i];
+		for( int p = 0; p < blk->nPred; p ++ )
+		{
+			tIRMBlock	*pred = blk->Pred[p];
+			tRAMoveList	*list = (pred->nSucc == 1 ? &ra->ExitMoves[pred->Index] : &ra->EntryMoves[i]);
+			assert( pred->nSucc == 1 || blk->nPred == 1 );
+			for( int j = 0; j < State->nLiveIn[i]; j ++ )
+			{
+				tIRMReg	r = State->LiveIn[i][j];
+				tRALocation	src = RA_GetLocation(ra, r, State->BlockTo[pred->Index]-2);
+				tRALocation	dst = RA_GetLocation(ra, r, State->BlockFrom[i]);
+				if( !RA_int_LocEqual(src, dst) )
+					RA_int_AddMove(list, dst, src);
+			}
+		}
+	}
+}
+
+/**
+ * \brief Record which registers hold values during each operation (for scratch use)
+ */
+void RA_int_ComputeBusy(tRAState *State)
+{
+	tRegAllocation	*ra = State->RA;
+	for( int r = 1; r < State->Handle->nRegs; r ++ )
+	{
+		for( tRAInterval *it = ra->Intervals[r]; it; it = it->NextSplit )
+		{
+			if( it->Reg < 0 )
+				continue ;
+			for( int i = 0; i < it->nRanges; i ++ )
+			{
+				 int	first = (it->Ranges[i].From + 1) / 4;
+				 int	last = it->Ranges[i].To / 4;
+				if( last >= ra->nOps )
+					last = ra->nOps - 1;
+				for( int op = first; op <= last; op ++ )
+					ra->BusyRegs[op] |= 1U << it->Reg;
+			}
+		}
+	}
+}
+
+// --- Intervals ---
+tRAInterval *RA_int_NewInterval(tIRMReg VReg)
+{
+	tRAInterval	*ret = calloc(1, sizeof(tRAInterval));
+	ret->VReg = VReg;
+	ret->Reg = -1;
+	ret->Hint = -1;
+	return ret;
+}
+
+void RA_int_FreeInterval(tRAInterval *It)
+{
+	free(It->Ranges);
+	free(It->Uses);
+	free(It);
+}
+
+void RA_int_AddRange(tRAInterval *It, int From, int To)
+{
+	if( It->nRanges > 0 && It->Ranges[It->nRanges-1].To >= From && It->Ranges[It->nRanges-1].From <= From ) {
+		if( To > It->Ranges[It->nRanges-1].To )
+			It->Ranges[It->nRanges-1].To = To;
+		return ;
+	}
+	if( It->nRanges == It->RangeSpace ) {
+		It->RangeSpace = It->RangeSpace*2 + 4;
+		It->Ranges = realloc(It->Ranges, It->RangeSpace * sizeof(tRARange));
+	}
+	It->Ranges[It->nRanges].From = From;
+	It->Ranges[It->nRanges].To = To;
+	It->nRanges ++;
+}
+
+static int RA_int_CompareRanges(const void *A, const void *B)
+{
+	const tRARange	*a = A, *b = B;
+	return (a->From > b->From) - (a->From < b->From);
+}
+
+/**
+ * \brief Sort and merge overlapping/adjacent ranges
+ */
+void RA_int_NormaliseRanges(tRAInterval *It)
+{
+	if( It->nRanges < 2 )
+		return ;
+	qsort(It->Ranges, It->nRanges, sizeof(tRARange), RA_int_CompareRanges);
+	 int	out = 0;
+	for( int i = 1; i < It->nRanges; i ++ )
+	{
+		if( It->Ranges[i].From <= It->Ranges[out].To ) {
+			if( It->Ranges[i].To > It->Ranges[out].To )
+				It->Ranges[out].To = It->Ranges[i].To;
+		}
+		else
+			It->Ranges[++out] = It->Ranges[i];
+	}
+	It->nRanges = out + 1;
+}
+
+void RA_int_AddUse(tRAInterval *It, int Pos, bool bNeedsReg)
+{
+	if( It->nUses == It->UseSpace ) {
+		It->UseSpace = It->UseSpace*2 + 4;
+		It->Uses = realloc(It->Uses, It->UseSpace * sizeof(tRAUse));
+	}
+	// Uses arrive in position order
+	It->Uses[It->nUses].Pos = Pos;
+	It->Uses[It->nUses].bNeedsReg = bNeedsReg;
+	It->nUses ++;
+}
+
+/**
+ * \brief Largest split position whose moves happen before Pos
+ *
+ * Split positions are always gaps (4N-1), and the first piece keeps
+ * covering the gap so the move can read it.
+ */
+int RA_int_SplitPosBefore(int Pos)
+{
+	return (Pos / 4) * 4 - 1;
+}
+
+/**
+ * \brief Split an interval at a gap position
+ * \return New piece covering [Pos, end), NULL if nothing is live after Pos
+ */
+tRAInterval *RA_int_Split(tRAInterval *It, int Pos)
+{
+	assert( (Pos & 3) == 3 );
+	assert( Pos > RA_int_Start(It) );
+
+	 int	i;
+	for( i = 0; i < It->nRanges && It->Ranges[i].To <= Pos; i ++ )
+		;
+	if( i == It->nRanges )
+		return NULL;
+
+	tRAInterval	*child = RA_int_NewInterval(It->VReg);
+	child->Hint = It->Hint;
+	child->HintVReg = It->HintVReg;
+	child->HintPos = It->HintPos;
+
+	 int	keep = i;
+	if( It->Ranges[i].From <= Pos )
+	{
+		// Straddles the split, both pieces cover the gap
+		if( It->Ranges[i].To > Pos+1 )
+			RA_int_AddRange(child, Pos, It->Ranges[i].To);
+		It->Ranges[i].To = Pos+1;
+		keep = i + 1;
+		i ++;
+	}
+	for( ; i < It->nRanges; i ++ )
+		RA_int_AddRange(child, It->Ranges[i].From, It->Ranges[i].To);
+	It->nRanges = keep;
+	if( It->CurRange > It->nRanges )
+		It->CurRange = It->nRanges;
+
+	 int	u;
+	for( u = 0; u < It->nUses && It->Uses[u].Pos < Pos; u ++ )
+		;
+	for( int j = u; j < It->nUses; j ++ )
+		RA_int_AddUse(child, It->Uses[j].Pos, It->Uses[j].bNeedsReg);
+	It->nUses = u;
+
+	if( child->nRanges == 0 ) {
+		RA_int_FreeInterval(child);
+		return NULL;
+	}
+
+	child->NextSplit = It->NextSplit;
+	It->NextSplit = child;
+	return child;
+}
+
+/**
+ * \brief Check if an interval covers a position (positions must not decrease)
+ */
+bool RA_int_Covers(tRAInterval *It, int Pos)
+{
+	while( It->CurRange < It->nRanges && It->Ranges[It->CurRange].To <= Pos )
+		It->CurRange ++;
+	return It->CurRange < It->nRanges && It->Ranges[It->CurRange].From <= Pos;
+}
+
+int RA_int_NextIntersection(const tRAInterval *A, const tRAInterval *B)
+{
+	 int	i = A->CurRange, j = B->CurRange;
+	while( i < A->nRanges && j < B->nRanges )
+	{
+		const tRARange	*a = &A->Ranges[i], *b = &B->Ranges[j];
+		if( a->To <= b->From )
+			i ++;
+		else if( b->To <= a->From )
+			j ++;
+		else
+			return (a->From > b->From ? a->From : b->From);
+	}
+	return POS_MAX;
+}
+
+/**
+ * \brief First use at or after a position
+ */
+int RA_int_NextUse(const tRAInterval *It, int Pos, bool bRegOnly)
+{
+	 int	lo = 0, hi = It->nUses;
+	while( lo < hi )
+	{
+		 int	mid = (lo + hi) / 2;
+		if( It->Uses[mid].Pos < Pos )
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for( ; lo < It->nUses; lo ++ )
+	{
+		if( !bRegOnly || It->Uses[lo].bNeedsReg )
+			return It->Uses[lo].Pos;
+	}
+	return POS_MAX;
+}
+
+// --- Lists ---
+void RA_int_PushUnhandled(tRAState *State, tRAInterval *It)
+{
+	if( State->nUnhandled == State->UnhandledSpace ) {
+		State->UnhandledSpace = State->UnhandledSpace*2 + 16;
+		State->Unhandled = realloc(State->Unhandled, State->UnhandledSpace * sizeof(tRAInterval*));
+	}
+	It->Reg = -1;
+	It->CurRange = 0;
+	 int	i = State->nUnhandled ++;
+	while( i > 0 )
+	{
+		 int	parent = (i - 1) / 2;
+		if( RA_int_Start(State->Unhandled[parent]) <= RA_int_Start(It) )
+			break;
+		State->Unhandled[i] = State->Unhandled[parent];
+		i = parent;
+	}
+	State->Unhandled[i] = It;
+}
+
+tRAInterval *RA_int_PopUnhandled(tRAState *State)
+{
+	if( State->nUnhandled == 0 )
+		return NULL;
+	tRAInterval	*ret = State->Unhandled[0];
+	tRAInterval	*last = State->Unhandled[--State->nUnhandled];
+	 int	i = 0, n = State->nUnhandled;
+	for( ;; )
+	{
+		 int	c = i*2 + 1;
+		if( c >= n )	break;
+		if( c+1 < n && RA_int_Start(State->Unhandled[c+1]) < RA_int_Start(State->Unhandled[c]) )
+			c ++;
+		if( RA_int_Start(last) <= RA_int_Start(State->Unhandled[c]) )
+			break;
+		State->Unhandled[i] = State->Unhandled[c];
+		i = c;
+	}
+	if( n > 0 )
+		State->Unhandled[i] = last;
+	return ret;
+}
+
+void RA_int_ListAppend(tRAInterval ***List, int *Count, int *Space, tRAInterval *It)
+{
+	if( *Count == *Space ) {
+		*Space = *Space*2 + 8;
+		*List = realloc(*List, *Space * sizeof(tRAInterval*));
+	}
+	(*List)[(*Count)++] = It;
+}
+
+void RA_int_AddMove(tRAMoveList *List, tRALocation Dst, tRALocation Src)
+{
+	if( List->nMoves == List->Space ) {
+		List->Space = List->Space*2 + 4;
+		List->Moves = realloc(List->Moves, List->Space * sizeof(tRAMove));
+	}
+	List->Moves[List->nMoves].Dst = Dst;
+	List->Moves[List->nMoves].Src = Src;
+	List->nMoves ++;
+}
+
+bool RA_int_LocEqual(tRALocation A, tRALocation B)
+{
+	if( A.Reg >= 0 || B.Reg >= 0 )
+		return A.Reg == B.Reg;
+	return A.Slot == B.Slot;
+}
@@ -0,0 +1,598 @@
+/*
+ * Acess C Compiler
+ * By John Hodge (thePowersGang)
+ *
+ * This code is published under the terms of the BSD Licence. For more
+ * information see the file COPYING.
+ *
+ * output/sched.c - List scheduling
+ *
+ * Reorders the instructions of each block (after instruction selection,
+ * before register allocation) so that independent work fills the latency
+ * of long operations. Blocks are split into regions at calls, volatile
+ * accesses and every SCHED_REGION_MAX instructions; each region gets a
+ * dependency graph (register and memory dependencies, using the IRM alias
+ * analysis) and is list scheduled cycle by cycle against the target's
+ * issue width, port and latency model, critical path first.
+ *
+ * Scheduling for latency lengthens live ranges, so once the values
+ * created in a region would exceed the target's registers the scheduler
+ * switches to picking whatever reduces pressure (roughly source order).
+ *
+ * Operations folded into their users (IRMFLAG_FOLDED) are not scheduled,
+ * their operands and memory reads are accounted to the instruction that
+ * absorbed them.
+ */
+#include <global.h>
+#include <sched.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#define SCHED_REGION_MAX	256	//!< Bounds the (quadratic) dependency graph construction
+#define SCHED_MAX_ACCESSES	3	//!< Memory accesses of one instruction (itself and folded loads)
+
+typedef struct sSchedEdge
+{
+	 int	To;
+	 int	Latency;
+	 int	Next;
+} tSchedEdge;
+
+typedef struct sSchedNode
+{
+	tIRMOp	*Op;
+	tSchedModel	Model;
+
+	 int	FirstRead, nReads;
+	tIRMReg	*Reads;	//!< Registers read (through folded operations), set once the region is complete
+	 int	nAccesses;
+	tIRMMemLocation	Accesses[SCHED_MAX_ACCESSES];
+	bool	bExact[SCHED_MAX_ACCESSES];	//!< Location comparable with others (not an unknown pointer)
+	bool	bStore;	//!< Accesses[0] is written
+	 int	nFoldedLoads;
+
+	 int	FirstSucc;	//!< Edge list
+	 int	nPreds;	//!< Unscheduled predecessors
+	 int	Height;	//!< Critical path to the end of the region
+	 int	ReadyCycle;
+} tSchedNode;
+
+typedef struct sSchedState
+{
+	tIRMHandle	Handle;
+	const tSchedTarget	*Target;
+	tIRMOp	**Defs;	//!< [nRegs] Definition of single-def registers (NULL otherwise)
+	 int	*nDefs;	//!< [nRegs]
+	 int	*nUses;	//!< [nRegs]
+
+	 int	nNodes;
+	tSchedNode	Nodes[SCHED_REGION_MAX];
+	 int	nEdges, EdgeSpace;
+	tSchedEdge	*Edges;
+	 int	nReadSpace;
+	tIRMReg	*ReadPool;	//!< Backing for tSchedNode.Reads
+	 int	nReadPool;
+
+	 int	*Remaining;	//!< [nRegs] Uses left in the region
+	 int	*RegionUses;	//!< [nRegs] Uses within the region
+	 int	*RegionDef;	//!< [nRegs] Region that defined the register (negated when live into it)
+	 int	Region;
+	 int	nMoved;
+} tSchedState;
+
+// === PROTOTYPES ===
+ int	Sched_ScheduleFunction(tIRMHandle Handle, const tSchedTarget *Target);
+void	Sched_int_ScheduleBlock(tSchedState *State, tIRMBlock *Block);
+bool	Sched_int_IsBarrier(tSchedState *State, const tIRMOp *Op);
+void	Sched_int_AddNode(tSchedState *State, tIRMOp *Op);
+void	Sched_int_CollectReads(tSchedState *State, tSchedNode *Node, const tIRMOp *Op, bool bFolded);
+void	Sched_int_AddAccess(tSchedState *State, tSchedNode *Node, const tIRMOp *Op);
+void	Sched_int_BuildGraph(tSchedState *State);
+bool	Sched_int_MemoryConflict(const tSchedNode *A, const tSchedNode *B);
+void	Sched_int_AddEdge(tSchedState *State, int From, int To, int Latency);
+void	Sched_int_ScheduleRegion(tSchedState *State, tIRMOp **Order);
+ int	Sched_int_PressureDelta(tSchedState *State, const tSchedNode *Node);
+bool	Sched_int_TryIssue(tSchedState *State, const tSchedNode *Node, uint32_t *PortsUsed);
+
+// === CODE ===
+/**
+ * \brief Schedule every block of a (non-SSA) function
+ * \return Number of instructions that changed position
+ */
+int Sched_ScheduleFunction(tIRMHandle Handle, const tSchedTarget *Target)
+{
+	assert( !Handle->bIsSSA );
+	assert( Target->nPorts <= SCHED_MAX_PORTS );
+	tSchedState	state = {
+		.Handle = Handle,
+		.Target = Target,
+		.Defs = calloc(Handle->nRegs, sizeof(tIRMOp*)),
+		.nDefs = calloc(Handle->nRegs, sizeof(int)),
+		.nUses = calloc(Handle->nRegs, sizeof(int)),
+		.Remaining = calloc(Handle->nRegs, sizeof(int)),
+		.RegionUses = calloc(Handle->nRegs, sizeof(int)),
+		.RegionDef = calloc(Handle->nRegs, sizeof(int)),
+		};
+
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+	{
+		for( tIRMOp *op = Handle->Blocks[i]->FirstOp; op; op = op->Next )
+		{
+			if( op->Dst != IRM_REG_VOID ) {
+				state.Defs[op->Dst] = op;
+				state.nDefs[op->Dst] ++;
+			}
+			 int	nuse = IRM_GetUseCount(op);
+			for( int j = 0; j < nuse; j ++ )
+			{
+				tIRMReg	r = *IRM_GetUse(op, j);
+				if( r != IRM_REG_VOID )
+					state.nUses[r] ++;
+			}
+		}
+	}
+	for( int r = 0; r < Handle->nRegs; r ++ )
+	{
+		if( state.nDefs[r] != 1 )
+			state.Defs[r] = NULL;
+	}
+
+	for( int i = 0; i < Handle->nBlocks; i ++ )
+		Sched_int_ScheduleBlock(&state, Handle->Blocks[i]);
+
+	free(state.Defs);
+	free(state.nDefs);
+	free(state.nUses);
+	free(state.Remaining);
+	free(state.RegionUses);
+	free(state.RegionDef);
+	free(state.Edges);
+	free(state.ReadPool);
+	return state.nMoved;
+}
+
+/**
+ * \brief Split a block into regions and schedule each
+ *
+ * Folded operations are moved to the start of the block (they generate no
+ * code), barriers and the terminator stay where they are.
+ */
+void Sched_int_ScheduleBlock(tSchedState *State, tIRMBlock *Block)
+{
+	tIRMOp	*term = (Block->LastOp && IRM_IsTerminator(Block->LastOp) ? Block->LastOp : NULL);
+	 int	nops = 0;
+	for( tIRMOp *op = Block->FirstOp; op; op = op->Next )
+		nops ++;
+	if( nops < 3 )
+		return ;
+
+	tIRMOp	**ops = malloc(nops * sizeof(tIRMOp*));
+	tIRMOp	**order = malloc(nops * sizeof(tIRMOp*));
+	 int	n = 0, nout = 0;
+	for( tIRMOp *op = Block->FirstOp; op; op = op->Next )
+		ops[n++] = op;
+	// Folded operations first
+	for( int i = 0; i < n; i ++ )
+	{
+		if( ops[i]->Flags & IRMFLAG_FOLDED )
+			order[nout++] = ops[i];
+	}
+
+	State->nNodes = 0;
+	State->nReadPool = 0;
+	for( int i = 0; i < n; i ++ )
+	{
+		tIRMOp	*op = ops[i];
+		if( op->Flags & IRMFLAG_FOLDED )
+			continue ;
+		bool	barrier = (op == term || Sched_int_IsBarrier(State, op));
+		if( barrier || State->nNodes == SCHED_REGION_MAX )
+		{
+			Sched_int_ScheduleRegion(State, order + nout);
+			nout += State->nNodes;
+			State->nNodes = 0;
+			State->nReadPool = 0;
+		}
+		if( barrier )
+			order[nout++] = op;
+		else
+			Sched_int_AddNode(State, op);
+	}
+	Sched_int_ScheduleRegion(State, order + nout);
+	nout += State->nNodes;
+	State->nNodes = 0;
+	assert( nout == n );
+
+	// Relink in the new order
+	tIRMOp	*prev = NULL;
+	for( int i = 0; i < n; i ++ )
+	{
+		order[i]->Prev = prev;
+		order[i]->Next = NULL;
+		if( prev )
+			prev->Next = order[i];
+		else
+			Block->FirstOp = order[i];
+		prev = order[i];
+	}
+	Block->LastOp = prev;
+
+	free(ops);
+	free(order);
+}
+
+/**
+ * \brief Operations nothing can move across
+ */
+bool Sched_int_IsBarrier(tSchedState *State, const tIRMOp *Op)
+{
+	switch(Op->Op)
+	{
+	case IRMOP_CALL:
+	case IRMOP_PHI:
+		return true;
+	case IRMOP_LOAD:
+	case IRMOP_LOADLOCAL:
+		return IRM_GetRegType(State->Handle, Op->Dst)->bVolatile;
+	case IRMOP_STORE:
+		return IRM_GetRegType(State->Handle, Op->Src[1])->bVolatile;
+	case IRMOP_STORELOCAL:
+		return State->Handle->Locals[Op->Local].Type->bVolatile;
+	default:
+		return IRM_IsTerminator(Op);
+	}
+}
+
+void Sched_int_AddNode(tSchedState *State, tIRMOp *Op)
+{
+	tSchedNode	*node = &State->Nodes[State->nNodes++];
+	memset(node, 0, sizeof(*node));
+	node->Op = Op;
+	node->FirstSucc = -1;
+	node->FirstRead = State->nReadPool;
+	Sched_int_CollectReads(State, node, Op, false);
+	State->Target->GetModel(State->Handle, Op, node->nFoldedLoads, &node->Model);
+	assert( node->Model.nUops <= SCHED_MAX_UOPS );
+
+	switch(Op->Op)
+	{
+	case IRMOP_STORE:
+	case IRMOP_STORELOCAL:
+		node->bStore = true;
+		Sched_int_AddAccess(State, node, Op);
+		break;
+	case IRMOP_LOAD:
+	case IRMOP_LOADLOCAL:
+		Sched_int_AddAccess(State, node, Op);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * \brief Collect the registers (and memory) an instruction reads, including through folded operations
+ */
+void Sched_int_CollectReads(tSchedState *State, tSchedNode *Node, const tIRMOp *Op, bool bFolded)
+{
+	if( bFolded && (Op->Op == IRMOP_LOAD || Op->Op == IRMOP_LOADLOCAL) ) {
+		Sched_int_AddAccess(State, Node, Op);
+		Node->nFoldedLoads ++;
+	}
+	// Argument slots are never written, so they have no memory dependencies
+	if( bFolded && Op->Op == IRMOP_ARGUMENT )
+		Node->nFoldedLoads ++;
+	 int	nuse = IRM_GetUseCount(Op);
+	for( int j = 0; j < nuse; j ++ )
+	{
+		tIRMReg	r = *IRM_GetUse((tIRMOp*)Op, j);
+		if( r == IRM_REG_VOID )
+			continue ;
+		if( j < 32 && (Op->FoldMask & (1U << j)) ) {
+			assert( State->Defs[r] );
+			Sched_int_CollectReads(State, Node, State->Defs[r], true);
+			continue ;
+		}
+		if( State->nReadPool == State->nReadSpace ) {
+			State->nReadSpace = State->nReadSpace*2 + 32;
+			State->ReadPool = realloc(State->ReadPool, State->nReadSpace * sizeof(tIRMReg));
+		}
+		State->ReadPool[State->nReadPool++] = r;
+		Node->nReads ++;
+	}
+}
+
+void Sched_int_AddAccess(tSchedState *State, tSchedNode *Node, const tIRMOp *Op)
+{
+	assert( Node->nAccesses < SCHED_MAX_ACCESSES );
+	tIRMMemLocation	*loc = &Node->Accesses[Node->nAccesses];
+	IRM_GetMemLocation(State->Handle, State->Defs, Op, loc);
+	// Pointers held in multiply defined registers may differ between two accesses
+	Node->bExact[Node->nAccesses] = (loc->BaseType != IRMMEM_REGISTER || State->nDefs[loc->Reg] == 1);
+	Node->nAccesses ++;
+}
+
+/**
+ * \brief Add dependency edges between the nodes of the current region
+ */
+void Sched_int_BuildGraph(tSchedState *State)
+{
+	State->nEdges = 0;
+	for( int b = 0; b < State->nNodes; b ++ )
+	{
+		tSchedNode	*nb = &State->Nodes[b];
+		tIRMReg	bdst = nb->Op->Dst;
+		for( int a = 0; a < b; a ++ )
+		{
+			tSchedNode	*na = &State->Nodes[a];
+			tIRMReg	adst = na->Op->Dst;
+			 int	latency = -1;
+			// Read after write
+			for( int k = 0; adst != IRM_REG_VOID && k < nb->nReads; k ++ )
+			{
+				if( nb->Reads[k] == adst )
+					latency = na->Model.Latency;
+			}
+			// Write after read/write
+			if( bdst != IRM_REG_VOID && latency < 0 )
+			{
+				if( bdst == adst )
+					latency = 0;
+				for( int k = 0; k < na->nReads; k ++ )
+				{
+					if( na->Reads[k] == bdst )
+						latency = 0;
+				}
+			}
+			if( Sched_int_MemoryConflict(na, nb) )
+			{
+				 int	mem_latency = (na->bStore ? State->Target->StoreLatency : 0);
+				if( mem_latency > latency )
+					latency = mem_latency;
+			}
+			if( latency >= 0 )
+				Sched_int_AddEdge(State, a, b, latency);
+		}
+	}
+
+	// Critical path heights (edges only go forwards)
+	for( int i = State->nNodes; i --; )
+	{
+		tSchedNode	*n = &State->Nodes[i];
+		n->Height = n->Model.Latency;
+		for( int e = n->FirstSucc; e != -1; e = State->Edges[e].Next )
+		{
+			 int	h = State->Edges[e].Latency + State->Nodes[State->Edges[e].To].Height;
+			if( h > n->Height )
+				n->Height = h;
+		}
+	}
+}
+
+bool Sched_int_MemoryConflict(const tSchedNode *A, const tSchedNode *B)
+{
+	if( !A->bStore && !B->bStore )
+		return false;
+	for( int i = 0; i < A->nAccesses; i ++ )
+	{
+		for( int j = 0; j < B->nAccesses; j ++ )
+		{
+			// Only Accesses[0] can be a store
+			if( !(A->bStore && i == 0) && !(B->bStore && j == 0) )
+				continue ;
+			if( !A->bExact[i] || !B->bExact[j] )
+				return true;
+			if( IRM_MayAlias(&A->Accesses[i], &B->Accesses[j]) )
+				return true;
+		}
+	}
+	return false;
+}
+
+void Sched_int_AddEdge(tSchedState *State, int From, int To, int Latency)
+{
+	if( State->nEdges == State->EdgeSpace ) {
+		State->EdgeSpace = State->EdgeSpace*2 + 64;
+		State->Edges = realloc(State->Edges, State->EdgeSpace * sizeof(tSchedEdge));
+	}
+	tSchedEdge	*e = &State->Edges[State->nEdges];
+	e->To = To;
+	e->Latency = Latency;
+	e->Next = State->Nodes[From].FirstSucc;
+	State->Nodes[From].FirstSucc = State->nEdges;
+	State->Nodes[To].nPreds ++;
+	State->nEdges ++;
+}
+
+/**
+ * \brief List schedule the current region
+ * \param Order	Receives the operations in their new order
+ */
+void Sched_int_ScheduleRegion(tSchedState *State, tIRMOp **Order)
+{
+	 int	n = State->nNodes;
+	if( n == 0 )
+		return ;
+	for( int i = 0; i < n; i ++ )
+		State->Nodes[i].Reads = State->ReadPool + State->Nodes[i].FirstRead;
+	if( n == 1 ) {
+		Order[0] = State->Nodes[0].Op;
+		return ;
+	}
+	Sched_int_BuildGraph(State);
+
+	// Values created (and entirely used) in the region count towards pressure
+	for( int i = 0; i < n; i ++ )
+	{
+		for( int k = 0; k < State->Nodes[i].nReads; k ++ )
+			State->RegionUses[State->Nodes[i].Reads[k]] = 0;
+	}
+	for( int i = 0; i < n; i ++ )
+	{
+		for( int k = 0; k < State->Nodes[i].nReads; k ++ )
+			State->RegionUses[State->Nodes[i].Reads[k]] ++;
+	}
+	State->Region ++;
+	for( int i = 0; i < n; i ++ )
+	{
+		tIRMReg	r = State->Nodes[i].Op->Dst;
+		if( r == IRM_REG_VOID )
+			continue ;
+		if( State->nDefs[r] == 1 )
+			State->RegionDef[r] = State->Region;
+		State->Remaining[r] = 0;
+		if( State->nDefs[r] == 1 ) {
+			for( int j = i + 1; j < n; j ++ )
+			{
+				for( int k = 0; k < State->Nodes[j].nReads; k ++ )
+					State->Remaining[r] += (State->Nodes[j].Reads[k] == r);
+			}
+		}
+	}
+
+	 int	ready[SCHED_REGION_MAX];
+	 int	nready = 0;
+	for( int i = 0; i < n; i ++ )
+	{
+		if( State->Nodes[i].nPreds == 0 )
+			ready[nready++] = i;
+	}
+
+	// Values read from outside the region hold registers throughout it
+	 int	limit = State->Target->nRegs;
+	for( int i = 0; i < n; i ++ )
+	{
+		for( int k = 0; k < State->Nodes[i].nReads; k ++ )
+		{
+			tIRMReg	r = State->Nodes[i].Reads[k];
+			if( State->RegionDef[r] != State->Region && State->RegionDef[r] != -State->Region ) {
+				State->RegionDef[r] = -State->Region;
+				limit --;
+			}
+		}
+	}
+	 int	cycle = 0, nsched = 0, live = 0;
+	while( nsched < n )
+	{
+		uint32_t	ports = 0;
+		 int	issued = 0;
+		for( ;; )
+		{
+			// (stop once a new value would take the last free register)
+			bool	pressure = (live + 1 >= limit);
+			 int	best = -1, best_delta = 0;
+			for( int i = 0; i < nready; i ++ )
+			{
+				tSchedNode	*c = &State->Nodes[ready[i]];
+				if( !pressure && c->ReadyCycle > cycle )
+					continue ;
+				if( issued > 0 && issued + c->Model.nUops > State->Target->IssueWidth )
+					continue ;
+				// Anything can start in an empty cycle (long sequences take the following cycles)
+				uint32_t	tmp_ports = ports;
+				if( issued > 0 && !Sched_int_TryIssue(State, c, &tmp_ports) )
+					continue ;
+				 int	delta = Sched_int_PressureDelta(State, c);
+				if( best >= 0 )
+				{
+					tSchedNode	*b = &State->Nodes[ready[best]];
+					if( pressure ) {
+						// Free registers first, then keep the original order
+						if( delta > best_delta || (delta == best_delta && ready[i] > ready[best]) )
+							continue ;
+					}
+					else {
+						// Longest path to the end first
+						if( c->Height < b->Height || (c->Height == b->Height && ready[i] > ready[best]) )
+							continue ;
+					}
+				}
+				best = i;
+				best_delta = delta;
+			}
+			if( best < 0 )
+				break;
+
+			 int	idx = ready[best];
+			tSchedNode	*node = &State->Nodes[idx];
+			ready[best] = ready[--nready];
+			Sched_int_TryIssue(State, node, &ports);
+			issued += node->Model.nUops;
+			if( node->ReadyCycle > cycle )
+				cycle = node->ReadyCycle;
+			if( node->Op != State->Nodes[nsched].Op )
+				State->nMoved ++;
+			Order[nsched++] = node->Op;
+
+			live += best_delta;
+			for( int k = 0; k < node->nReads; k ++ )
+				State->Remaining[node->Reads[k]] --;
+
+			for( int e = node->FirstSucc; e != -1; e = State->Edges[e].Next )
+			{
+				tSchedNode	*s = &State->Nodes[State->Edges[e].To];
+				if( cycle + State->Edges[e].Latency > s->ReadyCycle )
+					s->ReadyCycle = cycle + State->Edges[e].Latency;
+				if( --s->nPreds == 0 )
+					ready[nready++] = State->Edges[e].To;
+			}
+			if( issued >= State->Target->IssueWidth )
+				break;
+		}
+
+		// Next cycle (skipping ahead if nothing can start before then)
+		 int	next = INT_MAX;
+		for( int i = 0; i < nready; i ++ )
+		{
+			if( State->Nodes[ready[i]].ReadyCycle < next )
+				next = State->Nodes[ready[i]].ReadyCycle;
+		}
+		cycle = (next > cycle + 1 && next != INT_MAX ? next : cycle + 1);
+	}
+}
+
+/**
+ * \brief Change in live region values if a node is scheduled now
+ */
+int Sched_int_PressureDelta(tSchedState *State, const tSchedNode *Node)
+{
+	 int	delta = 0;
+	tIRMReg	dst = Node->Op->Dst;
+	// A result that's used later in the region (or outside it) occupies a register
+	if( dst != IRM_REG_VOID && (State->Remaining[dst] > 0 || State->nDefs[dst] != 1
+	 || State->nUses[dst] != State->RegionUses[dst]) )
+		delta ++;
+	for( int k = 0; k < Node->nReads; k ++ )
+	{
+		tIRMReg	r = Node->Reads[k];
+		 int	n = 0;
+		for( int j = 0; j < Node->nReads; j ++ )
+			n += (Node->Reads[j] == r);
+		// Last reads of a value created in the region (counted once)
+		bool	first = true;
+		for( int j = 0; j < k; j ++ )
+			first = first && (Node->Reads[j] != r);
+		if( first && State->nDefs[r] == 1 && State->RegionDef[r] == State->Region
+		 && State->nUses[r] == State->RegionUses[r] && State->Remaining[r] == n )
+			delta --;
+	}
+	return delta;
+}
+
+/**
+ * \brief Check that a node's micro-ops can get ports this cycle (claiming them)
+ */
+bool Sched_int_TryIssue(tSchedState *State, const tSchedNode *Node, uint32_t *PortsUsed)
+{
+	for( int u = 0; u < Node->Model.nUops; u ++ )
+	{
+		uint32_t	free = Node->Model.UopPorts[u] & ~*PortsUsed;
+		if( Node->Model.UopPorts[u] == 0 )
+			continue ;
+		if( free == 0 )
+			return false;
+		*PortsUsed |= free & -free;
+	}
+	return true;
+}
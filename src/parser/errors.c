@@ -19,7 +19,7 @@ static inline void message_header_p(tParser *Parser, const char *sev, const char
 
 void CompileError(tAST_Node *Node, const char *format, ...)
 {
-	message_header("", Node->Line, "error", "compile");
+	message_header(Node->File ? Node->File : "", Node->Line, "error", "compile");
 	va_list	args;
 	va_start(args, format);
 	vfprintf(stderr, format, args);
@@ -29,7 +29,7 @@ void CompileError(tAST_Node *Node, const char *format, ...)
 
 void CompileWarning(tAST_Node *Node, const char *format, ...)
 {
-	message_header("", Node->Line, "warning", "compile");
+	message_header(Node->File ? Node->File : "", Node->Line, "warning", "compile");
 	va_list	args;
 	va_start(args, format);
 	vfprintf(stderr, format, args);
@@ -15,6 +15,7 @@
 #include <memory.h>
 #include <symbol.h>
 #include <ast.h>
+#include <consteval.h>
 #include <stdbool.h>
 #include <assert.h>
 
@@ -30,7 +31,7 @@ void	Parse_CodeRoot(tParser *Parser);
 const tType	*Parse_GetType(tParser *Parser, char **NamePtr, const tType **BaseType, char ***VarNames);
 char	**Parse_DoFcnProto(tParser *Parser, const tType *Type, const tType **OutType);
  int	Parse_DoDefinition(tParser *Parser, tAST_Node *CodeNode);
- int	Parse_DoDefinition_VarActual(tParser *Parser, const tType *Type, const char *Name, tAST_Node *CodeNode);
+ int	Parse_DoDefinition_VarActual(tParser *Parser, const tType *Type, enum eLinkage Linkage, const char *Name, tAST_Node *CodeNode);
 tAST_Node	*DoCodeBlock(tParser *Parser);
 tAST_Node	*DoStatement(tParser *Parser, tAST_Node *CodeNode);
 tAST_Node	*DoIf(tParser *Parser);
@@ -58,6 +59,9 @@ tAST_Node	*GetIdent(tParser *Parser);
 tAST_Node	*GetNumeric(tParser *Parser);
 tAST_Node	*GetSizeof(tParser *Parser);
 
+// === GLOBALS ===
+ int	giParse_StaticCount;	//!< Used to give block scope statics unique names
+
 // === CODE ===
 /**
  * \brief Handle the root of the parse tree
@@ -292,13 +296,17 @@ const tType *Parse_GetType_Base(tParser *Parser, enum eStorageClass *StorageClas
 					
 					if( LookAhead(Parser) == TOK_ASSIGNEQU )
 					{
+						int64_t	cval;
 						GetToken(Parser);
-						if( SyntaxAssert(Parser, GetToken(Parser), TOK_CONST_NUM) )
+						if( ConstEval_Integer(DoExpr1(Parser), &cval) )
 							return NULL;
-						val = Parser->Cur.Integer;
+						val = cval;
 					}
 					
-					Types_AddEnumValue(enum_info, name, val);
+					if( Types_AddEnumValue(enum_info, name, val) ) {
+						SyntaxError(Parser, "Redefinition of enumerator '%s'", name);
+						return NULL;
+					}
 					
 					val ++;
 				} while(GetToken(Parser) == TOK_COMMA);
@@ -558,14 +566,13 @@ const tType *Parse_GetType_Ext(tParser *Parser, char **NamePtr, const tType *Bas
 		}
 		else
 		{
-			extern tAST_Node *Opt1_Optimise(tAST_Node *Node);
+			int64_t	count;
 			tAST_Node *size = DoExpr0(Parser);
 			if(SyntaxAssert(Parser, GetToken(Parser), TOK_SQUARE_CLOSE))
 				return NULL;
-			size = Opt1_Optimise(size);
-			if( size->Type == NODETYPE_INTEGER ) {
-				DEBUG("size={Value:%lli}", (long long)size->Integer.Value);
-				type = Types_CreateArrayType(type, size->Integer.Value);
+			if( ConstEval_Integer(size, &count) == 0 ) {
+				DEBUG("size={Value:%lli}", (long long)count);
+				type = Types_CreateArrayType(type, count);
 			}
 			else {
 				SyntaxError(Parser, "TODO: variable-sized arrays");
@@ -605,7 +612,7 @@ const tType *Parse_GetType(tParser *Parser, char **NamePtr, const tType **BaseTy
 {
 	DEBUG("NamePtr=%p,BaseType=%p,VarNames=%p",
 		NamePtr, BaseType, VarNames);
-	enum eStorageClass	storage_class;
+	enum eStorageClass	storage_class = STORAGECLASS_NORMAL;
 	const tType *type;
 	
 	if( BaseType && *BaseType )
@@ -691,7 +698,16 @@ _err:
  */
 int Parse_DoDefinition(tParser *Parser, tAST_Node *CodeNode)
 {
-	const tType *basetype = NULL;
+	enum eStorageClass	storage_class;
+	const tType *basetype = Parse_GetType_Base(Parser, &storage_class);
+	if( !basetype )
+		return 1;
+	// (Inside a function, LINKAGE_GLOBAL is a normal local)
+	enum eLinkage	linkage = LINKAGE_GLOBAL;
+	if( storage_class == STORAGECLASS_STATIC )
+		linkage = LINKAGE_STATIC;
+	else if( storage_class == STORAGECLASS_EXTERN )
+		linkage = LINKAGE_EXTERNAL;
 	do {
 		char	**argnames;
 		char	*name;
@@ -706,22 +722,24 @@ int Parse_DoDefinition(tParser *Parser, tAST_Node *CodeNode)
 				SyntaxError(Parser, "Expected name after type");
 				return 1;
 			}
+			// (`extern` is the default for functions)
+			enum eLinkage	fcn_linkage = (linkage == LINKAGE_STATIC && !CodeNode ? LINKAGE_STATIC : LINKAGE_GLOBAL);
 
 			// if set, it was a bare function
 			if( LookAhead(Parser) == TOK_BRACE_OPEN )
 			{
 				// Definition
 				// - Add an unbound symbol first to allow for recursion
-				Symbol_AddFunction(type, LINKAGE_GLOBAL, name, NULL);
+				Symbol_AddFunction(type, fcn_linkage, name, argnames, NULL);
 				tAST_Node *code = DoCodeBlock(Parser);
 				if( !code )	return 1;
-				Symbol_AddFunction(type, LINKAGE_GLOBAL, name, code);
+				Symbol_AddFunction(type, fcn_linkage, name, argnames, code);
 			}
 			else if( LookAhead(Parser) == TOK_SEMICOLON )
 			{
 				GetToken(Parser);
 				// prototype
-				Symbol_AddFunction(type, LINKAGE_GLOBAL, name, NULL);
+				Symbol_AddFunction(type, fcn_linkage, name, argnames, NULL);
 			}
 			else
 			{
@@ -746,7 +764,7 @@ int Parse_DoDefinition(tParser *Parser, tAST_Node *CodeNode)
 				return 1;
 			}
 			
-			if( Parse_DoDefinition_VarActual(Parser, type, name, CodeNode) ) {
+			if( Parse_DoDefinition_VarActual(Parser, type, linkage, name, CodeNode) ) {
 				free(name);
 				return 1;
 			}
@@ -791,25 +809,144 @@ _err:
 	return NULL;
 }
 
-int Parse_DoDefinition_VarActual(tParser *Parser, const tType *Type, const char *Name, tAST_Node *CodeNode)
+/**
+ * \brief Braced initialiser of an integer array, evaluated as it is parsed
+ *
+ * Generated lookup tables can have millions of entries, so constant elements
+ * are packed straight into a blob instead of each becoming a node. The first
+ * element that isn't an integer constant turns it back into a normal list.
+ */
+tAST_Node *Parse_ConstantArray(tParser *Parser, const tType *Type)
+{
+	const tType	*ele = Type->Array.Type;
+	size_t	ele_size = Types_GetSizeOf(ele);
+	size_t	count = 0, space = 0;
+	uint8_t	*data = NULL;
+	tAST_Node	*ret = NULL;	// (Set if there was a non-constant element)
+
+	if( SyntaxAssert(Parser, GetToken(Parser), TOK_BRACE_OPEN) )
+		return NULL;
+	do {
+		if(GetToken(Parser) == TOK_BRACE_CLOSE)
+			break;
+		PutBack(Parser);
+		tAST_Node *val = Parse_BracedValue(Parser);
+		if(!val)
+			goto _err;
+
+		int64_t	cval;
+		if( !ret && val->Type != NODETYPE_BLOCK && ConstEval_TryInteger(val, &cval) == 0 )
+		{
+			if( count == space ) {
+				space = (space ? space * 2 : 64);
+				data = realloc(data, space * ele_size);
+			}
+			// (little endian, like all the targets)
+			for( size_t i = 0; i < ele_size; i ++ )
+				data[count*ele_size + i] = (uint64_t)cval >> (i*8);
+			count ++;
+			if( val->Type == NODETYPE_INTEGER )
+				AST_FreeNode(val);
+			continue ;
+		}
+
+		if( !ret )
+		{
+			ret = AST_NewCodeBlock();
+			for( size_t i = 0; i < count; i ++ )
+			{
+				uint64_t	v = 0;
+				for( size_t j = ele_size; j --; )
+					v = (v << 8) | data[i*ele_size + j];
+				AST_AppendNode(ret, AST_NewInteger(v));
+			}
+		}
+		AST_AppendNode(ret, val);
+	} while(GetToken(Parser) == TOK_COMMA);
+	if( SyntaxAssert(Parser, Parser->Cur.Token, TOK_BRACE_CLOSE) )
+		goto _err;
+
+	if( ret ) {
+		free(data);
+		return ret;
+	}
+	DEBUG("Blob of %zi elements", count);
+	return AST_NewBlob(ele, data, count * ele_size);
+_err:
+	free(data);
+	return NULL;
+}
+
+int Parse_DoDefinition_VarActual(tParser *Parser, const tType *Type, enum eLinkage Linkage, const char *Name, tAST_Node *CodeNode)
 {
 	DEBUG("Name='%s'", Name);
 	
-	// TODO: Get linkage from Parse_GetType
-	enum eLinkage	linkage = LINKAGE_GLOBAL;
 	// TODO: Arrays (need to propagate nodes from Parse_GetType)
 	
 	tAST_Node	*init_value = NULL;
 	if( GetToken(Parser) == TOK_ASSIGNEQU )
 	{
-		init_value = Parse_BracedValue(Parser);
+		const tType	*ele = (Type->Class == TYPECLASS_ARRAY ? Type->Array.Type : NULL);
+		if( ele && LookAhead(Parser) == TOK_BRACE_OPEN
+		 && ((ele->Class == TYPECLASS_INTEGER && ele->Integer.Size != INTSIZE_BOOL) || ele->Class == TYPECLASS_ENUM) )
+			init_value = Parse_ConstantArray(Parser, Type);
+		else
+			init_value = Parse_BracedValue(Parser);
 		if( !init_value )
 			return 1;
+		if( Linkage == LINKAGE_EXTERNAL && CodeNode ) {
+			SyntaxError(Parser, "Block scope extern '%s' can't be initialised", Name);
+			return 1;
+		}
+		// `extern int x = 1;` is a definition
+		if( Linkage == LINKAGE_EXTERNAL )
+			Linkage = LINKAGE_GLOBAL;
 	}
 	else
 	{
 		PutBack(Parser);
 	}
+
+	// `int a[] = {...}` takes its size from the initialiser
+	if( Type->Class == TYPECLASS_ARRAY && Type->Array.Count == (size_t)-1 && init_value )
+	{
+		size_t	count = 0;
+		switch( init_value->Type )
+		{
+		case NODETYPE_BLOB:
+			count = init_value->Blob.Length / Types_GetSizeOf(Type->Array.Type);
+			break;
+		case NODETYPE_STRING:
+			count = init_value->String.Length + 1;
+			break;
+		case NODETYPE_BLOCK:
+			for( tAST_Node *val = init_value->CodeBlock.FirstStatement; val; val = val->NextSibling )
+				count ++;
+			break;
+		default:
+			break;
+		}
+		Type = Types_CreateArrayType(Type->Array.Type, count);
+	}
+	
+	tSymbol	*global = NULL;
+	if( CodeNode && Linkage != LINKAGE_GLOBAL )
+	{
+		// Block scope static/extern: the storage is a global, the local only names it
+		if( Linkage == LINKAGE_STATIC )
+		{
+			char	global_name[strlen(Name) + 16];
+			snprintf(global_name, sizeof(global_name), "%s.%i", Name, giParse_StaticCount ++);
+			Symbol_AddGlobalVariable(Type, LINKAGE_STATIC, global_name, init_value);
+			global = Symbol_ResolveSymbol(global_name);
+		}
+		else
+		{
+			Symbol_AddGlobalVariable(Type, LINKAGE_EXTERNAL, Name, NULL);
+			global = Symbol_ResolveSymbol(Name);
+		}
+		init_value = NULL;
+	}
 	
 	if( CodeNode )
 	{
@@ -817,19 +954,22 @@ int Parse_DoDefinition_VarActual(tParser *Parser, const tType *Type, const char
 		//AST_AppendNode(CodeNode, ret);
 		tSymbol	*sym = malloc( sizeof(tSymbol) + strlen(Name) + 1 );
 		sym->Next = NULL;
-		sym->Linkage = linkage;
+		sym->Linkage = Linkage;
 		sym->Name = (char*)(sym + 1);
 		strcpy( (char*)sym->Name, Name );
 		sym->Type = Type;
 		sym->Line = Parser->Cur.Line;
 		sym->Offset = 0;
 		sym->Value = init_value;
+		sym->bReadOnly = false;
+		sym->bDirectOnly = false;
+		sym->Global = global;
 		
 		AST_AppendNode(CodeNode, AST_NewLocalVar(sym));
 	}
 	else
 	{
-		Symbol_AddGlobalVariable(Type, linkage, Name, init_value);
+		Symbol_AddGlobalVariable(Type, Linkage, Name, init_value);
 	}
 	DEBUG("<<<");
 	return 0;
@@ -873,7 +1013,11 @@ tAST_Node *DoStatement(tParser *Parser, tAST_Node *CodeNode)
 	tAST_Node	*ret;
 	DEBUG("");
 
-	switch(GetToken(Parser))
+	enum eTokens	tok = GetToken(Parser);
+	// A `#pragma unroll` only applies to the statement that follows it
+	 int	unroll = Parser->UnrollHint;
+	Parser->UnrollHint = 0;
+	switch(tok)
 	{
 	case TOK_EOF:
 		return NULL;
@@ -887,7 +1031,10 @@ tAST_Node *DoStatement(tParser *Parser, tAST_Node *CodeNode)
 		return DoIf(Parser);
 
 	case TOK_RWORD_FOR:
-		return DoFor(Parser);
+		ret = DoFor(Parser);
+		if( ret )
+			ret->For.Unroll = unroll;
+		return ret;
 	case TOK_RWORD_WHILE:
 		return DoWhile(Parser);
 	case TOK_RWORD_DO:
@@ -1670,14 +1817,34 @@ tAST_Node *GetIdent(tParser *Parser)
 /**
  * \fn tAST_Node *GetNumeric()
  * \brief Reads a numeric value
+ *
+ * The type is the first of int, long and long long that can hold the value
+ * (hex and octal constants can also be the unsigned versions).
  */
 tAST_Node *GetNumeric(tParser *Parser)
 {
+	const enum eIntegerSize	sizes[] = {INTSIZE_INT, INTSIZE_LONG, INTSIZE_LONGLONG};
 	// Check token
 	if( SyntaxAssert(Parser, GetToken(Parser), TOK_CONST_NUM) )
 		return NULL;
 
-	return AST_NewInteger( Parser->Cur.Integer );
+	uint64_t	val = Parser->Cur.Integer;
+	tAST_Node	*ret = AST_NewInteger(val);
+	ret->Integer.Type = Types_CreateIntegerType(false, INTSIZE_LONGLONG);
+	for( int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i ++ )
+	{
+		const tType	*type = Types_CreateIntegerType(true, sizes[i]);
+		 int	bits = Types_GetSizeOf(type) * 8;
+		if( val < (1ULL << (bits-1)) ) {
+			ret->Integer.Type = type;
+			break;
+		}
+		if( !Parser->Cur.bDecimal && (bits == 64 || val < (1ULL << bits)) ) {
+			ret->Integer.Type = Types_CreateIntegerType(false, sizes[i]);
+			break;
+		}
+	}
+	return ret;
 }
 
 tAST_Node *GetSizeof(tParser *Parser)
@@ -14,10 +14,13 @@
 #include <ctype.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <limits.h>
 #include <parser.h>
+#include <ast.h>
 
 // === PROTOTYPES ===
 enum eTokens	GetToken_Int(tParser *Parser);
+void	Parse_int_Pragma(tParser *Parser);
 bool	is_ident(char ch);
 void	Parse_MoveState(struct sParser_State *Dst, struct sParser_State *Src);
 
@@ -80,6 +83,7 @@ enum eTokens GetToken(tParser *Parser)
 	{
 		Parse_MoveState(&Parser->Cur, &Parser->Next);
 		DEBUG("Fast ret %s", csaTOKEN_NAMES[Parser->Cur.Token]);
+		AST_SetPosition(Parser->Cur.Filename, Parser->Cur.Line);
 		return Parser->Cur.Token;
 	}
 	
@@ -95,8 +99,15 @@ enum eTokens GetToken(tParser *Parser)
 		}
 		if( ret == TOK_HASH )
 		{
+			// #pragma
+			if( GetToken_Int(Parser) == TOK_IDENT ) {
+				Parse_int_Pragma(Parser);
+				while( Parser->Cur.Token != TOK_NEWLINE )
+					GetToken_Int(Parser);
+				continue ;
+			}
 			// Integer
-			if( GetToken_Int(Parser) != TOK_CONST_NUM ) {
+			if( Parser->Cur.Token != TOK_CONST_NUM ) {
 				// ERROR!
 				while( Parser->Cur.Token != TOK_NEWLINE )
 					GetToken_Int(Parser);
@@ -120,9 +131,38 @@ enum eTokens GetToken(tParser *Parser)
 				GetToken_Int(Parser);
 		}
 	}
+	// New nodes are placed at the token that was just read
+	AST_SetPosition(Parser->Cur.Filename, Parser->Cur.Line);
 	return Parser->Cur.Token;
 }
 
+/**
+ * \brief Handle a `#pragma` line (the current token is the directive name)
+ *
+ * Only loop unrolling hints are understood, `#pragma unroll [N]` and
+ * `#pragma GCC unroll N`. The rest of the line is skipped by the caller.
+ */
+void Parse_int_Pragma(tParser *Parser)
+{
+	#define IS_WORD(str)	(Parser->Cur.Token == TOK_IDENT && Parser->Cur.TokenLen == sizeof(str)-1 \
+		&& memcmp(Parser->Cur.TokenStart, str, sizeof(str)-1) == 0)
+	if( !IS_WORD("pragma") )
+		return ;
+	GetToken_Int(Parser);
+	if( IS_WORD("GCC") )
+		GetToken_Int(Parser);
+	if( !IS_WORD("unroll") )
+		return ;
+	if( GetToken_Int(Parser) != TOK_CONST_NUM )
+		Parser->UnrollHint = FOR_UNROLL_FULL;
+	// (0 and 1 both mean "don't unroll")
+	else if( Parser->Cur.Integer <= 1 )
+		Parser->UnrollHint = 1;
+	else
+		Parser->UnrollHint = (Parser->Cur.Integer > INT_MAX ? INT_MAX : Parser->Cur.Integer);
+	#undef IS_WORD
+}
+
 enum eTokens GetToken_Int(tParser *Parser)
 {
 	char last_ch;
@@ -460,12 +500,18 @@ enum eTokens GetToken_Int(tParser *Parser)
 		{
 			// Hex
 			fscanf(Parser->FP, "%llx", &Parser->Cur.Integer);
+			Parser->Cur.bDecimal = false;
 			// TODO: Float (look for a .)
 		}
 		else {
+			// Octal (read by hand, fscanf would skip whitespace after a lone '0')
+			Parser->Cur.Integer = 0;
+			while( '0' <= ch && ch <= '7' ) {
+				Parser->Cur.Integer = Parser->Cur.Integer * 8 + (ch - '0');
+				ch = fgetc(Parser->FP);
+			}
 			ungetc(ch, Parser->FP);
-			// Octal
-			fscanf(Parser->FP, "%llo", &Parser->Cur.Integer);
+			Parser->Cur.bDecimal = false;
 			// TODO: Float
 		}
 		token = TOK_CONST_NUM;
@@ -474,6 +520,7 @@ enum eTokens GetToken_Int(tParser *Parser)
 		ungetc(ch, Parser->FP);
 		// Decimal / float
 		fscanf(Parser->FP, "%lld", &Parser->Cur.Integer);
+		Parser->Cur.bDecimal = true;
 		// TODO: Float
 		token = TOK_CONST_NUM;
 		break;
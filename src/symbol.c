@@ -25,7 +25,7 @@ tType	*Symbol_CreateIntegralType(int bSigned, int bConst, int Linkage, int Size,
 //tSymbol	*Symbol_ResolveSymbol(const char *Name);
  int	Symbol_GetSymClass(tSymbol *Symbol);
 // int	Symbol_AddGlobalVariable(tType *Type, enum eLinkage Linkage, const char *Name, tAST_Node *InitValue);
-// int	Symbol_AddFunction(tType *Type, enum eLinkage Linkage, const char *Name, tAST_Node *Code);
+// int	Symbol_AddFunction(tType *Type, enum eLinkage Linkage, const char *Name, char **ArgNames, tAST_Node *Code);
 void	Symbol_SetFunction(tFunction *Fcn);
 void	Symbol_SetFunctionCode(tFunction *Fcn, void *Block);
 void	Symbol_DumpTree(void);
@@ -110,10 +110,18 @@ int Symbol_AddGlobalVariable(const tType *Type, enum eLinkage Linkage, const cha
 {
 	for( tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
 	{
-		// TODO: Linkage checks?
-		if( strcmp(Name, sym->Name) == 0 ) {
-			return 1;
+		if( strcmp(Name, sym->Name) != 0 )
+			continue ;
+		// `extern` declarations can be repeated, and are completed by the definition
+		if( Linkage == LINKAGE_EXTERNAL )
+			return 0;
+		if( sym->Linkage == LINKAGE_EXTERNAL ) {
+			sym->Linkage = Linkage;
+			sym->Type = Type;
+			sym->Value = InitValue;
+			return 0;
 		}
+		return 1;
 	}
 	tSymbol *new_sym = malloc( sizeof(tSymbol) + strlen(Name) + 1 );
 	new_sym->Linkage = Linkage;
@@ -123,19 +131,23 @@ int Symbol_AddGlobalVariable(const tType *Type, enum eLinkage Linkage, const cha
 	new_sym->Line = 0;	// TODO: Get line
 	new_sym->Offset = 0;	// not used yet
 	new_sym->Value = InitValue;
+	new_sym->bReadOnly = false;
+	new_sym->bDirectOnly = false;
+	new_sym->Global = NULL;
 
 	new_sym->Next = gpGlobalSymbols;
 	gpGlobalSymbols = new_sym;
 	return 0;
 }
 
-int Symbol_AddFunction(const tType *Type, enum eLinkage Linkage, const char *Name, tAST_Node *Code)
+int Symbol_AddFunction(const tType *Type, enum eLinkage Linkage, const char *Name, char **ArgNames, tAST_Node *Code)
 {
-	for( tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
+	 int	nargs = Type->Function->nArgs;
+	for( tFunction *fcn = gpFunctions; fcn; fcn = fcn->Next )
 	{
-		if( strcmp(Name, sym->Name) == 0 )
+		if( strcmp(Name, fcn->Sym.Name) == 0 )
 		{
-			if( Types_Compare(Type, sym->Type) ) {
+			if( Types_Compare(Type, fcn->Sym.Type) ) {
 				//SyntaxError(NULL, "Redefinition of %s as incomatible type", Name);
 				return 1;
 			}
@@ -144,27 +156,52 @@ int Symbol_AddFunction(const tType *Type, enum eLinkage Linkage, const char *Nam
 			// TODO: Check linkage
 			// 2. Existing doesn't have code (and adding code)
 			if( Code ) {
-				if( sym->Value ) {
+				if( fcn->Sym.Value ) {
 					//SyntaxError(NULL, "Redefinition of %s", Name);
 					return 1;
 				}
-				sym->Value = Code;
+				fcn->Sym.Value = Code;
+				// Names used by the definition override the prototype's
+				for( int i = 0; i < nargs; i ++ )
+					fcn->ArgNames[i] = (ArgNames ? ArgNames[i] : NULL);
 			}
-			return 1;
+			return 0;
 		}
 	}
+	for( tSymbol *sym = gpGlobalSymbols; sym; sym = sym->Next )
+	{
+		if( strcmp(Name, sym->Name) == 0 )
+			return 1;
+	}
 	
-	tSymbol *new_sym = malloc( sizeof(tSymbol) + strlen(Name) + 1 );
+	tFunction *fcn = malloc( sizeof(tFunction) + nargs*sizeof(char*) + strlen(Name) + 1 );
+	char	*name_buf = (char*)&fcn->ArgNames[nargs];
+	strcpy( name_buf, Name );
+	fcn->Next = NULL;
+	fcn->Linkage = Linkage;
+	fcn->IRM = NULL;
+	for( int i = 0; i < nargs; i ++ )
+		fcn->ArgNames[i] = (ArgNames ? ArgNames[i] : NULL);
+	
+	tSymbol *new_sym = &fcn->Sym;
 	new_sym->Linkage = Linkage;
-	new_sym->Name = (void*)(new_sym+1);
-	strcpy( (void*)(new_sym+1), Name );
+	new_sym->Name = name_buf;
 	new_sym->Type = Type;
 	new_sym->Line = 0;	// TODO: Get line
 	new_sym->Offset = 0;	// not used yet
 	new_sym->Value = Code;
+	new_sym->bReadOnly = false;
+	new_sym->bDirectOnly = false;
+	new_sym->Global = NULL;
 
 	new_sym->Next = gpGlobalSymbols;
 	gpGlobalSymbols = new_sym;
+
+	// Functions are kept in definition order
+	tFunction **pnp = &gpFunctions;
+	while( *pnp )
+		pnp = &(*pnp)->Next;
+	*pnp = fcn;
 	return 0;
 }
 
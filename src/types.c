@@ -14,6 +14,7 @@
 #include <assert.h>
 
 // === PROTOTYPES ===
+size_t	Types_int_PadToAlign(const tType *Type, size_t Size);
 
 // === GLOBALS ===
 tTypedef	*gpTypedefs = NULL;
@@ -25,6 +26,8 @@ tStruct	*gpStructures;
 tStruct	*gpUnions;
 tEnumValue	*gaEnumValues;
 tEnum	*gpEnums;
+const tTypeLayout	cTypes_DefaultLayout = {.LongSize = 4, .PointerSize = 4};
+const tTypeLayout	*gpTypeLayout = &cTypes_DefaultLayout;
 
 // === CODE ===
 const tType *Types_GetTypeFromName(const char *Name, size_t Len)
@@ -117,7 +120,6 @@ size_t max_size_t(size_t a, size_t b)
 
 size_t Types_GetSizeOf(const tType *Type)
 {
-	// TODO: machine sizes
 	switch(Type->Class)
 	{
 	case TYPECLASS_VOID:
@@ -129,7 +131,7 @@ size_t Types_GetSizeOf(const tType *Type)
 		case INTSIZE_CHAR:	return 1;
 		case INTSIZE_SHORT:	return 2;
 		case INTSIZE_INT:	return 4;
-		case INTSIZE_LONG:	return 4;
+		case INTSIZE_LONG:	return gpTypeLayout->LongSize;
 		case INTSIZE_LONGLONG:	return 8;
 		}
 		break;
@@ -145,19 +147,20 @@ size_t Types_GetSizeOf(const tType *Type)
 		}
 		break;
 	case TYPECLASS_POINTER:
-		return 4;
+		return gpTypeLayout->PointerSize;
 	case TYPECLASS_ARRAY:
 		return Type->Array.Count * Types_GetSizeOf(Type->Array.Type);
 	case TYPECLASS_STRUCTURE: {
-		size_t	ret = 0;
-		for(int i = 0; i < Type->StructUnion->nFields; i ++ )
-			ret += Types_GetSizeOf(Type->StructUnion->Entries[i].Type);
-		return ret; }
+		 int	n = Type->StructUnion->nFields;
+		if( n == 0 )
+			return 0;
+		size_t	ret = Types_GetFieldOffset(Type, n-1) + Types_GetSizeOf(Type->StructUnion->Entries[n-1].Type);
+		return Types_int_PadToAlign(Type, ret); }
 	case TYPECLASS_UNION: {
 		size_t	ret = 0;
 		for(int i = 0; i < Type->StructUnion->nFields; i ++ )
 			ret = max_size_t(ret, Types_GetSizeOf(Type->StructUnion->Entries[i].Type));
-		return ret; }
+		return Types_int_PadToAlign(Type, ret); }
 	case TYPECLASS_ENUM:
 		if( Type->Enum->Max == 0 )
 			return 0;
@@ -173,6 +176,73 @@ size_t Types_GetSizeOf(const tType *Type)
 	return 0;
 }
 
+/**
+ * \brief Get the alignment of a type's storage (its largest scalar)
+ */
+size_t Types_GetAlignOf(const tType *Type)
+{
+	switch(Type->Class)
+	{
+	case TYPECLASS_ARRAY:
+		return Types_GetAlignOf(Type->Array.Type);
+	case TYPECLASS_STRUCTURE:
+	case TYPECLASS_UNION: {
+		size_t	ret = 1;
+		for(int i = 0; i < Type->StructUnion->nFields; i ++ )
+			ret = max_size_t(ret, Types_GetAlignOf(Type->StructUnion->Entries[i].Type));
+		return ret; }
+	case TYPECLASS_FUNCTION:
+	case TYPECLASS_VOID:
+		return 1;
+	default: {
+		size_t	size = Types_GetSizeOf(Type);
+		if( size > 8 )
+			return 8;
+		// Round up to a power of two (long double is 10 bytes)
+		size_t	ret = 1;
+		while( ret < size )
+			ret *= 2;
+		return ret; }
+	}
+}
+
+/**
+ * \brief Get the offset of a field within a structure (always 0 for a union)
+ *
+ * Fields are packed unless the layout pads each one to its alignment.
+ */
+size_t Types_GetFieldOffset(const tType *Type, int Index)
+{
+	if( Type->Class == TYPECLASS_UNION )
+		return 0;
+	size_t	ofs = 0;
+	for( int i = 0; ; i ++ )
+	{
+		const tType	*ft = Type->StructUnion->Entries[i].Type;
+		if( gpTypeLayout->bAlignFields ) {
+			size_t	align = Types_GetAlignOf(ft);
+			ofs = (ofs + align - 1) / align * align;
+		}
+		if( i == Index )
+			return ofs;
+		ofs += Types_GetSizeOf(ft);
+	}
+}
+
+//! \brief Round a structure/union's size up to its alignment (so arrays of it stay aligned)
+size_t Types_int_PadToAlign(const tType *Type, size_t Size)
+{
+	if( !gpTypeLayout->bAlignFields )
+		return Size;
+	size_t	align = Types_GetAlignOf(Type);
+	return (Size + align - 1) / align * align;
+}
+
+void Types_SetLayout(const tTypeLayout *Layout)
+{
+	gpTypeLayout = Layout;
+}
+
 tType *Types_CreateVoid(void)
 {
 	tType	ret = {.Class=TYPECLASS_VOID};
@@ -372,8 +442,37 @@ tEnum *Types_GetEnum(const char *Tag, bool Create)
 }
 int Types_AddEnumValue(tEnum *Enum, const char *Name, uint64_t Value)
 {
-	//TODO("AddEnumValue");
-	return 1;
+	for( size_t i = 0; i < Enum->nValues; i ++ )
+	{
+		if( strcmp(Enum->Values[i].Name, Name) == 0 )
+			return 1;
+	}
+	Enum->Values = realloc(Enum->Values, (Enum->nValues+1)*sizeof(tEnumValue));
+	Enum->Values[Enum->nValues].Name = strdup(Name);
+	Enum->Values[Enum->nValues].Value = Value;
+	Enum->nValues ++;
+	if( Value > Enum->Max )
+		Enum->Max = Value;
+	Enum->IsPopulated = true;
+	return 0;
+}
+
+/**
+ * \brief Look up an enumeration constant by name (in any enum)
+ */
+bool Types_GetEnumValue(const char *Name, uint64_t *Value)
+{
+	for( tEnum *ele = gpEnums; ele; ele = ele->Next )
+	{
+		for( size_t i = 0; i < ele->nValues; i ++ )
+		{
+			if( strcmp(ele->Values[i].Name, Name) == 0 ) {
+				*Value = ele->Values[i].Value;
+				return true;
+			}
+		}
+	}
+	return false;
 }
 
 const tType *Types_ApplyQualifiers(const tType *SrcType, unsigned int Qualifiers)
@@ -454,7 +553,8 @@ int Types_Compare(const tType *T1, const tType *T2)
 		break;
 	case TYPECLASS_ARRAY:
 		CMPEXT(Types_Compare, Array.Type);
-		// TODO: Compare sizes
+		if( T1->Array.Count != T2->Array.Count )
+			return (T1->Array.Count < T2->Array.Count ? -1 : 1);
 		break;
 	case TYPECLASS_REAL:
 		CMPFLD(Real.Size);
@@ -0,0 +1,11 @@
+extern int opterr;
+int abs(int v);
+
+int main(int argc)
+{
+	if( opterr != 1 )	return 1;
+	opterr = 5;
+	if( opterr + abs(-40) != 45 )	return 2;
+	opterr = 1;
+	return 0;
+}
@@ -0,0 +1,40 @@
+int count;
+const char *last;
+
+int note(const char *s)
+{
+	last = s;
+	count = count + 1;
+	return count;
+}
+
+int pick(int a, int b)
+{
+	if( a )
+	{
+		if( b )
+			return note("both");
+		else
+			return note("first");
+	}
+	else
+	{
+		if( b )
+			return note("second");
+		else
+			return note("neither");
+	}
+}
+
+int main(int argc)
+{
+	pick(argc, 0);
+	pick(argc - 1, argc);
+	pick(argc - 1, argc - 1);
+	if( pick(argc, argc) - 4 )
+		return 1;
+	else if( note("done") - 5 )
+		return 2;
+	else
+		return 0;
+}
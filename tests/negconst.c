@@ -0,0 +1,41 @@
+int minus_one(int x)
+{
+	return -1;
+}
+
+int negate(int x)
+{
+	return -x;
+}
+
+int zero_minus(int x)
+{
+	return 0 - 5;
+}
+
+int main(int argc)
+{
+	int	a = -2147483647 - 1;
+	if( minus_one(3) != -1 )	return 1;
+	if( negate(7) != -7 )	return 2;
+	if( negate(-7) != 7 )	return 3;
+	if( zero_minus(1) != -5 )	return 4;
+	if( a + 2147483647 != -1 )	return 5;
+	if( -7 / 2 != -3 )	return 6;
+	if( -7 >> 1 != -4 )	return 7;
+	if( ~5 != -6 )	return 8;
+	if( -(0 - 3) != 3 )	return 9;
+	if( 0 - 3 * 4 != -12 )	return 10;
+	if( !(-1 < 0) )	return 11;
+	if( !((unsigned int)(-1) > 0) )	return 12;
+	if( (unsigned int)(-8) >> 1 != 2147483644 )	return 13;
+	if( (char)300 != 44 )	return 14;
+	if( (unsigned char)(-1) != 255 )	return 15;
+	if( (short)(-65537) != -1 )	return 16;
+	if( 0xFFFFFFFF != -1 )	return 17;
+	if( !(0xFFFFFFFF > 0) )	return 18;
+	if( (int)(4294967296 >> 1) != -2147483647 - 1 )	return 19;
+	if( -argc != -1 )	return 20;
+	if( argc * -3 != -3 )	return 21;
+	return 0;
+}
@@ -0,0 +1,36 @@
+int cl;
+int sp = 3;
+int byte;
+int dword = 4;
+int rip;
+int near;
+static int esi = 6;
+const int rel = 7;
+
+int rax(int v)
+{
+	return v + 1;
+}
+
+static int ebx(int v)
+{
+	return v * 2;
+}
+
+int word(int al)
+{
+	int	r8 = al + cl;
+	return r8 + sp;
+}
+
+int main(int argc)
+{
+	cl = argc;
+	byte = rax(cl) + dword;
+	rip = ebx(byte);
+	near = word(2) + esi + rel;
+	if( byte != 6 )	return 1;
+	if( rip != 12 )	return 2;
+	if( near != 19 )	return 3;
+	return 0;
+}
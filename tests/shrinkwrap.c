@@ -0,0 +1,60 @@
+int g;
+
+int side(int v)
+{
+	g = g + v;
+	return v + 1;
+}
+
+int early(int a, int b)
+{
+	int	r;
+	if( b == 0 )
+		return 0;
+	r = side(a);
+	if( r & 1 )
+		g = side(r + a);
+	return r + a;
+}
+
+int dispatch(int a, int b)
+{
+	int	r;
+	if( b == 0 )
+		return 0;
+	r = side(a);
+	switch( r & 7 )
+	{
+	case 0:
+		g = g + 1;
+	case 1:
+		g = g + 2;
+		break;
+	case 2:
+		g = g * 3;
+	case 3:
+		g = g - 4;
+		break;
+	case 4:
+		r = r + 5;
+	case 5:
+		g = g ^ 6;
+		break;
+	}
+	return r + a;
+}
+
+int main(int argc)
+{
+	int	sum = 0;
+	int	a;
+	for( a = 0; a < 9; a ++ )
+		sum = sum * 7 + early(a, a & 3);
+	if( sum != 3181038 )	return 1;
+	sum = 0;
+	for( a = 0; a < 9; a ++ )
+		sum = sum * 7 + dispatch(a, a & 3);
+	if( sum != 3265073 )	return 2;
+	if( g != 78 )	return 3;
+	return 0;
+}
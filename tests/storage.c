@@ -0,0 +1,57 @@
+extern int late;
+int total;
+
+static const int table[4] = {10, 20, 30, 40};
+static const int *const third = &table[2];
+
+struct pair
+{
+	int	a;
+	int	b;
+};
+static const struct pair both = {5, 6};
+static const int *const second_field = &both.b;
+
+int counter(int step)
+{
+	static int n = 100;
+	n = n + step;
+	return n;
+}
+
+int other_counter(int step)
+{
+	static int n;
+	n = n + step;
+	return n;
+}
+
+int add_total(int v)
+{
+	extern int total;
+	total = total + v;
+	return total;
+}
+
+int main(int argc)
+{
+	int	total = 1000;
+	if( counter(1) != 101 )	return 1;
+	if( counter(2) != 103 )	return 2;
+	if( other_counter(3) != 3 )	return 3;
+	if( counter(argc) != 104 )	return 4;
+	if( add_total(7) != 7 )	return 5;
+	{
+		extern int total;
+		total = total + 1;
+	}
+	if( total != 1000 )	return 6;
+	if( add_total(0) != 8 )	return 7;
+	if( *third != 30 )	return 8;
+	if( third[argc] != 40 )	return 9;
+	if( *second_field != 6 )	return 10;
+	if( late != 7 )	return 11;
+	return 0;
+}
+
+int late = 7;
@@ -0,0 +1,45 @@
+struct Mixed {
+	char	c;
+	int	i;
+	short	s;
+	long	l;
+	char	d;
+};
+
+struct Mixed gInit = {1, 2, 3, 4, 5};
+
+int offset(void *base, void *field)
+{
+	char	*b = base;
+	char	*f = field;
+	return f - b;
+}
+
+int main(int argc)
+{
+	struct Mixed	m = {6, 7, 8, 9, 10};
+	struct Mixed	arr[2];
+	int	wide = sizeof(long) == 8;
+
+	if( offset(&m, &m.i) != (wide ? 4 : 1) )
+		return 1;
+	if( offset(&m, &m.s) != (wide ? 8 : 5) )
+		return 2;
+	if( offset(&m, &m.l) != (wide ? 16 : 7) )
+		return 3;
+	if( offset(&m, &m.d) != (wide ? 24 : 11) )
+		return 4;
+	if( sizeof(struct Mixed) != (wide ? 32 : 12) )
+		return 5;
+	if( offset(&arr[0], &arr[1]) != sizeof(struct Mixed) )
+		return 6;
+	if( m.c != 6 || m.i != 7 || m.s != 8 || m.l != 9 || m.d != 10 )
+		return 7;
+	if( gInit.c != 1 || gInit.i != 2 || gInit.s != 3 || gInit.l != 4 || gInit.d != 5 )
+		return 8;
+	arr[1].l = argc;
+	arr[1].d = gInit.d;
+	if( arr[1].l + arr[1].d != argc + 5 )
+		return 9;
+	return 0;
+}
@@ -0,0 +1,119 @@
+int g;
+
+int side(int v)
+{
+	g = g + v;
+	return v + 1;
+}
+
+int classify(int a, int b)
+{
+	int	r = 0;
+	switch( a )
+	{
+	case 0:
+		r = 1;
+	case 1:
+		switch( b )
+		{
+		case 0:
+			r = r + 10;
+		case 1:
+			r = r + 20;
+			break;
+		case 2:
+			r = r + 30;
+		case 3:
+			r = r + 40;
+			break;
+		case 7:
+			return r + 1000;
+		default:
+			r = r + 50;
+		}
+	case 2:
+		r = r + 100;
+		break;
+	case 3:
+		switch( b )
+		{
+		case 1:
+		case 2:
+			r = 7;
+			break;
+		case 5:
+			r = 9;
+		}
+	case 4:
+		r = r * 3;
+		break;
+	default:
+		r = -1;
+	}
+	return r;
+}
+
+int pressure(int a, int b, int c)
+{
+	int	p = a * 1 + b - c * 2;
+	int	q = a * 2 + b - c * 3;
+	int	r = a * 3 + b - c * 4;
+	int	s = a * 4 + b - c * 5;
+	int	t = a * 5 + b - c * 6;
+	int	u = a * 6 + b - c * 7;
+	switch( c & 7 )
+	{
+	case 7:
+		return r | r;
+	case 2:
+		t = side(p & q);
+	case 3:
+		switch( r & 7 )
+		{
+		case 2:
+			switch( c & 7 )
+			{
+			case 0:
+				p = side(b - a);
+				s = a & a;
+			}
+			switch( p & 7 )
+			{
+			}
+		}
+	case 0:
+		switch( t & 7 )
+		{
+		case 4:
+			switch( q & 7 )
+			{
+			case 2:
+				u = side(u - c);
+			}
+			return q - p;
+		}
+	}
+	return p * 1 + q * 3 + r * 5 + s * 7 + t * 9 + u * 11;
+}
+
+int main(int argc)
+{
+	int	sum = 0;
+	int	a;
+	int	b;
+	for( a = 0; a < 6; a ++ )
+	{
+		for( b = 0; b < 9; b ++ )
+			sum = sum * 7 + classify(a, b);
+	}
+	if( sum != 251923271 )	return 1;
+	sum = 0;
+	for( a = 0; a < 9; a ++ )
+	{
+		for( b = 0; b < 9; b ++ )
+			sum = sum * 7 + pressure(a, b, a - b);
+	}
+	if( sum != 955129627 )	return 2;
+	if( g != 108 )	return 3;
+	return 0;
+}